@@ -31,6 +31,12 @@ LOCAL_MODULE:= tm
 LOCAL_MODULE_TAGS:= test
 include $(BUILD_HEAPTRACKED_EXECUTABLE)
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= tmbench.c
+LOCAL_MODULE:= tmbench
+LOCAL_MODULE_TAGS:= test
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
+
 else
 BUILD_HEAPTRACKED_SHARED_LIBRARY:=$(BUILD_SHARED_LIBRARY)
 BUILD_HEAPTRACKED_EXECUTABLE:= $(BUILD_EXECUTABLE)
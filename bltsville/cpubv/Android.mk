@@ -0,0 +1,82 @@
+#
+# Copyright (c) 2012,
+# Texas Instruments, Inc.
+#
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Texas Instruments, Inc. nor the names of its
+#       contributors may be used to endorse or promote products derived from
+#       this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+# THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+LOCAL_PATH:= $(call my-dir)
+
+# Open CPU implementation of BLTsville. It is installed next to the TI CPU
+# implementation and does not replace the libbltsville_cpu.so link.
+
+CPUBV_SRC_FILES := \
+	cpubv.c \
+	cpuparser.c \
+	cpufilter.c \
+	cpublit.c \
+	cpukernel.c
+
+CPUBV_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/../bltsville/include \
+	$(LOCAL_PATH)/../ocd/include
+
+CPUBV_CFLAGS := -Wall -Werror -O2 -fno-short-enums
+
+ifdef ARCH_ARM_HAVE_NEON
+    CPUBV_CFLAGS += -DARCH_ARM_HAVE_NEON
+endif
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= $(CPUBV_SRC_FILES)
+LOCAL_C_INCLUDES:= $(CPUBV_C_INCLUDES)
+LOCAL_CFLAGS:= $(CPUBV_CFLAGS)
+LOCAL_EXPORT_C_INCLUDE_DIRS:= $(CPUBV_C_INCLUDES)
+LOCAL_ARM_MODE:= arm
+
+LOCAL_SHARED_LIBRARIES:= \
+    libcutils \
+
+LOCAL_MODULE_TAGS:= optional
+LOCAL_MODULE:= libbltsville_cpubv
+LOCAL_MODULE_PATH:= $(TARGET_OUT_SHARED_LIBRARIES)/../vendor/lib
+
+include $(BUILD_SHARED_LIBRARY)
+
+# Host build of the same sources for the test and benchmark.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= $(CPUBV_SRC_FILES)
+LOCAL_C_INCLUDES:= $(CPUBV_C_INCLUDES)
+LOCAL_CFLAGS:= $(CPUBV_CFLAGS)
+LOCAL_EXPORT_C_INCLUDE_DIRS:= $(CPUBV_C_INCLUDES)
+
+LOCAL_MODULE:= libbltsville_cpubv_host
+LOCAL_MODULE_TAGS:= optional
+LOCAL_MULTILIB:= 32
+
+include $(BUILD_HOST_STATIC_LIBRARY)
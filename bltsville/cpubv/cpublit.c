@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpubv.h"
+
+
+/*******************************************************************************
+ * Tile buffers.
+ */
+
+#define TILE_ALIGN 64
+
+static inline size_t align_tile(size_t size)
+{
+	return (size + TILE_ALIGN - 1) & ~((size_t) TILE_ALIGN - 1);
+}
+
+/* Row of a destination tile. */
+static inline size_t row_bytes(struct cpublt *blt)
+{
+	return align_tile(blt->tilewidth * sizeof(uint32_t));
+}
+
+/* Whole destination tile. */
+static inline size_t block_bytes(struct cpublt *blt)
+{
+	return align_tile(blt->tilewidth * blt->tileheight * sizeof(uint32_t));
+}
+
+static inline bool unpremultiplied_alpha(const struct cpuformat *format)
+{
+	return !format->premultiplied && (format->comp[3].size != 0);
+}
+
+
+/*******************************************************************************
+ * Execution path.
+ */
+
+/* Computes the result of an operation that only depends on solid sources,
+ * returns false if it depends on the destination or on a real source. */
+static bool solid_result(struct cpublt *blt, uint32_t *color)
+{
+	uint32_t s = 0, p = 0, d = 0;
+
+	if (blt->dstused)
+		return false;
+
+	if (blt->srcused[0]) {
+		if (!blt->src[0].solid)
+			return false;
+		s = blt->src[0].color;
+	}
+
+	if (blt->srcused[1]) {
+		if (!blt->src[1].solid)
+			return false;
+		p = blt->src[1].color;
+	}
+
+	if (blt->blend)
+		blt->kernels->blend(&blt->blendparams, &s, &p, color, 1);
+	else
+		blt->kernels->rop(blt->rop, &s, &p, &d, color, 1);
+
+	return true;
+}
+
+/* A source with the destination format, read forward without scaling,
+ * is copied row by row. */
+static bool copy_source(struct cpublt *blt)
+{
+	struct cpusource *src;
+	int i;
+
+	if (blt->passthrough < 0)
+		return false;
+
+	src = &blt->src[blt->passthrough];
+	if (src->solid || src->transpose)
+		return false;
+
+	if ((src->surf.format.type != CPUFMT_RGB) ||
+	    (src->surf.format.ocdformat != blt->dst.format.ocdformat))
+		return false;
+
+	for (i = 0; i < 2; i += 1)
+		if ((src->axis[i].taps != 0) || src->axis[i].reverse)
+			return false;
+
+	return true;
+}
+
+void plan_tiles(struct cpublt *blt)
+{
+	unsigned int width, height, rows;
+	uint32_t color;
+	bool transpose = false;
+	size_t size;
+	int i;
+
+	blt->tilecount = 0;
+	blt->scratchsize = 0;
+
+	if (blt->path == CPUPATH_NOP)
+		return;
+
+	if (solid_result(blt, &color)) {
+		if (unpremultiplied_alpha(&blt->dst.format))
+			cpu_unpremultiply(&color, 1);
+
+		blt->fill = 0;
+		blt->kernels->pack(&blt->dst.format, &color, &blt->fill, 1);
+		blt->path = CPUPATH_FILL;
+	} else if (copy_source(blt)) {
+		blt->path = CPUPATH_COPY;
+	}
+
+	if (blt->path == CPUPATH_GENERIC)
+		for (i = 0; i < 2; i += 1)
+			if (blt->srcused[i] && !blt->src[i].solid &&
+			    blt->src[i].transpose)
+				transpose = true;
+
+	width = blt->cliprect.right - blt->cliprect.left;
+	height = blt->cliprect.bottom - blt->cliprect.top;
+
+	/* Sources read across the destination rows are resampled into
+	 * square tiles and transposed, everything else runs in bands. */
+	if (transpose) {
+		blt->tilewidth = CPU_SQUARE_TILE;
+		blt->tileheight = CPU_SQUARE_TILE;
+	} else {
+		blt->tilewidth = (width < CPU_BAND_WIDTH)
+			       ? width : CPU_BAND_WIDTH;
+		blt->tileheight = CPU_BAND_PIXELS / blt->tilewidth;
+	}
+
+	if (blt->tilewidth > width)
+		blt->tilewidth = width;
+	if (blt->tileheight > height)
+		blt->tileheight = height;
+
+	blt->tilecols = (width + blt->tilewidth - 1) / blt->tilewidth;
+	rows = (height + blt->tileheight - 1) / blt->tileheight;
+	blt->tilecount = blt->tilecols * rows;
+
+	if (blt->path != CPUPATH_GENERIC)
+		return;
+
+	/* Scratch memory of one tile, carved in the same order by
+	 * render_tile(). */
+	size = 0;
+	for (i = 0; i < 2; i += 1) {
+		if (!blt->srcused[i])
+			continue;
+
+		if (blt->src[i].solid) {
+			size += row_bytes(blt);
+		} else {
+			size += source_scratch(blt, i);
+			size += blt->src[i].transpose
+			      ? 2 * block_bytes(blt)
+			      : row_bytes(blt);
+		}
+	}
+
+	if (blt->dstused)
+		size += row_bytes(blt);
+
+	blt->scratchsize = size + row_bytes(blt);
+}
+
+
+/*******************************************************************************
+ * Tile processing.
+ */
+
+static void fill_tile(struct cpublt *blt, int left, int top,
+		      unsigned int width, unsigned int height)
+{
+	struct cpusurface *dst = &blt->dst;
+	unsigned int bytespp = dst->format.bitspp / 8;
+	unsigned char *row;
+	unsigned int y;
+
+	row = dst->plane[0] + top * dst->stride[0] + left * bytespp;
+	for (y = 0; y < height; y += 1, row += dst->stride[0])
+		blt->kernels->fill(row, blt->fill, bytespp, width);
+}
+
+static void copy_tile(struct cpublt *blt, int left, int top,
+		      unsigned int width, unsigned int height)
+{
+	struct cpusurface *dst = &blt->dst;
+	struct cpusource *src = &blt->src[blt->passthrough];
+	unsigned int bytespp = dst->format.bitspp / 8;
+	const unsigned char *srcrow;
+	unsigned char *dstrow;
+	unsigned int y;
+
+	srcrow = src->surf.plane[0]
+	       + (src->axis[1].lo + top - dst->physrect.top)
+			* src->surf.stride[0]
+	       + (src->axis[0].lo + left - dst->physrect.left) * bytespp;
+	dstrow = dst->plane[0] + top * dst->stride[0] + left * bytespp;
+
+	/* An identity copy of the destination onto itself. */
+	if (srcrow == dstrow)
+		return;
+
+	for (y = 0; y < height; y += 1) {
+		memcpy(dstrow, srcrow, width * bytespp);
+		srcrow += src->surf.stride[0];
+		dstrow += dst->stride[0];
+	}
+}
+
+static void render_tile(struct cpublt *blt, struct cpuscratch *scratch,
+			int left, int top,
+			unsigned int width, unsigned int height)
+{
+	const struct cpukernels *kernels = blt->kernels;
+	struct cpusurface *dst = &blt->dst;
+	unsigned int bytespp = dst->format.bitspp / 8;
+	struct cpusampler sampler[2];
+	uint32_t *buffer[2] = { NULL, NULL };
+	const uint32_t *s[2];
+	uint32_t *dstrow = NULL, *outrow, *tbuf;
+	const uint32_t *result;
+	unsigned char *next = (unsigned char *) scratch->mem;
+	unsigned char *row;
+	unsigned int x, y, j;
+	bool unpremultiply;
+	int i;
+
+	/* Per source setup. */
+	for (i = 0; i < 2; i += 1) {
+		struct cpusource *src = &blt->src[i];
+
+		if (!blt->srcused[i])
+			continue;
+
+		if (src->solid) {
+			buffer[i] = (uint32_t *) next;
+			next += row_bytes(blt);
+
+			for (x = 0; x < width; x += 1)
+				buffer[i][x] = src->color;
+			continue;
+		}
+
+		next = (unsigned char *) sampler_init(&sampler[i], blt, i, next);
+
+		if (!src->transpose) {
+			buffer[i] = (uint32_t *) next;
+			next += row_bytes(blt);
+
+			sampler_tile(&sampler[i],
+				     left - dst->physrect.left, width);
+			continue;
+		}
+
+		/* Resample the source rows along the destination columns,
+		 * then turn them around. */
+		tbuf = (uint32_t *) next;
+		next += block_bytes(blt);
+		buffer[i] = (uint32_t *) next;
+		next += block_bytes(blt);
+
+		sampler_tile(&sampler[i], top - dst->physrect.top, height);
+		for (j = 0; j < width; j += 1)
+			sampler_row(&sampler[i],
+				    left - dst->physrect.left + j,
+				    tbuf + j * height);
+
+		kernels->transpose(tbuf, height, buffer[i], width,
+				   height, width);
+	}
+
+	if (blt->dstused) {
+		dstrow = (uint32_t *) next;
+		next += row_bytes(blt);
+	}
+
+	outrow = (uint32_t *) next;
+
+	unpremultiply = unpremultiplied_alpha(&dst->format);
+	row = dst->plane[0] + top * dst->stride[0] + left * bytespp;
+
+	for (y = 0; y < height; y += 1, row += dst->stride[0]) {
+		for (i = 0; i < 2; i += 1) {
+			struct cpusource *src = &blt->src[i];
+
+			if (!blt->srcused[i]) {
+				s[i] = outrow;
+			} else if (src->solid) {
+				s[i] = buffer[i];
+			} else if (src->transpose) {
+				s[i] = buffer[i] + y * width;
+			} else {
+				sampler_row(&sampler[i],
+					    top + y - dst->physrect.top,
+					    buffer[i]);
+				s[i] = buffer[i];
+			}
+		}
+
+		if (blt->dstused) {
+			kernels->unpack(&dst->format, row, dstrow, width);
+			if (!dst->format.premultiplied)
+				cpu_premultiply(dstrow, width);
+		}
+
+		if (blt->passthrough >= 0) {
+			result = s[blt->passthrough];
+		} else if (blt->blend) {
+			kernels->blend(&blt->blendparams, s[0], s[1],
+				       outrow, width);
+			result = outrow;
+		} else {
+			kernels->rop(blt->rop, s[0], s[1],
+				     blt->dstused ? dstrow : outrow,
+				     outrow, width);
+			result = outrow;
+		}
+
+		if (unpremultiply) {
+			if (result != outrow)
+				memcpy(outrow, result,
+				       width * sizeof(uint32_t));
+			cpu_unpremultiply(outrow, width);
+			result = outrow;
+		}
+
+		kernels->pack(&dst->format, result, row, width);
+	}
+}
+
+void do_tile(struct cpublt *blt, struct cpuscratch *scratch,
+	     unsigned int tile)
+{
+	int left, top, right, bottom;
+
+	left = blt->cliprect.left + (tile % blt->tilecols) * blt->tilewidth;
+	top = blt->cliprect.top + (tile / blt->tilecols) * blt->tileheight;
+
+	right = left + blt->tilewidth;
+	if (right > blt->cliprect.right)
+		right = blt->cliprect.right;
+
+	bottom = top + blt->tileheight;
+	if (bottom > blt->cliprect.bottom)
+		bottom = blt->cliprect.bottom;
+
+	switch (blt->path) {
+	case CPUPATH_FILL:
+		fill_tile(blt, left, top, right - left, bottom - top);
+		break;
+
+	case CPUPATH_COPY:
+		copy_tile(blt, left, top, right - left, bottom - top);
+		break;
+
+	case CPUPATH_GENERIC:
+		render_tile(blt, scratch, left, top,
+			    right - left, bottom - top);
+		break;
+
+	default:
+		break;
+	}
+}
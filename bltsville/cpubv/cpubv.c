@@ -0,0 +1,662 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpubv.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#if ANDROID
+#include <cutils/process_name.h>
+#endif
+
+char g_cpuerrorstr[128];
+
+
+/*******************************************************************************
+ * Float to normalized 8 bit, same rounding as the GC implementation.
+ */
+
+union cpufp {
+	struct {
+		unsigned int mantissa:23;
+		unsigned int exponent:8;
+		unsigned int sign:1;
+	} comp;
+
+	float value;
+};
+
+unsigned char cpufp2norm8(float value)
+{
+	union cpufp cpufp;
+	int exponent;
+	unsigned int mantissa;
+	int shift;
+
+	/* Get access to components. */
+	cpufp.value = value;
+
+	/* Clamp negatives. */
+	if (cpufp.comp.sign)
+		return 0;
+
+	/* Get unbiased exponent. */
+	exponent = (int) cpufp.comp.exponent - 127;
+
+	/* Clamp if too large. */
+	if (exponent >= 0)
+		return 255;
+
+	/* Clamp if too small. */
+	if (exponent < -8)
+		return 0;
+
+	/* Determine the shift value. */
+	shift = (23 - 8) - exponent;
+
+	/* Compute the mantissa. */
+	mantissa = (cpufp.comp.mantissa | 0x00800000) >> shift;
+
+	/* Normalize. */
+	mantissa = (mantissa * 255) >> 8;
+
+	return (unsigned char) mantissa;
+}
+
+
+/*******************************************************************************
+ * Thread pool.
+ */
+
+/* Workers are created on the first blt large enough to be split and stay
+ * around for the life of the process. One blt at a time uses the pool,
+ * blts issued concurrently from other threads run on the calling thread. */
+struct cpupool {
+	/* Held by the blt using the pool. */
+	pthread_mutex_t bltlock;
+
+	/* Work distribution. */
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation;
+	unsigned int participants;
+	unsigned int active;
+	bool quit;
+	struct cpublt *blt;
+	unsigned int nexttile;
+
+	/* Workers 1..workercount, index 0 is the calling thread. */
+	unsigned int workercount;
+	pthread_t worker[CPU_MAX_THREADS];
+	unsigned int seen[CPU_MAX_THREADS];
+	struct cpuscratch scratch[CPU_MAX_THREADS];
+};
+
+static struct cpupool g_pool = {
+	.bltlock = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.start = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+/* Threads per blt, 0 selects the default. */
+static unsigned int g_threads;
+static unsigned int g_defaultthreads = 1;
+
+static void run_tiles(struct cpublt *blt, struct cpuscratch *scratch,
+		      unsigned int *nexttile)
+{
+	unsigned int tile;
+
+	while ((tile = __sync_fetch_and_add(nexttile, 1)) < blt->tilecount)
+		do_tile(blt, scratch, tile);
+}
+
+static void *worker_main(void *arg)
+{
+	unsigned int index = (unsigned int) (uintptr_t) arg;
+	unsigned int seen;
+	struct cpublt *blt;
+
+	pthread_mutex_lock(&g_pool.lock);
+	seen = g_pool.seen[index];
+
+	for (;;) {
+		while (!g_pool.quit && (g_pool.generation == seen))
+			pthread_cond_wait(&g_pool.start, &g_pool.lock);
+
+		if (g_pool.quit)
+			break;
+
+		seen = g_pool.generation;
+		if (index >= g_pool.participants)
+			continue;
+
+		blt = g_pool.blt;
+		pthread_mutex_unlock(&g_pool.lock);
+
+		run_tiles(blt, &g_pool.scratch[index], &g_pool.nexttile);
+
+		pthread_mutex_lock(&g_pool.lock);
+		g_pool.active -= 1;
+		if (g_pool.active == 0)
+			pthread_cond_signal(&g_pool.done);
+	}
+
+	pthread_mutex_unlock(&g_pool.lock);
+	return NULL;
+}
+
+/* Creates up to count workers, called with the blt lock held. Returns the
+ * number of workers available. */
+static unsigned int start_workers(unsigned int count)
+{
+	unsigned int index;
+
+#if ANDROID
+	/* The Android zygote process refuses to fork if there is
+	 * more than one thread present. */
+	if (strcmp(get_process_name(), "zygote") == 0)
+		return 0;
+#endif
+
+	while (g_pool.workercount < count) {
+		index = g_pool.workercount + 1;
+		g_pool.seen[index] = g_pool.generation;
+
+		if (pthread_create(&g_pool.worker[index], NULL, worker_main,
+				   (void *) (uintptr_t) index) != 0) {
+			CPUERR("failed to create worker thread.\n");
+			break;
+		}
+
+		g_pool.workercount += 1;
+	}
+
+	return (g_pool.workercount < count) ? g_pool.workercount : count;
+}
+
+static void stop_workers(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&g_pool.lock);
+	g_pool.quit = true;
+	pthread_cond_broadcast(&g_pool.start);
+	pthread_mutex_unlock(&g_pool.lock);
+
+	for (i = 1; i <= g_pool.workercount; i += 1)
+		pthread_join(g_pool.worker[i], NULL);
+
+	g_pool.workercount = 0;
+	g_pool.quit = false;
+}
+
+static bool grow_scratch(struct cpuscratch *scratch, size_t size)
+{
+	void *mem;
+
+	if (scratch->size >= size)
+		return true;
+
+	if (posix_memalign(&mem, 64, size) != 0)
+		return false;
+
+	free(scratch->mem);
+	scratch->mem = mem;
+	scratch->size = size;
+
+	return true;
+}
+
+/* The workers do not survive fork(). */
+static void fork_prepare(void)
+{
+	pthread_mutex_lock(&g_pool.bltlock);
+}
+
+static void fork_parent(void)
+{
+	pthread_mutex_unlock(&g_pool.bltlock);
+}
+
+static void fork_child(void)
+{
+	g_pool.workercount = 0;
+	pthread_mutex_unlock(&g_pool.bltlock);
+}
+
+static unsigned int thread_count(void)
+{
+	unsigned int threads = g_threads;
+
+	if (threads == 0)
+		threads = g_defaultthreads;
+
+	return (threads > CPU_MAX_THREADS) ? CPU_MAX_THREADS : threads;
+}
+
+void cpubv_set_threads(unsigned int threads)
+{
+	g_threads = threads;
+}
+
+
+/*******************************************************************************
+ * Blt execution.
+ */
+
+/* A source reading every destination pixel from the same location is
+ * processed in place, one row at a time. */
+static bool identity_source(struct cpublt *blt, struct cpusource *src)
+{
+	struct cpusurface *dst = &blt->dst;
+	int i;
+
+	if ((src->surf.format.type != CPUFMT_RGB) ||
+	    (src->surf.format.bitspp != dst->format.bitspp) ||
+	    (src->surf.plane[0] != dst->plane[0]) ||
+	    (src->surf.stride[0] != dst->stride[0]) ||
+	    src->transpose)
+		return false;
+
+	for (i = 0; i < 2; i += 1)
+		if ((src->axis[i].taps != 0) || src->axis[i].reverse)
+			return false;
+
+	return (src->axis[0].lo == dst->physrect.left) &&
+	       (src->axis[1].lo == dst->physrect.top);
+}
+
+static bool source_overlaps(struct cpublt *blt, struct cpusource *src)
+{
+	const unsigned char *s = (const unsigned char *) src->surf.desc->virtaddr;
+	const unsigned char *d = (const unsigned char *) blt->dst.desc->virtaddr;
+
+	return (s < d + blt->dst.desc->length) &&
+	       (d < s + src->surf.desc->length);
+}
+
+/* Copies a source that is modified by the blt, RGB sources up to the last
+ * row used. */
+static enum bverror take_snapshot(struct cpublt *blt, struct cpusource *src)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct bvbltparams *bvbltparams = blt->bvbltparams;
+	struct cpusurface *surf = &src->surf;
+	unsigned char *base = (unsigned char *) surf->desc->virtaddr;
+	unsigned char *snapshot;
+	size_t size;
+	int i;
+
+	if (surf->format.type == CPUFMT_RGB)
+		size = (size_t) (surf->physrect.bottom - 1) * surf->stride[0]
+		     + (size_t) surf->physrect.right
+			* (surf->format.bitspp / 8);
+	else
+		size = surf->desc->length;
+
+	snapshot = cpualloc(unsigned char, size);
+	if (snapshot == NULL) {
+		BVSETBLTERROR(BVERR_OOM, "failed to allocate source copy");
+		goto exit;
+	}
+
+	memcpy(snapshot, base, size);
+
+	for (i = 0; i < 3; i += 1)
+		if (surf->plane[i] != NULL)
+			surf->plane[i] = snapshot + (surf->plane[i] - base);
+
+	src->snapshot = snapshot;
+
+exit:
+	return bverror;
+}
+
+static void free_snapshots(struct cpublt *blt)
+{
+	int i;
+
+	for (i = 0; i < 2; i += 1) {
+		cpufree(blt->src[i].snapshot);
+		blt->src[i].snapshot = NULL;
+	}
+}
+
+static enum bverror execute(struct cpublt *blt)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct bvbltparams *bvbltparams = blt->bvbltparams;
+	struct cpuscratch scratch = { NULL, 0 };
+	unsigned int threads, workers, pixels, tile, i;
+
+	if (blt->tilecount == 0)
+		goto exit;
+
+	for (i = 0; i < 2; i += 1) {
+		struct cpusource *src = &blt->src[i];
+
+		if (!blt->srcused[i] || src->solid)
+			continue;
+
+		if (!source_overlaps(blt, src) || identity_source(blt, src))
+			continue;
+
+		bverror = take_snapshot(blt, src);
+		if (bverror != BVERR_NONE)
+			goto exit;
+	}
+
+	pixels = (blt->cliprect.right - blt->cliprect.left)
+	       * (blt->cliprect.bottom - blt->cliprect.top);
+
+	threads = (pixels < CPU_MIN_PARALLEL) ? 1 : thread_count();
+	if (threads > blt->tilecount)
+		threads = blt->tilecount;
+
+	/* Another blt is using the pool, run on this thread. */
+	if (pthread_mutex_trylock(&g_pool.bltlock) != 0) {
+		if (!grow_scratch(&scratch, blt->scratchsize)) {
+			BVSETBLTERROR(BVERR_OOM,
+				      "failed to allocate scratch memory");
+			goto exit;
+		}
+
+		for (tile = 0; tile < blt->tilecount; tile += 1)
+			do_tile(blt, &scratch, tile);
+
+		free(scratch.mem);
+		goto exit;
+	}
+
+	workers = (threads > 1) ? start_workers(threads - 1) : 0;
+
+	for (i = 0; i <= workers; i += 1)
+		if (!grow_scratch(&g_pool.scratch[i], blt->scratchsize))
+			break;
+
+	if (i == 0) {
+		pthread_mutex_unlock(&g_pool.bltlock);
+		BVSETBLTERROR(BVERR_OOM, "failed to allocate scratch memory");
+		goto exit;
+	}
+
+	workers = i - 1;
+
+	if (workers == 0) {
+		for (tile = 0; tile < blt->tilecount; tile += 1)
+			do_tile(blt, &g_pool.scratch[0], tile);
+	} else {
+		pthread_mutex_lock(&g_pool.lock);
+		g_pool.blt = blt;
+		g_pool.nexttile = 0;
+		g_pool.participants = workers + 1;
+		g_pool.active = workers;
+		g_pool.generation += 1;
+		pthread_cond_broadcast(&g_pool.start);
+		pthread_mutex_unlock(&g_pool.lock);
+
+		run_tiles(blt, &g_pool.scratch[0], &g_pool.nexttile);
+
+		pthread_mutex_lock(&g_pool.lock);
+		while (g_pool.active != 0)
+			pthread_cond_wait(&g_pool.done, &g_pool.lock);
+		g_pool.blt = NULL;
+		pthread_mutex_unlock(&g_pool.lock);
+	}
+
+	pthread_mutex_unlock(&g_pool.bltlock);
+
+exit:
+	free_snapshots(blt);
+	return bverror;
+}
+
+
+/*******************************************************************************
+ * Library constructor and destructor.
+ */
+
+void __attribute__((constructor)) bv_init(void)
+{
+	char *env;
+	long cpus;
+
+	env = getenv("CPUBV_THREADS");
+	if (env && (atol(env) > 0)) {
+		g_defaultthreads = atol(env);
+	} else {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		g_defaultthreads = (cpus > 0) ? cpus : 1;
+	}
+
+	if (g_defaultthreads > CPU_MAX_THREADS)
+		g_defaultthreads = CPU_MAX_THREADS;
+
+	pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+void __attribute__((destructor)) bv_exit(void)
+{
+	unsigned int i;
+
+	stop_workers();
+
+	for (i = 0; i < CPU_MAX_THREADS; i += 1) {
+		free(g_pool.scratch[i].mem);
+		g_pool.scratch[i].mem = NULL;
+		g_pool.scratch[i].size = 0;
+	}
+}
+
+
+/*******************************************************************************
+ * BLTsville interface.
+ */
+
+static pthread_mutex_t g_maplock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Handle returned for batches, every blt of a batch is executed when it is
+ * submitted. */
+static char g_batch;
+
+enum bverror bv_map(struct bvbuffdesc *bvbuffdesc)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct bvbuffmap *bvbuffmap;
+
+	if (bvbuffdesc == NULL) {
+		BVSETERROR(BVERR_BUFFERDESC, "bvbuffdesc is NULL");
+		goto exit;
+	}
+
+	if (bvbuffdesc->structsize < STRUCTSIZE(bvbuffdesc, map)) {
+		BVSETERROR(BVERR_BUFFERDESC_VERS, "argument has invalid size");
+		goto exit;
+	}
+
+	pthread_mutex_lock(&g_maplock);
+
+	/* The CPU accesses the buffer directly, the mapping only records
+	 * that the buffer is known to this implementation. */
+	for (bvbuffmap = bvbuffdesc->map; bvbuffmap != NULL;
+	     bvbuffmap = bvbuffmap->nextmap)
+		if (bvbuffmap->bv_unmap == bv_unmap)
+			goto unlock;
+
+	bvbuffmap = cpualloc(struct bvbuffmap, sizeof(struct bvbuffmap));
+	if (bvbuffmap == NULL) {
+		BVSETERROR(BVERR_OOM, "failed to allocate mapping");
+		goto unlock;
+	}
+
+	bvbuffmap->structsize = sizeof(struct bvbuffmap);
+	bvbuffmap->bv_unmap = bv_unmap;
+	bvbuffmap->handle = 0;
+	bvbuffmap->nextmap = bvbuffdesc->map;
+	bvbuffdesc->map = bvbuffmap;
+
+unlock:
+	pthread_mutex_unlock(&g_maplock);
+
+exit:
+	return bverror;
+}
+
+enum bverror bv_unmap(struct bvbuffdesc *bvbuffdesc)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct bvbuffmap *prev = NULL;
+	struct bvbuffmap *bvbuffmap;
+
+	if (bvbuffdesc == NULL) {
+		BVSETERROR(BVERR_BUFFERDESC, "bvbuffdesc is NULL");
+		goto exit;
+	}
+
+	if (bvbuffdesc->structsize < STRUCTSIZE(bvbuffdesc, map)) {
+		BVSETERROR(BVERR_BUFFERDESC_VERS, "argument has invalid size");
+		goto exit;
+	}
+
+	pthread_mutex_lock(&g_maplock);
+
+	/* Try to find our mapping. */
+	bvbuffmap = bvbuffdesc->map;
+	while (bvbuffmap != NULL) {
+		if (bvbuffmap->bv_unmap == bv_unmap)
+			break;
+		prev = bvbuffmap;
+		bvbuffmap = bvbuffmap->nextmap;
+	}
+
+	if (bvbuffmap != NULL) {
+		if (bvbuffmap->structsize < STRUCTSIZE(bvbuffmap, nextmap)) {
+			BVSETERROR(BVERR_BUFFERDESC_VERS,
+				   "unsupported bvbuffdesc version");
+			pthread_mutex_unlock(&g_maplock);
+			goto exit;
+		}
+
+		/* Remove our mapping. */
+		if (prev == NULL)
+			bvbuffdesc->map = bvbuffmap->nextmap;
+		else
+			prev->nextmap = bvbuffmap->nextmap;
+
+		cpufree(bvbuffmap);
+	}
+
+	pthread_mutex_unlock(&g_maplock);
+
+	/* Call other implementations. */
+	if (bvbuffdesc->map != NULL)
+		bverror = bvbuffdesc->map->bv_unmap(bvbuffdesc);
+
+exit:
+	return bverror;
+}
+
+enum bverror bv_blt(struct bvbltparams *bvbltparams)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct cpublt blt;
+
+	/* Verify blt parameters structure. */
+	if (bvbltparams == NULL) {
+		BVSETERROR(BVERR_BLTPARAMS_VERS, "bvbltparams is NULL");
+		goto exit;
+	}
+
+	if (bvbltparams->structsize < STRUCTSIZE(bvbltparams, callbackdata)) {
+		BVSETERROR(BVERR_BLTPARAMS_VERS, "argument has invalid size");
+		goto exit;
+	}
+
+	/* Reset the error message. */
+	bvbltparams->errdesc = NULL;
+
+	switch (bvbltparams->flags & BVFLAG_BATCH_MASK) {
+	case BVFLAG_BATCH_NONE:
+		break;
+
+	case BVFLAG_BATCH_BEGIN:
+		bvbltparams->batch = (struct bvbatch *) &g_batch;
+		break;
+
+	case BVFLAG_BATCH_CONTINUE:
+		if (bvbltparams->batch == NULL) {
+			BVSETBLTERROR(BVERR_BATCH, "batch is not initialized");
+			goto exit;
+		}
+		break;
+
+	case BVFLAG_BATCH_END:
+		if (bvbltparams->batch == NULL) {
+			BVSETBLTERROR(BVERR_BATCH, "batch is not initialized");
+			goto exit;
+		}
+
+		if ((bvbltparams->batchflags & BVBATCH_ENDNOP) != 0)
+			goto exit;
+		break;
+	}
+
+	memset(&blt, 0, sizeof(blt));
+	blt.kernels = cpu_kernels();
+
+	bverror = parse_blt(bvbltparams, &blt);
+	if (bverror != BVERR_NONE)
+		goto exit;
+
+	if ((bvbltparams->flags & BVFLAG_TESTPARAMS_NOP) != 0)
+		goto exit;
+
+	plan_tiles(&blt);
+
+	bverror = execute(&blt);
+	if (bverror != BVERR_NONE)
+		goto exit;
+
+	/* The blt is complete, report it right away. */
+	if (((bvbltparams->flags & BVFLAG_ASYNC) != 0) &&
+	    (bvbltparams->callbackfn != NULL))
+		bvbltparams->callbackfn(NULL, bvbltparams->callbackdata);
+
+exit:
+	return bverror;
+}
+
+enum bverror bv_cache(struct bvcopparams *copparams)
+{
+	/* Buffers are only accessed through the CPU caches. */
+	return BVERR_NONE;
+}
@@ -0,0 +1,520 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CPU implementation of the BLTsville API.
+ *
+ * Every blt is broken into destination tiles which are processed
+ * independently by a small pool of worker threads. Within a tile the
+ * sources are resampled one row at a time into a common intermediate
+ * pixel (premultiplied RGBA, 8 bits per component, red in the low byte),
+ * combined with a ROP or a blend and packed into the destination. The
+ * row kernels have scalar, SSE2 and NEON versions which produce identical
+ * results.
+ */
+
+#ifndef CPUBV_H
+#define CPUBV_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <bltsville.h>
+#include <bvinternal.h>
+#include <bverror.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*******************************************************************************
+ * Miscellaneous macros.
+ */
+
+#if ANDROID
+#include <cutils/log.h>
+#define CPUERR(...) \
+	LOGE(__VA_ARGS__)
+#else
+#define CPUERR(...) \
+	fprintf(stderr, "cpubv: " __VA_ARGS__)
+#endif
+
+#define cpualloc(type, size) \
+	(type *) malloc(size)
+
+#define cpufree(ptr) \
+	free(ptr)
+
+#define STRUCTSIZE(structptr, lastmember) \
+( \
+	(size_t) &structptr->lastmember + \
+	sizeof(structptr->lastmember) - \
+	(size_t) structptr \
+)
+
+/* Error strings are kept in a single buffer like the GC implementation
+ * does, they are meant for debugging rather than for the end user. */
+extern char g_cpuerrorstr[128];
+
+#define BVSETERROR(error, message, ...) \
+do { \
+	snprintf(g_cpuerrorstr, sizeof(g_cpuerrorstr), \
+		 message, ##__VA_ARGS__); \
+	bverror = error; \
+} while (0)
+
+#define BVSETBLTERROR(error, message, ...) \
+do { \
+	snprintf(g_cpuerrorstr, sizeof(g_cpuerrorstr), \
+		 message, ##__VA_ARGS__); \
+	bvbltparams->errdesc = g_cpuerrorstr; \
+	bverror = error; \
+} while (0)
+
+/* Largest rectangle dimension, keeps the 32.32 source positions and the
+ * intermediate products of the scaler within 64 bits. */
+#define CPU_MAX_DIM		32767
+
+/* Number of threads processing the tiles of one blt. */
+#define CPU_MAX_THREADS		8
+
+/* Blts smaller than this many pixels are not split between threads. */
+#define CPU_MIN_PARALLEL	16384
+
+/* Tile geometry: bands of rows when the sources are read along the
+ * destination rows, square tiles when they have to be transposed. */
+#define CPU_BAND_WIDTH		512
+#define CPU_BAND_PIXELS		16384
+#define CPU_SQUARE_TILE		64
+
+/* Resampling filter: up to 9 taps with 32 subpixel phases and
+ * coefficients in 2.14 fixed point, same as the GC320 filter blt. */
+#define CPU_MAX_TAPS		9
+#define CPU_PHASE_BITS		5
+#define CPU_PHASE_COUNT		(1 << CPU_PHASE_BITS)
+#define CPU_COEF_BITS		14
+#define CPU_COEF_ONE		(1 << CPU_COEF_BITS)
+
+/* Intermediate pixel components. */
+#define CPU_R(pixel)		((pixel) & 0xFF)
+#define CPU_G(pixel)		(((pixel) >> 8) & 0xFF)
+#define CPU_B(pixel)		(((pixel) >> 16) & 0xFF)
+#define CPU_A(pixel)		((pixel) >> 24)
+#define CPU_RGBA(r, g, b, a) \
+	((uint32_t) (r) | ((uint32_t) (g) << 8) | \
+	 ((uint32_t) (b) << 16) | ((uint32_t) (a) << 24))
+
+/* Rounded x / 255 for x in 0..255*255. */
+static inline unsigned int cpudiv255(unsigned int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+
+/*******************************************************************************
+ * Rotation angles.
+ */
+
+#define ROT_ANGLE_INVALID	-1
+#define ROT_ANGLE_0		0
+#define ROT_ANGLE_90		1
+#define ROT_ANGLE_180		2
+#define ROT_ANGLE_270		3
+
+
+/*******************************************************************************
+ * Surface formats.
+ */
+
+enum cpufmttype {
+	CPUFMT_RGB,
+	CPUFMT_YUV
+};
+
+enum cpuyuvstd {
+	CPUYUV_601,
+	CPUYUV_709
+};
+
+/* Placement of a component within a 16 or 32 bit RGB pixel, a component
+ * of size zero is not stored. */
+struct cpucomp {
+	unsigned char shift;
+	unsigned char size;
+};
+
+struct cpuformat {
+	/* Format identifier and class. */
+	enum ocdformat ocdformat;
+	enum cpufmttype type;
+
+	/* Bits per pixel of the first plane (the whole pixel for RGB, the
+	 * luma or the packed 4:2:2 pixel for YUV). */
+	unsigned int bitspp;
+
+	/* RGB components in R, G, B, A order. */
+	struct cpucomp comp[4];
+
+	/* Bits that do not belong to any component, written as ones. */
+	uint32_t fillmask;
+
+	/* RGB components are premultiplied by alpha. */
+	bool premultiplied;
+
+	/* YUV layout. */
+	struct {
+		enum cpuyuvstd std;
+		unsigned int planecount;
+		unsigned int xsample;
+		unsigned int ysample;
+
+		/* V precedes U (YVYU, VYUY, NV21, YV12). */
+		bool vfirst;
+
+		/* Packed 4:2:2 with luma in the even bytes (YUYV). */
+		bool yfirst;
+	} yuv;
+};
+
+
+/*******************************************************************************
+ * Parsed blt.
+ */
+
+/* Rectangle in physical (memory) coordinates. */
+struct cpurect {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+struct cpusurface {
+	struct bvbuffdesc *desc;
+	struct bvsurfgeom *geom;
+	struct cpuformat format;
+	int angle;
+
+	/* Physical dimensions of the surface. */
+	unsigned int physwidth;
+	unsigned int physheight;
+
+	/* Base address and stride of every plane. */
+	unsigned char *plane[3];
+	unsigned long stride[3];
+
+	/* Virtual and physical rectangles of the operation. */
+	struct bvrect rect;
+	struct cpurect physrect;
+};
+
+/* Mapping of one source axis onto the destination. Destination index u
+ * in 0..dspan-1 samples the source at lo + (u + 0.5) * span / dspan - 0.5
+ * or, if reverse is set, at the mirrored position. */
+struct cpuaxis {
+	int lo;
+	unsigned int span;
+	unsigned int dspan;
+	bool reverse;
+
+	/* 0 if the axis is not scaled, 1 for nearest sampling, otherwise the
+	 * number of taps of the resampling filter. */
+	unsigned int taps;
+	short coef[CPU_PHASE_COUNT * CPU_MAX_TAPS];
+};
+
+struct cpusource {
+	struct cpusurface surf;
+
+	/* Single pixel source replicated over the whole destination. */
+	bool solid;
+	uint32_t color;
+
+	/* Source rows run along the destination columns. */
+	bool transpose;
+
+	/* Source x and y axes. */
+	struct cpuaxis axis[2];
+
+	/* Longest span of source pixels needed for one resampled row. */
+	unsigned int spanmax;
+
+	/* Copy of the source taken when it overlaps the destination. */
+	void *snapshot;
+};
+
+/* Blend factors. */
+enum cpufactor {
+	CPUFACTOR_ZERO,
+	CPUFACTOR_ONE,
+	CPUFACTOR_C1,
+	CPUFACTOR_A1,
+	CPUFACTOR_C2,
+	CPUFACTOR_A2,
+	CPUFACTOR_INV_C1,
+	CPUFACTOR_INV_A1,
+	CPUFACTOR_INV_C2,
+	CPUFACTOR_INV_A2,
+	CPUFACTOR_MIN_INV_A1_A2,
+	CPUFACTOR_MIN_INV_A2_A1
+};
+
+/* Co = k1 x C1 + k2 x C2, Ao = k3 x A1 + k4 x A2, where C1 and A1 have
+ * been scaled by the global alpha. */
+struct cpublend {
+	enum cpufactor k1, k2, k3, k4;
+	unsigned char globalalpha;
+
+	/* Blend reduces to C1 + (1 - A1) x C2. */
+	bool src1over;
+};
+
+enum cpupath {
+	CPUPATH_GENERIC,
+	CPUPATH_FILL,
+	CPUPATH_COPY,
+	CPUPATH_NOP
+};
+
+struct cpublt {
+	struct bvbltparams *bvbltparams;
+	const struct cpukernels *kernels;
+
+	struct cpusurface dst;
+
+	/* Physical destination area written, the clipped physical rect. */
+	struct cpurect cliprect;
+
+	/* Sources, src[0] is S and src[1] is P in ROP terms. */
+	struct cpusource src[2];
+	bool srcused[2];
+	bool dstused;
+
+	/* Operation. */
+	bool blend;
+	unsigned short rop;
+	struct cpublend blendparams;
+
+	/* Source passed through unchanged (ROP 0xCC, 0xF0 or the SRC1 and
+	 * SRC2 blends), -1 if the operation has to be computed. */
+	int passthrough;
+
+	/* Execution path and fill value for CPUPATH_FILL. */
+	enum cpupath path;
+	uint32_t fill;
+
+	/* Tiling. */
+	unsigned int tilewidth;
+	unsigned int tileheight;
+	unsigned int tilecols;
+	unsigned int tilecount;
+
+	/* Per thread scratch memory needed by one tile. */
+	size_t scratchsize;
+};
+
+struct cpuscratch {
+	void *mem;
+	size_t size;
+};
+
+
+/*******************************************************************************
+ * Row kernels.
+ */
+
+/* One row of YUV source, luma sample i is at y[i * ystep] and the chroma
+ * samples of the pixel pair i / 2 at u and v[(i / 2) * uvstep]. */
+struct cpuyuvrow {
+	const unsigned char *y;
+	const unsigned char *u;
+	const unsigned char *v;
+	unsigned int ystep;
+	unsigned int uvstep;
+	enum cpuyuvstd std;
+};
+
+enum cpukernel {
+	CPUKERNEL_AUTO,
+	CPUKERNEL_SCALAR,
+	CPUKERNEL_NEON,
+	CPUKERNEL_SSE2
+};
+
+struct cpukernels {
+	enum cpukernel id;
+
+	/* RGB pixels to intermediate pixels and back. */
+	void (*unpack)(const struct cpuformat *format, const void *src,
+		       uint32_t *dst, unsigned int count);
+	void (*pack)(const struct cpuformat *format, const uint32_t *src,
+		     void *dst, unsigned int count);
+
+	/* YUV pixels x..x+count-1 of a row to intermediate pixels. */
+	void (*unpack_yuv)(const struct cpuyuvrow *row, unsigned int x,
+			   uint32_t *dst, unsigned int count);
+
+	/* Fill with a 16 or 32 bit pixel. */
+	void (*fill)(void *dst, uint32_t value, unsigned int bytespp,
+		     unsigned int count);
+
+	/* Ternary raster operation, S, P and D as in the ROP code. */
+	void (*rop)(unsigned int rop, const uint32_t *s, const uint32_t *p,
+		    const uint32_t *d, uint32_t *out, unsigned int count);
+
+	/* Classic blend of C1 (src1) and C2 (src2). */
+	void (*blend)(const struct cpublend *blend, const uint32_t *c1,
+		      const uint32_t *c2, uint32_t *out, unsigned int count);
+
+	/* Vertical filter pass, count intermediate pixels of taps rows into
+	 * 16 bit components. */
+	void (*vfilter)(const uint32_t * const *rows, const short *coef,
+			unsigned int taps, short *out, unsigned int count);
+
+	/* Horizontal filter pass, output pixel i uses the taps starting at
+	 * pixel start[i] of src with coefficient set phase[i]. */
+	void (*hfilter)(const short *src, const unsigned int *start,
+			const unsigned char *phase, const short *coef,
+			unsigned int taps, uint32_t *out, unsigned int count);
+
+	/* dst[x][y] = src[y][x], strides in pixels. */
+	void (*transpose)(const uint32_t *src, unsigned int srcstride,
+			  uint32_t *dst, unsigned int dststride,
+			  unsigned int width, unsigned int height);
+};
+
+const struct cpukernels *cpu_kernels(void);
+
+/* Conversions for surfaces that are not premultiplied. */
+void cpu_premultiply(uint32_t *pixels, unsigned int count);
+void cpu_unpremultiply(uint32_t *pixels, unsigned int count);
+
+/* Reads one pixel of a surface as an intermediate pixel. */
+uint32_t cpu_read_pixel(const struct cpusurface *surf, int x, int y);
+
+
+/*******************************************************************************
+ * Source sampling.
+ */
+
+/* Resampling state of one source for the tile being processed, carved
+ * from the scratch memory of the thread. Output pixel i of a sampled row
+ * is destination index first + i along the source x axis. */
+struct cpusampler {
+	const struct cpusource *src;
+	const struct cpukernels *kernels;
+
+	/* Source pixels spanlo..spanlo+spanlen-1 of a row are read. */
+	int spanlo;
+	unsigned int spanlen;
+
+	/* Unscaled forward rows are unpacked straight to the output. */
+	bool direct;
+
+	/* Horizontal sampling of the output pixels, relative to spanlo. */
+	unsigned int count;
+	unsigned int *start;
+	unsigned char *phase;
+
+	/* Least recently used cache of the unpacked source rows. */
+	unsigned int slotcount;
+	uint32_t *slot[CPU_MAX_TAPS + 1];
+	int slotrow[CPU_MAX_TAPS + 1];
+	unsigned int slotused[CPU_MAX_TAPS + 1];
+	unsigned int clock;
+
+	/* Vertical filter output. */
+	short *vspan;
+};
+
+
+/*******************************************************************************
+ * Internal entry points.
+ */
+
+/* cpuparser.c */
+enum bverror parse_blt(struct bvbltparams *bvbltparams, struct cpublt *blt);
+int get_angle(int orientation);
+
+/* cpufilter.c */
+void calculate_filter(struct cpuaxis *axis);
+void yuv_row(const struct cpusurface *surf, unsigned int y,
+	     struct cpuyuvrow *row);
+size_t source_scratch(struct cpublt *blt, int index);
+void *sampler_init(struct cpusampler *sampler, struct cpublt *blt,
+		   int index, void *mem);
+void sampler_tile(struct cpusampler *sampler,
+		  unsigned int first, unsigned int count);
+void sampler_row(struct cpusampler *sampler, unsigned int v, uint32_t *out);
+
+/* cpublit.c */
+void plan_tiles(struct cpublt *blt);
+void do_tile(struct cpublt *blt, struct cpuscratch *scratch,
+	     unsigned int tile);
+
+/* cpubv.c */
+unsigned char cpufp2norm8(float value);
+
+
+/*******************************************************************************
+ * Test hooks.
+ */
+
+/* Process wide kernel selection, returns false if the kernel is not built
+ * in or not supported by the cpu. */
+bool cpubv_set_kernel(enum cpukernel kernel);
+enum cpukernel cpubv_get_kernel(void);
+const char *cpubv_kernel_name(enum cpukernel kernel);
+
+/* Number of threads used per blt, 0 restores the default. */
+void cpubv_set_threads(unsigned int threads);
+
+
+/*******************************************************************************
+ * BLTsville API.
+ */
+
+void bv_init(void);
+void bv_exit(void);
+
+enum bverror bv_map(struct bvbuffdesc *buffdesc);
+enum bverror bv_unmap(struct bvbuffdesc *buffdesc);
+enum bverror bv_blt(struct bvbltparams *bltparams);
+enum bverror bv_cache(struct bvcopparams *copparams);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpubv.h"
+#include <math.h>
+
+
+/*******************************************************************************
+ * Resampling filter.
+ */
+
+/* Coefficient set of single tap sampling. */
+static const short g_identity[1] = { CPU_COEF_ONE };
+
+static double sinc(double x)
+{
+	x *= M_PI;
+	return sin(x) / x;
+}
+
+/* Lanczos style windowed sinc, the window covers the half width of the
+ * kernel. */
+static double sinc_filter(double x, unsigned int radius)
+{
+	if (x == 0.0)
+		return 1.0;
+
+	if (fabs(x) >= radius)
+		return 0.0;
+
+	return sinc(x) * sinc(x / radius);
+}
+
+void calculate_filter(struct cpuaxis *axis)
+{
+	unsigned int taps = axis->taps;
+	unsigned int half = taps >> 1;
+	unsigned int centre = (taps - 1) >> 1;
+	double weight[CPU_MAX_TAPS];
+	double scale, offset, x, sum;
+	short *coef;
+	unsigned int p, k, i;
+	int value, total, step;
+
+	/* Widen the kernel when downscaling so it covers every source
+	 * pixel that contributes to the destination pixel. */
+	scale = (axis->dspan < axis->span)
+	      ? (double) axis->dspan / axis->span
+	      : 1.0;
+
+	/* Odd kernels are centred on the nearest source pixel, even ones
+	 * start on the source pixel left of the sample position. */
+	offset = (taps & 1) ? 0.5 : 1.0;
+
+	for (p = 0; p < CPU_PHASE_COUNT; p += 1) {
+		coef = &axis->coef[p * taps];
+
+		sum = 0.0;
+		for (k = 0; k < taps; k += 1) {
+			x = ((double) k - half + offset
+			     - (double) p / CPU_PHASE_COUNT) * scale;
+			weight[k] = sinc_filter(x, half);
+			sum += weight[k];
+		}
+
+		/* Normalize and quantize. */
+		total = 0;
+		for (k = 0; k < taps; k += 1) {
+			value = (sum > 0.0)
+			      ? (int) lround(weight[k] / sum * CPU_COEF_ONE)
+			      : ((k == centre) ? CPU_COEF_ONE : 0);
+
+			if (value > CPU_COEF_ONE)
+				value = CPU_COEF_ONE;
+			else if (value < -CPU_COEF_ONE)
+				value = -CPU_COEF_ONE;
+
+			coef[k] = (short) value;
+			total += value;
+		}
+
+		/* Spread the rounding error over the centre taps so that
+		 * every set adds up to exactly one. */
+		for (i = 0; total != CPU_COEF_ONE; i += 1) {
+			k = (centre + taps + ((i & 1) ? -(int) ((i + 1) >> 1)
+						      : (int) (i >> 1)))
+			  % taps;
+			step = (total < CPU_COEF_ONE) ? 1 : -1;
+			coef[k] += step;
+			total += step;
+		}
+	}
+}
+
+/* Source pixel sampled by destination index u of an unscaled or nearest
+ * sampled axis. */
+static inline int sample_index(const struct cpuaxis *axis, unsigned int u)
+{
+	if (axis->reverse)
+		u = axis->dspan - 1 - u;
+
+	if (axis->taps == 0)
+		return axis->lo + (int) u;
+
+	return axis->lo + (int) (((uint64_t) (2 * u + 1) * axis->span)
+				 / (2 * (uint64_t) axis->dspan));
+}
+
+/* First source pixel and coefficient set of the filter at destination
+ * index u. */
+static inline int filter_start(const struct cpuaxis *axis, unsigned int u,
+			       unsigned int *phase)
+{
+	int64_t t;
+
+	if (axis->reverse)
+		u = axis->dspan - 1 - u;
+
+	/* Sample position plus one half in 32.32 fixed point, rounded to
+	 * the nearest phase. Even kernels use the position itself. */
+	t = (int64_t) ((((uint64_t) (2 * u + 1) * axis->span) << 31)
+		       / axis->dspan);
+	if ((axis->taps & 1) == 0)
+		t -= (int64_t) 1 << 31;
+	t += (int64_t) 1 << (31 - CPU_PHASE_BITS);
+
+	*phase = (unsigned int) (t >> (32 - CPU_PHASE_BITS))
+	       & (CPU_PHASE_COUNT - 1);
+
+	return axis->lo + (int) (t >> 32) - (int) (axis->taps >> 1)
+	     + (((axis->taps & 1) == 0) ? 1 : 0);
+}
+
+
+/*******************************************************************************
+ * Source rows.
+ */
+
+void yuv_row(const struct cpusurface *surf, unsigned int y,
+	     struct cpuyuvrow *row)
+{
+	const struct cpuformat *format = &surf->format;
+	const unsigned char *base, *swap;
+	unsigned int cy, cheight;
+
+	row->std = format->yuv.std;
+
+	if (format->yuv.planecount == 1) {
+		/* Packed 4:2:2, YUYV or UYVY with U and V swapped if V
+		 * comes first. */
+		base = surf->plane[0] + y * surf->stride[0];
+		if (format->yuv.yfirst) {
+			row->y = base;
+			row->u = base + 1;
+			row->v = base + 3;
+		} else {
+			row->y = base + 1;
+			row->u = base;
+			row->v = base + 2;
+		}
+		row->ystep = 2;
+		row->uvstep = 4;
+	} else {
+		row->y = surf->plane[0] + y * surf->stride[0];
+		row->ystep = 1;
+
+		/* The last luma row of an odd height uses the last chroma
+		 * row. */
+		cy = y / format->yuv.ysample;
+		cheight = surf->physheight / format->yuv.ysample;
+		if ((cheight > 0) && (cy >= cheight))
+			cy = cheight - 1;
+
+		base = surf->plane[1] + cy * surf->stride[1];
+		if (format->yuv.planecount == 2) {
+			row->u = base;
+			row->v = base + 1;
+			row->uvstep = 2;
+		} else {
+			row->u = base;
+			row->v = surf->plane[2] + cy * surf->stride[2];
+			row->uvstep = 1;
+		}
+	}
+
+	if (format->yuv.vfirst) {
+		swap = row->u;
+		row->u = row->v;
+		row->v = swap;
+	}
+}
+
+/* Unpacks source pixels x..x+count-1 of row y. */
+static void unpack_row(const struct cpukernels *kernels,
+		       const struct cpusurface *surf,
+		       int x, int y, uint32_t *dst, unsigned int count)
+{
+	struct cpuyuvrow row;
+
+	if (surf->format.type == CPUFMT_YUV) {
+		yuv_row(surf, y, &row);
+		kernels->unpack_yuv(&row, x, dst, count);
+		return;
+	}
+
+	kernels->unpack(&surf->format,
+			surf->plane[0] + y * surf->stride[0]
+				       + x * (surf->format.bitspp / 8),
+			dst, count);
+
+	if (!surf->format.premultiplied)
+		cpu_premultiply(dst, count);
+}
+
+uint32_t cpu_read_pixel(const struct cpusurface *surf, int x, int y)
+{
+	uint32_t pixel;
+
+	unpack_row(cpu_kernels(), surf, x, y, &pixel, 1);
+	return pixel;
+}
+
+/* Unpacks the tile span of source row y, replicating the edge pixels of
+ * the source rectangle for the filter taps that fall outside of it. */
+static void load_row(struct cpusampler *sampler, int y, uint32_t *dst)
+{
+	const struct cpuaxis *axis = &sampler->src->axis[0];
+	int lo = sampler->spanlo;
+	int hi = lo + (int) sampler->spanlen;
+	int first, last, i;
+
+	first = (lo > axis->lo) ? lo : axis->lo;
+	last = (hi < axis->lo + (int) axis->span)
+	     ? hi : axis->lo + (int) axis->span;
+
+	unpack_row(sampler->kernels, &sampler->src->surf,
+		   first, y, dst + (first - lo), last - first);
+
+	for (i = lo; i < first; i += 1)
+		dst[i - lo] = dst[first - lo];
+
+	for (i = last; i < hi; i += 1)
+		dst[i - lo] = dst[last - 1 - lo];
+}
+
+static const uint32_t *get_row(struct cpusampler *sampler, int y)
+{
+	const struct cpuaxis *axis = &sampler->src->axis[1];
+	unsigned int i, victim = 0;
+
+	/* Rows above and below the rectangle replicate its edges. */
+	if (y < axis->lo)
+		y = axis->lo;
+	else if (y >= axis->lo + (int) axis->span)
+		y = axis->lo + (int) axis->span - 1;
+
+	sampler->clock += 1;
+
+	for (i = 0; i < sampler->slotcount; i += 1) {
+		if (sampler->slotrow[i] == y) {
+			sampler->slotused[i] = sampler->clock;
+			return sampler->slot[i];
+		}
+
+		if (sampler->slotused[i] < sampler->slotused[victim])
+			victim = i;
+	}
+
+	load_row(sampler, y, sampler->slot[victim]);
+	sampler->slotrow[victim] = y;
+	sampler->slotused[victim] = sampler->clock;
+
+	return sampler->slot[victim];
+}
+
+
+/*******************************************************************************
+ * Sampler.
+ */
+
+#define SCRATCH_ALIGN 64
+
+static inline size_t align_scratch(size_t size)
+{
+	return (size + SCRATCH_ALIGN - 1) & ~((size_t) SCRATCH_ALIGN - 1);
+}
+
+static unsigned int slot_count(const struct cpusource *src)
+{
+	/* One row more than the vertical taps so the rows of the next
+	 * output row can be loaded without evicting the ones in use. */
+	return ((src->axis[1].taps > 1) ? src->axis[1].taps : 1) + 1;
+}
+
+/* Longest output run of the source within a tile. */
+static unsigned int tile_length(struct cpublt *blt, const struct cpusource *src)
+{
+	return src->transpose ? blt->tileheight : blt->tilewidth;
+}
+
+size_t source_scratch(struct cpublt *blt, int index)
+{
+	struct cpusource *src = &blt->src[index];
+	const struct cpuaxis *axis = &src->axis[0];
+	unsigned int length = tile_length(blt, src);
+	size_t size;
+
+	src->spanmax = (unsigned int) (((uint64_t) length * axis->span)
+				       / axis->dspan)
+		     + ((axis->taps > 1) ? axis->taps : 1) + 2;
+
+	size = slot_count(src)
+	     * align_scratch(src->spanmax * sizeof(uint32_t));
+	size += align_scratch(src->spanmax * 4 * sizeof(short));
+	size += align_scratch(length * sizeof(unsigned int));
+	size += align_scratch(length);
+
+	return size;
+}
+
+void *sampler_init(struct cpusampler *sampler, struct cpublt *blt,
+		   int index, void *mem)
+{
+	const struct cpusource *src = &blt->src[index];
+	unsigned int length = tile_length(blt, src);
+	unsigned char *next = (unsigned char *) mem;
+	unsigned int i;
+
+	sampler->src = src;
+	sampler->kernels = blt->kernels;
+
+	sampler->slotcount = slot_count(src);
+	for (i = 0; i < sampler->slotcount; i += 1) {
+		sampler->slot[i] = (uint32_t *) next;
+		next += align_scratch(src->spanmax * sizeof(uint32_t));
+	}
+
+	sampler->vspan = (short *) next;
+	next += align_scratch(src->spanmax * 4 * sizeof(short));
+
+	sampler->start = (unsigned int *) next;
+	next += align_scratch(length * sizeof(unsigned int));
+
+	sampler->phase = next;
+	next += align_scratch(length);
+
+	return next;
+}
+
+void sampler_tile(struct cpusampler *sampler,
+		  unsigned int first, unsigned int count)
+{
+	const struct cpuaxis *axis = &sampler->src->axis[0];
+	unsigned int i, phase;
+	int index, lo, hi;
+
+	sampler->count = count;
+	sampler->direct = (axis->taps == 0) && !axis->reverse;
+
+	lo = INT32_MAX;
+	hi = INT32_MIN;
+
+	for (i = 0; i < count; i += 1) {
+		if (axis->taps > 1) {
+			index = filter_start(axis, first + i, &phase);
+			sampler->phase[i] = (unsigned char) phase;
+		} else {
+			index = sample_index(axis, first + i);
+			sampler->phase[i] = 0;
+		}
+
+		sampler->start[i] = (unsigned int) index;
+
+		if (index < lo)
+			lo = index;
+		if (index > hi)
+			hi = index;
+	}
+
+	if (axis->taps > 1)
+		hi += axis->taps - 1;
+
+	for (i = 0; i < count; i += 1)
+		sampler->start[i] -= (unsigned int) lo;
+
+	sampler->spanlo = lo;
+	sampler->spanlen = hi - lo + 1;
+
+	/* The cached rows belong to the previous span. */
+	for (i = 0; i < sampler->slotcount; i += 1) {
+		sampler->slotrow[i] = -1;
+		sampler->slotused[i] = 0;
+	}
+	sampler->clock = 0;
+}
+
+void sampler_row(struct cpusampler *sampler, unsigned int v, uint32_t *out)
+{
+	const struct cpusource *src = sampler->src;
+	const struct cpukernels *kernels = sampler->kernels;
+	const struct cpuaxis *xaxis = &src->axis[0];
+	const struct cpuaxis *yaxis = &src->axis[1];
+	const uint32_t *rows[CPU_MAX_TAPS];
+	unsigned int i, phase;
+	int y;
+
+	if (yaxis->taps <= 1) {
+		y = sample_index(yaxis, v);
+
+		if (sampler->direct) {
+			load_row(sampler, y, out);
+			return;
+		}
+
+		rows[0] = get_row(sampler, y);
+
+		if (xaxis->taps <= 1) {
+			for (i = 0; i < sampler->count; i += 1)
+				out[i] = rows[0][sampler->start[i]];
+			return;
+		}
+
+		kernels->vfilter(rows, g_identity, 1,
+				 sampler->vspan, sampler->spanlen);
+	} else {
+		y = filter_start(yaxis, v, &phase);
+		for (i = 0; i < yaxis->taps; i += 1)
+			rows[i] = get_row(sampler, y + (int) i);
+
+		kernels->vfilter(rows, &yaxis->coef[phase * yaxis->taps],
+				 yaxis->taps, sampler->vspan, sampler->spanlen);
+
+		if (xaxis->taps <= 1) {
+			kernels->hfilter(sampler->vspan, sampler->start,
+					 sampler->phase, g_identity, 1,
+					 out, sampler->count);
+			return;
+		}
+	}
+
+	kernels->hfilter(sampler->vspan, sampler->start, sampler->phase,
+			 xaxis->coef, xaxis->taps, out, sampler->count);
+}
@@ -0,0 +1,1541 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpubv.h"
+
+#if defined(ARCH_ARM_HAVE_NEON) || defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define CPU_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#define CPU_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/*******************************************************************************
+ * Shared definitions.
+ */
+
+/* YUV to RGB in 6 bit fixed point. Every product fits 16 bits and the
+ * sums saturate to 16 bits at each step, so the SIMD kernels are bit
+ * exact with the scalar one. */
+struct yuvcoef {
+	short y;
+	short rv;
+	short gu;
+	short gv;
+	short bu;
+};
+
+static const struct yuvcoef g_yuvcoef[] = {
+	{ 74, 102, 25, 52, 129 },	/* CPUYUV_601 */
+	{ 74, 115, 14, 34, 135 }	/* CPUYUV_709 */
+};
+
+static inline int sat16(int value)
+{
+	return (value < -32768) ? -32768 : (value > 32767) ? 32767 : value;
+}
+
+static inline unsigned int clamp8(int value)
+{
+	return (value < 0) ? 0 : (value > 255) ? 255 : value;
+}
+
+/* Widens a component of the given size to 8 bits. */
+static inline unsigned int expand(unsigned int value, unsigned int size)
+{
+	if (size == 1)
+		return value ? 0xFF : 0x00;
+
+	return (value << (8 - size)) | (value >> (2 * size - 8));
+}
+
+/* Operations that copy one of the inputs or produce a constant. */
+static bool rop_trivial(unsigned int rop, const uint32_t *s,
+			const uint32_t *p, const uint32_t *d,
+			uint32_t *out, unsigned int count)
+{
+	switch (rop) {
+	case 0x00:
+		memset(out, 0x00, count * sizeof(uint32_t));
+		return true;
+
+	case 0xFF:
+		memset(out, 0xFF, count * sizeof(uint32_t));
+		return true;
+
+	case 0xAA:
+		memcpy(out, d, count * sizeof(uint32_t));
+		return true;
+
+	case 0xCC:
+		memcpy(out, s, count * sizeof(uint32_t));
+		return true;
+
+	case 0xF0:
+		memcpy(out, p, count * sizeof(uint32_t));
+		return true;
+	}
+
+	return false;
+}
+
+static inline unsigned int factor_scalar(enum cpufactor factor,
+					 unsigned int channel,
+					 uint32_t c1, uint32_t c2)
+{
+	unsigned int a1 = CPU_A(c1);
+	unsigned int a2 = CPU_A(c2);
+	unsigned int v;
+
+	switch (factor) {
+	case CPUFACTOR_ZERO:
+		return 0;
+	case CPUFACTOR_ONE:
+		return 255;
+	case CPUFACTOR_C1:
+		return (c1 >> (8 * channel)) & 0xFF;
+	case CPUFACTOR_A1:
+		return a1;
+	case CPUFACTOR_C2:
+		return (c2 >> (8 * channel)) & 0xFF;
+	case CPUFACTOR_A2:
+		return a2;
+	case CPUFACTOR_INV_C1:
+		return 255 - ((c1 >> (8 * channel)) & 0xFF);
+	case CPUFACTOR_INV_A1:
+		return 255 - a1;
+	case CPUFACTOR_INV_C2:
+		return 255 - ((c2 >> (8 * channel)) & 0xFF);
+	case CPUFACTOR_INV_A2:
+		return 255 - a2;
+	case CPUFACTOR_MIN_INV_A1_A2:
+		v = 255 - a1;
+		return (v < a2) ? v : a2;
+	default:
+		v = 255 - a2;
+		return (v < a1) ? v : a1;
+	}
+}
+
+static inline uint32_t scale_pixel(uint32_t pixel, unsigned int alpha)
+{
+	return CPU_RGBA(cpudiv255(CPU_R(pixel) * alpha),
+			cpudiv255(CPU_G(pixel) * alpha),
+			cpudiv255(CPU_B(pixel) * alpha),
+			cpudiv255(CPU_A(pixel) * alpha));
+}
+
+void cpu_premultiply(uint32_t *pixels, unsigned int count)
+{
+	unsigned int i, a;
+
+	for (i = 0; i < count; i += 1) {
+		a = CPU_A(pixels[i]);
+		if (a != 255)
+			pixels[i] = (scale_pixel(pixels[i], a) & 0x00FFFFFF)
+				  | (a << 24);
+	}
+}
+
+void cpu_unpremultiply(uint32_t *pixels, unsigned int count)
+{
+	unsigned int i, a, r, g, b;
+
+	for (i = 0; i < count; i += 1) {
+		a = CPU_A(pixels[i]);
+		if (a == 255)
+			continue;
+
+		if (a == 0) {
+			pixels[i] = 0;
+			continue;
+		}
+
+		r = (CPU_R(pixels[i]) * 255 + a / 2) / a;
+		g = (CPU_G(pixels[i]) * 255 + a / 2) / a;
+		b = (CPU_B(pixels[i]) * 255 + a / 2) / a;
+		pixels[i] = CPU_RGBA((r > 255) ? 255 : r,
+				     (g > 255) ? 255 : g,
+				     (b > 255) ? 255 : b, a);
+	}
+}
+
+
+/*******************************************************************************
+ * Scalar kernels.
+ */
+
+static void unpack_scalar(const struct cpuformat *format, const void *src,
+			  uint32_t *dst, unsigned int count)
+{
+	const struct cpucomp *comp = format->comp;
+	uint32_t opaque = (comp[3].size == 0) ? 0xFF000000 : 0;
+	uint32_t pixel, out;
+	unsigned int i, c;
+
+	for (i = 0; i < count; i += 1) {
+		pixel = (format->bitspp == 32)
+		      ? ((const uint32_t *) src)[i]
+		      : ((const uint16_t *) src)[i];
+
+		out = opaque;
+		for (c = 0; c < 4; c += 1) {
+			if (comp[c].size == 0)
+				continue;
+
+			out |= expand((pixel >> comp[c].shift)
+					& ((1U << comp[c].size) - 1),
+				      comp[c].size) << (8 * c);
+		}
+
+		dst[i] = out;
+	}
+}
+
+static void pack_scalar(const struct cpuformat *format, const uint32_t *src,
+			void *dst, unsigned int count)
+{
+	const struct cpucomp *comp = format->comp;
+	uint32_t out;
+	unsigned int i, c;
+
+	for (i = 0; i < count; i += 1) {
+		out = format->fillmask;
+		for (c = 0; c < 4; c += 1) {
+			if (comp[c].size == 0)
+				continue;
+
+			out |= (((src[i] >> (8 * c)) & 0xFF)
+					>> (8 - comp[c].size)) << comp[c].shift;
+		}
+
+		if (format->bitspp == 32)
+			((uint32_t *) dst)[i] = out;
+		else
+			((uint16_t *) dst)[i] = (uint16_t) out;
+	}
+}
+
+static inline uint32_t yuv_pixel(const struct yuvcoef *k,
+				 int y, int u, int v)
+{
+	int yy, r, g, b;
+
+	yy = (y - 16) * k->y;
+	u -= 128;
+	v -= 128;
+
+	r = sat16(sat16(yy + k->rv * v) + 32) >> 6;
+	g = sat16(sat16(sat16(yy - k->gu * u) - k->gv * v) + 32) >> 6;
+	b = sat16(sat16(yy + k->bu * u) + 32) >> 6;
+
+	return CPU_RGBA(clamp8(r), clamp8(g), clamp8(b), 255);
+}
+
+static void unpack_yuv_scalar(const struct cpuyuvrow *row, unsigned int x,
+			      uint32_t *dst, unsigned int count)
+{
+	const struct yuvcoef *k = &g_yuvcoef[row->std];
+	unsigned int i, px, pair;
+
+	for (i = 0; i < count; i += 1) {
+		px = x + i;
+		pair = px >> 1;
+		dst[i] = yuv_pixel(k, row->y[px * row->ystep],
+				   row->u[pair * row->uvstep],
+				   row->v[pair * row->uvstep]);
+	}
+}
+
+static void fill_scalar(void *dst, uint32_t value, unsigned int bytespp,
+			unsigned int count)
+{
+	unsigned int i;
+
+	if (bytespp == 4) {
+		for (i = 0; i < count; i += 1)
+			((uint32_t *) dst)[i] = value;
+	} else {
+		for (i = 0; i < count; i += 1)
+			((uint16_t *) dst)[i] = (uint16_t) value;
+	}
+}
+
+static void rop_scalar(unsigned int rop, const uint32_t *s,
+		       const uint32_t *p, const uint32_t *d,
+		       uint32_t *out, unsigned int count)
+{
+	unsigned int i, bit;
+	uint32_t r;
+
+	if (rop_trivial(rop, s, p, d, out, count))
+		return;
+
+	/* Sum of the minterms, bit (P << 2 | S << 1 | D) of the code. */
+	for (i = 0; i < count; i += 1) {
+		r = 0;
+		for (bit = 0; bit < 8; bit += 1) {
+			if ((rop & (1 << bit)) == 0)
+				continue;
+
+			r |= ((bit & 4) ? p[i] : ~p[i])
+			   & ((bit & 2) ? s[i] : ~s[i])
+			   & ((bit & 1) ? d[i] : ~d[i]);
+		}
+		out[i] = r;
+	}
+}
+
+static void blend_scalar(const struct cpublend *blend, const uint32_t *c1,
+			 const uint32_t *c2, uint32_t *out, unsigned int count)
+{
+	unsigned int i, c, v;
+	uint32_t a, b, r;
+
+	for (i = 0; i < count; i += 1) {
+		a = c1[i];
+		b = c2[i];
+
+		if (blend->globalalpha != 255)
+			a = scale_pixel(a, blend->globalalpha);
+
+		r = 0;
+		for (c = 0; c < 4; c += 1) {
+			v = cpudiv255(((a >> (8 * c)) & 0xFF) *
+				      factor_scalar((c == 3) ? blend->k3
+							     : blend->k1,
+						    c, a, b))
+			  + cpudiv255(((b >> (8 * c)) & 0xFF) *
+				      factor_scalar((c == 3) ? blend->k4
+							     : blend->k2,
+						    c, a, b));
+			r |= ((v > 255) ? 255 : v) << (8 * c);
+		}
+
+		out[i] = r;
+	}
+}
+
+static void vfilter_scalar(const uint32_t * const *rows, const short *coef,
+			   unsigned int taps, short *out, unsigned int count)
+{
+	unsigned int i, k;
+	int acc;
+
+	for (i = 0; i < count * 4; i += 1) {
+		acc = 0;
+		for (k = 0; k < taps; k += 1)
+			acc += coef[k] * ((const unsigned char *) rows[k])[i];
+
+		out[i] = (short) ((acc + (1 << (CPU_COEF_BITS - 1)))
+				  >> CPU_COEF_BITS);
+	}
+}
+
+static void hfilter_scalar(const short *src, const unsigned int *start,
+			   const unsigned char *phase, const short *coef,
+			   unsigned int taps, uint32_t *out, unsigned int count)
+{
+	const short *s, *f;
+	unsigned int i, k, c;
+	uint32_t r;
+	int acc;
+
+	for (i = 0; i < count; i += 1) {
+		s = src + start[i] * 4;
+		f = coef + phase[i] * taps;
+
+		r = 0;
+		for (c = 0; c < 4; c += 1) {
+			acc = 0;
+			for (k = 0; k < taps; k += 1)
+				acc += f[k] * s[k * 4 + c];
+
+			r |= clamp8((acc + (1 << (CPU_COEF_BITS - 1)))
+				    >> CPU_COEF_BITS) << (8 * c);
+		}
+
+		out[i] = r;
+	}
+}
+
+static void transpose_scalar(const uint32_t *src, unsigned int srcstride,
+			     uint32_t *dst, unsigned int dststride,
+			     unsigned int width, unsigned int height)
+{
+	unsigned int x, y;
+
+	for (y = 0; y < height; y += 1)
+		for (x = 0; x < width; x += 1)
+			dst[x * dststride + y] = src[y * srcstride + x];
+}
+
+static const struct cpukernels g_scalarkernels = {
+	CPUKERNEL_SCALAR,
+	unpack_scalar,
+	pack_scalar,
+	unpack_yuv_scalar,
+	fill_scalar,
+	rop_scalar,
+	blend_scalar,
+	vfilter_scalar,
+	hfilter_scalar,
+	transpose_scalar
+};
+
+
+/*******************************************************************************
+ * SSE2 kernels.
+ */
+
+#ifdef CPU_HAVE_SSE2
+
+static inline __m128i shiftcount(unsigned int count)
+{
+	return _mm_cvtsi32_si128(count);
+}
+
+/* Four pixels held in 32 bit lanes to intermediate pixels. */
+static inline __m128i unpack4_sse2(const struct cpucomp *comp, __m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i out, x;
+	unsigned int c, size;
+
+	out = (comp[3].size == 0) ? _mm_set1_epi32(0xFF000000) : zero;
+	for (c = 0; c < 4; c += 1) {
+		size = comp[c].size;
+		if (size == 0)
+			continue;
+
+		x = _mm_and_si128(_mm_srl_epi32(v, shiftcount(comp[c].shift)),
+				  _mm_set1_epi32((1 << size) - 1));
+
+		if (size == 1)
+			x = _mm_and_si128(_mm_sub_epi32(zero, x),
+					  _mm_set1_epi32(0xFF));
+		else if (size < 8)
+			x = _mm_or_si128(
+				_mm_sll_epi32(x, shiftcount(8 - size)),
+				_mm_srl_epi32(x, shiftcount(2 * size - 8)));
+
+		out = _mm_or_si128(out, _mm_sll_epi32(x, shiftcount(8 * c)));
+	}
+
+	return out;
+}
+
+static inline __m128i pack4_sse2(const struct cpuformat *format, __m128i v)
+{
+	const struct cpucomp *comp = format->comp;
+	__m128i out, x;
+	unsigned int c;
+
+	out = _mm_set1_epi32(format->fillmask);
+	for (c = 0; c < 4; c += 1) {
+		if (comp[c].size == 0)
+			continue;
+
+		x = _mm_and_si128(_mm_srl_epi32(v, shiftcount(8 * c)),
+				  _mm_set1_epi32(0xFF));
+		x = _mm_srl_epi32(x, shiftcount(8 - comp[c].size));
+		out = _mm_or_si128(out, _mm_sll_epi32(x,
+						shiftcount(comp[c].shift)));
+	}
+
+	return out;
+}
+
+static void unpack_sse2(const struct cpuformat *format, const void *src,
+			uint32_t *dst, unsigned int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int i = 0;
+	__m128i v;
+
+	if (format->bitspp == 32) {
+		const uint32_t *s = (const uint32_t *) src;
+
+		for (; i + 4 <= count; i += 4) {
+			v = _mm_loadu_si128((const __m128i *) (s + i));
+			_mm_storeu_si128((__m128i *) (dst + i),
+					 unpack4_sse2(format->comp, v));
+		}
+	} else {
+		const uint16_t *s = (const uint16_t *) src;
+
+		for (; i + 8 <= count; i += 8) {
+			v = _mm_loadu_si128((const __m128i *) (s + i));
+			_mm_storeu_si128((__m128i *) (dst + i),
+					 unpack4_sse2(format->comp,
+						_mm_unpacklo_epi16(v, zero)));
+			_mm_storeu_si128((__m128i *) (dst + i + 4),
+					 unpack4_sse2(format->comp,
+						_mm_unpackhi_epi16(v, zero)));
+		}
+	}
+
+	unpack_scalar(format, (const unsigned char *) src
+				+ i * (format->bitspp / 8),
+		      dst + i, count - i);
+}
+
+static void pack_sse2(const struct cpuformat *format, const uint32_t *src,
+		      void *dst, unsigned int count)
+{
+	unsigned int i = 0;
+	__m128i lo, hi;
+
+	if (format->bitspp == 32) {
+		uint32_t *d = (uint32_t *) dst;
+
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_si128((__m128i *) (d + i),
+				pack4_sse2(format,
+					_mm_loadu_si128((const __m128i *)
+							(src + i))));
+	} else {
+		uint16_t *d = (uint16_t *) dst;
+
+		for (; i + 8 <= count; i += 8) {
+			lo = pack4_sse2(format, _mm_loadu_si128(
+					(const __m128i *) (src + i)));
+			hi = pack4_sse2(format, _mm_loadu_si128(
+					(const __m128i *) (src + i + 4)));
+
+			/* Sign extend so the signed pack keeps the bits. */
+			lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+			hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+			_mm_storeu_si128((__m128i *) (d + i),
+					 _mm_packs_epi32(lo, hi));
+		}
+	}
+
+	pack_scalar(format, src + i,
+		    (unsigned char *) dst + i * (format->bitspp / 8),
+		    count - i);
+}
+
+/* Eight pixels of 16 bit Y, U and V to intermediate pixels. */
+static inline void yuv8_sse2(const struct yuvcoef *k,
+			     __m128i y, __m128i u, __m128i v, uint32_t *dst)
+{
+	const __m128i round = _mm_set1_epi16(32);
+	__m128i yy, r, g, b, rg, ba;
+
+	yy = _mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)),
+			     _mm_set1_epi16(k->y));
+	u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+	v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+	r = _mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(k->rv)));
+	g = _mm_subs_epi16(_mm_subs_epi16(yy,
+			_mm_mullo_epi16(u, _mm_set1_epi16(k->gu))),
+			_mm_mullo_epi16(v, _mm_set1_epi16(k->gv)));
+	b = _mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(k->bu)));
+
+	r = _mm_srai_epi16(_mm_adds_epi16(r, round), 6);
+	g = _mm_srai_epi16(_mm_adds_epi16(g, round), 6);
+	b = _mm_srai_epi16(_mm_adds_epi16(b, round), 6);
+
+	r = _mm_packus_epi16(r, r);
+	g = _mm_packus_epi16(g, g);
+	b = _mm_packus_epi16(b, b);
+
+	rg = _mm_unpacklo_epi8(r, g);
+	ba = _mm_unpacklo_epi8(b, _mm_set1_epi8((char) 0xFF));
+	_mm_storeu_si128((__m128i *) dst, _mm_unpacklo_epi16(rg, ba));
+	_mm_storeu_si128((__m128i *) (dst + 4), _mm_unpackhi_epi16(rg, ba));
+}
+
+static void unpack_yuv_sse2(const struct cpuyuvrow *row, unsigned int x,
+			    uint32_t *dst, unsigned int count)
+{
+	const struct yuvcoef *k = &g_yuvcoef[row->std];
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lobyte = _mm_set1_epi16(0x00FF);
+	const __m128i loword = _mm_set1_epi32(0x0000FFFF);
+	const unsigned char *base;
+	unsigned int i = 0, pair;
+	__m128i y0, y1, u, v, h0, h1, c0, c1, first, second;
+	bool yfirst, ufirst;
+
+	/* Start on a pixel pair. */
+	if ((x & 1) && (count > 0)) {
+		unpack_yuv_scalar(row, x, dst, 1);
+		i = 1;
+	}
+
+	if (row->ystep == 2) {
+		/* Packed 4:2:2, every pair is 4 bytes. */
+		base = (row->y < row->u) ? row->y : row->u;
+		if (row->v < base)
+			base = row->v;
+		yfirst = (row->y == base);
+		ufirst = (row->u < row->v);
+
+		for (; i + 16 <= count; i += 16) {
+			pair = (x + i) >> 1;
+			h0 = _mm_loadu_si128((const __m128i *)
+					     (base + pair * 4));
+			h1 = _mm_loadu_si128((const __m128i *)
+					     (base + pair * 4 + 16));
+
+			if (yfirst) {
+				y0 = _mm_and_si128(h0, lobyte);
+				y1 = _mm_and_si128(h1, lobyte);
+				c0 = _mm_srli_epi16(h0, 8);
+				c1 = _mm_srli_epi16(h1, 8);
+			} else {
+				y0 = _mm_srli_epi16(h0, 8);
+				y1 = _mm_srli_epi16(h1, 8);
+				c0 = _mm_and_si128(h0, lobyte);
+				c1 = _mm_and_si128(h1, lobyte);
+			}
+
+			first = _mm_packs_epi32(_mm_and_si128(c0, loword),
+						_mm_and_si128(c1, loword));
+			second = _mm_packs_epi32(_mm_srli_epi32(c0, 16),
+						 _mm_srli_epi32(c1, 16));
+			u = ufirst ? first : second;
+			v = ufirst ? second : first;
+
+			yuv8_sse2(k, y0, _mm_unpacklo_epi16(u, u),
+				  _mm_unpacklo_epi16(v, v), dst + i);
+			yuv8_sse2(k, y1, _mm_unpackhi_epi16(u, u),
+				  _mm_unpackhi_epi16(v, v), dst + i + 8);
+		}
+	} else {
+		ufirst = (row->u < row->v);
+		base = ufirst ? row->u : row->v;
+
+		for (; i + 16 <= count; i += 16) {
+			pair = (x + i) >> 1;
+			h0 = _mm_loadu_si128((const __m128i *)
+					     (row->y + x + i));
+			y0 = _mm_unpacklo_epi8(h0, zero);
+			y1 = _mm_unpackhi_epi8(h0, zero);
+
+			if (row->uvstep == 2) {
+				/* Interleaved chroma plane. */
+				c0 = _mm_loadu_si128((const __m128i *)
+						     (base + pair * 2));
+				first = _mm_and_si128(c0, lobyte);
+				second = _mm_srli_epi16(c0, 8);
+				u = ufirst ? first : second;
+				v = ufirst ? second : first;
+			} else {
+				u = _mm_unpacklo_epi8(_mm_loadl_epi64(
+					(const __m128i *) (row->u + pair)),
+					zero);
+				v = _mm_unpacklo_epi8(_mm_loadl_epi64(
+					(const __m128i *) (row->v + pair)),
+					zero);
+			}
+
+			yuv8_sse2(k, y0, _mm_unpacklo_epi16(u, u),
+				  _mm_unpacklo_epi16(v, v), dst + i);
+			yuv8_sse2(k, y1, _mm_unpackhi_epi16(u, u),
+				  _mm_unpackhi_epi16(v, v), dst + i + 8);
+		}
+	}
+
+	unpack_yuv_scalar(row, x + i, dst + i, count - i);
+}
+
+static void fill_sse2(void *dst, uint32_t value, unsigned int bytespp,
+		      unsigned int count)
+{
+	unsigned char *d = (unsigned char *) dst;
+	size_t bytes = (size_t) count * bytespp;
+	size_t i = 0;
+	__m128i v;
+
+	if (bytespp == 2)
+		value = (value & 0xFFFF) | (value << 16);
+
+	/* 16 bit fills start on a pixel boundary so every 4 bytes hold
+	 * the same pair of pixels. */
+	v = _mm_set1_epi32(value);
+	for (; i + 64 <= bytes; i += 64) {
+		_mm_storeu_si128((__m128i *) (d + i), v);
+		_mm_storeu_si128((__m128i *) (d + i + 16), v);
+		_mm_storeu_si128((__m128i *) (d + i + 32), v);
+		_mm_storeu_si128((__m128i *) (d + i + 48), v);
+	}
+	for (; i + 16 <= bytes; i += 16)
+		_mm_storeu_si128((__m128i *) (d + i), v);
+
+	fill_scalar(d + i, value, bytespp, (bytes - i) / bytespp);
+}
+
+static void rop_sse2(unsigned int rop, const uint32_t *s,
+		     const uint32_t *p, const uint32_t *d,
+		     uint32_t *out, unsigned int count)
+{
+	const __m128i ones = _mm_set1_epi32(-1);
+	__m128i vs, vp, vd, ns, np, nd, r;
+	unsigned int i = 0, bit;
+
+	if (rop_trivial(rop, s, p, d, out, count))
+		return;
+
+	for (; i + 4 <= count; i += 4) {
+		vs = _mm_loadu_si128((const __m128i *) (s + i));
+		vp = _mm_loadu_si128((const __m128i *) (p + i));
+		vd = _mm_loadu_si128((const __m128i *) (d + i));
+		ns = _mm_xor_si128(vs, ones);
+		np = _mm_xor_si128(vp, ones);
+		nd = _mm_xor_si128(vd, ones);
+
+		r = _mm_setzero_si128();
+		for (bit = 0; bit < 8; bit += 1) {
+			if ((rop & (1 << bit)) == 0)
+				continue;
+
+			r = _mm_or_si128(r, _mm_and_si128(
+				_mm_and_si128((bit & 4) ? vp : np,
+					      (bit & 2) ? vs : ns),
+				(bit & 1) ? vd : nd));
+		}
+
+		_mm_storeu_si128((__m128i *) (out + i), r);
+	}
+
+	rop_scalar(rop, s + i, p + i, d + i, out + i, count - i);
+}
+
+/* Rounded x / 255 in 16 bit lanes. */
+static inline __m128i div255_sse2(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* Replicates the alpha of the two pixels in 16 bit lanes. */
+static inline __m128i alpha_sse2(__m128i x)
+{
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xFF), 0xFF);
+}
+
+static inline __m128i factor_sse2(enum cpufactor factor,
+				  __m128i c1, __m128i a1,
+				  __m128i c2, __m128i a2)
+{
+	const __m128i one = _mm_set1_epi16(255);
+
+	switch (factor) {
+	case CPUFACTOR_ZERO:
+		return _mm_setzero_si128();
+	case CPUFACTOR_ONE:
+		return one;
+	case CPUFACTOR_C1:
+		return c1;
+	case CPUFACTOR_A1:
+		return a1;
+	case CPUFACTOR_C2:
+		return c2;
+	case CPUFACTOR_A2:
+		return a2;
+	case CPUFACTOR_INV_C1:
+		return _mm_xor_si128(c1, one);
+	case CPUFACTOR_INV_A1:
+		return _mm_xor_si128(a1, one);
+	case CPUFACTOR_INV_C2:
+		return _mm_xor_si128(c2, one);
+	case CPUFACTOR_INV_A2:
+		return _mm_xor_si128(a2, one);
+	case CPUFACTOR_MIN_INV_A1_A2:
+		return _mm_min_epi16(_mm_xor_si128(a1, one), a2);
+	default:
+		return _mm_min_epi16(_mm_xor_si128(a2, one), a1);
+	}
+}
+
+/* Blends two pixels held in 16 bit lanes. */
+static inline __m128i blend2_sse2(const struct cpublend *blend,
+				  __m128i c1, __m128i c2, __m128i alphamask)
+{
+	__m128i a1, a2, f1, f2;
+
+	if (blend->globalalpha != 255)
+		c1 = div255_sse2(_mm_mullo_epi16(c1,
+				 _mm_set1_epi16(blend->globalalpha)));
+
+	a1 = alpha_sse2(c1);
+	a2 = alpha_sse2(c2);
+
+	if (blend->src1over)
+		return _mm_add_epi16(c1, div255_sse2(_mm_mullo_epi16(c2,
+				     _mm_xor_si128(a1, _mm_set1_epi16(255)))));
+
+	f1 = factor_sse2(blend->k1, c1, a1, c2, a2);
+	if (blend->k3 != blend->k1)
+		f1 = _mm_or_si128(_mm_andnot_si128(alphamask, f1),
+				  _mm_and_si128(alphamask,
+				  factor_sse2(blend->k3, c1, a1, c2, a2)));
+
+	f2 = factor_sse2(blend->k2, c1, a1, c2, a2);
+	if (blend->k4 != blend->k2)
+		f2 = _mm_or_si128(_mm_andnot_si128(alphamask, f2),
+				  _mm_and_si128(alphamask,
+				  factor_sse2(blend->k4, c1, a1, c2, a2)));
+
+	return _mm_add_epi16(div255_sse2(_mm_mullo_epi16(c1, f1)),
+			     div255_sse2(_mm_mullo_epi16(c2, f2)));
+}
+
+static void blend_sse2(const struct cpublend *blend, const uint32_t *c1,
+		       const uint32_t *c2, uint32_t *out, unsigned int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphamask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	__m128i v1, v2, lo, hi;
+	unsigned int i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		v1 = _mm_loadu_si128((const __m128i *) (c1 + i));
+		v2 = _mm_loadu_si128((const __m128i *) (c2 + i));
+
+		lo = blend2_sse2(blend, _mm_unpacklo_epi8(v1, zero),
+				 _mm_unpacklo_epi8(v2, zero), alphamask);
+		hi = blend2_sse2(blend, _mm_unpackhi_epi8(v1, zero),
+				 _mm_unpackhi_epi8(v2, zero), alphamask);
+
+		_mm_storeu_si128((__m128i *) (out + i),
+				 _mm_packus_epi16(lo, hi));
+	}
+
+	blend_scalar(blend, c1 + i, c2 + i, out + i, count - i);
+}
+
+static void vfilter_sse2(const uint32_t * const *rows, const short *coef,
+			 unsigned int taps, short *out, unsigned int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (CPU_COEF_BITS - 1));
+	__m128i pairs[(CPU_MAX_TAPS + 1) / 2];
+	__m128i a, b, acclo, acchi;
+	unsigned int i = 0, k, lanes = count * 4;
+
+	/* Coefficients of consecutive rows side by side for madd. */
+	for (k = 0; k < taps; k += 2)
+		pairs[k / 2] = _mm_set1_epi32(
+			(uint16_t) coef[k] |
+			((uint32_t) (uint16_t) ((k + 1 < taps) ? coef[k + 1]
+							       : 0) << 16));
+
+	for (; i + 8 <= lanes; i += 8) {
+		acclo = round;
+		acchi = round;
+
+		for (k = 0; k < taps; k += 2) {
+			a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)
+				((const unsigned char *) rows[k] + i)), zero);
+			b = (k + 1 < taps)
+			  ? _mm_unpacklo_epi8(_mm_loadl_epi64(
+				(const __m128i *)
+				((const unsigned char *) rows[k + 1] + i)),
+				zero)
+			  : zero;
+
+			acclo = _mm_add_epi32(acclo, _mm_madd_epi16(
+				_mm_unpacklo_epi16(a, b), pairs[k / 2]));
+			acchi = _mm_add_epi32(acchi, _mm_madd_epi16(
+				_mm_unpackhi_epi16(a, b), pairs[k / 2]));
+		}
+
+		_mm_storeu_si128((__m128i *) (out + i),
+			_mm_packs_epi32(_mm_srai_epi32(acclo, CPU_COEF_BITS),
+					_mm_srai_epi32(acchi, CPU_COEF_BITS)));
+	}
+
+	if (i < lanes) {
+		const uint32_t *tail[CPU_MAX_TAPS];
+
+		for (k = 0; k < taps; k += 1)
+			tail[k] = rows[k] + i / 4;
+
+		vfilter_scalar(tail, coef, taps, out + i, count - i / 4);
+	}
+}
+
+static void hfilter_sse2(const short *src, const unsigned int *start,
+			 const unsigned char *phase, const short *coef,
+			 unsigned int taps, uint32_t *out, unsigned int count)
+{
+	const __m128i round = _mm_set1_epi32(1 << (CPU_COEF_BITS - 1));
+	__m128i pairs[CPU_PHASE_COUNT][(CPU_MAX_TAPS + 1) / 2];
+	__m128i acc, a, b, v;
+	unsigned int phases, i, k, p;
+	const short *s, *f;
+
+	/* Single tap sampling has a single coefficient set. */
+	phases = (taps == 1) ? 1 : CPU_PHASE_COUNT;
+	for (p = 0; p < phases; p += 1) {
+		f = coef + p * taps;
+		for (k = 0; k < taps; k += 2)
+			pairs[p][k / 2] = _mm_set1_epi32(
+				(uint16_t) f[k] |
+				((uint32_t) (uint16_t)
+				 ((k + 1 < taps) ? f[k + 1] : 0) << 16));
+	}
+
+	for (i = 0; i < count; i += 1) {
+		s = src + start[i] * 4;
+		p = (taps == 1) ? 0 : phase[i];
+
+		acc = round;
+		for (k = 0; k < taps; k += 2) {
+			a = _mm_loadl_epi64((const __m128i *) (s + k * 4));
+			b = (k + 1 < taps)
+			  ? _mm_loadl_epi64((const __m128i *) (s + k * 4 + 4))
+			  : _mm_setzero_si128();
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(
+				_mm_unpacklo_epi16(a, b), pairs[p][k / 2]));
+		}
+
+		v = _mm_srai_epi32(acc, CPU_COEF_BITS);
+		v = _mm_packs_epi32(v, v);
+		out[i] = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+	}
+}
+
+static void transpose_sse2(const uint32_t *src, unsigned int srcstride,
+			   uint32_t *dst, unsigned int dststride,
+			   unsigned int width, unsigned int height)
+{
+	__m128i r0, r1, r2, r3, t0, t1, t2, t3;
+	unsigned int x, y;
+
+	for (y = 0; y + 4 <= height; y += 4) {
+		for (x = 0; x + 4 <= width; x += 4) {
+			const uint32_t *s = src + y * srcstride + x;
+			uint32_t *d = dst + x * dststride + y;
+
+			r0 = _mm_loadu_si128((const __m128i *) s);
+			r1 = _mm_loadu_si128((const __m128i *)
+					     (s + srcstride));
+			r2 = _mm_loadu_si128((const __m128i *)
+					     (s + 2 * srcstride));
+			r3 = _mm_loadu_si128((const __m128i *)
+					     (s + 3 * srcstride));
+
+			t0 = _mm_unpacklo_epi32(r0, r1);
+			t1 = _mm_unpacklo_epi32(r2, r3);
+			t2 = _mm_unpackhi_epi32(r0, r1);
+			t3 = _mm_unpackhi_epi32(r2, r3);
+
+			_mm_storeu_si128((__m128i *) d,
+					 _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128((__m128i *) (d + dststride),
+					 _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128((__m128i *) (d + 2 * dststride),
+					 _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128((__m128i *) (d + 3 * dststride),
+					 _mm_unpackhi_epi64(t2, t3));
+		}
+
+		transpose_scalar(src + y * srcstride + x, srcstride,
+				 dst + x * dststride + y, dststride,
+				 width - x, 4);
+	}
+
+	transpose_scalar(src + y * srcstride, srcstride,
+			 dst + y, dststride, width, height - y);
+}
+
+static const struct cpukernels g_sse2kernels = {
+	CPUKERNEL_SSE2,
+	unpack_sse2,
+	pack_sse2,
+	unpack_yuv_sse2,
+	fill_sse2,
+	rop_sse2,
+	blend_sse2,
+	vfilter_sse2,
+	hfilter_sse2,
+	transpose_sse2
+};
+
+#endif
+
+
+/*******************************************************************************
+ * NEON kernels.
+ */
+
+#ifdef CPU_HAVE_NEON
+
+/* Four pixels held in 32 bit lanes to intermediate pixels. */
+static inline uint32x4_t unpack4_neon(const struct cpucomp *comp,
+				      uint32x4_t v)
+{
+	uint32x4_t out, x;
+	unsigned int c, size;
+
+	out = vdupq_n_u32((comp[3].size == 0) ? 0xFF000000 : 0);
+	for (c = 0; c < 4; c += 1) {
+		size = comp[c].size;
+		if (size == 0)
+			continue;
+
+		x = vandq_u32(vshlq_u32(v, vdupq_n_s32(-comp[c].shift)),
+			      vdupq_n_u32((1 << size) - 1));
+
+		if (size == 1)
+			x = vmulq_n_u32(x, 0xFF);
+		else if (size < 8)
+			x = vorrq_u32(
+				vshlq_u32(x, vdupq_n_s32(8 - size)),
+				vshlq_u32(x, vdupq_n_s32(8 - 2 * size)));
+
+		out = vorrq_u32(out, vshlq_u32(x, vdupq_n_s32(8 * c)));
+	}
+
+	return out;
+}
+
+static inline uint32x4_t pack4_neon(const struct cpuformat *format,
+				    uint32x4_t v)
+{
+	const struct cpucomp *comp = format->comp;
+	uint32x4_t out, x;
+	unsigned int c;
+
+	out = vdupq_n_u32(format->fillmask);
+	for (c = 0; c < 4; c += 1) {
+		if (comp[c].size == 0)
+			continue;
+
+		x = vandq_u32(vshlq_u32(v, vdupq_n_s32(-8 * (int) c)),
+			      vdupq_n_u32(0xFF));
+		x = vshlq_u32(x, vdupq_n_s32(comp[c].size - 8));
+		out = vorrq_u32(out, vshlq_u32(x, vdupq_n_s32(comp[c].shift)));
+	}
+
+	return out;
+}
+
+static void unpack_neon(const struct cpuformat *format, const void *src,
+			uint32_t *dst, unsigned int count)
+{
+	unsigned int i = 0;
+	uint16x8_t v;
+
+	if (format->bitspp == 32) {
+		const uint32_t *s = (const uint32_t *) src;
+
+		for (; i + 4 <= count; i += 4)
+			vst1q_u32(dst + i, unpack4_neon(format->comp,
+							vld1q_u32(s + i)));
+	} else {
+		const uint16_t *s = (const uint16_t *) src;
+
+		for (; i + 8 <= count; i += 8) {
+			v = vld1q_u16(s + i);
+			vst1q_u32(dst + i, unpack4_neon(format->comp,
+					vmovl_u16(vget_low_u16(v))));
+			vst1q_u32(dst + i + 4, unpack4_neon(format->comp,
+					vmovl_u16(vget_high_u16(v))));
+		}
+	}
+
+	unpack_scalar(format, (const unsigned char *) src
+				+ i * (format->bitspp / 8),
+		      dst + i, count - i);
+}
+
+static void pack_neon(const struct cpuformat *format, const uint32_t *src,
+		      void *dst, unsigned int count)
+{
+	unsigned int i = 0;
+
+	if (format->bitspp == 32) {
+		uint32_t *d = (uint32_t *) dst;
+
+		for (; i + 4 <= count; i += 4)
+			vst1q_u32(d + i, pack4_neon(format,
+						    vld1q_u32(src + i)));
+	} else {
+		uint16_t *d = (uint16_t *) dst;
+
+		for (; i + 8 <= count; i += 8)
+			vst1q_u16(d + i, vcombine_u16(
+				vmovn_u32(pack4_neon(format,
+						     vld1q_u32(src + i))),
+				vmovn_u32(pack4_neon(format,
+						     vld1q_u32(src + i + 4)))));
+	}
+
+	pack_scalar(format, src + i,
+		    (unsigned char *) dst + i * (format->bitspp / 8),
+		    count - i);
+}
+
+/* Sixteen pixels from the even and odd luma samples and the chroma of
+ * their eight pairs. */
+static inline void yuv16_neon(const struct yuvcoef *k,
+			      uint8x8_t yeven, uint8x8_t yodd,
+			      uint8x8_t u8, uint8x8_t v8, uint32_t *dst)
+{
+	const int16x8_t round = vdupq_n_s16(32);
+	int16x8_t u, v, rv, gu, gv, bu, yy;
+	uint8x8_t r[2], g[2], b[2];
+	uint8x8x2_t rz, gz, bz;
+	uint8x8x4_t px;
+	int half;
+
+	u = vreinterpretq_s16_u16(vsubl_u8(u8, vdup_n_u8(128)));
+	v = vreinterpretq_s16_u16(vsubl_u8(v8, vdup_n_u8(128)));
+	rv = vmulq_n_s16(v, k->rv);
+	gu = vmulq_n_s16(u, k->gu);
+	gv = vmulq_n_s16(v, k->gv);
+	bu = vmulq_n_s16(u, k->bu);
+
+	for (half = 0; half < 2; half += 1) {
+		yy = vmulq_n_s16(vreinterpretq_s16_u16(
+				vsubl_u8(half ? yodd : yeven, vdup_n_u8(16))),
+				k->y);
+
+		r[half] = vqmovun_s16(vshrq_n_s16(vqaddq_s16(
+				vqaddq_s16(yy, rv), round), 6));
+		g[half] = vqmovun_s16(vshrq_n_s16(vqaddq_s16(
+				vqsubq_s16(vqsubq_s16(yy, gu), gv), round), 6));
+		b[half] = vqmovun_s16(vshrq_n_s16(vqaddq_s16(
+				vqaddq_s16(yy, bu), round), 6));
+	}
+
+	rz = vzip_u8(r[0], r[1]);
+	gz = vzip_u8(g[0], g[1]);
+	bz = vzip_u8(b[0], b[1]);
+
+	px.val[3] = vdup_n_u8(0xFF);
+	for (half = 0; half < 2; half += 1) {
+		px.val[0] = rz.val[half];
+		px.val[1] = gz.val[half];
+		px.val[2] = bz.val[half];
+		vst4_u8((uint8_t *) (dst + half * 8), px);
+	}
+}
+
+static void unpack_yuv_neon(const struct cpuyuvrow *row, unsigned int x,
+			    uint32_t *dst, unsigned int count)
+{
+	const struct yuvcoef *k = &g_yuvcoef[row->std];
+	const unsigned char *base;
+	unsigned int i = 0, pair;
+	uint8x8x4_t q;
+	uint8x8x2_t d, c;
+	bool yfirst, ufirst;
+
+	/* Start on a pixel pair. */
+	if ((x & 1) && (count > 0)) {
+		unpack_yuv_scalar(row, x, dst, 1);
+		i = 1;
+	}
+
+	ufirst = (row->u < row->v);
+
+	if (row->ystep == 2) {
+		/* Packed 4:2:2, every pair is 4 bytes. */
+		base = (row->y < row->u) ? row->y : row->u;
+		if (row->v < base)
+			base = row->v;
+		yfirst = (row->y == base);
+
+		for (; i + 16 <= count; i += 16) {
+			pair = (x + i) >> 1;
+			q = vld4_u8(base + pair * 4);
+
+			if (yfirst)
+				yuv16_neon(k, q.val[0], q.val[2],
+					   ufirst ? q.val[1] : q.val[3],
+					   ufirst ? q.val[3] : q.val[1],
+					   dst + i);
+			else
+				yuv16_neon(k, q.val[1], q.val[3],
+					   ufirst ? q.val[0] : q.val[2],
+					   ufirst ? q.val[2] : q.val[0],
+					   dst + i);
+		}
+	} else {
+		base = ufirst ? row->u : row->v;
+
+		for (; i + 16 <= count; i += 16) {
+			pair = (x + i) >> 1;
+			d = vld2_u8(row->y + x + i);
+
+			if (row->uvstep == 2) {
+				/* Interleaved chroma plane. */
+				c = vld2_u8(base + pair * 2);
+				yuv16_neon(k, d.val[0], d.val[1],
+					   ufirst ? c.val[0] : c.val[1],
+					   ufirst ? c.val[1] : c.val[0],
+					   dst + i);
+			} else {
+				yuv16_neon(k, d.val[0], d.val[1],
+					   vld1_u8(row->u + pair),
+					   vld1_u8(row->v + pair),
+					   dst + i);
+			}
+		}
+	}
+
+	unpack_yuv_scalar(row, x + i, dst + i, count - i);
+}
+
+static void fill_neon(void *dst, uint32_t value, unsigned int bytespp,
+		      unsigned int count)
+{
+	unsigned char *d = (unsigned char *) dst;
+	size_t bytes = (size_t) count * bytespp;
+	size_t i = 0;
+	uint32x4_t v;
+
+	if (bytespp == 2)
+		value = (value & 0xFFFF) | (value << 16);
+
+	v = vdupq_n_u32(value);
+	for (; i + 64 <= bytes; i += 64) {
+		vst1q_u8(d + i, vreinterpretq_u8_u32(v));
+		vst1q_u8(d + i + 16, vreinterpretq_u8_u32(v));
+		vst1q_u8(d + i + 32, vreinterpretq_u8_u32(v));
+		vst1q_u8(d + i + 48, vreinterpretq_u8_u32(v));
+	}
+	for (; i + 16 <= bytes; i += 16)
+		vst1q_u8(d + i, vreinterpretq_u8_u32(v));
+
+	fill_scalar(d + i, value, bytespp, (bytes - i) / bytespp);
+}
+
+static void rop_neon(unsigned int rop, const uint32_t *s,
+		     const uint32_t *p, const uint32_t *d,
+		     uint32_t *out, unsigned int count)
+{
+	uint32x4_t vs, vp, vd, ns, np, nd, r;
+	unsigned int i = 0, bit;
+
+	if (rop_trivial(rop, s, p, d, out, count))
+		return;
+
+	for (; i + 4 <= count; i += 4) {
+		vs = vld1q_u32(s + i);
+		vp = vld1q_u32(p + i);
+		vd = vld1q_u32(d + i);
+		ns = vmvnq_u32(vs);
+		np = vmvnq_u32(vp);
+		nd = vmvnq_u32(vd);
+
+		r = vdupq_n_u32(0);
+		for (bit = 0; bit < 8; bit += 1) {
+			if ((rop & (1 << bit)) == 0)
+				continue;
+
+			r = vorrq_u32(r, vandq_u32(
+				vandq_u32((bit & 4) ? vp : np,
+					  (bit & 2) ? vs : ns),
+				(bit & 1) ? vd : nd));
+		}
+
+		vst1q_u32(out + i, r);
+	}
+
+	rop_scalar(rop, s + i, p + i, d + i, out + i, count - i);
+}
+
+/* Rounded x / 255 narrowed to 8 bits, same as cpudiv255(). */
+static inline uint8x8_t div255_neon(uint16x8_t x)
+{
+	return vrshrn_n_u16(vaddq_u16(x, vrshrq_n_u16(x, 8)), 8);
+}
+
+static inline uint8x8_t factor_neon(enum cpufactor factor,
+				    uint8x8_t c1, uint8x8_t a1,
+				    uint8x8_t c2, uint8x8_t a2)
+{
+	switch (factor) {
+	case CPUFACTOR_ZERO:
+		return vdup_n_u8(0);
+	case CPUFACTOR_ONE:
+		return vdup_n_u8(255);
+	case CPUFACTOR_C1:
+		return c1;
+	case CPUFACTOR_A1:
+		return a1;
+	case CPUFACTOR_C2:
+		return c2;
+	case CPUFACTOR_A2:
+		return a2;
+	case CPUFACTOR_INV_C1:
+		return vmvn_u8(c1);
+	case CPUFACTOR_INV_A1:
+		return vmvn_u8(a1);
+	case CPUFACTOR_INV_C2:
+		return vmvn_u8(c2);
+	case CPUFACTOR_INV_A2:
+		return vmvn_u8(a2);
+	case CPUFACTOR_MIN_INV_A1_A2:
+		return vmin_u8(vmvn_u8(a1), a2);
+	default:
+		return vmin_u8(vmvn_u8(a2), a1);
+	}
+}
+
+static void blend_neon(const struct cpublend *blend, const uint32_t *c1,
+		       const uint32_t *c2, uint32_t *out, unsigned int count)
+{
+	uint8x8x4_t v1, v2, r;
+	uint8x8_t ga, f1, f2;
+	unsigned int i = 0, c;
+
+	ga = vdup_n_u8(blend->globalalpha);
+
+	for (; i + 8 <= count; i += 8) {
+		v1 = vld4_u8((const uint8_t *) (c1 + i));
+		v2 = vld4_u8((const uint8_t *) (c2 + i));
+
+		if (blend->globalalpha != 255)
+			for (c = 0; c < 4; c += 1)
+				v1.val[c] = div255_neon(vmull_u8(v1.val[c],
+								 ga));
+
+		for (c = 0; c < 4; c += 1) {
+			if (blend->src1over) {
+				r.val[c] = vqadd_u8(v1.val[c],
+					div255_neon(vmull_u8(v2.val[c],
+						vmvn_u8(v1.val[3]))));
+				continue;
+			}
+
+			f1 = factor_neon((c == 3) ? blend->k3 : blend->k1,
+					 v1.val[c], v1.val[3],
+					 v2.val[c], v2.val[3]);
+			f2 = factor_neon((c == 3) ? blend->k4 : blend->k2,
+					 v1.val[c], v1.val[3],
+					 v2.val[c], v2.val[3]);
+
+			r.val[c] = vqadd_u8(
+				div255_neon(vmull_u8(v1.val[c], f1)),
+				div255_neon(vmull_u8(v2.val[c], f2)));
+		}
+
+		vst4_u8((uint8_t *) (out + i), r);
+	}
+
+	blend_scalar(blend, c1 + i, c2 + i, out + i, count - i);
+}
+
+static void vfilter_neon(const uint32_t * const *rows, const short *coef,
+			 unsigned int taps, short *out, unsigned int count)
+{
+	unsigned int i = 0, k, lanes = count * 4;
+	int32x4_t acclo, acchi;
+	int16x8_t x;
+
+	for (; i + 8 <= lanes; i += 8) {
+		acclo = vdupq_n_s32(0);
+		acchi = vdupq_n_s32(0);
+
+		for (k = 0; k < taps; k += 1) {
+			x = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(
+				(const uint8_t *) rows[k] + i)));
+			acclo = vmlal_n_s16(acclo, vget_low_s16(x), coef[k]);
+			acchi = vmlal_n_s16(acchi, vget_high_s16(x), coef[k]);
+		}
+
+		vst1q_s16(out + i, vcombine_s16(
+			vmovn_s32(vrshrq_n_s32(acclo, CPU_COEF_BITS)),
+			vmovn_s32(vrshrq_n_s32(acchi, CPU_COEF_BITS))));
+	}
+
+	if (i < lanes) {
+		const uint32_t *tail[CPU_MAX_TAPS];
+
+		for (k = 0; k < taps; k += 1)
+			tail[k] = rows[k] + i / 4;
+
+		vfilter_scalar(tail, coef, taps, out + i, count - i / 4);
+	}
+}
+
+static void hfilter_neon(const short *src, const unsigned int *start,
+			 const unsigned char *phase, const short *coef,
+			 unsigned int taps, uint32_t *out, unsigned int count)
+{
+	const short *s, *f;
+	unsigned int i, k;
+	int32x4_t acc;
+	int16x4_t v;
+	uint8x8_t r;
+
+	for (i = 0; i < count; i += 1) {
+		s = src + start[i] * 4;
+		f = coef + ((taps == 1) ? 0 : phase[i] * taps);
+
+		acc = vdupq_n_s32(0);
+		for (k = 0; k < taps; k += 1)
+			acc = vmlal_n_s16(acc, vld1_s16(s + k * 4), f[k]);
+
+		v = vqmovn_s32(vrshrq_n_s32(acc, CPU_COEF_BITS));
+		r = vqmovun_s16(vcombine_s16(v, v));
+		out[i] = vget_lane_u32(vreinterpret_u32_u8(r), 0);
+	}
+}
+
+static void transpose_neon(const uint32_t *src, unsigned int srcstride,
+			   uint32_t *dst, unsigned int dststride,
+			   unsigned int width, unsigned int height)
+{
+	uint32x4x2_t t01, t23;
+	unsigned int x, y;
+
+	for (y = 0; y + 4 <= height; y += 4) {
+		for (x = 0; x + 4 <= width; x += 4) {
+			const uint32_t *s = src + y * srcstride + x;
+			uint32_t *d = dst + x * dststride + y;
+
+			t01 = vtrnq_u32(vld1q_u32(s),
+					vld1q_u32(s + srcstride));
+			t23 = vtrnq_u32(vld1q_u32(s + 2 * srcstride),
+					vld1q_u32(s + 3 * srcstride));
+
+			vst1q_u32(d, vcombine_u32(vget_low_u32(t01.val[0]),
+						  vget_low_u32(t23.val[0])));
+			vst1q_u32(d + dststride,
+				  vcombine_u32(vget_low_u32(t01.val[1]),
+					       vget_low_u32(t23.val[1])));
+			vst1q_u32(d + 2 * dststride,
+				  vcombine_u32(vget_high_u32(t01.val[0]),
+					       vget_high_u32(t23.val[0])));
+			vst1q_u32(d + 3 * dststride,
+				  vcombine_u32(vget_high_u32(t01.val[1]),
+					       vget_high_u32(t23.val[1])));
+		}
+
+		transpose_scalar(src + y * srcstride + x, srcstride,
+				 dst + x * dststride + y, dststride,
+				 width - x, 4);
+	}
+
+	transpose_scalar(src + y * srcstride, srcstride,
+			 dst + y, dststride, width, height - y);
+}
+
+static const struct cpukernels g_neonkernels = {
+	CPUKERNEL_NEON,
+	unpack_neon,
+	pack_neon,
+	unpack_yuv_neon,
+	fill_neon,
+	rop_neon,
+	blend_neon,
+	vfilter_neon,
+	hfilter_neon,
+	transpose_neon
+};
+
+#endif
+
+
+/*******************************************************************************
+ * Kernel selection.
+ */
+
+static const struct cpukernels * volatile g_kernels;
+
+static const struct cpukernels *kernels_for(enum cpukernel kernel)
+{
+	switch (kernel) {
+	case CPUKERNEL_SCALAR:
+		return &g_scalarkernels;
+#ifdef CPU_HAVE_NEON
+	/* NEON is part of the ARM target the library is built for. */
+	case CPUKERNEL_NEON:
+		return &g_neonkernels;
+#endif
+#ifdef CPU_HAVE_SSE2
+	case CPUKERNEL_SSE2:
+		return &g_sse2kernels;
+#endif
+	case CPUKERNEL_AUTO:
+#if defined(CPU_HAVE_NEON)
+		return &g_neonkernels;
+#elif defined(CPU_HAVE_SSE2)
+		return &g_sse2kernels;
+#else
+		return &g_scalarkernels;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+const struct cpukernels *cpu_kernels(void)
+{
+	const struct cpukernels *kernels = g_kernels;
+
+	if (kernels == NULL) {
+		kernels = kernels_for(CPUKERNEL_AUTO);
+		g_kernels = kernels;
+	}
+
+	return kernels;
+}
+
+bool cpubv_set_kernel(enum cpukernel kernel)
+{
+	const struct cpukernels *kernels = kernels_for(kernel);
+
+	if (kernels == NULL)
+		return false;
+
+	g_kernels = kernels;
+	return true;
+}
+
+enum cpukernel cpubv_get_kernel(void)
+{
+	return cpu_kernels()->id;
+}
+
+const char *cpubv_kernel_name(enum cpukernel kernel)
+{
+	switch (kernel) {
+	case CPUKERNEL_AUTO:   return "auto";
+	case CPUKERNEL_SCALAR: return "scalar";
+	case CPUKERNEL_NEON:   return "neon";
+	case CPUKERNEL_SSE2:   return "sse2";
+	default:               return "unknown";
+	}
+}
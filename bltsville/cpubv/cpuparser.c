@@ -0,0 +1,1324 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpubv.h"
+#include <math.h>
+
+
+/*******************************************************************************
+ * Format parser.
+ */
+
+#define OCDFMTDEF_PLACEMENT_SHIFT 9
+#define OCDFMTDEF_PLACEMENT_MASK (3 << OCDFMTDEF_PLACEMENT_SHIFT)
+
+#define BVRED(Shift, Size) \
+	{ Shift, Size }
+
+#define BVGREEN(Shift, Size) \
+	{ Shift, Size }
+
+#define BVBLUE(Shift, Size) \
+	{ Shift, Size }
+
+#define BVALPHA(Shift, Size) \
+	{ Shift, Size }
+
+static const struct cpucomp xrgb4444_bits[4][4] = {
+	{ BVRED(8,  4), BVGREEN(4, 4), BVBLUE(0,  4), BVALPHA(12, 0) },
+	{ BVRED(12, 4), BVGREEN(8, 4), BVBLUE(4,  4), BVALPHA(0,  0) },
+	{ BVRED(0,  4), BVGREEN(4, 4), BVBLUE(8,  4), BVALPHA(12, 0) },
+	{ BVRED(4,  4), BVGREEN(8, 4), BVBLUE(12, 4), BVALPHA(0,  0) }
+};
+
+static const struct cpucomp argb4444_bits[4][4] = {
+	{ BVRED(8,  4), BVGREEN(4, 4), BVBLUE(0,  4), BVALPHA(12, 4) },
+	{ BVRED(12, 4), BVGREEN(8, 4), BVBLUE(4,  4), BVALPHA(0,  4) },
+	{ BVRED(0,  4), BVGREEN(4, 4), BVBLUE(8,  4), BVALPHA(12, 4) },
+	{ BVRED(4,  4), BVGREEN(8, 4), BVBLUE(12, 4), BVALPHA(0,  4) }
+};
+
+static const struct cpucomp xrgb1555_bits[4][4] = {
+	{ BVRED(10, 5), BVGREEN(5, 5), BVBLUE(0,  5), BVALPHA(15, 0) },
+	{ BVRED(11, 5), BVGREEN(6, 5), BVBLUE(1,  5), BVALPHA(0,  0) },
+	{ BVRED(0,  5), BVGREEN(5, 5), BVBLUE(10, 5), BVALPHA(15, 0) },
+	{ BVRED(1,  5), BVGREEN(6, 5), BVBLUE(11, 5), BVALPHA(0,  0) }
+};
+
+static const struct cpucomp argb1555_bits[4][4] = {
+	{ BVRED(10, 5), BVGREEN(5, 5), BVBLUE(0,  5), BVALPHA(15, 1) },
+	{ BVRED(11, 5), BVGREEN(6, 5), BVBLUE(1,  5), BVALPHA(0,  1) },
+	{ BVRED(0,  5), BVGREEN(5, 5), BVBLUE(10, 5), BVALPHA(15, 1) },
+	{ BVRED(1,  5), BVGREEN(6, 5), BVBLUE(11, 5), BVALPHA(0,  1) }
+};
+
+static const struct cpucomp rgb565_bits[4][4] = {
+	{ BVRED(11, 5), BVGREEN(5, 6), BVBLUE(0,  5), BVALPHA(0, 0) },
+	{ BVRED(11, 5), BVGREEN(5, 6), BVBLUE(0,  5), BVALPHA(0, 0) },
+	{ BVRED(0,  5), BVGREEN(5, 6), BVBLUE(11, 5), BVALPHA(0, 0) },
+	{ BVRED(0,  5), BVGREEN(5, 6), BVBLUE(11, 5), BVALPHA(0, 0) }
+};
+
+static const struct cpucomp xrgb8888_bits[4][4] = {
+	{ BVRED(8,  8), BVGREEN(16, 8), BVBLUE(24, 8), BVALPHA(0,  0) },
+	{ BVRED(0,  8), BVGREEN(8,  8), BVBLUE(16, 8), BVALPHA(24, 0) },
+	{ BVRED(24, 8), BVGREEN(16, 8), BVBLUE(8,  8), BVALPHA(0,  0) },
+	{ BVRED(16, 8), BVGREEN(8,  8), BVBLUE(0,  8), BVALPHA(24, 0) }
+};
+
+static const struct cpucomp argb8888_bits[4][4] = {
+	{ BVRED(8,  8), BVGREEN(16, 8), BVBLUE(24, 8), BVALPHA(0,  8) },
+	{ BVRED(0,  8), BVGREEN(8,  8), BVBLUE(16, 8), BVALPHA(24, 8) },
+	{ BVRED(24, 8), BVGREEN(16, 8), BVBLUE(8,  8), BVALPHA(0,  8) },
+	{ BVRED(16, 8), BVGREEN(8,  8), BVBLUE(0,  8), BVALPHA(24, 8) }
+};
+
+static const unsigned int container[] = {
+	  8,	/* OCDFMTDEF_CONTAINER_8BIT */
+	 16,	/* OCDFMTDEF_CONTAINER_16BIT */
+	 24,	/* OCDFMTDEF_CONTAINER_24BIT */
+	 32,	/* OCDFMTDEF_CONTAINER_32BIT */
+	~0U,	/* reserved */
+	 48,	/* OCDFMTDEF_CONTAINER_48BIT */
+	~0U,	/* reserved */
+	 64	/* OCDFMTDEF_CONTAINER_64BIT */
+};
+
+/* Accepts the same set of formats as the GC implementation. */
+static enum bverror parse_format(struct bvbltparams *bvbltparams,
+				 struct cpusurface *surf)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct cpuformat *format;
+	const struct cpucomp *comp;
+	enum ocdformat ocdformat;
+	unsigned int cs, std, alpha, subsample, layout;
+	unsigned int reversed, leftjust, swizzle, cont, bits;
+	unsigned int allocbitspp;
+	uint32_t used;
+	int i;
+
+	format = &surf->format;
+	ocdformat = surf->geom->format;
+
+	memset(format, 0, sizeof(struct cpuformat));
+	format->ocdformat = ocdformat;
+
+	cs = (ocdformat & OCDFMTDEF_CS_MASK)
+		>> OCDFMTDEF_CS_SHIFT;
+	std = (ocdformat & OCDFMTDEF_STD_MASK)
+		>> OCDFMTDEF_STD_SHIFT;
+	alpha = ocdformat & OCDFMTDEF_ALPHA;
+	subsample = (ocdformat & OCDFMTDEF_SUBSAMPLE_MASK)
+		>> OCDFMTDEF_SUBSAMPLE_SHIFT;
+	layout = (ocdformat & OCDFMTDEF_LAYOUT_MASK)
+		>> OCDFMTDEF_LAYOUT_SHIFT;
+	cont = (ocdformat & OCDFMTDEF_CONTAINER_MASK)
+		>> OCDFMTDEF_CONTAINER_SHIFT;
+	bits = ((ocdformat & OCDFMTDEF_COMPONENTSIZEMINUS1_MASK)
+		>> OCDFMTDEF_COMPONENTSIZEMINUS1_SHIFT) + 1;
+
+	switch (cs) {
+	case (OCDFMTDEF_CS_RGB >> OCDFMTDEF_CS_SHIFT):
+		/* Determine the swizzle. */
+		swizzle = (ocdformat & OCDFMTDEF_PLACEMENT_MASK)
+			>> OCDFMTDEF_PLACEMENT_SHIFT;
+
+		/* RGB color space. */
+		format->type = CPUFMT_RGB;
+
+		/* Has to be 0 for RGB. */
+		if (std != 0) {
+			BVSETBLTERROR(BVERR_UNK,
+				      "unsupported standard");
+			goto exit;
+		}
+
+		/* Determine premultuplied or not. */
+		if (alpha == OCDFMTDEF_ALPHA) {
+			format->premultiplied
+				= ((ocdformat & OCDFMTDEF_NON_PREMULT) == 0);
+		} else {
+			format->premultiplied = true;
+
+			if ((ocdformat & OCDFMTDEF_FILL_EMPTY_0) != 0) {
+				BVSETBLTERROR(BVERR_UNK,
+					      "0 filling is not supported");
+				goto exit;
+			}
+		}
+
+		/* No subsample support. */
+		if (subsample !=
+		    (OCDFMTDEF_SUBSAMPLE_NONE >> OCDFMTDEF_SUBSAMPLE_SHIFT)) {
+			BVSETBLTERROR(BVERR_UNK,
+					"subsampling for RGB is not supported");
+			goto exit;
+		}
+
+		/* Only packed RGB is supported. */
+		if (layout !=
+		    (OCDFMTDEF_PACKED >> OCDFMTDEF_LAYOUT_SHIFT)) {
+			BVSETBLTERROR(BVERR_UNK,
+				      "only packed RGBA formats are supported");
+			goto exit;
+		}
+
+		/* Determine the format. */
+		switch (bits) {
+		case 12:
+			format->bitspp = 16;
+			comp = (alpha == OCDFMTDEF_ALPHA)
+			     ? argb4444_bits[swizzle]
+			     : xrgb4444_bits[swizzle];
+			break;
+
+		case 15:
+			format->bitspp = 16;
+			comp = (alpha == OCDFMTDEF_ALPHA)
+			     ? argb1555_bits[swizzle]
+			     : xrgb1555_bits[swizzle];
+			break;
+
+		case 16:
+			if (alpha == OCDFMTDEF_ALPHA) {
+				BVSETBLTERROR(BVERR_UNK,
+					      "alpha component is not supported"
+					      "for this format.");
+				goto exit;
+			}
+
+			format->bitspp = 16;
+			comp = rgb565_bits[swizzle];
+			break;
+
+		case 24:
+			format->bitspp = 32;
+			comp = (alpha == OCDFMTDEF_ALPHA)
+			     ? argb8888_bits[swizzle]
+			     : xrgb8888_bits[swizzle];
+			break;
+
+		default:
+			BVSETBLTERROR(BVERR_UNK,
+				      "unsupported bit width %d", bits);
+			goto exit;
+		}
+
+		if (format->bitspp != container[cont]) {
+			BVSETBLTERROR(BVERR_UNK,
+				      "unsupported container");
+			goto exit;
+		}
+
+		/* Unused bits are written as ones. */
+		memcpy(format->comp, comp, sizeof(format->comp));
+		used = 0;
+		for (i = 0; i < 4; i += 1)
+			used |= ((1U << comp[i].size) - 1) << comp[i].shift;
+		format->fillmask = ((format->bitspp == 32) ? 0xFFFFFFFF
+							   : 0x0000FFFF)
+				 & ~used;
+		break;
+
+	case (OCDFMTDEF_CS_YCbCr >> OCDFMTDEF_CS_SHIFT):
+		/* YUV color space. */
+		format->type = CPUFMT_YUV;
+
+		/* Determine the swizzle. */
+		reversed = ocdformat & OCDFMTDEF_REVERSED;
+		leftjust = ocdformat & OCDFMTDEF_LEFT_JUSTIFIED;
+
+		/* Parse the standard. */
+		switch (std) {
+		case OCDFMTDEF_STD_ITUR_601_YCbCr >> OCDFMTDEF_STD_SHIFT:
+			format->yuv.std = CPUYUV_601;
+			break;
+
+		case OCDFMTDEF_STD_ITUR_709_YCbCr >> OCDFMTDEF_STD_SHIFT:
+			format->yuv.std = CPUYUV_709;
+			break;
+
+		default:
+			BVSETBLTERROR(BVERR_UNK,
+				      "unsupported color standard");
+			goto exit;
+		}
+
+		/* Alpha is not supported. */
+		if (alpha == OCDFMTDEF_ALPHA) {
+			BVSETBLTERROR(BVERR_UNK,
+				      "alpha channel is not supported");
+			goto exit;
+		}
+
+		format->premultiplied = true;
+		format->yuv.vfirst = (reversed != 0);
+
+		/* Parse subsampling. */
+		switch (subsample) {
+		case OCDFMTDEF_SUBSAMPLE_422_YCbCr >> OCDFMTDEF_SUBSAMPLE_SHIFT:
+			/* Parse layout. */
+			switch (layout) {
+			case OCDFMTDEF_PACKED >> OCDFMTDEF_LAYOUT_SHIFT:
+				if (container[cont] != 32) {
+					BVSETBLTERROR(BVERR_UNK,
+						      "unsupported container");
+					goto exit;
+				}
+
+				format->bitspp = 16;
+				allocbitspp = 16;
+				format->yuv.yfirst = (leftjust != 0);
+				format->yuv.planecount = 1;
+				format->yuv.xsample = 2;
+				format->yuv.ysample = 1;
+				break;
+
+			default:
+				BVSETBLTERROR(BVERR_UNK,
+					      "specified 4:2:2 layout "
+					      "is not supported");
+				goto exit;
+			}
+			break;
+
+		case OCDFMTDEF_SUBSAMPLE_420_YCbCr >> OCDFMTDEF_SUBSAMPLE_SHIFT:
+			/* Parse layout. */
+			switch (layout) {
+			case OCDFMTDEF_2_PLANE_YCbCr
+						>> OCDFMTDEF_LAYOUT_SHIFT:
+				if (container[cont] != 48) {
+					BVSETBLTERROR(BVERR_UNK,
+						      "unsupported container");
+					goto exit;
+				}
+
+				format->bitspp = 8;
+				allocbitspp = 12;
+				format->yuv.planecount = 2;
+				format->yuv.xsample = 2;
+				format->yuv.ysample = 2;
+				break;
+
+			case OCDFMTDEF_3_PLANE_STACKED
+						>> OCDFMTDEF_LAYOUT_SHIFT:
+				if (container[cont] != 48) {
+					BVSETBLTERROR(BVERR_UNK,
+						      "unsupported container");
+					goto exit;
+				}
+
+				format->bitspp = 8;
+				allocbitspp = 12;
+				format->yuv.planecount = 3;
+				format->yuv.xsample = 2;
+				format->yuv.ysample = 2;
+				break;
+
+			default:
+				BVSETBLTERROR(BVERR_UNK,
+					      "specified 4:2:0 layout "
+					      "is not supported");
+				goto exit;
+			}
+			break;
+
+		default:
+			BVSETBLTERROR(BVERR_UNK,
+				      "specified subsampling is not supported");
+			goto exit;
+		}
+
+		if (allocbitspp != bits) {
+			BVSETBLTERROR(BVERR_UNK,
+				      "unsupported bit width %d", bits);
+			goto exit;
+		}
+		break;
+
+	default:
+		BVSETBLTERROR(BVERR_UNK,
+			      "unsupported color space %d", cs);
+		goto exit;
+	}
+
+exit:
+	return bverror;
+}
+
+
+/*******************************************************************************
+ * Alpha blending parser.
+ */
+
+/* Translates one classic blend coefficient. */
+static bool parse_factor(unsigned int k, enum cpufactor *factor)
+{
+	static const enum cpufactor normal[] = {
+		CPUFACTOR_C1, CPUFACTOR_A1, CPUFACTOR_C2, CPUFACTOR_A2
+	};
+	static const enum cpufactor inverse[] = {
+		CPUFACTOR_INV_C1, CPUFACTOR_INV_A1,
+		CPUFACTOR_INV_C2, CPUFACTOR_INV_A2
+	};
+	unsigned int inv, norm;
+	bool invalpha, normalpha;
+
+	inv = (k & BVBLENDDEF_INV_MASK) >> BVBLENDDEF_INV_SHIFT;
+	norm = (k & BVBLENDDEF_NORM_MASK) >> BVBLENDDEF_NORM_SHIFT;
+
+	/* Odd selectors are the alpha components. */
+	invalpha = (inv & 1) != 0;
+	normalpha = (norm & 1) != 0;
+
+	switch (k & BVBLENDDEF_MODE_MASK) {
+	case BVBLENDDEF_ONLY_A:
+		/* Only the alpha selector counts, none means zero. */
+		if (invalpha && normalpha)
+			return false;
+		*factor = invalpha ? inverse[inv]
+			: normalpha ? normal[norm]
+			: CPUFACTOR_ZERO;
+		return true;
+
+	case BVBLENDDEF_ONLY_C:
+		/* Only the color selector counts, none means one. */
+		if (!invalpha && !normalpha)
+			return false;
+		*factor = !invalpha ? inverse[inv]
+			: !normalpha ? normal[norm]
+			: CPUFACTOR_ONE;
+		return true;
+
+	case BVBLENDDEF_MIN:
+		/* min(1 - inv, norm) over the two source alphas. */
+		if ((inv == 1) && (norm == 3)) {
+			*factor = CPUFACTOR_MIN_INV_A1_A2;
+			return true;
+		}
+		if ((inv == 3) && (norm == 1)) {
+			*factor = CPUFACTOR_MIN_INV_A2_A1;
+			return true;
+		}
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+static bool factor_uses(enum cpufactor factor, int src)
+{
+	switch (factor) {
+	case CPUFACTOR_C1:
+	case CPUFACTOR_A1:
+	case CPUFACTOR_INV_C1:
+	case CPUFACTOR_INV_A1:
+		return src == 0;
+
+	case CPUFACTOR_C2:
+	case CPUFACTOR_A2:
+	case CPUFACTOR_INV_C2:
+	case CPUFACTOR_INV_A2:
+		return src == 1;
+
+	case CPUFACTOR_MIN_INV_A1_A2:
+	case CPUFACTOR_MIN_INV_A2_A1:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static enum bverror parse_blend(struct bvbltparams *bvbltparams,
+				enum bvblend blend,
+				struct cpublt *blt)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct cpublend *params = &blt->blendparams;
+	unsigned int global;
+	int i;
+
+	/* The format occupies the top bits, BVBLENDDEF_FORMAT_MASK
+	 * overflows an int. */
+	if (((unsigned int) blend >> BVBLENDDEF_FORMAT_SHIFT) !=
+	    (BVBLENDDEF_FORMAT_CLASSIC >> BVBLENDDEF_FORMAT_SHIFT)) {
+		BVSETBLTERROR(BVERR_BLEND,
+			      "blend format not supported");
+		goto exit;
+	}
+
+	if ((blend & BVBLENDDEF_REMOTE) != 0) {
+		BVSETBLTERROR(BVERR_BLEND, "remote alpha not supported");
+		goto exit;
+	}
+
+	global = (blend & BVBLENDDEF_GLOBAL_MASK) >> BVBLENDDEF_GLOBAL_SHIFT;
+
+	switch (global) {
+	case (BVBLENDDEF_GLOBAL_NONE >> BVBLENDDEF_GLOBAL_SHIFT):
+		params->globalalpha = 255;
+		break;
+
+	case (BVBLENDDEF_GLOBAL_UCHAR >> BVBLENDDEF_GLOBAL_SHIFT):
+		params->globalalpha = bvbltparams->globalalpha.size8;
+		break;
+
+	case (BVBLENDDEF_GLOBAL_FLOAT >> BVBLENDDEF_GLOBAL_SHIFT):
+		params->globalalpha = cpufp2norm8(bvbltparams->globalalpha.fp);
+		break;
+
+	default:
+		BVSETBLTERROR(BVERR_BLEND, "invalid global alpha mode");
+		goto exit;
+	}
+
+	/*
+		Co = k1 x C1 + k2 x C2
+		Ao = k3 x A1 + k4 x A2
+	*/
+
+	if (!parse_factor((blend >> BVBLENDDEF_K1_SHIFT) & 0x3F,
+			  &params->k1) ||
+	    !parse_factor((blend >> BVBLENDDEF_K2_SHIFT) & 0x3F,
+			  &params->k2) ||
+	    !parse_factor((blend >> BVBLENDDEF_K3_SHIFT) & 0x3F,
+			  &params->k3) ||
+	    !parse_factor((blend >> BVBLENDDEF_K4_SHIFT) & 0x3F,
+			  &params->k4)) {
+		BVSETBLTERROR(BVERR_BLEND,
+			      "not supported coefficient combination");
+		goto exit;
+	}
+
+	/* A source is needed if its term is not zero or if the other
+	 * term is weighted by it. */
+	for (i = 0; i < 2; i += 1)
+		blt->srcused[i] = factor_uses(params->k1, i)
+				|| factor_uses(params->k2, i)
+				|| factor_uses(params->k3, i)
+				|| factor_uses(params->k4, i);
+
+	if ((params->k1 != CPUFACTOR_ZERO) || (params->k3 != CPUFACTOR_ZERO))
+		blt->srcused[0] = true;
+
+	if ((params->k2 != CPUFACTOR_ZERO) || (params->k4 != CPUFACTOR_ZERO))
+		blt->srcused[1] = true;
+
+	params->src1over = (params->k1 == CPUFACTOR_ONE)
+			&& (params->k2 == CPUFACTOR_INV_A1)
+			&& (params->k3 == CPUFACTOR_ONE)
+			&& (params->k4 == CPUFACTOR_INV_A1);
+
+	/* Plain copies of either source. */
+	if ((params->globalalpha == 255) &&
+	    (params->k1 == CPUFACTOR_ONE) && (params->k3 == CPUFACTOR_ONE) &&
+	    (params->k2 == CPUFACTOR_ZERO) && (params->k4 == CPUFACTOR_ZERO))
+		blt->passthrough = 0;
+
+	if ((params->k1 == CPUFACTOR_ZERO) && (params->k3 == CPUFACTOR_ZERO) &&
+	    (params->k2 == CPUFACTOR_ONE) && (params->k4 == CPUFACTOR_ONE))
+		blt->passthrough = 1;
+
+exit:
+	return bverror;
+}
+
+
+/*******************************************************************************
+ * Scale mode parser.
+ */
+
+static enum bverror parse_implicitscale(struct bvbltparams *bvbltparams,
+					unsigned int *horkernelsize,
+					unsigned int *verkernelsize)
+{
+	enum bverror bverror = BVERR_NONE;
+	unsigned int quality;
+	unsigned int technique;
+	unsigned int imagetype;
+
+	quality = (bvbltparams->scalemode & BVSCALEDEF_QUALITY_MASK)
+		>> BVSCALEDEF_QUALITY_SHIFT;
+	technique = (bvbltparams->scalemode & BVSCALEDEF_TECHNIQUE_MASK)
+		  >> BVSCALEDEF_TECHNIQUE_SHIFT;
+	imagetype = (bvbltparams->scalemode & BVSCALEDEF_TYPE_MASK)
+		  >> BVSCALEDEF_TYPE_SHIFT;
+
+	switch (quality) {
+	case BVSCALEDEF_FASTEST >> BVSCALEDEF_QUALITY_SHIFT:
+		*horkernelsize = *verkernelsize = 3;
+		break;
+
+	case BVSCALEDEF_GOOD >> BVSCALEDEF_QUALITY_SHIFT:
+		*horkernelsize = *verkernelsize = 5;
+		break;
+
+	case BVSCALEDEF_BETTER >> BVSCALEDEF_QUALITY_SHIFT:
+		*horkernelsize = *verkernelsize = 7;
+		break;
+
+	case BVSCALEDEF_BEST >> BVSCALEDEF_QUALITY_SHIFT:
+		*horkernelsize = *verkernelsize = 9;
+		break;
+
+	default:
+		BVSETBLTERROR(BVERR_SCALE_MODE,
+			      "unsupported scale quality 0x%02X", quality);
+		goto exit;
+	}
+
+	switch (technique) {
+	case BVSCALEDEF_DONT_CARE >> BVSCALEDEF_TECHNIQUE_SHIFT:
+	case BVSCALEDEF_NOT_NEAREST_NEIGHBOR >> BVSCALEDEF_TECHNIQUE_SHIFT:
+	case BVSCALEDEF_INTERPOLATED >> BVSCALEDEF_TECHNIQUE_SHIFT:
+		break;
+
+	case BVSCALEDEF_POINT_SAMPLE >> BVSCALEDEF_TECHNIQUE_SHIFT:
+		*horkernelsize = *verkernelsize = 1;
+		break;
+
+	default:
+		BVSETBLTERROR(BVERR_SCALE_MODE,
+			      "unsupported scale technique %d", technique);
+		goto exit;
+	}
+
+	switch (imagetype) {
+	case 0:
+	case BVSCALEDEF_PHOTO >> BVSCALEDEF_TYPE_SHIFT:
+	case BVSCALEDEF_DRAWING >> BVSCALEDEF_TYPE_SHIFT:
+		break;
+
+	default:
+		BVSETBLTERROR(BVERR_SCALE_MODE,
+			      "unsupported image type %d", imagetype);
+		goto exit;
+	}
+
+exit:
+	return bverror;
+}
+
+static bool parse_kernelsize(unsigned int size, unsigned int *kernelsize)
+{
+	switch (size) {
+	case BVSCALEDEF_NEAREST_NEIGHBOR:
+		*kernelsize = 1;
+		return true;
+
+	case BVSCALEDEF_LINEAR:
+	case BVSCALEDEF_CUBIC:
+	case BVSCALEDEF_3_TAP:
+		*kernelsize = 3;
+		return true;
+
+	case BVSCALEDEF_5_TAP:
+		*kernelsize = 5;
+		return true;
+
+	case BVSCALEDEF_7_TAP:
+		*kernelsize = 7;
+		return true;
+
+	case BVSCALEDEF_9_TAP:
+		*kernelsize = 9;
+		return true;
+	}
+
+	return false;
+}
+
+static enum bverror parse_explicitscale(struct bvbltparams *bvbltparams,
+					unsigned int *horkernelsize,
+					unsigned int *verkernelsize)
+{
+	enum bverror bverror = BVERR_NONE;
+	unsigned int horsize;
+	unsigned int versize;
+
+	horsize = (bvbltparams->scalemode & BVSCALEDEF_HORZ_MASK)
+		>> BVSCALEDEF_HORZ_SHIFT;
+	versize = (bvbltparams->scalemode & BVSCALEDEF_VERT_MASK)
+		  >> BVSCALEDEF_VERT_SHIFT;
+
+	if (!parse_kernelsize(horsize, horkernelsize)) {
+		BVSETBLTERROR(BVERR_SCALE_MODE,
+			      "unsupported horizontal kernel size %d", horsize);
+		goto exit;
+	}
+
+	if (!parse_kernelsize(versize, verkernelsize)) {
+		BVSETBLTERROR(BVERR_SCALE_MODE,
+			      "unsupported vertical kernel size %d", versize);
+		goto exit;
+	}
+
+exit:
+	return bverror;
+}
+
+static enum bverror parse_scalemode(struct bvbltparams *bvbltparams,
+				    unsigned int *horkernelsize,
+				    unsigned int *verkernelsize)
+{
+	enum bverror bverror;
+	unsigned int scaleclass;
+
+	scaleclass = (bvbltparams->scalemode & BVSCALEDEF_CLASS_MASK)
+		   >> BVSCALEDEF_CLASS_SHIFT;
+
+	switch (scaleclass) {
+	case BVSCALEDEF_IMPLICIT >> BVSCALEDEF_CLASS_SHIFT:
+		bverror = parse_implicitscale(bvbltparams,
+					      horkernelsize, verkernelsize);
+		break;
+
+	case BVSCALEDEF_EXPLICIT >> BVSCALEDEF_CLASS_SHIFT:
+		bverror = parse_explicitscale(bvbltparams,
+					      horkernelsize, verkernelsize);
+		break;
+
+	default:
+		BVSETBLTERROR(BVERR_SCALE_MODE,
+			      "unsupported scale class %d", scaleclass);
+		goto exit;
+	}
+
+exit:
+	return bverror;
+}
+
+/* Explicit scale mode matching a kernel size, for BVFLAG_SCALE_RETURN. */
+static unsigned int explicit_kernel(unsigned int kernelsize)
+{
+	switch (kernelsize) {
+	case 1:  return BVSCALEDEF_NEAREST_NEIGHBOR;
+	case 3:  return BVSCALEDEF_3_TAP;
+	case 5:  return BVSCALEDEF_5_TAP;
+	case 7:  return BVSCALEDEF_7_TAP;
+	default: return BVSCALEDEF_9_TAP;
+	}
+}
+
+
+/*******************************************************************************
+ * Rotation and mirror.
+ */
+
+/* NOTE: BLTsville rotation is defined conunter clock wise. */
+int get_angle(int orientation)
+{
+	int angle;
+
+	/* Normalize the angle. */
+	angle = orientation % 360;
+
+	/* Flip to positive. */
+	if (angle < 0)
+		angle = 360 + angle;
+
+	/* Translate the angle. */
+	switch (angle) {
+	case 0:   return ROT_ANGLE_0;
+	case 90:  return ROT_ANGLE_90;
+	case 180: return ROT_ANGLE_180;
+	case 270: return ROT_ANGLE_270;
+	}
+
+	/* Not supported angle. */
+	return ROT_ANGLE_INVALID;
+}
+
+/* Maps a point of the virtual (displayed) surface of width w and height h
+ * to memory; the image is stored rotated counter clockwise by the angle. */
+static void virt_to_phys(int angle, double w, double h,
+			 double vx, double vy, double *px, double *py)
+{
+	switch (angle) {
+	case ROT_ANGLE_0:
+		*px = vx;
+		*py = vy;
+		break;
+
+	case ROT_ANGLE_90:
+		*px = vy;
+		*py = w - vx;
+		break;
+
+	case ROT_ANGLE_180:
+		*px = w - vx;
+		*py = h - vy;
+		break;
+
+	default:
+		*px = h - vy;
+		*py = vx;
+		break;
+	}
+}
+
+static void phys_to_virt(int angle, double w, double h,
+			 double px, double py, double *vx, double *vy)
+{
+	switch (angle) {
+	case ROT_ANGLE_0:
+		*vx = px;
+		*vy = py;
+		break;
+
+	case ROT_ANGLE_90:
+		*vx = w - py;
+		*vy = px;
+		break;
+
+	case ROT_ANGLE_180:
+		*vx = w - px;
+		*vy = h - py;
+		break;
+
+	default:
+		*vx = py;
+		*vy = h - px;
+		break;
+	}
+}
+
+static void rotate_rect(int angle, struct bvsurfgeom *geom,
+			struct bvrect *rect, struct cpurect *physrect)
+{
+	double x0, y0, x1, y1;
+
+	virt_to_phys(angle, geom->width, geom->height,
+		     rect->left, rect->top, &x0, &y0);
+	virt_to_phys(angle, geom->width, geom->height,
+		     rect->left + rect->width, rect->top + rect->height,
+		     &x1, &y1);
+
+	physrect->left = (int) ((x0 < x1) ? x0 : x1);
+	physrect->right = (int) ((x0 < x1) ? x1 : x0);
+	physrect->top = (int) ((y0 < y1) ? y0 : y1);
+	physrect->bottom = (int) ((y0 < y1) ? y1 : y0);
+}
+
+
+/*******************************************************************************
+ * Surface validation.
+ */
+
+struct surferrors {
+	const char *name;
+	enum bverror desc;
+	enum bverror descvers;
+	enum bverror virtaddr;
+	enum bverror len;
+	enum bverror geom;
+	enum bverror geomvers;
+	enum bverror format;
+	enum bverror stride;
+	enum bverror rect;
+	enum bverror rot;
+};
+
+static const struct surferrors g_surferrors[] = {
+	{
+		"destination",
+		BVERR_DSTDESC, BVERR_DSTDESC_VERS, BVERR_DSTDESC_VIRTADDR,
+		BVERR_DSTDESC_LEN, BVERR_DSTGEOM, BVERR_DSTGEOM_VERS,
+		BVERR_DSTGEOM_FORMAT, BVERR_DSTGEOM_STRIDE, BVERR_DSTRECT,
+		BVERR_DSTGEOM
+	},
+	{
+		"source1",
+		BVERR_SRC1DESC, BVERR_SRC1DESC_VERS, BVERR_SRC1DESC_VIRTADDR,
+		BVERR_SRC1DESC_LEN, BVERR_SRC1GEOM, BVERR_SRC1GEOM_VERS,
+		BVERR_SRC1GEOM_FORMAT, BVERR_SRC1GEOM_STRIDE, BVERR_SRC1RECT,
+		BVERR_SRC1_ROT
+	},
+	{
+		"source2",
+		BVERR_SRC2DESC, BVERR_SRC2DESC_VERS, BVERR_SRC2DESC_VIRTADDR,
+		BVERR_SRC2DESC_LEN, BVERR_SRC2GEOM, BVERR_SRC2GEOM_VERS,
+		BVERR_SRC2GEOM_FORMAT, BVERR_SRC2GEOM_STRIDE, BVERR_SRC2RECT,
+		BVERR_SRC2_ROT
+	}
+};
+
+static bool valid_rect(struct bvsurfgeom *geom, struct bvrect *rect)
+{
+	if ((rect->left < 0) || (rect->top < 0))
+		return false;
+
+	if ((rect->width == 0) || (rect->height == 0) ||
+	    (rect->width > CPU_MAX_DIM) || (rect->height > CPU_MAX_DIM))
+		return false;
+
+	if ((rect->left + rect->width > geom->width) ||
+	    (rect->top + rect->height > geom->height))
+		return false;
+
+	return true;
+}
+
+static enum bverror parse_surface(struct bvbltparams *bvbltparams,
+				  const struct surferrors *errors,
+				  struct bvbuffdesc *desc,
+				  struct bvsurfgeom *geom,
+				  struct bvrect *rect,
+				  struct cpusurface *surf)
+{
+	enum bverror bverror = BVERR_NONE;
+	unsigned long rowbytes, size1, size2, stride2;
+	unsigned long length;
+
+	surf->desc = desc;
+	surf->geom = geom;
+	surf->rect = *rect;
+
+	if (desc == NULL) {
+		BVSETBLTERROR(errors->desc,
+			      "%s buffer descriptor is NULL", errors->name);
+		goto exit;
+	}
+
+	if (desc->structsize < STRUCTSIZE(desc, map)) {
+		BVSETBLTERROR(errors->descvers,
+			      "%s buffer descriptor has invalid size",
+			      errors->name);
+		goto exit;
+	}
+
+	if (desc->virtaddr == NULL) {
+		BVSETBLTERROR(errors->virtaddr,
+			      "%s buffer has no virtual address",
+			      errors->name);
+		goto exit;
+	}
+
+	if (geom == NULL) {
+		BVSETBLTERROR(errors->geom,
+			      "%s geometry is NULL", errors->name);
+		goto exit;
+	}
+
+	if (geom->structsize < STRUCTSIZE(geom, palette)) {
+		BVSETBLTERROR(errors->geomvers,
+			      "%s geometry has invalid size", errors->name);
+		goto exit;
+	}
+
+	if (parse_format(bvbltparams, surf) != BVERR_NONE) {
+		bverror = errors->format;
+		goto exit;
+	}
+
+	surf->angle = get_angle(geom->orientation);
+	if (surf->angle == ROT_ANGLE_INVALID) {
+		BVSETBLTERROR(errors->rot,
+			      "unsupported %s orientation %d.",
+			      errors->name, geom->orientation);
+		goto exit;
+	}
+
+	if (!valid_rect(geom, rect)) {
+		BVSETBLTERROR(errors->rect,
+			      "invalid %s rectangle %d,%d %dx%d",
+			      errors->name, rect->left, rect->top,
+			      rect->width, rect->height);
+		goto exit;
+	}
+
+	if ((surf->angle % 2) == 0) {
+		surf->physwidth = geom->width;
+		surf->physheight = geom->height;
+	} else {
+		surf->physwidth = geom->height;
+		surf->physheight = geom->width;
+	}
+
+	/* Rows have to fit in the stride. */
+	rowbytes = (surf->physwidth * surf->format.bitspp) / 8;
+	if ((geom->virtstride <= 0) ||
+	    ((unsigned long) geom->virtstride < rowbytes)) {
+		BVSETBLTERROR(errors->stride,
+			      "%s stride %ld is too small",
+			      errors->name, geom->virtstride);
+		goto exit;
+	}
+
+	surf->plane[0] = (unsigned char *) desc->virtaddr;
+	surf->stride[0] = geom->virtstride;
+	length = geom->virtstride * (surf->physheight - 1) + rowbytes;
+
+	/* Chroma planes follow the luma plane, see set_computeyuv(). */
+	if (surf->format.type == CPUFMT_YUV &&
+	    surf->format.yuv.planecount > 1) {
+		size1 = geom->virtstride * surf->physheight;
+		stride2 = geom->virtstride / surf->format.yuv.xsample;
+		if (surf->format.yuv.planecount == 2)
+			stride2 *= 2;
+		size2 = stride2 * (surf->physheight / surf->format.yuv.ysample);
+
+		surf->plane[1] = surf->plane[0] + size1;
+		surf->stride[1] = stride2;
+		length = size1 + size2;
+
+		if (surf->format.yuv.planecount == 3) {
+			surf->plane[2] = surf->plane[1] + size2;
+			surf->stride[2] = stride2;
+			length += size2;
+		}
+
+		if (surf->physheight < surf->format.yuv.ysample) {
+			BVSETBLTERROR(errors->geom,
+				      "%s is too small for 4:2:0",
+				      errors->name);
+			goto exit;
+		}
+	}
+
+	if (desc->length < length) {
+		BVSETBLTERROR(errors->len,
+			      "%s geometry needs %lu bytes, buffer has %lu",
+			      errors->name, length, desc->length);
+		goto exit;
+	}
+
+	rotate_rect(surf->angle, geom, rect, &surf->physrect);
+
+exit:
+	return bverror;
+}
+
+
+/*******************************************************************************
+ * Source mapping.
+ */
+
+/* Maps a physical destination point to the physical source point it
+ * samples, following the destination orientation, the flips, the scaling
+ * and the source orientation. */
+static void map_point(struct cpublt *blt, struct cpusource *src,
+		      bool hflip, bool vflip,
+		      double dx, double dy, double *sx, double *sy)
+{
+	struct cpusurface *dst = &blt->dst;
+	double vx, vy, rx, ry;
+
+	phys_to_virt(dst->angle, dst->geom->width, dst->geom->height,
+		     dx, dy, &vx, &vy);
+
+	rx = (vx - dst->rect.left) / dst->rect.width;
+	ry = (vy - dst->rect.top) / dst->rect.height;
+
+	if (hflip)
+		rx = 1.0 - rx;
+	if (vflip)
+		ry = 1.0 - ry;
+
+	virt_to_phys(src->surf.angle,
+		     src->surf.geom->width, src->surf.geom->height,
+		     src->surf.rect.left + rx * src->surf.rect.width,
+		     src->surf.rect.top + ry * src->surf.rect.height,
+		     sx, sy);
+}
+
+static void map_source(struct cpublt *blt, struct cpusource *src,
+		       bool hflip, bool vflip,
+		       unsigned int horkernelsize, unsigned int verkernelsize)
+{
+	struct cpurect *dstrect = &blt->dst.physrect;
+	struct cpurect *srcrect = &src->surf.physrect;
+	double x0, y0, x1, y1, x2, y2;
+	double xstep, ystep;
+	unsigned int dstwidth, dstheight;
+	bool horizontal;
+	int i;
+
+	/* Follow one destination pixel and its right and lower
+	 * neighbours into the source. */
+	map_point(blt, src, hflip, vflip,
+		  dstrect->left + 0.5, dstrect->top + 0.5, &x0, &y0);
+	map_point(blt, src, hflip, vflip,
+		  dstrect->left + 1.5, dstrect->top + 0.5, &x1, &y1);
+	map_point(blt, src, hflip, vflip,
+		  dstrect->left + 0.5, dstrect->top + 1.5, &x2, &y2);
+
+	/* Source rows run along the destination columns if moving right
+	 * in the destination moves vertically in the source. */
+	src->transpose = fabs(y1 - y0) > fabs(x1 - x0);
+	xstep = src->transpose ? (x2 - x0) : (x1 - x0);
+	ystep = src->transpose ? (y1 - y0) : (y2 - y0);
+
+	dstwidth = dstrect->right - dstrect->left;
+	dstheight = dstrect->bottom - dstrect->top;
+
+	src->axis[0].lo = srcrect->left;
+	src->axis[0].span = srcrect->right - srcrect->left;
+	src->axis[0].dspan = src->transpose ? dstheight : dstwidth;
+	src->axis[0].reverse = xstep < 0;
+
+	src->axis[1].lo = srcrect->top;
+	src->axis[1].span = srcrect->bottom - srcrect->top;
+	src->axis[1].dspan = src->transpose ? dstwidth : dstheight;
+	src->axis[1].reverse = ystep < 0;
+
+	/* Source x follows the destination horizontal when it follows
+	 * the physical x of an upright destination. */
+	horizontal = (src->transpose == ((blt->dst.angle % 2) != 0));
+
+	for (i = 0; i < 2; i += 1) {
+		struct cpuaxis *axis = &src->axis[i];
+
+		if (axis->span == axis->dspan)
+			axis->taps = 0;
+		else if ((i == 0) == horizontal)
+			axis->taps = horkernelsize;
+		else
+			axis->taps = verkernelsize;
+
+		if (axis->taps > 1)
+			calculate_filter(axis);
+	}
+}
+
+
+/*******************************************************************************
+ * Blt parser.
+ */
+
+static enum bverror parse_source(struct bvbltparams *bvbltparams,
+				 struct cpublt *blt, int index,
+				 unsigned int *horkernelsize,
+				 unsigned int *verkernelsize,
+				 bool *scaleparsed)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct cpusource *src = &blt->src[index];
+	union bvinbuff *buff;
+	struct bvsurfgeom *geom;
+	struct bvrect *rect;
+	unsigned long hflip, vflip, tile;
+
+	if (index == 0) {
+		buff = &bvbltparams->src1;
+		geom = bvbltparams->src1geom;
+		rect = &bvbltparams->src1rect;
+		hflip = BVFLAG_HORZ_FLIP_SRC1;
+		vflip = BVFLAG_VERT_FLIP_SRC1;
+		tile = BVFLAG_TILE_SRC1;
+	} else {
+		buff = &bvbltparams->src2;
+		geom = bvbltparams->src2geom;
+		rect = &bvbltparams->src2rect;
+		hflip = BVFLAG_HORZ_FLIP_SRC2;
+		vflip = BVFLAG_VERT_FLIP_SRC2;
+		tile = BVFLAG_TILE_SRC2;
+	}
+
+	if ((bvbltparams->flags & tile) != 0) {
+		BVSETBLTERROR((index == 0) ? BVERR_SRC1_TILE : BVERR_SRC2_TILE,
+			      "tiled sources are not supported");
+		goto exit;
+	}
+
+	bverror = parse_surface(bvbltparams, &g_surferrors[1 + index],
+				buff->desc, geom, rect, &src->surf);
+	if (bverror != BVERR_NONE)
+		goto exit;
+
+	/* A single pixel is replicated over the destination. */
+	if ((rect->width == 1) && (rect->height == 1)) {
+		src->solid = true;
+		src->color = cpu_read_pixel(&src->surf,
+					    src->surf.physrect.left,
+					    src->surf.physrect.top);
+		goto exit;
+	}
+
+	/* Determine the kernel sizes once scaling is needed. */
+	if (!*scaleparsed &&
+	    ((rect->width != bvbltparams->dstrect.width) ||
+	     (rect->height != bvbltparams->dstrect.height))) {
+		bverror = parse_scalemode(bvbltparams,
+					  horkernelsize, verkernelsize);
+		if (bverror != BVERR_NONE)
+			goto exit;
+
+		*scaleparsed = true;
+	}
+
+	map_source(blt, src,
+		   (bvbltparams->flags & hflip) != 0,
+		   (bvbltparams->flags & vflip) != 0,
+		   *horkernelsize, *verkernelsize);
+
+exit:
+	return bverror;
+}
+
+enum bverror parse_blt(struct bvbltparams *bvbltparams, struct cpublt *blt)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct bvrect cliprect;
+	unsigned int op, rop;
+	unsigned int horkernelsize = 1, verkernelsize = 1;
+	bool scaleparsed = false;
+	int left, top, right, bottom;
+	int i;
+
+	blt->bvbltparams = bvbltparams;
+	blt->passthrough = -1;
+	blt->path = CPUPATH_GENERIC;
+
+	op = bvbltparams->flags & BVFLAG_OP_MASK;
+	switch (op) {
+	case BVFLAG_ROP:
+		rop = bvbltparams->op.rop;
+
+		/* The upper byte applies where the mask is 0. */
+		if (((rop & 0xFF00) >> 8) != (rop & 0x00FF)) {
+			BVSETBLTERROR(BVERR_OP,
+				      "operation with mask not supported");
+			goto exit;
+		}
+
+		blt->rop = rop & 0xFF;
+		blt->srcused[0] = (((rop & 0xCC) >> 2) ^ (rop & 0x33)) != 0;
+		blt->srcused[1] = (((rop & 0xF0) >> 4) ^ (rop & 0x0F)) != 0;
+		blt->dstused = (((rop & 0xAA) >> 1) ^ (rop & 0x55)) != 0;
+
+		if (blt->rop == 0xCC)
+			blt->passthrough = 0;
+		else if (blt->rop == 0xF0)
+			blt->passthrough = 1;
+		break;
+
+	case BVFLAG_BLEND:
+		blt->blend = true;
+		bverror = parse_blend(bvbltparams, bvbltparams->op.blend, blt);
+		if (bverror != BVERR_NONE)
+			goto exit;
+		break;
+
+	case BVFLAG_FILTER:
+		BVSETBLTERROR(BVERR_OP,
+			      "filter operation not supported");
+		goto exit;
+
+	default:
+		BVSETBLTERROR(BVERR_OP, "unrecognized operation");
+		goto exit;
+	}
+
+	if ((bvbltparams->flags & (BVFLAG_KEY_SRC | BVFLAG_KEY_DST)) != 0) {
+		BVSETBLTERROR(BVERR_KEY, "color keys not supported");
+		goto exit;
+	}
+
+	if ((bvbltparams->flags &
+	     (BVFLAG_SRC2_AUXDSTRECT | BVFLAG_MASK_AUXDSTRECT)) != 0) {
+		BVSETBLTERROR(BVERR_FLAGS,
+			      "auxiliary destination rectangles "
+			      "not supported");
+		goto exit;
+	}
+
+	/* Destination. */
+	bverror = parse_surface(bvbltparams, &g_surferrors[0],
+				bvbltparams->dstdesc, bvbltparams->dstgeom,
+				&bvbltparams->dstrect, &blt->dst);
+	if (bverror != BVERR_NONE)
+		goto exit;
+
+	if (blt->dst.format.type != CPUFMT_RGB) {
+		BVSETBLTERROR(BVERR_DSTGEOM_FORMAT,
+			      "destination format unsupported");
+		goto exit;
+	}
+
+	/* Clip the destination rectangle. */
+	cliprect = bvbltparams->dstrect;
+	if ((bvbltparams->flags & BVFLAG_CLIP) != 0) {
+		left = bvbltparams->cliprect.left;
+		top = bvbltparams->cliprect.top;
+		right = left + (int) bvbltparams->cliprect.width;
+		bottom = top + (int) bvbltparams->cliprect.height;
+
+		if (left < cliprect.left)
+			left = cliprect.left;
+		if (top < cliprect.top)
+			top = cliprect.top;
+		if (right > cliprect.left + (int) cliprect.width)
+			right = cliprect.left + (int) cliprect.width;
+		if (bottom > cliprect.top + (int) cliprect.height)
+			bottom = cliprect.top + (int) cliprect.height;
+
+		/* Nothing left to draw. */
+		if ((left >= right) || (top >= bottom)) {
+			blt->path = CPUPATH_NOP;
+			goto exit;
+		}
+
+		cliprect.left = left;
+		cliprect.top = top;
+		cliprect.width = right - left;
+		cliprect.height = bottom - top;
+	}
+
+	rotate_rect(blt->dst.angle, blt->dst.geom, &cliprect, &blt->cliprect);
+
+	/* Sources. */
+	for (i = 0; i < 2; i += 1) {
+		if (!blt->srcused[i])
+			continue;
+
+		bverror = parse_source(bvbltparams, blt, i,
+				       &horkernelsize, &verkernelsize,
+				       &scaleparsed);
+		if (bverror != BVERR_NONE)
+			goto exit;
+	}
+
+	if (scaleparsed && ((bvbltparams->flags & BVFLAG_SCALE_RETURN) != 0))
+		/* Generic vendor and explicit class taken from a predefined
+		 * mode, BVSCALEDEF_VENDOR_GENERIC overflows an int. */
+		bvbltparams->scalemode = (enum bvscalemode)
+			((BVSCALE_NEAREST_NEIGHBOR &
+			  ~(BVSCALEDEF_HORZ_MASK | BVSCALEDEF_VERT_MASK)) |
+			 (explicit_kernel(horkernelsize)
+				<< BVSCALEDEF_HORZ_SHIFT) |
+			 (explicit_kernel(verkernelsize)
+				<< BVSCALEDEF_VERT_SHIFT));
+
+exit:
+	return bverror;
+}
@@ -83,3 +83,66 @@ ALL_DEFAULT_INSTALLED_MODULES += $(SYMLINKS) $(SYMLINKS1)
 # for mm/mmm
 all_modules: $(SYMLINKS) $(SYMLINKS1)
 
+
+# Host build of the library on top of the stub driver, for the command
+# stream test and for measuring the cost of building the commands. Only
+# this build carries the stub driver and the trace recorder.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	gcmain.c \
+	gcstub.c \
+	gctrace.c \
+	gcdecode.c \
+	mirror/gcbv.c \
+	mirror/gcparser.c \
+	mirror/gcmap.c \
+	mirror/gcbuffer.c \
+	mirror/gcfill.c \
+	mirror/gcblit.c \
+	mirror/gcfilter.c \
+	mirror/gcdbglog.c
+
+LOCAL_CFLAGS := -fno-short-enums -DGCBV_TEST_BACKENDS=1
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/mirror \
+	$(LOCAL_PATH)/mirror/include \
+	$(LOCAL_PATH)/../bltsville/include \
+	$(LOCAL_PATH)/../ocd/include
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/../bltsville/include \
+	$(LOCAL_PATH)/../ocd/include
+
+LOCAL_MODULE_TAGS    := optional
+LOCAL_MODULE         := libbltsville_gc2d_host
+LOCAL_MULTILIB       := 32
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# Summarizes, decodes and replays traces recorded with GCBV_TRACE.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	gcbvtrace.c \
+	gcstub.c \
+	gctrace.c \
+	gcdecode.c
+
+LOCAL_CFLAGS := -fno-short-enums
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/mirror \
+	$(LOCAL_PATH)/mirror/include \
+	$(LOCAL_PATH)/../bltsville/include \
+	$(LOCAL_PATH)/../ocd/include
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE_TAGS    := optional
+LOCAL_MODULE         := gcbvtrace
+LOCAL_MULTILIB       := 32
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,643 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc. and Vivante Corporation
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * gcbvtrace: inspects command stream traces recorded with GCBV_TRACE.
+ *
+ * Usage: gcbvtrace [-d] [-r <passes>] <trace>
+ *   -d  list every record, command buffers decoded symbolically
+ *   -r  replay the trace through the stub driver; every commit is checked
+ *       against the live mappings and the outcome compared to the one
+ *       the driver reported while recording
+ *
+ * Without options the summary is printed: command bytes per commit and
+ * per blit, how many state writes reload the value a state already holds,
+ * and the time spent in the driver and between commits.
+ */
+
+#include "gcmain.h"
+#include "gctrace.h"
+#include <time.h>
+
+static const char * const g_typenames[] = {
+	[GCTRACE_CAPS] = "CAPS",
+	[GCTRACE_MAP] = "MAP",
+	[GCTRACE_UNMAP] = "UNMAP",
+	[GCTRACE_COMMIT] = "COMMIT",
+	[GCTRACE_CALLBACK_ARM] = "CALLBACK_ARM",
+	[GCTRACE_CALLBACK] = "CALLBACK"
+};
+
+struct summary {
+	unsigned int records;
+	unsigned int count[GCTRACE_CALLBACK + 1];
+	unsigned long long duration[GCTRACE_CALLBACK + 1];
+	unsigned long long elapsed;
+
+	/* Time between the end of a commit and the start of the next. */
+	unsigned long long gap;
+	unsigned int gaps;
+	unsigned long long sinceend;
+
+	unsigned int async;
+	unsigned int errors;
+	unsigned long long pixels;
+	struct gcdecodestats stats;
+};
+
+static double percent(unsigned long long part, unsigned long long whole)
+{
+	return (whole == 0) ? 0.0 : (100.0 * part / whole);
+}
+
+static double ratio(unsigned long long part, unsigned long long whole)
+{
+	return (whole == 0) ? 0.0 : ((double) part / whole);
+}
+
+
+/*******************************************************************************
+ * Listing and summary.
+ */
+
+static int print_record(struct gctracefile *trace)
+{
+	struct gctracerecord *record = &trace->record;
+	struct gctracecommit commit;
+	struct gctracebuffer buffer;
+	uint32_t *data = trace->data;
+	unsigned int i;
+
+	printf("%-12s +%uus %uus", g_typenames[record->type],
+	       record->delta, record->duration);
+
+	if (record->gcerror != GCERR_NONE)
+		printf(" error 0x%08X", record->gcerror);
+
+	switch (record->type) {
+	case GCTRACE_CAPS:
+		printf(" model 0x%X revision 0x%X\n", data[0], data[1]);
+		break;
+
+	case GCTRACE_MAP:
+		printf(" handle 0x%08X size %u pagesize %u pages %u"
+		       " offset 0x%X\n",
+		       data[0], data[1], data[2], data[3], data[4]);
+		break;
+
+	case GCTRACE_UNMAP:
+		printf(" handle 0x%08X\n", data[0]);
+		break;
+
+	case GCTRACE_COMMIT:
+		if (gctrace_commit(trace, &commit) != 0)
+			return -1;
+
+		printf(" pipes %u-%u%s%s buffers %u\n",
+		       commit.entrypipe, commit.exitpipe,
+		       (commit.flags & GCTRACE_ASYNC) ? " async" : "",
+		       (commit.flags & GCTRACE_HASCALLBACK)
+				? " callback" : "",
+		       commit.buffercount);
+
+		for (i = 0; i < commit.buffercount; i += 1) {
+			if (gctrace_buffer(&commit, &buffer) != 0)
+				return -1;
+
+			printf("  BUFFER %u: %u bytes, %u pixels,"
+			       " %u fixups\n", i, buffer.wordcount * 4,
+			       buffer.pixelcount, buffer.fixupcount);
+			gcdecode_print(stdout, buffer.words, buffer.wordcount,
+				       buffer.fixups, buffer.fixupcount);
+		}
+
+		for (i = 0; i < commit.unmapcount; i += 1)
+			printf("  UNMAP 0x%08X\n", commit.unmap[i]);
+		break;
+
+	default:
+		printf("\n");
+	}
+
+	return 0;
+}
+
+static int account_record(struct summary *summary, struct gctracefile *trace)
+{
+	struct gctracerecord *record = &trace->record;
+	struct gctracecommit commit;
+	struct gctracebuffer buffer;
+	unsigned int i;
+
+	summary->records += 1;
+	summary->count[record->type] += 1;
+	summary->duration[record->type] += record->duration;
+	summary->elapsed += record->delta;
+	summary->sinceend += record->delta;
+
+	if (record->gcerror != GCERR_NONE)
+		summary->errors += 1;
+
+	if (record->type != GCTRACE_COMMIT)
+		return 0;
+
+	if (gctrace_commit(trace, &commit) != 0)
+		return -1;
+
+	if (summary->count[GCTRACE_COMMIT] > 1) {
+		summary->gap += summary->sinceend;
+		summary->gaps += 1;
+	}
+
+	if (commit.flags & GCTRACE_ASYNC)
+		summary->async += 1;
+
+	gcdecode_commit(&summary->stats);
+
+	for (i = 0; i < commit.buffercount; i += 1) {
+		if (gctrace_buffer(&commit, &buffer) != 0)
+			return -1;
+
+		summary->pixels += buffer.pixelcount;
+		gcdecode_buffer(&summary->stats, buffer.words,
+				buffer.wordcount, buffer.fixupcount);
+	}
+
+	/* The next gap starts when this commit returns; the deltas are
+	 * counted from its start. */
+	summary->sinceend = 0ULL - record->duration;
+
+	return 0;
+}
+
+static void print_summary(struct summary *summary)
+{
+	struct gcdecodestats *stats = &summary->stats;
+	unsigned int commits = summary->count[GCTRACE_COMMIT];
+	unsigned int maps = summary->count[GCTRACE_MAP];
+
+	printf("records      %u over %.3f s, %u failed\n", summary->records,
+	       summary->elapsed / 1000000.0, summary->errors);
+	printf("mappings     %u maps, %u unmaps\n",
+	       maps, summary->count[GCTRACE_UNMAP]);
+	printf("commits      %u, %u asynchronous, %u callbacks delivered\n",
+	       commits, summary->async, summary->count[GCTRACE_CALLBACK]);
+	printf("buffers      %u, %.1f per commit\n",
+	       stats->buffers, ratio(stats->buffers, commits));
+	printf("blits        %u, %u rectangles, %llu pixels\n",
+	       stats->blits, stats->rects, summary->pixels);
+	printf("command      %llu bytes, %.1f per commit, %.1f per blit\n",
+	       stats->words * 4, ratio(stats->words * 4, commits),
+	       ratio(stats->words * 4, stats->blits));
+	printf("states       %llu writes in %u loads, %.1f per blit\n",
+	       stats->states, stats->loadstates,
+	       ratio(stats->states, stats->blits));
+	printf("redundant    %llu (%.1f%%) within a commit,"
+	       " %llu (%.1f%%) left by the previous one\n",
+	       stats->redundant, percent(stats->redundant, stats->states),
+	       stats->carried, percent(stats->carried, stats->states));
+	printf("fixups       %u, %.1f per blit\n",
+	       stats->fixups, ratio(stats->fixups, stats->blits));
+
+	if (stats->malformed != 0)
+		printf("MALFORMED    %u buffers\n", stats->malformed);
+
+	printf("driver       %.1f us per commit, %.1f us per map\n",
+	       ratio(summary->duration[GCTRACE_COMMIT], commits),
+	       ratio(summary->duration[GCTRACE_MAP], maps));
+	printf("between      %.1f us from one commit to the next\n",
+	       ratio(summary->gap, summary->gaps));
+}
+
+
+/*******************************************************************************
+ * Replay.
+ */
+
+struct replay {
+	int handle;
+	unsigned long callback;
+
+	/* Recorded to stub map handles. */
+	uint32_t (*maps)[2];
+	unsigned int mapcount;
+	unsigned int mapcapacity;
+
+	/* Mappings made before the recording started. */
+	unsigned int adopted;
+
+	unsigned int commits;
+	unsigned int mismatches;
+	unsigned int callbacks;
+	unsigned long long nsec;
+};
+
+static void replay_callback(void *callbackparam)
+{
+	struct replay *replay = callbackparam;
+	replay->callbacks += 1;
+}
+
+static unsigned long long replay_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int add_map(struct replay *replay, uint32_t handle, unsigned int size,
+		   unsigned int pagesize, enum gcerror *gcerror)
+{
+	struct gcimap gcimap;
+	void *maps;
+
+	if (replay->mapcount == replay->mapcapacity) {
+		replay->mapcapacity = replay->mapcapacity * 2 + 64;
+		maps = realloc(replay->maps,
+			       replay->mapcapacity * sizeof(*replay->maps));
+		if (maps == NULL)
+			return -1;
+		replay->maps = maps;
+	}
+
+	memset(&gcimap, 0, sizeof(gcimap));
+	gcimap.size = size;
+	gcimap.pagesize = pagesize;
+
+	gcdevice_stub.ioctl(replay->handle, GCIOCTL_MAP, &gcimap);
+	*gcerror = gcimap.gcerror;
+
+	if (gcimap.gcerror == GCERR_NONE) {
+		replay->maps[replay->mapcount][0] = handle;
+		replay->maps[replay->mapcount][1] = gcimap.handle;
+		replay->mapcount += 1;
+	}
+
+	return 0;
+}
+
+static uint32_t translate(struct replay *replay, uint32_t handle, bool remove)
+{
+	enum gcerror gcerror;
+	unsigned int i;
+	uint32_t result;
+
+	while (1) {
+		for (i = 0; i < replay->mapcount; i += 1) {
+			if (replay->maps[i][0] != handle)
+				continue;
+
+			result = replay->maps[i][1];
+			if (remove)
+				memcpy(replay->maps[i],
+				       replay->maps[--replay->mapcount],
+				       sizeof(replay->maps[i]));
+			return result;
+		}
+
+		/* A mapping made before the recording started; stand in
+		 * for it with one of unknown size. */
+		if ((add_map(replay, handle, 1, 0, &gcerror) != 0) ||
+		    (gcerror != GCERR_NONE))
+			return 0;
+
+		replay->adopted += 1;
+	}
+}
+
+static int replay_map(struct replay *replay, struct gctracefile *trace)
+{
+	enum gcerror gcerror;
+
+	if (add_map(replay, trace->data[0], trace->data[1], trace->data[2],
+		    &gcerror) != 0)
+		return -1;
+
+	if (gcerror != trace->record.gcerror)
+		replay->mismatches += 1;
+
+	return 0;
+}
+
+static int replay_commit(struct replay *replay, struct gctracefile *trace)
+{
+	struct gcicommit gcicommit;
+	struct gctracecommit commit;
+	struct gctracebuffer buffer;
+	struct gcbuffer *gcbuffer;
+	struct gcfixup *gcfixup;
+	struct gcschedunmap *gcschedunmap;
+	struct gcicallbackwait gcicallbackwait;
+	unsigned long long start;
+	unsigned int i, j, offset;
+	int result = -1;
+
+	if (gctrace_commit(trace, &commit) != 0)
+		return -1;
+
+	memset(&gcicommit, 0, sizeof(gcicommit));
+	gcicommit.entrypipe = commit.entrypipe;
+	gcicommit.exitpipe = commit.exitpipe;
+	gcicommit.asynchronous = (commit.flags & GCTRACE_ASYNC) != 0;
+	INIT_LIST_HEAD(&gcicommit.buffer);
+	INIT_LIST_HEAD(&gcicommit.unmap);
+
+	if (commit.flags & GCTRACE_HASCALLBACK) {
+		gcicommit.callback = replay_callback;
+		gcicommit.callbackparam = replay;
+		gcicommit.handle = replay->callback;
+	}
+
+	/* Rebuild the buffers with the handles of the stub. */
+	for (i = 0; i < commit.buffercount; i += 1) {
+		if (gctrace_buffer(&commit, &buffer) != 0)
+			goto exit;
+
+		gcbuffer = malloc(sizeof(struct gcbuffer)
+				  + buffer.wordcount * sizeof(uint32_t));
+		if (gcbuffer == NULL)
+			goto exit;
+
+		INIT_LIST_HEAD(&gcbuffer->fixup);
+		list_add_tail(&gcbuffer->link, &gcicommit.buffer);
+
+		gcbuffer->pixelcount = buffer.pixelcount;
+		gcbuffer->head = (unsigned int *) (gcbuffer + 1);
+		gcbuffer->tail = gcbuffer->head + buffer.wordcount;
+		gcbuffer->available = 0;
+		memcpy(gcbuffer->head, buffer.words,
+		       buffer.wordcount * sizeof(uint32_t));
+
+		gcfixup = NULL;
+		for (j = 0; j < buffer.fixupcount; j += 1) {
+			if ((gcfixup == NULL) ||
+			    (gcfixup->count == GC_FIXUP_MAX)) {
+				gcfixup = malloc(sizeof(struct gcfixup));
+				if (gcfixup == NULL)
+					goto exit;
+
+				gcfixup->count = 0;
+				list_add_tail(&gcfixup->link,
+					      &gcbuffer->fixup);
+			}
+
+			offset = buffer.fixups[j * 2];
+			gcfixup->fixup[gcfixup->count].dataoffset = offset;
+			gcfixup->fixup[gcfixup->count].surfoffset
+				= buffer.fixups[j * 2 + 1];
+			gcfixup->count += 1;
+
+			if (offset < buffer.wordcount)
+				gcbuffer->head[offset] = translate(
+					replay, gcbuffer->head[offset], false);
+		}
+	}
+
+	for (i = 0; i < commit.unmapcount; i += 1) {
+		gcschedunmap = malloc(sizeof(struct gcschedunmap));
+		if (gcschedunmap == NULL)
+			goto exit;
+
+		gcschedunmap->handle = translate(replay, commit.unmap[i],
+						 true);
+		list_add_tail(&gcschedunmap->link, &gcicommit.unmap);
+	}
+
+	start = replay_time();
+	gcdevice_stub.ioctl(replay->handle, GCIOCTL_COMMIT, &gcicommit);
+	replay->nsec += replay_time() - start;
+	replay->commits += 1;
+
+	if (gcicommit.gcerror != trace->record.gcerror)
+		replay->mismatches += 1;
+
+	/* Deliver the callbacks queued by the commit. */
+	gcicallbackwait.handle = replay->callback;
+	gcicallbackwait.timeoutms = 0;
+	while (1) {
+		gcdevice_stub.ioctl(replay->handle, GCIOCTL_CALLBACK_WAIT,
+				    &gcicallbackwait);
+		if (gcicallbackwait.gcerror != GCERR_NONE)
+			break;
+
+		gcicallbackwait.callback(gcicallbackwait.callbackparam);
+	}
+
+	result = 0;
+
+exit:
+	while (!list_empty(&gcicommit.buffer)) {
+		gcbuffer = list_first_entry(&gcicommit.buffer,
+					    struct gcbuffer, link);
+
+		while (!list_empty(&gcbuffer->fixup)) {
+			gcfixup = list_first_entry(&gcbuffer->fixup,
+						   struct gcfixup, link);
+			list_del(&gcfixup->link);
+			free(gcfixup);
+		}
+
+		list_del(&gcbuffer->link);
+		free(gcbuffer);
+	}
+
+	while (!list_empty(&gcicommit.unmap)) {
+		gcschedunmap = list_first_entry(&gcicommit.unmap,
+						struct gcschedunmap, link);
+		list_del(&gcschedunmap->link);
+		free(gcschedunmap);
+	}
+
+	return result;
+}
+
+static int replay_pass(struct replay *replay, const char *path)
+{
+	struct gctracefile trace;
+	struct gcicallback gcicallback;
+	struct gcimap gcimap;
+	int result;
+
+	if (gctrace_open(&trace, path) != 0)
+		return -1;
+
+	gcstub_reset();
+	replay->handle = gcdevice_stub.open();
+	replay->mapcount = 0;
+
+	gcdevice_stub.ioctl(replay->handle, GCIOCTL_CALLBACK_ALLOC,
+			    &gcicallback);
+	replay->callback = gcicallback.handle;
+
+	while ((result = gctrace_read(&trace)) > 0) {
+		switch (trace.record.type) {
+		case GCTRACE_CAPS:
+			gcstub_caps(trace.data, trace.record.size / 4);
+			break;
+
+		case GCTRACE_MAP:
+			result = (trace.record.size >= 20)
+			       ? replay_map(replay, &trace) : -1;
+			break;
+
+		case GCTRACE_UNMAP:
+			if (trace.record.size < 4) {
+				result = -1;
+				break;
+			}
+
+			memset(&gcimap, 0, sizeof(gcimap));
+			gcimap.handle = translate(replay, trace.data[0], true);
+			gcdevice_stub.ioctl(replay->handle, GCIOCTL_UNMAP,
+					    &gcimap);
+			if (gcimap.gcerror != trace.record.gcerror)
+				replay->mismatches += 1;
+			break;
+
+		case GCTRACE_COMMIT:
+			result = replay_commit(replay, &trace);
+			break;
+		}
+
+		if (result < 0)
+			break;
+	}
+
+	gcdevice_stub.ioctl(replay->handle, GCIOCTL_CALLBACK_FREE,
+			    &gcicallback);
+	gctrace_close(&trace);
+	return result;
+}
+
+
+/*******************************************************************************
+ * Main.
+ */
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: gcbvtrace [-d] [-r <passes>] <trace>\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct gctracefile trace;
+	struct summary summary;
+	struct replay replay;
+	struct gcstubstats stubstats;
+	bool dump = false;
+	int passes = 0;
+	int result, i;
+
+	for (i = 1; i < argc - 1; i += 1) {
+		if (strcmp(argv[i], "-d") == 0) {
+			dump = true;
+		} else if ((strcmp(argv[i], "-r") == 0) && (i < argc - 2)) {
+			passes = atoi(argv[++i]);
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (i != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	if (gctrace_open(&trace, argv[i]) != 0) {
+		fprintf(stderr, "%s is not a trace.\n", argv[i]);
+		return 1;
+	}
+
+	memset(&summary, 0, sizeof(summary));
+	if (gcdecode_init(&summary.stats) != 0)
+		return 1;
+
+	while ((result = gctrace_read(&trace)) > 0) {
+		if ((trace.record.type < GCTRACE_CAPS) ||
+		    (trace.record.type > GCTRACE_CALLBACK)) {
+			result = -1;
+			break;
+		}
+
+		if (dump && (print_record(&trace) != 0)) {
+			result = -1;
+			break;
+		}
+
+		if (account_record(&summary, &trace) != 0) {
+			result = -1;
+			break;
+		}
+	}
+
+	gctrace_close(&trace);
+
+	if (result < 0)
+		fprintf(stderr, "%s is corrupt after %u records.\n",
+			argv[i], summary.records);
+
+	if (dump)
+		printf("\n");
+
+	print_summary(&summary);
+	gcdecode_free(&summary.stats);
+
+	if (result < 0)
+		return 1;
+
+	memset(&replay, 0, sizeof(replay));
+	for (; passes > 0; passes -= 1) {
+		if (replay_pass(&replay, argv[i]) != 0) {
+			fprintf(stderr, "replay failed.\n");
+			return 1;
+		}
+	}
+
+	if (replay.commits != 0) {
+		gcstub_stats(&stubstats);
+
+		printf("replay       %u commits, %.2f us per commit in the"
+		       " stub, %u callbacks\n", replay.commits,
+		       ratio(replay.nsec, replay.commits) / 1000.0,
+		       replay.callbacks);
+		printf("stub         %u errors in the last pass,"
+		       " %u outcomes differ from the recording,"
+		       " %u mappings predate it\n",
+		       stubstats.errors, replay.mismatches, replay.adopted);
+
+		if (replay.mismatches != 0)
+			result = -1;
+	}
+
+	free(replay.maps);
+	return (result < 0) ? 1 : 0;
+}
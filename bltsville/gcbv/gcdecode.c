@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc. and Vivante Corporation
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Command stream decoder: names the states of the 2D core after gcreg.h,
+ * lists the commands of a buffer and accounts how much of a stream is
+ * spent reloading states with the values they already hold.
+ */
+
+#include "gcmain.h"
+#include "gctrace.h"
+
+
+/*******************************************************************************
+ * State names.
+ */
+
+struct gcregname {
+	unsigned int address;
+	unsigned int count;
+	const char *name;
+};
+
+#define GCREGNAME(name, count) \
+	{ gcreg ## name ## RegAddrs, count, #name }
+
+/* Sorted by address. */
+static const struct gcregname g_regnames[] = {
+	GCREGNAME(MMUSafeAddress, 1),
+	GCREGNAME(MMUConfiguration, 1),
+	GCREGNAME(MMUException, 1),
+	GCREGNAME(SrcAddress, 1),
+	GCREGNAME(SrcStride, 1),
+	GCREGNAME(SrcRotationConfig, 1),
+	GCREGNAME(SrcConfig, 1),
+	GCREGNAME(SrcOrigin, 1),
+	GCREGNAME(SrcSize, 1),
+	GCREGNAME(SrcColorBg, 1),
+	GCREGNAME(SrcColorFg, 1),
+	GCREGNAME(StretchFactorLow, 1),
+	GCREGNAME(StretchFactorHigh, 1),
+	GCREGNAME(DestAddress, 1),
+	GCREGNAME(DestStride, 1),
+	GCREGNAME(DestRotationConfig, 1),
+	GCREGNAME(DestConfig, 1),
+	GCREGNAME(Rop, 1),
+	GCREGNAME(ClipTopLeft, 1),
+	GCREGNAME(ClipBottomRight, 1),
+	GCREGNAME(Config, 1),
+	GCREGNAME(SrcOriginFraction, 1),
+	GCREGNAME(AlphaControl, 1),
+	GCREGNAME(AlphaModes, 1),
+	GCREGNAME(UPlaneAddress, 1),
+	GCREGNAME(UPlaneStride, 1),
+	GCREGNAME(VPlaneAddress, 1),
+	GCREGNAME(VPlaneStride, 1),
+	GCREGNAME(VRConfig, 1),
+	GCREGNAME(VRSourceImageLow, 1),
+	GCREGNAME(VRSourceImageHigh, 1),
+	GCREGNAME(VRSourceOriginLow, 1),
+	GCREGNAME(VRSourceOriginHigh, 1),
+	GCREGNAME(VRTargetWindowLow, 1),
+	GCREGNAME(VRTargetWindowHigh, 1),
+	GCREGNAME(PEConfig, 1),
+	GCREGNAME(DstRotationHeight, 1),
+	GCREGNAME(SrcRotationHeight, 1),
+	GCREGNAME(RotAngle, 1),
+	GCREGNAME(ClearPixelValue32, 1),
+	GCREGNAME(DestColorKey, 1),
+	GCREGNAME(GlobalSrcColor, 1),
+	GCREGNAME(GlobalDestColor, 1),
+	GCREGNAME(ColorMultiplyModes, 1),
+	GCREGNAME(PETransparency, 1),
+	GCREGNAME(PEControl, 1),
+	GCREGNAME(SrcColorKeyHigh, 1),
+	GCREGNAME(DestColorKeyHigh, 1),
+	GCREGNAME(VRConfigEx, 1),
+	GCREGNAME(PEDitherLow, 1),
+	GCREGNAME(PEDitherHigh, 1),
+	GCREGNAME(BWConfig, 1),
+	GCREGNAME(BWBlockSize, 1),
+	GCREGNAME(BWTileSize, 1),
+	GCREGNAME(BWBlockMask, 1),
+	GCREGNAME(SrcExConfig, 1),
+	GCREGNAME(SrcExAddress, 1),
+	GCREGNAME(DEMultiSource, 1),
+	GCREGNAME(DEYUVConversion, 1),
+	GCREGNAME(DEPlane2Address, 1),
+	GCREGNAME(DEPlane2Stride, 1),
+	GCREGNAME(DEPlane3Address, 1),
+	GCREGNAME(DEPlane3Stride, 1),
+	GCREGNAME(DEStallDE, 1),
+	GCREGNAME(FilterKernel, 128),
+	GCREGNAME(IndexColorTable, 256),
+	GCREGNAME(HoriFilterKernel, 128),
+	GCREGNAME(VertiFilterKernel, 128),
+	GCREGNAME(IndexColorTable32, 256),
+	GCREGNAME(PipeSelect, 1),
+	GCREGNAME(Event, 1),
+	GCREGNAME(Semaphore, 1),
+	GCREGNAME(Flush, 1),
+	GCREGNAME(MMUFlush, 1),
+	GCREGNAME(Stall, 1),
+	GCREGNAME(Block4SrcAddress, 4),
+	GCREGNAME(Block4SrcStride, 4),
+	GCREGNAME(Block4SrcRotationConfig, 4),
+	GCREGNAME(Block4SrcConfig, 4),
+	GCREGNAME(Block4SrcOrigin, 4),
+	GCREGNAME(Block4SrcSize, 4),
+	GCREGNAME(Block4SrcColorBg, 4),
+	GCREGNAME(Block4Rop, 4),
+	GCREGNAME(Block4AlphaControl, 4),
+	GCREGNAME(Block4AlphaModes, 4),
+	GCREGNAME(Block4UPlaneAddress, 4),
+	GCREGNAME(Block4UPlaneStride, 4),
+	GCREGNAME(Block4VPlaneAddress, 4),
+	GCREGNAME(Block4VPlaneStride, 4),
+	GCREGNAME(Block4SrcRotationHeight, 4),
+	GCREGNAME(Block4RotAngle, 4),
+	GCREGNAME(Block4GlobalSrcColor, 4),
+	GCREGNAME(Block4GlobalDestColor, 4),
+	GCREGNAME(Block4ColorMultiplyModes, 4),
+	GCREGNAME(Block4Transparency, 4),
+	GCREGNAME(Block4PEControl, 4),
+	GCREGNAME(Block4SrcColorKeyHigh, 4),
+	GCREGNAME(Block4SrcExConfig, 4),
+	GCREGNAME(Block4SrcExAddress, 4),
+	GCREGNAME(Block8SrcAddress, 8),
+	GCREGNAME(Block8SrcStride, 8),
+	GCREGNAME(Block8SrcRotationConfig, 8),
+	GCREGNAME(Block8SrcConfig, 8),
+	GCREGNAME(Block8SrcOrigin, 8),
+	GCREGNAME(Block8SrcSize, 8),
+	GCREGNAME(Block8SrcColorBg, 8),
+	GCREGNAME(Block8Rop, 8),
+	GCREGNAME(Block8AlphaControl, 8),
+	GCREGNAME(Block8AlphaModes, 8),
+	GCREGNAME(Block8AddressU, 8),
+	GCREGNAME(Block8StrideU, 8),
+	GCREGNAME(Block8AddressV, 8),
+	GCREGNAME(Block8StrideV, 8),
+	GCREGNAME(Block8SrcRotationHeight, 8),
+	GCREGNAME(Block8RotAngle, 8),
+	GCREGNAME(Block8GlobalSrcColor, 8),
+	GCREGNAME(Block8GlobalDestColor, 8),
+	GCREGNAME(Block8ColorMultiplyModes, 8),
+	GCREGNAME(Block8Transparency, 8),
+	GCREGNAME(Block8PEControl, 8),
+	GCREGNAME(Block8SrcColorKeyHigh, 8),
+	GCREGNAME(Block8SrcExConfig, 8),
+	GCREGNAME(Block8SrcExAddress, 8),
+};
+
+static const char * const g_commandnames[] = {
+	[GCREG_DEST_CONFIG_COMMAND_CLEAR] = "CLEAR",
+	[GCREG_DEST_CONFIG_COMMAND_LINE] = "LINE",
+	[GCREG_DEST_CONFIG_COMMAND_BIT_BLT] = "BIT_BLT",
+	[GCREG_DEST_CONFIG_COMMAND_BIT_BLT_REVERSED] = "BIT_BLT_REVERSED",
+	[GCREG_DEST_CONFIG_COMMAND_STRETCH_BLT] = "STRETCH_BLT",
+	[GCREG_DEST_CONFIG_COMMAND_HOR_FILTER_BLT] = "HOR_FILTER_BLT",
+	[GCREG_DEST_CONFIG_COMMAND_VER_FILTER_BLT] = "VER_FILTER_BLT",
+	[GCREG_DEST_CONFIG_COMMAND_ONE_PASS_FILTER_BLT] = "ONE_PASS_FILTER_BLT",
+	[GCREG_DEST_CONFIG_COMMAND_MULTI_SOURCE_BLT] = "MULTI_SOURCE_BLT"
+};
+
+static const char * const g_formatnames[] = {
+	[GCREG_DE_FORMAT_X4R4G4B4] = "X4R4G4B4",
+	[GCREG_DE_FORMAT_A4R4G4B4] = "A4R4G4B4",
+	[GCREG_DE_FORMAT_X1R5G5B5] = "X1R5G5B5",
+	[GCREG_DE_FORMAT_A1R5G5B5] = "A1R5G5B5",
+	[GCREG_DE_FORMAT_R5G6B5] = "R5G6B5",
+	[GCREG_DE_FORMAT_X8R8G8B8] = "X8R8G8B8",
+	[GCREG_DE_FORMAT_A8R8G8B8] = "A8R8G8B8",
+	[GCREG_DE_FORMAT_YUY2] = "YUY2",
+	[GCREG_DE_FORMAT_UYVY] = "UYVY",
+	[GCREG_DE_FORMAT_INDEX8] = "INDEX8",
+	[GCREG_DE_FORMAT_MONOCHROME] = "MONOCHROME",
+	[GCREG_DE_FORMAT_YV12] = "YV12",
+	[GCREG_DE_FORMAT_A8] = "A8",
+	[GCREG_DE_FORMAT_NV12] = "NV12",
+	[GCREG_DE_FORMAT_NV16] = "NV16",
+	[GCREG_DE_FORMAT_RG16] = "RG16"
+};
+
+static const char *table_name(const char * const *table, unsigned int count,
+			      unsigned int index)
+{
+	if ((index >= count) || (table[index] == NULL))
+		return "?";
+
+	return table[index];
+}
+
+static const char *module_name(unsigned int module)
+{
+	switch (module) {
+	case GCREG_COMMAND_STALL_STALL_SOURCE_FRONT_END:
+		return "FE";
+
+	case GCREG_COMMAND_STALL_STALL_SOURCE_PIXEL_ENGINE:
+		return "PE";
+
+	case GCREG_COMMAND_STALL_STALL_SOURCE_DRAWING_ENGINE:
+		return "DE";
+
+	default:
+		return "?";
+	}
+}
+
+const char *gcdecode_register(unsigned int address, unsigned int *index)
+{
+	unsigned int i;
+
+	for (i = 0; i < countof(g_regnames); i += 1) {
+		if (address < g_regnames[i].address)
+			break;
+
+		if (address < g_regnames[i].address + g_regnames[i].count) {
+			*index = address - g_regnames[i].address;
+			return g_regnames[i].name;
+		}
+	}
+
+	*index = 0;
+	return NULL;
+}
+
+
+/*******************************************************************************
+ * Command parsing.
+ */
+
+static unsigned int state_count(uint32_t command)
+{
+	unsigned int count = (command >> 16) & 0x3FF;
+	return (count == 0) ? 1024 : count;
+}
+
+unsigned int gcdecode_length(const uint32_t *data, unsigned int count)
+{
+	unsigned int length, rects, extra;
+
+	if (count == 0)
+		return 0;
+
+	switch ((data[0] >> 27) & 0x1F) {
+	case GCREG_COMMAND_OPCODE_LOAD_STATE:
+		/* States are padded to keep the next command 64-bit
+		 * aligned. */
+		length = 1 + (state_count(data[0]) | 1);
+		break;
+
+	case GCREG_COMMAND_OPCODE_STARTDE:
+		rects = (data[0] >> 8) & 0xFF;
+		extra = (data[0] >> 16) & 0x7FF;
+		length = 2 + rects * 2 + ((extra + 1) & ~1);
+		break;
+
+	case GCREG_COMMAND_OPCODE_END:
+	case GCREG_COMMAND_OPCODE_NOP:
+	case GCREG_COMMAND_OPCODE_WAIT:
+	case GCREG_COMMAND_OPCODE_LINK:
+	case GCREG_COMMAND_OPCODE_STALL:
+	case GCREG_COMMAND_OPCODE_CALL:
+	case GCREG_COMMAND_OPCODE_RETURN:
+		length = 2;
+		break;
+
+	default:
+		return 0;
+	}
+
+	return (length <= count) ? length : 0;
+}
+
+
+/*******************************************************************************
+ * Listing.
+ */
+
+static int find_fixup(const uint32_t *fixups, unsigned int fixupcount,
+		      unsigned int offset)
+{
+	unsigned int i;
+
+	for (i = 0; i < fixupcount; i += 1)
+		if (fixups[i * 2] == offset)
+			return i;
+
+	return -1;
+}
+
+static void print_state(FILE *out, unsigned int address, uint32_t value)
+{
+	const char *name;
+	unsigned int index;
+
+	name = gcdecode_register(address, &index);
+	if (name == NULL)
+		fprintf(out, "  0x%04X", address);
+	else if (index != 0)
+		fprintf(out, "  %s[%d]", name, index);
+	else
+		fprintf(out, "  %s", name);
+
+	if (address == gcregDestConfigRegAddrs)
+		fprintf(out, "  %s %s",
+			table_name(g_commandnames, countof(g_commandnames),
+				   (value >> 12) & 0xF),
+			table_name(g_formatnames, countof(g_formatnames),
+				   value & 0x1F));
+}
+
+int gcdecode_print(FILE *out, const uint32_t *data, unsigned int count,
+		   const uint32_t *fixups, unsigned int fixupcount)
+{
+	unsigned int i, j, length, address, states, rects;
+	int fixup;
+
+	for (i = 0; i < count; i += length) {
+		length = gcdecode_length(data + i, count - i);
+		if (length == 0) {
+			fprintf(out, "    %04X: 0x%08X  MALFORMED\n",
+				i * 4, data[i]);
+			return -1;
+		}
+
+		switch ((data[i] >> 27) & 0x1F) {
+		case GCREG_COMMAND_OPCODE_LOAD_STATE:
+			address = data[i] & 0xFFFF;
+			states = state_count(data[i]);
+			fprintf(out, "    %04X: 0x%08X  STATE(0x%04X, %d)\n",
+				i * 4, data[i], address, states);
+
+			for (j = 1; j <= states; j += 1) {
+				fprintf(out, "    %04X: 0x%08X",
+					(i + j) * 4, data[i + j]);
+				print_state(out, address + j - 1,
+					    data[i + j]);
+
+				fixup = find_fixup(fixups, fixupcount, i + j);
+				if (fixup >= 0)
+					fprintf(out, "  -> map 0x%08X + 0x%X",
+						data[i + j],
+						fixups[fixup * 2 + 1]);
+
+				fprintf(out, "\n");
+			}
+			break;
+
+		case GCREG_COMMAND_OPCODE_STARTDE:
+			rects = (data[i] >> 8) & 0xFF;
+			fprintf(out, "    %04X: 0x%08X  STARTDE(%d)\n",
+				i * 4, data[i], rects);
+
+			for (j = 0; j < rects; j += 1) {
+				const uint32_t *lt = &data[i + 2 + j * 2];
+
+				fprintf(out, "%20cLT(%d,%d) RB(%d,%d)\n", ' ',
+					lt[0] & 0xFFFF, lt[0] >> 16,
+					lt[1] & 0xFFFF, lt[1] >> 16);
+			}
+			break;
+
+		case GCREG_COMMAND_OPCODE_END:
+			fprintf(out, "    %04X: 0x%08X  END()\n",
+				i * 4, data[i]);
+			break;
+
+		case GCREG_COMMAND_OPCODE_NOP:
+			fprintf(out, "    %04X: 0x%08X  NOP()\n",
+				i * 4, data[i]);
+			break;
+
+		case GCREG_COMMAND_OPCODE_WAIT:
+			fprintf(out, "    %04X: 0x%08X  WAIT(%d)\n",
+				i * 4, data[i], data[i] & 0xFFFF);
+			break;
+
+		case GCREG_COMMAND_OPCODE_LINK:
+			fprintf(out, "    %04X: 0x%08X  LINK(0x%08X, %d)\n",
+				i * 4, data[i], data[i + 1],
+				data[i] & 0xFFFF);
+			break;
+
+		case GCREG_COMMAND_OPCODE_STALL:
+			fprintf(out, "    %04X: 0x%08X  STALL(%s-%s)\n",
+				i * 4, data[i],
+				module_name(data[i + 1] & 0x1F),
+				module_name((data[i + 1] >> 8) & 0x1F));
+			break;
+
+		case GCREG_COMMAND_OPCODE_CALL:
+			fprintf(out, "    %04X: 0x%08X  CALL(0x%08X)\n",
+				i * 4, data[i], data[i + 1]);
+			break;
+
+		case GCREG_COMMAND_OPCODE_RETURN:
+			fprintf(out, "    %04X: 0x%08X  RETURN()\n",
+				i * 4, data[i]);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
+/*******************************************************************************
+ * Statistics.
+ */
+
+/* One shadow entry per state address. */
+#define GCDECODE_STATES		0x10000
+
+int gcdecode_init(struct gcdecodestats *stats)
+{
+	memset(stats, 0, sizeof(struct gcdecodestats));
+
+	stats->value = calloc(GCDECODE_STATES, sizeof(uint32_t));
+	stats->epoch = calloc(GCDECODE_STATES, sizeof(uint32_t));
+	if ((stats->value == NULL) || (stats->epoch == NULL)) {
+		gcdecode_free(stats);
+		return -1;
+	}
+
+	return 0;
+}
+
+void gcdecode_free(struct gcdecodestats *stats)
+{
+	free(stats->value);
+	free(stats->epoch);
+	stats->value = NULL;
+	stats->epoch = NULL;
+}
+
+void gcdecode_commit(struct gcdecodestats *stats)
+{
+	stats->commits += 1;
+}
+
+void gcdecode_buffer(struct gcdecodestats *stats,
+		     const uint32_t *data, unsigned int count,
+		     unsigned int fixupcount)
+{
+	unsigned int i, j, length, address, states;
+	uint32_t epoch = stats->commits;
+
+	stats->buffers += 1;
+	stats->words += count;
+	stats->fixups += fixupcount;
+
+	for (i = 0; i < count; i += length) {
+		length = gcdecode_length(data + i, count - i);
+		if (length == 0) {
+			stats->malformed += 1;
+			return;
+		}
+
+		switch ((data[i] >> 27) & 0x1F) {
+		case GCREG_COMMAND_OPCODE_LOAD_STATE:
+			address = data[i] & 0xFFFF;
+			states = state_count(data[i]);
+			stats->loadstates += 1;
+			stats->states += states;
+
+			for (j = 1; j <= states; j += 1) {
+				unsigned int a = (address + j - 1)
+					       % GCDECODE_STATES;
+
+				/* Filter blits start with the write of their
+				 * configuration. */
+				if (a == gcregVRConfigRegAddrs) {
+					stats->blits += 1;
+					continue;
+				}
+
+				/* Pipe select, events, semaphores, flushes and
+				 * stalls are triggers rather than states. */
+				if ((a >= gcregPipeSelectRegAddrs) &&
+				    (a <= gcregStallRegAddrs))
+					continue;
+
+				if ((stats->epoch[a] != 0) &&
+				    (stats->value[a] == data[i + j])) {
+					if (stats->epoch[a] == epoch)
+						stats->redundant += 1;
+					else
+						stats->carried += 1;
+				}
+
+				stats->value[a] = data[i + j];
+				stats->epoch[a] = epoch;
+			}
+			break;
+
+		case GCREG_COMMAND_OPCODE_STARTDE:
+			stats->blits += 1;
+			stats->rects += (data[i] >> 8) & 0xFF;
+			break;
+		}
+	}
+}
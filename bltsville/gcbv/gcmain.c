@@ -29,7 +29,9 @@
 
 #include "gcmain.h"
 #include "gcbv.h"
+#include "gctrace.h"
 #include <semaphore.h>
+#include <signal.h>
 
 #if ANDROID
 #include <cutils/log.h>
@@ -47,6 +49,61 @@ GCDBG_FILTERDEF(gcmain, GCZONE_NONE,
 
 
 static int g_handle;
+static const struct gcdevice *g_device;
+
+#if GCBV_TEST_BACKENDS
+/* Tracing swaps the device while other threads issue ioctls. */
+static GCDEFINE_LOCK(g_devicelock);
+
+static const struct gcdevice *get_device(void)
+{
+	const struct gcdevice *device;
+
+	GCLOCK(&g_devicelock);
+	device = g_device;
+	GCUNLOCK(&g_devicelock);
+
+	return device;
+}
+#else
+static inline const struct gcdevice *get_device(void)
+{
+	return g_device;
+}
+#endif
+
+
+/*******************************************************************************
+ * Kernel driver backend.
+ */
+
+static int kernel_open(void)
+{
+	return open("/dev/gcioctl", O_RDWR);
+}
+
+static void kernel_close(int handle)
+{
+	close(handle);
+}
+
+static int kernel_ioctl(int handle, unsigned int code, void *arg)
+{
+	return ioctl(handle, code, arg);
+}
+
+static void kernel_wake(__unused int handle, pthread_t thread)
+{
+	pthread_kill(thread, SIGINT);
+}
+
+const struct gcdevice gcdevice_kernel = {
+	.name = "kernel",
+	.open = kernel_open,
+	.close = kernel_close,
+	.ioctl = kernel_ioctl,
+	.wake = kernel_wake
+};
 
 
 /*******************************************************************************
@@ -101,8 +158,8 @@ static void *callbackthread(void *_gccallbackinfo)
 	/* Enter wait loop. */
 	while (1) {
 		/* Call the kernel to wait for callback event. */
-		result = ioctl(g_handle, GCIOCTL_CALLBACK_WAIT,
-			       &gccmdcallbackwait);
+		result = get_device()->ioctl(g_handle, GCIOCTL_CALLBACK_WAIT,
+					     &gccmdcallbackwait);
 		if (result == 0) {
 			if (gccmdcallbackwait.gcerror == GCERR_NONE) {
 				/* Work completed. */
@@ -170,9 +227,9 @@ static int callback_start(struct gccallbackinfo *gccallbackinfo)
 
 	if (gccallbackinfo->status == SUPPORTED) {
 		/* Initialize callback. */
-		result = ioctl(g_handle,
-			       GCIOCTL_CALLBACK_ALLOC,
-			       &gccmdcallback);
+		result = get_device()->ioctl(g_handle,
+					     GCIOCTL_CALLBACK_ALLOC,
+					     &gccmdcallback);
 		if (result != 0) {
 			GCERR("callback ioctl failed (%d).\n", result);
 			goto fail;
@@ -207,7 +264,8 @@ static int callback_start(struct gccallbackinfo *gccallbackinfo)
 
 fail:
 	if (gccmdcallback.handle != 0) {
-		ioctl(g_handle, GCIOCTL_CALLBACK_FREE, &gccmdcallback);
+		get_device()->ioctl(g_handle, GCIOCTL_CALLBACK_FREE,
+				    &gccmdcallback);
 		gccallbackinfo->handle = 0;
 	}
 
@@ -228,7 +286,7 @@ static void callback_stop(struct gccallbackinfo *gccallbackinfo)
 	if (gccallbackinfo->status == SUPPORTED) {
 		if (gccallbackinfo->thread) {
 			sem_post(&gccallbackinfo->stop);
-			pthread_kill(gccallbackinfo->thread, SIGINT);
+			get_device()->wake(g_handle, gccallbackinfo->thread);
 
 			GCDBG(GCZONE_CALLBACK,
 			      "waiting to join callback thread...\n");
@@ -239,7 +297,8 @@ static void callback_stop(struct gccallbackinfo *gccallbackinfo)
 
 		/* Free kernel resources. */
 		gccmdcallback.handle = gccallbackinfo->handle;
-		ioctl(g_handle, GCIOCTL_CALLBACK_FREE, &gccmdcallback);
+		get_device()->ioctl(g_handle, GCIOCTL_CALLBACK_FREE,
+				    &gccmdcallback);
 		gccallbackinfo->handle = 0;
 	}
 
@@ -267,7 +326,7 @@ void gc_getcaps_wrapper(struct gcicaps *gcicaps)
 
 	GCPRINTDELAY();
 
-	result = ioctl(g_handle, GCIOCTL_GETCAPS, gcicaps);
+	result = get_device()->ioctl(g_handle, GCIOCTL_GETCAPS, gcicaps);
 	if (result != 0) {
 		GCERR("ioctl failed (%d).\n", result);
 		gcicaps->gcerror = GCERR_IOCTL;
@@ -279,7 +338,7 @@ void gc_map_wrapper(struct gcimap *gcmap)
 	int result;
 
 	GCPRINTDELAY();
-	result = ioctl(g_handle, GCIOCTL_MAP, gcmap);
+	result = get_device()->ioctl(g_handle, GCIOCTL_MAP, gcmap);
 
 	if (result != 0) {
 		GCERR("ioctl failed (%d).\n", result);
@@ -292,7 +351,7 @@ void gc_unmap_wrapper(struct gcimap *gcmap)
 	int result;
 
 	GCPRINTDELAY();
-	result = ioctl(g_handle, GCIOCTL_UNMAP, gcmap);
+	result = get_device()->ioctl(g_handle, GCIOCTL_UNMAP, gcmap);
 
 	if (result != 0) {
 		GCERR("ioctl failed (%d).\n", result);
@@ -312,7 +371,7 @@ void gc_commit_wrapper(struct gcicommit *gccommit)
 		callback_start(&g_callbackinfo);
 
 	gccommit->handle = g_callbackinfo.handle;
-	result = ioctl(g_handle, GCIOCTL_COMMIT, gccommit);
+	result = get_device()->ioctl(g_handle, GCIOCTL_COMMIT, gccommit);
 
 	if (result != 0) {
 		GCERR("ioctl failed (%d).\n", result);
@@ -329,7 +388,8 @@ void gc_callback_wrapper(struct gcicallbackarm *gcicallbackarm)
 	callback_start(&g_callbackinfo);
 
 	gcicallbackarm->handle = g_callbackinfo.handle;
-	result = ioctl(g_handle, GCIOCTL_CALLBACK_ARM, gcicallbackarm);
+	result = get_device()->ioctl(g_handle, GCIOCTL_CALLBACK_ARM,
+				     gcicallbackarm);
 	if (result != 0) {
 		GCERR("ioctl failed (%d).\n", result);
 		gcicallbackarm->gcerror = GCERR_IOCTL;
@@ -465,7 +525,7 @@ enum bverror gcbvcacheop(int count, struct c2dmrgn rgn[],
 	memcpy(xfer.rgn, rgn, count * sizeof(struct c2dmrgn));
 
 	GCPRINTDELAY();
-	result = ioctl(g_handle, GCIOCTL_CACHE, &xfer);
+	result = get_device()->ioctl(g_handle, GCIOCTL_CACHE, &xfer);
 
 	if (result != 0)
 		GCERR("ioctl failed (%d).\n", result);
@@ -474,6 +534,60 @@ enum bverror gcbvcacheop(int count, struct c2dmrgn rgn[],
 }
 
 
+#if GCBV_TEST_BACKENDS
+/*******************************************************************************
+ * Command stream tracing.
+ */
+
+static const struct gcdevice *g_traceddevice;
+
+/* Called with the device lock held. */
+static void trace_stop(void)
+{
+	if (g_traceddevice == NULL)
+		return;
+
+	/* Closing the recorder does not close the device. The recorder is
+	 * static, so a thread still inside one of its ioctls is safe; it
+	 * just stops recording. */
+	g_device->close(g_handle);
+	g_device = g_traceddevice;
+	g_traceddevice = NULL;
+}
+
+int gc_trace_start(const char *path)
+{
+	const struct gcdevice *recorder;
+	int result = 0;
+
+	GCLOCK(&g_devicelock);
+
+	trace_stop();
+
+	recorder = gctrace_attach(path, g_device, g_handle);
+	if (recorder == NULL) {
+		GCERR("failed to create trace %s.\n", path);
+		result = -1;
+		goto exit;
+	}
+
+	g_traceddevice = g_device;
+	g_device = recorder;
+
+exit:
+	GCUNLOCK(&g_devicelock);
+	return result;
+}
+
+void gc_trace_stop(void)
+{
+	GCLOCK(&g_devicelock);
+	trace_stop();
+	GCUNLOCK(&g_devicelock);
+}
+#endif
+
+
 /*******************************************************************************
  * Device init/cleanup.
  */
@@ -491,14 +605,40 @@ void  __attribute__((constructor)) dev_init(void)
 
 	GCENTER(GCZONE_INIT);
 
-	g_handle = open("/dev/gcioctl", O_RDWR);
+#if GCBV_TEST_BACKENDS && !ANDROID
+	g_device = &gcdevice_stub;
+#else
+	g_device = &gcdevice_kernel;
+#endif
+
+#if GCBV_TEST_BACKENDS
+	env = getenv("GCBV_STUB");
+	if (env && (atol(env) != 0))
+		g_device = &gcdevice_stub;
+#endif
+
+	g_handle = g_device->open();
 	if (g_handle == -1) {
 		GCERR("failed to open device (%d).\n", errno);
 		goto fail;
 	}
 
+#if GCBV_TEST_BACKENDS
+	env = getenv("GCBV_TRACE");
+	if (env && (*env != '\0'))
+		gc_trace_start(env);
+#endif
+
 	bv_init();
 
+	env = getenv("GCBV_DEFER");
+	if (env && (atol(env) > 0))
+		gcbv_defer(atol(env));
+
+	env = getenv("GCBV_MAPCACHE");
+	if (env && (*env != '\0'))
+		gcbv_mapcache(strtoul(env, NULL, 0));
+
 	pthread_mutex_init(&g_callbackinfo.mutex, 0);
 
 	GCEXIT(GCZONE_INIT);
@@ -506,7 +646,7 @@ void  __attribute__((constructor)) dev_init(void)
 
 fail:
 	if (g_handle > 0) {
-		close(g_handle);
+		g_device->close(g_handle);
 		g_handle = 0;
 	}
 
@@ -519,9 +659,12 @@ void __attribute__((destructor)) dev_exit(void)
 
 	bv_exit();
 	callback_stop(&g_callbackinfo);
+#if GCBV_TEST_BACKENDS
+	gc_trace_stop();
+#endif
 
 	if (g_handle != 0) {
-		close(g_handle);
+		g_device->close(g_handle);
 		g_handle = 0;
 	}
 
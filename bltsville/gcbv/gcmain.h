@@ -32,6 +32,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
@@ -67,6 +68,10 @@
 
 #define gc_debug_blt(...)
 
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
 typedef int64_t s64;
 typedef uint64_t u64;
 
@@ -94,6 +99,39 @@ struct bvphysdesc {
 };
 
 
+/*******************************************************************************
+ * Driver backends.
+ */
+
+/* The ioctl interface the wrappers go through: the kernel driver on the
+ * target. Builds with GCBV_TEST_BACKENDS set, which only the host targets
+ * are, add the stub driver, used on the host or when GCBV_STUB is set, and
+ * record the traffic of either to the file named by GCBV_TRACE
+ * (gctrace.h). */
+struct gcdevice {
+	const char *name;
+
+	/* Return a positive handle or -1. */
+	int (*open)(void);
+	void (*close)(int handle);
+
+	/* Same contract as ioctl(2). */
+	int (*ioctl)(int handle, unsigned int code, void *arg);
+
+	/* Releases a thread blocked in GCIOCTL_CALLBACK_WAIT. */
+	void (*wake)(int handle, pthread_t thread);
+};
+
+extern const struct gcdevice gcdevice_kernel;
+extern const struct gcdevice gcdevice_stub;
+
+/* Wraps the device into the trace recorder; returns NULL if the trace
+ * cannot be created. Only one trace is recorded at a time. */
+const struct gcdevice *gctrace_attach(const char *path,
+				      const struct gcdevice *device,
+				      int handle);
+
+
 /*******************************************************************************
  * IOCTL wrappers.
  */
@@ -143,4 +181,31 @@ enum bverror bv_unmap(struct bvbuffdesc *buffdesc);
 enum bverror bv_blt(struct bvbltparams *bltparams);
 enum bverror bv_cache(struct bvcopparams *copparams);
 
+/* Deferred commits: asynchronous blits without a callback are merged into
+ * one commit until a synchronous blit, a blit with a callback, a call to
+ * gcbv_flush() or until the commit grows to the given size in bytes. Size
+ * 0, the default, commits every blit; GCBV_DEFER sets the size at load. */
+void gcbv_defer(unsigned int size);
+enum bverror gcbv_flush(void);
+
+/* Cache of implicit mappings: buffers described by physical pages keep
+ * their GC mapping after the blits that mapped them are done, and a later
+ * buffer with the same pages reuses it. The least recently used mappings
+ * are released once the cached buffers exceed the budget in bytes; 0
+ * disables the cache and GCBV_MAPCACHE sets the budget at load. bv_unmap
+ * drops the cached mapping of a buffer that is about to be freed. */
+struct gcbvmapstats {
+	unsigned int maps;		/* mappings made by the kernel */
+	unsigned int unmaps;		/* mappings released */
+	unsigned int hits;		/* mappings found in the cache */
+	unsigned int misses;		/* cacheable mappings not found */
+	unsigned int evictions;		/* mappings released over budget */
+	unsigned int entries;		/* mappings in the cache */
+	unsigned long size;		/* bytes mapped by the cache */
+	unsigned long budget;
+};
+
+void gcbv_mapcache(unsigned long budget);
+void gcbv_mapstats(struct gcbvmapstats *stats);
+
 #endif
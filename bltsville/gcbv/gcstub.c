@@ -0,0 +1,586 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc. and Vivante Corporation
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Stub driver: a user space stand-in for the gcx kernel driver that lets the
+ * library and recorded traces run on a workstation. Mappings get handles,
+ * commits are checked rather than executed, and callbacks are delivered as
+ * soon as they are requested.
+ *
+ * The checks catch what the kernel would trip over or silently
+ * misinterpret: pipes, malformed command streams, fixups that do not point
+ * at the handle of a live mapping and unmaps of unknown handles. Fixup
+ * offsets are not range checked; the builder moves the base address back
+ * to the origin of the surface, so they are often negative.
+ */
+
+#include "gcmain.h"
+#include "gctrace.h"
+#include <time.h>
+
+#define GCZONE_NONE		0
+#define GCZONE_ALL		(~0U)
+#define GCZONE_MAPPING		(1 << 0)
+#define GCZONE_COMMIT		(1 << 1)
+#define GCZONE_CALLBACK		(1 << 2)
+
+GCDBG_FILTERDEF(stub, GCZONE_NONE,
+		"mapping",
+		"commit",
+		"callback")
+
+
+/* Handle returned by open(). */
+#define GCSTUB_HANDLE		0x5D
+
+struct gcstubmap {
+	unsigned long handle;
+	unsigned int size;
+	struct list_head link;
+};
+
+struct gcstubpending {
+	void (*callback) (void *callbackparam);
+	void *callbackparam;
+	struct list_head link;
+};
+
+struct gcstubcallback {
+	unsigned long handle;
+
+	/* Callbacks waiting for GCIOCTL_CALLBACK_WAIT (gcstubpending). */
+	struct list_head pending;
+
+	/* Set by wake() to end the current wait. */
+	bool wake;
+
+	struct list_head link;
+};
+
+static GCDEFINE_LOCK(g_stublock);
+static pthread_cond_t g_stubcond = PTHREAD_COND_INITIALIZER;
+
+static struct list_head g_stubmaps = LIST_HEAD_INIT(g_stubmaps);
+static struct list_head g_stubcallbacks = LIST_HEAD_INIT(g_stubcallbacks);
+static unsigned long g_stubnexthandle = 1;
+static struct gcstubstats g_stubstats;
+
+/* Reported by GCIOCTL_GETCAPS; a GC320 unless a trace says otherwise. */
+static uint32_t g_stubcaps[9] = { 0x320 };
+
+
+/*******************************************************************************
+ * Bookkeeping; called with the lock held.
+ */
+
+static struct gcstubmap *find_map(unsigned long handle)
+{
+	struct list_head *head;
+	struct gcstubmap *gcstubmap;
+
+	list_for_each(head, &g_stubmaps) {
+		gcstubmap = list_entry(head, struct gcstubmap, link);
+		if (gcstubmap->handle == handle)
+			return gcstubmap;
+	}
+
+	return NULL;
+}
+
+static struct gcstubcallback *find_callback(unsigned long handle)
+{
+	struct list_head *head;
+	struct gcstubcallback *gcstubcallback;
+
+	list_for_each(head, &g_stubcallbacks) {
+		gcstubcallback = list_entry(head, struct gcstubcallback, link);
+		if (gcstubcallback->handle == handle)
+			return gcstubcallback;
+	}
+
+	return NULL;
+}
+
+static enum gcerror unmap_handle(unsigned long handle)
+{
+	struct gcstubmap *gcstubmap;
+
+	gcstubmap = find_map(handle);
+	if (gcstubmap == NULL) {
+		GCERR("unmapping unknown handle 0x%08lX.\n", handle);
+		return GCERR_NOT_FOUND;
+	}
+
+	list_del(&gcstubmap->link);
+	free(gcstubmap);
+
+	g_stubstats.unmaps += 1;
+	g_stubstats.livemaps -= 1;
+	return GCERR_NONE;
+}
+
+static enum gcerror queue_callback(unsigned long handle,
+				   void (*callback) (void *callbackparam),
+				   void *callbackparam)
+{
+	struct gcstubcallback *gcstubcallback;
+	struct gcstubpending *gcstubpending;
+
+	gcstubcallback = find_callback(handle);
+	if (gcstubcallback == NULL) {
+		GCERR("unknown callback handle 0x%08lX.\n", handle);
+		return GCERR_NOT_FOUND;
+	}
+
+	gcstubpending = malloc(sizeof(struct gcstubpending));
+	if (gcstubpending == NULL)
+		return GCERR_OODM;
+
+	gcstubpending->callback = callback;
+	gcstubpending->callbackparam = callbackparam;
+	list_add_tail(&gcstubpending->link, &gcstubcallback->pending);
+
+	g_stubstats.callbacks += 1;
+	pthread_cond_broadcast(&g_stubcond);
+	return GCERR_NONE;
+}
+
+static enum gcerror check_buffer(struct gcbuffer *gcbuffer)
+{
+	struct list_head *head;
+	struct gcfixup *gcfixup;
+	struct gcstubmap *gcstubmap;
+	unsigned int count, i, length;
+	unsigned int *data = gcbuffer->head;
+
+	if ((gcbuffer->tail < gcbuffer->head) ||
+	    ((unsigned int) (gcbuffer->tail - gcbuffer->head)
+		> GC_BUFFER_SIZE / sizeof(unsigned int))) {
+		GCERR("invalid buffer bounds.\n");
+		return GCERR_CMD_CONSISTENCY;
+	}
+
+	count = gcbuffer->tail - gcbuffer->head;
+	for (i = 0; i < count; i += length) {
+		length = gcdecode_length(data + i, count - i);
+		if (length == 0) {
+			GCERR("malformed command 0x%08X at %d.\n",
+			      data[i], i * 4);
+			return GCERR_CMD_CONSISTENCY;
+		}
+	}
+
+	list_for_each(head, &gcbuffer->fixup) {
+		gcfixup = list_entry(head, struct gcfixup, link);
+
+		for (i = 0; i < gcfixup->count; i += 1) {
+			if (gcfixup->fixup[i].dataoffset >= count) {
+				GCERR("fixup outside of the buffer.\n");
+				return GCERR_CMD_CONSISTENCY;
+			}
+
+			gcstubmap = find_map(data[gcfixup->fixup[i].dataoffset]);
+			if (gcstubmap == NULL) {
+				GCERR("fixup at %d refers to unmapped "
+				      "handle 0x%08X.\n",
+				      gcfixup->fixup[i].dataoffset * 4,
+				      data[gcfixup->fixup[i].dataoffset]);
+				return GCERR_CMD_MAPPED;
+			}
+
+			g_stubstats.fixups += 1;
+		}
+	}
+
+	g_stubstats.buffers += 1;
+	g_stubstats.bytes += count * sizeof(unsigned int);
+	return GCERR_NONE;
+}
+
+
+/*******************************************************************************
+ * IOCTL handlers; called with the lock held.
+ */
+
+static void stub_getcaps(struct gcicaps *gcicaps)
+{
+	gcicaps->gcerror = GCERR_NONE;
+	gcicaps->gcmodel = g_stubcaps[0];
+	gcicaps->gcrevision = g_stubcaps[1];
+	gcicaps->gcdate = g_stubcaps[2];
+	gcicaps->gctime = g_stubcaps[3];
+	gcicaps->gcfeatures.raw = g_stubcaps[4];
+	gcicaps->gcfeatures0.raw = g_stubcaps[5];
+	gcicaps->gcfeatures1.raw = g_stubcaps[6];
+	gcicaps->gcfeatures2.raw = g_stubcaps[7];
+	gcicaps->gcfeatures3.raw = g_stubcaps[8];
+}
+
+static void stub_map(struct gcimap *gcimap)
+{
+	struct gcstubmap *gcstubmap;
+
+	if (gcimap->size == 0) {
+		gcimap->gcerror = GCERR_PMMAP;
+		return;
+	}
+
+	gcstubmap = malloc(sizeof(struct gcstubmap));
+	if (gcstubmap == NULL) {
+		gcimap->gcerror = GCERR_OODM;
+		return;
+	}
+
+	gcstubmap->handle = g_stubnexthandle++;
+	gcstubmap->size = gcimap->size;
+	list_add_tail(&gcstubmap->link, &g_stubmaps);
+
+	GCDBG(GCZONE_MAPPING, "map 0x%08lX, size %d.\n",
+	      gcstubmap->handle, gcstubmap->size);
+
+	g_stubstats.maps += 1;
+	g_stubstats.livemaps += 1;
+
+	gcimap->gcerror = GCERR_NONE;
+	gcimap->handle = gcstubmap->handle;
+}
+
+static void stub_unmap(struct gcimap *gcimap)
+{
+	gcimap->gcerror = unmap_handle(gcimap->handle);
+	if (gcimap->gcerror != GCERR_NONE)
+		g_stubstats.errors += 1;
+}
+
+static void stub_commit(struct gcicommit *gcicommit)
+{
+	struct list_head *head;
+	struct gcbuffer *gcbuffer;
+	struct gcschedunmap *gcschedunmap;
+	enum gcerror gcerror;
+
+	gcicommit->gcerror = GCERR_NONE;
+
+	if ((gcicommit->entrypipe != GCPIPE_2D) &&
+	    (gcicommit->entrypipe != GCPIPE_3D)) {
+		gcicommit->gcerror = GCERR_CMD_ENTRY_PIPE;
+		goto fail;
+	}
+
+	if ((gcicommit->exitpipe != GCPIPE_2D) &&
+	    (gcicommit->exitpipe != GCPIPE_3D)) {
+		gcicommit->gcerror = GCERR_CMD_EXIT_PIPE;
+		goto fail;
+	}
+
+	list_for_each(head, &gcicommit->buffer) {
+		gcbuffer = list_entry(head, struct gcbuffer, link);
+
+		gcicommit->gcerror = check_buffer(gcbuffer);
+		if (gcicommit->gcerror != GCERR_NONE)
+			goto fail;
+	}
+
+	g_stubstats.commits += 1;
+
+	/* The buffers are done as soon as they have been checked. */
+	if (gcicommit->callback != NULL) {
+		gcerror = queue_callback(gcicommit->handle,
+					 gcicommit->callback,
+					 gcicommit->callbackparam);
+		if (gcerror != GCERR_NONE) {
+			gcicommit->gcerror = gcerror;
+			goto fail;
+		}
+	}
+
+fail:
+	/* The kernel unmaps the scheduled buffers even if the commit
+	 * fails, do the same to keep the map list in sync. */
+	list_for_each(head, &gcicommit->unmap) {
+		gcschedunmap = list_entry(head, struct gcschedunmap, link);
+
+		gcerror = unmap_handle(gcschedunmap->handle);
+		if ((gcerror != GCERR_NONE) &&
+		    (gcicommit->gcerror == GCERR_NONE))
+			gcicommit->gcerror = gcerror;
+	}
+
+	if (gcicommit->gcerror != GCERR_NONE) {
+		GCDBG(GCZONE_COMMIT, "commit failed (0x%08X).\n",
+		      gcicommit->gcerror);
+		g_stubstats.errors += 1;
+	}
+}
+
+static void stub_callback_alloc(struct gcicallback *gcicallback)
+{
+	struct gcstubcallback *gcstubcallback;
+
+	gcstubcallback = malloc(sizeof(struct gcstubcallback));
+	if (gcstubcallback == NULL) {
+		gcicallback->gcerror = GCERR_OODM;
+		return;
+	}
+
+	gcstubcallback->handle = g_stubnexthandle++;
+	gcstubcallback->wake = false;
+	INIT_LIST_HEAD(&gcstubcallback->pending);
+	list_add_tail(&gcstubcallback->link, &g_stubcallbacks);
+
+	gcicallback->gcerror = GCERR_NONE;
+	gcicallback->handle = gcstubcallback->handle;
+}
+
+static void stub_callback_free(struct gcicallback *gcicallback)
+{
+	struct gcstubcallback *gcstubcallback;
+	struct gcstubpending *gcstubpending;
+
+	gcstubcallback = find_callback(gcicallback->handle);
+	if (gcstubcallback == NULL) {
+		gcicallback->gcerror = GCERR_NOT_FOUND;
+		return;
+	}
+
+	while (!list_empty(&gcstubcallback->pending)) {
+		gcstubpending = list_first_entry(&gcstubcallback->pending,
+						 struct gcstubpending, link);
+		list_del(&gcstubpending->link);
+		free(gcstubpending);
+	}
+
+	list_del(&gcstubcallback->link);
+	free(gcstubcallback);
+
+	gcicallback->gcerror = GCERR_NONE;
+}
+
+static void stub_callback_wait(struct gcicallbackwait *gcicallbackwait)
+{
+	struct gcstubcallback *gcstubcallback;
+	struct gcstubpending *gcstubpending;
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += gcicallbackwait->timeoutms / 1000;
+	deadline.tv_nsec += (gcicallbackwait->timeoutms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while (1) {
+		/* Look the object up again after every wait, it may have
+		 * been freed in the meantime. */
+		gcstubcallback = find_callback(gcicallbackwait->handle);
+		if (gcstubcallback == NULL) {
+			gcicallbackwait->gcerror = GCERR_NOT_FOUND;
+			return;
+		}
+
+		if (!list_empty(&gcstubcallback->pending))
+			break;
+
+		if (gcstubcallback->wake ||
+		    (pthread_cond_timedwait(&g_stubcond, &g_stublock,
+					    &deadline) != 0)) {
+			gcstubcallback->wake = false;
+			gcicallbackwait->gcerror = GCERR_TIMEOUT;
+			return;
+		}
+	}
+
+	gcstubpending = list_first_entry(&gcstubcallback->pending,
+					 struct gcstubpending, link);
+	list_del(&gcstubpending->link);
+
+	gcicallbackwait->gcerror = GCERR_NONE;
+	gcicallbackwait->callback = gcstubpending->callback;
+	gcicallbackwait->callbackparam = gcstubpending->callbackparam;
+
+	free(gcstubpending);
+}
+
+static void stub_callback_arm(struct gcicallbackarm *gcicallbackarm)
+{
+	gcicallbackarm->gcerror = queue_callback(gcicallbackarm->handle,
+						 gcicallbackarm->callback,
+						 gcicallbackarm->callbackparam);
+	if (gcicallbackarm->gcerror != GCERR_NONE)
+		g_stubstats.errors += 1;
+}
+
+
+/*******************************************************************************
+ * Backend.
+ */
+
+static int stub_open(void)
+{
+	GCDBG_REGISTER(stub);
+	return GCSTUB_HANDLE;
+}
+
+static void stub_close(__unused int handle)
+{
+	gcstub_reset();
+}
+
+static int stub_ioctl(int handle, unsigned int code, void *arg)
+{
+	int result = 0;
+
+	if (handle != GCSTUB_HANDLE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	GCLOCK(&g_stublock);
+
+	switch (code) {
+	case GCIOCTL_GETCAPS:
+		stub_getcaps(arg);
+		break;
+
+	case GCIOCTL_MAP:
+		stub_map(arg);
+		break;
+
+	case GCIOCTL_UNMAP:
+		stub_unmap(arg);
+		break;
+
+	case GCIOCTL_COMMIT:
+		stub_commit(arg);
+		break;
+
+	case GCIOCTL_CACHE:
+		break;
+
+	case GCIOCTL_CALLBACK_ALLOC:
+		stub_callback_alloc(arg);
+		break;
+
+	case GCIOCTL_CALLBACK_FREE:
+		stub_callback_free(arg);
+		break;
+
+	case GCIOCTL_CALLBACK_WAIT:
+		stub_callback_wait(arg);
+		break;
+
+	case GCIOCTL_CALLBACK_ARM:
+		stub_callback_arm(arg);
+		break;
+
+	default:
+		errno = ENOTTY;
+		result = -1;
+	}
+
+	GCUNLOCK(&g_stublock);
+	return result;
+}
+
+static void stub_wake(__unused int handle, __unused pthread_t thread)
+{
+	struct list_head *head;
+	struct gcstubcallback *gcstubcallback;
+
+	GCLOCK(&g_stublock);
+
+	list_for_each(head, &g_stubcallbacks) {
+		gcstubcallback = list_entry(head, struct gcstubcallback, link);
+		gcstubcallback->wake = true;
+	}
+
+	pthread_cond_broadcast(&g_stubcond);
+
+	GCUNLOCK(&g_stublock);
+}
+
+const struct gcdevice gcdevice_stub = {
+	.name = "stub",
+	.open = stub_open,
+	.close = stub_close,
+	.ioctl = stub_ioctl,
+	.wake = stub_wake
+};
+
+
+/*******************************************************************************
+ * Host tools interface.
+ */
+
+void gcstub_stats(struct gcstubstats *stats)
+{
+	GCLOCK(&g_stublock);
+	*stats = g_stubstats;
+	GCUNLOCK(&g_stublock);
+}
+
+void gcstub_reset(void)
+{
+	struct gcstubmap *gcstubmap;
+	struct gcicallback gcicallback;
+
+	GCLOCK(&g_stublock);
+
+	while (!list_empty(&g_stubmaps)) {
+		gcstubmap = list_first_entry(&g_stubmaps,
+					     struct gcstubmap, link);
+		list_del(&gcstubmap->link);
+		free(gcstubmap);
+	}
+
+	while (!list_empty(&g_stubcallbacks)) {
+		gcicallback.handle = list_first_entry(&g_stubcallbacks,
+						      struct gcstubcallback,
+						      link)->handle;
+		stub_callback_free(&gcicallback);
+	}
+
+	memset(&g_stubstats, 0, sizeof(g_stubstats));
+	g_stubnexthandle = 1;
+
+	GCUNLOCK(&g_stublock);
+}
+
+void gcstub_caps(const uint32_t *caps, unsigned int count)
+{
+	unsigned int i;
+
+	GCLOCK(&g_stublock);
+
+	for (i = 0; i < countof(g_stubcaps); i += 1)
+		g_stubcaps[i] = (i < count) ? caps[i] : 0;
+
+	GCUNLOCK(&g_stublock);
+}
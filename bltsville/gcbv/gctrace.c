@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc. and Vivante Corporation
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Trace recorder and reader. The recorder sits between the ioctl wrappers
+ * and the driver backend and appends every GETCAPS, MAP, UNMAP, COMMIT and
+ * callback request to a file in the format described in gctrace.h; the
+ * commit records carry the command words and fixups as the builder left
+ * them, before the kernel patches any address.
+ */
+
+#include "gcmain.h"
+#include "gctrace.h"
+#include <time.h>
+
+#define GCZONE_NONE		0
+#define GCZONE_ALL		(~0U)
+#define GCZONE_RECORD		(1 << 0)
+
+GCDBG_FILTERDEF(trace, GCZONE_NONE,
+		"record")
+
+
+struct gctracestate {
+	FILE *file;
+	const struct gcdevice *device;
+
+	/* Time the previous record was issued, in microseconds. */
+	uint64_t last;
+};
+
+static GCDEFINE_LOCK(g_tracelock);
+static struct gctracestate g_trace;
+
+static uint64_t trace_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void put_word(uint32_t word)
+{
+	fwrite(&word, sizeof(word), 1, g_trace.file);
+}
+
+static void put_record(enum gctracetype type, unsigned int words,
+		       uint32_t gcerror, uint64_t start, uint64_t end)
+{
+	struct gctracerecord record;
+
+	record.type = type;
+	record.size = words * sizeof(uint32_t);
+	record.gcerror = gcerror;
+	record.duration = (uint32_t) (end - start);
+
+	/* Requests from different threads may finish out of order. */
+	if (start > g_trace.last) {
+		record.delta = (uint32_t) (start - g_trace.last);
+		g_trace.last = start;
+	} else {
+		record.delta = 0;
+	}
+
+	fwrite(&record, sizeof(record), 1, g_trace.file);
+}
+
+
+/*******************************************************************************
+ * Records; called with the lock held.
+ */
+
+static void record_caps(struct gcicaps *gcicaps, uint64_t start, uint64_t end)
+{
+	put_record(GCTRACE_CAPS, 9, gcicaps->gcerror, start, end);
+	put_word(gcicaps->gcmodel);
+	put_word(gcicaps->gcrevision);
+	put_word(gcicaps->gcdate);
+	put_word(gcicaps->gctime);
+	put_word(gcicaps->gcfeatures.raw);
+	put_word(gcicaps->gcfeatures0.raw);
+	put_word(gcicaps->gcfeatures1.raw);
+	put_word(gcicaps->gcfeatures2.raw);
+	put_word(gcicaps->gcfeatures3.raw);
+}
+
+static void record_map(struct gcimap *gcimap, uint64_t start, uint64_t end)
+{
+	unsigned int pagesize, pagecount, offset;
+
+	pagesize = (gcimap->pagesize != 0) ? gcimap->pagesize : PAGE_SIZE;
+
+	if (gcimap->pagearray != NULL) {
+		offset = gcimap->buf.offset;
+		pagecount = (offset + gcimap->size + pagesize - 1) / pagesize;
+	} else {
+		offset = (unsigned long) gcimap->buf.logical & (pagesize - 1);
+		pagecount = 0;
+	}
+
+	put_record(GCTRACE_MAP, 5, gcimap->gcerror, start, end);
+	put_word(gcimap->handle);
+	put_word(gcimap->size);
+	put_word(gcimap->pagesize);
+	put_word(pagecount);
+	put_word(offset);
+}
+
+static void record_unmap(struct gcimap *gcimap, uint64_t start, uint64_t end)
+{
+	put_record(GCTRACE_UNMAP, 1, gcimap->gcerror, start, end);
+	put_word(gcimap->handle);
+}
+
+static void record_commit(struct gcicommit *gcicommit,
+			  uint64_t start, uint64_t end)
+{
+	struct list_head *head, *fixuphead;
+	struct gcbuffer *gcbuffer;
+	struct gcfixup *gcfixup;
+	struct gcschedunmap *gcschedunmap;
+	unsigned int words, buffercount, unmapcount, fixupcount, count, i;
+	uint32_t flags;
+
+	/* Size the record. */
+	words = 5;
+	buffercount = 0;
+	list_for_each(head, &gcicommit->buffer) {
+		gcbuffer = list_entry(head, struct gcbuffer, link);
+
+		words += 3 + (gcbuffer->tail - gcbuffer->head);
+		list_for_each(fixuphead, &gcbuffer->fixup) {
+			gcfixup = list_entry(fixuphead, struct gcfixup, link);
+			words += gcfixup->count * 2;
+		}
+
+		buffercount += 1;
+	}
+
+	unmapcount = 0;
+	list_for_each(head, &gcicommit->unmap)
+		unmapcount += 1;
+	words += unmapcount;
+
+	flags = 0;
+	if (gcicommit->asynchronous)
+		flags |= GCTRACE_ASYNC;
+	if (gcicommit->callback != NULL)
+		flags |= GCTRACE_HASCALLBACK;
+
+	put_record(GCTRACE_COMMIT, words, gcicommit->gcerror, start, end);
+	put_word(gcicommit->entrypipe);
+	put_word(gcicommit->exitpipe);
+	put_word(flags);
+	put_word(buffercount);
+	put_word(unmapcount);
+
+	list_for_each(head, &gcicommit->buffer) {
+		gcbuffer = list_entry(head, struct gcbuffer, link);
+
+		count = gcbuffer->tail - gcbuffer->head;
+
+		fixupcount = 0;
+		list_for_each(fixuphead, &gcbuffer->fixup) {
+			gcfixup = list_entry(fixuphead, struct gcfixup, link);
+			fixupcount += gcfixup->count;
+		}
+
+		put_word(gcbuffer->pixelcount);
+		put_word(count);
+		put_word(fixupcount);
+		fwrite(gcbuffer->head, sizeof(uint32_t), count, g_trace.file);
+
+		list_for_each(fixuphead, &gcbuffer->fixup) {
+			gcfixup = list_entry(fixuphead, struct gcfixup, link);
+
+			for (i = 0; i < gcfixup->count; i += 1) {
+				put_word(gcfixup->fixup[i].dataoffset);
+				put_word(gcfixup->fixup[i].surfoffset);
+			}
+		}
+	}
+
+	list_for_each(head, &gcicommit->unmap) {
+		gcschedunmap = list_entry(head, struct gcschedunmap, link);
+		put_word(gcschedunmap->handle);
+	}
+}
+
+
+/*******************************************************************************
+ * Recorder backend.
+ */
+
+static int trace_open(void)
+{
+	return g_trace.device->open();
+}
+
+static void trace_close(__unused int handle)
+{
+	GCLOCK(&g_tracelock);
+
+	if (g_trace.file != NULL) {
+		fclose(g_trace.file);
+		g_trace.file = NULL;
+	}
+
+	GCUNLOCK(&g_tracelock);
+}
+
+static int trace_ioctl(int handle, unsigned int code, void *arg)
+{
+	struct gcicallbackwait *gcicallbackwait;
+	uint64_t start, end;
+	int result;
+
+	start = trace_time();
+	result = g_trace.device->ioctl(handle, code, arg);
+	end = trace_time();
+
+	/* Only requests that reached the driver are recorded. */
+	if (result != 0)
+		return result;
+
+	GCLOCK(&g_tracelock);
+
+	if (g_trace.file == NULL)
+		goto exit;
+
+	switch (code) {
+	case GCIOCTL_GETCAPS:
+		record_caps(arg, start, end);
+		break;
+
+	case GCIOCTL_MAP:
+		record_map(arg, start, end);
+		break;
+
+	case GCIOCTL_UNMAP:
+		record_unmap(arg, start, end);
+		break;
+
+	case GCIOCTL_COMMIT:
+		record_commit(arg, start, end);
+		break;
+
+	case GCIOCTL_CALLBACK_ARM:
+		put_record(GCTRACE_CALLBACK_ARM, 0,
+			   ((struct gcicallbackarm *) arg)->gcerror,
+			   start, end);
+		break;
+
+	case GCIOCTL_CALLBACK_WAIT:
+		gcicallbackwait = arg;
+		/* Stamped with the delivery, not the start of the wait. */
+		if (gcicallbackwait->gcerror == GCERR_NONE)
+			put_record(GCTRACE_CALLBACK, 0, GCERR_NONE,
+				   end, end);
+		break;
+	}
+
+	GCDBG(GCZONE_RECORD, "ioctl 0x%08X recorded.\n", code);
+
+exit:
+	GCUNLOCK(&g_tracelock);
+	return result;
+}
+
+static void trace_wake(int handle, pthread_t thread)
+{
+	g_trace.device->wake(handle, thread);
+}
+
+static const struct gcdevice g_tracedevice = {
+	.name = "trace",
+	.open = trace_open,
+	.close = trace_close,
+	.ioctl = trace_ioctl,
+	.wake = trace_wake
+};
+
+const struct gcdevice *gctrace_attach(const char *path,
+				      const struct gcdevice *device,
+				      int handle)
+{
+	struct gctracehead head;
+	struct gcicaps gcicaps;
+	FILE *file;
+
+	GCDBG_REGISTER(trace);
+
+	file = fopen(path, "wb");
+	if (file == NULL)
+		return NULL;
+
+	head.magic = GCTRACE_MAGIC;
+	head.version = GCTRACE_VERSION;
+	fwrite(&head, sizeof(head), 1, file);
+
+	GCLOCK(&g_tracelock);
+
+	if (g_trace.file != NULL)
+		fclose(g_trace.file);
+
+	g_trace.file = file;
+	g_trace.device = device;
+	g_trace.last = trace_time();
+
+	GCUNLOCK(&g_tracelock);
+
+	/* Replays need the capabilities the library saw. */
+	g_tracedevice.ioctl(handle, GCIOCTL_GETCAPS, &gcicaps);
+
+	return &g_tracedevice;
+}
+
+
+/*******************************************************************************
+ * Reader.
+ */
+
+int gctrace_open(struct gctracefile *trace, const char *path)
+{
+	struct gctracehead head;
+
+	memset(trace, 0, sizeof(struct gctracefile));
+
+	trace->file = fopen(path, "rb");
+	if (trace->file == NULL)
+		return -1;
+
+	if ((fread(&head, sizeof(head), 1, trace->file) != 1) ||
+	    (head.magic != GCTRACE_MAGIC) ||
+	    (head.version != GCTRACE_VERSION)) {
+		gctrace_close(trace);
+		return -1;
+	}
+
+	return 0;
+}
+
+void gctrace_close(struct gctracefile *trace)
+{
+	if (trace->file != NULL)
+		fclose(trace->file);
+
+	free(trace->data);
+	memset(trace, 0, sizeof(struct gctracefile));
+}
+
+int gctrace_read(struct gctracefile *trace)
+{
+	uint32_t *data;
+
+	if (fread(&trace->record, sizeof(trace->record), 1, trace->file) != 1)
+		return feof(trace->file) ? 0 : -1;
+
+	if ((trace->record.size % sizeof(uint32_t)) != 0)
+		return -1;
+
+	if (trace->record.size > trace->capacity) {
+		data = realloc(trace->data, trace->record.size);
+		if (data == NULL)
+			return -1;
+
+		trace->data = data;
+		trace->capacity = trace->record.size;
+	}
+
+	if ((trace->record.size != 0) &&
+	    (fread(trace->data, trace->record.size, 1, trace->file) != 1))
+		return -1;
+
+	return 1;
+}
+
+int gctrace_commit(const struct gctracefile *trace,
+		   struct gctracecommit *commit)
+{
+	unsigned int count = trace->record.size / sizeof(uint32_t);
+
+	if ((trace->record.type != GCTRACE_COMMIT) || (count < 5))
+		return -1;
+
+	commit->entrypipe = trace->data[0];
+	commit->exitpipe = trace->data[1];
+	commit->flags = trace->data[2];
+	commit->buffercount = trace->data[3];
+	commit->unmapcount = trace->data[4];
+
+	if (commit->unmapcount > count - 5)
+		return -1;
+
+	commit->next = trace->data + 5;
+	commit->end = trace->data + count - commit->unmapcount;
+	commit->unmap = commit->end;
+	return 0;
+}
+
+int gctrace_buffer(struct gctracecommit *commit,
+		   struct gctracebuffer *buffer)
+{
+	unsigned int available = commit->end - commit->next;
+
+	if (available < 3)
+		return -1;
+
+	buffer->pixelcount = commit->next[0];
+	buffer->wordcount = commit->next[1];
+	buffer->fixupcount = commit->next[2];
+	available -= 3;
+
+	if ((buffer->wordcount > available) ||
+	    (buffer->fixupcount > (available - buffer->wordcount) / 2))
+		return -1;
+
+	buffer->words = commit->next + 3;
+	buffer->fixups = buffer->words + buffer->wordcount;
+	commit->next = buffer->fixups + buffer->fixupcount * 2;
+	return 0;
+}
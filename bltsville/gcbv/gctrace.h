@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2012,
+ * Texas Instruments, Inc. and Vivante Corporation
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Texas Instruments, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL TEXAS INSTRUMENTS, INC. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GCTRACE_H
+#define GCTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * Trace file format.
+ *
+ * A trace is a gctracehead followed by records; every record is a
+ * gctracerecord followed by 'size' bytes of 32-bit words. All values are
+ * stored in the byte order of the recording machine.
+ */
+
+#define GCTRACE_MAGIC		0x52544347	/* "GCTR" */
+#define GCTRACE_VERSION		1
+
+struct gctracehead {
+	uint32_t magic;
+	uint32_t version;
+};
+
+enum gctracetype {
+	/* model, revision, date, time, features, features0..3 */
+	GCTRACE_CAPS = 1,
+
+	/* handle, size, pagesize, pagecount, offset */
+	GCTRACE_MAP,
+
+	/* handle */
+	GCTRACE_UNMAP,
+
+	/* entrypipe, exitpipe, flags, buffercount, unmapcount,
+	 * buffercount times:
+	 *     pixelcount, wordcount, fixupcount,
+	 *     wordcount command words,
+	 *     fixupcount (dataoffset, surfoffset) pairs,
+	 * unmapcount map handles */
+	GCTRACE_COMMIT,
+
+	/* no payload */
+	GCTRACE_CALLBACK_ARM,
+
+	/* a callback delivered by GCIOCTL_CALLBACK_WAIT, no payload */
+	GCTRACE_CALLBACK
+};
+
+/* GCTRACE_COMMIT flags. */
+#define GCTRACE_ASYNC		(1 << 0)
+#define GCTRACE_HASCALLBACK	(1 << 1)
+
+struct gctracerecord {
+	uint32_t type;
+	uint32_t size;
+
+	/* gcerror returned by the driver. */
+	uint32_t gcerror;
+
+	/* Microseconds since the previous record was issued. */
+	uint32_t delta;
+
+	/* Microseconds spent in the driver. */
+	uint32_t duration;
+};
+
+
+/*******************************************************************************
+ * Recording control, only in builds with GCBV_TEST_BACKENDS set; the library
+ * starts recording on its own when GCBV_TRACE is set. Only switch while no
+ * blit is in flight.
+ */
+
+int gc_trace_start(const char *path);
+void gc_trace_stop(void);
+
+
+/*******************************************************************************
+ * Trace reader.
+ */
+
+struct gctracefile {
+	FILE *file;
+	struct gctracerecord record;
+
+	/* Payload of the current record. */
+	uint32_t *data;
+	unsigned int capacity;
+};
+
+struct gctracebuffer {
+	uint32_t pixelcount;
+	uint32_t wordcount;
+	uint32_t fixupcount;
+	const uint32_t *words;
+	const uint32_t *fixups;
+};
+
+struct gctracecommit {
+	uint32_t entrypipe;
+	uint32_t exitpipe;
+	uint32_t flags;
+	uint32_t buffercount;
+	uint32_t unmapcount;
+	const uint32_t *unmap;
+
+	/* Buffer iterator. */
+	const uint32_t *next;
+	const uint32_t *end;
+};
+
+/* Return 0 on success, -1 if the file is not a trace. */
+int gctrace_open(struct gctracefile *trace, const char *path);
+void gctrace_close(struct gctracefile *trace);
+
+/* Reads the next record; returns 1, 0 at the end of the trace, or -1 if
+ * the trace is truncated or corrupt. */
+int gctrace_read(struct gctracefile *trace);
+
+/* Split a GCTRACE_COMMIT record; return 0 or -1 if it is malformed. */
+int gctrace_commit(const struct gctracefile *trace,
+		   struct gctracecommit *commit);
+int gctrace_buffer(struct gctracecommit *commit,
+		   struct gctracebuffer *buffer);
+
+
+/*******************************************************************************
+ * Command stream decoder.
+ */
+
+/* Returns the gcreg.h name of a state address, or NULL if unknown;
+ * index is set to the element of register arrays. */
+const char *gcdecode_register(unsigned int address, unsigned int *index);
+
+/* Returns the number of words taken by the command at data, or 0 if the
+ * command is unknown or does not fit into count words. */
+unsigned int gcdecode_length(const uint32_t *data, unsigned int count);
+
+/* Prints the commands symbolically; fixups are the (dataoffset, surfoffset)
+ * pairs of the buffer. Returns -1 if the stream is malformed. */
+int gcdecode_print(FILE *out, const uint32_t *data, unsigned int count,
+		   const uint32_t *fixups, unsigned int fixupcount);
+
+struct gcdecodestats {
+	unsigned int commits;
+	unsigned int buffers;
+	unsigned long long words;
+	unsigned int blits;		/* STARTDE and filter starts */
+	unsigned int rects;
+	unsigned int loadstates;	/* LOAD_STATE commands */
+	unsigned long long states;	/* register writes */
+
+	/* Writes of the value the register already had, set earlier in the
+	 * same commit or left behind by a previous commit. */
+	unsigned long long redundant;
+	unsigned long long carried;
+
+	unsigned int fixups;
+	unsigned int malformed;
+
+	/* Register shadow, indexed by state address. */
+	uint32_t *value;
+	uint32_t *epoch;
+};
+
+int gcdecode_init(struct gcdecodestats *stats);
+void gcdecode_free(struct gcdecodestats *stats);
+
+/* Starts a commit; its buffers are accounted after it. */
+void gcdecode_commit(struct gcdecodestats *stats);
+void gcdecode_buffer(struct gcdecodestats *stats,
+		     const uint32_t *data, unsigned int count,
+		     unsigned int fixupcount);
+
+
+/*******************************************************************************
+ * Stub driver.
+ */
+
+struct gcstubstats {
+	unsigned int commits;
+	unsigned int buffers;
+	unsigned long long bytes;
+	unsigned int fixups;
+	unsigned int maps;
+	unsigned int unmaps;
+	unsigned int livemaps;
+	unsigned int callbacks;
+
+	/* Commits, unmaps and callbacks the stub refused. */
+	unsigned int errors;
+};
+
+void gcstub_stats(struct gcstubstats *stats);
+void gcstub_reset(void);
+
+/* Reports the capabilities of a GCTRACE_CAPS record from now on. */
+void gcstub_caps(const uint32_t *caps, unsigned int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -38,12 +38,14 @@
 #define GCZONE_BUFFER_ALLOC	(1 << 1)
 #define GCZONE_FIXUP_ALLOC	(1 << 2)
 #define GCZONE_FIXUP		(1 << 3)
+#define GCZONE_SHADOW		(1 << 4)
 
 GCDBG_FILTERDEF(buffer, GCZONE_NONE,
 		"batchalloc",
 		"bufferalloc"
 		"fixupalloc",
-		"fixup")
+		"fixup",
+		"shadow")
 
 
 /*******************************************************************************
@@ -381,3 +383,501 @@ exit:
 		  (bverror == BVERR_NONE) ? "result" : "error", bverror);
 	return bverror;
 }
+
+
+/*******************************************************************************
+ * State shadow.
+ */
+
+/* Writes that start operations or synchronize the pipe rather than load
+ * a state: filter blits start with the write of their configuration,
+ * pipe select, events, semaphores, flushes and stalls follow it. */
+static inline bool trigger_state(unsigned int address)
+{
+	return (address == gcregVRConfigRegAddrs) ||
+	       ((address >= gcregPipeSelectRegAddrs) &&
+		(address <= gcregStallRegAddrs));
+}
+
+static struct gcshadowstate *get_shadow(unsigned int address)
+{
+	struct gccontext *gccontext = get_context();
+	struct gcshadow *gcshadow = &gccontext->shadow;
+	struct gcshadowstate *page;
+	unsigned int index;
+
+	index = address >> GC_SHADOW_PAGE_BITS;
+	if (index >= GC_SHADOW_PAGE_COUNT)
+		return NULL;
+
+	page = gcshadow->page[index];
+	if (page == NULL) {
+		page = gcalloc(struct gcshadowstate,
+			       GC_SHADOW_PAGE_SIZE
+			       * sizeof(struct gcshadowstate));
+		if (page == NULL)
+			return NULL;
+
+		memset(page, 0, GC_SHADOW_PAGE_SIZE
+				* sizeof(struct gcshadowstate));
+		gcshadow->page[index] = page;
+
+		GCDBG(GCZONE_SHADOW, "shadow page 0x%04X allocated.\n",
+		      address & ~(GC_SHADOW_PAGE_SIZE - 1));
+	}
+
+	return &page[address & (GC_SHADOW_PAGE_SIZE - 1)];
+}
+
+/* Records the write of a state, returns false if the state already holds
+ * the value. */
+static bool load_state(unsigned int address, unsigned int value,
+		       struct gcfixupentry *fixup)
+{
+	struct gccontext *gccontext = get_context();
+	struct gcshadowstate *state;
+	bool changed;
+
+	if (trigger_state(address))
+		return true;
+
+	state = get_shadow(address);
+	if (state == NULL)
+		return true;
+
+	changed = (state->epoch != gccontext->shadow.epoch) ||
+		  (state->value != value) ||
+		  (state->fixup != (fixup != NULL)) ||
+		  ((fixup != NULL) &&
+		   (state->surfoffset != fixup->surfoffset));
+
+	state->epoch = gccontext->shadow.epoch;
+	state->value = value;
+	state->fixup = (fixup != NULL);
+	state->surfoffset = (fixup != NULL) ? fixup->surfoffset : 0;
+
+	return changed;
+}
+
+void invalidate_shadow(void)
+{
+	struct gccontext *gccontext = get_context();
+	struct gcshadow *gcshadow = &gccontext->shadow;
+	unsigned int i;
+
+	gcshadow->epoch += 1;
+	if (gcshadow->epoch != 0)
+		return;
+
+	/* Wrapped around, forget the old epochs. */
+	for (i = 0; i < GC_SHADOW_PAGE_COUNT; i += 1)
+		if (gcshadow->page[i] != NULL)
+			memset(gcshadow->page[i], 0, GC_SHADOW_PAGE_SIZE
+					* sizeof(struct gcshadowstate));
+
+	gcshadow->epoch = 1;
+}
+
+void free_shadow(void)
+{
+	struct gccontext *gccontext = get_context();
+	struct gcshadow *gcshadow = &gccontext->shadow;
+	unsigned int i;
+
+	for (i = 0; i < GC_SHADOW_PAGE_COUNT; i += 1) {
+		gcfree(gcshadow->page[i]);
+		gcshadow->page[i] = NULL;
+	}
+}
+
+
+/*******************************************************************************
+ * Pending commit management.
+ */
+
+/* Fixups of a command buffer in buffer order. */
+struct fixupiter {
+	struct list_head *list;
+	struct list_head *head;
+	unsigned int index;
+};
+
+static void fixup_begin(struct fixupiter *iter, struct gcbuffer *gcbuffer)
+{
+	iter->list = &gcbuffer->fixup;
+	iter->head = gcbuffer->fixup.next;
+	iter->index = 0;
+}
+
+static struct gcfixupentry *fixup_peek(struct fixupiter *iter)
+{
+	struct gcfixup *gcfixup;
+
+	while (iter->head != iter->list) {
+		gcfixup = list_entry(iter->head, struct gcfixup, link);
+		if (iter->index < gcfixup->count)
+			return &gcfixup->fixup[iter->index];
+
+		iter->head = iter->head->next;
+		iter->index = 0;
+	}
+
+	return NULL;
+}
+
+/* Returns the fixup of the word at the offset if there is one. */
+static struct gcfixupentry *fixup_take(struct fixupiter *iter,
+				       unsigned int dataoffset)
+{
+	struct gcfixupentry *fixup;
+
+	while (((fixup = fixup_peek(iter)) != NULL) &&
+	       (fixup->dataoffset < dataoffset))
+		iter->index += 1;
+
+	if ((fixup == NULL) || (fixup->dataoffset != dataoffset))
+		return NULL;
+
+	iter->index += 1;
+	return fixup;
+}
+
+static bool fixups_sorted(struct gcbuffer *gcbuffer)
+{
+	struct fixupiter iter;
+	struct gcfixupentry *fixup;
+	unsigned int dataoffset = 0;
+
+	fixup_begin(&iter, gcbuffer);
+	while ((fixup = fixup_peek(&iter)) != NULL) {
+		if (fixup->dataoffset < dataoffset)
+			return false;
+
+		dataoffset = fixup->dataoffset;
+		iter.index += 1;
+	}
+
+	return true;
+}
+
+/* Length of the command in words, 0 if it is not one the builder emits or
+ * if it is cut short. */
+static unsigned int command_length(unsigned int *data, unsigned int count)
+{
+	struct gccmdldstate *gccmdldstate;
+	unsigned int length, rects, extra;
+
+	switch (data[0] >> 27) {
+	case GCREG_COMMAND_OPCODE_LOAD_STATE:
+		/* States are padded to keep the next command 64-bit
+		 * aligned. */
+		gccmdldstate = (struct gccmdldstate *) data;
+		length = 1 + (((gccmdldstate->count == 0)
+				? 1024 : gccmdldstate->count) | 1);
+		break;
+
+	case GCREG_COMMAND_OPCODE_STARTDE:
+		rects = (data[0] >> 8) & 0xFF;
+		extra = (data[0] >> 16) & 0x7FF;
+		length = 2 + rects * 2 + ((extra + 1) & ~1);
+		break;
+
+	case GCREG_COMMAND_OPCODE_NOP:
+		length = 2;
+		break;
+
+	default:
+		return 0;
+	}
+
+	return (length <= count) ? length : 0;
+}
+
+/* Appends the words to the pending commit with their fixups. */
+static enum bverror copy_commands(struct bvbltparams *bvbltparams,
+				  struct gcbatch *pending,
+				  unsigned int *data,
+				  unsigned int first, unsigned int last,
+				  struct fixupiter *iter)
+{
+	enum bverror bverror;
+	struct gcfixupentry *fixup;
+	unsigned int *buffer;
+
+	bverror = claim_buffer(bvbltparams, pending,
+			       (last - first) * sizeof(unsigned int),
+			       (void **) &buffer);
+	if (bverror != BVERR_NONE)
+		return bverror;
+
+	memcpy(buffer, data + first, (last - first) * sizeof(unsigned int));
+
+	while (((fixup = fixup_peek(iter)) != NULL) &&
+	       (fixup->dataoffset < last)) {
+		if (fixup->dataoffset >= first) {
+			bverror = add_fixup(bvbltparams, pending,
+					    buffer + fixup->dataoffset - first,
+					    fixup->surfoffset);
+			if (bverror != BVERR_NONE)
+				return bverror;
+		}
+
+		iter->index += 1;
+	}
+
+	return BVERR_NONE;
+}
+
+/* Size in words of a state load. */
+static inline unsigned int load_size(unsigned int count)
+{
+	return 1 + (count | 1);
+}
+
+/* Appends the states first to last - 1 of the state load at the offset. */
+static enum bverror copy_states(struct bvbltparams *bvbltparams,
+				struct gcbatch *pending,
+				unsigned int *data,
+				unsigned int offset,
+				unsigned int first, unsigned int last,
+				struct fixupiter *iter)
+{
+	enum bverror bverror;
+	struct gccmdldstate gccmdldstate;
+	struct gcfixupentry *fixup;
+	unsigned int *buffer;
+	unsigned int count, i;
+
+	count = last - first;
+	bverror = claim_buffer(bvbltparams, pending,
+			       load_size(count) * sizeof(unsigned int),
+			       (void **) &buffer);
+	if (bverror != BVERR_NONE)
+		return bverror;
+
+	gccmdldstate = *(struct gccmdldstate *) &data[offset];
+	gccmdldstate.address += first;
+	gccmdldstate.count = (count == 1024) ? 0 : count;
+	*(struct gccmdldstate *) buffer = gccmdldstate;
+
+	memcpy(buffer + 1, data + offset + 1 + first,
+	       count * sizeof(unsigned int));
+	if ((count & 1) == 0)
+		buffer[1 + count] = 0;
+
+	for (i = first; i < last; i += 1) {
+		fixup = fixup_take(iter, offset + 1 + i);
+		if (fixup == NULL)
+			continue;
+
+		bverror = add_fixup(bvbltparams, pending,
+				    buffer + 1 + i - first,
+				    fixup->surfoffset);
+		if (bverror != BVERR_NONE)
+			return bverror;
+	}
+
+	return BVERR_NONE;
+}
+
+/* Appends the state load at the offset without the states the pending
+ * commit already loaded. */
+static enum bverror queue_states(struct bvbltparams *bvbltparams,
+				 struct gcbatch *pending,
+				 unsigned int *data,
+				 unsigned int offset,
+				 struct fixupiter *iter)
+{
+	enum bverror bverror;
+	struct gccmdldstate *gccmdldstate;
+	struct gcfixupentry *fixup;
+	struct fixupiter start;
+	unsigned char keep[1024];
+	unsigned int count, first, last, i;
+
+	gccmdldstate = (struct gccmdldstate *) &data[offset];
+	count = (gccmdldstate->count == 0) ? 1024 : gccmdldstate->count;
+
+	/* Fixed point values are converted on the way, pass them through
+	 * and forget what was loaded. */
+	if (gccmdldstate->fixed) {
+		invalidate_shadow();
+		return copy_commands(bvbltparams, pending, data,
+				     offset, offset + load_size(count), iter);
+	}
+
+	start = *iter;
+	for (i = 0; i < count; i += 1) {
+		fixup = fixup_take(iter, offset + 1 + i);
+		keep[i] = load_state(gccmdldstate->address + i,
+				     data[offset + 1 + i], fixup);
+	}
+	*iter = start;
+
+	/* Split the load around the states already loaded where a separate
+	 * load costs less than reloading them. */
+	first = last = count;
+	for (i = 0; i < count; i += 1) {
+		if (!keep[i])
+			continue;
+
+		if (first == count) {
+			first = i;
+		} else if (load_size(i + 1 - first)
+			   > load_size(last - first) + load_size(1)) {
+			bverror = copy_states(bvbltparams, pending, data,
+					      offset, first, last, iter);
+			if (bverror != BVERR_NONE)
+				return bverror;
+
+			first = i;
+		}
+
+		last = i + 1;
+	}
+
+	if (first == count) {
+		GCDBG(GCZONE_SHADOW, "states 0x%04X-0x%04X already loaded.\n",
+		      gccmdldstate->address,
+		      gccmdldstate->address + count - 1);
+		return BVERR_NONE;
+	}
+
+	return copy_states(bvbltparams, pending, data,
+			   offset, first, last, iter);
+}
+
+static enum bverror queue_buffer(struct bvbltparams *bvbltparams,
+				 struct gcbatch *pending,
+				 struct gcbuffer *gcbuffer)
+{
+	enum bverror bverror;
+	struct fixupiter iter;
+	unsigned int *data;
+	unsigned int count, offset, length;
+
+	data = gcbuffer->head;
+	count = gcbuffer->tail - gcbuffer->head;
+	fixup_begin(&iter, gcbuffer);
+
+	/* The shadow walks the fixups along with the commands. */
+	if (!fixups_sorted(gcbuffer)) {
+		GCDBG(GCZONE_SHADOW, "fixups out of order.\n");
+		invalidate_shadow();
+		return copy_commands(bvbltparams, pending, data,
+				     0, count, &iter);
+	}
+
+	for (offset = 0; offset < count; offset += length) {
+		length = command_length(data + offset, count - offset);
+		if (length == 0) {
+			GCDBG(GCZONE_SHADOW,
+			      "unexpected command 0x%08X.\n", data[offset]);
+			invalidate_shadow();
+			return copy_commands(bvbltparams, pending, data,
+					     offset, count, &iter);
+		}
+
+		if ((data[offset] >> 27) == GCREG_COMMAND_OPCODE_LOAD_STATE)
+			bverror = queue_states(bvbltparams, pending,
+					       data, offset, &iter);
+		else
+			bverror = copy_commands(bvbltparams, pending, data,
+						offset, offset + length,
+						&iter);
+
+		if (bverror != BVERR_NONE)
+			return bverror;
+	}
+
+	return BVERR_NONE;
+}
+
+enum bverror queue_batch(struct bvbltparams *bvbltparams,
+			 struct gcbatch *gcbatch)
+{
+	enum bverror bverror;
+	struct gccontext *gccontext = get_context();
+	struct gcbatch *pending;
+	struct list_head *head, *fixuptail;
+	struct gcbuffer *gcbuffer, *last;
+	struct gcfixup *gcfixup = NULL;
+	unsigned int *tail;
+	unsigned int available, size, fixupcount = 0;
+	unsigned int pixelcount = 0;
+
+	GCENTERARG(GCZONE_BATCH_ALLOC, "batch = 0x%08X\n",
+		   (unsigned int) gcbatch);
+
+	if (gccontext->pending == NULL) {
+		bverror = allocate_batch(bvbltparams, &gccontext->pending);
+		if (bverror != BVERR_NONE)
+			goto exit;
+	}
+
+	pending = gccontext->pending;
+
+	/* Remember where the batch starts to take it back on failure. */
+	last = list_entry(pending->buffer.prev, struct gcbuffer, link);
+	tail = last->tail;
+	available = last->available;
+	size = pending->size;
+
+	if (!list_empty(&last->fixup)) {
+		gcfixup = list_entry(last->fixup.prev, struct gcfixup, link);
+		fixupcount = gcfixup->count;
+	}
+
+	list_for_each(head, &gcbatch->buffer) {
+		gcbuffer = list_entry(head, struct gcbuffer, link);
+
+		bverror = queue_buffer(bvbltparams, pending, gcbuffer);
+		if (bverror != BVERR_NONE)
+			goto fail;
+
+		pixelcount += gcbuffer->pixelcount;
+	}
+
+	gcbuffer = list_entry(pending->buffer.prev, struct gcbuffer, link);
+	gcbuffer->pixelcount += pixelcount;
+
+	/* The commit unmaps what the batch mapped implicitly. */
+	list_splice_tail_init(&gcbatch->unmap, &pending->unmap);
+
+	GCDBG(GCZONE_BATCH_ALLOC, "pending commit size = %d\n",
+	      pending->size);
+	goto exit;
+
+fail:
+	GCLOCK(&gccontext->bufferlock);
+	GCLOCK(&gccontext->fixuplock);
+
+	while (pending->buffer.prev != &last->link) {
+		gcbuffer = list_entry(pending->buffer.prev,
+				      struct gcbuffer, link);
+		list_splice_init(&gcbuffer->fixup, &gccontext->fixupvac);
+		list_move(&gcbuffer->link, &gccontext->buffervac);
+	}
+
+	fixuptail = (gcfixup == NULL) ? &last->fixup : &gcfixup->link;
+	while (last->fixup.prev != fixuptail)
+		list_move(last->fixup.prev, &gccontext->fixupvac);
+
+	if (gcfixup != NULL)
+		gcfixup->count = fixupcount;
+
+	last->tail = tail;
+	last->available = available;
+	pending->size = size;
+
+	GCUNLOCK(&gccontext->fixuplock);
+	GCUNLOCK(&gccontext->bufferlock);
+
+	/* The shadow has seen the states of the dropped commands. */
+	invalidate_shadow();
+
+exit:
+	GCEXITARG(GCZONE_BATCH_ALLOC, "bv%s = %d\n",
+		  (bverror == BVERR_NONE) ? "result" : "error", bverror);
+	return bverror;
+}
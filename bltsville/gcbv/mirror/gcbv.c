@@ -353,6 +353,178 @@ void callbackfreesurface(void *callbackinfo)
 }
 
 
+/*******************************************************************************
+ * Pending commit.
+ */
+
+/* Submits the pending commit; called with commitlock held. */
+static enum bverror commit_pending(struct bvbltparams *bvbltparams,
+				   struct gcicommit *gcicommit)
+{
+	enum bverror bverror = BVERR_NONE;
+	struct gccontext *gccontext = get_context();
+	struct gcbatch *pending;
+
+	pending = gccontext->pending;
+	if (pending == NULL)
+		goto exit;
+
+	/* Process scheduled unmappings. */
+	do_unmap_implicit(pending);
+
+	INIT_LIST_HEAD(&gcicommit->unmap);
+	list_splice_init(&pending->unmap, &gcicommit->unmap);
+
+	/* Pass the batch for execution. */
+	GCDUMPBATCH(pending);
+
+	gcicommit->gcerror = GCERR_NONE;
+	gcicommit->entrypipe = GCPIPE_2D;
+	gcicommit->exitpipe = GCPIPE_2D;
+
+	INIT_LIST_HEAD(&gcicommit->buffer);
+	list_splice_init(&pending->buffer, &gcicommit->buffer);
+
+	GCDBG(GCZONE_BLIT, "submitting the batch.\n");
+	gc_commit_wrapper(gcicommit);
+
+	/* Move the lists back to the batch. */
+	list_splice_init(&gcicommit->buffer, &pending->buffer);
+	list_splice_init(&gcicommit->unmap, &pending->unmap);
+
+	/* Start over with the next commit. */
+	gccontext->pending = NULL;
+	free_batch(pending);
+	invalidate_shadow();
+
+	/* Error? */
+	if (gcicommit->gcerror != GCERR_NONE) {
+		switch (gcicommit->gcerror) {
+		case GCERR_OODM:
+		case GCERR_CTX_ALLOC:
+			BVSETERROR(BVERR_OOM,
+				   "unable to allocate gccore memory");
+			break;
+		default:
+			BVSETERROR(BVERR_RSRC, "gccore error");
+		}
+
+		if (bvbltparams != NULL)
+			bvbltparams->errdesc = gccontext->bverrorstr;
+		goto exit;
+	}
+
+	GCDBG(GCZONE_BLIT, "batch is submitted.\n");
+
+exit:
+	return bverror;
+}
+
+/* Submits the pending commit without waiting for it. */
+static enum bverror flush_pending(void)
+{
+	enum bverror bverror;
+	struct gccontext *gccontext = get_context();
+	struct gcicommit gcicommit;
+
+	GCLOCK(&gccontext->commitlock);
+
+	gcicommit.callback = NULL;
+	gcicommit.callbackparam = NULL;
+	gcicommit.asynchronous = true;
+	bverror = commit_pending(NULL, &gcicommit);
+
+	GCUNLOCK(&gccontext->commitlock);
+
+	return bverror;
+}
+
+/* Adds the finished batch to the pending commit and submits it unless
+ * the batch may wait for the ones that follow. */
+static enum bverror submit_batch(struct bvbltparams *bvbltparams,
+				 struct gcbatch *gcbatch)
+{
+	enum bverror bverror;
+	struct gccontext *gccontext = get_context();
+	struct gcicommit gcicommit;
+
+	/* Lock access to the pending commit. */
+	GCLOCK(&gccontext->commitlock);
+
+	bverror = queue_batch(bvbltparams, gcbatch);
+	if (bverror != BVERR_NONE)
+		goto exit;
+
+	/* Asynchronous batches without callbacks are deferred. */
+	if (((bvbltparams->flags & BVFLAG_ASYNC) != 0) &&
+	    (bvbltparams->callbackfn == NULL) &&
+	    (gccontext->pending->size < gccontext->defersize)) {
+		GCDBG(GCZONE_BATCH, "commit deferred (%d bytes).\n",
+		      gccontext->pending->size);
+		goto exit;
+	}
+
+	/* Process asynchronous operation. */
+	if ((bvbltparams->flags & BVFLAG_ASYNC) == 0) {
+		GCDBG(GCZONE_BLIT, "synchronous batch.\n");
+		gcicommit.callback = NULL;
+		gcicommit.callbackparam = NULL;
+		gcicommit.asynchronous = false;
+	} else {
+		struct gccallbackinfo *gccallbackinfo;
+
+		GCDBG(GCZONE_BLIT, "asynchronous batch (0x%08X):\n",
+		      bvbltparams->flags);
+
+		if (bvbltparams->callbackfn == NULL) {
+			GCDBG(GCZONE_BLIT, "no callback given.\n");
+			gcicommit.callback = NULL;
+			gcicommit.callbackparam = NULL;
+		} else {
+			bverror = get_callbackinfo(&gccallbackinfo);
+			if (bverror != BVERR_NONE) {
+				BVSETBLTERROR(BVERR_OOM,
+					      "callback allocation failed");
+				goto exit;
+			}
+
+			gccallbackinfo->info.callback.fn
+				= bvbltparams->callbackfn;
+			gccallbackinfo->info.callback.data
+				= bvbltparams->callbackdata;
+
+			gcicommit.callback = callbackbltsville;
+			gcicommit.callbackparam = gccallbackinfo;
+
+			GCDBG(GCZONE_BLIT,
+			      "gcbv_callback = 0x%08X\n",
+			      (unsigned int) gcicommit.callback);
+			GCDBG(GCZONE_BLIT,
+			      "gcbv_param    = 0x%08X\n",
+			      (unsigned int) gcicommit.callbackparam);
+			GCDBG(GCZONE_BLIT,
+			      "bltsville_callback = 0x%08X\n",
+			      (unsigned int)
+			      gccallbackinfo->info.callback.fn);
+			GCDBG(GCZONE_BLIT,
+			      "bltsville_param    = 0x%08X\n",
+			      (unsigned int)
+			      gccallbackinfo->info.callback.data);
+		}
+
+		gcicommit.asynchronous = true;
+	}
+
+	bverror = commit_pending(bvbltparams, &gcicommit);
+
+exit:
+	/* Unlock access to the pending commit. */
+	GCUNLOCK(&gccontext->commitlock);
+
+	return bverror;
+}
+
+
 /*******************************************************************************
  * Temporary buffer management.
  */
@@ -436,6 +608,12 @@ enum bverror free_temp(bool schedule)
 
 	/* Free the buffer. */
 	if (schedule) {
+		/* Deferred blits may still use the buffer, the callback
+		 * has to follow them. */
+		bverror = flush_pending();
+		if (bverror != BVERR_NONE)
+			goto exit;
+
 		bverror = get_callbackinfo(&gccallbackinfo);
 		if (bverror != BVERR_NONE) {
 			BVSETERROR(BVERR_OOM,
@@ -1120,6 +1298,7 @@ void bv_init(void)
 	GCLOCK_INIT(&gccontext->fixuplock);
 	GCLOCK_INIT(&gccontext->maplock);
 	GCLOCK_INIT(&gccontext->callbacklock);
+	GCLOCK_INIT(&gccontext->commitlock);
 
 	INIT_LIST_HEAD(&gccontext->unmapvac);
 	INIT_LIST_HEAD(&gccontext->buffervac);
@@ -1128,6 +1307,12 @@ void bv_init(void)
 	INIT_LIST_HEAD(&gccontext->callbacklist);
 	INIT_LIST_HEAD(&gccontext->callbackvac);
 
+	/* Nothing is known about the GC state yet. */
+	gccontext->shadow.epoch = 1;
+
+	INIT_LIST_HEAD(&gccontext->mapcache.lru);
+	gccontext->mapcache.stats.budget = GC_MAPCACHE_BUDGET;
+
 	/* Initialize the filter cache. */
 	for (i = 0; i < GC_FILTER_COUNT; i += 1)
 		for (j = 0; j < GC_TAP_COUNT; j += 1)
@@ -1158,6 +1343,20 @@ void bv_exit(void)
 	struct gcfixup *gcfixup;
 	struct gcbatch *gcbatch;
 	struct gccallbackinfo *gccallbackinfo;
+	struct gcicommit gcicommit;
+
+	/* Wait for the deferred blits. */
+	GCLOCK(&gccontext->commitlock);
+	gcicommit.callback = NULL;
+	gcicommit.callbackparam = NULL;
+	gcicommit.asynchronous = false;
+	commit_pending(NULL, &gcicommit);
+	GCUNLOCK(&gccontext->commitlock);
+
+	/* Release the cached mappings. */
+	GCLOCK(&gccontext->maplock);
+	trim_mapcache(NULL, 0);
+	GCUNLOCK(&gccontext->maplock);
 
 	while (gccontext->buffmapvac != NULL) {
 		bvbuffmap = gccontext->buffmapvac;
@@ -1206,6 +1405,7 @@ void bv_exit(void)
 	}
 
 	free_temp(false);
+	free_shadow();
 }
 
 
@@ -1252,6 +1452,11 @@ enum bverror bv_unmap(struct bvbuffdesc *bvbuffdesc)
 	GCENTERARG(GCZONE_MAPPING, "bvbuffdesc = 0x%08X\n",
 		   (unsigned int) bvbuffdesc);
 
+	/* Deferred blits may still reference the mapping; submit them
+	 * before it goes away. Takes the commit lock, so it has to come
+	 * before the mapping lock. */
+	flush_pending();
+
 	/* Lock access to the mapping list. */
 	GCLOCK(&gccontext->maplock);
 
@@ -1265,6 +1470,9 @@ enum bverror bv_unmap(struct bvbuffdesc *bvbuffdesc)
 		goto exit;
 	}
 
+	/* The buffer is about to be freed; its pages may be cached. */
+	drop_mapping(bvbuffdesc);
+
 	/* Is the buffer mapped? */
 	bvbuffmap = bvbuffdesc->map;
 	if (bvbuffmap == NULL) {
@@ -1331,6 +1539,12 @@ enum bverror bv_unmap(struct bvbuffdesc *bvbuffdesc)
 		GCERR("explicit count is already zero.\n");
 	bvbuffmapinfo->usermap = 0;
 
+	/* Don't cache the mapping once the implicit ones are gone. */
+	if (bvbuffmapinfo->entry != NULL) {
+		gcfree(bvbuffmapinfo->entry);
+		bvbuffmapinfo->entry = NULL;
+	}
+
 	GCDBG(GCZONE_MAPPING, "explicit count = %d\n",
 		bvbuffmapinfo->usermap);
 	GCDBG(GCZONE_MAPPING, "implicit count = %d\n",
@@ -1351,6 +1565,8 @@ enum bverror bv_unmap(struct bvbuffdesc *bvbuffdesc)
 		goto exit;
 	}
 
+	gccontext->mapcache.stats.unmaps += 1;
+
 	/* Remove from the buffer descriptor list. */
 	if (prev == NULL)
 		bvbuffdesc->map = bvbuffmap->nextmap;
@@ -1388,7 +1604,6 @@ enum bverror bv_blt(struct bvbltparams *bvbltparams)
 	struct surfaceinfo srcinfo[2];
 	struct bvrect *srcrect[2];
 	unsigned short rop;
-	struct gcicommit gcicommit;
 	int i, srccount, res;
 
 	GCENTERARG(GCZONE_BLIT, "bvbltparams = 0x%08X\n",
@@ -1767,110 +1982,58 @@ enum bverror bv_blt(struct bvbltparams *bvbltparams)
 		flush->flush_ldst = gcmoflush_flush_ldst;
 		flush->flush.reg = gcregflush_pe2D;
 
-		/* Process asynchronous operation. */
-		if ((bvbltparams->flags & BVFLAG_ASYNC) == 0) {
-			GCDBG(GCZONE_BLIT, "synchronous batch.\n");
-			gcicommit.callback = NULL;
-			gcicommit.callbackparam = NULL;
-			gcicommit.asynchronous = false;
-		} else {
-			struct gccallbackinfo *gccallbackinfo;
-
-			GCDBG(GCZONE_BLIT, "asynchronous batch (0x%08X):\n",
-			      bvbltparams->flags);
-
-			if (bvbltparams->callbackfn == NULL) {
-				GCDBG(GCZONE_BLIT, "no callback given.\n");
-				gcicommit.callback = NULL;
-				gcicommit.callbackparam = NULL;
-			} else {
-				bverror = get_callbackinfo(&gccallbackinfo);
-				if (bverror != BVERR_NONE) {
-					BVSETBLTERROR(BVERR_OOM,
-						      "callback allocation "
-						      "failed");
-					goto exit;
-				}
-
-				gccallbackinfo->info.callback.fn
-					= bvbltparams->callbackfn;
-				gccallbackinfo->info.callback.data
-					= bvbltparams->callbackdata;
-
-				gcicommit.callback = callbackbltsville;
-				gcicommit.callbackparam = gccallbackinfo;
-
-				GCDBG(GCZONE_BLIT,
-				      "gcbv_callback = 0x%08X\n",
-				      (unsigned int) gcicommit.callback);
-				GCDBG(GCZONE_BLIT,
-				      "gcbv_param    = 0x%08X\n",
-				      (unsigned int) gcicommit.callbackparam);
-				GCDBG(GCZONE_BLIT,
-				      "bltsville_callback = 0x%08X\n",
-				      (unsigned int)
-				      gccallbackinfo->info.callback.fn);
-				GCDBG(GCZONE_BLIT,
-				      "bltsville_param    = 0x%08X\n",
-				      (unsigned int)
-				      gccallbackinfo->info.callback.data);
-			}
-
-			gcicommit.asynchronous = true;
-		}
+		bverror = submit_batch(bvbltparams, gcbatch);
+	}
 
-		/* Process scheduled unmappings. */
-		do_unmap_implicit(gcbatch);
+exit:
+	if ((gcbatch != NULL) && batchexec) {
+		free_batch(gcbatch);
+		bvbltparams->batch = NULL;
+	}
 
-		INIT_LIST_HEAD(&gcicommit.unmap);
-		list_splice_init(&gcbatch->unmap, &gcicommit.unmap);
+	GCEXITARG(GCZONE_BLIT, "bv%s = %d\n",
+		  (bverror == BVERR_NONE) ? "result" : "error", bverror);
+	return bverror;
+}
 
-		/* Pass the batch for execution. */
-		GCDUMPBATCH(gcbatch);
+void gcbv_defer(unsigned int size)
+{
+	struct gccontext *gccontext = get_context();
 
-		gcicommit.gcerror = GCERR_NONE;
-		gcicommit.entrypipe = GCPIPE_2D;
-		gcicommit.exitpipe = GCPIPE_2D;
+	GCDBG(GCZONE_BATCH, "deferring commits up to %d bytes.\n", size);
 
-		INIT_LIST_HEAD(&gcicommit.buffer);
-		list_splice_init(&gcbatch->buffer, &gcicommit.buffer);
+	GCLOCK(&gccontext->commitlock);
+	gccontext->defersize = size;
+	GCUNLOCK(&gccontext->commitlock);
 
-		GCDBG(GCZONE_BLIT, "submitting the batch.\n");
-		gc_commit_wrapper(&gcicommit);
+	if (size == 0)
+		flush_pending();
+}
 
-		/* Move the lists back to the batch. */
-		list_splice_init(&gcicommit.buffer, &gcbatch->buffer);
-		list_splice_init(&gcicommit.unmap, &gcbatch->unmap);
+enum bverror gcbv_flush(void)
+{
+	return flush_pending();
+}
 
-		/* Error? */
-		if (gcicommit.gcerror != GCERR_NONE) {
-			switch (gcicommit.gcerror) {
-			case GCERR_OODM:
-			case GCERR_CTX_ALLOC:
-				BVSETBLTERROR(BVERR_OOM,
-					      "unable to allocate gccore "
-					      "memory");
-				goto exit;
-			default:
-				BVSETBLTERROR(BVERR_RSRC,
-					      "gccore error");
+void gcbv_mapcache(unsigned long budget)
+{
+	struct gccontext *gccontext = get_context();
 
-				goto exit;
-			}
-		}
+	GCDBG(GCZONE_MAPPING, "caching mappings up to %lu bytes.\n", budget);
 
-		GCDBG(GCZONE_BLIT, "batch is submitted.\n");
-	}
+	GCLOCK(&gccontext->maplock);
+	gccontext->mapcache.stats.budget = budget;
+	trim_mapcache(NULL, budget);
+	GCUNLOCK(&gccontext->maplock);
+}
 
-exit:
-	if ((gcbatch != NULL) && batchexec) {
-		free_batch(gcbatch);
-		bvbltparams->batch = NULL;
-	}
+void gcbv_mapstats(struct gcbvmapstats *stats)
+{
+	struct gccontext *gccontext = get_context();
 
-	GCEXITARG(GCZONE_BLIT, "bv%s = %d\n",
-		  (bverror == BVERR_NONE) ? "result" : "error", bverror);
-	return bverror;
+	GCLOCK(&gccontext->maplock);
+	*stats = gccontext->mapcache.stats;
+	GCUNLOCK(&gccontext->maplock);
 }
 
 enum bverror bv_cache(struct bvcopparams *copparams)
@@ -137,6 +137,71 @@ struct gcfiltercache {
 };
 
 
+/*******************************************************************************
+ * State shadow.
+ */
+
+/* The shadow covers the state address space in pages allocated on the first
+ * write to them. */
+#define GC_SHADOW_PAGE_BITS	8
+#define GC_SHADOW_PAGE_SIZE	(1 << GC_SHADOW_PAGE_BITS)
+#define GC_SHADOW_PAGE_COUNT	(0x5000 >> GC_SHADOW_PAGE_BITS)
+
+struct gcshadowstate {
+	/* Epoch of the commit the state was loaded in. */
+	unsigned int epoch;
+
+	/* Loaded value; for addresses the map handle and the offset. */
+	unsigned int value;
+	unsigned int surfoffset;
+	bool fixup;
+};
+
+struct gcshadow {
+	/* States loaded with an older epoch are unknown. */
+	unsigned int epoch;
+
+	struct gcshadowstate *page[GC_SHADOW_PAGE_COUNT];
+};
+
+
+/*******************************************************************************
+ * Mapping cache.
+ */
+
+#define GC_MAPCACHE_BUCKETS	64
+#define GC_MAPCACHE_BUDGET	(32 * 1024 * 1024)
+
+/* Released implicit mapping, kept for the next buffer with the same
+ * physical pages. */
+struct gcmapentry {
+	/* LRU order, the least recently used first. */
+	struct list_head link;
+
+	/* Hash bucket chain. */
+	struct gcmapentry *next;
+	unsigned int hash;
+
+	/* Mapped handle. */
+	unsigned long handle;
+
+	/* Mapped pages. */
+	unsigned long size;
+	unsigned long pagesize;
+	unsigned long pageoffset;
+	unsigned int pagecount;
+	unsigned long pagearray[1];
+};
+
+struct gcmapcache {
+	struct list_head lru;			/* gcmapentry */
+	struct gcmapentry *bucket[GC_MAPCACHE_BUCKETS];
+
+	/* Counters, bytes mapped by the entries and their limit. */
+	struct gcbvmapstats stats;
+};
+
+
 /*******************************************************************************
  * Global data structure.
  */
@@ -173,6 +238,7 @@ struct gccontext {
 	GCLOCK_TYPE fixuplock;
 	GCLOCK_TYPE maplock;
 	GCLOCK_TYPE callbacklock;
+	GCLOCK_TYPE commitlock;
 
 	/* Kernel table cache. */
 	struct gcfilterkernel *loadedfilter;	/* gcfilterkernel */
@@ -181,6 +247,18 @@ struct gccontext {
 	/* Temporary buffer descriptor. */
 	struct bvbuffdesc *tmpbuffdesc;
 	void *tmpbuff;
+
+	/* Commit being prepared and the states it loads; the GC is shared
+	 * with other processes, so its state is only known within one. */
+	struct gcbatch *pending;
+	struct gcshadow shadow;
+
+	/* Size at which deferred commits are submitted, 0 if every batch
+	 * is committed as it ends. */
+	unsigned int defersize;
+
+	/* Released implicit mappings; protected by maplock. */
+	struct gcmapcache mapcache;
 };
 
 
@@ -198,6 +276,10 @@ struct bvbuffmapinfo {
 
 	/* Number of times implicit mapping happened. */
 	int automap;
+
+	/* Record of the mapping for the cache; NULL if the mapping is
+	 * unmapped when the last reference is gone. */
+	struct gcmapentry *entry;
 };
 
 
@@ -526,6 +608,11 @@ enum bverror do_map(struct bvbuffdesc *bvbuffdesc,
 		    struct bvbuffmap **map);
 void do_unmap_implicit(struct gcbatch *gcbatch);
 
+/* Mapping cache; called with maplock held. Mappings over the budget are
+ * unmapped with the batch if given or right away otherwise. */
+void trim_mapcache(struct gcbatch *gcbatch, unsigned long budget);
+void drop_mapping(struct bvbuffdesc *bvbuffdesc);
+
 /* Batch/command buffer management. */
 enum bverror do_end(struct bvbltparams *bvbltparams,
 		    struct gcbatch *gcbatch);
@@ -545,6 +632,12 @@ enum bverror claim_buffer(struct bvbltparams *bvbltparams,
 			  unsigned int size,
 			  void **buffer);
 
+/* Pending commit management; called with commitlock held. */
+enum bverror queue_batch(struct bvbltparams *bvbltparams,
+			 struct gcbatch *gcbatch);
+void invalidate_shadow(void);
+void free_shadow(void);
+
 /* Temporary buffer management. */
 enum bverror allocate_temp(struct bvbltparams *bvbltparams,
 			   unsigned int size);
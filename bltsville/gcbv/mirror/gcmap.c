@@ -35,9 +35,222 @@
 #define GCZONE_NONE		0
 #define GCZONE_ALL		(~0U)
 #define GCZONE_MAPPING		(1 << 0)
+#define GCZONE_CACHE		(1 << 1)
 
 GCDBG_FILTERDEF(map, GCZONE_NONE,
-		"mapping")
+		"mapping",
+		"cache")
+
+
+/*******************************************************************************
+ * Mapping cache.
+ */
+
+/* Number of pages the kernel maps for a buffer of the given size. */
+static unsigned int get_pagecount(struct bvphysdesc *bvphysdesc,
+				  unsigned long size)
+{
+	unsigned long pagesize;
+
+	/* Zero selects the default page size. */
+	pagesize = (bvphysdesc->pagesize == 0)
+		 ? PAGE_SIZE : bvphysdesc->pagesize;
+	return (bvphysdesc->pageoffset + size + pagesize - 1) / pagesize;
+}
+
+static unsigned int hash_pages(struct bvphysdesc *bvphysdesc,
+			       unsigned long size,
+			       unsigned int pagecount)
+{
+	unsigned int hash = 2166136261U;
+	unsigned int i;
+
+	hash = (hash ^ size) * 16777619U;
+	hash = (hash ^ bvphysdesc->pageoffset) * 16777619U;
+	for (i = 0; i < pagecount; i += 1)
+		hash = (hash ^ bvphysdesc->pagearray[i]) * 16777619U;
+
+	return hash;
+}
+
+/* Creates the cache record of a new mapping. */
+static struct gcmapentry *new_entry(struct bvphysdesc *bvphysdesc,
+				    unsigned long size)
+{
+	struct gcmapentry *gcmapentry;
+	unsigned int pagecount;
+
+	pagecount = get_pagecount(bvphysdesc, size);
+
+	gcmapentry = gcalloc(struct gcmapentry,
+			     sizeof(struct gcmapentry)
+			     + (pagecount - 1) * sizeof(unsigned long));
+	if (gcmapentry == NULL)
+		return NULL;
+
+	gcmapentry->next = NULL;
+	gcmapentry->hash = hash_pages(bvphysdesc, size, pagecount);
+	gcmapentry->handle = 0;
+	gcmapentry->size = size;
+	gcmapentry->pagesize = bvphysdesc->pagesize;
+	gcmapentry->pageoffset = bvphysdesc->pageoffset;
+	gcmapentry->pagecount = pagecount;
+	memcpy(gcmapentry->pagearray, bvphysdesc->pagearray,
+	       pagecount * sizeof(unsigned long));
+
+	return gcmapentry;
+}
+
+static void insert_entry(struct gcmapcache *gcmapcache,
+			 struct gcmapentry *gcmapentry)
+{
+	struct gcmapentry **bucket;
+
+	bucket = &gcmapcache->bucket[gcmapentry->hash % GC_MAPCACHE_BUCKETS];
+	gcmapentry->next = *bucket;
+	*bucket = gcmapentry;
+
+	list_add_tail(&gcmapentry->link, &gcmapcache->lru);
+
+	gcmapcache->stats.entries += 1;
+	gcmapcache->stats.size += gcmapentry->size;
+}
+
+static void remove_entry(struct gcmapcache *gcmapcache,
+			 struct gcmapentry *gcmapentry)
+{
+	struct gcmapentry **link;
+
+	link = &gcmapcache->bucket[gcmapentry->hash % GC_MAPCACHE_BUCKETS];
+	while (*link != gcmapentry)
+		link = &(*link)->next;
+	*link = gcmapentry->next;
+
+	list_del(&gcmapentry->link);
+
+	gcmapcache->stats.entries -= 1;
+	gcmapcache->stats.size -= gcmapentry->size;
+}
+
+/* Removes and returns the cached mapping of the pages, if any. */
+static struct gcmapentry *find_entry(struct gcmapcache *gcmapcache,
+				     struct bvphysdesc *bvphysdesc,
+				     unsigned long size)
+{
+	struct gcmapentry *gcmapentry;
+	unsigned int pagecount, hash;
+
+	pagecount = get_pagecount(bvphysdesc, size);
+	hash = hash_pages(bvphysdesc, size, pagecount);
+
+	gcmapentry = gcmapcache->bucket[hash % GC_MAPCACHE_BUCKETS];
+	while (gcmapentry != NULL) {
+		if ((gcmapentry->hash == hash) &&
+		    (gcmapentry->size == size) &&
+		    (gcmapentry->pagesize == bvphysdesc->pagesize) &&
+		    (gcmapentry->pageoffset == bvphysdesc->pageoffset) &&
+		    (gcmapentry->pagecount == pagecount) &&
+		    (memcmp(gcmapentry->pagearray, bvphysdesc->pagearray,
+			    pagecount * sizeof(unsigned long)) == 0)) {
+			remove_entry(gcmapcache, gcmapentry);
+			return gcmapentry;
+		}
+
+		gcmapentry = gcmapentry->next;
+	}
+
+	return NULL;
+}
+
+static void unmap_entry(struct gcmapentry *gcmapentry)
+{
+	struct gcimap gcimap;
+
+	memset(&gcimap, 0, sizeof(gcimap));
+	gcimap.handle = gcmapentry->handle;
+	gc_unmap_wrapper(&gcimap);
+	if (gcimap.gcerror != GCERR_NONE)
+		GCERR("failed to unmap cached handle 0x%08X.\n",
+		      (unsigned int) gcmapentry->handle);
+}
+
+void trim_mapcache(struct gcbatch *batch, unsigned long budget)
+{
+	struct gccontext *gccontext = get_context();
+	struct gcmapcache *gcmapcache = &gccontext->mapcache;
+	struct gcmapentry *gcmapentry;
+	struct gcschedunmap *gcschedunmap;
+
+	GCENTERARG(GCZONE_CACHE, "budget = %lu\n", budget);
+
+	while (gcmapcache->stats.size > budget) {
+		gcmapentry = list_first_entry(&gcmapcache->lru,
+					      struct gcmapentry, link);
+
+		GCDBG(GCZONE_CACHE, "evicting handle 0x%08X (%lu bytes).\n",
+		      (unsigned int) gcmapentry->handle, gcmapentry->size);
+
+		/* The batch may use the mapping, the kernel unmaps it once
+		 * the batch is done. */
+		if (batch != NULL) {
+			if (list_empty(&gccontext->unmapvac)) {
+				gcschedunmap = gcalloc(struct gcschedunmap,
+						sizeof(struct gcschedunmap));
+				if (gcschedunmap == NULL) {
+					GCERR("failed to schedule unmapping.\n");
+					break;
+				}
+				list_add(&gcschedunmap->link, &batch->unmap);
+			} else {
+				gcschedunmap = list_first_entry(
+					&gccontext->unmapvac,
+					struct gcschedunmap, link);
+				list_move(&gcschedunmap->link, &batch->unmap);
+			}
+
+			gcschedunmap->handle = gcmapentry->handle;
+		} else {
+			unmap_entry(gcmapentry);
+		}
+
+		remove_entry(gcmapcache, gcmapentry);
+		gcfree(gcmapentry);
+
+		gcmapcache->stats.unmaps += 1;
+		gcmapcache->stats.evictions += 1;
+	}
+
+	GCEXITARG(GCZONE_CACHE, "cached = %lu\n", gcmapcache->stats.size);
+}
+
+void drop_mapping(struct bvbuffdesc *bvbuffdesc)
+{
+	struct gccontext *gccontext = get_context();
+	struct gcmapcache *gcmapcache = &gccontext->mapcache;
+	struct bvphysdesc *bvphysdesc;
+	struct gcmapentry *gcmapentry;
+
+	if (bvbuffdesc->auxtype != BVAT_PHYSDESC)
+		return;
+
+	bvphysdesc = (struct bvphysdesc *) bvbuffdesc->auxptr;
+	if ((bvphysdesc == NULL) ||
+	    (bvphysdesc->structsize < STRUCTSIZE(bvphysdesc, pageoffset)) ||
+	    (bvphysdesc->pagearray == NULL))
+		return;
+
+	/* Buffers with the same pages may have left several. */
+	while ((gcmapentry = find_entry(gcmapcache, bvphysdesc,
+					bvbuffdesc->length)) != NULL) {
+		GCDBG(GCZONE_CACHE, "dropping handle 0x%08X.\n",
+		      (unsigned int) gcmapentry->handle);
+
+		unmap_entry(gcmapentry);
+		gcfree(gcmapentry);
+
+		gcmapcache->stats.unmaps += 1;
+	}
+}
 
 
 /*******************************************************************************
@@ -56,8 +269,10 @@ enum bverror do_map(struct bvbuffdesc *bvbuffdesc,
 	struct gccontext *gccontext = get_context();
 	struct bvbuffmap *bvbuffmap;
 	struct bvbuffmapinfo *bvbuffmapinfo;
-	struct bvphysdesc *bvphysdesc;
-	bool mappedbyothers;
+	struct bvphysdesc *bvphysdesc = NULL;
+	struct gcmapcache *gcmapcache = &gccontext->mapcache;
+	struct gcmapentry *gcmapentry = NULL;
+	bool mappedbyothers, cached = false;
 	struct gcimap gcimap;
 	struct gcschedunmap *gcschedunmap;
 
@@ -142,16 +357,45 @@ enum bverror do_map(struct bvbuffdesc *bvbuffdesc,
 			      gcimap.size);
 		}
 
-		gc_map_wrapper(&gcimap);
-		if (gcimap.gcerror != GCERR_NONE) {
-			BVSETERROR(BVERR_OOM,
-				   "unable to allocate gccore memory");
-			goto fail;
+		/* Implicit mappings of physical pages not mapped by others
+		 * come from the cache and go back to it once released. */
+		if ((batch != NULL) && (bvbuffdesc->map == NULL) &&
+		    (bvphysdesc != NULL) && (bvphysdesc->pagearray != NULL) &&
+		    (gcmapcache->stats.budget != 0)) {
+			gcmapentry = find_entry(gcmapcache, bvphysdesc,
+						gcimap.size);
+			if (gcmapentry != NULL) {
+				gcmapcache->stats.hits += 1;
+				cached = true;
+			} else {
+				gcmapcache->stats.misses += 1;
+				gcmapentry = new_entry(bvphysdesc, gcimap.size);
+			}
+		}
+
+		if (cached) {
+			GCDBG(GCZONE_CACHE, "cached handle = 0x%08X\n",
+			      (unsigned int) gcmapentry->handle);
+			gcimap.handle = gcmapentry->handle;
+		} else {
+			gc_map_wrapper(&gcimap);
+			if (gcimap.gcerror != GCERR_NONE) {
+				if (gcmapentry != NULL)
+					gcfree(gcmapentry);
+				BVSETERROR(BVERR_OOM,
+					   "unable to allocate gccore memory");
+				goto fail;
+			}
+
+			gcmapcache->stats.maps += 1;
+			if (gcmapentry != NULL)
+				gcmapentry->handle = gcimap.handle;
 		}
 
 		/* Set map handle. */
 		bvbuffmapinfo = (struct bvbuffmapinfo *) bvbuffmap->handle;
 		bvbuffmapinfo->handle = gcimap.handle;
+		bvbuffmapinfo->entry = gcmapentry;
 
 		/* Initialize reference counters. */
 		if (batch == NULL) {
@@ -254,6 +498,8 @@ void do_unmap_implicit(struct gcbatch *batch)
 	struct bvbuffdesc *bvbuffdesc;
 	struct bvbuffmap *prev, *bvbuffmap;
 	struct bvbuffmapinfo *bvbuffmapinfo;
+	struct gcmapcache *gcmapcache = &gccontext->mapcache;
+	struct gcmapentry *gcmapentry;
 
 	GCENTER(GCZONE_MAPPING);
 
@@ -321,8 +567,23 @@ void do_unmap_implicit(struct gcbatch *batch)
 
 		GCDBG(GCZONE_MAPPING, "  ready for unmapping.\n");
 
-		/* Set the handle. */
-		gcschedunmap->handle = bvbuffmapinfo->handle;
+		/* Keep the mapping if the cache can hold it. */
+		gcmapentry = bvbuffmapinfo->entry;
+		bvbuffmapinfo->entry = NULL;
+
+		if ((gcmapentry != NULL) &&
+		    (gcmapentry->size <= gcmapcache->stats.budget)) {
+			GCDBG(GCZONE_CACHE, "  cached.\n");
+			insert_entry(gcmapcache, gcmapentry);
+			list_move(head, &gccontext->unmapvac);
+		} else {
+			if (gcmapentry != NULL)
+				gcfree(gcmapentry);
+
+			/* Set the handle. */
+			gcschedunmap->handle = bvbuffmapinfo->handle;
+			gcmapcache->stats.unmaps += 1;
+		}
 
 		/* Remove from the buffer descriptor. */
 		if (prev == NULL)
@@ -335,6 +596,9 @@ void do_unmap_implicit(struct gcbatch *batch)
 		gccontext->buffmapvac = bvbuffmap;
 	}
 
+	/* Release the mappings the cache cannot hold after the batch. */
+	trim_mapcache(batch, gcmapcache->stats.budget);
+
 	/* Unlock access to the mapping list. */
 	GCUNLOCK(&gccontext->maplock);
 
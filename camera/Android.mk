@@ -134,6 +134,7 @@ TI_CAMERAHAL_COMMON_SRC := \
     BufferSourceAdapter.cpp \
     CameraProperties.cpp \
     BaseCameraAdapter.cpp \
+    FrameRefTable.cpp \
     MemoryManager.cpp \
     Encoder_libjpeg.cpp \
     Decoder_libjpeg.cpp \
@@ -170,7 +171,8 @@ endif
 
 TI_CAMERAHAL_USB_SRC := \
     V4LCameraAdapter/V4LCameraAdapter.cpp \
-    V4LCameraAdapter/V4LCapabilities.cpp
+    V4LCameraAdapter/V4LCapabilities.cpp \
+    V4LCameraAdapter/V4LPreviewPipeline.cpp
 
 
 TI_CAMERAHAL_EXIF_LIBRARY := libexif
@@ -201,6 +203,9 @@ TI_CAMERAHAL_COMMON_SHARED_LIBRARIES += libion
 TI_CAMERAHAL_COMMON_SRC +=  ../libion/ion_ti_custom.c
 TI_CAMERAHAL_COMMON_INCLUDES += $(HARDWARE_TI_OMAP4_BASE)/libion
 
+TI_CAMERAHAL_COMMON_STATIC_LIBRARIES := libyuvconvert
+TI_CAMERAHAL_COMMON_INCLUDES += $(HARDWARE_TI_OMAP4_BASE)/libyuvconvert
+
 TI_CAMERAHAL_OMX_SHARED_LIBRARIES := \
     libmm_osal \
     libOMX_Core \
@@ -21,14 +21,13 @@
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferMapper.h>
 #include "NV12_resize.h"
+#include "yuv_convert.h"
 #include "TICameraParameters.h"
 
 namespace Ti {
 namespace Camera {
 
 const int AppCallbackNotifier::NOTIFIER_TIMEOUT = -1;
-android::KeyedVector<void*, android::sp<Encoder_libjpeg> > gEncoderQueue;
-
 void AppCallbackNotifierEncoderCallback(void* main_jpeg,
                                         void* thumb_jpeg,
                                         CameraFrame::FrameType type,
@@ -41,6 +40,14 @@ void AppCallbackNotifierEncoderCallback(void* main_jpeg,
     if (cookie1 && !canceled) {
         AppCallbackNotifier* cb = (AppCallbackNotifier*) cookie1;
         cb->EncoderDoneCb(main_jpeg, thumb_jpeg, type, cookie2, cookie3, cookie4);
+    } else if (canceled) {
+        camera_memory_t* encoded_mem = (camera_memory_t*) cookie2;
+        if (encoded_mem) {
+            encoded_mem->release(encoded_mem);
+        }
+        if (cookie3) {
+            delete (ExifElementsTable*) cookie3;
+        }
     }
 
     if (main_jpeg) {
@@ -62,9 +69,7 @@ void AppCallbackNotifier::EncoderDoneCb(void* main_jpeg, void* thumb_jpeg, Camer
     camera_memory_t* encoded_mem = NULL;
     Encoder_libjpeg::params *main_param = NULL, *thumb_param = NULL;
     size_t jpeg_size;
-    uint8_t* src = NULL;
     CameraBuffer *camera_buffer;
-    android::sp<Encoder_libjpeg> encoder = NULL;
 
     LOG_FUNCTION_NAME;
 
@@ -81,7 +86,6 @@ void AppCallbackNotifier::EncoderDoneCb(void* main_jpeg, void* thumb_jpeg, Camer
     main_param = (Encoder_libjpeg::params *) main_jpeg;
     jpeg_size = main_param->jpeg_size;
     camera_buffer = (CameraBuffer *)cookie3;
-    src = main_param->src;
 
     if(encoded_mem && encoded_mem->data && (jpeg_size > 0)) {
         if (cookie2) {
@@ -153,11 +157,6 @@ void AppCallbackNotifier::EncoderDoneCb(void* main_jpeg, void* thumb_jpeg, Camer
         if (cookie2) {
             delete (ExifElementsTable*) cookie2;
         }
-        encoder = gEncoderQueue.valueFor(src);
-        if (encoder.get()) {
-            gEncoderQueue.removeItem(src);
-            encoder.clear();
-        }
         mFrameProvider->returnFrame(camera_buffer, type);
     }
 
@@ -196,6 +195,8 @@ status_t AppCallbackNotifier::initialize()
         return ret;
         }
 
+    JpegEncoderService::instance().registerClient(this);
+
     mUseMetaDataBufferMode = true;
     mRawAvailable = false;
 
@@ -490,8 +491,6 @@ static void copy2Dto1D(void *dst,
 {
     unsigned int alignedRow, row;
     unsigned char *bufferDst, *bufferSrc;
-    unsigned char *bufferDstEnd, *bufferSrcEnd;
-    uint16_t *bufferSrc_UV;
 
     unsigned int *y_uv = (unsigned int *)src;
 
@@ -500,136 +499,31 @@ static void copy2Dto1D(void *dst,
 
     if (pixelFormat!=NULL) {
         if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV422I) == 0) {
-            bytesPerPixel = 2;
-            bufferSrc = ( unsigned char * ) y_uv[0] + offset;
             uint32_t xOff = offset % stride;
             uint32_t yOff = offset / stride;
-            uint8_t *bufferSrcUV = ((uint8_t*)y_uv[1] + (stride/2)*yOff + xOff);
-            uint8_t *bufferSrcUVEven = bufferSrcUV;
-
-            uint8_t *bufferDstY = ( uint8_t * ) dst;
-            uint8_t *bufferDstU = bufferDstY + 1;
-            uint8_t *bufferDstV = bufferDstY + 3;
+            const uint8_t *bufferSrcY = (uint8_t*)y_uv[0] + offset;
+            const uint8_t *bufferSrcUV = ((uint8_t*)y_uv[1] + (stride/2)*yOff + xOff);
 
             // going to convert from NV12 here and return
-            for ( int i = 0 ; i < height; i ++ ) {
-                for ( int j = 0 ; j < width / 2 ; j++ ) {
-
-                    // Y
-                    *bufferDstY = *bufferSrc;
-                    bufferSrc++;
-                    bufferDstY += 2;
-
-                    *bufferDstY = *bufferSrc;
-                    bufferSrc++;
-                    bufferDstY += 2;
-
-                    // V
-                    *bufferDstV = *(bufferSrcUV + 1);
-                    bufferDstV += 4;
-
-                    // U
-                    *bufferDstU = *bufferSrcUV;
-                    bufferDstU += 4;
-
-                    bufferSrcUV += 2;
-                }
-                if ( i % 2 ) {
-                    bufferSrcUV += ( stride - width);
-                    bufferSrcUVEven = bufferSrcUV;
-                } else {
-                    bufferSrcUV = bufferSrcUVEven;
-                }
-                bufferSrc += ( stride - width);
-            }
+            yuv_nv12_to_yuyv(bufferSrcY, stride, bufferSrcUV, stride,
+                             (uint8_t*)dst, width * 2, width, height);
 
             return;
         } else if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0 ||
                    strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420P) == 0) {
-            bytesPerPixel = 1;
-            bufferDst = ( unsigned char * ) dst;
-            bufferDstEnd = ( unsigned char * ) dst + width*height*bytesPerPixel;
-            bufferSrc = ( unsigned char * ) y_uv[0] + offset;
-            bufferSrcEnd = ( unsigned char * ) ( ( size_t ) y_uv[0] + length + offset);
-            row = width*bytesPerPixel;
-            alignedRow = stride-width;
-            int stride_bytes = stride / 8;
             uint32_t xOff = offset % stride;
             uint32_t yOff = offset / stride;
-
-            // going to convert from NV12 here and return
-            // Step 1: Y plane: iterate through each row and copy
-            for ( int i = 0 ; i < height ; i++) {
-                memcpy(bufferDst, bufferSrc, row);
-                bufferSrc += stride;
-                bufferDst += row;
-                if ( ( bufferSrc > bufferSrcEnd ) || ( bufferDst > bufferDstEnd ) ) {
-                    break;
-                }
-            }
-
-            bufferSrc_UV = ( uint16_t * ) ((uint8_t*)y_uv[1] + (stride/2)*yOff + xOff);
+            const uint8_t *bufferSrcY = (uint8_t*)y_uv[0] + offset;
+            const uint8_t *bufferSrcUV = ((uint8_t*)y_uv[1] + (stride/2)*yOff + xOff);
+            uint8_t *bufferDstY = (uint8_t*)dst;
 
             if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-                 uint16_t *bufferDst_UV;
-
-                // Step 2: UV plane: convert NV12 to NV21 by swapping U & V
-                bufferDst_UV = (uint16_t *) (((uint8_t*)dst)+row*height);
-
-#ifdef ARCH_ARM_HAVE_NEON
-                for (int i = 0 ; i < height/2 ; i++, bufferSrc_UV += alignedRow/2) {
-                    int n = width;
-                    asm volatile (
-                    "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   blt 1f                                                      \n\t"
-                    "0: @ 32 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #32                                         \n\t"
-                    "   vld2.8  {q0, q1} , [%[src]]!                                \n\t"
-                    "   vswp q0, q1                                                 \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   vst2.8  {q0,q1},[%[dst]]!                                   \n\t"
-                    "   bge 0b                                                      \n\t"
-                    "1: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   blt 3f                                                      \n\t"
-                    "2: @ 16 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #16                                         \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   vswp d0, d1                                                 \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   vst2.8  {d0,d1},[%[dst]]!                                   \n\t"
-                    "   bge 2b                                                      \n\t"
-                    "3: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   blt 5f                                                      \n\t"
-                    "4: @ 8 byte swap                                               \n\t"
-                    "   sub %[n], %[n], #8                                          \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   vswp d0, d1                                                 \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   vst2.8  {d0[0],d1[0]},[%[dst]]!                             \n\t"
-                    "   bge 4b                                                      \n\t"
-                    "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                    "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                    : [dst] "+r" (bufferDst_UV), [src] "+r" (bufferSrc_UV), [n] "+r" (n)
-                    : [src_stride] "r" (stride_bytes)
-                    : "cc", "memory", "q0", "q1"
-                    );
-                }
-#else
-                for ( int i = 0; i < height/2; ++i ) {
-                    for ( int j = 0; j < width/2; ++j ) {
-                        bufferDst_UV[j] = (bufferSrc_UV[j] >> 8) | (bufferSrc_UV[j] << 8);
-                    }
-                    bufferSrc_UV += stride/bytesPerPixel/2;
-                    bufferDst_UV += width/2;
-                }
-#endif
-            } else if (strcmp(pixelFormat, android::CameraParameters::PIXEL_FORMAT_YUV420P) == 0) {
-                // Step 2: UV plane: convert NV12 to YV12 by de-interleaving U & V
+                // convert NV12 to NV21 by swapping U & V
+                yuv_nv12_to_nv21(bufferSrcY, stride, bufferSrcUV, stride,
+                                 bufferDstY, width, bufferDstY + width*height, width,
+                                 width, height);
+            } else {
+                // convert NV12 to YV12 by de-interleaving U & V
                 // TODO(XXX): This version of CameraHal assumes NV12 format it set at
                 //            camera adapter to support YV12. Need to address for
                 //            USBCamera
@@ -637,72 +531,12 @@ static void copy2Dto1D(void *dst,
                 size_t yStride, uvStride, ySize, uvSize, size;
                 alignYV12(width, height, yStride, uvStride, ySize, uvSize, size);
 
-                uint16_t *bufferDst_V = (uint16_t *) (((uint8_t*)dst) + ySize);
-                uint16_t *bufferDst_U = (uint16_t *) (((uint8_t*)dst) + ySize + uvSize);
-
-#ifdef ARCH_ARM_HAVE_NEON
-                int inc = (uvStride - width/2)/2;
-
-                for (int i = 0 ; i < height/2 ; i++, bufferSrc_UV += alignedRow/2) {
-                    int n = width;
-                    asm volatile (
-                    "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   blt 1f                                                      \n\t"
-                    "0: @ 32 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #32                                         \n\t"
-                    "   vld2.8  {q0, q1} , [%[src]]!                                \n\t"
-                    "   cmp %[n], #32                                               \n\t"
-                    "   vst1.8  {q1},[%[dst_v]]!                                    \n\t"
-                    "   vst1.8  {q0},[%[dst_u]]!                                    \n\t"
-                    "   bge 0b                                                      \n\t"
-                    "1: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   blt 3f                                                      \n\t"
-                    "2: @ 16 byte swap                                              \n\t"
-                    "   sub %[n], %[n], #16                                         \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   cmp %[n], #16                                               \n\t"
-                    "   vst1.8  {d1},[%[dst_v]]!                                    \n\t"
-                    "   vst1.8  {d0},[%[dst_u]]!                                    \n\t"
-                    "   bge 2b                                                      \n\t"
-                    "3: @ Is there enough data?                                     \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   blt 5f                                                      \n\t"
-                    "4: @ 8 byte swap                                               \n\t"
-                    "   sub %[n], %[n], #8                                          \n\t"
-                    "   vld2.8  {d0, d1} , [%[src]]!                                \n\t"
-                    "   cmp %[n], #8                                                \n\t"
-                    "   vst1.8  {d1[0]},[%[dst_v]]!                                 \n\t"
-                    "   vst1.8  {d0[0]},[%[dst_u]]!                                 \n\t"
-                    "   bge 4b                                                      \n\t"
-                    "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                    "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                    : [dst_u] "+r" (bufferDst_U), [dst_v] "+r" (bufferDst_V),
-                      [src] "+r" (bufferSrc_UV), [n] "+r" (n)
-                    : [src_stride] "r" (stride_bytes)
-                    : "cc", "memory", "q0", "q1"
-                    );
-
-                    bufferDst_U += inc;
-                    bufferDst_V += inc;
-                }
-#else
-                uint8_t * udst = reinterpret_cast<uint8_t*>(bufferDst_V);
-                uint8_t * vdst = reinterpret_cast<uint8_t*>(bufferDst_U);
+                uint8_t *bufferDstV = bufferDstY + ySize;
+                uint8_t *bufferDstU = bufferDstY + ySize + uvSize;
 
-                for ( int i = 0; i < height/2; ++i ) {
-                    for ( int j = 0; j < width/2; ++j ) {
-                        udst[j] = bufferSrc_UV[j] >> 8;
-                        vdst[j] = bufferSrc_UV[j] & 0x00ff;
-                    }
-                    bufferSrc_UV += stride/bytesPerPixel/2;
-                    udst += width/2;
-                    vdst += width/2;
-                }
-#endif
+                yuv_nv12_to_i420(bufferSrcY, stride, bufferSrcUV, stride,
+                                 bufferDstY, width, bufferDstU, uvStride, bufferDstV, uvStride,
+                                 width, height);
             }
             return ;
 
@@ -748,16 +582,8 @@ static void copyCroppedNV12(CameraFrame* frame, unsigned char *dst)
     unsigned const char *chroma = src + uvoffset;
 
     // copy luma and chroma line x line
-    for (unsigned int i = 0; i < height; i++) {
-        memcpy(dst, luma, width);
-        luma += stride;
-        dst += width;
-    }
-    for (unsigned int i = 0; i < height / 2; i++) {
-        memcpy(dst, chroma, width);
-        chroma += stride;
-        dst += width;
-    }
+    yuv_copy_plane(luma, stride, dst, width, width, height);
+    yuv_copy_plane(chroma, stride, dst + width * height, width, width, height / 2);
 }
 
 void AppCallbackNotifier::copyAndSendPictureFrame(CameraFrame* frame, int32_t msgType)
@@ -1075,6 +901,7 @@ void AppCallbackNotifier::notifyFrame()
                         main_jpeg->out_height = frame->mHeight;
                         main_jpeg->right_crop = rightCrop;
                         main_jpeg->start_offset = frame->mOffset;
+                        main_jpeg->bands = parameters.getInt(TICameraParameters::KEY_JPEG_ENCODE_BANDS);
                         if ( CameraFrame::FORMAT_YUV422I_UYVY & frame->mQuirks) {
                             main_jpeg->format = TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY;
                         }
@@ -1113,6 +940,7 @@ void AppCallbackNotifier::notifyFrame()
                         tn_jpeg->out_height = tn_height;
                         tn_jpeg->right_crop = 0;
                         tn_jpeg->start_offset = 0;
+                        tn_jpeg->bands = 1;
                         tn_jpeg->format = android::CameraParameters::PIXEL_FORMAT_YUV420SP;;
                     }
 
@@ -1123,12 +951,12 @@ void AppCallbackNotifier::notifyFrame()
                                                       this,
                                                       raw_picture,
                                                       exif_data, frame->mBuffer);
-                    gEncoderQueue.add(frame->mBuffer->mapped, encoder);
-#ifdef ANDROID_API_N_OR_LATER
-                    encoder->run("jpeg_encoder");
-#else
-                    encoder->run();
-#endif
+                    if (JpegEncoderService::instance().submit(encoder,
+                                                              us2ns(CANCEL_TIMEOUT)) != NO_ERROR) {
+                        encoder->abort();
+                        mFrameProvider->returnFrame(frame->mBuffer,
+                                                    (CameraFrame::FrameType) frame->mFrameType);
+                    }
                     encoder.clear();
                     if (params != NULL)
                       {
@@ -1203,21 +1031,28 @@ void AppCallbackNotifier::notifyFrame()
                                 android_ycbcr ycbcr = android_ycbcr();
                                 mapper.lockYCbCr((buffer_handle_t)vBuf, CAMHAL_GRALLOC_USAGE, bounds, &ycbcr);
 
-                                structConvImage input =  {(int32_t)frame->mWidth,
-                                                          (int32_t)frame->mHeight,
-                                                          (int32_t)(ycbcr.ystride),
-                                                          (uint8_t *)frame->mYuv[0],
-                                                          (uint8_t *)frame->mYuv[1],
-                                                          (int32_t)frame->mOffset};
-
-                                structConvImage output = {mVideoWidth,
-                                                          mVideoHeight,
-                                                          (int32_t)(ycbcr.ystride),
-                                                          (uint8_t *)ycbcr.y,
-                                                          (uint8_t *)ycbcr.cb,
-                                                          0};
-
-                                VT_resizeFrame_Video_opt2_lp(&input, &output, nullptr);
+                                // the frame offset selects the valid region of the source
+                                int srcStride = (int)ycbcr.ystride;
+                                NV12Rect crop = {(int)(frame->mOffset % srcStride) & ~1,
+                                                 (int)(frame->mOffset / srcStride) & ~1,
+                                                 (int)frame->mWidth,
+                                                 (int)frame->mHeight};
+
+                                NV12Image input = {crop.x + crop.width,
+                                                   crop.y + crop.height,
+                                                   srcStride,
+                                                   srcStride,
+                                                   (uint8_t *)frame->mYuv[0],
+                                                   (uint8_t *)frame->mYuv[1]};
+
+                                NV12Image output = {mVideoWidth,
+                                                    mVideoHeight,
+                                                    (int)ycbcr.ystride,
+                                                    (int)ycbcr.cstride,
+                                                    (uint8_t *)ycbcr.y,
+                                                    (uint8_t *)ycbcr.cb};
+
+                                NV12Resizer::instance().resize(input, &crop, output, NULL);
                                 mapper.unlock((buffer_handle_t)vBuf->opaque);
                                 if (mExternalLocking) {
                                     unlockBufferAndUpdatePtrs(frame);
@@ -1471,6 +1306,9 @@ AppCallbackNotifier::~AppCallbackNotifier()
     ///Stop app callback notifier if not already stopped
     stop();
 
+    // the encoder workers exit with the last notifier
+    JpegEncoderService::instance().unregisterClient(this);
+
     ///Unregister with the frame provider
     if ( NULL != mFrameProvider )
         {
@@ -1960,8 +1798,6 @@ status_t AppCallbackNotifier::start()
     mNotifierState = AppCallbackNotifier::NOTIFIER_STARTED;
     CAMHAL_LOGDA(" --> AppCallbackNotifier NOTIFIER_STARTED \n");
 
-    gEncoderQueue.clear();
-
     LOG_FUNCTION_NAME_EXIT;
 
     return NO_ERROR;
@@ -1985,25 +1821,19 @@ status_t AppCallbackNotifier::stop()
     CAMHAL_LOGDA(" --> AppCallbackNotifier NOTIFIER_STOPPED \n");
     }
 
-    while(!gEncoderQueue.isEmpty()) {
-        android::sp<Encoder_libjpeg> encoder = gEncoderQueue.valueAt(0);
-        camera_memory_t* encoded_mem = NULL;
-        ExifElementsTable* exif = NULL;
-
-        if(encoder.get()) {
-            encoder->cancel();
-
-            encoder->getCookies(NULL, (void**) &encoded_mem, (void**) &exif);
-            if (encoded_mem) {
-                encoded_mem->release(encoded_mem);
-            }
-            if (exif) {
-                delete exif;
-            }
-
-            encoder.clear();
-        }
-        gEncoderQueue.removeItemsAt(0);
+    // canceled jobs release their output buffer and exif data in the callback
+    JpegEncoderService::instance().cancel(this);
+
+    JpegEncoderService::Stats stats;
+    if ((JpegEncoderService::instance().getStats(this, stats) == NO_ERROR) &&
+        stats.completed) {
+        CAMHAL_LOGDB("Jpeg encoder: %u done, %u canceled, %u rejected, "
+                     "queue avg %lld us max %lld us, encode avg %lld us max %lld us",
+                     stats.completed, stats.canceled, stats.rejected,
+                     (long long) (ns2us(stats.queueTotal) / stats.completed),
+                     (long long) ns2us(stats.queueMax),
+                     (long long) (ns2us(stats.encodeTotal) / stats.completed),
+                     (long long) ns2us(stats.encodeMax));
     }
 
     LOG_FUNCTION_NAME_EXIT;
@@ -310,6 +310,7 @@ void BaseCameraAdapter::addFramePointers(CameraBuffer *frameBuf, android_ycbcr*
       frame->mYuv[0] = (unsigned int)ycbcr->y;
       frame->mYuv[1] = (unsigned int)ycbcr->cb;
       mFrameQueue.add(frameBuf, frame);
+      mFrameRefs.setCookie(frameBuf, frame);
 
       CAMHAL_LOGVB("Adding Frame=0x%x Y=0x%x UV=0x%x", frame->mBuffer, frame->mYuv[0], frame->mYuv[1]);
     }
@@ -328,13 +329,14 @@ void BaseCameraAdapter::removeFramePointers()
       delete frame;
     }
   mFrameQueue.clear();
+  mFrameRefs.clearCookies();
 }
 
 void BaseCameraAdapter::returnFrame(CameraBuffer * frameBuf, CameraFrame::FrameType frameType)
 {
     status_t res = NO_ERROR;
-    size_t subscriberCount = 0;
     int refCount = -1;
+    int totalCount = -1;
 
     if ( NULL == frameBuf )
         {
@@ -344,35 +346,29 @@ void BaseCameraAdapter::returnFrame(CameraBuffer * frameBuf, CameraFrame::FrameT
 
     if ( NO_ERROR == res)
         {
-        android::AutoMutex lock(mReturnFrameLock);
-
-        refCount = getFrameRefCountByType(frameBuf, frameType);
-
         if(frameType == CameraFrame::PREVIEW_FRAME_SYNC)
             {
-            mFramesWithDisplay--;
+            __atomic_sub_fetch(&mFramesWithDisplay, 1, __ATOMIC_RELAXED);
             }
         else if(frameType == CameraFrame::VIDEO_FRAME_SYNC)
             {
-            mFramesWithEncoder--;
+            __atomic_sub_fetch(&mFramesWithEncoder, 1, __ATOMIC_RELAXED);
             }
 
-        if ( 0 < refCount )
-            {
-
-            refCount--;
-            setFrameRefCountByType(frameBuf, frameType, refCount);
-
-            if (mRecording) {
-                refCount += getFrameRefCount(frameBuf);
-            }
+        // The decrement and the check of the remaining references are one
+        // atomic step, so exactly one of several concurrent returns of the
+        // same buffer gives it back to the camera
+        refCount = mFrameRefs.release(frameBuf, getFrameRefGroup(frameType), &totalCount);
 
-            }
-        else
+        if ( 0 > refCount )
             {
             CAMHAL_LOGDA("Frame returned when ref count is already zero!!");
             return;
             }
+
+        if (mRecording) {
+            refCount = totalCount;
+        }
         }
 
     CAMHAL_LOGVB("REFCOUNT 0x%x %d", frameBuf, refCount);
@@ -430,17 +426,17 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                     android::AutoMutex lock(mPreviewBufferLock);
                     mPreviewBuffers = desc->mBuffers;
                     mPreviewBuffersLength = desc->mLength;
-                    mPreviewBuffersAvailable.clear();
-                    mSnapshotBuffersAvailable.clear();
+                    clearFrameRefCounts(CameraFrame::PREVIEW_FRAME_SYNC);
+                    clearFrameRefCounts(CameraFrame::SNAPSHOT_FRAME);
                     for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
                         {
-                        mPreviewBuffersAvailable.add(&mPreviewBuffers[i], 0);
+                        setFrameRefCountByType(&mPreviewBuffers[i], CameraFrame::PREVIEW_FRAME_SYNC, 0);
                         }
                     // initial ref count for undeqeueued buffers is 1 since buffer provider
                     // is still holding on to it
                     for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
                         {
-                        mPreviewBuffersAvailable.add(&mPreviewBuffers[i], 1);
+                        setFrameRefCountByType(&mPreviewBuffers[i], CameraFrame::PREVIEW_FRAME_SYNC, 1);
                         }
                     }
 
@@ -484,16 +480,16 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                         android::AutoMutex lock(mPreviewDataBufferLock);
                         mPreviewDataBuffers = desc->mBuffers;
                         mPreviewDataBuffersLength = desc->mLength;
-                        mPreviewDataBuffersAvailable.clear();
+                        clearFrameRefCounts(CameraFrame::FRAME_DATA_SYNC);
                         for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
                             {
-                            mPreviewDataBuffersAvailable.add(&mPreviewDataBuffers[i], 0);
+                            setFrameRefCountByType(&mPreviewDataBuffers[i], CameraFrame::FRAME_DATA_SYNC, 0);
                             }
                         // initial ref count for undeqeueued buffers is 1 since buffer provider
                         // is still holding on to it
                         for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
                             {
-                            mPreviewDataBuffersAvailable.add(&mPreviewDataBuffers[i], 1);
+                            setFrameRefCountByType(&mPreviewDataBuffers[i], CameraFrame::FRAME_DATA_SYNC, 1);
                             }
                         }
 
@@ -576,14 +572,14 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
             if (ret == NO_ERROR) {
                 android::AutoMutex lock(mVideoInBufferLock);
                 mVideoInBuffers = desc->mBuffers;
-                mVideoInBuffersAvailable.clear();
+                clearFrameRefCounts(CameraFrame::REPROCESS_INPUT_FRAME);
                 for (uint32_t i = 0 ; i < desc->mMaxQueueable ; i++) {
-                    mVideoInBuffersAvailable.add(&mVideoInBuffers[i], 0);
+                    setFrameRefCountByType(&mVideoInBuffers[i], CameraFrame::REPROCESS_INPUT_FRAME, 0);
                 }
                 // initial ref count for undeqeueued buffers is 1 since buffer provider
                 // is still holding on to it
                 for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ ) {
-                    mVideoInBuffersAvailable.add(&mVideoInBuffers[i], 1);
+                    setFrameRefCountByType(&mVideoInBuffers[i], CameraFrame::REPROCESS_INPUT_FRAME, 1);
                 }
                 ret = useBuffers(CameraAdapter::CAMERA_REPROCESS,
                                  desc->mBuffers,
@@ -1071,14 +1067,14 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                  android::AutoMutex lock(mVideoBufferLock);
                  mVideoBuffers = desc->mBuffers;
                  mVideoBuffersLength = desc->mLength;
-                 mVideoBuffersAvailable.clear();
+                 clearFrameRefCounts(CameraFrame::VIDEO_FRAME_SYNC);
                  for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ ) {
-                     mVideoBuffersAvailable.add(&mVideoBuffers[i], 1);
+                     setFrameRefCountByType(&mVideoBuffers[i], CameraFrame::VIDEO_FRAME_SYNC, 1);
                  }
                  // initial ref count for undeqeueued buffers is 1 since buffer provider
                  // is still holding on to it
                  for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ ) {
-                     mVideoBuffersAvailable.add(&mVideoBuffers[i], 1);
+                     setFrameRefCountByType(&mVideoBuffers[i], CameraFrame::VIDEO_FRAME_SYNC, 1);
                  }
              }
 
@@ -1360,8 +1356,8 @@ status_t BaseCameraAdapter::__sendFrameToSubscribers(CameraFrame* frame,
     if ( (frameType == CameraFrame::PREVIEW_FRAME_SYNC) ||
          (frameType == CameraFrame::VIDEO_FRAME_SYNC) ||
          (frameType == CameraFrame::SNAPSHOT_FRAME) ){
-        if (mFrameQueue.size() > 0){
-          CameraFrame *lframe = (CameraFrame *)mFrameQueue.valueFor(frame->mBuffer);
+        CameraFrame *lframe = (CameraFrame *)mFrameRefs.cookie(frame->mBuffer);
+        if (NULL != lframe){
           frame->mYuv[0] = lframe->mYuv[0];
           frame->mYuv[1] = lframe->mYuv[1];
         }
@@ -1472,136 +1468,52 @@ int BaseCameraAdapter::setInitFrameRefCount(CameraBuffer * buf, unsigned int mas
 
 int BaseCameraAdapter::getFrameRefCount(CameraBuffer * frameBuf)
 {
-    int res = 0, refCnt = 0;
-
-    for (unsigned int frameType = 1; frameType < CameraFrame::ALL_FRAMES; frameType <<= 1) {
-        refCnt = getFrameRefCountByType(frameBuf, static_cast<CameraFrame::FrameType>(frameType));
-        if (refCnt > 0) res += refCnt;
-    }
-    return res;
+    return mFrameRefs.total(frameBuf);
 }
 
-int BaseCameraAdapter::getFrameRefCountByType(CameraBuffer * frameBuf, CameraFrame::FrameType frameType)
+int BaseCameraAdapter::getFrameRefGroup(CameraFrame::FrameType frameType)
 {
-    int res = -1;
-    ssize_t index = NAME_NOT_FOUND;
-
-    LOG_FUNCTION_NAME;
+    enum {
+        CAPTURE_GROUP = 0,
+        SNAPSHOT_GROUP,
+        PREVIEW_GROUP,
+        PREVIEW_DATA_GROUP,
+        VIDEO_GROUP,
+        VIDEO_IN_GROUP
+    };
 
     switch (frameType) {
         case CameraFrame::IMAGE_FRAME:
         case CameraFrame::RAW_FRAME:
-        {
-            android::AutoMutex lock(mCaptureBufferLock);
-            index = mCaptureBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mCaptureBuffersAvailable[index];
-            }
-            break;
-        }
+            return CAPTURE_GROUP;
         case CameraFrame::SNAPSHOT_FRAME:
-        {
-            android::AutoMutex lock(mSnapshotBufferLock);
-            index = mSnapshotBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mSnapshotBuffersAvailable[index];
-            }
-            break;
-        }
+            return SNAPSHOT_GROUP;
         case CameraFrame::PREVIEW_FRAME_SYNC:
-        {
-            android::AutoMutex lock(mPreviewBufferLock);
-            index = mPreviewBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mPreviewBuffersAvailable[index];
-            }
-            break;
-        }
+            return PREVIEW_GROUP;
         case CameraFrame::FRAME_DATA_SYNC:
-        {
-            android::AutoMutex lock(mPreviewDataBufferLock);
-            index = mPreviewDataBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mPreviewDataBuffersAvailable[index];
-            }
-            break;
-        }
+            return PREVIEW_DATA_GROUP;
         case CameraFrame::VIDEO_FRAME_SYNC:
-        {
-            android::AutoMutex lock(mVideoBufferLock);
-            index = mVideoBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mVideoBuffersAvailable[index];
-            }
-            break;
-        }
+            return VIDEO_GROUP;
         case CameraFrame::REPROCESS_INPUT_FRAME:
-        {
-            android::AutoMutex lock(mVideoInBufferLock);
-            index = mVideoInBuffersAvailable.indexOfKey(frameBuf);
-            if (index != NAME_NOT_FOUND) {
-                res = mVideoInBuffersAvailable[index];
-            }
-            break;
-        }
+            return VIDEO_IN_GROUP;
         default:
-            break;
+            return -1;
     }
+}
 
-    LOG_FUNCTION_NAME_EXIT;
-
-    return res;
+int BaseCameraAdapter::getFrameRefCountByType(CameraBuffer * frameBuf, CameraFrame::FrameType frameType)
+{
+    return mFrameRefs.get(frameBuf, getFrameRefGroup(frameType));
 }
 
 void BaseCameraAdapter::setFrameRefCountByType(CameraBuffer * frameBuf, CameraFrame::FrameType frameType, int refCount)
 {
+    mFrameRefs.set(frameBuf, getFrameRefGroup(frameType), refCount);
+}
 
-    LOG_FUNCTION_NAME;
-
-    switch ( frameType )
-        {
-        case CameraFrame::IMAGE_FRAME:
-        case CameraFrame::RAW_FRAME:
-                {
-                android::AutoMutex lock(mCaptureBufferLock);
-                mCaptureBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::SNAPSHOT_FRAME:
-                {
-                android::AutoMutex lock(mSnapshotBufferLock);
-                mSnapshotBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::PREVIEW_FRAME_SYNC:
-                {
-                android::AutoMutex lock(mPreviewBufferLock);
-                mPreviewBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::FRAME_DATA_SYNC:
-                {
-                android::AutoMutex lock(mPreviewDataBufferLock);
-                mPreviewDataBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::VIDEO_FRAME_SYNC:
-                {
-                android::AutoMutex lock(mVideoBufferLock);
-                mVideoBuffersAvailable.replaceValueFor(frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::REPROCESS_INPUT_FRAME: {
-            android::AutoMutex lock(mVideoInBufferLock);
-            mVideoInBuffersAvailable.replaceValueFor(frameBuf, refCount);
-        }
-            break;
-        default:
-            break;
-        };
-
-    LOG_FUNCTION_NAME_EXIT;
-
+void BaseCameraAdapter::clearFrameRefCounts(CameraFrame::FrameType frameType)
+{
+    mFrameRefs.clear(getFrameRefGroup(frameType));
 }
 
 status_t BaseCameraAdapter::startVideoCapture()
@@ -1622,11 +1534,15 @@ status_t BaseCameraAdapter::startVideoCapture()
     if ( NO_ERROR == ret )
         {
 
-        mVideoBuffersAvailable.clear();
+        const void *buffers[FrameRefTable::MAX_SLOTS];
+        int count = mFrameRefs.buffers(getFrameRefGroup(CameraFrame::PREVIEW_FRAME_SYNC),
+                                       buffers, FrameRefTable::MAX_SLOTS);
 
-        for ( unsigned int i = 0 ; i < mPreviewBuffersAvailable.size() ; i++ )
+        clearFrameRefCounts(CameraFrame::VIDEO_FRAME_SYNC);
+
+        for ( int i = 0 ; i < count ; i++ )
             {
-            mVideoBuffersAvailable.add(mPreviewBuffersAvailable.keyAt(i), 0);
+            setFrameRefCountByType((CameraBuffer *) buffers[i], CameraFrame::VIDEO_FRAME_SYNC, 0);
             }
 
         mRecording = true;
@@ -1650,9 +1566,13 @@ status_t BaseCameraAdapter::stopVideoCapture()
 
     if ( NO_ERROR == ret )
         {
-        for ( unsigned int i = 0 ; i < mVideoBuffersAvailable.size() ; i++ )
+        const void *buffers[FrameRefTable::MAX_SLOTS];
+        int count = mFrameRefs.buffers(getFrameRefGroup(CameraFrame::VIDEO_FRAME_SYNC),
+                                       buffers, FrameRefTable::MAX_SLOTS);
+
+        for ( int i = 0 ; i < count ; i++ )
             {
-            CameraBuffer *frameBuf = mVideoBuffersAvailable.keyAt(i);
+            CameraBuffer *frameBuf = (CameraBuffer *) buffers[i];
             if( getFrameRefCountByType(frameBuf,  CameraFrame::VIDEO_FRAME_SYNC) > 0)
                 {
                 returnFrame(frameBuf, CameraFrame::VIDEO_FRAME_SYNC);
@@ -1030,6 +1030,12 @@ int CameraHal::setParameters(const android::CameraParameters& params)
             mParameters.set(android::CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, varint);
         }
 
+        varint = params.getInt(TICameraParameters::KEY_JPEG_ENCODE_BANDS);
+        if ( varint >= 0 ) {
+            CAMHAL_LOGDB("Jpeg encode bands set %d", varint);
+            mParameters.set(TICameraParameters::KEY_JPEG_ENCODE_BANDS, varint);
+        }
+
         if( (valstr = params.get(android::CameraParameters::KEY_GPS_LATITUDE)) != NULL )
             {
             CAMHAL_LOGDB("GPS latitude set %s", params.get(android::CameraParameters::KEY_GPS_LATITUDE));
@@ -4644,6 +4650,7 @@ void CameraHal::initDefaultParameters()
     p.setPreviewFormat(mCameraProperties->get(CameraProperties::PREVIEW_FORMAT));
     p.setPictureFormat(mCameraProperties->get(CameraProperties::PICTURE_FORMAT));
     p.set(android::CameraParameters::KEY_JPEG_QUALITY, mCameraProperties->get(CameraProperties::JPEG_QUALITY));
+    p.set(TICameraParameters::KEY_JPEG_ENCODE_BANDS, 0);
     p.set(android::CameraParameters::KEY_WHITE_BALANCE, mCameraProperties->get(CameraProperties::WHITEBALANCE));
     p.set(android::CameraParameters::KEY_EFFECT,  mCameraProperties->get(CameraProperties::EFFECT));
     p.set(android::CameraParameters::KEY_ANTIBANDING, mCameraProperties->get(CameraProperties::ANTIBANDING));
@@ -14,7 +14,13 @@
  * limitations under the License.
  */
 
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "Decoder_libjpeg.h"
+#include "WorkerPool.h"
+#include "yuv_convert.h"
 
 extern "C" {
     #include "jpeglib.h"
@@ -64,17 +70,33 @@ static unsigned char jpeg_odml_dht[0x1a6] = {
     0xf9, 0xfa
 };
 
+/* Number of pieces a frame is fed to libjpeg in: SOI and DHT, the
+ * headers up to the frame height, the frame height, the remaining
+ * headers, the entropy coded data and EOI */
+#define MAX_SOURCE_SEGMENTS 6
+
+static const unsigned char jpeg_eoi[2] = { 0xff, 0xd9 };
+
+/* Reads the frame from a list of segments so that the DHT table and the
+ * slice headers never need to be copied in front of the frame data */
 struct libjpeg_source_mgr : jpeg_source_mgr {
-    libjpeg_source_mgr(unsigned char *buffer_ptr, int len);
-    ~libjpeg_source_mgr();
+    libjpeg_source_mgr();
+
+    void reset();
+    void add(const unsigned char *data, size_t len);
 
-    unsigned char *mBufferPtr;
-    int mFilledLen;
+    const unsigned char *mSegment[MAX_SOURCE_SEGMENTS];
+    size_t mLength[MAX_SOURCE_SEGMENTS];
+    int mCount;
+    int mNext;
 };
 
+static boolean libjpeg_fill_input_buffer(j_decompress_ptr cinfo);
+
 static void libjpeg_init_source(j_decompress_ptr cinfo) {
     libjpeg_source_mgr*  src = (libjpeg_source_mgr*)cinfo->src;
-    src->next_input_byte = (const JOCTET*)src->mBufferPtr;
+    src->mNext = 0;
+    src->next_input_byte = NULL;
     src->bytes_in_buffer = 0;
 #ifndef ANDROID_API_N_OR_LATER
     src->current_offset = 0;
@@ -84,44 +106,70 @@ static void libjpeg_init_source(j_decompress_ptr cinfo) {
 #ifndef ANDROID_API_N_OR_LATER
 static boolean libjpeg_seek_input_data(j_decompress_ptr cinfo, long byte_offset) {
     libjpeg_source_mgr* src = (libjpeg_source_mgr*)cinfo->src;
-    src->current_offset = byte_offset;
-    src->next_input_byte = (const JOCTET*)src->mBufferPtr + byte_offset;
-    src->bytes_in_buffer = 0;
-    return TRUE;
+    long start = 0;
+
+    for (int i = 0; i < src->mCount; i++) {
+        if (byte_offset < start + (long)src->mLength[i]) {
+            src->mNext = i + 1;
+            src->current_offset = byte_offset;
+            src->next_input_byte = src->mSegment[i] + (byte_offset - start);
+            src->bytes_in_buffer = src->mLength[i] - (byte_offset - start);
+            return TRUE;
+        }
+        start += src->mLength[i];
+    }
+    return FALSE;
 }
 #endif
 
 static boolean libjpeg_fill_input_buffer(j_decompress_ptr cinfo) {
     libjpeg_source_mgr* src = (libjpeg_source_mgr*)cinfo->src;
+
+    if (src->mNext >= src->mCount) {
+        // truncated frame, let libjpeg see the end of the image
+        WARNMS(cinfo, JWRN_JPEG_EOF);
+        src->next_input_byte = jpeg_eoi;
+        src->bytes_in_buffer = sizeof(jpeg_eoi);
+        return TRUE;
+    }
+
 #ifndef ANDROID_API_N_OR_LATER
-    src->current_offset += src->mFilledLen;
+    if (src->next_input_byte) {
+        src->current_offset += src->mLength[src->mNext - 1];
+    }
 #endif
-    src->next_input_byte = src->mBufferPtr;
-    src->bytes_in_buffer = src->mFilledLen;
+    src->next_input_byte = src->mSegment[src->mNext];
+    src->bytes_in_buffer = src->mLength[src->mNext];
+    src->mNext++;
     return TRUE;
 }
 
 static void libjpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
     libjpeg_source_mgr*  src = (libjpeg_source_mgr*)cinfo->src;
 
-    if (num_bytes > (long)src->bytes_in_buffer) {
-        CAMHAL_LOGEA("\n\n\n libjpeg_skip_input_data - num_bytes > (long)src->bytes_in_buffer \n\n\n");
-    } else {
+    while (num_bytes > (long)src->bytes_in_buffer) {
+        num_bytes -= src->bytes_in_buffer;
+        libjpeg_fill_input_buffer(cinfo);
+    }
+    if (num_bytes > 0) {
         src->next_input_byte += num_bytes;
         src->bytes_in_buffer -= num_bytes;
     }
 }
 
+/* A slice starts in the middle of the restart marker sequence, so any
+ * RSTn is accepted in place of the one libjpeg expects */
 static boolean libjpeg_resync_to_restart(j_decompress_ptr cinfo, int desired) {
-    libjpeg_source_mgr*  src = (libjpeg_source_mgr*)cinfo->src;
-    src->next_input_byte = (const JOCTET*)src->mBufferPtr;
-    src->bytes_in_buffer = 0;
-    return TRUE;
+    if ((cinfo->unread_marker >= 0xd0) && (cinfo->unread_marker <= 0xd7)) {
+        cinfo->unread_marker = 0;
+        return TRUE;
+    }
+    return jpeg_resync_to_restart(cinfo, desired);
 }
 
 static void libjpeg_term_source(j_decompress_ptr /*cinfo*/) {}
 
-libjpeg_source_mgr::libjpeg_source_mgr(unsigned char *buffer_ptr, int len) : mBufferPtr(buffer_ptr), mFilledLen(len) {
+libjpeg_source_mgr::libjpeg_source_mgr() : mCount(0), mNext(0) {
     init_source = libjpeg_init_source;
     fill_input_buffer = libjpeg_fill_input_buffer;
     skip_input_data = libjpeg_skip_input_data;
@@ -130,176 +178,430 @@ libjpeg_source_mgr::libjpeg_source_mgr(unsigned char *buffer_ptr, int len) : mBu
 #ifndef ANDROID_API_N_OR_LATER
     seek_input_data = libjpeg_seek_input_data;
 #endif
+    next_input_byte = NULL;
+    bytes_in_buffer = 0;
 }
 
-libjpeg_source_mgr::~libjpeg_source_mgr() {}
-
-Decoder_libjpeg::Decoder_libjpeg()
-{
-    mWidth = 0;
-    mHeight = 0;
-    Y_Plane = NULL;
-    U_Plane = NULL;
-    V_Plane = NULL;
-    UV_Plane = NULL;
+void libjpeg_source_mgr::reset() {
+    mCount = 0;
+    mNext = 0;
 }
 
-Decoder_libjpeg::~Decoder_libjpeg()
-{
-    release();
+void libjpeg_source_mgr::add(const unsigned char *data, size_t len) {
+    if (len > 0) {
+        mSegment[mCount] = data;
+        mLength[mCount] = len;
+        mCount++;
+    }
 }
 
-void Decoder_libjpeg::release()
-{
-    if (Y_Plane) {
-        free(Y_Plane);
-        Y_Plane = NULL;
-    }
-    if (U_Plane) {
-        free(U_Plane);
-        U_Plane = NULL;
-    }
-    if (V_Plane) {
-        free(V_Plane);
-        V_Plane = NULL;
-    }
-    if (UV_Plane) {
-        free(UV_Plane);
-        UV_Plane = NULL;
-    }
+/* Errors unwind to the decode call instead of terminating the process */
+struct libjpeg_error_mgr : jpeg_error_mgr {
+    jmp_buf mJump;
+};
+
+static void libjpeg_error_exit(j_common_ptr cinfo) {
+    libjpeg_error_mgr* err = (libjpeg_error_mgr*)cinfo->err;
+    (*err->output_message)(cinfo);
+    longjmp(err->mJump, 1);
 }
 
-int Decoder_libjpeg::readDHTSize()
-{
-    return sizeof(jpeg_odml_dht);
+static void libjpeg_output_message(j_common_ptr cinfo) {
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    CAMHAL_LOGEB("libjpeg: %s", buffer);
 }
 
-// 0xFF 0xC4 - DHT (Define Huffman Table) marker
-// 0xFF 0xD9 - SOI (Start Of Image) marker
-// 0xFF 0xD9 - EOI (End Of Image) marker
-// This function return true if if found DHT
-bool Decoder_libjpeg::isDhtExist(unsigned char *jpeg_src,  int filled_len) {
-    if (filled_len <= 0) {
+/* Frame layout found in the markers in front of the scan */
+struct JpegHeader {
+    int width;
+    int height;
+    int mcuWidth;
+    int mcuHeight;
+    int restartInterval;
+    bool hasDHT;
+    size_t sofHeight;    // offset of the frame height field, 0 if not baseline
+    size_t scanData;     // offset of the first entropy coded byte
+};
+
+/* Rows [firstRow, firstRow + rows) and the entropy coded data for them */
+struct JpegSlice {
+    int firstRow;
+    int rows;
+    size_t offset;
+    size_t length;
+};
+
+static bool parseHeader(const unsigned char *jpeg, size_t size, JpegHeader &header) {
+    size_t pos = 2;
+
+    memset(&header, 0, sizeof(header));
+
+    if ((size < 4) || (jpeg[0] != 0xff) || (jpeg[1] != 0xd8)) {
         return false;
     }
 
-    for (int i = 1; i < filled_len; i++) {
-        if((jpeg_src[i - 1] == 0xFF) && (jpeg_src[i] == 0xC4)) {
-            CAMHAL_LOGD("Found DHT (Define Huffman Table) marker");
-            return true;
+    while (pos + 4 <= size) {
+        if (jpeg[pos] != 0xff) {
+            return false;
+        }
+
+        unsigned char marker = jpeg[pos + 1];
+        if (marker == 0xff) {
+            // fill byte
+            pos++;
+            continue;
+        }
+
+        size_t len = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        const unsigned char *seg = jpeg + pos + 4;
+        if ((len < 2) || (pos + 2 + len > size)) {
+            return false;
+        }
+
+        switch (marker) {
+            case 0xc0: case 0xc1: case 0xc2: {
+                int components = (len >= 8) ? seg[5] : 0;
+                int hmax = 1, vmax = 1;
+
+                if ((components == 0) || (len < 8 + 3 * (size_t)components)) {
+                    return false;
+                }
+                for (int i = 0; i < components; i++) {
+                    int h = seg[6 + 3 * i + 1] >> 4;
+                    int v = seg[6 + 3 * i + 1] & 0xf;
+                    if (h > hmax) hmax = h;
+                    if (v > vmax) vmax = v;
+                }
+                header.height = (seg[1] << 8) | seg[2];
+                header.width = (seg[3] << 8) | seg[4];
+                header.mcuWidth = hmax * DCTSIZE;
+                header.mcuHeight = vmax * DCTSIZE;
+                // progressive frames are never sliced
+                header.sofHeight = (marker != 0xc2) ? pos + 5 : 0;
+                break;
+            }
+            case 0xc4:
+                header.hasDHT = true;
+                break;
+            case 0xdd:
+                header.restartInterval = (len >= 4) ? ((seg[0] << 8) | seg[1]) : 0;
+                break;
+            case 0xda:
+                header.scanData = pos + 2 + len;
+                return (header.width > 0) && (header.height > 0);
         }
+
+        pos += 2 + len;
     }
+
     return false;
 }
 
-int Decoder_libjpeg::appendDHT(unsigned char *jpeg_src, int filled_len, unsigned char *jpeg_with_dht_buffer, int buff_size)
-{
-    /* Appending DHT to JPEG */
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Splits the frame at restart markers which fall on MCU row boundaries.
+ * Always returns at least one slice covering the whole frame. */
+static int findSlices(const unsigned char *jpeg, size_t size, const JpegHeader &header,
+                      int maxSlices, JpegSlice *slices) {
+    slices[0].firstRow = 0;
+    slices[0].rows = header.height;
+    slices[0].offset = header.scanData;
+    slices[0].length = size - header.scanData;
+
+    if ((maxSlices < 2) || (header.restartInterval <= 0) || (header.sofHeight == 0)) {
+        return 1;
+    }
+
+    int mcusPerRow = (header.width + header.mcuWidth - 1) / header.mcuWidth;
+    int mcuRows = (header.height + header.mcuHeight - 1) / header.mcuHeight;
+    // MCU rows between restart boundaries that are also row boundaries
+    int groupRows = header.restartInterval / gcd(header.restartInterval, mcusPerRow);
+    int groups = (mcuRows + groupRows - 1) / groupRows;
+    int count = (groups < maxSlices) ? groups : maxSlices;
+
+    if (count < 2) {
+        return 1;
+    }
+
+    size_t pos = header.scanData;
+    int markers = 0;
+    int slice = 1;
+    int startRow = (slice * groups / count) * groupRows;
+    int interval = startRow * mcusPerRow / header.restartInterval;
+
+    while (slice < count) {
+        const unsigned char *p = (const unsigned char *)memchr(jpeg + pos, 0xff, size - pos);
+        if (!p || (p + 1 >= jpeg + size)) {
+            break;
+        }
+        pos = p - jpeg;
+
+        unsigned char marker = p[1];
+        if ((marker >= 0xd0) && (marker <= 0xd7)) {
+            if (++markers == interval) {
+                slices[slice - 1].length = pos - slices[slice - 1].offset;
+                slices[slice].firstRow = startRow * header.mcuHeight;
+                slices[slice].offset = pos + 2;
+                slice++;
+                startRow = (slice * groups / count) * groupRows;
+                interval = startRow * mcusPerRow / header.restartInterval;
+            }
+            pos += 2;
+        } else if (marker == 0xd9) {
+            break;
+        } else {
+            // stuffed zero byte or fill byte
+            pos++;
+        }
+    }
+
+    if (slice < count) {
+        // fewer restart markers than announced, decode in one piece
+        slices[0].length = size - header.scanData;
+        return 1;
+    }
 
-    int len = filled_len + sizeof(jpeg_odml_dht) - 2; // final length of jpeg data
-    if (len > buff_size)  {
-        CAMHAL_LOGEA("\n\n\n Buffer size too small. filled_len=%d, buff_size=%d, sizeof(jpeg_odml_dht)=%d\n\n\n", filled_len, buff_size, sizeof(jpeg_odml_dht));
-        return 0;
+    slices[count - 1].length = size - slices[count - 1].offset;
+    for (int i = 0; i < count; i++) {
+        int end = (i + 1 < count) ? slices[i + 1].firstRow : header.height;
+        slices[i].rows = end - slices[i].firstRow;
     }
 
-    memcpy(jpeg_with_dht_buffer, jpeg_odml_dht, sizeof(jpeg_odml_dht));
-    memcpy((jpeg_with_dht_buffer + sizeof(jpeg_odml_dht)), jpeg_src + 2, (filled_len - 2));
-    return len;
+    return count;
 }
 
+struct Decoder_libjpeg::Context {
+    jpeg_decompress_struct cinfo;
+    libjpeg_error_mgr error;
+    libjpeg_source_mgr source;
+    unsigned char height[2];   // frame height patched into slice headers
+    unsigned char* scratch;    // U and V rows of one iMCU row, one dummy luma row
+    size_t scratch_size;
+};
 
-bool Decoder_libjpeg::decode(unsigned char *jpeg_src, int filled_len, unsigned char *nv12_buffer, int stride)
-{
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct libjpeg_source_mgr s_mgr(jpeg_src, filled_len);
+struct Decoder_libjpeg::SliceJob {
+    Decoder_libjpeg* decoder;
+    const unsigned char* jpeg;
+    const JpegHeader* header;
+    const JpegSlice* slices;
+    unsigned char* nv12;
+    int stride;
+    bool ok[MAX_SLICES];
+};
 
-    if (filled_len == 0)
-        return false;
+/* Decodes one slice straight into the NV12 frame */
+static bool decodeSlice(Decoder_libjpeg::Context* ctx, const unsigned char* jpeg,
+                        const JpegHeader& header, const JpegSlice& slice,
+                        unsigned char* nv12, int stride) {
+    jpeg_decompress_struct* cinfo = &ctx->cinfo;
+    libjpeg_source_mgr* src = &ctx->source;
+    JSAMPROW y_rows[2 * DCTSIZE], u_rows[DCTSIZE], v_rows[DCTSIZE];
+    JSAMPARRAY planes[NUM_COMPONENTS_IN_YUV] = { y_rows, u_rows, v_rows };
+
+    src->reset();
+    if (header.hasDHT) {
+        src->add(jpeg, header.sofHeight ? header.sofHeight : header.scanData);
+    } else {
+        src->add(jpeg_odml_dht, sizeof(jpeg_odml_dht));
+        src->add(jpeg + 2, (header.sofHeight ? header.sofHeight : header.scanData) - 2);
+    }
+    if (header.sofHeight) {
+        ctx->height[0] = slice.rows >> 8;
+        ctx->height[1] = slice.rows & 0xff;
+        src->add(ctx->height, sizeof(ctx->height));
+        src->add(jpeg + header.sofHeight + 2, header.scanData - header.sofHeight - 2);
+    }
+    src->add(jpeg + slice.offset, slice.length);
+    src->add(jpeg_eoi, sizeof(jpeg_eoi));
+    cinfo->src = src;
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_decompress(&cinfo);
+    if (setjmp(ctx->error.mJump)) {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
 
-    cinfo.src = &s_mgr;
-    int status = jpeg_read_header(&cinfo, true);
-    if (status != JPEG_HEADER_OK) {
+    if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
         CAMHAL_LOGEA("jpeg header corrupted");
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    // NV12 needs 2x horizontally subsampled chroma, 4:2:2 and 4:2:0 are accepted
+    if ((cinfo->num_components != NUM_COMPONENTS_IN_YUV) ||
+        (cinfo->comp_info[0].h_samp_factor != 2) ||
+        (cinfo->comp_info[0].v_samp_factor > 2) ||
+        (cinfo->comp_info[1].h_samp_factor != 1) || (cinfo->comp_info[1].v_samp_factor != 1) ||
+        (cinfo->comp_info[2].h_samp_factor != 1) || (cinfo->comp_info[2].v_samp_factor != 1)) {
+        CAMHAL_LOGEA("Unsupported jpeg sampling");
+        jpeg_abort_decompress(cinfo);
         return false;
     }
 
-    cinfo.out_color_space = JCS_YCbCr;
-    cinfo.raw_data_out = true;
-    status = jpeg_start_decompress(&cinfo);
-    if (!status){
+    cinfo->out_color_space = JCS_YCbCr;
+    cinfo->raw_data_out = TRUE;
+    if (!jpeg_start_decompress(cinfo)) {
         CAMHAL_LOGEA("jpeg_start_decompress failed");
+        jpeg_abort_decompress(cinfo);
         return false;
     }
 
-    if (mWidth == 0){
-        mWidth = cinfo.output_width;
-        mHeight = cinfo.output_height;
-        CAMHAL_LOGEA("w x h = %d x %d. stride=%d", cinfo.output_width, cinfo.output_height, stride);
+    int rows_per_call = cinfo->max_v_samp_factor * DCTSIZE;
+    // every chroma row of 4:2:0 goes to NV12, every second one of 4:2:2
+    int chroma_step = (cinfo->max_v_samp_factor == 2) ? 1 : 2;
+    size_t luma_width = cinfo->comp_info[0].width_in_blocks * DCTSIZE;
+    size_t chroma_width = cinfo->comp_info[1].width_in_blocks * DCTSIZE;
+    int height = cinfo->output_height;
+    int uv_height = (height + 1) / 2;
+    int pairs = (cinfo->output_width + 1) / 2;
+
+    unsigned char* scratch = Utils::reserveScratch(&ctx->scratch, &ctx->scratch_size,
+                                                   2 * DCTSIZE * chroma_width + luma_width);
+    if (!scratch) {
+        CAMHAL_LOGEA("Unable to allocate decoder rows");
+        jpeg_abort_decompress(cinfo);
+        return false;
     }
-    else if ((cinfo.output_width > mWidth) || (cinfo.output_height > mHeight)) {
-        CAMHAL_LOGEA(" Free the existing buffers so that they are reallocated for new w x h. Old WxH = %dx%d. New WxH = %dx%d",
-        mWidth, mHeight, cinfo.output_width, cinfo.output_height);
-        release();
-        mWidth = cinfo.output_width;
-        mHeight = cinfo.output_height;
+    unsigned char* u_scratch = scratch;
+    unsigned char* v_scratch = scratch + DCTSIZE * chroma_width;
+    unsigned char* dummy_row = scratch + 2 * DCTSIZE * chroma_width;
+
+    unsigned char* y_plane = nv12 + slice.firstRow * stride;
+    unsigned char* uv_plane = nv12 + header.height * stride + (slice.firstRow / 2) * stride;
+
+    for (int i = 0; i < DCTSIZE; i++) {
+        u_rows[i] = u_scratch + i * chroma_width;
+        v_rows[i] = v_scratch + i * chroma_width;
     }
 
-    unsigned int decoded_uv_buffer_size = cinfo.output_width * cinfo.output_height / 2;
-    if (Y_Plane == NULL)Y_Plane = (unsigned char **)malloc(cinfo.output_height * sizeof(unsigned char *));
-    if (U_Plane == NULL)U_Plane = (unsigned char **)malloc(cinfo.output_height * sizeof(unsigned char *));
-    if (V_Plane == NULL)V_Plane = (unsigned char **)malloc(cinfo.output_height * sizeof(unsigned char *));
-    if (UV_Plane == NULL) UV_Plane = (unsigned char *)malloc(decoded_uv_buffer_size);
+    for (int row = 0; row < height; row += rows_per_call) {
+        // rows past the bottom of a partial iMCU row are discarded
+        for (int i = 0; i < rows_per_call; i++) {
+            y_rows[i] = (row + i < height) ? y_plane + (row + i) * stride : dummy_row;
+        }
 
-    unsigned char **YUV_Planes[NUM_COMPONENTS_IN_YUV];
-    YUV_Planes[0] = Y_Plane;
-    YUV_Planes[1] = U_Plane;
-    YUV_Planes[2] = V_Plane;
+        jpeg_read_raw_data(cinfo, planes, rows_per_call);
 
-    unsigned char *row = &nv12_buffer[0];
+        int uv_row = row / 2;
+        int uv_rows = rows_per_call / 2;
+        if (uv_row + uv_rows > uv_height) {
+            uv_rows = uv_height - uv_row;
+        }
+        yuv_merge_pairs(u_scratch, chroma_width * chroma_step,
+                        v_scratch, chroma_width * chroma_step,
+                        uv_plane + uv_row * stride, stride, pairs, uv_rows);
+    }
 
-    // Y Component
-    for (unsigned int j = 0; j < cinfo.output_height; j++, row += stride)
-        YUV_Planes[0][j] = row;
+    jpeg_finish_decompress(cinfo);
 
-    row = &UV_Plane[0];
+    return true;
+}
 
-    // U Component
-    for (unsigned int j = 0; j < cinfo.output_height; j+=2, row += cinfo.output_width / 2){
-        YUV_Planes[1][j+0] = row;
-        YUV_Planes[1][j+1] = row;
+Decoder_libjpeg::Decoder_libjpeg()
+{
+    for (int i = 0; i < MAX_SLICES; i++) {
+        mContexts[i] = NULL;
     }
+}
 
-    // V Component
-    for (unsigned int j = 0; j < cinfo.output_height; j+=2, row += cinfo.output_width / 2){
-        YUV_Planes[2][j+0] = row;
-        YUV_Planes[2][j+1] = row;
+Decoder_libjpeg::~Decoder_libjpeg()
+{
+    for (int i = 0; i < MAX_SLICES; i++) {
+        if (mContexts[i]) {
+            jpeg_destroy_decompress(&mContexts[i]->cinfo);
+            free(mContexts[i]->scratch);
+            delete mContexts[i];
+        }
+    }
+}
+
+Decoder_libjpeg::Context* Decoder_libjpeg::context(int slice)
+{
+    if (mContexts[slice]) {
+        return mContexts[slice];
     }
 
-    // Interleaving U and V
-    for (unsigned int i = 0; i < cinfo.output_height; i += 8) {
-        jpeg_read_raw_data(&cinfo, YUV_Planes, 8);
-        YUV_Planes[0] += 8;
-        YUV_Planes[1] += 8;
-        YUV_Planes[2] += 8;
+    Context* const ctx = new Context;
+    ctx->scratch = NULL;
+    ctx->scratch_size = 0;
+    ctx->cinfo.err = jpeg_std_error(&ctx->error);
+    ctx->error.error_exit = libjpeg_error_exit;
+    ctx->error.output_message = libjpeg_output_message;
+
+    if (setjmp(ctx->error.mJump)) {
+        delete ctx;
+        return NULL;
     }
+    jpeg_create_decompress(&ctx->cinfo);
+
+    mContexts[slice] = ctx;
+    return ctx;
+}
 
-    unsigned char *uv_ptr = nv12_buffer + (stride * cinfo.output_height);
-    unsigned char *u_ptr = UV_Plane;
-    unsigned char *v_ptr = UV_Plane + (decoded_uv_buffer_size / 2);
-    for(unsigned int i = 0; i < cinfo.output_height / 2; i++){
-        for(unsigned int j = 0; j < cinfo.output_width; j+=2){
-            *(uv_ptr + j) = *u_ptr; u_ptr++;
-            *(uv_ptr + j + 1) = *v_ptr; v_ptr++;
+void Decoder_libjpeg::decodeSliceTask(void* arg, int index)
+{
+    SliceJob* job = static_cast<SliceJob*>(arg);
+    Context* ctx = job->decoder->mContexts[index];
+
+    job->ok[index] = ctx && decodeSlice(ctx, job->jpeg, *job->header, job->slices[index],
+                                        job->nv12, job->stride);
+}
+
+bool Decoder_libjpeg::decode(unsigned char *jpeg_src, int filled_len, unsigned char *nv12_buffer, int stride)
+{
+    JpegHeader header;
+    JpegSlice slices[MAX_SLICES];
+    SliceJob job;
+
+    if (filled_len <= 0)
+        return false;
+
+    if (!parseHeader(jpeg_src, filled_len, header)) {
+        CAMHAL_LOGEA("jpeg header corrupted");
+        return false;
+    }
+
+    Utils::WorkerPool& workers = Utils::WorkerPool::shared();
+    int max_slices = workers.concurrency();
+    if (max_slices > MAX_SLICES) {
+        max_slices = MAX_SLICES;
+    }
+
+    // every slice needs a decompressor of its own
+    for (int i = 0; i < max_slices; i++) {
+        if (!context(i)) {
+            max_slices = i;
+            break;
         }
-        uv_ptr = uv_ptr + stride;
     }
+    if (max_slices == 0) {
+        CAMHAL_LOGEA("Unable to create jpeg decompressor");
+        return false;
+    }
+
+    int count = findSlices(jpeg_src, filled_len, header, max_slices, slices);
+
+    job.decoder = this;
+    job.jpeg = jpeg_src;
+    job.header = &header;
+    job.slices = slices;
+    job.nv12 = nv12_buffer;
+    job.stride = stride;
 
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    workers.run(decodeSliceTask, &job, count);
+
+    for (int i = 0; i < count; i++) {
+        if (!job.ok[i]) {
+            return false;
+        }
+    }
 
     return true;
 }
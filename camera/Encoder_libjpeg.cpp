@@ -41,9 +41,28 @@ extern "C" {
     #include "jerror.h"
 }
 
+#ifdef ARCH_ARM_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 #define ARRAY_SIZE(array) (sizeof((array)) / sizeof((array)[0]))
 #define MIN(x,y) ((x < y) ? x : y)
 
+// one MCU row is 16 lines for 4:2:0 and 8 lines for 4:2:2 sampling
+#define JPEG_MAX_MCU_HEIGHT (2 * DCTSIZE)
+// strips start on a multiple of 8 MCU rows, the RSTn marker cycle length
+#define JPEG_STRIP_ALIGN_MCU_ROWS 8
+#define JPEG_MAX_STRIPS 16
+// images with fewer MCU rows than this are always encoded in one piece
+#define JPEG_MIN_STRIP_MCU_ROWS (2 * JPEG_STRIP_ALIGN_MCU_ROWS)
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_SOF2 0xC2
+#define JPEG_MARKER_RST0 0xD0
+#define JPEG_MARKER_SOI  0xD8
+#define JPEG_MARKER_EOI  0xD9
+#define JPEG_MARKER_SOS  0xDA
+
 namespace Ti {
 namespace Camera {
 
@@ -65,6 +84,7 @@ struct libjpeg_destination_mgr : jpeg_destination_mgr {
     uint8_t* buf;
     int bufsize;
     size_t jpegsize;
+    bool overflow;
 };
 
 static void libjpeg_init_destination (j_compress_ptr cinfo) {
@@ -80,6 +100,7 @@ static boolean libjpeg_empty_output_buffer(j_compress_ptr cinfo) {
 
     dest->next_output_byte = dest->buf;
     dest->free_in_buffer = dest->bufsize;
+    dest->overflow = true;
     return TRUE; // ?
 }
 
@@ -97,167 +118,109 @@ libjpeg_destination_mgr::libjpeg_destination_mgr(uint8_t* input, int size) {
     this->bufsize = size;
 
     jpegsize = 0;
+    overflow = false;
 }
 
 /* private static functions */
-static void nv21_to_yuv(uint8_t* dst, uint8_t* y, uint8_t* uv, int width) {
-    if (!dst || !y || !uv) {
-        return;
-    }
 
-    while ((width--) > 0) {
-        uint8_t y0 = y[0];
-        uint8_t v0 = uv[0];
-        uint8_t u0 = *(uv+1);
-        dst[0] = y0;
-        dst[1] = u0;
-        dst[2] = v0;
-        dst += 3;
-        y++;
-        if(!(width % 2)) uv+=2;
+/* Splits an interleaved VU (NV21) chroma row into Cb and Cr rows */
+static void split_vu(uint8_t* cb, uint8_t* cr, const uint8_t* vu, int n) {
+#ifdef ARCH_ARM_HAVE_NEON
+    for (; n >= 16; n -= 16) {
+        uint8x16x2_t v = vld2q_u8(vu);
+        vst1q_u8(cr, v.val[0]);
+        vst1q_u8(cb, v.val[1]);
+        vu += 32;
+        cb += 16;
+        cr += 16;
     }
-}
-
-static void uyvy_to_yuv(uint8_t* dst, uint32_t* src, int width) {
-    if (!dst || !src) {
-        return;
+#endif
+    while ((n--) > 0) {
+        *cr++ = vu[0];
+        *cb++ = vu[1];
+        vu += 2;
     }
+}
 
-    if (width % 2) {
-        return; // not supporting odd widths
-    }
+/* Splits a packed UYVY or YUYV row of 'pairs' 4 byte groups into
+ * planar Y, Cb and Cr rows */
+static void split_yuv422(uint8_t* y, uint8_t* cb, uint8_t* cr, const uint8_t* src,
+                         int pairs, bool uyvy) {
+    const int y0 = uyvy ? 1 : 0;
+    const int u0 = uyvy ? 0 : 1;
+    const int y1 = uyvy ? 3 : 2;
+    const int v0 = uyvy ? 2 : 3;
 
 #ifdef ARCH_ARM_HAVE_NEON
-    // currently, neon routine only supports multiple of 16 width
-    if ((width % 16) == 0) {
-        int n = width;
-        asm volatile (
-        "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-        "   cmp %[n], #16                                               \n\t"
-        "   blt 5f                                                      \n\t"
-        "0: @ 16 pixel swap                                             \n\t"
-        "   vld2.8  {q0, q1} , [%[src]]! @ q0 = uv q1 = y               \n\t"
-        "   vuzp.8 q0, q2                @ d0 = u d4 = v                \n\t"
-        "   vmov d1, d0                  @ q0 = u0u1u2..u0u1u2...       \n\t"
-        "   vmov d5, d4                  @ q2 = v0v1v2..v0v1v2...       \n\t"
-        "   vzip.8 d0, d1                @ q0 = u0u0u1u1u2u2...         \n\t"
-        "   vzip.8 d4, d5                @ q2 = v0v0v1v1v2v2...         \n\t"
-        "   vswp q0, q1                  @ now q0 = y q1 = u q2 = v     \n\t"
-        "   vst3.8  {d0,d2,d4},[%[dst]]!                                \n\t"
-        "   vst3.8  {d1,d3,d5},[%[dst]]!                                \n\t"
-        "   sub %[n], %[n], #16                                         \n\t"
-        "   cmp %[n], #16                                               \n\t"
-        "   bge 0b                                                      \n\t"
-        "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-        "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-        : [dst] "+r" (dst), [src] "+r" (src), [n] "+r" (n)
-        : [src_stride] "r" (width)
-        : "cc", "memory", "q0", "q1", "q2"
-        );
-    } else
-#endif
-    {
-        while ((width-=2) >= 0) {
-            uint8_t u0 = (src[0] >> 0) & 0xFF;
-            uint8_t y0 = (src[0] >> 8) & 0xFF;
-            uint8_t v0 = (src[0] >> 16) & 0xFF;
-            uint8_t y1 = (src[0] >> 24) & 0xFF;
-            dst[0] = y0;
-            dst[1] = u0;
-            dst[2] = v0;
-            dst[3] = y1;
-            dst[4] = u0;
-            dst[5] = v0;
-            dst += 6;
-            src++;
+    for (; pairs >= 8; pairs -= 8) {
+        uint8x8x4_t p = vld4_u8(src);
+        uint8x8x2_t l;
+        if (uyvy) {
+            l.val[0] = p.val[1];
+            l.val[1] = p.val[3];
+            vst1_u8(cb, p.val[0]);
+            vst1_u8(cr, p.val[2]);
+        } else {
+            l.val[0] = p.val[0];
+            l.val[1] = p.val[2];
+            vst1_u8(cb, p.val[1]);
+            vst1_u8(cr, p.val[3]);
         }
+        vst2_u8(y, l);
+        src += 32;
+        y += 16;
+        cb += 8;
+        cr += 8;
     }
-}
-
-static void yuyv_to_yuv(uint8_t* dst, uint32_t* src, int width) {
-    if (!dst || !src) {
-        return;
+#endif
+    while ((pairs--) > 0) {
+        y[0] = src[y0];
+        y[1] = src[y1];
+        *cb++ = src[u0];
+        *cr++ = src[v0];
+        src += 4;
+        y += 2;
     }
+}
 
-    if (width % 2) {
-        return; // not supporting odd widths
-    }
-
-#ifdef ARCH_ARM_HAVE_NEON
-    // currently, neon routine only supports multiple of 16 width
-    if ((width % 16) == 0) {
-        int n = width;
-        asm volatile (
-        "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-        "   cmp %[n], #16                                               \n\t"
-        "   blt 5f                                                      \n\t"
-        "0: @ 16 pixel swap                                             \n\t"
-        "   vld2.8  {q0, q1} , [%[src]]! @ q0 = yyyy.. q1 = uvuv..      \n\t"
-        "   vuzp.8 q1, q2                @ d2 = u d4 = v                \n\t"
-        "   vmov d3, d2                  @ q1 = u0u1u2..u0u1u2...       \n\t"
-        "   vmov d5, d4                  @ q2 = v0v1v2..v0v1v2...       \n\t"
-        "   vzip.8 d2, d3                @ q1 = u0u0u1u1u2u2...         \n\t"
-        "   vzip.8 d4, d5                @ q2 = v0v0v1v1v2v2...         \n\t"
-        "                                @ now q0 = y q1 = u q2 = v     \n\t"
-        "   vst3.8  {d0,d2,d4},[%[dst]]!                                \n\t"
-        "   vst3.8  {d1,d3,d5},[%[dst]]!                                \n\t"
-        "   sub %[n], %[n], #16                                         \n\t"
-        "   cmp %[n], #16                                               \n\t"
-        "   bge 0b                                                      \n\t"
-        "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-        "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-        : [dst] "+r" (dst), [src] "+r" (src), [n] "+r" (n)
-        : [src_stride] "r" (width)
-        : "cc", "memory", "q0", "q1", "q2"
-        );
-    } else
-#endif
-    {
-        while ((width-=2) >= 0) {
-            uint8_t y0 = (src[0] >> 0) & 0xFF;
-            uint8_t u0 = (src[0] >> 8) & 0xFF;
-            uint8_t y1 = (src[0] >> 16) & 0xFF;
-            uint8_t v0 = (src[0] >> 24) & 0xFF;
-            dst[0] = y0;
-            dst[1] = u0;
-            dst[2] = v0;
-            dst[3] = y1;
-            dst[4] = u0;
-            dst[5] = v0;
-            dst += 6;
-            src++;
-        }
+/* libjpeg reads whole 8 sample blocks in raw mode, replicate the last
+ * sample into the padding the same way its own edge expansion would */
+static void pad_row(uint8_t* row, int width, int padded) {
+    if (padded > width) {
+        memset(row + width, row[width - 1], padded - width);
     }
 }
 
-static void resize_nv12(Encoder_libjpeg::params* params, uint8_t* dst_buffer) {
-    structConvImage o_img_ptr, i_img_ptr;
+static status_t resize_nv12(Encoder_libjpeg::params* params, uint8_t* dst_buffer) {
+    NV12Image i_img, o_img;
 
     if (!params || !dst_buffer) {
-        return;
+        return BAD_VALUE;
     }
 
     //input
-    i_img_ptr.uWidth =  params->in_width;
-    i_img_ptr.uStride =  i_img_ptr.uWidth;
-    i_img_ptr.uHeight =  params->in_height;
-    i_img_ptr.imgPtr = (uint8_t*) params->src;
-    i_img_ptr.clrPtr = i_img_ptr.imgPtr + (i_img_ptr.uWidth * i_img_ptr.uHeight);
-    i_img_ptr.uOffset = 0;
+    i_img.width = params->in_width;
+    i_img.height = params->in_height;
+    i_img.yStride = i_img.width;
+    i_img.uvStride = i_img.width;
+    i_img.y = (uint8_t*) params->src;
+    i_img.uv = i_img.y + (i_img.width * i_img.height);
 
     //ouput
-    o_img_ptr.uWidth = params->out_width;
-    o_img_ptr.uStride = o_img_ptr.uWidth;
-    o_img_ptr.uHeight = params->out_height;
-    o_img_ptr.imgPtr = dst_buffer;
-    o_img_ptr.clrPtr = o_img_ptr.imgPtr + (o_img_ptr.uWidth * o_img_ptr.uHeight);
-    o_img_ptr.uOffset = 0;
+    o_img.width = params->out_width;
+    o_img.height = params->out_height;
+    o_img.yStride = o_img.width;
+    o_img.uvStride = o_img.width;
+    o_img.y = dst_buffer;
+    o_img.uv = o_img.y + (o_img.width * o_img.height);
+
+    // thumbnails are usually heavily downscaled, average the whole footprint then
+    NV12ResizeFilter filter = NV12_RESIZE_FILTER_BILINEAR;
+    if ((o_img.width < i_img.width) && (o_img.height < i_img.height)) {
+        filter = NV12_RESIZE_FILTER_BOX;
+    }
 
-    VT_resizeFrame_Video_opt2_lp(&i_img_ptr, &o_img_ptr, nullptr);
+    return NV12Resizer::instance().resize(i_img, NULL, o_img, NULL, filter);
 }
 
 /* public static functions */
@@ -423,18 +386,337 @@ status_t ExifElementsTable::insertElement(const char* tag, const char* value) {
 }
 
 /* private member functions */
-size_t Encoder_libjpeg::encode(params* input) {
-    jpeg_compress_struct    cinfo;
+enum {
+    ENCODE_FORMAT_YUV420SP,
+    ENCODE_FORMAT_YUV422I_UYVY,
+    ENCODE_FORMAT_YUV422I_YUYV,
+};
+
+// source layout, resolved once per picture instead of once per row
+struct Encoder_libjpeg::Source {
+    int format;
+    uint8_t* y;      // first row, start offset applied
+    uint8_t* uv;     // first chroma row, YUV420SP only
+    int stride;      // bytes per row of y and uv
+    int width;       // encoded width with right crop removed
+    int height;
+    int mcu_height;  // lines per MCU row, 16 for 4:2:0 and 8 for 4:2:2
+};
+
+// one libjpeg compressor with the buffers it needs, kept across pictures
+struct JpegCompressor {
+    jpeg_compress_struct cinfo;
     jpeg_error_mgr jerr;
-    jpeg_destination_mgr jdest;
+    bool created;
+    uint8_t* rows;          // padded planar rows of one MCU row
+    size_t rows_size;
+    uint8_t* output;        // strip output, unused by the first strip
+    size_t output_size;
+};
+
+struct Encoder_libjpeg::Context {
+    JpegCompressor compressor[JPEG_MAX_STRIPS];
+    uint8_t* resized;       // resized YUV420SP input
+    size_t resized_size;
+};
+
+struct Encoder_libjpeg::StripJob {
+    Encoder_libjpeg* encoder;
+    Context* context;
+    params* input;
+    const Source* source;
+    int strip_rows;
+    int strips;
+    libjpeg_destination_mgr* dest[JPEG_MAX_STRIPS];
+    size_t size[JPEG_MAX_STRIPS];
+};
+
+/* Number of luma rows per strip, or 0 if the image should not be split */
+static int stripRows(int requested, int height, int mcu_height) {
+    int mcu_rows = (height + mcu_height - 1) / mcu_height;
+    int strips = (requested > 0) ? requested : Utils::WorkerPool::onlineCpus();
+    int strip_mcu_rows;
+
+    if ((strips < 2) || (mcu_rows < JPEG_MIN_STRIP_MCU_ROWS)) {
+        return 0;
+    }
+
+    if (strips > JPEG_MAX_STRIPS) {
+        strips = JPEG_MAX_STRIPS;
+    }
+
+    strip_mcu_rows = (mcu_rows + strips - 1) / strips;
+    strip_mcu_rows = (strip_mcu_rows + JPEG_STRIP_ALIGN_MCU_ROWS - 1) &
+                     ~(JPEG_STRIP_ALIGN_MCU_ROWS - 1);
+
+    if (strip_mcu_rows >= mcu_rows) {
+        return 0;
+    }
+
+    return strip_mcu_rows * mcu_height;
+}
+
+/* Offset of the first entropy coded byte, optionally returns the
+ * offset of the frame height field of the SOFn segment */
+static size_t findScanData(const uint8_t* jpeg, size_t size, size_t* sof_height) {
+    size_t pos = 2;
+
+    if ((size < 4) || (jpeg[0] != 0xFF) || (jpeg[1] != JPEG_MARKER_SOI)) {
+        return 0;
+    }
+
+    while (pos + 4 <= size) {
+        uint8_t marker;
+        size_t length;
+
+        if (jpeg[pos] != 0xFF) {
+            return 0;
+        }
+
+        marker = jpeg[pos + 1];
+        length = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+
+        if ((marker >= JPEG_MARKER_SOF0) && (marker <= JPEG_MARKER_SOF2) && sof_height) {
+            *sof_height = pos + 5;
+        }
+
+        pos += 2 + length;
+
+        if (marker == JPEG_MARKER_SOS) {
+            return (pos <= size) ? pos : 0;
+        }
+    }
+
+    return 0;
+}
+
+/* Joins the strips into the buffer of strip 0. Every strip was encoded as
+ * a complete JPEG with one restart interval per MCU row, so the scan data
+ * of strip n can follow strip n-1 separated by the restart marker that
+ * would have been emitted at that MCU row. */
+static size_t stitchStrips(libjpeg_destination_mgr** dest, const size_t* size,
+                           int strips, int strip_rows, int height, int mcu_height) {
+    uint8_t* out = dest[0]->buf;
+    size_t sof_height = 0;
+    size_t pos;
+
+    if ((0 == findScanData(out, size[0], &sof_height)) || (0 == sof_height) ||
+        (size[0] < 2) || (out[size[0] - 1] != JPEG_MARKER_EOI)) {
+        return 0;
+    }
+
+    // strip 0 header carries the height of the first strip only
+    out[sof_height] = (height >> 8) & 0xFF;
+    out[sof_height + 1] = height & 0xFF;
+
+    pos = size[0] - 2;
+
+    for (int i = 1; i < strips; i++) {
+        const uint8_t* jpeg = dest[i]->buf;
+        size_t begin = findScanData(jpeg, size[i], NULL);
+        size_t end = size[i] - 2;
+        int mcu_row = (i * strip_rows) / mcu_height;
+
+        if ((0 == begin) || (begin > end) || (jpeg[end + 1] != JPEG_MARKER_EOI) ||
+            (pos + 2 + (end - begin) + 2 > (size_t)dest[0]->bufsize)) {
+            return 0;
+        }
+
+        out[pos++] = 0xFF;
+        out[pos++] = JPEG_MARKER_RST0 + ((mcu_row - 1) & (JPEG_STRIP_ALIGN_MCU_ROWS - 1));
+        memcpy(out + pos, jpeg + begin, end - begin);
+        pos += end - begin;
+    }
+
+    out[pos++] = 0xFF;
+    out[pos++] = JPEG_MARKER_EOI;
+
+    return pos;
+}
+
+void Encoder_libjpeg::encodeStripTask(void* arg, int index) {
+    StripJob* job = (StripJob*) arg;
+    int first_row = index * job->strip_rows;
+    int rows = job->source->height - first_row;
+
+    if (rows > job->strip_rows) {
+        rows = job->strip_rows;
+    }
+
+    job->size[index] = job->encoder->encodeRows(&job->context->compressor[index], job->input,
+                                                *job->source, first_row, rows,
+                                                job->dest[index], true);
+}
+
+size_t Encoder_libjpeg::encodeStrips(Context* context, params* input, const Source& source,
+                                     int strip_rows) {
+    StripJob job;
+    size_t jpeg_size = 0;
+    int strips = (source.height + strip_rows - 1) / strip_rows;
+    bool valid = true;
+
+    if (strips > JPEG_MAX_STRIPS) {
+        return 0;
+    }
+
+    job.encoder = this;
+    job.context = context;
+    job.input = input;
+    job.source = &source;
+    job.strip_rows = strip_rows;
+    job.strips = strips;
+
+    // strip 0 writes straight into the output, the others into scratch
+    // buffers sized relative to their share of the output buffer
+    job.dest[0] = new libjpeg_destination_mgr(input->dst, input->dst_size);
+    for (int i = 1; i < strips; i++) {
+        JpegCompressor* c = &context->compressor[i];
+        int size = (int)(((int64_t)input->dst_size * strip_rows) / source.height);
+        uint8_t* buf = Utils::reserveScratch(&c->output, &c->output_size, size);
+        job.dest[i] = new libjpeg_destination_mgr(buf, buf ? size : 0);
+        valid = valid && buf;
+    }
+
+    if (valid) {
+        CAMHAL_LOGDB("encoding %d strips of %d rows", strips, strip_rows);
+        Utils::WorkerPool::shared().run(encodeStripTask, &job, strips);
+
+        for (int i = 0; i < strips; i++) {
+            valid = valid && !job.dest[i]->overflow && (job.size[i] > 0);
+        }
+    }
+
+    if (valid && !mCancelEncoding) {
+        jpeg_size = stitchStrips(job.dest, job.size, strips, strip_rows, source.height,
+                                 source.mcu_height);
+    }
+
+    for (int i = 0; i < strips; i++) {
+        delete job.dest[i];
+    }
+
+    return jpeg_size;
+}
+
+size_t Encoder_libjpeg::encodeRows(JpegCompressor* compressor, params* input,
+                                   const Source& source, int first_row, int rows,
+                                   libjpeg_destination_mgr* dest, bool restart) {
+    jpeg_compress_struct& cinfo = compressor->cinfo;
+    JSAMPROW y_rows[JPEG_MAX_MCU_HEIGHT];
+    JSAMPROW cb_rows[DCTSIZE];
+    JSAMPROW cr_rows[DCTSIZE];
+    JSAMPARRAY planes[3] = { y_rows, cb_rows, cr_rows };
+    bool yuv420 = (source.format == ENCODE_FORMAT_YUV420SP);
+    int chroma_width = (source.width + 1) / 2;
+    int y_padded = (source.width + DCTSIZE - 1) & ~(DCTSIZE - 1);
+    int c_padded = (chroma_width + DCTSIZE - 1) & ~(DCTSIZE - 1);
+    // NV21 luma rows are fed straight from the source when no padding is needed
+    bool y_direct = yuv420 && (y_padded == source.width);
+    uint8_t* scratch = NULL;
+    uint8_t* y_tmp = NULL;
+    uint8_t* cb_tmp = NULL;
+    uint8_t* cr_tmp = NULL;
+
+    scratch = Utils::reserveScratch(&compressor->rows, &compressor->rows_size,
+                                    (y_direct ? 0 : source.mcu_height * y_padded) + 2 * DCTSIZE * c_padded);
+    if (!scratch) {
+        return 0;
+    }
+
+    cb_tmp = scratch;
+    cr_tmp = cb_tmp + DCTSIZE * c_padded;
+    y_tmp = cr_tmp + DCTSIZE * c_padded;
+
+    for (int i = 0; i < DCTSIZE; i++) {
+        cb_rows[i] = cb_tmp + i * c_padded;
+        cr_rows[i] = cr_tmp + i * c_padded;
+    }
+    for (int i = 0; !y_direct && (i < source.mcu_height); i++) {
+        y_rows[i] = y_tmp + i * y_padded;
+    }
+
+    if (!compressor->created) {
+        cinfo.err = jpeg_std_error(&compressor->jerr);
+        jpeg_create_compress(&cinfo);
+        compressor->created = true;
+    }
+
+    cinfo.dest = dest;
+    cinfo.image_width = source.width;
+    cinfo.image_height = rows;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    cinfo.input_gamma = 1;
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, input->quality, TRUE);
+    cinfo.dct_method = JDCT_IFAST;
+
+    // feed subsampled planes directly instead of expanding to 4:4:4
+    // and letting libjpeg downsample the chroma again
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = yuv420 ? 2 : 1;
+
+    if (restart) {
+        // strips share the default huffman tables and restart every MCU row
+        cinfo.optimize_coding = FALSE;
+        cinfo.restart_in_rows = 1;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    for (int line = 0; (line < rows) && !mCancelEncoding; line += source.mcu_height) {
+        // rows past the bottom edge repeat the last one
+        for (int i = 0; i < source.mcu_height; i++) {
+            int row = first_row + MIN(line + i, rows - 1);
+            uint8_t* src = source.y + row * source.stride;
+
+            if (y_direct) {
+                y_rows[i] = src;
+            } else if (yuv420) {
+                memcpy(y_rows[i], src, source.width);
+                pad_row(y_rows[i], source.width, y_padded);
+            } else {
+                split_yuv422(y_rows[i], cb_rows[i], cr_rows[i], src, chroma_width,
+                             source.format == ENCODE_FORMAT_YUV422I_UYVY);
+                pad_row(y_rows[i], source.width, y_padded);
+                pad_row(cb_rows[i], chroma_width, c_padded);
+                pad_row(cr_rows[i], chroma_width, c_padded);
+            }
+        }
+
+        if (yuv420) {
+            for (int i = 0; i < DCTSIZE; i++) {
+                int row = (first_row + MIN(line + 2 * i, rows - 1)) / 2;
+
+                split_vu(cb_rows[i], cr_rows[i], source.uv + row * source.stride, chroma_width);
+                pad_row(cb_rows[i], chroma_width, c_padded);
+                pad_row(cr_rows[i], chroma_width, c_padded);
+            }
+        }
+
+        jpeg_write_raw_data(&cinfo, planes, source.mcu_height);
+    }
+
+    // no need to finish encoding routine if we are prematurely stopping
+    // we will end up crashing in dest_mgr since data is incomplete.
+    // Either way the compressor is ready for the next picture.
+    if (!mCancelEncoding)
+        jpeg_finish_compress(&cinfo);
+    else
+        jpeg_abort_compress(&cinfo);
+
+    return mCancelEncoding ? 0 : dest->jpegsize;
+}
+
+size_t Encoder_libjpeg::encode(Context* context, params* input) {
     uint8_t* src = NULL, *resize_src = NULL;
-    uint8_t* row_tmp = NULL;
-    uint8_t* row_src = NULL;
-    uint8_t* row_uv = NULL; // used only for NV12
     int out_width = 0, in_width = 0;
     int out_height = 0, in_height = 0;
     int bpp = 2; // for uyvy
-    int right_crop = 0, start_offset = 0;
+    int strip_rows = 0;
+    Source source;
 
     if (!input) {
         return 0;
@@ -444,8 +726,6 @@ size_t Encoder_libjpeg::encode(params* input) {
     in_width = input->in_width;
     out_height = input->out_height;
     in_height = input->in_height;
-    right_crop = input->right_crop;
-    start_offset = input->start_offset;
     src = input->src;
     input->jpeg_size = 0;
 
@@ -460,24 +740,40 @@ size_t Encoder_libjpeg::encode(params* input) {
 
     if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
         bpp = 1;
+        source.format = ENCODE_FORMAT_YUV420SP;
         if ((in_width != out_width) || (in_height != out_height)) {
-            resize_src = (uint8_t*) malloc(input->dst_size);
-            resize_nv12(input, resize_src);
-            if (resize_src) src = resize_src;
+            resize_src = Utils::reserveScratch(&context->resized, &context->resized_size,
+                                               (size_t)out_width * out_height * 3 / 2);
+            // the source does not have the output size, there is nothing to fall back to
+            if (NO_ERROR != resize_nv12(input, resize_src)) {
+                CAMHAL_LOGEB("Encoder: resizing %dx%d to %dx%d failed",
+                             in_width, in_height, out_width, out_height);
+                goto exit;
+            }
+            src = resize_src;
         }
-    } else if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV422I) &&
-               strcmp(input->format, TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY)) {
+    } else if (strcmp(input->format, TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY) == 0) {
+        source.format = ENCODE_FORMAT_YUV422I_UYVY;
+    } else if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV422I) == 0) {
+        source.format = ENCODE_FORMAT_YUV422I_YUYV;
+    } else {
         // we currently only support yuv422i and yuv420sp
         CAMHAL_LOGEB("Encoder: format not supported: %s", input->format);
         goto exit;
-    } else if ((in_width != out_width) || (in_height != out_height)) {
+    }
+
+    if ((source.format != ENCODE_FORMAT_YUV420SP) &&
+        ((in_width != out_width) || (in_height != out_height))) {
         CAMHAL_LOGEB("Encoder: resizing is not supported for this format: %s", input->format);
         goto exit;
     }
 
-    cinfo.err = jpeg_std_error(&jerr);
-
-    jpeg_create_compress(&cinfo);
+    source.y = src + input->start_offset;
+    source.uv = src + out_width * out_height * bpp;
+    source.stride = out_width * bpp;
+    source.width = out_width - input->right_crop;
+    source.height = out_height;
+    source.mcu_height = (source.format == ENCODE_FORMAT_YUV420SP) ? 2 * DCTSIZE : DCTSIZE;
 
     CAMHAL_LOGDB("encoding...  \n\t"
                  "width: %d    \n\t"
@@ -489,58 +785,347 @@ size_t Encoder_libjpeg::encode(params* input) {
                  out_width, out_height, input->dst,
                  input->dst_size, src, input->format);
 
-    cinfo.dest = &dest_mgr;
-    cinfo.image_width = out_width - right_crop;
-    cinfo.image_height = out_height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_YCbCr;
-    cinfo.input_gamma = 1;
+    strip_rows = stripRows(input->bands, out_height, source.mcu_height);
+    if (strip_rows > 0) {
+        dest_mgr.jpegsize = encodeStrips(context, input, source, strip_rows);
+        if ((dest_mgr.jpegsize == 0) && !mCancelEncoding) {
+            CAMHAL_LOGEA("Strip encoding failed, encoding in one piece");
+            strip_rows = 0;
+        }
+    }
 
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, input->quality, TRUE);
-    cinfo.dct_method = JDCT_IFAST;
+    if (strip_rows == 0) {
+        encodeRows(&context->compressor[0], input, source, 0, out_height, &dest_mgr, false);
+    }
 
-    jpeg_start_compress(&cinfo, TRUE);
+ exit:
+    input->jpeg_size = dest_mgr.jpegsize;
+    return dest_mgr.jpegsize;
+}
+
+Encoder_libjpeg::Context* Encoder_libjpeg::createContext() {
+    return (Context*) calloc(1, sizeof(Context));
+}
+
+void Encoder_libjpeg::destroyContext(Context* context) {
+    if (!context) {
+        return;
+    }
+
+    for (int i = 0; i < JPEG_MAX_STRIPS; i++) {
+        JpegCompressor* c = &context->compressor[i];
+        if (c->created) {
+            jpeg_destroy_compress(&c->cinfo);
+        }
+        free(c->rows);
+        free(c->output);
+    }
+    free(context->resized);
+    free(context);
+}
+
+void Encoder_libjpeg::process(Context* context) {
+    // the thumbnail is small next to the strip encoded main picture,
+    // encode it first on this worker
+    if (mThumbnailInput && !mCancelEncoding) {
+        encode(context, mThumbnailInput);
+    }
+
+    if (mMainInput && !mCancelEncoding) {
+        encode(context, mMainInput);
+    }
+
+    if (mCb) {
+        mCb(mMainInput, mThumbnailInput, mType, mCookie1, mCookie2, mCookie3, mCookie4, mCancelEncoding);
+    }
+}
 
-    row_tmp = (uint8_t*)malloc((out_width - right_crop) * 3);
-    row_src = src + start_offset;
-    row_uv = src + out_width * out_height * bpp;
+void Encoder_libjpeg::abort() {
+    mCancelEncoding = true;
 
-    while ((cinfo.next_scanline < cinfo.image_height) && !mCancelEncoding) {
-        JSAMPROW row[1];    /* pointer to JSAMPLE row[s] */
+    if (mCb) {
+        mCb(mMainInput, mThumbnailInput, mType, mCookie1, mCookie2, mCookie3, mCookie4, true);
+    }
+}
+
+/* JpegEncoderService */
+JpegEncoderService& JpegEncoderService::instance() {
+    // never destroyed, workers may still be running at process exit
+    static JpegEncoderService* sInstance = new JpegEncoderService();
+    return *sInstance;
+}
+
+JpegEncoderService::JpegEncoderService() : mExiting(false) {
+    for (int i = 0; i < WORKERS; i++) {
+        mContexts[i] = NULL;
+    }
+}
+
+JpegEncoderService::~JpegEncoderService() {
+    for (int i = 0; i < WORKERS; i++) {
+        Encoder_libjpeg::destroyContext(mContexts[i]);
+    }
+}
+
+status_t JpegEncoderService::startWorkers() {
+    int started = 0;
 
-        // convert input yuv format to yuv444
-        if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-            nv21_to_yuv(row_tmp, row_src, row_uv, out_width - right_crop);
-        } else if (strcmp(input->format, TICameraParameters::PIXEL_FORMAT_YUV422I_UYVY) == 0) {
-            uyvy_to_yuv(row_tmp, (uint32_t*)row_src, out_width - right_crop);
-        } else if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV422I) == 0) {
-            yuyv_to_yuv(row_tmp, (uint32_t*)row_src, out_width - right_crop);
+    for (int i = 0; i < WORKERS; i++) {
+        if (mWorkers[i].get()) {
+            started++;
+            continue;
         }
 
-        row[0] = row_tmp;
-        jpeg_write_scanlines(&cinfo, row, 1);
-        row_src = row_src + out_width*bpp;
+        if (!mContexts[i]) {
+            mContexts[i] = Encoder_libjpeg::createContext();
+            if (!mContexts[i]) {
+                continue;
+            }
+        }
 
-        // move uv row if input format needs it
-        if (strcmp(input->format, android::CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
-            if (!(cinfo.next_scanline % 2))
-                row_uv = row_uv +  out_width * bpp;
+        mWorkers[i] = new Worker(this, i);
+#ifdef ANDROID_API_N_OR_LATER
+        status_t ret = mWorkers[i]->run("jpeg_encoder");
+#else
+        status_t ret = mWorkers[i]->run();
+#endif
+        if (ret != NO_ERROR) {
+            CAMHAL_LOGEB("Unable to start jpeg encoder worker %d (%d)", i, ret);
+            mWorkers[i].clear();
+            continue;
         }
+        started++;
     }
 
-    // no need to finish encoding routine if we are prematurely stopping
-    // we will end up crashing in dest_mgr since data is incomplete
-    if (!mCancelEncoding)
-        jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    return started ? NO_ERROR : NO_INIT;
+}
 
-    if (resize_src) free(resize_src);
-    if (row_tmp) free(row_tmp);
+void JpegEncoderService::stopWorkers() {
+    // called with mLock held once no client is left, so the queue is empty
+    android::sp<Worker> workers[WORKERS];
 
- exit:
-    input->jpeg_size = dest_mgr.jpegsize;
-    return dest_mgr.jpegsize;
+    mExiting = true;
+    mJobCond.broadcast();
+    for (int i = 0; i < WORKERS; i++) {
+        workers[i] = mWorkers[i];
+        mWorkers[i].clear();
+    }
+
+    mLock.unlock();
+    for (int i = 0; i < WORKERS; i++) {
+        if (workers[i].get()) {
+            workers[i]->requestExit();
+            workers[i]->join();
+        }
+    }
+    mLock.lock();
+
+    for (int i = 0; i < WORKERS; i++) {
+        Encoder_libjpeg::destroyContext(mContexts[i]);
+        mContexts[i] = NULL;
+    }
+    mExiting = false;
+}
+
+void JpegEncoderService::registerClient(void* cookie) {
+    android::AutoMutex clientLock(mClientLock);
+    android::AutoMutex lock(mLock);
+    Stats stats;
+
+    if (mClients.indexOfKey(cookie) < 0) {
+        memset(&stats, 0, sizeof(stats));
+        mClients.add(cookie, stats);
+    }
+}
+
+void JpegEncoderService::unregisterClient(void* cookie) {
+    android::AutoMutex clientLock(mClientLock);
+
+    cancel(cookie);
+
+    android::AutoMutex lock(mLock);
+    if (mClients.removeItem(cookie) < 0) {
+        return;
+    }
+    if (mClients.isEmpty()) {
+        stopWorkers();
+    }
+}
+
+JpegEncoderService::Stats* JpegEncoderService::clientStats(void* cookie) {
+    ssize_t index = mClients.indexOfKey(cookie);
+
+    return (index < 0) ? NULL : &mClients.editValueAt(index);
+}
+
+status_t JpegEncoderService::submit(const android::sp<Encoder_libjpeg>& encoder, nsecs_t timeout) {
+    android::AutoMutex lock(mLock);
+    Job job;
+    Stats* stats;
+    void* cookie = NULL;
+
+    if (!encoder.get()) {
+        return BAD_VALUE;
+    }
+
+    encoder->getCookies(&cookie, NULL, NULL);
+    stats = clientStats(cookie);
+    if (!stats) {
+        CAMHAL_LOGEB("Jpeg job from unregistered client %p", cookie);
+        return NO_INIT;
+    }
+
+    if (mExiting || startWorkers() != NO_ERROR) {
+        stats->rejected++;
+        return NO_INIT;
+    }
+
+    // backpressure: hold the producer while every slot is taken
+    nsecs_t deadline = systemTime() + timeout;
+    while (mQueue.size() >= QUEUE_DEPTH) {
+        nsecs_t remaining = deadline - systemTime();
+        if (remaining <= 0) {
+            CAMHAL_LOGEA("Jpeg encoder queue full, dropping job");
+            stats->rejected++;
+            return TIMED_OUT;
+        }
+        mSpaceCond.waitRelative(mLock, remaining);
+    }
+
+    job.encoder = encoder;
+    job.queued = systemTime();
+    mQueue.push_back(job);
+    mJobCond.signal();
+
+    return NO_ERROR;
+}
+
+bool JpegEncoderService::matches(const android::sp<Encoder_libjpeg>& encoder, void* cookie) {
+    void* cookie1 = NULL;
+
+    if (!encoder.get()) {
+        return false;
+    }
+
+    encoder->getCookies(&cookie1, NULL, NULL);
+    return cookie1 == cookie;
+}
+
+void JpegEncoderService::cancel(void* cookie) {
+    android::Vector< android::sp<Encoder_libjpeg> > dropped;
+
+    {
+        android::AutoMutex lock(mLock);
+        Stats* stats = clientStats(cookie);
+
+        for (size_t i = 0; i < mQueue.size(); ) {
+            if (matches(mQueue[i].encoder, cookie)) {
+                dropped.push_back(mQueue[i].encoder);
+                mQueue.removeAt(i);
+            } else {
+                i++;
+            }
+        }
+
+        if (!dropped.isEmpty()) {
+            if (stats) {
+                stats->canceled += dropped.size();
+            }
+            mSpaceCond.broadcast();
+        }
+
+        for (int i = 0; i < WORKERS; i++) {
+            if (matches(mRunning[i], cookie)) {
+                mRunning[i]->cancel();
+                if (stats) {
+                    stats->canceled++;
+                }
+            }
+        }
+
+        for (int i = 0; i < WORKERS; ) {
+            if (matches(mRunning[i], cookie)) {
+                mDoneCond.wait(mLock);
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    // queued jobs never reached a worker, complete them here
+    for (size_t i = 0; i < dropped.size(); i++) {
+        dropped[i]->abort();
+    }
+}
+
+status_t JpegEncoderService::getStats(void* cookie, Stats& stats) {
+    android::AutoMutex lock(mLock);
+    Stats* client = clientStats(cookie);
+
+    if (!client) {
+        return BAD_VALUE;
+    }
+
+    stats = *client;
+    return NO_ERROR;
+}
+
+bool JpegEncoderService::processNext(int index) {
+    android::sp<Encoder_libjpeg> encoder;
+    nsecs_t queued, started, done;
+    void* cookie = NULL;
+
+    {
+        android::AutoMutex lock(mLock);
+
+        while (mQueue.isEmpty() && !mExiting) {
+            mJobCond.wait(mLock);
+        }
+
+        if (mQueue.isEmpty()) {
+            return false;
+        }
+
+        encoder = mQueue[0].encoder;
+        queued = mQueue[0].queued;
+        mQueue.removeAt(0);
+        mRunning[index] = encoder;
+        mSpaceCond.signal();
+    }
+
+    started = systemTime();
+    encoder->process(mContexts[index]);
+    done = systemTime();
+
+    encoder->getCookies(&cookie, NULL, NULL);
+
+    {
+        android::AutoMutex lock(mLock);
+        Stats* stats = clientStats(cookie);
+
+        mRunning[index].clear();
+        if (stats) {
+            stats->completed++;
+            stats->queueTotal += started - queued;
+            stats->encodeTotal += done - started;
+            if (started - queued > stats->queueMax) {
+                stats->queueMax = started - queued;
+            }
+            if (done - started > stats->encodeMax) {
+                stats->encodeMax = done - started;
+            }
+        }
+        mDoneCond.broadcast();
+    }
+
+    CAMHAL_LOGDB("jpeg job %p: queued %lld us, encoded %lld us", encoder.get(),
+                 (long long) ((started - queued) / 1000), (long long) ((done - started) / 1000));
+
+    // drop the last reference outside of the lock
+    encoder.clear();
+
+    return true;
 }
 
 } // namespace Camera
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file FrameRefTable.cpp
+*
+* Lock free per buffer reference counts of the camera adapter.
+*
+*/
+
+#include "Common.h"
+#include "FrameRefTable.h"
+
+namespace Ti {
+namespace Camera {
+
+static_assert(0 == ( FrameRefTable::MAX_SLOTS & ( FrameRefTable::MAX_SLOTS - 1 ) ),
+              "slot count must be a power of two");
+
+static inline uint64_t pack(uint32_t generation, int value)
+{
+    return ( static_cast<uint64_t>(generation) << 32 ) | static_cast<uint32_t>(value);
+}
+
+static inline uint32_t generationOf(uint64_t word)
+{
+    return static_cast<uint32_t>(word >> 32);
+}
+
+static inline int valueOf(uint64_t word)
+{
+    return static_cast<int>(static_cast<uint32_t>(word));
+}
+
+FrameRefTable::FrameRefTable()
+{
+    for ( int i = 0; i < MAX_SLOTS; i++ ) {
+        mSlots[i].buffer = NULL;
+        mSlots[i].cookie = NULL;
+        mSlots[i].generation = 0;
+        mSlots[i].total = pack(0, 0);
+        for ( int j = 0; j < MAX_GROUPS; j++ ) {
+            mSlots[i].counts[j] = pack(0, -1);
+        }
+    }
+}
+
+uint32_t FrameRefTable::hash(const void* buffer)
+{
+    // buffers are array elements, the low bits carry no information
+    uint32_t key = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(buffer) >> 3);
+
+    return ( ( key * 2654435761u ) >> 16 ) & ( MAX_SLOTS - 1 );
+}
+
+FrameRefTable::Slot* FrameRefTable::find(const void* buffer) const
+{
+    uint32_t start;
+
+    if ( NULL == buffer ) {
+        return NULL;
+    }
+
+    start = hash(buffer);
+
+    // slots are never emptied again, so a probe ends at the first empty one
+    for ( int i = 0; i < MAX_SLOTS; i++ ) {
+        Slot* slot = const_cast<Slot*>(&mSlots[( start + i ) & ( MAX_SLOTS - 1 )]);
+        const void* key = __atomic_load_n(&slot->buffer, __ATOMIC_ACQUIRE);
+
+        if ( buffer == key ) {
+            return slot;
+        }
+        if ( NULL == key ) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+bool FrameRefTable::isFree(const Slot& slot)
+{
+    if ( NULL != slot.cookie ) {
+        return false;
+    }
+
+    for ( int i = 0; i < MAX_GROUPS; i++ ) {
+        if ( 0 <= valueOf(__atomic_load_n(&slot.counts[i], __ATOMIC_ACQUIRE)) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+FrameRefTable::Slot* FrameRefTable::insert(const void* buffer)
+{
+    uint32_t start = hash(buffer);
+    Slot* slot = find(buffer);
+    Slot* reuse = NULL;
+
+    if ( NULL != slot ) {
+        return slot;
+    }
+
+    // prefer the first slot of a buffer that is no longer registered
+    // anywhere, those stay in the probe chains of other buffers
+    for ( int i = 0; i < MAX_SLOTS; i++ ) {
+        Slot* candidate = &mSlots[( start + i ) & ( MAX_SLOTS - 1 )];
+
+        if ( NULL == candidate->buffer ) {
+            if ( NULL == reuse ) {
+                reuse = candidate;
+            }
+            break;
+        }
+        if ( ( NULL == reuse ) && isFree(*candidate) ) {
+            reuse = candidate;
+        }
+    }
+
+    if ( NULL == reuse ) {
+        CAMHAL_LOGEB("No free reference count slot for buffer %p", buffer);
+        return NULL;
+    }
+
+    // Nothing can register in a free slot without the lock, so only late
+    // updates for its previous buffer race with this. The new owner is
+    // published first, those updates check it after loading a count and
+    // their compare and swap fails on the new generation.
+    uint32_t generation = reuse->generation + 1;
+
+    reuse->generation = generation;
+    __atomic_store_n(&reuse->buffer, buffer, __ATOMIC_RELEASE);
+    __atomic_store_n(&reuse->total, pack(generation, 0), __ATOMIC_RELEASE);
+    for ( int i = 0; i < MAX_GROUPS; i++ ) {
+        __atomic_store_n(&reuse->counts[i], pack(generation, -1), __ATOMIC_RELEASE);
+    }
+
+    return reuse;
+}
+
+bool FrameRefTable::addTotal(Slot& slot, uint32_t generation, int delta, int* total)
+{
+    uint64_t word = __atomic_load_n(&slot.total, __ATOMIC_ACQUIRE);
+
+    do {
+        if ( generation != generationOf(word) ) {
+            return false;
+        }
+    } while ( !__atomic_compare_exchange_n(&slot.total, &word,
+                                           pack(generation, valueOf(word) + delta), true,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) );
+
+    if ( NULL != total ) {
+        *total = valueOf(word) + delta;
+    }
+
+    return true;
+}
+
+bool FrameRefTable::store(Slot& slot, const void* buffer, int group, int count, bool locked)
+{
+    uint64_t word = __atomic_load_n(&slot.counts[group], __ATOMIC_ACQUIRE);
+    uint32_t generation;
+    int old;
+
+    do {
+        generation = generationOf(word);
+        old = valueOf(word);
+        // the slot went to another buffer, or this registers the buffer
+        // in the group and has to hold the lock
+        if ( ( buffer != __atomic_load_n(&slot.buffer, __ATOMIC_ACQUIRE) ) ||
+             ( ( 0 > old ) && !locked ) ) {
+            return false;
+        }
+    } while ( !__atomic_compare_exchange_n(&slot.counts[group], &word,
+                                           pack(generation, count), true,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) );
+
+    int delta = ( count > 0 ? count : 0 ) - ( old > 0 ? old : 0 );
+    if ( 0 != delta ) {
+        addTotal(slot, generation, delta, NULL);
+    }
+
+    return true;
+}
+
+int FrameRefTable::get(const void* buffer, int group) const
+{
+    const Slot* slot = find(buffer);
+
+    if ( ( NULL == slot ) || ( 0 > group ) || ( MAX_GROUPS <= group ) ) {
+        return -1;
+    }
+
+    return valueOf(__atomic_load_n(&slot->counts[group], __ATOMIC_ACQUIRE));
+}
+
+int FrameRefTable::total(const void* buffer) const
+{
+    const Slot* slot = find(buffer);
+
+    if ( NULL == slot ) {
+        return 0;
+    }
+
+    return valueOf(__atomic_load_n(&slot->total, __ATOMIC_ACQUIRE));
+}
+
+void FrameRefTable::set(const void* buffer, int group, int count)
+{
+    Slot* slot;
+
+    if ( ( NULL == buffer ) || ( 0 > group ) || ( MAX_GROUPS <= group ) ) {
+        return;
+    }
+
+    slot = find(buffer);
+    if ( ( NULL != slot ) && store(*slot, buffer, group, count, false) ) {
+        return;
+    }
+
+    android::AutoMutex lock(mLock);
+    slot = insert(buffer);
+    if ( NULL != slot ) {
+        store(*slot, buffer, group, count, true);
+    }
+}
+
+int FrameRefTable::release(const void* buffer, int group, int* total)
+{
+    Slot* slot = find(buffer);
+    uint64_t word;
+    uint32_t generation;
+    int count;
+
+    if ( ( NULL == slot ) || ( 0 > group ) || ( MAX_GROUPS <= group ) ) {
+        return -1;
+    }
+
+    word = __atomic_load_n(&slot->counts[group], __ATOMIC_ACQUIRE);
+    do {
+        generation = generationOf(word);
+        count = valueOf(word);
+        // find() may have returned the slot just before another buffer got it
+        if ( ( 0 >= count ) || ( buffer != __atomic_load_n(&slot->buffer, __ATOMIC_ACQUIRE) ) ) {
+            return -1;
+        }
+    } while ( !__atomic_compare_exchange_n(&slot->counts[group], &word,
+                                           pack(generation, count - 1), true,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) );
+
+    // exactly one of several concurrent releases sees the sum drop to zero,
+    // none if the group was cleared and the slot reused in between
+    if ( !addTotal(*slot, generation, -1, total) ) {
+        return -1;
+    }
+
+    return count - 1;
+}
+
+void FrameRefTable::clear(int group)
+{
+    android::AutoMutex lock(mLock);
+
+    if ( ( 0 > group ) || ( MAX_GROUPS <= group ) ) {
+        return;
+    }
+
+    for ( int i = 0; i < MAX_SLOTS; i++ ) {
+        if ( NULL != mSlots[i].buffer ) {
+            store(mSlots[i], mSlots[i].buffer, group, -1, true);
+        }
+    }
+}
+
+int FrameRefTable::buffers(int group, const void** buffers, int max) const
+{
+    int found = 0;
+
+    if ( ( 0 > group ) || ( MAX_GROUPS <= group ) ) {
+        return 0;
+    }
+
+    for ( int i = 0; ( i < MAX_SLOTS ) && ( found < max ); i++ ) {
+        const void* key = __atomic_load_n(&mSlots[i].buffer, __ATOMIC_ACQUIRE);
+
+        if ( ( NULL != key ) &&
+             ( 0 <= valueOf(__atomic_load_n(&mSlots[i].counts[group], __ATOMIC_ACQUIRE)) ) ) {
+            buffers[found++] = key;
+        }
+    }
+
+    return found;
+}
+
+void FrameRefTable::setCookie(const void* buffer, void* cookie)
+{
+    android::AutoMutex lock(mLock);
+    Slot* slot = ( NULL != buffer ) ? insert(buffer) : NULL;
+
+    if ( NULL != slot ) {
+        __atomic_store_n(&slot->cookie, cookie, __ATOMIC_RELEASE);
+    }
+}
+
+void* FrameRefTable::cookie(const void* buffer) const
+{
+    const Slot* slot = find(buffer);
+
+    if ( NULL == slot ) {
+        return NULL;
+    }
+
+    return __atomic_load_n(&slot->cookie, __ATOMIC_ACQUIRE);
+}
+
+void FrameRefTable::clearCookies()
+{
+    android::AutoMutex lock(mLock);
+
+    for ( int i = 0; i < MAX_SLOTS; i++ ) {
+        __atomic_store_n(&mSlots[i].cookie, (void*) NULL, __ATOMIC_RELEASE);
+    }
+}
+
+} // namespace Camera
+} // namespace Ti
@@ -16,268 +16,536 @@
 
 #include "NV12_resize.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ARCH_ARM_HAVE_NEON) || defined(__ARM_NEON__)
+#define NV12_RESIZE_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#define NV12_RESIZE_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
 #define LOG_TAG "NV12_resize"
 
-#define STRIDE 4096
+namespace Ti {
+namespace Camera {
 
-/*==========================================================================
-* Function Name  : VT_resizeFrame_Video_opt2_lp
-*
-* Description    : Resize a yuv frame.
-*
-* Input(s)       : input_img_ptr        -> Input Image Structure
-*                : output_img_ptr       -> Output Image Structure
-*                : cropout              -> crop structure
-*
-* Value Returned : bool                 -> FALSE on error TRUE on success
-* NOTE:
-*            Not tested for crop funtionallity.
-*            faster version.
-============================================================================*/
-bool
-VT_resizeFrame_Video_opt2_lp(
-        structConvImage* i_img_ptr, /* Points to the input image            */
-        structConvImage* o_img_ptr, /* Points to the output image           */
-        IC_rect_type*    cropout    /* how much to resize to in final image */
-        ) {
-    LOG_FUNCTION_NAME;
+/* Bilinear weights have 7 fractional bits so that a weighted pair of
+ * samples still fits into 16 bits for the SIMD kernels */
+#define WEIGHT_BITS   7
+#define WEIGHT_ONE    (1 << WEIGHT_BITS)
+#define WEIGHT_ROUND  (1 << (WEIGHT_BITS - 1))
 
-    uint16_t row,col;
-    uint32_t resizeFactorX;
-    uint32_t resizeFactorY;
-
-    uint16_t x, y;
-
-    uint8_t* ptr8;
-    uint8_t* ptr8Cb;
-    uint8_t* ptr8Cr;
-
-    uint16_t xf, yf;
-    uint8_t* inImgPtrY;
-    uint8_t* inImgPtrU;
-    uint8_t* inImgPtrV;
-    uint32_t cox, coy, codx, cody;
-    uint16_t idx, idy, idxC;
-
-    if ( i_img_ptr->uWidth == o_img_ptr->uWidth ) {
-        if ( i_img_ptr->uHeight == o_img_ptr->uHeight ) {
-            CAMHAL_LOGV("************************f(i_img_ptr->uHeight == o_img_ptr->uHeight) are same *********************\n");
-            CAMHAL_LOGV("************************(i_img_ptr->width == %d" , i_img_ptr->uWidth );
-            CAMHAL_LOGV("************************(i_img_ptr->uHeight == %d" , i_img_ptr->uHeight );
-            CAMHAL_LOGV("************************(o_img_ptr->width == %d" ,o_img_ptr->uWidth );
-            CAMHAL_LOGV("************************(o_img_ptr->uHeight == %d" , o_img_ptr->uHeight );
-        }
+/* Box filter divides through a 24 bit reciprocal */
+#define RECIP_BITS    24
+
+/* Below this many destination pixels a resize is not worth splitting */
+#define MIN_PARALLEL_PIXELS (160 * 120)
+
+struct RowKernels {
+    /* dst[i] = (r0[i] * (WEIGHT_ONE - f) + r1[i] * f + WEIGHT_ROUND) >> WEIGHT_BITS */
+    void (*lerp)(uint8_t* dst, const uint8_t* r0, const uint8_t* r1, int n, int f);
+    /* acc[i] += src[i] */
+    void (*accumulate)(uint32_t* acc, const uint8_t* src, int n);
+};
+
+/*--------------------Scalar kernels-----------------------------*/
+
+static void lerp_scalar(uint8_t* dst, const uint8_t* r0, const uint8_t* r1, int n, int f) {
+    const int f0 = WEIGHT_ONE - f;
+
+    for ( int i = 0; i < n; i++ ) {
+        dst[i] = (uint8_t)((r0[i] * f0 + r1[i] * f + WEIGHT_ROUND) >> WEIGHT_BITS);
     }
+}
 
-    if ( !i_img_ptr || !i_img_ptr->imgPtr || !o_img_ptr || !o_img_ptr->imgPtr ) {
-        CAMHAL_LOGE("Image Point NULL");
-        return false;
+static void accumulate_scalar(uint32_t* acc, const uint8_t* src, int n) {
+    for ( int i = 0; i < n; i++ ) {
+        acc[i] += src[i];
     }
+}
 
-    inImgPtrY = (uint8_t*)i_img_ptr->imgPtr + i_img_ptr->uOffset;
-    inImgPtrU = (uint8_t*)i_img_ptr->clrPtr + i_img_ptr->uOffset / 2;
-    inImgPtrV = (uint8_t*)inImgPtrU + 1;
-
-    if ( cropout != nullptr ) {
-        cox = 0;
-        coy = 0;
-        codx = o_img_ptr->uWidth;
-        cody = o_img_ptr->uHeight;
-    } else {
-        cox = cropout->x;
-        coy = cropout->y;
-        codx = cropout->uWidth;
-        cody = cropout->uHeight;
+static const RowKernels kScalarKernels = { lerp_scalar, accumulate_scalar };
+
+/*--------------------NEON kernels-----------------------------*/
+
+#ifdef NV12_RESIZE_HAVE_NEON
+static void lerp_neon(uint8_t* dst, const uint8_t* r0, const uint8_t* r1, int n, int f) {
+    const uint8x8_t w0 = vdup_n_u8((uint8_t)(WEIGHT_ONE - f));
+    const uint8x8_t w1 = vdup_n_u8((uint8_t)f);
+    int i = 0;
+
+    for ( ; i + 16 <= n; i += 16 ) {
+        uint8x16_t a = vld1q_u8(r0 + i);
+        uint8x16_t b = vld1q_u8(r1 + i);
+        uint16x8_t lo = vmull_u8(vget_low_u8(a), w0);
+        uint16x8_t hi = vmull_u8(vget_high_u8(a), w0);
+        lo = vmlal_u8(lo, vget_low_u8(b), w1);
+        hi = vmlal_u8(hi, vget_high_u8(b), w1);
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, WEIGHT_BITS),
+                                      vrshrn_n_u16(hi, WEIGHT_BITS)));
     }
-    idx = i_img_ptr->uWidth;
-    idy = i_img_ptr->uHeight;
 
-    /* make sure valid input size */
-    if ( idx < 1 || idy < 1 || i_img_ptr->uStride < 1 ) {
-        CAMHAL_LOGE("idx or idy less then 1 idx = %d idy = %d stride = %d", idx, idy, i_img_ptr->uStride);
-        return false;
+    lerp_scalar(dst + i, r0 + i, r1 + i, n - i, f);
+}
+
+static void accumulate_neon(uint32_t* acc, const uint8_t* src, int n) {
+    int i = 0;
+
+    for ( ; i + 16 <= n; i += 16 ) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(s));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(s));
+        vst1q_u32(acc + i,      vaddw_u16(vld1q_u32(acc + i),      vget_low_u16(lo)));
+        vst1q_u32(acc + i + 4,  vaddw_u16(vld1q_u32(acc + i + 4),  vget_high_u16(lo)));
+        vst1q_u32(acc + i + 8,  vaddw_u16(vld1q_u32(acc + i + 8),  vget_low_u16(hi)));
+        vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
     }
 
-    resizeFactorX = ((idx - 1) << 9) / codx;
-    resizeFactorY = ((idy - 1) << 9) / cody;
-
-    ptr8 = (uint8_t*)o_img_ptr->imgPtr + cox + coy * o_img_ptr->uWidth;
-
-    ////////////////////////////for Y//////////////////////////
-    for ( row = 0; row < cody; row++ ) {
-        uint8_t* pu8Yrow1 = NULL;
-        uint8_t* pu8Yrow2 = NULL;
-        y  = (uint16_t) ((uint32_t) (row * resizeFactorY) >> 9);
-        yf = (uint8_t)  ((uint32_t)((row * resizeFactorY) >> 6) & 0x7);
-        pu8Yrow1 = inImgPtrY + (y) * i_img_ptr->uStride;
-        pu8Yrow2 = pu8Yrow1 + i_img_ptr->uStride;
-
-        for ( col = 0; col < codx; col++ ) {
-            uint8_t in11, in12, in21, in22;
-            uint8_t* pu8ptr1 = NULL;
-            uint8_t* pu8ptr2 = NULL;
-            uint8_t w;
-            uint16_t accum_1;
-            //uint32_t accum_W;
-
-            x  = (uint16_t) ((uint32_t)  (col * resizeFactorX) >> 9);
-            xf = (uint8_t)  ((uint32_t) ((col * resizeFactorX) >> 6) & 0x7);
-
-            //accum_W = 0;
-            accum_1 =  0;
-
-            pu8ptr1 = pu8Yrow1 + (x);
-            pu8ptr2 = pu8Yrow2 + (x);
-
-            /* A pixel */
-            //in = *(inImgPtrY + (y) * idx + (x));
-            in11 = *(pu8ptr1);
-
-            w = bWeights[xf][yf][0];
-            accum_1 = (w * in11);
-            //accum_W += (w);
-
-            /* B pixel */
-            //in = *(inImgPtrY + (y) * idx + (x + 1));
-            in12 = *(pu8ptr1 + 1);
-            w = bWeights[xf][yf][1];
-            accum_1 += (w * in12);
-            //accum_W += (w);
-
-            /* C pixel */
-            //in = *(inImgPtrY + (y + 1) * idx + (x));
-            in21 = *(pu8ptr2);
-            w = bWeights[xf][yf][3];
-            accum_1 += (w * in21);
-            //accum_W += (w);
-
-            /* D pixel */
-            //in = *(inImgPtrY + (y + 1) * idx + (x + 1));
-            in22 = *(pu8ptr2 + 1);
-            w = bWeights[xf][yf][2];
-            accum_1 += (w * in22);
-            //accum_W += (w);
-
-            /* divide by sum of the weights */
-            //accum_1 /= (accum_W);
-            //accum_1 = (accum_1 / 64);
-            accum_1 = (accum_1 >> 6);
-            *ptr8 = (uint8_t)accum_1 ;
-
-            ptr8++;
-        }
-        ptr8 = ptr8 + (o_img_ptr->uStride - codx);
+    accumulate_scalar(acc + i, src + i, n - i);
+}
+
+static const RowKernels kNeonKernels = { lerp_neon, accumulate_neon };
+#endif
+
+/*--------------------SSE2 kernels-----------------------------*/
+
+#ifdef NV12_RESIZE_HAVE_SSE2
+static void lerp_sse2(uint8_t* dst, const uint8_t* r0, const uint8_t* r1, int n, int f) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w0 = _mm_set1_epi16((short)(WEIGHT_ONE - f));
+    const __m128i w1 = _mm_set1_epi16((short)f);
+    const __m128i round = _mm_set1_epi16(WEIGHT_ROUND);
+    int i = 0;
+
+    for ( ; i + 16 <= n; i += 16 ) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(r0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(r1 + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), WEIGHT_BITS);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), WEIGHT_BITS);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
     }
-    ////////////////////////////for Y//////////////////////////
 
-    ///////////////////////////////for Cb-Cr//////////////////////
+    lerp_scalar(dst + i, r0 + i, r1 + i, n - i, f);
+}
 
-    ptr8Cb = (uint8_t*)o_img_ptr->clrPtr + cox + coy * o_img_ptr->uWidth;
+static void accumulate_sse2(uint32_t* acc, const uint8_t* src, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for ( ; i + 16 <= n; i += 16 ) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(s, zero);
+        __m128i hi = _mm_unpackhi_epi8(s, zero);
+        __m128i* a = (__m128i*)(acc + i);
+        _mm_storeu_si128(a,     _mm_add_epi32(_mm_loadu_si128(a),     _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
 
-    ptr8Cr = (uint8_t*)(ptr8Cb + 1);
+    accumulate_scalar(acc + i, src + i, n - i);
+}
 
-    idxC = (idx >> 1);
-    for ( row = 0; row < (cody >> 1); row++ ) {
-        uint8_t* pu8Cbr1 = NULL;
-        uint8_t* pu8Cbr2 = NULL;
-        uint8_t* pu8Crr1 = NULL;
-        uint8_t* pu8Crr2 = NULL;
+static const RowKernels kSse2Kernels = { lerp_sse2, accumulate_sse2 };
+#endif
 
-        y  = (uint16_t) ((uint32_t) (row * resizeFactorY) >> 9);
-        yf = (uint8_t)  ((uint32_t)((row * resizeFactorY) >> 6) & 0x7);
+static const RowKernels* kernelsFor(NV12ResizeKernel kernel) {
+    switch ( kernel ) {
+        case NV12_RESIZE_KERNEL_SCALAR:
+            return &kScalarKernels;
+#ifdef NV12_RESIZE_HAVE_NEON
+        case NV12_RESIZE_KERNEL_NEON:
+            return &kNeonKernels;
+#endif
+#ifdef NV12_RESIZE_HAVE_SSE2
+        case NV12_RESIZE_KERNEL_SSE2:
+            return &kSse2Kernels;
+#endif
+        case NV12_RESIZE_KERNEL_AUTO:
+#if defined(NV12_RESIZE_HAVE_NEON)
+            return &kNeonKernels;
+#elif defined(NV12_RESIZE_HAVE_SSE2)
+            return &kSse2Kernels;
+#else
+            return &kScalarKernels;
+#endif
+        default:
+            return NULL;
+    }
+}
 
-        pu8Cbr1 = inImgPtrU + (y) * i_img_ptr->uStride;
-        pu8Cbr2 = pu8Cbr1 + i_img_ptr->uStride;
-        pu8Crr1 = inImgPtrV + (y) * i_img_ptr->uStride;
-        pu8Crr2 = pu8Crr1 + i_img_ptr->uStride;
+/*--------------------Sample position tables-----------------------------*/
+
+/* One axis of the scaling operation. For a destination index i:
+ *  nearest:  i0 is the source sample
+ *  bilinear: i0/i1 are the neighbouring samples, w the weight of i1
+ *  box:      [i0, i1) is the source footprint, w is its reciprocal */
+struct AxisMap {
+    int i0;
+    int i1;
+    int w;
+};
+
+static void buildAxis(AxisMap* map, int dst_len, int src_len, NV12ResizeFilter filter) {
+    for ( int i = 0; i < dst_len; i++ ) {
+        AxisMap& m = map[i];
+
+        switch ( filter ) {
+            case NV12_RESIZE_FILTER_NEAREST: {
+                int s = (int)(((int64_t)(2 * i + 1) * src_len) / (2 * dst_len));
+                m.i0 = (s < src_len) ? s : src_len - 1;
+                m.i1 = m.i0;
+                m.w = 0;
+                break;
+            }
+            case NV12_RESIZE_FILTER_BILINEAR: {
+                // sample centres are aligned, position in 16.16 fixed point
+                int64_t pos = (((int64_t)(2 * i + 1) * src_len) << 16) / (2 * dst_len) - (1 << 15);
+                if ( pos < 0 ) {
+                    pos = 0;
+                }
+                m.i0 = (int)(pos >> 16);
+                m.w = (int)((pos >> (16 - WEIGHT_BITS)) & (WEIGHT_ONE - 1));
+                if ( m.i0 >= src_len - 1 ) {
+                    m.i0 = src_len - 1;
+                    m.w = 0;
+                }
+                m.i1 = (m.i0 + 1 < src_len) ? m.i0 + 1 : m.i0;
+                break;
+            }
+            case NV12_RESIZE_FILTER_BOX:
+            default: {
+                m.i0 = (int)(((int64_t)i * src_len) / dst_len);
+                m.i1 = (int)(((int64_t)(i + 1) * src_len) / dst_len);
+                if ( m.i1 <= m.i0 ) {
+                    m.i1 = m.i0 + 1;
+                }
+                if ( m.i1 > src_len ) {
+                    m.i1 = src_len;
+                }
+                m.w = m.i1 - m.i0;
+                break;
+            }
+        }
+    }
+}
 
-        for ( col = 0; col < (codx >> 1); col++ ) {
-            uint8_t in11, in12, in21, in22;
-            uint8_t* pu8Cbc1 = NULL;
-            uint8_t* pu8Cbc2 = NULL;
-            uint8_t* pu8Crc1 = NULL;
-            uint8_t* pu8Crc2 = NULL;
+/*--------------------Band processing-----------------------------*/
+
+struct ResizeJob {
+    const RowKernels* kernels;
+    NV12ResizeFilter filter;
+
+    const uint8_t* srcY;
+    const uint8_t* srcUV;
+    int srcYStride;
+    int srcUVStride;
+    int srcWidth;           /* luma samples */
+    int srcChromaBytes;     /* CbCr bytes per row, odd widths round up */
+
+    uint8_t* dstY;
+    uint8_t* dstUV;
+    int dstYStride;
+    int dstUVStride;
+    int dstWidth;
+    int dstHeight;
+    int dstChromaWidth;     /* CbCr pairs per row, odd widths round up */
+
+    const AxisMap* colsY;
+    const AxisMap* rowsY;
+    const AxisMap* colsC;
+    const AxisMap* rowsC;
+
+    int chromaRows;         /* destination chroma rows, odd heights round up */
+    int bands;
+};
+
+/* Builds one destination row from a (vertically filtered) source row.
+ * step is 1 for luma and 2 for interleaved CbCr. */
+static void horizontalRow(const ResizeJob& job, uint8_t* dst, const uint8_t* src,
+                          const uint32_t* acc, const AxisMap* cols, int count,
+                          int step, uint32_t row_span) {
+    switch ( job.filter ) {
+        case NV12_RESIZE_FILTER_NEAREST:
+            if ( 1 == step ) {
+                for ( int i = 0; i < count; i++ ) {
+                    dst[i] = src[cols[i].i0];
+                }
+            } else {
+                for ( int i = 0; i < count; i++ ) {
+                    const uint8_t* s = src + 2 * cols[i].i0;
+                    dst[2 * i]     = s[0];
+                    dst[2 * i + 1] = s[1];
+                }
+            }
+            break;
+
+        case NV12_RESIZE_FILTER_BILINEAR:
+            for ( int i = 0; i < count; i++ ) {
+                const int w1 = cols[i].w;
+                const int w0 = WEIGHT_ONE - w1;
+                const uint8_t* a = src + step * cols[i].i0;
+                const uint8_t* b = src + step * cols[i].i1;
+                for ( int c = 0; c < step; c++ ) {
+                    dst[step * i + c] = (uint8_t)((a[c] * w0 + b[c] * w1 + WEIGHT_ROUND) >> WEIGHT_BITS);
+                }
+            }
+            break;
+
+        case NV12_RESIZE_FILTER_BOX:
+        default:
+            for ( int i = 0; i < count; i++ ) {
+                const uint32_t area = row_span * (uint32_t)cols[i].w;
+                const uint64_t recip = (((uint64_t)1 << RECIP_BITS) + area / 2) / area;
+                for ( int c = 0; c < step; c++ ) {
+                    uint32_t sum = 0;
+                    for ( int x = cols[i].i0; x < cols[i].i1; x++ ) {
+                        sum += acc[step * x + c];
+                    }
+                    uint32_t v = (uint32_t)((sum * recip + ((uint64_t)1 << (RECIP_BITS - 1))) >> RECIP_BITS);
+                    dst[step * i + c] = (uint8_t)((v > 255) ? 255 : v);
+                }
+            }
+            break;
+    }
+}
 
-            uint8_t w;
-            uint16_t accum_1Cb, accum_1Cr;
-            //uint32_t accum_WCb, accum_WCr;
+/* Vertical pass over width source bytes for one destination row, followed
+ * by the horizontal pass */
+static void resizeRow(const ResizeJob& job, uint8_t* dst, const uint8_t* src, int src_stride,
+                      int width, const AxisMap& row, const AxisMap* cols, int count, int step,
+                      uint8_t* line, uint32_t* acc) {
+    const uint8_t* r0 = src + row.i0 * src_stride;
+
+    switch ( job.filter ) {
+        case NV12_RESIZE_FILTER_NEAREST:
+            horizontalRow(job, dst, r0, NULL, cols, count, step, 1);
+            break;
+
+        case NV12_RESIZE_FILTER_BILINEAR:
+            if ( 0 != row.w ) {
+                job.kernels->lerp(line, r0, src + row.i1 * src_stride, width, row.w);
+                r0 = line;
+            }
+            horizontalRow(job, dst, r0, NULL, cols, count, step, 1);
+            break;
+
+        case NV12_RESIZE_FILTER_BOX:
+        default:
+            memset(acc, 0, width * sizeof(uint32_t));
+            for ( int y = row.i0; y < row.i1; y++ ) {
+                job.kernels->accumulate(acc, src + y * src_stride, width);
+            }
+            horizontalRow(job, dst, NULL, acc, cols, count, step, (uint32_t)row.w);
+            break;
+    }
+}
 
-            x  = (uint16_t) ((uint32_t)  (col * resizeFactorX) >> 9);
-            xf = (uint8_t)  ((uint32_t) ((col * resizeFactorX) >> 6) & 0x7);
+static void resizeBand(void* arg, int band) {
+    const ResizeJob& job = *static_cast<const ResizeJob*>(arg);
+    const int c0 = (int)(((int64_t)band * job.chromaRows) / job.bands);
+    const int c1 = (int)(((int64_t)(band + 1) * job.chromaRows) / job.bands);
+    const int y1 = (2 * c1 < job.dstHeight) ? 2 * c1 : job.dstHeight;
+    uint8_t* line = NULL;
+    uint32_t* acc = NULL;
 
-            //accum_WCb = accum_WCr =  0;
-            accum_1Cb = accum_1Cr =  0;
+    if ( c0 >= c1 ) {
+        return;
+    }
 
-            pu8Cbc1 = pu8Cbr1 + (x * 2);
-            pu8Cbc2 = pu8Cbr2 + (x * 2);
-            pu8Crc1 = pu8Crr1 + (x * 2);
-            pu8Crc2 = pu8Crr2 + (x * 2);
+    if ( NV12_RESIZE_FILTER_BILINEAR == job.filter ) {
+        line = (uint8_t*)malloc(job.srcChromaBytes);
+        if ( NULL == line ) {
+            CAMHAL_LOGEA("Out of memory for resize line buffer");
+            return;
+        }
+    } else if ( NV12_RESIZE_FILTER_BOX == job.filter ) {
+        acc = (uint32_t*)malloc(job.srcChromaBytes * sizeof(uint32_t));
+        if ( NULL == acc ) {
+            CAMHAL_LOGEA("Out of memory for resize accumulator");
+            return;
+        }
+    }
 
-            /* A pixel */
-            w = bWeights[xf][yf][0];
+    // the last band of an odd height ends with a luma row of its own
+    for ( int y = 2 * c0; y < y1; y++ ) {
+        resizeRow(job, job.dstY + y * job.dstYStride, job.srcY, job.srcYStride, job.srcWidth,
+                  job.rowsY[y], job.colsY, job.dstWidth, 1, line, acc);
+    }
 
-            in11 = *(pu8Cbc1);
-            accum_1Cb = (w * in11);
-            //accum_WCb += (w);
+    for ( int y = c0; y < c1; y++ ) {
+        resizeRow(job, job.dstUV + y * job.dstUVStride, job.srcUV, job.srcUVStride,
+                  job.srcChromaBytes, job.rowsC[y], job.colsC, job.dstChromaWidth, 2,
+                  line, acc);
+    }
 
-            in11 = *(pu8Crc1);
-            accum_1Cr = (w * in11);
-            //accum_WCr += (w);
+    free(line);
+    free(acc);
+}
 
-            /* B pixel */
-            w = bWeights[xf][yf][1];
+/* Odd sizes are allowed, the last CbCr pair then covers a single column
+ * and the last chroma row a single luma row */
+static bool isValidRect(const NV12Rect& rect, const NV12Image& img) {
+    return (rect.x >= 0) && (rect.y >= 0) &&
+           (rect.width >= 2) && (rect.height >= 2) &&
+           !(rect.x & 1) && !(rect.y & 1) &&
+           (rect.x + rect.width <= img.width) && (rect.y + rect.height <= img.height);
+}
+
+static bool isValidImage(const NV12Image& img) {
+    return img.y && img.uv &&
+           (img.width >= 2) && (img.height >= 2) &&
+           (img.yStride >= img.width) && (img.uvStride >= ((img.width + 1) & ~1));
+}
 
-            in12 = *(pu8Cbc1 + 2);
-            accum_1Cb += (w * in12);
-            //accum_WCb += (w);
+/*--------------------NV12Resizer Class STARTS here-----------------------------*/
 
-            in12 = *(pu8Crc1 + 2);
-            accum_1Cr += (w * in12);
-            //accum_WCr += (w);
+NV12Resizer::NV12Resizer(int threads)
+    : mKernel(NV12_RESIZE_KERNEL_AUTO), mWorkers(&mOwnWorkers) {
+    if ( threads < 0 ) {
+        mWorkers = &Utils::WorkerPool::shared();
+    } else if ( 0 < threads ) {
+        mOwnWorkers.start(threads);
+    }
+}
+
+NV12Resizer::~NV12Resizer() {
+    mOwnWorkers.stop();
+}
+
+NV12Resizer& NV12Resizer::instance() {
+    static NV12Resizer sResizer;
+    return sResizer;
+}
 
-            /* C pixel */
-            w = bWeights[xf][yf][3];
+bool NV12Resizer::isKernelAvailable(NV12ResizeKernel kernel) {
+    return NULL != kernelsFor(kernel);
+}
 
-            in21 = *(pu8Cbc2);
-            accum_1Cb += (w * in21);
-            //accum_WCb += (w);
+status_t NV12Resizer::setKernel(NV12ResizeKernel kernel) {
+    if ( !isKernelAvailable(kernel) ) {
+        return BAD_VALUE;
+    }
 
-            in21 = *(pu8Crc2);
-            accum_1Cr += (w * in21);
-            //accum_WCr += (w);
+    mKernel = kernel;
+    return NO_ERROR;
+}
 
-            /* D pixel */
-            w = bWeights[xf][yf][2];
+NV12ResizeKernel NV12Resizer::kernel() const {
+    return mKernel;
+}
 
-            in22 = *(pu8Cbc2 + 2);
-            accum_1Cb += (w * in22);
-            //accum_WCb += (w);
+/*==========================================================================
+* Function Name  : NV12Resizer::resize
+*
+* Description    : Scale the src_crop region of src into the dst_rect
+*                  region of dst. Pixels of dst outside of dst_rect are
+*                  left untouched.
+*
+* Input(s)       : src                  -> Input Image
+*                : src_crop             -> Source region, NULL for all
+*                : dst                  -> Output Image
+*                : dst_rect             -> Destination region, NULL for all
+*                : filter               -> Scaling filter
+*
+* Value Returned : NO_ERROR on success, BAD_VALUE or NO_MEMORY on error
+============================================================================*/
+status_t NV12Resizer::resize(const NV12Image& src, const NV12Rect* src_crop,
+                             const NV12Image& dst, const NV12Rect* dst_rect,
+                             NV12ResizeFilter filter) {
+    LOG_FUNCTION_NAME;
 
-            in22 = *(pu8Crc2 + 2);
-            accum_1Cr += (w * in22);
-            //accum_WCr += (w);
+    NV12Rect sr = { 0, 0, src.width, src.height };
+    NV12Rect dr = { 0, 0, dst.width, dst.height };
+    ResizeJob job;
+    AxisMap* maps = NULL;
+    status_t ret = NO_ERROR;
+
+    if ( !isValidImage(src) || !isValidImage(dst) ) {
+        CAMHAL_LOGEB("Invalid image src %dx%d (%d/%d) dst %dx%d (%d/%d)",
+                     src.width, src.height, src.yStride, src.uvStride,
+                     dst.width, dst.height, dst.yStride, dst.uvStride);
+        return BAD_VALUE;
+    }
 
-            /* divide by sum of the weights */
-            //accum_1Cb /= (accum_WCb);
-            accum_1Cb = (accum_1Cb >> 6);
-            *ptr8Cb = (uint8_t)accum_1Cb ;
+    if ( src_crop ) {
+        sr = *src_crop;
+    }
+    if ( dst_rect ) {
+        dr = *dst_rect;
+    }
 
-            accum_1Cr = (accum_1Cr >> 6);
-            *ptr8Cr = (uint8_t)accum_1Cr ;
+    if ( !isValidRect(sr, src) || !isValidRect(dr, dst) ) {
+        CAMHAL_LOGEB("Invalid rect src (%d,%d %dx%d) dst (%d,%d %dx%d)",
+                     sr.x, sr.y, sr.width, sr.height,
+                     dr.x, dr.y, dr.width, dr.height);
+        return BAD_VALUE;
+    }
 
-            ptr8Cb++;
-            ptr8Cr++;
+    job.kernels = kernelsFor(mKernel);
+    job.filter = filter;
+
+    job.srcY = src.y + sr.y * src.yStride + sr.x;
+    job.srcUV = src.uv + (sr.y / 2) * src.uvStride + sr.x;
+    job.srcYStride = src.yStride;
+    job.srcUVStride = src.uvStride;
+    job.srcWidth = sr.width;
+    job.srcChromaBytes = 2 * ((sr.width + 1) / 2);
+
+    job.dstY = dst.y + dr.y * dst.yStride + dr.x;
+    job.dstUV = dst.uv + (dr.y / 2) * dst.uvStride + dr.x;
+    job.dstYStride = dst.yStride;
+    job.dstUVStride = dst.uvStride;
+    job.dstWidth = dr.width;
+    job.dstHeight = dr.height;
+    job.dstChromaWidth = (dr.width + 1) / 2;
+    job.chromaRows = (dr.height + 1) / 2;
+
+    maps = (AxisMap*)malloc(sizeof(AxisMap) *
+                            (dr.width + dr.height + job.dstChromaWidth + job.chromaRows));
+    if ( NULL == maps ) {
+        CAMHAL_LOGEA("Out of memory for resize tables");
+        return NO_MEMORY;
+    }
 
-            ptr8Cb++;
-            ptr8Cr++;
+    job.colsY = maps;
+    job.rowsY = job.colsY + dr.width;
+    job.colsC = job.rowsY + dr.height;
+    job.rowsC = job.colsC + job.dstChromaWidth;
+
+    buildAxis((AxisMap*)job.colsY, dr.width, sr.width, filter);
+    buildAxis((AxisMap*)job.rowsY, dr.height, sr.height, filter);
+    buildAxis((AxisMap*)job.colsC, job.dstChromaWidth, (sr.width + 1) / 2, filter);
+    buildAxis((AxisMap*)job.rowsC, job.chromaRows, (sr.height + 1) / 2, filter);
+
+    job.bands = 1;
+    if ( dr.width * dr.height >= MIN_PARALLEL_PIXELS ) {
+        job.bands = mWorkers->concurrency();
+        if ( job.bands > job.chromaRows ) {
+            job.bands = job.chromaRows;
         }
-        ptr8Cb = ptr8Cb + (o_img_ptr->uStride - codx);
-        ptr8Cr = ptr8Cr + (o_img_ptr->uStride - codx);
     }
-    ///////////////////For Cb- Cr////////////////////////////////////////
 
-    return true;
+    ret = mWorkers->run(resizeBand, &job, job.bands);
+
+    free(maps);
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
 }
+
+} // namespace Camera
+} // namespace Ti
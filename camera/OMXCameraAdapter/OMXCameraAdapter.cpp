@@ -1879,10 +1879,7 @@ status_t OMXCameraAdapter::switchToLoaded(bool bPortEnableRequired) {
                 GOTO_EXIT_IF((eError!=OMX_ErrorNone), eError);
             }
 
-            {
-                android::AutoMutex lock(mPreviewDataBufferLock);
-                mPreviewDataBuffersAvailable.clear();
-            }
+            clearFrameRefCounts(CameraFrame::FRAME_DATA_SYNC);
 
         }
     }
@@ -1921,11 +1918,8 @@ status_t OMXCameraAdapter::switchToLoaded(bool bPortEnableRequired) {
 
 EXIT:
     CAMHAL_LOGEB("Exiting function %s because of ret %d eError=%x", __FUNCTION__, ret, eError);
-    {
-        android::AutoMutex lock(mPreviewBufferLock);
-        ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
-    }
+    ///Clear all the available preview buffers
+    clearFrameRefCounts(CameraFrame::PREVIEW_FRAME_SYNC);
     performCleanupAfterError();
     LOG_FUNCTION_NAME_EXIT;
     return (ret | Utils::ErrorUtils::omxToAndroidError(eError));
@@ -2470,11 +2464,8 @@ status_t OMXCameraAdapter::destroyTunnel()
 
 EXIT:
     CAMHAL_LOGEB("Exiting function %s because of ret %d eError=%x", __FUNCTION__, ret, eError);
-    {
-        android::AutoMutex lock(mPreviewBufferLock);
-        ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
-    }
+    ///Clear all the available preview buffers
+    clearFrameRefCounts(CameraFrame::PREVIEW_FRAME_SYNC);
     performCleanupAfterError();
     LOG_FUNCTION_NAME_EXIT;
     return (ret | Utils::ErrorUtils::omxToAndroidError(eError));
@@ -2504,11 +2495,8 @@ status_t OMXCameraAdapter::stopPreview() {
 
     mTunnelDestroyed = false;
 
-    {
-        android::AutoMutex lock(mPreviewBufferLock);
-        ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
-    }
+    ///Clear all the available preview buffers
+    clearFrameRefCounts(CameraFrame::PREVIEW_FRAME_SYNC);
 
     switchToLoaded();
 
@@ -3533,7 +3521,7 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
         if (mRecording)
             {
             mask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-            mFramesWithEncoder++;
+            __atomic_add_fetch(&mFramesWithEncoder, 1, __ATOMIC_RELAXED);
             }
 
         //CAMHAL_LOGV("FBD pBuffer = 0x%x", pBuffHeader->pBuffer);
@@ -3550,7 +3538,7 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
             }
 
         stat = sendCallBacks(cameraFrame, pBuffHeader, mask, pPortParam);
-        mFramesWithDisplay++;
+        __atomic_add_fetch(&mFramesWithDisplay, 1, __ATOMIC_RELAXED);
 
         mFramesWithDucati--;
 
@@ -16,70 +16,285 @@
 
 #include "Common.h"
 #include "SwFrameDecoder.h"
+#include "WorkerPool.h"
 
 namespace Ti {
 namespace Camera {
 
+// Output buffers are Tiler 2D buffers
+static const int kOutputStride = 4096;
+
 SwFrameDecoder::SwFrameDecoder()
-: mjpegWithHdrSize(0), mJpegWithHeaderBuffer(NULL) {
+: mThreadCount(0), mSequence(0), mExit(false), mDropped(0) {
 }
 
 SwFrameDecoder::~SwFrameDecoder() {
-    delete [] mJpegWithHeaderBuffer;
-    mJpegWithHeaderBuffer = NULL;
+    stopThreads();
 }
 
 
 void SwFrameDecoder::doConfigure(const DecoderParameters& params) {
     LOG_FUNCTION_NAME;
 
-    mjpegWithHdrSize = (mParams.width * mParams.height / 2) +
-            mJpgdecoder.readDHTSize();
-    if (mJpegWithHeaderBuffer != NULL) {
-        delete [] mJpegWithHeaderBuffer;
-        mJpegWithHeaderBuffer = NULL;
+    CAMHAL_LOGDB("MJPEG %dx%d, %d input and %d output buffers",
+                 params.width, params.height, params.inputBufferCount, params.outputBufferCount);
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+
+status_t SwFrameDecoder::doStart() {
+    LOG_FUNCTION_NAME;
+
+    int count = Utils::WorkerPool::onlineCpus();
+    if (count > MAX_DECODE_THREADS) {
+        count = MAX_DECODE_THREADS;
+    }
+    // keep at least one output buffer out of the decoder
+    if (count > mParams.outputBufferCount - 1) {
+        count = mParams.outputBufferCount - 1;
+    }
+    if (count < 1) {
+        count = 1;
+    }
+
+    mExit = false;
+    mSequence = 0;
+    mDropped = 0;
+    mThreadCount = 0;
+
+    for (int i = 0; i < count; i++) {
+        mThreads[i] = new DecodeThread(this, i);
+#ifdef ANDROID_API_N_OR_LATER
+        status_t ret = mThreads[i]->run("mjpeg_decoder");
+#else
+        status_t ret = mThreads[i]->run();
+#endif
+        if (ret != NO_ERROR) {
+            CAMHAL_LOGEB("Unable to start mjpeg decoder thread %d (%d)", i, ret);
+            mThreads[i].clear();
+            break;
+        }
+        mThreadCount++;
     }
-    mJpegWithHeaderBuffer = new unsigned char[mjpegWithHdrSize];
 
     LOG_FUNCTION_NAME_EXIT;
+
+    return mThreadCount ? NO_ERROR : NO_INIT;
 }
 
 
-void SwFrameDecoder::doProcessInputBuffer() {
+void SwFrameDecoder::doStop() {
     LOG_FUNCTION_NAME;
-    nsecs_t timestamp = 0;
 
-    CAMHAL_LOGV("Will add header to MJPEG");
-    int final_jpg_sz = 0;
     {
-        int inIndex = mInQueue.itemAt(0);
-        android::sp<MediaBuffer>& inBuffer = mInBuffers->editItemAt(inIndex);
-        android::AutoMutex lock(inBuffer->getLock());
-        timestamp = inBuffer->getTimestamp();
-        final_jpg_sz = mJpgdecoder.appendDHT(
-                reinterpret_cast<unsigned char*>(inBuffer->buffer),
-                inBuffer->filledLen, mJpegWithHeaderBuffer, mjpegWithHdrSize);
-        inBuffer->setStatus(BufferStatus_InDecoded);
-    }
-    CAMHAL_LOGV("Added header to MJPEG");
+        // frames in flight still own their buffers, let them complete
+        android::AutoMutex lock(mJobLock);
+        while (!mJobs.isEmpty() && mThreadCount) {
+            mDoneCond.wait(mJobLock);
+        }
+    }
+
+    stopThreads();
+
+    CAMHAL_LOGDB("MJPEG decoder stopped, %u frames dropped", mDropped);
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+
+void SwFrameDecoder::doFlush() {
+    // called with the FrameDecoder lock held, the queues are stable
+    android::AutoMutex lock(mJobLock);
+
+    // frames not started yet are dropped, the ones being decoded still
+    // write to their output buffer and have to complete first
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        if (mJobs[i].state == JobState_Queued) {
+            mJobs.editItemAt(i).state = JobState_Cancelled;
+        }
+    }
+    for (;;) {
+        size_t i;
+        for (i = 0; i < mJobs.size(); i++) {
+            if (mJobs[i].state == JobState_Running) {
+                break;
+            }
+        }
+        if (i == mJobs.size()) {
+            break;
+        }
+        mDoneCond.wait(mJobLock);
+    }
+    mJobs.clear();
+
+    // every buffer goes back to the caller
+    for (size_t i = 0; i < mInQueue.size(); i++) {
+        android::sp<MediaBuffer>& in = mInBuffers->editItemAt(mInQueue[i]);
+        android::AutoMutex bufferLock(in->getLock());
+        in->setStatus(BufferStatus_Unknown);
+    }
+    for (size_t i = 0; i < mOutQueue.size(); i++) {
+        android::sp<MediaBuffer>& out = mOutBuffers->editItemAt(mOutQueue[i]);
+        android::AutoMutex bufferLock(out->getLock());
+        out->setStatus(BufferStatus_Unknown);
+    }
+}
+
+
+void SwFrameDecoder::stopThreads() {
     {
-        int outIndex = mOutQueue.itemAt(0);
-        android::sp<MediaBuffer>& outBuffer = mOutBuffers->editItemAt(outIndex);
-        android::AutoMutex lock(outBuffer->getLock());
-        CameraBuffer* buffer = reinterpret_cast<CameraBuffer*>(outBuffer->buffer);
-        if (!mJpgdecoder.decode(mJpegWithHeaderBuffer, final_jpg_sz,
-                reinterpret_cast<unsigned char*>(buffer->mapped), 4096)) {
-            CAMHAL_LOGEA("Error while decoding JPEG");
+        android::AutoMutex lock(mJobLock);
+        mExit = true;
+        mJobCond.broadcast();
+    }
+
+    for (int i = 0; i < mThreadCount; i++) {
+        mThreads[i]->requestExitAndWait();
+        mThreads[i].clear();
+    }
+    mThreadCount = 0;
+}
+
+
+void SwFrameDecoder::doProcessInputBuffer() {
+    LOG_FUNCTION_NAME;
+    Job job;
+    int inIndex = -1;
+    int outIndex = -1;
+
+    // called with the FrameDecoder lock held, the queues are stable
+    for (size_t i = 0; i < mInQueue.size(); i++) {
+        android::sp<MediaBuffer>& in = mInBuffers->editItemAt(mInQueue[i]);
+        android::AutoMutex lock(in->getLock());
+        if (in->getStatus() == BufferStatus_InQueued) {
+            inIndex = mInQueue[i];
+            break;
+        }
+    }
+    if (inIndex < 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < mOutQueue.size(); i++) {
+        android::sp<MediaBuffer>& out = mOutBuffers->editItemAt(mOutQueue[i]);
+        android::AutoMutex lock(out->getLock());
+        if (out->getStatus() == BufferStatus_OutQueued) {
+            outIndex = mOutQueue[i];
+            out->setStatus(BufferStatus_OutWaitForFill);
+            job.dst = reinterpret_cast<unsigned char*>(
+                    reinterpret_cast<CameraBuffer*>(out->buffer)->mapped);
+            break;
+        }
+    }
+
+    {
+        android::sp<MediaBuffer>& in = mInBuffers->editItemAt(inIndex);
+        android::AutoMutex lock(in->getLock());
+        if (outIndex < 0) {
+            // every output buffer is busy, give the frame back right away
+            CAMHAL_LOGD("No free output buffer, dropping MJPEG frame");
+            in->setStatus(BufferStatus_InDecoded);
+            mDropped++;
             return;
         }
-        outBuffer->setTimestamp(timestamp);
-        outBuffer->setStatus(BufferStatus_OutFilled);
+        in->setStatus(BufferStatus_InWaitForEmpty);
+        job.src = reinterpret_cast<unsigned char*>(in->buffer);
+        job.filledLen = in->filledLen;
+        job.timestamp = in->getTimestamp();
+    }
+
+    job.inIndex = inIndex;
+    job.outIndex = outIndex;
+    job.state = JobState_Queued;
+    job.decoded = false;
+
+    {
+        android::AutoMutex lock(mJobLock);
+        job.sequence = mSequence++;
+        mJobs.push_back(job);
+        mJobCond.signal();
     }
-    CAMHAL_LOGV("JPEG decoded!");
 
     LOG_FUNCTION_NAME_EXIT;
 }
 
 
+bool SwFrameDecoder::decodeNext(int index) {
+    Job job;
+    size_t i;
+
+    {
+        android::AutoMutex lock(mJobLock);
+
+        for (;;) {
+            if (mExit) {
+                return false;
+            }
+            for (i = 0; i < mJobs.size(); i++) {
+                if (mJobs[i].state == JobState_Queued) {
+                    break;
+                }
+            }
+            if (i < mJobs.size()) {
+                break;
+            }
+            mJobCond.wait(mJobLock);
+        }
+
+        mJobs.editItemAt(i).state = JobState_Running;
+        job = mJobs[i];
+    }
+
+    bool decoded = mJpgdecoder[index].decode(job.src, job.filledLen, job.dst, kOutputStride);
+    if (!decoded) {
+        CAMHAL_LOGEA("Error while decoding JPEG");
+    }
+
+    {
+        android::sp<MediaBuffer>& in = mInBuffers->editItemAt(job.inIndex);
+        android::AutoMutex lock(in->getLock());
+        in->setStatus(BufferStatus_InDecoded);
+    }
+
+    {
+        android::AutoMutex lock(mJobLock);
+
+        for (i = 0; i < mJobs.size(); i++) {
+            if (mJobs[i].sequence == job.sequence) {
+                mJobs.editItemAt(i).state = JobState_Done;
+                mJobs.editItemAt(i).decoded = decoded;
+                break;
+            }
+        }
+
+        publishDecoded();
+        mDoneCond.broadcast();
+    }
+
+    return true;
+}
+
+
+/* Hands out the decoded frames at the head of the queue, called with
+ * mJobLock held */
+void SwFrameDecoder::publishDecoded() {
+    while (!mJobs.isEmpty() && (mJobs[0].state == JobState_Done)) {
+        const Job& job = mJobs[0];
+        android::sp<MediaBuffer>& out = mOutBuffers->editItemAt(job.outIndex);
+        android::AutoMutex lock(out->getLock());
+
+        if (job.decoded) {
+            out->setTimestamp(job.timestamp);
+            out->setStatus(BufferStatus_OutFilled);
+        } else {
+            // nothing to show, the buffer can take the next frame
+            out->setStatus(BufferStatus_OutQueued);
+        }
+        mJobs.removeAt(0);
+    }
+}
+
+
 }  // namespace Camera
 }  // namespace Ti
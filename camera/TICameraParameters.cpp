@@ -232,6 +232,9 @@ const char TICameraParameters::KEY_GAMMA_TABLE[] = "gamma-table";
 
 const char TICameraParameters::KEY_PREVIEW_FRAME_RATE_RANGE[] = "preview-frame-rate-range";
 
+//TI extensions for the software jpeg encoder
+const char TICameraParameters::KEY_JPEG_ENCODE_BANDS[] = "jpeg-encode-bands"; // 0 for one per cpu
+
 #ifdef MOTOROLA_CAMERA
 const char TICameraParameters::KEY_MOT_LEDFLASH[] = "mot-led-flash"; // U32, default 100, percent
 const char TICameraParameters::KEY_MOT_LEDTORCH[] = "mot-led-torch"; // U32, default 100, percent
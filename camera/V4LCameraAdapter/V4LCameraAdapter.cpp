@@ -39,6 +39,7 @@
 #include <linux/videodev.h>
 #include <cutils/properties.h>
 #include "DecoderFactory.h"
+#include "yuv_convert.h"
 
 #define UNLIKELY( exp ) (__builtin_expect( (exp) != 0, false ))
 static int mDebugFps = 0;
@@ -55,7 +56,6 @@ namespace Camera {
 
 //Proto Types
 static void convertYUV422i_yuyvTouyvy(uint8_t *src, uint8_t *dest, size_t size );
-static void convertYUV422ToNV12Tiler(unsigned char *src, unsigned char *dest, int width, int height );
 static void convertYUV422ToNV12(unsigned char *src, unsigned char *dest, int width, int height );
 
 android::Mutex gV4LAdapterLock;
@@ -351,6 +351,9 @@ status_t V4LCameraAdapter::restartPreview ()
     }
 
     ret = v4lStartStreaming();
+    if ((ret == NO_ERROR) && !isNeedToUseDecoder()) {
+        ret = startPreviewPipeline();
+    }
     CAMHAL_LOGDA("Ready for preview....");
 EXIT:
     LOG_FUNCTION_NAME_EXIT;
@@ -469,18 +472,10 @@ status_t V4LCameraAdapter::fillThisBuffer(CameraBuffer *frameBuf, CameraFrame::F
         }
 
     } else {
-        v4l2_buffer buf;
-        buf.index = idx;
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        CAMHAL_LOGD("Will return buffer to V4L with id=%d", idx);
-        ret = v4lIoctl(mCameraHandle, VIDIOC_QBUF, &buf);
-        if (ret < 0) {
-           CAMHAL_LOGEA("VIDIOC_QBUF Failed");
-           goto EXIT;
-        }
-
-        nQueued++;
+        // The V4L buffer was queued again right after conversion,
+        // only the preview buffer comes back here
+        CAMHAL_LOGD("Preview buffer %d is free", idx);
+        ret = mPreviewPipeline.releaseOutput(idx);
     }
 
 EXIT:
@@ -610,15 +605,15 @@ status_t V4LCameraAdapter::UseBuffersCapture(CameraBuffer *bufArr, int num) {
         CAMHAL_LOGDB("capture- buff [%d] = 0x%x ",i, mCaptureBufs.keyAt(i));
     }
 
-    mCaptureBuffersAvailable.clear();
+    clearFrameRefCounts(CameraFrame::IMAGE_FRAME);
     for (int i = 0; i < mCaptureBufferCountQueueable; i++ ) {
-        mCaptureBuffersAvailable.add(&mCaptureBuffers[i], 0);
+        setFrameRefCountByType(&mCaptureBuffers[i], CameraFrame::IMAGE_FRAME, 0);
     }
 
     // initial ref count for undeqeueued buffers is 1 since buffer provider
     // is still holding on to it
     for (int i = mCaptureBufferCountQueueable; i < num; i++ ) {
-        mCaptureBuffersAvailable.add(&mCaptureBuffers[i], 1);
+        setFrameRefCountByType(&mCaptureBuffers[i], CameraFrame::IMAGE_FRAME, 1);
     }
 
     // Update the preview buffer count
@@ -699,6 +694,8 @@ status_t V4LCameraAdapter::takePicture() {
     if (isNeedToUseDecoder()) {
         mDecoder->stop();
         mDecoder->flush();
+    } else {
+        stopPreviewPipeline();
     }
     mLock.lock();
     mCapturing = true;
@@ -896,6 +893,9 @@ status_t V4LCameraAdapter::startPreview()
         mDecoder->start();
     }
     ret = v4lStartStreaming();
+    if ((ret == NO_ERROR) && !isNeedToUseDecoder()) {
+        ret = startPreviewPipeline();
+    }
 
     // Create and start preview thread for receiving buffers from V4L Camera
     if(!mCapturing) {
@@ -930,6 +930,11 @@ status_t V4LCameraAdapter::stopPreview()
         mStopCondition.waitRelative(mStopLock, 100000000);
         mDecoder->stop();
         mDecoder->flush();
+    } else {
+        // delivery may call back into fillThisBuffer
+        mLock.unlock();
+        stopPreviewPipeline();
+        mLock.lock();
     }
     ret = v4lStopStreaming(mPreviewBufferCount);
     if (ret < 0) {
@@ -1163,7 +1168,7 @@ void V4LCameraAdapter::setupWorkingMode() {
 
 V4LCameraAdapter::V4LCameraAdapter(size_t sensor_index, CameraHal* hal)
     :mPixelFormat(DEFAULT_PIXEL_FORMAT), mFrameRate(0), mCameraHal(hal),
-     mSkipFramesCount(0)
+     mSkipFramesCount(0), mPreviewPipeline(this)
 {
     LOG_FUNCTION_NAME;
 
@@ -1206,168 +1211,23 @@ V4LCameraAdapter::~V4LCameraAdapter()
 
 static void convertYUV422i_yuyvTouyvy(uint8_t *src, uint8_t *dest, size_t size ) {
     //convert YUV422I yuyv to uyvy format.
-    uint32_t *bf = (uint32_t*)src;
-    uint32_t *dst = (uint32_t*)dest;
-
     LOG_FUNCTION_NAME;
 
     if (!src || !dest) {
         return;
     }
 
-    for(size_t i = 0; i < size; i = i+4)
-    {
-        dst[0] = ((bf[0] & 0x00FF00FF) << 8) | ((bf[0] & 0xFF00FF00) >> 8);
-        bf++;
-        dst++;
-    }
-
-    LOG_FUNCTION_NAME_EXIT;
-}
-
-static void convertYUV422ToNV12Tiler(unsigned char *src, unsigned char *dest, int width, int height ) {
-    //convert YUV422I to YUV420 NV12 format and copies directly to preview buffers (Tiler memory).
-    int stride = 4096;
-    unsigned char *bf = src;
-    unsigned char *dst_y = dest;
-    unsigned char *dst_uv = dest + ( height * stride);
-#ifdef PPM_PER_FRAME_CONVERSION
-    static int frameCount = 0;
-    static nsecs_t ppm_diff = 0;
-    nsecs_t ppm_start  = systemTime();
-#endif
-
-    LOG_FUNCTION_NAME;
-
-    if (width % 16 ) {
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                *dst_y = *bf;
-                dst_y++;
-                bf = bf + 2;
-            }
-            dst_y += (stride - width);
-        }
-
-        bf = src;
-        bf++;  //UV sample
-        for(int i = 0; i < height/2; i++) {
-            for(int j=0; j<width; j++) {
-                *dst_uv = *bf;
-                dst_uv++;
-                bf = bf + 2;
-            }
-            bf = bf + width*2;
-            dst_uv = dst_uv + (stride - width);
-        }
-    } else {
-        //neon conversion
-        for(int i = 0; i < height; i++) {
-            int n = width;
-            int skip = i & 0x1;       // skip uv elements for the odd rows
-            asm volatile (
-                "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   blt 5f                                                      \n\t"
-                "0: @ 16 pixel copy                                             \n\t"
-                "   vld2.8  {q0, q1} , [%[src]]! @ q0 = yyyy.. q1 = uvuv..      \n\t"
-                "                                @ now q0 = y q1 = uv           \n\t"
-                "   vst1.32   {d0,d1}, [%[dst_y]]!                              \n\t"
-                "   cmp    %[skip], #0                                          \n\t"
-                "   bne 1f                                                      \n\t"
-                "   vst1.32  {d2,d3},[%[dst_uv]]!                               \n\t"
-                "1: @ skip odd rows for UV                                      \n\t"
-                "   sub %[n], %[n], #16                                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   bge 0b                                                      \n\t"
-                "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                : [dst_y] "+r" (dst_y), [dst_uv] "+r" (dst_uv), [src] "+r" (src), [n] "+r" (n)
-                : [src_stride] "r" (width), [skip] "r" (skip)
-                : "cc", "memory", "q0", "q1", "q2", "d0", "d1", "d2", "d3"
-            );
-            dst_y = dst_y + (stride - width);
-            if (skip == 0) {
-                dst_uv = dst_uv + (stride - width);
-            }
-        } //end of for()
-    }
-
-#ifdef PPM_PER_FRAME_CONVERSION
-    ppm_diff += (systemTime() - ppm_start);
-    frameCount++;
-
-    if (frameCount >= 30) {
-        ppm_diff = ppm_diff / frameCount;
-        LOGD("PPM: YUV422i to NV12 Conversion(%d x %d): %llu us ( %llu ms )", width, height,
-                ns2us(ppm_diff), ns2ms(ppm_diff) );
-        ppm_diff = 0;
-        frameCount = 0;
-    }
-#endif
+    yuv_swap_pairs(src, 0, dest, 0, size / 2, 1);
 
     LOG_FUNCTION_NAME_EXIT;
 }
 
 static void convertYUV422ToNV12(unsigned char *src, unsigned char *dest, int width, int height ) {
     //convert YUV422I to YUV420 NV12 format.
-    unsigned char *bf = src;
-    unsigned char *dst_y = dest;
-    unsigned char *dst_uv = dest + (width * height);
-
     LOG_FUNCTION_NAME;
 
-    if (width % 16 ) {
-        for(int i = 0; i < height; i++) {
-            for(int j = 0; j < width; j++) {
-                *dst_y = *bf;
-                dst_y++;
-                bf = bf + 2;
-            }
-        }
-
-        bf = src;
-        bf++;  //UV sample
-        for(int i = 0; i < height/2; i++) {
-            for(int j=0; j<width; j++) {
-                *dst_uv = *bf;
-                dst_uv++;
-                bf = bf + 2;
-            }
-            bf = bf + width*2;
-        }
-    } else {
-        //neon conversion
-        for(int i = 0; i < height; i++) {
-            int n = width;
-            int skip = i & 0x1;       // skip uv elements for the odd rows
-            asm volatile (
-                "   pld [%[src], %[src_stride], lsl #2]                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   blt 5f                                                      \n\t"
-                "0: @ 16 pixel copy                                             \n\t"
-                "   vld2.8  {q0, q1} , [%[src]]! @ q0 = yyyy.. q1 = uvuv..      \n\t"
-                "                                @ now q0 = y q1 = uv           \n\t"
-                "   vst1.32   {d0,d1}, [%[dst_y]]!                              \n\t"
-                "   cmp    %[skip], #0                                          \n\t"
-                "   bne 1f                                                      \n\t"
-                "   vst1.32  {d2,d3},[%[dst_uv]]!                               \n\t"
-                "1: @ skip odd rows for UV                                      \n\t"
-                "   sub %[n], %[n], #16                                         \n\t"
-                "   cmp %[n], #16                                               \n\t"
-                "   bge 0b                                                      \n\t"
-                "5: @ end                                                       \n\t"
-#ifdef NEEDS_ARM_ERRATA_754319_754320
-                "   vmov s0,s0  @ add noop for errata item                      \n\t"
-#endif
-                : [dst_y] "+r" (dst_y), [dst_uv] "+r" (dst_uv), [src] "+r" (src), [n] "+r" (n)
-                : [src_stride] "r" (width), [skip] "r" (skip)
-                : "cc", "memory", "q0", "q1", "q2", "d0", "d1", "d2", "d3"
-            );
-        }
-    }
+    yuv_yuyv_to_nv12(src, width * 2, dest, width, dest + (width * height), width,
+                     width, height);
 
     LOG_FUNCTION_NAME_EXIT;
 }
@@ -1411,7 +1271,7 @@ void V4LCameraAdapter::returnOutputBuffer(int index)
     if (mRecording)
     {
         frame.mFrameMask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-        mFramesWithEncoder++;
+        __atomic_add_fetch(&mFramesWithEncoder, 1, __ATOMIC_RELAXED);
     }
 
     int ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
@@ -1436,6 +1296,8 @@ status_t V4LCameraAdapter::returnBufferToV4L(int id) {
        CAMHAL_LOGEA("VIDIOC_QBUF Failed 0x%x", ret);
        return FAILED_TRANSACTION;
     }
+    // the preview pipeline queues buffers from its conversion thread
+    __atomic_add_fetch(&nQueued, 1, __ATOMIC_RELAXED);
 
     return NO_ERROR;
 }
@@ -1444,11 +1306,8 @@ int V4LCameraAdapter::previewThread()
 {
     status_t ret = NO_ERROR;
     int width, height;
-    CameraFrame frame;
-    void *y_uv[2];
     int index = 0;
     int filledLen = 0;
-    int stride = 4096;
     char *fp = NULL;
 
     mParams.getPreviewSize(&width, &height);
@@ -1493,6 +1352,7 @@ int V4LCameraAdapter::previewThread()
     }
     else
     {
+        // Capture stage: conversion and delivery run on the preview pipeline
         fp = GetFrame(index, filledLen);
 
         if(!fp) {
@@ -1501,11 +1361,12 @@ int V4LCameraAdapter::previewThread()
         }
         CAMHAL_LOGD("GOT IN frame with ID=%d",index);
 
-        CameraBuffer *buffer = mPreviewBufs[index];
-        if (mPixelFormat == V4L2_PIX_FMT_YUYV) {
-            convertYUV422ToNV12Tiler(reinterpret_cast<unsigned char*>(fp), reinterpret_cast<unsigned char*>(buffer->mapped), width, height);
+        // The pipeline converts from YUYV only
+        if (mPixelFormat != V4L2_PIX_FMT_YUYV) {
+            CAMHAL_LOGEB("Unsupported preview format 0x%x, dropping frame %d", mPixelFormat, index);
+            returnBufferToV4L(index);
+            goto EXIT;
         }
-        CAMHAL_LOGVB("##...index= %d.;camera buffer= 0x%x; mapped= 0x%x.",index, buffer, buffer->mapped);
 
 #ifdef SAVE_RAW_FRAMES
         unsigned char* nv12_buff = (unsigned char*) malloc(width*height*3/2);
@@ -1515,27 +1376,11 @@ int V4LCameraAdapter::previewThread()
         free (nv12_buff);
 #endif
 
-        android::Mutex::Autolock lock(mSubscriberLock);
-
-        frame.mFrameType = CameraFrame::PREVIEW_FRAME_SYNC;
-        frame.mBuffer = buffer;
-        frame.mLength = width*height*3/2;
-        frame.mAlignment = stride;
-        frame.mOffset = 0;
-        frame.mTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);
-        frame.mFrameMask = (unsigned int)CameraFrame::PREVIEW_FRAME_SYNC;
-
-        if (mRecording)
-        {
-            frame.mFrameMask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-            mFramesWithEncoder++;
-        }
-
-        ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
+        ret = mPreviewPipeline.queueInput(index, reinterpret_cast<const uint8_t*>(fp),
+                                          mInBuffers[index]->getTimestamp());
         if (ret != NO_ERROR) {
-            CAMHAL_LOGDB("Error in setInitFrameRefCount %d", ret);
-        } else {
-            ret = sendFrameToSubscribers(&frame);
+            CAMHAL_LOGDB("Preview pipeline busy, dropping frame %d", index);
+            returnBufferToV4L(index);
         }
     }
 
@@ -1544,6 +1389,109 @@ EXIT:
     return ret;
 }
 
+status_t V4LCameraAdapter::startPreviewPipeline()
+{
+    V4LPreviewPipeline::Output outputs[NB_BUFFER];
+    int width = 0, height = 0;
+    int stride = 4096;
+    int inputStride;
+
+    LOG_FUNCTION_NAME;
+
+    mParams.getPreviewSize(&width, &height);
+
+    inputStride = mVideoInfo->format.fmt.pix.bytesperline;
+    if (inputStride < width * 2) {
+        inputStride = width * 2;
+    }
+
+    for (int i = 0; i < mPreviewBufferCount; i++) {
+        unsigned char *mapped = reinterpret_cast<unsigned char*>(mPreviewBufs[i]->mapped);
+        outputs[i].y = mapped;
+        outputs[i].uv = mapped + height * stride;
+        outputs[i].stride = stride;
+    }
+
+    status_t ret = mPreviewPipeline.start(width, height, inputStride, outputs,
+                                          mPreviewBufferCount, mPreviewBufferCountQueueable);
+    if (ret != NO_ERROR) {
+        CAMHAL_LOGEB("Unable to start preview pipeline %d", ret);
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return ret;
+}
+
+void V4LCameraAdapter::stopPreviewPipeline()
+{
+    V4LPreviewPipeline::Stats stats;
+
+    LOG_FUNCTION_NAME;
+
+    if (!mPreviewPipeline.isRunning()) {
+        return;
+    }
+
+    mPreviewPipeline.stop();
+    mPreviewPipeline.getStats(stats);
+
+    CAMHAL_LOGI("Preview pipeline: %u captured, %u delivered, %u dropped (queue %u, buffers %u)",
+                stats.captured, stats.delivered, stats.droppedInput + stats.droppedOutput,
+                stats.droppedInput, stats.droppedOutput);
+    if (stats.delivered) {
+        CAMHAL_LOGI("Preview pipeline avg/max us: queued %llu/%llu convert %llu/%llu "
+                    "handoff %llu/%llu deliver %llu/%llu total %llu/%llu",
+                    ns2us(stats.queued.total / stats.queued.count), ns2us(stats.queued.max),
+                    ns2us(stats.convert.total / stats.convert.count), ns2us(stats.convert.max),
+                    ns2us(stats.handoff.total / stats.handoff.count), ns2us(stats.handoff.max),
+                    ns2us(stats.deliver.total / stats.deliver.count), ns2us(stats.deliver.max),
+                    ns2us(stats.total.total / stats.total.count), ns2us(stats.total.max));
+    }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+void V4LCameraAdapter::releaseInput(int index)
+{
+    returnBufferToV4L(index);
+}
+
+void V4LCameraAdapter::deliverOutput(int index, nsecs_t timestamp)
+{
+    int width, height;
+    int stride = 4096;
+    CameraFrame frame;
+
+    mParams.getPreviewSize(&width, &height);
+
+    CameraBuffer *buffer = mPreviewBufs[index];
+    CAMHAL_LOGVB("##...index= %d.;camera buffer= 0x%x; mapped= 0x%x.",index, buffer, buffer->mapped);
+
+    android::Mutex::Autolock lock(mSubscriberLock);
+
+    frame.mFrameType = CameraFrame::PREVIEW_FRAME_SYNC;
+    frame.mBuffer = buffer;
+    frame.mLength = width*height*3/2;
+    frame.mAlignment = stride;
+    frame.mOffset = 0;
+    frame.mTimestamp = timestamp;
+    frame.mFrameMask = (unsigned int)CameraFrame::PREVIEW_FRAME_SYNC;
+
+    if (mRecording)
+    {
+        frame.mFrameMask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
+        __atomic_add_fetch(&mFramesWithEncoder, 1, __ATOMIC_RELAXED);
+    }
+
+    status_t ret = setInitFrameRefCount(frame.mBuffer, frame.mFrameMask);
+    if (ret != NO_ERROR) {
+        CAMHAL_LOGDB("Error in setInitFrameRefCount %d", ret);
+    } else {
+        sendFrameToSubscribers(&frame);
+    }
+}
+
 //scan for video devices
 void detectVideoDevice(char** video_device_list, int& num_device) {
     char dir_path[20];
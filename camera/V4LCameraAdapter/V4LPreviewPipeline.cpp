@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file V4LPreviewPipeline.cpp
+*
+* Staged YUYV to NV12 preview path of the V4L camera adapter.
+*
+*/
+
+#include <string.h>
+
+#include "V4LPreviewPipeline.h"
+#include "yuv_convert.h"
+
+namespace Ti {
+namespace Camera {
+
+V4LPreviewPipeline::V4LPreviewPipeline(Client* client) :
+    mClient(client), mWidth(0), mHeight(0), mInputStride(0), mBands(1),
+    mOutputCount(0), mBandSrc(NULL), mBandDst(NULL),
+    mRunning(false), mExit(false), mSequence(0), mLastDelivered(0)
+{
+    memset(mOutputs, 0, sizeof(mOutputs));
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+V4LPreviewPipeline::~V4LPreviewPipeline()
+{
+    stop();
+}
+
+status_t V4LPreviewPipeline::start(int width, int height, int inputStride,
+                                   const Output* outputs, int outputCount, int freeOutputs)
+{
+    status_t ret = NO_ERROR;
+
+    LOG_FUNCTION_NAME;
+
+    if ( mRunning ) {
+        return INVALID_OPERATION;
+    }
+
+    if ( ( NULL == outputs ) || ( 0 >= outputCount ) || ( MAX_BUFFERS < outputCount ) ||
+         ( 0 > freeOutputs ) || ( outputCount < freeOutputs ) ||
+         ( 0 >= width ) || ( 0 >= height ) || ( width & 1 ) || ( inputStride < width * 2 ) ) {
+        CAMHAL_LOGEB("Invalid configuration %dx%d stride %d, %d/%d outputs",
+                     width, height, inputStride, freeOutputs, outputCount);
+        return BAD_VALUE;
+    }
+
+    mWidth = width;
+    mHeight = height;
+    mInputStride = inputStride;
+    mOutputCount = outputCount;
+    memcpy(mOutputs, outputs, outputCount * sizeof(Output));
+
+    mInputs.clear();
+    mConverted.clear();
+    mFreeOutputs.clear();
+    for ( int i = 0; i < freeOutputs; i++ ) {
+        mFreeOutputs.push(i);
+    }
+
+    memset(&mStats, 0, sizeof(mStats));
+    mSequence = 0;
+    mLastDelivered = 0;
+    mExit = false;
+
+    ret = mInputSem.Create(0);
+    if ( NO_ERROR == ret ) {
+        ret = mConvertedSem.Create(0);
+    }
+    if ( NO_ERROR != ret ) {
+        CAMHAL_LOGEB("Unable to create stage semaphores %d", ret);
+        return ret;
+    }
+
+    // The conversion thread converts one band itself
+    if ( NO_ERROR != mWorkers.start() ) {
+        CAMHAL_LOGEA("No conversion workers, converting on a single thread");
+    }
+    mBands = mWorkers.concurrency();
+    if ( mBands > mHeight / 2 ) {
+        mBands = 1;
+    }
+
+    mConvertThread = new StageThread(this, &V4LPreviewPipeline::convertNext);
+    mDeliverThread = new StageThread(this, &V4LPreviewPipeline::deliverNext);
+    mConvertThread->run("V4LConvertThread", android::PRIORITY_URGENT_DISPLAY);
+    mDeliverThread->run("V4LDeliverThread", android::PRIORITY_URGENT_DISPLAY);
+
+    mRunning = true;
+
+    LOG_FUNCTION_NAME_EXIT;
+
+    return NO_ERROR;
+}
+
+void V4LPreviewPipeline::stop()
+{
+    Input input;
+    Converted converted;
+
+    LOG_FUNCTION_NAME;
+
+    if ( !mRunning ) {
+        return;
+    }
+    mRunning = false;
+
+    mExit = true;
+    mInputSem.Signal();
+    mConvertedSem.Signal();
+
+    mConvertThread->requestExitAndWait();
+    mDeliverThread->requestExitAndWait();
+    mConvertThread.clear();
+    mDeliverThread.clear();
+
+    mWorkers.stop();
+
+    // Frames which never made it to conversion go back to the device
+    while ( mInputs.pop(input) ) {
+        mClient->releaseInput(input.index);
+    }
+    // Converted frames gave their input back already, only the preview
+    // buffer is left to return
+    {
+        android::AutoMutex lock(mFreeOutputsLock);
+        while ( mConverted.pop(converted) ) {
+            mFreeOutputs.push(converted.index);
+        }
+    }
+
+    mInputSem.Release();
+    mConvertedSem.Release();
+
+    CAMHAL_LOGDB("Preview pipeline: %u captured, %u delivered, %u/%u dropped",
+                 mStats.captured, mStats.delivered,
+                 mStats.droppedInput, mStats.droppedOutput);
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+bool V4LPreviewPipeline::isRunning() const
+{
+    return mRunning;
+}
+
+status_t V4LPreviewPipeline::queueInput(int index, const uint8_t* data, nsecs_t timestamp)
+{
+    Input input;
+
+    if ( !mRunning ) {
+        return NO_INIT;
+    }
+
+    input.index = index;
+    input.data = data;
+    input.timestamp = timestamp;
+    input.queued = systemTime();
+    input.sequence = ++mSequence;
+
+    if ( !mInputs.push(input) ) {
+        android::AutoMutex lock(mStatsLock);
+        mStats.captured++;
+        mStats.droppedInput++;
+        return NO_MEMORY;
+    }
+
+    {
+        android::AutoMutex lock(mStatsLock);
+        mStats.captured++;
+    }
+
+    mInputSem.Signal();
+
+    return NO_ERROR;
+}
+
+status_t V4LPreviewPipeline::releaseOutput(int index)
+{
+    if ( ( 0 > index ) || ( mOutputCount <= index ) ) {
+        return BAD_VALUE;
+    }
+
+    android::AutoMutex lock(mFreeOutputsLock);
+    if ( !mFreeOutputs.push(index) ) {
+        CAMHAL_LOGEB("Preview buffer %d released twice", index);
+        return INVALID_OPERATION;
+    }
+
+    return NO_ERROR;
+}
+
+void V4LPreviewPipeline::getStats(Stats& stats) const
+{
+    android::AutoMutex lock(mStatsLock);
+    stats = mStats;
+}
+
+void V4LPreviewPipeline::account(StageStats& stage, nsecs_t duration)
+{
+    stage.count++;
+    stage.total += duration;
+    if ( duration > stage.max ) {
+        stage.max = duration;
+    }
+}
+
+void V4LPreviewPipeline::convertBand(void* arg, int band)
+{
+    const V4LPreviewPipeline* pipeline = static_cast<const V4LPreviewPipeline*>(arg);
+    const Output* dst = pipeline->mBandDst;
+
+    // bands start on even rows so every band owns whole chroma rows
+    int bandRows = ( ( pipeline->mHeight + pipeline->mBands - 1 ) / pipeline->mBands + 1 ) & ~1;
+    int first = band * bandRows;
+    int rows = pipeline->mHeight - first;
+
+    if ( rows > bandRows ) {
+        rows = bandRows;
+    }
+    if ( 0 >= rows ) {
+        return;
+    }
+
+    yuv_yuyv_to_nv12(pipeline->mBandSrc + first * pipeline->mInputStride, pipeline->mInputStride,
+                     dst->y + first * dst->stride, dst->stride,
+                     dst->uv + ( first / 2 ) * dst->stride, dst->stride,
+                     pipeline->mWidth, rows);
+}
+
+bool V4LPreviewPipeline::convertNext()
+{
+    Input input;
+    Converted converted;
+    int output;
+
+    mInputSem.Wait();
+    if ( mExit ) {
+        return false;
+    }
+
+    if ( !mInputs.pop(input) ) {
+        return true;
+    }
+
+    nsecs_t start = systemTime();
+
+    if ( !mFreeOutputs.pop(output) ) {
+        // every preview buffer is still held by a subscriber
+        {
+            android::AutoMutex lock(mStatsLock);
+            account(mStats.queued, start - input.queued);
+            mStats.droppedOutput++;
+        }
+        mClient->releaseInput(input.index);
+        return true;
+    }
+
+    mBandSrc = input.data;
+    mBandDst = &mOutputs[output];
+    mWorkers.run(convertBand, this, mBands);
+
+    nsecs_t end = systemTime();
+    {
+        android::AutoMutex lock(mStatsLock);
+        account(mStats.queued, start - input.queued);
+        account(mStats.convert, end - start);
+    }
+
+    mClient->releaseInput(input.index);
+
+    converted.index = output;
+    converted.timestamp = input.timestamp;
+    converted.queued = input.queued;
+    converted.converted = end;
+    converted.sequence = input.sequence;
+
+    // cannot overflow, there are never more converted frames than outputs
+    mConverted.push(converted);
+    mConvertedSem.Signal();
+
+    return true;
+}
+
+bool V4LPreviewPipeline::deliverNext()
+{
+    Converted converted;
+
+    mConvertedSem.Wait();
+    if ( mExit ) {
+        return false;
+    }
+
+    if ( !mConverted.pop(converted) ) {
+        return true;
+    }
+
+    if ( converted.sequence <= mLastDelivered ) {
+        CAMHAL_LOGEB("Frame %u delivered after %u", converted.sequence, mLastDelivered);
+    }
+    mLastDelivered = converted.sequence;
+
+    nsecs_t start = systemTime();
+
+    mClient->deliverOutput(converted.index, converted.timestamp);
+
+    nsecs_t end = systemTime();
+    {
+        android::AutoMutex lock(mStatsLock);
+        account(mStats.handoff, start - converted.converted);
+        account(mStats.deliver, end - start);
+        account(mStats.total, end - converted.queued);
+        mStats.delivered++;
+    }
+
+    return true;
+}
+
+} // namespace Camera
+} // namespace Ti
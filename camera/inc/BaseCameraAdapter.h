@@ -20,6 +20,7 @@
 #define BASE_CAMERA_ADAPTER_H
 
 #include "CameraHal.h"
+#include "FrameRefTable.h"
 
 namespace Ti {
 namespace Camera {
@@ -180,6 +181,8 @@ protected:
     int getFrameRefCount(CameraBuffer* frameBuf);
     int getFrameRefCountByType(CameraBuffer* frameBuf, CameraFrame::FrameType frameType);
     int setInitFrameRefCount(CameraBuffer* buf, unsigned int mask);
+    //Unregisters all buffers of the group the frame type belongs to
+    void clearFrameRefCounts(CameraFrame::FrameType frameType);
     static const char* getLUTvalue_translateHAL(int Value, LUTtypeHAL LUT);
 
 // private member functions
@@ -188,6 +191,7 @@ private:
                                       android::KeyedVector<int, frame_callback> *subscribers,
                                       CameraFrame::FrameType frameType);
     status_t rollbackToPreviousState();
+    static int getFrameRefGroup(CameraFrame::FrameType frameType);
 
 // protected data types and variables
 protected:
@@ -219,8 +223,6 @@ protected:
 
 #endif
 
-    mutable android::Mutex mReturnFrameLock;
-
     //Lock protecting the Adapter state
     mutable android::Mutex mLock;
     AdapterState mAdapterState;
@@ -243,37 +245,28 @@ protected:
     CameraBuffer *mPreviewBuffers;
     int mPreviewBufferCount;
     size_t mPreviewBuffersLength;
-    android::KeyedVector<CameraBuffer *, int> mPreviewBuffersAvailable;
     mutable android::Mutex mPreviewBufferLock;
 
-    //Snapshot buffer management data
-    android::KeyedVector<CameraBuffer *, int> mSnapshotBuffersAvailable;
-    mutable android::Mutex mSnapshotBufferLock;
-
     //Video buffer management data
     CameraBuffer *mVideoBuffers;
-    android::KeyedVector<CameraBuffer *, int> mVideoBuffersAvailable;
     int mVideoBuffersCount;
     size_t mVideoBuffersLength;
     mutable android::Mutex mVideoBufferLock;
 
     //Image buffer management data
     CameraBuffer *mCaptureBuffers;
-    android::KeyedVector<CameraBuffer *, int> mCaptureBuffersAvailable;
     int mCaptureBuffersCount;
     size_t mCaptureBuffersLength;
     mutable android::Mutex mCaptureBufferLock;
 
     //Metadata buffermanagement
     CameraBuffer *mPreviewDataBuffers;
-    android::KeyedVector<CameraBuffer *, int> mPreviewDataBuffersAvailable;
     int mPreviewDataBuffersCount;
     size_t mPreviewDataBuffersLength;
     mutable android::Mutex mPreviewDataBufferLock;
 
     //Video input buffer management data (used for reproc pipe)
     CameraBuffer *mVideoInBuffers;
-    android::KeyedVector<CameraBuffer *, int> mVideoInBuffersAvailable;
     mutable android::Mutex mVideoInBufferLock;
 
     Utils::MessageQueue mFrameQ;
@@ -298,6 +291,9 @@ protected:
 #endif
 
     android::KeyedVector<void *, CameraFrame *> mFrameQueue;
+
+    //Reference counts of all buffers, see getFrameRefGroup() for the groups
+    FrameRefTable mFrameRefs;
 };
 
 } // namespace Camera
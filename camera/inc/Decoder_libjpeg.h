@@ -17,24 +17,28 @@
 #ifndef ANDROID_CAMERA_HARDWARE_DECODER_LIBJPEG_H
 #define ANDROID_CAMERA_HARDWARE_DECODER_LIBJPEG_H
 
-#include "CameraHal.h"
-
-extern "C" {
-#include "jhead.h"
-
-#undef TRUE
-#undef FALSE
-
-}
-
+#include "Common.h"
 
 namespace Ti {
 namespace Camera {
 
+/**
+ * Software MJPEG to NV12 decoder.
+ *
+ * Decompressors and scratch rows are kept from one frame to the next.
+ * The DHT that MJPEG streams usually omit is fed to libjpeg from a
+ * static table, the frame itself is never copied. Frames with restart
+ * markers on MCU row boundaries are cut into horizontal slices which
+ * are decoded in parallel.
+ */
 class Decoder_libjpeg
 {
 
 public:
+    enum {
+        MAX_SLICES = 4,
+    };
+
     Decoder_libjpeg();
     ~Decoder_libjpeg();
     static int readDHTSize();
@@ -42,13 +46,16 @@ public:
     static int appendDHT(unsigned char *jpeg_src, int filled_len, unsigned char *jpeg_with_dht_buffer, int buff_size);
     bool decode(unsigned char *jpeg_src, int filled_len, unsigned char *nv12_buffer, int stride);
 
+    // decompressor and scratch rows of one slice
+    struct Context;
+
 private:
-    void release();
-    unsigned char **Y_Plane;
-    unsigned char **U_Plane;
-    unsigned char **V_Plane;
-    unsigned char *UV_Plane;
-    unsigned int mWidth, mHeight;
+    struct SliceJob;
+
+    Context* context(int slice);
+    static void decodeSliceTask(void* job, int index);
+
+    Context* mContexts[MAX_SLICES];
 };
 
 } // namespace Camera
@@ -26,6 +26,8 @@
 
 #include <utils/threads.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
+#include <utils/KeyedVector.h>
 
 extern "C" {
 #include "jhead.h"
@@ -47,6 +49,10 @@ namespace Camera {
  */
 
 #define MAX_EXIF_TAGS_SUPPORTED 30
+
+struct libjpeg_destination_mgr;
+struct JpegCompressor;
+
 typedef void (*encoder_libjpeg_callback_t) (void* main_jpeg,
                                             void* thumb_jpeg,
                                             CameraFrame::FrameType type,
@@ -123,7 +129,7 @@ class ExifElementsTable {
 #endif
 };
 
-class Encoder_libjpeg : public android::Thread {
+class Encoder_libjpeg : public virtual android::RefBase {
     /* public member types and variables */
     public:
         struct params {
@@ -140,7 +146,12 @@ class Encoder_libjpeg : public android::Thread {
             int start_offset;
             const char* format;
             size_t jpeg_size;
+            int bands; // horizontal strips encoded in parallel, 0 for one per cpu
          };
+
+        // compressors and scratch buffers reused from one picture to the next
+        struct Context;
+
     /* public member functions */
     public:
         Encoder_libjpeg(params* main_jpeg,
@@ -150,58 +161,24 @@ class Encoder_libjpeg : public android::Thread {
                         void* cookie1,
                         void* cookie2,
                         void* cookie3, void *cookie4)
-            : android::Thread(false), mMainInput(main_jpeg), mThumbnailInput(tn_jpeg), mCb(cb),
+            : mMainInput(main_jpeg), mThumbnailInput(tn_jpeg), mCb(cb),
               mCancelEncoding(false), mCookie1(cookie1), mCookie2(cookie2), mCookie3(cookie3), mCookie4(cookie4),
-              mType(type), mThumb(NULL) {
-            this->incStrong(this);
-            mCancelSem.Create(0);
+              mType(type) {
         }
 
         ~Encoder_libjpeg() {
             CAMHAL_LOGVB("~Encoder_libjpeg(%p)", this);
         }
 
-        virtual bool threadLoop() {
-            size_t size = 0;
-            if (mThumbnailInput) {
-                // start thread to encode thumbnail
-                mThumb = new Encoder_libjpeg(mThumbnailInput, NULL, NULL, mType, NULL, NULL, NULL, NULL);
-#ifdef ANDROID_API_N_OR_LATER
-                mThumb->run("thumbnail_encoder");
-#else
-                mThumb->run();
-#endif
-            }
-
-            // encode our main image
-            size = encode(mMainInput);
-
-            // signal cancel semaphore incase somebody is waiting
-            mCancelSem.Signal();
-
-            // check if it is main jpeg thread
-            if(mThumb.get()) {
-                // wait until tn jpeg thread exits.
-                mThumb->join();
-                mThumb.clear();
-                mThumb = NULL;
-            }
+        // encodes thumbnail and main picture on the calling thread, then
+        // delivers the callback
+        void process(Context* context);
 
-            if(mCb) {
-                mCb(mMainInput, mThumbnailInput, mType, mCookie1, mCookie2, mCookie3, mCookie4, mCancelEncoding);
-            }
-
-            // encoder thread runs, self-destructs, and then exits
-            this->decStrong(this);
-            return false;
-        }
+        // delivers the callback as canceled without encoding anything
+        void abort();
 
         void cancel() {
            mCancelEncoding = true;
-           if (mThumb.get()) {
-               mThumb->cancel();
-               mCancelSem.WaitTimeout(CANCEL_TIMEOUT);
-           }
         }
 
         void getCookies(void **cookie1, void **cookie2, void **cookie3) {
@@ -210,20 +187,115 @@ class Encoder_libjpeg : public android::Thread {
             if (cookie3) *cookie3 = mCookie3;
         }
 
+        static Context* createContext();
+        static void destroyContext(Context* context);
+
     private:
         params* mMainInput;
         params* mThumbnailInput;
         encoder_libjpeg_callback_t mCb;
-        bool mCancelEncoding;
+        volatile bool mCancelEncoding;
         void* mCookie1;
         void* mCookie2;
         void* mCookie3;
         void* mCookie4;
         CameraFrame::FrameType mType;
-        android::sp<Encoder_libjpeg> mThumb;
-        Utils::Semaphore mCancelSem;
 
-        size_t encode(params*);
+        struct Source;
+        struct StripJob;
+
+        size_t encode(Context*, params*);
+        size_t encodeRows(JpegCompressor*, params*, const Source&, int first_row, int rows,
+                          libjpeg_destination_mgr* dest, bool restart);
+        size_t encodeStrips(Context*, params*, const Source&, int strip_rows);
+        static void encodeStripTask(void* job, int index);
+};
+
+/**
+ * Process wide jpeg encoder service. A fixed set of workers, each with its
+ * own Encoder_libjpeg::Context, runs the jobs submitted by the callback
+ * notifiers in order. Every notifier registers as a client, identified by
+ * the first cookie of its jobs, and the workers run while a client is left.
+ */
+class JpegEncoderService {
+    public:
+        enum {
+            WORKERS = 2,
+            QUEUE_DEPTH = 4,
+        };
+
+        // latencies are in nanoseconds
+        struct Stats {
+            unsigned int completed;
+            unsigned int canceled;
+            unsigned int rejected;
+            nsecs_t queueTotal;
+            nsecs_t queueMax;
+            nsecs_t encodeTotal;
+            nsecs_t encodeMax;
+        };
+
+        static JpegEncoderService& instance();
+
+        void registerClient(void* cookie);
+
+        // cancels the jobs of the client and drops its stats, the workers
+        // are stopped once the last client is gone
+        void unregisterClient(void* cookie);
+
+        // queues a job, waiting up to timeout for a free slot while the
+        // queue is full. Returns TIMED_OUT if the job was not accepted,
+        // its callback is not invoked then.
+        status_t submit(const android::sp<Encoder_libjpeg>& job, nsecs_t timeout);
+
+        // cancels every queued or running job whose first cookie matches
+        // and returns once none of them is running anymore
+        void cancel(void* cookie);
+
+        // stats of the jobs submitted by one client
+        status_t getStats(void* cookie, Stats& stats);
+
+    private:
+        class Worker : public android::Thread {
+            public:
+                Worker(JpegEncoderService* service, int index)
+                    : android::Thread(false), mService(service), mIndex(index) {}
+
+                virtual bool threadLoop() {
+                    return mService->processNext(mIndex);
+                }
+
+            private:
+                JpegEncoderService* mService;
+                int mIndex;
+        };
+
+        struct Job {
+            android::sp<Encoder_libjpeg> encoder;
+            nsecs_t queued;
+        };
+
+        JpegEncoderService();
+        ~JpegEncoderService();
+
+        status_t startWorkers();
+        void stopWorkers();
+        bool processNext(int index);
+        Stats* clientStats(void* cookie);
+        static bool matches(const android::sp<Encoder_libjpeg>& encoder, void* cookie);
+
+        // serializes client registration against stopping the workers
+        android::Mutex mClientLock;
+        android::Mutex mLock;
+        android::Condition mJobCond;
+        android::Condition mSpaceCond;
+        android::Condition mDoneCond;
+        android::Vector<Job> mQueue;
+        android::sp<Worker> mWorkers[WORKERS];
+        android::sp<Encoder_libjpeg> mRunning[WORKERS];
+        Encoder_libjpeg::Context* mContexts[WORKERS];
+        android::KeyedVector<void*, Stats> mClients;
+        bool mExiting;
 };
 
 } // namespace Camera
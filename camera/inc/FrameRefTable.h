@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAME_REF_TABLE_H
+#define FRAME_REF_TABLE_H
+
+#include <stdint.h>
+#include <utils/threads.h>
+
+namespace Ti {
+namespace Camera {
+
+/*==========================================================================
+* Class Name     : FrameRefTable
+*
+* Description    : Per buffer reference counts of the camera adapter. Every
+*                  buffer gets a slot when it is first registered, usually
+*                  at use buffers time, and keeps it for the lifetime of the
+*                  table. A slot holds one count per buffer group plus their
+*                  sum, so looking up, setting and releasing a count is a
+*                  hash probe and an atomic operation without any lock.
+*                  Registering a buffer in a group, which may hand it a
+*                  slot given up by another buffer, and clearing whole
+*                  groups are serialized. Counts carry the generation of
+*                  their slot, so a late update for the previous buffer of
+*                  a reused slot is refused.
+============================================================================*/
+class FrameRefTable {
+public:
+    enum {
+        MAX_GROUPS = 8,
+        MAX_SLOTS = 128
+    };
+
+    FrameRefTable();
+
+    /* Count of a buffer in a group, -1 if it is not registered there */
+    int get(const void* buffer, int group) const;
+
+    /* Sum of all counts of a buffer */
+    int total(const void* buffer) const;
+
+    /* Sets a count, registering the buffer in the group if needed */
+    void set(const void* buffer, int group, int count);
+
+    /* Drops one reference. Returns the remaining count of the group and
+     * the remaining sum of all groups in total, or -1 if the count was
+     * already zero or the buffer is not registered in the group */
+    int release(const void* buffer, int group, int* total);
+
+    /* Unregisters every buffer of a group */
+    void clear(int group);
+
+    /* Copies up to max buffers registered in a group, returns how many */
+    int buffers(int group, const void** buffers, int max) const;
+
+    /* Opaque per buffer pointer, NULL unless set */
+    void setCookie(const void* buffer, void* cookie);
+    void* cookie(const void* buffer) const;
+    void clearCookies();
+
+private:
+    /* Counts and the total keep the slot generation in their upper half */
+    struct Slot {
+        const void* buffer;
+        void* cookie;
+        uint32_t generation;
+        uint64_t total;
+        uint64_t counts[MAX_GROUPS];
+    };
+
+    static uint32_t hash(const void* buffer);
+
+    Slot* find(const void* buffer) const;
+    Slot* insert(const void* buffer);
+    static bool isFree(const Slot& slot);
+    static bool store(Slot& slot, const void* buffer, int group, int count, bool locked);
+    static bool addTotal(Slot& slot, uint32_t generation, int delta, int* total);
+
+private:
+    mutable android::Mutex mLock;
+    Slot mSlots[MAX_SLOTS];
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif // FRAME_REF_TABLE_H
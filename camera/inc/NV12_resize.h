@@ -18,70 +18,90 @@
 #define NV12_RESIZE_H_
 
 #include <sys/types.h>
-#include "Common.h"
-
-const uint8_t bWeights[8][8][4] = {
-  {{64, 0, 0, 0}, {56, 0, 0, 8}, {48, 0, 0,16}, {40, 0, 0,24},
-   {32, 0, 0,32}, {24, 0, 0,40}, {16, 0, 0,48}, { 8, 0, 0,56}},
-
-  {{56, 8, 0, 0}, {49, 7, 1, 7}, {42, 6, 2,14}, {35, 5, 3,21},
-   {28, 4, 4,28}, {21, 3, 5,35}, {14, 2, 6,42}, { 7, 1, 7,49}},
+#include <stdint.h>
 
-  {{48,16, 0, 0}, {42,14, 2, 6}, {36,12,4 ,12}, {30,10,6 ,18},
-   {24, 8, 8,24}, {18, 6,10,30}, {12,4 ,12,36}, { 6, 2,14,42}},
-
-  {{40,24,0 ,0 }, {35,21, 3, 5}, {30,18, 6,10}, {25,15, 9,15},
-   {20,12,12,20}, {15, 9,15,25}, {10, 6,18,30}, { 5, 3,21,35}},
+#include "Common.h"
+#include "WorkerPool.h"
 
-  {{32,32, 0,0 }, {28,28, 4, 4}, {24,24, 8, 8}, {20,20,12,12},
-   {16,16,16,16}, {12,12,20,20}, { 8, 8,24,24}, { 4, 4,28,28}},
+namespace Ti {
+namespace Camera {
 
-  {{24,40,0 ,0 }, {21,35, 5, 3}, {18,30,10, 6}, {15,25,15, 9},
-   {12,20,20,12}, { 9,15,25,15}, { 6,10,30,18}, { 3, 5,35,21}},
+/* Filter used to compute destination samples */
+enum NV12ResizeFilter {
+    NV12_RESIZE_FILTER_NEAREST,
+    NV12_RESIZE_FILTER_BILINEAR,
+    NV12_RESIZE_FILTER_BOX,         /* area average, nearest when upscaling */
+};
 
-  {{16,48, 0,0 }, {14,42, 6, 2}, {12,36,12, 4}, {10,30,18, 6},
-   {8 ,24,24,8 }, { 6,18,30,10}, { 4,12,36,12}, { 2, 6,42,14}},
+/* Row kernel set, AUTO picks the best one built for the target */
+enum NV12ResizeKernel {
+    NV12_RESIZE_KERNEL_AUTO,
+    NV12_RESIZE_KERNEL_SCALAR,
+    NV12_RESIZE_KERNEL_NEON,
+    NV12_RESIZE_KERNEL_SSE2,
+};
 
-  {{ 8,56, 0,0 }, { 7,49, 7, 1}, { 6,42,14, 2}, { 5,35,21, 3},
-   { 4,28,28,4 }, { 3,21,35, 5}, { 2,14,42, 6}, { 1,7 ,49, 7}}
+/* NV12 image: full resolution Y plane followed by an interleaved
+ * half resolution CbCr plane, each with its own stride in bytes. For odd
+ * sizes the CbCr plane rounds up to (width + 1) / 2 pairs and
+ * (height + 1) / 2 rows */
+struct NV12Image {
+    int      width;
+    int      height;
+    int      yStride;
+    int      uvStride;
+    uint8_t* y;
+    uint8_t* uv;
 };
 
-/* This structure defines the format of an image */
-typedef struct {
-    int32_t  uWidth;
-    int32_t  uHeight;
-    int32_t  uStride;
-    uint8_t* imgPtr;
-    uint8_t* clrPtr;
-    int32_t  uOffset;
-} structConvImage;
-
-typedef struct IC_crop_struct {
-    uint32_t x;       /* x pos of rectangle */
-    uint32_t y;       /* y pos of rectangle */
-    uint32_t uWidth;  /* dx of rectangle    */
-    uint32_t uHeight; /* dy of rectangle    */
-} IC_rect_type;
+/* Rectangle in luma pixels, x/y must be even */
+struct NV12Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
 
 /*==========================================================================
-* Function Name  : VT_resizeFrame_Video_opt2_lp
-*
-* Description    : Resize a yuv frame.
+* Class Name     : NV12Resizer
 *
-* Input(s)       : input_img_ptr        -> Input Image Structure
-*                : output_img_ptr       -> Output Image Structure
-*                : cropout              -> crop structure
-*
-* Value Returned : bool                 -> FALSE on error TRUE on success
-* NOTE:
-*            Not tested for crop funtionallity.
-*            faster version.
+* Description    : Scales a (cropped) NV12 source into a rectangle of an
+*                  NV12 destination. Output rows are split into bands which
+*                  are processed in parallel on a worker pool; every band
+*                  uses the same row kernels so results do not depend on
+*                  the thread count. The row kernels vectorize the vertical
+*                  pass; the horizontal pass gathers samples through the
+*                  column tables and stays scalar.
 ============================================================================*/
-bool
-VT_resizeFrame_Video_opt2_lp(
-        structConvImage* i_img_ptr, /* Points to the input image            */
-        structConvImage* o_img_ptr, /* Points to the output image           */
-        IC_rect_type*  cropout      /* how much to resize to in final image */
-        );
+class NV12Resizer {
+public:
+    /* threads: worker threads of its own in addition to the caller,
+     * -1 to use the process wide Utils::WorkerPool::shared() */
+    NV12Resizer(int threads = -1);
+    ~NV12Resizer();
+
+    /* Returns BAD_VALUE if the requested kernel is not built in */
+    status_t setKernel(NV12ResizeKernel kernel);
+
+    NV12ResizeKernel kernel() const;
+
+    /* src_crop and dst_rect may be NULL to select the whole image */
+    status_t resize(const NV12Image& src, const NV12Rect* src_crop,
+                    const NV12Image& dst, const NV12Rect* dst_rect,
+                    NV12ResizeFilter filter = NV12_RESIZE_FILTER_BILINEAR);
+
+    /* Process wide instance shared by the encoder and preview paths */
+    static NV12Resizer& instance();
+
+    static bool isKernelAvailable(NV12ResizeKernel kernel);
+
+private:
+    NV12ResizeKernel mKernel;
+    Utils::WorkerPool mOwnWorkers;
+    Utils::WorkerPool* mWorkers;
+};
+
+} // namespace Camera
+} // namespace Ti
 
 #endif //#define NV12_RESIZE_H_
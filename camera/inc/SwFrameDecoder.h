@@ -23,23 +23,79 @@
 namespace Ti {
 namespace Camera {
 
+/**
+ * libjpeg based MJPEG decoder. Several frames are decoded at the same time
+ * on a fixed set of threads, each with its own Decoder_libjpeg. Input
+ * buffers are released as soon as their frame is decoded, output buffers
+ * are filled in the order the frames were queued.
+ */
 class SwFrameDecoder: public FrameDecoder {
 public:
+    enum {
+        MAX_DECODE_THREADS = 4,
+    };
+
     SwFrameDecoder();
     virtual ~SwFrameDecoder();
 
 protected:
     virtual void doConfigure(const DecoderParameters& config);
     virtual void doProcessInputBuffer();
-    virtual status_t doStart() { return NO_ERROR; }
-    virtual void doStop() { }
-    virtual void doFlush() { }
+    virtual status_t doStart();
+    virtual void doStop();
+    virtual void doFlush();
     virtual void doRelease() { }
 
 private:
-    int mjpegWithHdrSize;
-    Decoder_libjpeg mJpgdecoder;
-    unsigned char* mJpegWithHeaderBuffer;
+    class DecodeThread : public android::Thread {
+    public:
+        DecodeThread(SwFrameDecoder* decoder, int index)
+            : android::Thread(false), mDecoder(decoder), mIndex(index) {}
+
+        virtual bool threadLoop() {
+            return mDecoder->decodeNext(mIndex);
+        }
+
+    private:
+        SwFrameDecoder* mDecoder;
+        int mIndex;
+    };
+
+    enum JobState {
+        JobState_Queued,
+        JobState_Running,
+        JobState_Done,
+        JobState_Cancelled
+    };
+
+    struct Job {
+        uint32_t sequence;
+        JobState state;
+        bool decoded;
+        int inIndex;
+        int outIndex;
+        unsigned char* src;
+        int filledLen;
+        unsigned char* dst;
+        nsecs_t timestamp;
+    };
+
+    bool decodeNext(int index);
+    void publishDecoded();
+    void stopThreads();
+
+    Decoder_libjpeg mJpgdecoder[MAX_DECODE_THREADS];
+    android::sp<DecodeThread> mThreads[MAX_DECODE_THREADS];
+    int mThreadCount;
+
+    android::Mutex mJobLock;
+    android::Condition mJobCond;
+    android::Condition mDoneCond;
+    // frames in flight, in the order they were queued
+    android::Vector<Job> mJobs;
+    uint32_t mSequence;
+    bool mExit;
+    unsigned int mDropped;
 };
 
 }  // namespace Camera
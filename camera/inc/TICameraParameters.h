@@ -257,6 +257,9 @@ static const char KEY_GAMMA_TABLE[];
 
 static const char KEY_PREVIEW_FRAME_RATE_RANGE[];
 
+//TI extensions for the software jpeg encoder
+static const char KEY_JPEG_ENCODE_BANDS[];
+
 #ifdef MOTOROLA_CAMERA
 static const char KEY_MOT_LEDFLASH[];
 static const char KEY_MOT_LEDTORCH[];
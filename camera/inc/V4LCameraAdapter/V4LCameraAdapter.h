@@ -26,6 +26,7 @@
 #include "DebugUtils.h"
 #include "Decoder_libjpeg.h"
 #include "FrameDecoder.h"
+#include "V4LPreviewPipeline.h"
 
 
 namespace Ti {
@@ -92,7 +93,7 @@ typedef struct V4L_TI_CAPTYPE {
   * TODO: Need to list down here, all the message types that will be supported by this class
                 Need to implement BufferProvider interface to use AllocateBuffer of OMX if needed
   */
-class V4LCameraAdapter : public BaseCameraAdapter
+class V4LCameraAdapter : public BaseCameraAdapter, private V4LPreviewPipeline::Client
 {
 public:
 
@@ -142,6 +143,11 @@ protected:
     virtual void onOrientationEvent(uint32_t orientation, uint32_t tilt);
 //-----------------------------------------------------------------------------
 
+//----------V4LPreviewPipeline::Client implementation---------------------------
+    virtual void releaseInput(int index);
+    virtual void deliverOutput(int index, nsecs_t timestamp);
+//-----------------------------------------------------------------------------
+
 
 private:
 
@@ -206,6 +212,8 @@ private:
     status_t returnBufferToV4L(int id);
     void returnOutputBuffer(int index);
     bool isNeedToUseDecoder() const;
+    status_t startPreviewPipeline();
+    void stopPreviewPipeline();
 
     int mPreviewBufferCount;
     int mPreviewBufferCountQueueable;
@@ -254,6 +262,9 @@ private:
 
     CameraHal* mCameraHal;
     int mSkipFramesCount;
+
+    // YUYV preview conversion and delivery, decoder modes do not use it
+    V4LPreviewPipeline mPreviewPipeline;
 };
 
 } // namespace Camera
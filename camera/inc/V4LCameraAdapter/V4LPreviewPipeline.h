@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L_PREVIEW_PIPELINE_H
+#define V4L_PREVIEW_PIPELINE_H
+
+#include <stdint.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "Common.h"
+#include "Ring.h"
+#include "Semaphore.h"
+#include "WorkerPool.h"
+
+namespace Ti {
+namespace Camera {
+
+/*==========================================================================
+* Class Name     : V4LPreviewPipeline
+*
+* Description    : Converts captured YUYV frames into NV12 preview buffers
+*                  and delivers them in capture order. The capture thread
+*                  only hands dequeued buffers over; a conversion thread
+*                  converts each frame in row bands on a worker pool and
+*                  gives the input straight back to the device, and a
+*                  delivery thread passes the results to the client. The
+*                  stages are connected by bounded lock-free rings, so a
+*                  slow subscriber costs preview buffers, not camera frames.
+============================================================================*/
+class V4LPreviewPipeline {
+public:
+    /* Maximum number of device and preview buffers */
+    static const int MAX_BUFFERS = 16;
+
+    class Client {
+    public:
+        virtual ~Client() {}
+
+        /* Input buffer is no longer used and may be queued to the device.
+         * Called from the conversion thread, or from stop() */
+        virtual void releaseInput(int index) = 0;
+
+        /* Output buffer holds a converted frame. Called from the delivery
+         * thread in capture order; the buffer comes back by releaseOutput() */
+        virtual void deliverOutput(int index, nsecs_t timestamp) = 0;
+    };
+
+    /* Mapping of one NV12 preview buffer */
+    struct Output {
+        uint8_t* y;
+        uint8_t* uv;
+        int      stride;
+    };
+
+    struct StageStats {
+        uint32_t count;
+        nsecs_t  total;
+        nsecs_t  max;
+    };
+
+    struct Stats {
+        uint32_t   captured;
+        uint32_t   delivered;
+        uint32_t   droppedInput;   /* conversion queue full */
+        uint32_t   droppedOutput;  /* no free preview buffer */
+        StageStats queued;         /* capture to conversion start */
+        StageStats convert;        /* band parallel conversion */
+        StageStats handoff;        /* conversion end to delivery start */
+        StageStats deliver;        /* time spent in the client */
+        StageStats total;          /* capture to delivery end */
+    };
+
+    V4LPreviewPipeline(Client* client);
+    ~V4LPreviewPipeline();
+
+    /* outputs[0, freeOutputs) start out owned by the pipeline, the rest
+     * are expected to come back through releaseOutput() */
+    status_t start(int width, int height, int inputStride,
+                   const Output* outputs, int outputCount, int freeOutputs);
+
+    /* Stops and joins the stages, pending inputs are released */
+    void stop();
+
+    bool isRunning() const;
+
+    /* Capture stage: hand a filled YUYV buffer over. Returns NO_MEMORY
+     * if the conversion queue is full, the caller keeps the buffer then */
+    status_t queueInput(int index, const uint8_t* data, nsecs_t timestamp);
+
+    /* Preview buffer is free again, may be called from any thread */
+    status_t releaseOutput(int index);
+
+    void getStats(Stats& stats) const;
+
+private:
+    struct Input {
+        int            index;
+        const uint8_t* data;
+        nsecs_t        timestamp;
+        nsecs_t        queued;
+        uint32_t       sequence;
+    };
+
+    struct Converted {
+        int      index;
+        nsecs_t  timestamp;
+        nsecs_t  queued;
+        nsecs_t  converted;
+        uint32_t sequence;
+    };
+
+    class StageThread : public android::Thread {
+    public:
+        typedef bool (V4LPreviewPipeline::*Step)();
+
+        StageThread(V4LPreviewPipeline* pipeline, Step step) :
+                Thread(false), mPipeline(pipeline), mStep(step) { }
+
+        virtual bool threadLoop() {
+            return (mPipeline->*mStep)();
+        }
+
+    private:
+        V4LPreviewPipeline* mPipeline;
+        Step mStep;
+    };
+
+    bool convertNext();
+    bool deliverNext();
+
+    static void convertBand(void* arg, int band);
+    static void account(StageStats& stage, nsecs_t duration);
+
+private:
+    Client* mClient;
+
+    int mWidth;
+    int mHeight;
+    int mInputStride;
+    int mBands;
+    Output mOutputs[MAX_BUFFERS];
+    int mOutputCount;
+
+    /* band job of the frame being converted */
+    const uint8_t* mBandSrc;
+    const Output* mBandDst;
+
+    Utils::Ring<Input, MAX_BUFFERS> mInputs;
+    Utils::Ring<Converted, MAX_BUFFERS> mConverted;
+    Utils::Ring<int, MAX_BUFFERS> mFreeOutputs;
+    /* serializes the producers of mFreeOutputs */
+    android::Mutex mFreeOutputsLock;
+    Utils::Semaphore mInputSem;
+    Utils::Semaphore mConvertedSem;
+
+    Utils::WorkerPool mWorkers;
+    android::sp<StageThread> mConvertThread;
+    android::sp<StageThread> mDeliverThread;
+    volatile bool mRunning;
+    volatile bool mExit;
+
+    uint32_t mSequence;
+    uint32_t mLastDelivered;
+
+    /* updated by all three stages */
+    mutable android::Mutex mStatsLock;
+    Stats mStats;
+};
+
+} // namespace Camera
+} // namespace Ti
+
+#endif // V4L_PREVIEW_PIPELINE_H
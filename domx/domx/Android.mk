@@ -8,7 +8,12 @@ LOCAL_SRC_FILES:= \
     omx_rpc/src/omx_rpc_stub.c \
     omx_rpc/src/omx_rpc_config.c \
     omx_rpc/src/omx_rpc_platform.c \
+    omx_rpc/src/omx_rpc_packet.c \
+    omx_rpc/src/omx_rpc_async.c \
+    omx_rpc/src/omx_rpc_ioncache.c \
     omx_proxy_common/src/omx_proxy_common.c \
+    omx_proxy_common/src/omx_proxy_buflist.c \
+    omx_proxy_common/src/omx_proxy_cache.c \
     profiling/src/profile.c \
     plugins/memplugin.c \
     plugins/memplugin_table.c \
@@ -82,6 +82,13 @@ extern "C"
 #define OMX_VER_MINOR 0x1
 
 #define MAX_NUM_PROXY_BUFFERS             100
+#define PROXY_BUFFER_NONE                 MAX_NUM_PROXY_BUFFERS
+/*Buffer header index, at least twice MAX_NUM_PROXY_BUFFERS entries*/
+#define PROXY_BUFLIST_HASH_BITS           8
+#define PROXY_BUFLIST_HASH_SIZE           (1 << PROXY_BUFLIST_HASH_BITS)
+/*Parameter/config cache, entries hold the largest cacheable structure*/
+#define PROXY_CACHE_ENTRIES               16
+#define PROXY_CACHE_DATA_SIZE             256
 #define MAX_COMPONENT_NAME_LENGTH         128
 #define PROXY_MAXNUMOFPORTS               8
 
@@ -220,6 +227,50 @@ extern "C"
 		OMX_U32 IsBuffer2D;   /*Used when buffer pointers come from Gralloc allocations */
 	} PROXY_PORT_TYPE;
 
+/*===============================================================*/
+/** PROXY_CACHE_ENTRY        : A parameter or config structure cached by the
+ *                             proxy.
+ *
+ * @param nPortIndex         : Port of the structure, 0 for structures that
+ *                             are not specific to a port.
+ *
+ * @param tData              : Copy of the structure as the remote core
+ *                             returned it.
+ */
+/*===============================================================*/
+	typedef struct PROXY_CACHE_ENTRY
+	{
+		OMX_BOOL bValid;
+		OMX_BOOL bConfig;
+		OMX_U32 nIndex;
+		OMX_U32 nPortIndex;
+		OMX_U32 tData[PROXY_CACHE_DATA_SIZE / sizeof(OMX_U32)];
+	} PROXY_CACHE_ENTRY;
+
+/*===============================================================*/
+/** PROXY_PARAM_CACHE        : Cache of GetParameter/GetConfig results for
+ *                             the whitelisted indexes in omx_proxy_cache.c.
+ *
+ * @param bEnabled           : Set from debug.domx.param_cache.
+ *
+ * @param nGeneration        : Bumped on every invalidation, so that a result
+ *                             fetched across one is not stored.
+ *
+ * @param nHits, nMisses, nInvalidations : Reported by the KPI profiler.
+ */
+/*===============================================================*/
+	typedef struct PROXY_PARAM_CACHE
+	{
+		OMX_BOOL bEnabled;
+		pthread_mutex_t tLock;
+		OMX_U32 nGeneration;
+		OMX_U32 nNext;
+		OMX_U32 nHits;
+		OMX_U32 nMisses;
+		OMX_U32 nInvalidations;
+		PROXY_CACHE_ENTRY tEntries[PROXY_CACHE_ENTRIES];
+	} PROXY_PARAM_CACHE;
+
 #ifdef ENABLE_RAW_BUFFERS_DUMP_UTILITY
 /*===============================================================*/
 /** DebugFrame_Dump     : Structure holding the info about frames to dump
@@ -251,6 +302,11 @@ extern "C"
 /* ========================================================================== */
 /**
 * struct PROXY_COMPONENT_PRIVATE
+*		@param tLocalIndex: Open addressed hash of local buffer headers
+*		                    to their slot in tBufList
+*		@param tRemoteIndex: Same for remote buffer headers
+*		@param tFreeSlots: Stack of freed slots below nTotalBuffers
+*		@param tParamCache: Cached parameters and configs
 *		@param nMemmgr_client_desc: Memory manager client descriptor
 * 		@param bMapBuffers: buffers need to be mapped or not
 */
@@ -267,6 +323,12 @@ extern "C"
 		OMX_BOOL IsLoadedState;
 		OMX_U32 nTotalBuffers;
 		OMX_U32 nAllocatedBuffers;
+		OMX_U8 tLocalIndex[PROXY_BUFLIST_HASH_SIZE];
+		OMX_U8 tRemoteIndex[PROXY_BUFLIST_HASH_SIZE];
+		OMX_U8 tFreeSlots[MAX_NUM_PROXY_BUFFERS];
+		OMX_U32 nFreeSlots;
+		PROXY_PARAM_CACHE tParamCache;
+		OMX_PTR pKpi;	/*KPI monitoring state, see profile.c*/
 
 		/* PROXY specific data - PROXY PRIVATE DATA */
 		OMX_PTR pCompProxyPrv;
@@ -338,6 +400,40 @@ extern "C"
 	    OMX_IN OMX_U32 nPortIndex, OMX_IN OMX_BUFFERHEADERTYPE * pBufferHdr);
 	OMX_ERRORTYPE PROXY_ComponentDeInit(OMX_HANDLETYPE hComponent);
 
+	void PROXY_BufListReset(PROXY_COMPONENT_PRIVATE * pCompPrv);
+	OMX_U32 PROXY_BufListNextSlot(PROXY_COMPONENT_PRIVATE * pCompPrv);
+	void PROXY_BufListAdd(PROXY_COMPONENT_PRIVATE * pCompPrv,
+	    OMX_U32 nSlot);
+	void PROXY_BufListRemove(PROXY_COMPONENT_PRIVATE * pCompPrv,
+	    OMX_U32 nSlot);
+	OMX_U32 PROXY_BufListFindLocal(PROXY_COMPONENT_PRIVATE * pCompPrv,
+	    OMX_BUFFERHEADERTYPE * pBufHeader);
+	OMX_U32 PROXY_BufListFindRemote(PROXY_COMPONENT_PRIVATE * pCompPrv,
+	    OMX_U32 nBufHeaderRemote);
+
+	void PROXY_CacheInit(PROXY_COMPONENT_PRIVATE * pCompPrv);
+	void PROXY_CacheDeInit(PROXY_COMPONENT_PRIVATE * pCompPrv);
+	OMX_BOOL PROXY_CacheLookup(PROXY_COMPONENT_PRIVATE * pCompPrv,
+	    OMX_BOOL bConfig, OMX_INDEXTYPE nIndex, OMX_PTR pStruct,
+	    OMX_U32 * pGeneration);
+	void PROXY_CacheStore(PROXY_COMPONENT_PRIVATE * pCompPrv,
+	    OMX_BOOL bConfig, OMX_INDEXTYPE nIndex, OMX_PTR pStruct,
+	    OMX_U32 nGeneration);
+	void PROXY_CacheInvalidate(PROXY_COMPONENT_PRIVATE * pCompPrv);
+
+	RPC_OMX_ERRORTYPE RPC_MapIonBuffer(RPC_OMX_CONTEXT * hCtx, int fd1,
+	    int fd2, OMX_PTR * handle1, OMX_PTR * handle2,
+	    PROXY_BUFFER_TYPE proxyBufferType);
+	RPC_OMX_ERRORTYPE RPC_UnMapIonBuffer(RPC_OMX_CONTEXT * hCtx,
+	    OMX_PTR handle1, OMX_PTR handle2,
+	    PROXY_BUFFER_TYPE proxyBufferType);
+	RPC_OMX_ERRORTYPE RPC_IonCacheRegister(RPC_OMX_CONTEXT * hCtx,
+	    int fd1, int fd2, OMX_PTR * handle1, OMX_PTR * handle2,
+	    PROXY_BUFFER_TYPE proxyBufferType);
+	RPC_OMX_ERRORTYPE RPC_IonCacheUnRegister(RPC_OMX_CONTEXT * hCtx,
+	    OMX_PTR handle1, OMX_PTR handle2,
+	    PROXY_BUFFER_TYPE proxyBufferType);
+
 
 #ifdef __cplusplus
 }
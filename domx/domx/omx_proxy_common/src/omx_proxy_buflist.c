@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  omx_proxy_buflist.c
+ *         This file contains the buffer header index of the OpenMAX1.1
+ *         DOMX proxy. It maps local and remote buffer headers to their
+ *         slot in the tBufList of the proxy component private.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\omx_proxy_common\src
+ *
+ *  @rev 1.0
+ */
+
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <OMX_Core.h>
+#include <timm_osal_interfaces.h>
+
+
+/*-------program files ----------------------------------------*/
+#include "omx_proxy_common.h"
+
+
+/******************************************************************
+ *   MACROS - LOCAL
+ ******************************************************************/
+/*Index entries hold the slot plus one so that a zeroed index is empty.
+  Removed entries become tombstones rather than empty so that a probe
+  running concurrently on the callback thread never stops short of an
+  entry further down the chain*/
+#define PROXY_BUFLIST_EMPTY   0
+#define PROXY_BUFLIST_DELETED 0xFF
+#define PROXY_BUFLIST_MASK    (PROXY_BUFLIST_HASH_SIZE - 1)
+
+#if MAX_NUM_PROXY_BUFFERS >= PROXY_BUFLIST_DELETED
+#error "MAX_NUM_PROXY_BUFFERS does not fit the buffer index"
+#endif
+
+#if (PROXY_BUFLIST_HASH_SIZE & PROXY_BUFLIST_MASK) || \
+    (PROXY_BUFLIST_HASH_SIZE < 2 * MAX_NUM_PROXY_BUFFERS)
+#error "PROXY_BUFLIST_HASH_SIZE must be a power of two of at least twice MAX_NUM_PROXY_BUFFERS"
+#endif
+
+/*Buffer headers are heap blocks, the low bits carry no information*/
+#define PROXY_BUFLIST_HASH(nKey) \
+    ((((nKey) >> 3) * 2654435761u) >> (32 - PROXY_BUFLIST_HASH_BITS))
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListFind()
+ * @brief Probes one of the two indexes for a key.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param pIndex [IN] : tLocalIndex or tRemoteIndex.
+ * @param nKey [IN] : Local or remote buffer header.
+ * @param bRemote [IN] : Whether nKey is a remote buffer header.
+ * @return Slot in tBufList, PROXY_BUFFER_NONE if the header is not known
+ */
+/* ===========================================================================*/
+static OMX_U32 PROXY_BufListFind(PROXY_COMPONENT_PRIVATE * pCompPrv,
+    OMX_U8 * pIndex, OMX_U32 nKey, OMX_BOOL bRemote)
+{
+	OMX_U32 nHash = PROXY_BUFLIST_HASH(nKey);
+	OMX_U32 i = 0, nSlot = 0, nSlotKey = 0;
+	OMX_U8 nEntry = 0;
+
+	for (i = 0; i < PROXY_BUFLIST_HASH_SIZE; i++)
+	{
+		nEntry =
+		    __atomic_load_n(&pIndex[(nHash + i) & PROXY_BUFLIST_MASK],
+		    __ATOMIC_ACQUIRE);
+		if (nEntry == PROXY_BUFLIST_EMPTY)
+			break;
+		if (nEntry == PROXY_BUFLIST_DELETED)
+			continue;
+
+		nSlot = nEntry - 1;
+		nSlotKey = bRemote ? pCompPrv->tBufList[nSlot].pBufHeaderRemote :
+		    (OMX_U32) pCompPrv->tBufList[nSlot].pBufHeader;
+		if (nSlotKey == nKey)
+			return nSlot;
+	}
+
+	return PROXY_BUFFER_NONE;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListInsert()
+ * @brief Adds a slot to one of the two indexes, reusing the first empty or
+ *        removed entry of the probe chain.
+ * @param pIndex [IN] : tLocalIndex or tRemoteIndex.
+ * @param nKey [IN] : Local or remote buffer header.
+ * @param nSlot [IN] : Slot in tBufList.
+ * @return none
+ */
+/* ===========================================================================*/
+static void PROXY_BufListInsert(OMX_U8 * pIndex, OMX_U32 nKey,
+    OMX_U32 nSlot)
+{
+	OMX_U32 nHash = PROXY_BUFLIST_HASH(nKey);
+	OMX_U32 i = 0;
+	OMX_U8 *pEntry = NULL;
+
+	/*At most MAX_NUM_PROXY_BUFFERS entries are live, so there is always
+	  room */
+	for (i = 0; i < PROXY_BUFLIST_HASH_SIZE; i++)
+	{
+		pEntry = &pIndex[(nHash + i) & PROXY_BUFLIST_MASK];
+		if (*pEntry == PROXY_BUFLIST_EMPTY ||
+		    *pEntry == PROXY_BUFLIST_DELETED)
+		{
+			/*Publishes the tBufList entry written before */
+			__atomic_store_n(pEntry, (OMX_U8) (nSlot + 1),
+			    __ATOMIC_RELEASE);
+			return;
+		}
+	}
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListErase()
+ * @brief Turns the index entry of a slot into a tombstone.
+ * @param pIndex [IN] : tLocalIndex or tRemoteIndex.
+ * @param nKey [IN] : Local or remote buffer header.
+ * @param nSlot [IN] : Slot in tBufList.
+ * @return none
+ */
+/* ===========================================================================*/
+static void PROXY_BufListErase(OMX_U8 * pIndex, OMX_U32 nKey,
+    OMX_U32 nSlot)
+{
+	OMX_U32 nHash = PROXY_BUFLIST_HASH(nKey);
+	OMX_U32 i = 0;
+	OMX_U8 *pEntry = NULL;
+
+	for (i = 0; i < PROXY_BUFLIST_HASH_SIZE; i++)
+	{
+		pEntry = &pIndex[(nHash + i) & PROXY_BUFLIST_MASK];
+		if (*pEntry == PROXY_BUFLIST_EMPTY)
+			return;
+		if (*pEntry == nSlot + 1)
+		{
+			__atomic_store_n(pEntry, (OMX_U8) PROXY_BUFLIST_DELETED,
+			    __ATOMIC_RELEASE);
+			return;
+		}
+	}
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListReset()
+ * @brief Empties the buffer index. Only called while the proxy has no
+ *        buffers, which also drops the tombstones left by FreeBuffer.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_BufListReset(PROXY_COMPONENT_PRIVATE * pCompPrv)
+{
+	TIMM_OSAL_Memset(pCompPrv->tLocalIndex, 0,
+	    sizeof(pCompPrv->tLocalIndex));
+	TIMM_OSAL_Memset(pCompPrv->tRemoteIndex, 0,
+	    sizeof(pCompPrv->tRemoteIndex));
+	pCompPrv->nFreeSlots = 0;
+	pCompPrv->nTotalBuffers = 0;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListNextSlot()
+ * @brief Returns the slot the next UseBuffer/AllocateBuffer will fill: the
+ *        slot freed last, or the first one never used.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @return Slot in tBufList, PROXY_BUFFER_NONE if all slots are in use
+ */
+/* ===========================================================================*/
+OMX_U32 PROXY_BufListNextSlot(PROXY_COMPONENT_PRIVATE * pCompPrv)
+{
+	if (pCompPrv->nFreeSlots > 0)
+		return pCompPrv->tFreeSlots[pCompPrv->nFreeSlots - 1];
+	if (pCompPrv->nTotalBuffers < MAX_NUM_PROXY_BUFFERS)
+		return pCompPrv->nTotalBuffers;
+	return PROXY_BUFFER_NONE;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListAdd()
+ * @brief Indexes a slot returned by PROXY_BufListNextSlot() once its local
+ *        and remote buffer headers are set.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param nSlot [IN] : Slot in tBufList.
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_BufListAdd(PROXY_COMPONENT_PRIVATE * pCompPrv, OMX_U32 nSlot)
+{
+	if (pCompPrv->nFreeSlots > 0 &&
+	    pCompPrv->tFreeSlots[pCompPrv->nFreeSlots - 1] == nSlot)
+	{
+		pCompPrv->nFreeSlots--;
+	}
+
+	PROXY_BufListInsert(pCompPrv->tLocalIndex,
+	    (OMX_U32) pCompPrv->tBufList[nSlot].pBufHeader, nSlot);
+	PROXY_BufListInsert(pCompPrv->tRemoteIndex,
+	    pCompPrv->tBufList[nSlot].pBufHeaderRemote, nSlot);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListRemove()
+ * @brief Drops a slot from the index and makes it the next one to be
+ *        reused. Must be called before the tBufList entry is cleared.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param nSlot [IN] : Slot in tBufList.
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_BufListRemove(PROXY_COMPONENT_PRIVATE * pCompPrv, OMX_U32 nSlot)
+{
+	PROXY_BufListErase(pCompPrv->tLocalIndex,
+	    (OMX_U32) pCompPrv->tBufList[nSlot].pBufHeader, nSlot);
+	PROXY_BufListErase(pCompPrv->tRemoteIndex,
+	    pCompPrv->tBufList[nSlot].pBufHeaderRemote, nSlot);
+
+	pCompPrv->tFreeSlots[pCompPrv->nFreeSlots++] = (OMX_U8) nSlot;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListFindLocal()
+ * @brief Looks up the slot of a local buffer header.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param pBufHeader [IN] : Local buffer header.
+ * @return Slot in tBufList, PROXY_BUFFER_NONE if the header is not known
+ */
+/* ===========================================================================*/
+OMX_U32 PROXY_BufListFindLocal(PROXY_COMPONENT_PRIVATE * pCompPrv,
+    OMX_BUFFERHEADERTYPE * pBufHeader)
+{
+	if (pBufHeader == NULL)
+		return PROXY_BUFFER_NONE;
+
+	return PROXY_BufListFind(pCompPrv, pCompPrv->tLocalIndex,
+	    (OMX_U32) pBufHeader, OMX_FALSE);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_BufListFindRemote()
+ * @brief Looks up the slot of a remote buffer header.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param nBufHeaderRemote [IN] : Remote buffer header.
+ * @return Slot in tBufList, PROXY_BUFFER_NONE if the header is not known
+ */
+/* ===========================================================================*/
+OMX_U32 PROXY_BufListFindRemote(PROXY_COMPONENT_PRIVATE * pCompPrv,
+    OMX_U32 nBufHeaderRemote)
+{
+	if (nBufHeaderRemote == 0)
+		return PROXY_BUFFER_NONE;
+
+	return PROXY_BufListFind(pCompPrv, pCompPrv->tRemoteIndex,
+	    nBufHeaderRemote, OMX_TRUE);
+}
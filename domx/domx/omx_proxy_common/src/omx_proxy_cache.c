@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  omx_proxy_cache.c
+ *         This file contains the parameter and config cache of the
+ *         OpenMAX1.1 DOMX proxy. Structures that only change through the
+ *         client or through events the proxy sees are answered locally
+ *         instead of with an RPC round trip.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\omx_proxy_common\src
+ *
+ *  @rev 1.0
+ */
+
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _Android
+#include <cutils/properties.h>
+#endif
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+#include <timm_osal_interfaces.h>
+#include <timm_osal_trace.h>
+
+
+/*-------program files ----------------------------------------*/
+#include "omx_proxy_common.h"
+#include "OMX_TI_Index.h"
+#include "OMX_TI_Common.h"
+
+
+/******************************************************************
+ *   MACROS - LOCAL
+ ******************************************************************/
+/*Common head of the structures that are specific to one port*/
+typedef struct PROXY_CACHE_PORT_STRUCT
+{
+	OMX_U32 nSize;
+	OMX_VERSIONTYPE nVersion;
+	OMX_U32 nPortIndex;
+} PROXY_CACHE_PORT_STRUCT;
+
+/*Cacheable index together with the structure it takes*/
+typedef struct PROXY_CACHE_INDEX
+{
+	OMX_BOOL bConfig;
+	OMX_U32 nIndex;
+	OMX_U32 nStructSize;
+	OMX_BOOL bPerPort;
+} PROXY_CACHE_INDEX;
+
+/*Only structures the remote component changes on its own solely together
+  with OMX_EventPortSettingsChanged or a command completing. Anything
+  that moves while executing, like statistics or timestamps, stays out */
+static const PROXY_CACHE_INDEX tCacheIndexes[] = {
+	{OMX_FALSE, OMX_IndexParamPortDefinition,
+	    sizeof(OMX_PARAM_PORTDEFINITIONTYPE), OMX_TRUE},
+	{OMX_FALSE, OMX_IndexParamStandardComponentRole,
+	    sizeof(OMX_PARAM_COMPONENTROLETYPE), OMX_FALSE},
+	{OMX_FALSE, OMX_IndexParamVideoInit,
+	    sizeof(OMX_PORT_PARAM_TYPE), OMX_FALSE},
+	{OMX_FALSE, OMX_IndexParamImageInit,
+	    sizeof(OMX_PORT_PARAM_TYPE), OMX_FALSE},
+	{OMX_FALSE, OMX_IndexParamAudioInit,
+	    sizeof(OMX_PORT_PARAM_TYPE), OMX_FALSE},
+	{OMX_FALSE, OMX_IndexParamOtherInit,
+	    sizeof(OMX_PORT_PARAM_TYPE), OMX_FALSE},
+	{OMX_FALSE, OMX_TI_IndexParam2DBufferAllocDimension,
+	    sizeof(OMX_CONFIG_RECTTYPE), OMX_TRUE},
+	{OMX_TRUE, OMX_IndexConfigCommonOutputCrop,
+	    sizeof(OMX_CONFIG_RECTTYPE), OMX_TRUE}
+};
+
+#define PROXY_CACHE_NUM_INDEXES \
+    (sizeof(tCacheIndexes) / sizeof(tCacheIndexes[0]))
+
+/*Every structure of tCacheIndexes has to fit an entry*/
+typedef union PROXY_CACHE_DATA
+{
+	OMX_PARAM_PORTDEFINITIONTYPE tPortDef;
+	OMX_PARAM_COMPONENTROLETYPE tRole;
+	OMX_PORT_PARAM_TYPE tPorts;
+	OMX_CONFIG_RECTTYPE tRect;
+} PROXY_CACHE_DATA;
+
+typedef char PROXY_CACHE_DATA_FITS[(sizeof(PROXY_CACHE_DATA) <=
+    PROXY_CACHE_DATA_SIZE) ? 1 : -1];
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheFindIndex()
+ * @brief Looks up an index in the whitelist.
+ * @param bConfig [IN] : Config rather than parameter index.
+ * @param nIndex [IN] : Parameter or config index.
+ * @param pStruct [IN] : Structure passed by the client.
+ * @return Whitelist entry, NULL if the index or structure is not cacheable
+ */
+/* ===========================================================================*/
+static const PROXY_CACHE_INDEX *PROXY_CacheFindIndex(OMX_BOOL bConfig,
+    OMX_INDEXTYPE nIndex, OMX_PTR pStruct)
+{
+	OMX_U32 i = 0;
+
+	for (i = 0; i < PROXY_CACHE_NUM_INDEXES; i++)
+	{
+		if (tCacheIndexes[i].bConfig == bConfig &&
+		    tCacheIndexes[i].nIndex == (OMX_U32) nIndex)
+		{
+			/*A client using an older structure layout goes to the
+			  remote core, which knows how to deal with it */
+			if (((PROXY_CACHE_PORT_STRUCT *) pStruct)->nSize !=
+			    tCacheIndexes[i].nStructSize)
+				return NULL;
+			return &tCacheIndexes[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheFindEntry()
+ * @brief Looks up the valid entry of an index and port. Called with the
+ *        cache lock held.
+ * @param pCache [IN] : Cache of the proxy component.
+ * @param pIndex [IN] : Whitelist entry of the index.
+ * @param nPortIndex [IN] : Port, 0 for structures not specific to a port.
+ * @return Entry, NULL if nothing is cached
+ */
+/* ===========================================================================*/
+static PROXY_CACHE_ENTRY *PROXY_CacheFindEntry(PROXY_PARAM_CACHE * pCache,
+    const PROXY_CACHE_INDEX * pIndex, OMX_U32 nPortIndex)
+{
+	PROXY_CACHE_ENTRY *pEntry = NULL;
+	OMX_U32 i = 0;
+
+	for (i = 0; i < PROXY_CACHE_ENTRIES; i++)
+	{
+		pEntry = &pCache->tEntries[i];
+		if (pEntry->bValid && pEntry->bConfig == pIndex->bConfig &&
+		    pEntry->nIndex == pIndex->nIndex &&
+		    pEntry->nPortIndex == nPortIndex)
+			return pEntry;
+	}
+
+	return NULL;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheInit()
+ * @brief Sets up the cache of a proxy component. The cache is off unless
+ *        DEBUG_DOMX_PARAM_CACHE or debug.domx.param_cache is non zero.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_CacheInit(PROXY_COMPONENT_PRIVATE * pCompPrv)
+{
+	PROXY_PARAM_CACHE *pCache = &pCompPrv->tParamCache;
+	OMX_S32 nEnable = 0;
+	char *val = getenv("DEBUG_DOMX_PARAM_CACHE");
+
+	if (val)
+	{
+		nEnable = strtol(val, NULL, 0);
+	}
+#ifdef _Android
+	else
+	{
+		char value[PROPERTY_VALUE_MAX];
+
+		if (property_get("debug.domx.param_cache", value, NULL) > 0)
+			nEnable = atoi(value);
+	}
+#endif
+
+	TIMM_OSAL_Memset(pCache, 0, sizeof(PROXY_PARAM_CACHE));
+	pthread_mutex_init(&pCache->tLock, NULL);
+	pCache->bEnabled = (nEnable > 0) ? OMX_TRUE : OMX_FALSE;
+	DOMX_DEBUG("Parameter cache %s", pCache->bEnabled ? "on" : "off");
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheDeInit()
+ * @brief Releases the cache of a proxy component.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_CacheDeInit(PROXY_COMPONENT_PRIVATE * pCompPrv)
+{
+	pthread_mutex_destroy(&pCompPrv->tParamCache.tLock);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheLookup()
+ * @brief Fills a parameter or config structure from the cache.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param bConfig [IN] : Config rather than parameter index.
+ * @param nIndex [IN] : Parameter or config index.
+ * @param pStruct [INOUT] : Structure passed by the client.
+ * @param pGeneration [OUT] : To be handed to PROXY_CacheStore() on a miss.
+ * @return OMX_TRUE if pStruct was filled
+ */
+/* ===========================================================================*/
+OMX_BOOL PROXY_CacheLookup(PROXY_COMPONENT_PRIVATE * pCompPrv,
+    OMX_BOOL bConfig, OMX_INDEXTYPE nIndex, OMX_PTR pStruct,
+    OMX_U32 * pGeneration)
+{
+	PROXY_PARAM_CACHE *pCache = &pCompPrv->tParamCache;
+	const PROXY_CACHE_INDEX *pIndex = NULL;
+	PROXY_CACHE_ENTRY *pEntry = NULL;
+	OMX_U32 nPortIndex = 0;
+
+	if (!pCache->bEnabled)
+		return OMX_FALSE;
+	pIndex = PROXY_CacheFindIndex(bConfig, nIndex, pStruct);
+	if (pIndex == NULL)
+		return OMX_FALSE;
+	if (pIndex->bPerPort)
+		nPortIndex = ((PROXY_CACHE_PORT_STRUCT *) pStruct)->nPortIndex;
+
+	pthread_mutex_lock(&pCache->tLock);
+	*pGeneration = pCache->nGeneration;
+	pEntry = PROXY_CacheFindEntry(pCache, pIndex, nPortIndex);
+	if (pEntry != NULL)
+	{
+		TIMM_OSAL_Memcpy(pStruct, pEntry->tData, pIndex->nStructSize);
+		pCache->nHits++;
+	} else
+	{
+		pCache->nMisses++;
+	}
+	pthread_mutex_unlock(&pCache->tLock);
+
+	return (pEntry != NULL) ? OMX_TRUE : OMX_FALSE;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheStore()
+ * @brief Keeps the structure the remote core returned for a cacheable
+ *        index. Dropped if the cache was invalidated since the lookup, the
+ *        value may predate whatever caused the invalidation.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @param bConfig [IN] : Config rather than parameter index.
+ * @param nIndex [IN] : Parameter or config index.
+ * @param pStruct [IN] : Structure returned by the remote core.
+ * @param nGeneration [IN] : As returned by PROXY_CacheLookup().
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_CacheStore(PROXY_COMPONENT_PRIVATE * pCompPrv, OMX_BOOL bConfig,
+    OMX_INDEXTYPE nIndex, OMX_PTR pStruct, OMX_U32 nGeneration)
+{
+	PROXY_PARAM_CACHE *pCache = &pCompPrv->tParamCache;
+	const PROXY_CACHE_INDEX *pIndex = NULL;
+	PROXY_CACHE_ENTRY *pEntry = NULL;
+	OMX_U32 nPortIndex = 0;
+
+	if (!pCache->bEnabled)
+		return;
+	pIndex = PROXY_CacheFindIndex(bConfig, nIndex, pStruct);
+	if (pIndex == NULL)
+		return;
+	if (pIndex->bPerPort)
+		nPortIndex = ((PROXY_CACHE_PORT_STRUCT *) pStruct)->nPortIndex;
+
+	pthread_mutex_lock(&pCache->tLock);
+	if (nGeneration == pCache->nGeneration)
+	{
+		pEntry = PROXY_CacheFindEntry(pCache, pIndex, nPortIndex);
+		if (pEntry == NULL)
+		{
+			/*Round robin, the working set is a handful of entries */
+			pEntry = &pCache->tEntries[pCache->nNext];
+			pCache->nNext = (pCache->nNext + 1) % PROXY_CACHE_ENTRIES;
+		}
+		pEntry->bValid = OMX_TRUE;
+		pEntry->bConfig = pIndex->bConfig;
+		pEntry->nIndex = pIndex->nIndex;
+		pEntry->nPortIndex = nPortIndex;
+		TIMM_OSAL_Memcpy(pEntry->tData, pStruct, pIndex->nStructSize);
+	}
+	pthread_mutex_unlock(&pCache->tLock);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_CacheInvalidate()
+ * @brief Drops every cached structure. Called once a SetParameter,
+ *        SetConfig, SendCommand or buffer allocation has gone through to
+ *        the remote core and on events that report remote changes.
+ * @param pCompPrv [IN] : Proxy component private.
+ * @return none
+ */
+/* ===========================================================================*/
+void PROXY_CacheInvalidate(PROXY_COMPONENT_PRIVATE * pCompPrv)
+{
+	PROXY_PARAM_CACHE *pCache = &pCompPrv->tParamCache;
+	OMX_U32 i = 0;
+
+	if (!pCache->bEnabled)
+		return;
+
+	pthread_mutex_lock(&pCache->tLock);
+	for (i = 0; i < PROXY_CACHE_ENTRIES; i++)
+		pCache->tEntries[i].bValid = OMX_FALSE;
+	pCache->nGeneration++;
+	pCache->nInvalidations++;
+	pthread_mutex_unlock(&pCache->tLock);
+}
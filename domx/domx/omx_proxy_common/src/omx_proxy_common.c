@@ -132,7 +132,6 @@ RPC_OMX_ERRORTYPE RPC_RegisterBuffer(OMX_HANDLETYPE hRPCCtx, int fd1, int fd2,
 				     PROXY_BUFFER_TYPE proxyBufferType)
 {
 	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
-	int status;
 	RPC_OMX_CONTEXT *pRPCCtx = (RPC_OMX_CONTEXT *) hRPCCtx;
 
 	if ((fd1 < 0) || (handle1 ==  NULL) ||
@@ -142,6 +141,45 @@ RPC_OMX_ERRORTYPE RPC_RegisterBuffer(OMX_HANDLETYPE hRPCCtx, int fd1, int fd2,
 		goto EXIT;
 	}
 
+	/*A loopback remote core never maps buffers, the fds serve as handles */
+	if (pRPCCtx->bLoopback == OMX_TRUE)
+	{
+		*handle1 = (OMX_PTR) fd1;
+		if (handle2 != NULL)
+			*handle2 = (fd2 >= 0) ? (OMX_PTR) fd2 : NULL;
+		goto EXIT;
+	}
+
+	/*Buffers come back on every port reconfiguration, reuse their mapping */
+	eRPCError = RPC_IonCacheRegister(pRPCCtx, fd1, fd2, handle1, handle2,
+	    proxyBufferType);
+
+EXIT:
+	return eRPCError;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_MapIonBuffer()
+ * @brief Registers a buffer with the remote core, bypassing the mapping
+ *        cache.
+ * @param pRPCCtx [IN] : RPC Context structure.
+ * @param fd1, fd2 [IN] : Buffer components, fd2 only for two component
+ *                        types.
+ * @param handle1, handle2 [OUT] : Handles to pass to the remote core.
+ * @param proxyBufferType [IN] : Kind of buffer.
+ * @return RPC_OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+RPC_OMX_ERRORTYPE RPC_MapIonBuffer(RPC_OMX_CONTEXT * pRPCCtx, int fd1, int fd2,
+				   OMX_PTR *handle1, OMX_PTR *handle2,
+				   PROXY_BUFFER_TYPE proxyBufferType)
+{
+	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
+	int status;
+
     if(proxyBufferType == BufferDescriptorVirtual2D)
     {
         struct ion_fd_data ion_data;
@@ -266,14 +304,42 @@ EXIT:
 RPC_OMX_ERRORTYPE RPC_UnRegisterBuffer(OMX_HANDLETYPE hRPCCtx, OMX_PTR handle1, OMX_PTR handle2, PROXY_BUFFER_TYPE proxyBufferType)
 {
 	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
-	int status;
-	struct ion_fd_data data;
 	RPC_OMX_CONTEXT *pRPCCtx = (RPC_OMX_CONTEXT *) hRPCCtx;
 
 	if ((handle1 ==  NULL) || ((proxyBufferType == BufferDescriptorVirtual2D) && (handle2 ==  NULL))) {
 		eRPCError = RPC_OMX_ErrorBadParameter;
 		goto EXIT;
 	}
+	if (pRPCCtx->bLoopback == OMX_TRUE)
+		goto EXIT;
+
+	/*A cached mapping stays on the remote core until evicted */
+	eRPCError = RPC_IonCacheUnRegister(pRPCCtx, handle1, handle2,
+	    proxyBufferType);
+
+ EXIT:
+	return eRPCError;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_UnMapIonBuffer()
+ * @brief Unregisters a buffer from the remote core, bypassing the mapping
+ *        cache.
+ * @param pRPCCtx [IN] : RPC Context structure.
+ * @param handle1, handle2 [IN] : Handles returned by RPC_MapIonBuffer.
+ * @param proxyBufferType [IN] : Kind of buffer.
+ * @return RPC_OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+RPC_OMX_ERRORTYPE RPC_UnMapIonBuffer(RPC_OMX_CONTEXT * pRPCCtx, OMX_PTR handle1, OMX_PTR handle2, PROXY_BUFFER_TYPE proxyBufferType)
+{
+	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
+	int status;
+	struct ion_fd_data data;
+
     if(proxyBufferType == BufferDescriptorVirtual2D || proxyBufferType == GrallocPointers)
     {
 		data.handle = (ion_user_handle_t)handle1;
@@ -391,6 +457,13 @@ OMX_ERRORTYPE PROXY_EventHandler(OMX_HANDLETYPE hComponent,
 		TIMM_OSAL_Free(pTmpData);
 		break;
 
+	case OMX_EventCmdComplete:
+	case OMX_EventPortSettingsChanged:
+		/*The remote component may have changed cached structures,
+		   drop them before the client gets to query them again */
+		PROXY_CacheInvalidate(pCompPrv);
+		break;
+
 	default:
 		break;
 	}
@@ -426,7 +499,7 @@ static OMX_ERRORTYPE PROXY_EmptyBufferDone(OMX_HANDLETYPE hComponent,
 	OMX_ERRORTYPE eError = OMX_ErrorNone;
 	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
 	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
-	OMX_U16 count;
+	OMX_U32 count;
 	OMX_BUFFERHEADERTYPE *pBufHdr = NULL;
 
 	PROXY_require((hComp->pComponentPrivate != NULL),
@@ -439,27 +512,21 @@ static OMX_ERRORTYPE PROXY_EmptyBufferDone(OMX_HANDLETYPE hComponent,
 	    ("hComponent=%p, pCompPrv=%p, remoteBufHdr=%p, nFilledLen=%d, nOffset=%d, nFlags=%08x",
 	    hComponent, pCompPrv, remoteBufHdr, nfilledLen, nOffset, nFlags);
 
-	for (count = 0; count < pCompPrv->nTotalBuffers; ++count)
-	{
-		if (pCompPrv->tBufList[count].pBufHeaderRemote ==
-		    remoteBufHdr)
-		{
-			pBufHdr = pCompPrv->tBufList[count].pBufHeader;
-			pBufHdr->nFilledLen = nfilledLen;
-			pBufHdr->nOffset = nOffset;
-			pBufHdr->nFlags = nFlags;
-			/* Setting mark info to NULL. This would always be
-			   NULL in EBD, whether component has propagated the
-			   mark or has generated mark event */
-			pBufHdr->hMarkTargetComponent = NULL;
-			pBufHdr->pMarkData = NULL;
-			break;
-		}
-	}
-	PROXY_assert((count != pCompPrv->nTotalBuffers),
+	count = PROXY_BufListFindRemote(pCompPrv, remoteBufHdr);
+	PROXY_assert((count != PROXY_BUFFER_NONE),
 	    OMX_ErrorBadParameter,
 	    "Received invalid-buffer header from OMX component");
 
+	pBufHdr = pCompPrv->tBufList[count].pBufHeader;
+	pBufHdr->nFilledLen = nfilledLen;
+	pBufHdr->nOffset = nOffset;
+	pBufHdr->nFlags = nFlags;
+	/* Setting mark info to NULL. This would always be
+	   NULL in EBD, whether component has propagated the
+	   mark or has generated mark event */
+	pBufHdr->hMarkTargetComponent = NULL;
+	pBufHdr->pMarkData = NULL;
+
 	KPI_OmxCompBufferEvent(KPI_BUFFER_EBD, hComponent, &(pCompPrv->tBufList[count]));
 
       EXIT:
@@ -496,7 +563,7 @@ OMX_ERRORTYPE PROXY_FillBufferDone(OMX_HANDLETYPE hComponent,
 	OMX_ERRORTYPE eError = OMX_ErrorNone;
 	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
 	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
-	OMX_U16 count;
+	OMX_U32 count;
 	OMX_BUFFERHEADERTYPE *pBufHdr = NULL;
 
 	PROXY_require((hComp->pComponentPrivate != NULL),
@@ -509,34 +576,26 @@ OMX_ERRORTYPE PROXY_FillBufferDone(OMX_HANDLETYPE hComponent,
 	    ("hComponent=%p, pCompPrv=%p, remoteBufHdr=%p, nFilledLen=%d, nOffset=%d, nFlags=%08x",
 	    hComponent, pCompPrv, remoteBufHdr, nfilledLen, nOffset, nFlags);
 
-	for (count = 0; count < pCompPrv->nTotalBuffers; ++count)
-	{
-		if (pCompPrv->tBufList[count].pBufHeaderRemote ==
-		    remoteBufHdr)
-		{
-			pBufHdr = pCompPrv->tBufList[count].pBufHeader;
-			pBufHdr->nFilledLen = nfilledLen;
-			pBufHdr->nOffset = nOffset;
-			pBufHdr->nFlags = nFlags;
-			pBufHdr->nTimeStamp = nTimeStamp;
-			if (pMarkData != NULL)
-			{
-				/*Update mark info in the buffer header */
-				pBufHdr->pMarkData =
-				    ((PROXY_MARK_DATA *)
-				    pMarkData)->pMarkDataActual;
-				pBufHdr->hMarkTargetComponent =
-				    ((PROXY_MARK_DATA *)
-				    pMarkData)->hComponentActual;
-				TIMM_OSAL_Free(pMarkData);
-			}
-			break;
-		}
-	}
-	PROXY_assert((count != pCompPrv->nTotalBuffers),
+	count = PROXY_BufListFindRemote(pCompPrv, remoteBufHdr);
+	PROXY_assert((count != PROXY_BUFFER_NONE),
 	    OMX_ErrorBadParameter,
 	    "Received invalid-buffer header from OMX component");
 
+	pBufHdr = pCompPrv->tBufList[count].pBufHeader;
+	pBufHdr->nFilledLen = nfilledLen;
+	pBufHdr->nOffset = nOffset;
+	pBufHdr->nFlags = nFlags;
+	pBufHdr->nTimeStamp = nTimeStamp;
+	if (pMarkData != NULL)
+	{
+		/*Update mark info in the buffer header */
+		pBufHdr->pMarkData =
+		    ((PROXY_MARK_DATA *) pMarkData)->pMarkDataActual;
+		pBufHdr->hMarkTargetComponent =
+		    ((PROXY_MARK_DATA *) pMarkData)->hComponentActual;
+		TIMM_OSAL_Free(pMarkData);
+	}
+
 	KPI_OmxCompBufferEvent(KPI_BUFFER_FBD, hComponent, &(pCompPrv->tBufList[count]));
 
       EXIT:
@@ -591,17 +650,11 @@ OMX_ERRORTYPE PROXY_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	    pBufferHdr->nOffset, pBufferHdr->nFlags);
 
 	/*First find the index of this buffer header to retrieve remote buffer header */
-	for (count = 0; count < pCompPrv->nTotalBuffers; count++)
-	{
-		if (pCompPrv->tBufList[count].pBufHeader == pBufferHdr)
-		{
-			DOMX_DEBUG("Buffer Index of Match %d ", count);
-			break;
-		}
-	}
-	PROXY_assert((count != pCompPrv->nTotalBuffers),
+	count = PROXY_BufListFindLocal(pCompPrv, pBufferHdr);
+	PROXY_assert((count != PROXY_BUFFER_NONE),
 	    OMX_ErrorBadParameter,
 	    "Could not find the remote header in buffer list");
+	DOMX_DEBUG("Buffer Index of Match %d ", count);
 
 	if (pBufferHdr->hMarkTargetComponent != NULL)
 	{
@@ -649,6 +702,9 @@ OMX_ERRORTYPE PROXY_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	    RPC_EmptyThisBuffer(pCompPrv->hRemoteComp, pBufferHdr,
 	    pCompPrv->tBufList[count].pBufHeaderRemote, &eCompReturn,bMapBuffer);
 
+	if (eRPCError != RPC_OMX_ErrorNone || eCompReturn != OMX_ErrorNone)
+		KPI_OmxCompBufferEvent(KPI_BUFFER_REFUSED, hComponent, &(pCompPrv->tBufList[count]));
+
 	PROXY_checkRpcError();
 
       EXIT:
@@ -704,23 +760,20 @@ OMX_ERRORTYPE PROXY_FillThisBuffer(OMX_HANDLETYPE hComponent,
 	    pBufferHdr->nOffset, pBufferHdr->nFlags);
 
 	/*First find the index of this buffer header to retrieve remote buffer header */
-	for (count = 0; count < pCompPrv->nTotalBuffers; count++)
-	{
-		if (pCompPrv->tBufList[count].pBufHeader == pBufferHdr)
-		{
-			DOMX_DEBUG("Buffer Index of Match %d ", count);
-			break;
-		}
-	}
-	PROXY_assert((count != pCompPrv->nTotalBuffers),
+	count = PROXY_BufListFindLocal(pCompPrv, pBufferHdr);
+	PROXY_assert((count != PROXY_BUFFER_NONE),
 	    OMX_ErrorBadParameter,
 	    "Could not find the remote header in buffer list");
+	DOMX_DEBUG("Buffer Index of Match %d ", count);
 
 	KPI_OmxCompBufferEvent(KPI_BUFFER_FTB, hComponent, &(pCompPrv->tBufList[count]));
 
 	eRPCError = RPC_FillThisBuffer(pCompPrv->hRemoteComp, pBufferHdr,
 	    pCompPrv->tBufList[count].pBufHeaderRemote, &eCompReturn);
 
+	if (eRPCError != RPC_OMX_ErrorNone || eCompReturn != OMX_ErrorNone)
+		KPI_OmxCompBufferEvent(KPI_BUFFER_REFUSED, hComponent, &(pCompPrv->tBufList[count]));
+
 	PROXY_checkRpcError();
 
       EXIT:
@@ -747,8 +800,7 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	OMX_ERRORTYPE eError = OMX_ErrorNone;
 	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
 	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
-	OMX_U32 currentBuffer = 0, i = 0;
-	OMX_BOOL bSlotFound = OMX_FALSE;
+	OMX_U32 currentBuffer = 0;
 	MEMPLUGIN_BUFFER_PARAMS newbuffer_params;
 	MEMPLUGIN_BUFFER_PROPERTIES newbuffer_prop;
 	MEMPLUGIN_ERRORTYPE eMemError = MEMPLUGIN_ERROR_NONE;
@@ -772,26 +824,14 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	    ("hComponent = %p, pCompPrv = %p, nPortIndex = %p, pAppPrivate = %p, nSizeBytes = %d",
 	    hComponent, pCompPrv, nPortIndex, pAppPrivate, nSizeBytes);
 
-	/*Pick up 1st empty slot */
-	/*The same empty spot will be picked up by the subsequent
+	/*Pick up the next free slot */
+	/*The same slot will be picked up by the subsequent
 	Use buffer call to fill in the corresponding buffer
 	Buffer header in the list */
-
-	bSlotFound = OMX_FALSE;
-	for (i = 0; i < pCompPrv->nTotalBuffers; i++)
-	{
-		if (pCompPrv->tBufList[i].pBufHeader == NULL)
-		{
-			currentBuffer = i;
-			bSlotFound = OMX_TRUE;
-			break;
-		}
-	}
-
-	if (bSlotFound == OMX_FALSE)
-	{
-		currentBuffer = pCompPrv->nTotalBuffers;
-	}
+	currentBuffer = PROXY_BufListNextSlot(pCompPrv);
+	PROXY_assert((currentBuffer != PROXY_BUFFER_NONE),
+	    OMX_ErrorInsufficientResources,
+	    "Proxy cannot handle more than MAX buffers");
 
 		MEMPLUGIN_BUFFER_PARAMS_INIT(newbuffer_params);
 		newbuffer_params.nWidth = nSize;
@@ -831,10 +871,9 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	//This code is the un-changed version of original implementation.
 	OMX_BUFFERHEADERTYPE *pBufferHeader = NULL;
 	OMX_U32 pBufHeaderRemote = 0;
-	OMX_U32 currentBuffer = 0, i = 0;
+	OMX_U32 currentBuffer = 0;
 	OMX_U8 *pBuffer = NULL;
 	OMX_TI_PLATFORMPRIVATE *pPlatformPrivate = NULL;
-	OMX_BOOL bSlotFound = OMX_FALSE;
 	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
 	OMX_ERRORTYPE eCompReturn = OMX_ErrorNone;
 
@@ -849,23 +888,11 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	    ("hComponent = %p, pCompPrv = %p, nPortIndex = %p, pAppPrivate = %p, nSizeBytes = %d",
 	    hComponent, pCompPrv, nPortIndex, pAppPrivate, nSizeBytes);
 
-	/*Pick up 1st empty slot */
-	for (i = 0; i < pCompPrv->nTotalBuffers; i++)
-	{
-		if (pCompPrv->tBufList[i].pBufHeader == 0)
-		{
-			currentBuffer = i;
-			bSlotFound = OMX_TRUE;
-			break;
-		}
-	}
-	if (!bSlotFound)
-	{
-		currentBuffer = pCompPrv->nTotalBuffers;
-	}
+	/*Pick up the next free slot */
+	currentBuffer = PROXY_BufListNextSlot(pCompPrv);
 
 	DOMX_DEBUG("In AB, no. of buffers = %d", pCompPrv->nTotalBuffers);
-	PROXY_assert((pCompPrv->nTotalBuffers < MAX_NUM_PROXY_BUFFERS),
+	PROXY_assert((currentBuffer != PROXY_BUFFER_NONE),
 	    OMX_ErrorInsufficientResources,
 	    "Proxy cannot handle more than MAX buffers");
 
@@ -900,6 +927,9 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 
 	pCompPrv->tBufList[currentBuffer].pBufHeader = pBufferHeader;
 	pCompPrv->tBufList[currentBuffer].pBufHeaderRemote = pBufHeaderRemote;
+	PROXY_BufListAdd(pCompPrv, currentBuffer);
+	/*Port definitions report the port as populated now */
+	PROXY_CacheInvalidate(pCompPrv);
 
 
 	//keeping track of number of Buffers
@@ -949,11 +979,10 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	OMX_BUFFERHEADERTYPE *pBufferHeader = NULL;
 	OMX_U32 pBufHeaderRemote = 0;
 	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
-	OMX_U32 currentBuffer = 0, i = 0;
+	OMX_U32 currentBuffer = 0;
 	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
 	OMX_TI_PLATFORMPRIVATE *pPlatformPrivate = NULL;
 	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
-	OMX_BOOL bSlotFound = OMX_FALSE;
 	OMX_PTR pAuxBuf0 = pBuffer;
 	OMX_PTR pMappedMetaDataBuffer = NULL;
 	OMX_TI_PARAM_METADATABUFFERINFO tMetaDataBuffer;
@@ -976,23 +1005,11 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	    hComponent, pCompPrv, nPortIndex, pAppPrivate, nSizeBytes,
 	    pBuffer);
 
-	/*Pick up 1st empty slot */
-	for (i = 0; i < pCompPrv->nTotalBuffers; i++)
-	{
-		if (pCompPrv->tBufList[i].pBufHeader == 0)
-		{
-			currentBuffer = i;
-			bSlotFound = OMX_TRUE;
-			break;
-		}
-	}
-	if (!bSlotFound)
-	{
-		currentBuffer = pCompPrv->nTotalBuffers;
-	}
+	/*Pick up the next free slot */
+	currentBuffer = PROXY_BufListNextSlot(pCompPrv);
 	DOMX_DEBUG("In UB, no. of buffers = %d", pCompPrv->nTotalBuffers);
 
-	PROXY_assert((pCompPrv->nTotalBuffers < MAX_NUM_PROXY_BUFFERS),
+	PROXY_assert((currentBuffer != PROXY_BUFFER_NONE),
 	    OMX_ErrorInsufficientResources,
 	    "Proxy cannot handle more than MAX buffers");
 
@@ -1127,6 +1144,9 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	//Storing details of pBufferHeader/Mapped/Actual buffer address locally.
 	pCompPrv->tBufList[currentBuffer].pBufHeader = pBufferHeader;
 	pCompPrv->tBufList[currentBuffer].pBufHeaderRemote = pBufHeaderRemote;
+	PROXY_BufListAdd(pCompPrv, currentBuffer);
+	/*Port definitions report the port as populated now */
+	PROXY_CacheInvalidate(pCompPrv);
 
 	//keeping track of number of Buffers
 	pCompPrv->nAllocatedBuffers++;
@@ -1187,17 +1207,11 @@ OMX_ERRORTYPE PROXY_FreeBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	    hComponent, pCompPrv, nPortIndex, pBufferHdr,
 	    pBufferHdr->pBuffer);
 
-	for (count = 0; count < pCompPrv->nTotalBuffers; count++)
-	{
-		if (pCompPrv->tBufList[count].pBufHeader == pBufferHdr)
-		{
-			DOMX_DEBUG("Buffer Index of Match %d", count);
-			break;
-		}
-	}
-	PROXY_assert((count != pCompPrv->nTotalBuffers),
+	count = PROXY_BufListFindLocal(pCompPrv, pBufferHdr);
+	PROXY_assert((count != PROXY_BUFFER_NONE),
 	    OMX_ErrorBadParameter,
 	    "Could not find the mapped address in component private buffer list");
+	DOMX_DEBUG("Buffer Index of Match %d", count);
 
 	pBuffer = (OMX_U32)pBufferHdr->pBuffer;
     pAuxBuf0 = (OMX_PTR) pBuffer;
@@ -1225,6 +1239,7 @@ OMX_ERRORTYPE PROXY_FreeBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	    RPC_FreeBuffer(pCompPrv->hRemoteComp, nPortIndex,
 	    pCompPrv->tBufList[count].pBufHeaderRemote, (OMX_U32) pAuxBuf0,
 	    &eCompReturn);
+	PROXY_CacheInvalidate(pCompPrv);
 
 	if (eRPCError != RPC_OMX_ErrorNone)
 		eTmpRPCError = eRPCError;
@@ -1296,10 +1311,13 @@ OMX_ERRORTYPE PROXY_FreeBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 			TIMM_OSAL_Free(pCompPrv->tBufList[count].pBufHeader->
 			    pPlatformPrivate);
 		}
+		PROXY_BufListRemove(pCompPrv, count);
 		TIMM_OSAL_Free(pCompPrv->tBufList[count].pBufHeader);
 		TIMM_OSAL_Memset(&(pCompPrv->tBufList[count]), 0,
 		    sizeof(PROXY_BUFFER_INFO));
 	pCompPrv->nAllocatedBuffers--;
+	if (pCompPrv->nAllocatedBuffers == 0)
+		PROXY_BufListReset(pCompPrv);
 
 	PROXY_checkRpcError();
 
@@ -1419,6 +1437,10 @@ OMX_ERRORTYPE __PROXY_SetParameter(OMX_IN OMX_HANDLETYPE hComponent,
 	PROXY_checkRpcError();
 
  EXIT:
+	/*Other structures, port definitions in particular, are derived
+	   from the one being set, so everything cached goes */
+	if (pCompPrv)
+		PROXY_CacheInvalidate(pCompPrv);
 	DOMX_EXIT("eError: %d", eError);
 	return eError;
 }
@@ -1459,6 +1481,7 @@ OMX_ERRORTYPE __PROXY_GetParameter(OMX_IN OMX_HANDLETYPE hComponent,
 	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
 	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
 	OMX_TI_PARAM_USEBUFFERDESCRIPTOR *ptBufDescParam = NULL;
+	OMX_U32 nCacheGeneration = 0;
 #ifdef USE_ION
 	OMX_PTR *pAuxBuf = pLocBufNeedMap;
 	OMX_PTR pRegistered = NULL;
@@ -1474,6 +1497,13 @@ OMX_ERRORTYPE __PROXY_GetParameter(OMX_IN OMX_HANDLETYPE hComponent,
 		("hComponent = %p, pCompPrv = %p, nParamIndex = %d, pParamStruct = %p",
 		 hComponent, pCompPrv, nParamIndex, pParamStruct);
 
+	if (pLocBufNeedMap == NULL &&
+	    PROXY_CacheLookup(pCompPrv, OMX_FALSE, nParamIndex, pParamStruct,
+	    &nCacheGeneration))
+	{
+		goto EXIT;
+	}
+
 	switch((unsigned int)nParamIndex)
 	{
 #ifndef DOMX_TUNA
@@ -1523,6 +1553,10 @@ OMX_ERRORTYPE __PROXY_GetParameter(OMX_IN OMX_HANDLETYPE hComponent,
 
 	PROXY_checkRpcError();
 
+	if (pLocBufNeedMap == NULL && eError == OMX_ErrorNone)
+		PROXY_CacheStore(pCompPrv, OMX_FALSE, nParamIndex, pParamStruct,
+		    nCacheGeneration);
+
 EXIT:
 	DOMX_EXIT("eError: %d index: 0x%x", eError, nParamIndex);
 	return eError;
@@ -1566,6 +1600,7 @@ OMX_ERRORTYPE __PROXY_GetConfig(OMX_HANDLETYPE hComponent,
 	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
 	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
 	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	OMX_U32 nCacheGeneration = 0;
 
 	PROXY_require((pConfigStruct != NULL), OMX_ErrorBadParameter, NULL);
 	PROXY_require((hComp->pComponentPrivate != NULL),
@@ -1578,6 +1613,13 @@ OMX_ERRORTYPE __PROXY_GetConfig(OMX_HANDLETYPE hComponent,
 				hComponent, pCompPrv, nConfigIndex,
 				pConfigStruct);
 
+	if (pLocBufNeedMap == NULL &&
+	    PROXY_CacheLookup(pCompPrv, OMX_TRUE, nConfigIndex, pConfigStruct,
+	    &nCacheGeneration))
+	{
+		goto EXIT;
+	}
+
 #ifdef USE_ION
 	if (pAuxBuf != NULL) {
 		int fd = *((int*)pAuxBuf);
@@ -1604,6 +1646,10 @@ OMX_ERRORTYPE __PROXY_GetConfig(OMX_HANDLETYPE hComponent,
 
 	PROXY_checkRpcError();
 
+	if (pLocBufNeedMap == NULL && eError == OMX_ErrorNone)
+		PROXY_CacheStore(pCompPrv, OMX_TRUE, nConfigIndex, pConfigStruct,
+		    nCacheGeneration);
+
  EXIT:
 	DOMX_EXIT("eError: %d", eError);
 	return eError;
@@ -1677,6 +1723,7 @@ OMX_ERRORTYPE __PROXY_SetConfig(OMX_IN OMX_HANDLETYPE hComponent,
 	eRPCError =
 		RPC_SetConfig(pCompPrv->hRemoteComp, nConfigIndex, pConfigStruct,
 			pLocBufNeedMap, &eCompReturn);
+	PROXY_CacheInvalidate(pCompPrv);
 
 #ifdef USE_ION
 	PROXY_checkRpcError();
@@ -1840,6 +1887,10 @@ OMX_ERRORTYPE PROXY_SendCommand(OMX_IN OMX_HANDLETYPE hComponent,
 		((OMX_MARKTYPE *) pCmdData)->pMarkData = pMarkData;
 	}
 
+	/*State and port changes show up in cached structures */
+	if (eCmd != OMX_CommandMarkBuffer)
+		PROXY_CacheInvalidate(pCompPrv);
+
 	PROXY_checkRpcError();
 
       EXIT:
@@ -2226,6 +2277,7 @@ OMX_ERRORTYPE PROXY_ComponentDeInit(OMX_HANDLETYPE hComponent)
 
 	if (pCompPrv)
 	{
+		PROXY_CacheDeInit(pCompPrv);
 		TIMM_OSAL_Free(pCompPrv);
 	}
 
@@ -2264,7 +2316,8 @@ OMX_ERRORTYPE OMX_ProxyCommonInit(OMX_HANDLETYPE hComponent)
 
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 
-	pCompPrv->nTotalBuffers = 0;
+	PROXY_BufListReset(pCompPrv);
+	PROXY_CacheInit(pCompPrv);
 	pCompPrv->nAllocatedBuffers = 0;
 	pCompPrv->proxyEmptyBufferDone = PROXY_EmptyBufferDone;
 	pCompPrv->proxyFillBufferDone = PROXY_FillBufferDone;
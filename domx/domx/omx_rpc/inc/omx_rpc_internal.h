@@ -84,6 +84,26 @@ extern "C"
 /*Packet size for each message*/
 #define RPC_PACKET_SIZE 0x12C
 
+/*Number of packets preallocated per RPC context. The stubs hold one packet
+  while sending and one return packet per call in flight, the callback thread
+  one per incoming message. Packets beyond this come from the heap.*/
+#define RPC_PACKET_POOL_SIZE 32
+
+/*Maximum and default number of EmptyThisBuffer/FillThisBuffer calls that may
+  be in flight to the remote core at once. A window of 0 makes these calls
+  synchronous. The default can be changed with debug.domx.rpc_window. Calls
+  made from within a callback do not wait for the window and use the spare
+  half of the call table instead*/
+#define RPC_ASYNC_WINDOW_MAX 8
+#define RPC_ASYNC_WINDOW_DEFAULT 4
+
+/*Number of buffer mappings an RPC context remembers, and the default number
+  of those that may stay mapped on the remote core while no buffer header
+  uses them. The default can be changed with debug.domx.ion_cache, 0 turns
+  the cache off*/
+#define RPC_ION_CACHE_SIZE 64
+#define RPC_ION_CACHE_DEFAULT 16
+
 
 
 /*******************************************************************************
@@ -152,11 +172,107 @@ extern "C"
 * STRUCTURES
 *******************************************************************************/
 
+/*===============================================================*/
+/** RPC_OMX_PACKET_STATS            : Usage of the packet pool of a context
+ *
+ *  @ param nPoolSize               : Number of preallocated packets.
+ *  @ param nInUse                  : Packets currently allocated, including
+ *                                    those taken from the heap.
+ *  @ param nHighWater              : Highest value nInUse has reached.
+ *  @ param nExhausted              : Number of allocations that found the
+ *                                    pool empty and fell back to the heap.
+ *
+ */
+/*===============================================================*/
+	typedef struct RPC_OMX_PACKET_STATS
+	{
+		OMX_U32 nPoolSize;
+		OMX_U32 nInUse;
+		OMX_U32 nHighWater;
+		OMX_U32 nExhausted;
+	} RPC_OMX_PACKET_STATS;
+
+/*===============================================================*/
+/** RPC_OMX_ASYNC_CALL              : An asynchronous ETB/FTB awaiting its
+ *                                    acknowledgement from the remote core
+ *
+ *  @ param nMsgId                  : Sequence id sent in omx_packet.msg_id,
+ *                                    0 if the entry is free.
+ *  @ param nFxnIdx                 : RPC_OMX_FXN_IDX_EMPTYTHISBUFFER or
+ *                                    RPC_OMX_FXN_IDX_FILLTHISBUFFER.
+ *  @ param nOrder                  : Submission order, used to match
+ *                                    acknowledgements that carry no id.
+ *  @ param nBufHdrRemote           : Remote header of the buffer.
+ *  @ param nFilledLen, nOffset,
+ *          nFlags                  : Header fields at submission, handed
+ *                                    back if the buffer is returned unused.
+ *
+ */
+/*===============================================================*/
+	typedef struct RPC_OMX_ASYNC_CALL
+	{
+		OMX_U16 nMsgId;
+		OMX_U16 nFxnIdx;
+		OMX_U32 nOrder;
+		OMX_U32 nBufHdrRemote;
+		OMX_U32 nFilledLen;
+		OMX_U32 nOffset;
+		OMX_U32 nFlags;
+	} RPC_OMX_ASYNC_CALL;
+
+/*===============================================================*/
+/** RPC_OMX_ION_MAPPING             : A buffer registered with the remote core
+ *
+ *  @ param hKey1, hKey2            : Handles of the buffer components in the
+ *                                    ION client of the context. ION hands
+ *                                    out one handle per buffer and client,
+ *                                    so they identify the buffer whatever fd
+ *                                    it arrives on. NULL if the slot is free.
+ *  @ param hRemote1, hRemote2      : Handles returned by the registration.
+ *  @ param nType                   : PROXY_BUFFER_TYPE it was registered as.
+ *  @ param nUsers                  : Registrations not yet unregistered, the
+ *                                    mapping is idle at 0.
+ *  @ param nLastUse                : Cache clock when it last went idle.
+ *
+ */
+/*===============================================================*/
+	typedef struct RPC_OMX_ION_MAPPING
+	{
+		OMX_PTR hKey1;
+		OMX_PTR hKey2;
+		OMX_PTR hRemote1;
+		OMX_PTR hRemote2;
+		OMX_U32 nType;
+		OMX_U32 nUsers;
+		OMX_U32 nLastUse;
+	} RPC_OMX_ION_MAPPING;
+
+/*===============================================================*/
+/** RPC_OMX_ION_CACHE_STATS         : Usage of the mapping cache of a context
+ *
+ *  @ param nHits                   : Registrations served by a mapping that
+ *                                    already existed.
+ *  @ param nMisses                 : Registrations that mapped the buffer.
+ *  @ param nBypassed               : Registrations that could not be cached.
+ *  @ param nEvictions              : Idle mappings dropped for the budget.
+ *
+ */
+/*===============================================================*/
+	typedef struct RPC_OMX_ION_CACHE_STATS
+	{
+		OMX_U32 nHits;
+		OMX_U32 nMisses;
+		OMX_U32 nBypassed;
+		OMX_U32 nEvictions;
+	} RPC_OMX_ION_CACHE_STATS;
+
 /*===============================================================*/
 /** RPC_OMX_CONTEXT                 : RPC context structure
  *
  *  @ param fd_omx                  : File descriptor corresponding to this
  *                                    instance on remote core.
+ *  @ param bLoopback               : fd_omx is a socket to a loopback remote
+ *                                    core, which takes no ioctls.
  *  @ param fd_killcb               : File descriptor used to shut down the
  *                                    callback thread.
  *  @ param cbThread                : Callback thread.
@@ -167,18 +283,62 @@ extern "C"
  *                                    remote core.
  *  @ param hActualRemoteCompHandle : Actual component handle on remote core.
  *  @ param pAppData                : App data of RPC caller
+ *  @ param pPacketPool             : RPC_PACKET_POOL_SIZE preallocated
+ *                                    packets, each behind a small header.
+ *  @ param nPacketFreeList         : Lock free list of unused packets. Index
+ *                                    of the first one in the low byte, a
+ *                                    change count above it.
+ *  @ param tPacketStats            : Packet pool usage counters.
+ *  @ param nAsyncWindow            : Number of ETB/FTB calls allowed in
+ *                                    flight, 0 for synchronous calls.
+ *  @ param tAsyncLock              : Protects the fields below.
+ *  @ param tAsyncCond              : Signalled when a call is acknowledged.
+ *  @ param nAsyncSeq               : Last sequence id handed out.
+ *  @ param nAsyncOrder             : Submission counter.
+ *  @ param nAsyncInFlight          : Calls awaiting acknowledgement.
+ *  @ param bAsyncAbort             : Set once the remote core has failed.
+ *  @ param tAsyncCalls             : The calls in flight.
+ *  @ param fd_ion                  : ION client used to identify buffers
+ *                                    for the mapping cache, opened on first
+ *                                    use.
+ *  @ param nIonCacheBudget         : Idle mappings kept, 0 if the cache is
+ *                                    off.
+ *  @ param nIonCacheIdle           : Idle mappings currently kept.
+ *  @ param nIonCacheClock          : Counts mappings going idle, for LRU.
+ *  @ param tIonCacheLock           : Protects the mapping cache.
+ *  @ param tIonCacheStats          : Mapping cache counters.
+ *  @ param tIonCache               : The mapping cache.
  *
  */
 /*===============================================================*/
 	typedef struct RPC_OMX_CONTEXT
 	{
 		OMX_S32 fd_omx;
+		OMX_BOOL bLoopback;
 		OMX_S32 fd_killcb;
 		pthread_t cbThread;
 		OMX_PTR pMsgPipe[RPC_OMX_FXN_IDX_MAX];
 		OMX_HANDLETYPE hRemoteHandle;
 		OMX_HANDLETYPE hActualRemoteCompHandle;
 		OMX_PTR pAppData;
+		OMX_U8 *pPacketPool;
+		OMX_U32 nPacketFreeList;
+		RPC_OMX_PACKET_STATS tPacketStats;
+		OMX_U32 nAsyncWindow;
+		pthread_mutex_t tAsyncLock;
+		pthread_cond_t tAsyncCond;
+		OMX_U16 nAsyncSeq;
+		OMX_U32 nAsyncOrder;
+		OMX_U32 nAsyncInFlight;
+		OMX_BOOL bAsyncAbort;
+		RPC_OMX_ASYNC_CALL tAsyncCalls[2 * RPC_ASYNC_WINDOW_MAX];
+		OMX_S32 fd_ion;
+		OMX_U32 nIonCacheBudget;
+		OMX_U32 nIonCacheIdle;
+		OMX_U32 nIonCacheClock;
+		pthread_mutex_t tIonCacheLock;
+		RPC_OMX_ION_CACHE_STATS tIonCacheStats;
+		RPC_OMX_ION_MAPPING tIonCache[RPC_ION_CACHE_SIZE];
 	} RPC_OMX_CONTEXT;
 
 #ifdef __cplusplus
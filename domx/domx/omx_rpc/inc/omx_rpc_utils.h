@@ -100,22 +100,22 @@ extern "C"
  *   MACROS - COMMON MARSHALLING UTILITIES
  ******************************************************************/
 #define RPC_SETFIELDVALUE(MSGBODY, POS, VALUE, TYPE) do { \
-    *((TYPE *) ((OMX_U32)MSGBODY+POS)) = (TYPE)VALUE; \
+    *((TYPE *) ((OMX_U8 *)(MSGBODY)+POS)) = (TYPE)VALUE; \
     POS += sizeof(TYPE); \
     } while(0)
 
 #define RPC_SETFIELDOFFSET(MSGBODY, POS, OFFSET, TYPE) do { \
-    *((TYPE *) ((OMX_U32)MSGBODY+POS)) = OFFSET; \
+    *((TYPE *) ((OMX_U8 *)(MSGBODY)+POS)) = OFFSET; \
     POS += sizeof(TYPE); \
     } while(0)
 
 #define RPC_SETFIELDCOPYGEN(MSGBODY, POS, PTR, SIZE) do { \
-    TIMM_OSAL_Memcpy((OMX_U8*)((OMX_U32)MSGBODY+POS), PTR, SIZE); \
+    TIMM_OSAL_Memcpy((OMX_U8*)((OMX_U8 *)(MSGBODY)+POS), PTR, SIZE); \
     POS += SIZE; \
     } while (0)
 
 #define RPC_SETFIELDCOPYTYPE(MSGBODY, POS, PSTRUCT, TYPE) do { \
-    *((TYPE *)((OMX_U32)MSGBODY+POS)) = *PSTRUCT; \
+    *((TYPE *)((OMX_U8 *)(MSGBODY)+POS)) = *PSTRUCT; \
     POS += sizeof(TYPE); \
     } while (0)
 
@@ -123,22 +123,22 @@ extern "C"
  *   MACROS - COMMON UNMARSHALLING UTILITIES
  ******************************************************************/
 #define RPC_GETFIELDVALUE(MSGBODY, POS, VALUE, TYPE) do { \
-    VALUE = *((TYPE *) ((OMX_U32)MSGBODY+POS)); \
+    VALUE = *((TYPE *) ((OMX_U8 *)(MSGBODY)+POS)); \
     POS += sizeof(TYPE); \
     } while(0)
 
 #define RPC_GETFIELDOFFSET(MSGBODY, POS, OFFSET, TYPE) do { \
-    OFFSET = *((TYPE *) ((OMX_U32)MSGBODY+POS)); \
+    OFFSET = *((TYPE *) ((OMX_U8 *)(MSGBODY)+POS)); \
     POS += sizeof(TYPE); \
     } while(0)
 
 #define RPC_GETFIELDCOPYGEN(MSGBODY, POS, PTR, SIZE)  do { \
-    TIMM_OSAL_Memcpy(PTR, (OMX_U8*)((OMX_U32)MSGBODY+POS), SIZE); \
+    TIMM_OSAL_Memcpy(PTR, (OMX_U8*)((OMX_U8 *)(MSGBODY)+POS), SIZE); \
     POS += SIZE; \
     } while(0)
 
 #define RPC_GETFIELDCOPYTYPE(MSGBODY, POS, PSTRUCT, TYPE) do { \
-    *PSTRUCT = *((TYPE *)((OMX_U32)MSGBODY+POS)); \
+    *PSTRUCT = *((TYPE *)((OMX_U8 *)(MSGBODY)+POS)); \
     POS += sizeof(TYPE); \
     } while(0)
 
@@ -164,6 +164,27 @@ PTR = (TYPE *) (MSGBODY+OFFSET);
 	RPC_OMX_ERRORTYPE RPC_UTIL_GetTargetCore(OMX_STRING cComponentName,
 	    OMX_U32 * nCoreId);
 
+	RPC_OMX_ERRORTYPE RPC_PacketPoolInit(RPC_OMX_CONTEXT * hCtx);
+	void RPC_PacketPoolDeInit(RPC_OMX_CONTEXT * hCtx);
+	OMX_PTR RPC_PacketAlloc(RPC_OMX_CONTEXT * hCtx);
+	void RPC_PacketSetUsed(OMX_PTR pPacket, OMX_U32 nUsed);
+	void RPC_PacketFree(RPC_OMX_CONTEXT * hCtx, OMX_PTR pPacket);
+	void RPC_PacketGetStats(OMX_HANDLETYPE hRPCCtx,
+	    RPC_OMX_PACKET_STATS * pStats);
+
+	void RPC_AsyncInit(RPC_OMX_CONTEXT * hCtx);
+	void RPC_AsyncDeInit(RPC_OMX_CONTEXT * hCtx);
+	RPC_OMX_ERRORTYPE RPC_AsyncBegin(RPC_OMX_CONTEXT * hCtx,
+	    RPC_OMX_FXN_IDX_TYPE nFxnIdx, OMX_U32 nBufHdrRemote,
+	    OMX_BUFFERHEADERTYPE * pBufferHdr, OMX_U16 * pMsgId);
+	void RPC_AsyncCancel(RPC_OMX_CONTEXT * hCtx, OMX_U16 nMsgId);
+	void RPC_AsyncAck(RPC_OMX_CONTEXT * hCtx, OMX_PTR pPacket);
+	void RPC_AsyncDrain(RPC_OMX_CONTEXT * hCtx);
+	void RPC_AsyncAbort(RPC_OMX_CONTEXT * hCtx);
+
+	void RPC_IonCacheInit(RPC_OMX_CONTEXT * hCtx);
+	void RPC_IonCacheDeInit(RPC_OMX_CONTEXT * hCtx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,10 +51,17 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#ifdef _Android
+#include <cutils/properties.h>
+#endif
+
 #include <OMX_Types.h>
 #include <timm_osal_interfaces.h>
 #include <timm_osal_trace.h>
@@ -70,18 +77,21 @@
 
 #include "rpmsg_omx_defs.h"
 
-#define RPC_MSGPIPE_SIZE (4)
+/*Replies a function index pipe holds before the listener has to wait. Room
+  for every call the async table can track, so a burst of completions never
+  stalls the only callback thread*/
+#define RPC_MSGPIPE_SIZE (2 * RPC_ASYNC_WINDOW_MAX)
 #define RPC_MSG_SIZE_FOR_PIPE (sizeof(OMX_PTR))
 #define MAX_ATTEMPTS 15
 
-#define RPC_getPacket(nPacketSize, pPacket) do { \
-    pPacket = TIMM_OSAL_Malloc(nPacketSize, TIMM_OSAL_TRUE, 0, TIMMOSAL_MEM_SEGMENT_INT); \
+#define RPC_getPacket(hCtx, pPacket) do { \
+    pPacket = RPC_PacketAlloc(hCtx); \
     RPC_assert(pPacket != NULL, RPC_OMX_ErrorInsufficientResources, \
            "Error Allocating RCM Message Frame"); \
     } while(0)
 
-#define RPC_freePacket(pPacket) do { \
-    if(pPacket != NULL) TIMM_OSAL_Free(pPacket); \
+#define RPC_freePacket(hCtx, pPacket) do { \
+    if(pPacket != NULL) RPC_PacketFree(hCtx, pPacket); \
     } while(0)
 
 OMX_U8 pBufferError[RPC_PACKET_SIZE];
@@ -89,6 +99,66 @@ OMX_U8 pBufferError[RPC_PACKET_SIZE];
 void *RPC_CallbackThread(void *data);
 
 
+
+/* ===========================================================================*/
+/**
+* @name RPC_LoopbackConnect()
+* @brief Connects an RPC context to a loopback remote core instead of the
+*        rpmsg device. The socket path comes from DEBUG_DOMX_RPC_LOOPBACK or
+*        debug.domx.rpc_loopback, nothing is done when neither is set. The
+*        socket keeps packet boundaries, so it is read and written exactly
+*        like the device.
+* @param pRPCCtx [IN] : RPC Context structure. bLoopback is set and fd_omx
+*                       filled in when connected.
+* @return RPC_OMX_ErrorNone = Successful or no loopback configured
+*/
+/* ===========================================================================*/
+static RPC_OMX_ERRORTYPE RPC_LoopbackConnect(RPC_OMX_CONTEXT * pRPCCtx)
+{
+	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
+	struct sockaddr_un sAddr;
+	char *val = getenv("DEBUG_DOMX_RPC_LOOPBACK");
+	OMX_S32 fd = -1;
+#ifdef _Android
+	char value[PROPERTY_VALUE_MAX];
+
+	if (val == NULL && property_get("debug.domx.rpc_loopback", value,
+		NULL) > 0)
+		val = value;
+#endif
+
+	pRPCCtx->bLoopback = OMX_FALSE;
+	if (val == NULL || val[0] == '\0')
+		goto EXIT;
+
+	RPC_assert(strlen(val) < sizeof(sAddr.sun_path),
+	    RPC_OMX_ErrorBadParameter, "Loopback socket path too long");
+	TIMM_OSAL_Memset(&sAddr, 0, sizeof(sAddr));
+	sAddr.sun_family = AF_UNIX;
+	strcpy(sAddr.sun_path, val);
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	RPC_assert(fd >= 0, RPC_OMX_ErrorInsufficientResources,
+	    "Can't create loopback socket");
+	if (connect(fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0)
+	{
+		DOMX_ERROR("Can't connect to loopback remote core at %s, "
+		    "errno = %d", val, errno);
+		close(fd);
+		eRPCError = RPC_OMX_ErrorInsufficientResources;
+		goto EXIT;
+	}
+
+	DOMX_DEBUG("Connected to loopback remote core at %s, fd = %d", val,
+	    fd);
+	pRPCCtx->fd_omx = fd;
+	pRPCCtx->bLoopback = OMX_TRUE;
+
+      EXIT:
+	return eRPCError;
+}
+
+
 /* ===========================================================================*/
 /**
 * @name RPC_InstanceInit()
@@ -123,6 +193,16 @@ RPC_OMX_ERRORTYPE RPC_InstanceInit(__unused OMX_STRING cComponentName,
 	RPC_assert(pRPCCtx != NULL, RPC_OMX_ErrorInsufficientResources,
 	    "Malloc failed");
 	TIMM_OSAL_Memset(pRPCCtx, 0, sizeof(RPC_OMX_CONTEXT));
+	pRPCCtx->fd_omx = -1;
+	RPC_AsyncInit(pRPCCtx);
+	RPC_IonCacheInit(pRPCCtx);
+
+	/*A loopback remote core replaces the device when one is configured */
+	eRPCError = RPC_LoopbackConnect(pRPCCtx);
+	RPC_assert(eRPCError == RPC_OMX_ErrorNone, eRPCError,
+	    "Can't connect to loopback remote core");
+	if (pRPCCtx->bLoopback == OMX_TRUE)
+		goto CONNECTED;
 
 #ifdef DOMX_TUNA
 	// CMA-enabled kernel for tuna devices will unload Ducati firmware when
@@ -207,11 +287,17 @@ RPC_OMX_ERRORTYPE RPC_InstanceInit(__unused OMX_STRING cComponentName,
 	    "Can't connect");
 #endif
 
+      CONNECTED:
+	eRPCError = RPC_PacketPoolInit(pRPCCtx);
+	RPC_assert(eRPCError == RPC_OMX_ErrorNone,
+	    RPC_OMX_ErrorInsufficientResources, "Packet pool creation failed");
+
 	for (i = 0; i < RPC_OMX_FXN_IDX_MAX; i++)
 	{
 		eError =
 		    TIMM_OSAL_CreatePipe(&(pRPCCtx->pMsgPipe[i]),
-		    RPC_MSGPIPE_SIZE, RPC_MSG_SIZE_FOR_PIPE, 1);
+		    RPC_MSGPIPE_SIZE * RPC_MSG_SIZE_FOR_PIPE,
+		    RPC_MSG_SIZE_FOR_PIPE, 1);
 		RPC_assert(eError == TIMM_OSAL_ERR_NONE,
 		    RPC_OMX_ErrorInsufficientResources,
 		    "Pipe creation failed");
@@ -307,6 +393,9 @@ RPC_OMX_ERRORTYPE RPC_InstanceDeInit(OMX_HANDLETYPE hRPCCtx)
 		}
 	}
 
+	/*Cached mappings are released through fd_omx */
+	RPC_IonCacheDeInit(pRPCCtx);
+
 	DOMX_DEBUG("Closing the omx fd");
 	if (pRPCCtx->fd_omx >= 0)
 	{
@@ -319,6 +408,9 @@ RPC_OMX_ERRORTYPE RPC_InstanceDeInit(OMX_HANDLETYPE hRPCCtx)
 		}
 	}
 
+	RPC_AsyncDeInit(pRPCCtx);
+	RPC_PacketPoolDeInit(pRPCCtx);
+
 	TIMM_OSAL_Free(pRPCCtx);
 
 	EXIT:
@@ -372,16 +464,24 @@ void *RPC_CallbackThread(void *data)
 		if (FD_ISSET(pRPCCtx->fd_omx, &readfds))
 		{
 			DOMX_DEBUG("Recd. omx message");
-			RPC_getPacket(nPacketSize, pBuffer);
+			RPC_getPacket(pRPCCtx, pBuffer);
 			status = read(pRPCCtx->fd_omx, pBuffer, nPacketSize);
+			/*A loopback remote core going away looks like a crash */
+			if (status == 0 && pRPCCtx->bLoopback == OMX_TRUE)
+			{
+				status = -1;
+				errno = ENXIO;
+			}
             if(status < 0)
             {
                 if(errno == ENXIO)
                 {
+		    RPC_AsyncAbort(pRPCCtx);
 		    for(nFxnIdx = 0; nFxnIdx < RPC_OMX_FXN_IDX_MAX; nFxnIdx++)
 		    {
 			((struct omx_packet *) pBufferError)->result = OMX_ErrorHardware;
-			TIMM_OSAL_WriteToPipe(pRPCCtx->pMsgPipe[nFxnIdx], &pBuff, RPC_MSG_SIZE_FOR_PIPE, TIMM_OSAL_SUSPEND);
+			/*Pipes nobody reads may be full, the listener must not block here*/
+			eError = TIMM_OSAL_WriteToPipe(pRPCCtx->pMsgPipe[nFxnIdx], &pBuff, RPC_MSG_SIZE_FOR_PIPE, TIMM_OSAL_NO_SUSPEND);
 			if(eError != TIMM_OSAL_ERR_NONE)
 				DOMX_ERROR("Write to pipe failed");
 		    }
@@ -395,6 +495,7 @@ void *RPC_CallbackThread(void *data)
                     "read failed");
                 }
             }
+			RPC_PacketSetUsed(pBuffer, status);
 
 			nPos = 0;
 			nFxnIdx = ((struct omx_packet *) pBuffer)->fxn_idx;
@@ -409,28 +510,39 @@ void *RPC_CallbackThread(void *data)
 			case RPC_OMX_FXN_IDX_EVENTHANDLER:
 				RPC_SKEL_EventHandler(((struct omx_packet *)
 					pBuffer)->data);
-				RPC_freePacket(pBuffer);
+				RPC_freePacket(pRPCCtx, pBuffer);
 				pBuffer = NULL;
 				break;
 			case RPC_OMX_FXN_IDX_EMPTYBUFFERDONE:
 				RPC_SKEL_EmptyBufferDone(((struct omx_packet *)
 					pBuffer)->data);
-				RPC_freePacket(pBuffer);
+				RPC_freePacket(pRPCCtx, pBuffer);
 				pBuffer = NULL;
 				break;
 			case RPC_OMX_FXN_IDX_FILLBUFFERDONE:
 				RPC_SKEL_FillBufferDone(((struct omx_packet *)
 					pBuffer)->data);
-				RPC_freePacket(pBuffer);
+				RPC_freePacket(pRPCCtx, pBuffer);
 				pBuffer = NULL;
 				break;
+			case RPC_OMX_FXN_IDX_EMPTYTHISBUFFER:
+			case RPC_OMX_FXN_IDX_FILLTHISBUFFER:
+				/*Nobody waits for these replies in async mode */
+				if (pRPCCtx->nAsyncWindow != 0)
+				{
+					RPC_AsyncAck(pRPCCtx, pBuffer);
+					RPC_freePacket(pRPCCtx, pBuffer);
+					pBuffer = NULL;
+					break;
+				}
+				/*fall through*/
 			default:
 				if (((struct omx_packet *) pBuffer)->result == OMX_ErrorHardware)
 				{
 					//On a true OMX_ErrorHardware error, send the global error packet
 					//and release the local allocated packet to avoid memory leaks since
 					//the listener will not free the packet on OMX_ErrorHardware errors.
-					RPC_freePacket(pBuffer);
+					RPC_freePacket(pRPCCtx, pBuffer);
 					pBuffer = NULL;
 					((struct omx_packet *) pBufferError)->result = OMX_ErrorHardware;
 					eError = TIMM_OSAL_WriteToPipe(pRPCCtx->pMsgPipe[nFxnIdx],
@@ -457,12 +569,13 @@ EXIT:
 			//AD TODO: Send error CB to client and then go back in loop to wait for killfd
 			if (pBuffer != NULL)
 			{
-				RPC_freePacket(pBuffer);
+				RPC_freePacket(pRPCCtx, pBuffer);
 				pBuffer = NULL;
 			}
 			/*Report all hardware errors as fatal and exit from listener thread*/
 			if (eRPCError == RPC_OMX_ErrorHardware)
 			{
+				RPC_AsyncAbort(pRPCCtx);
 				/*Implicit detail: pAppData is proxy component handle updated during
                   RPC_GetHandle*/
 				hComp = (OMX_COMPONENTTYPE *) pRPCCtx->pAppData;
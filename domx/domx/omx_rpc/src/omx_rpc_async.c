@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  omx_rpc_async.c
+ *         This file contains the bookkeeping for EmptyThisBuffer and
+ *         FillThisBuffer calls that are sent to the remote core without
+ *         waiting for its reply.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\omx_rpc\src
+ *
+ *  @rev 1.0
+ */
+
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifdef _Android
+#include <cutils/properties.h>
+#endif
+
+#include <OMX_Types.h>
+#include <timm_osal_interfaces.h>
+#include <timm_osal_trace.h>
+
+#include <linux/rpmsg_omx.h>
+
+
+/*-------program files ----------------------------------------*/
+#include "omx_rpc.h"
+#include "omx_proxy_common.h"
+#include "omx_rpc_internal.h"
+#include "omx_rpc_utils.h"
+#include "profile.h"
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncInit()
+ * @brief Sets up asynchronous ETB/FTB for an RPC context. The window comes
+ *        from DEBUG_DOMX_RPC_WINDOW or debug.domx.rpc_window, 0 keeps the
+ *        calls synchronous.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_AsyncInit(RPC_OMX_CONTEXT * hCtx)
+{
+	OMX_S32 nWindow = RPC_ASYNC_WINDOW_DEFAULT;
+	char *val = getenv("DEBUG_DOMX_RPC_WINDOW");
+
+	if (val)
+	{
+		nWindow = strtol(val, NULL, 0);
+	}
+#ifdef _Android
+	else
+	{
+		char value[PROPERTY_VALUE_MAX];
+
+		if (property_get("debug.domx.rpc_window", value, NULL) > 0)
+			nWindow = atoi(value);
+	}
+#endif
+
+	if (nWindow < 0)
+		nWindow = 0;
+	if (nWindow > RPC_ASYNC_WINDOW_MAX)
+		nWindow = RPC_ASYNC_WINDOW_MAX;
+	DOMX_DEBUG("ETB/FTB window %d", nWindow);
+
+	hCtx->nAsyncWindow = nWindow;
+	hCtx->nAsyncSeq = 0;
+	hCtx->nAsyncOrder = 0;
+	hCtx->nAsyncInFlight = 0;
+	hCtx->bAsyncAbort = OMX_FALSE;
+	TIMM_OSAL_Memset(hCtx->tAsyncCalls, 0, sizeof(hCtx->tAsyncCalls));
+	pthread_mutex_init(&hCtx->tAsyncLock, NULL);
+	pthread_cond_init(&hCtx->tAsyncCond, NULL);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncDeInit()
+ * @brief Releases what RPC_AsyncInit set up. The callback thread must have
+ *        exited.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_AsyncDeInit(RPC_OMX_CONTEXT * hCtx)
+{
+	RPC_AsyncAbort(hCtx);
+	pthread_cond_destroy(&hCtx->tAsyncCond);
+	pthread_mutex_destroy(&hCtx->tAsyncLock);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncBegin()
+ * @brief Reserves a place in the window for an ETB/FTB, waiting while the
+ *        window is full, and returns the sequence id to send with it.
+ * @param hCtx [IN]          : RPC Context structure.
+ * @param nFxnIdx [IN]       : RPC_OMX_FXN_IDX_EMPTYTHISBUFFER or
+ *                             RPC_OMX_FXN_IDX_FILLTHISBUFFER.
+ * @param nBufHdrRemote [IN] : Remote header of the buffer.
+ * @param pBufferHdr [IN]    : Local header of the buffer.
+ * @param pMsgId [OUT]       : Sequence id for omx_packet.msg_id.
+ * @return RPC_OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+RPC_OMX_ERRORTYPE RPC_AsyncBegin(RPC_OMX_CONTEXT * hCtx,
+    RPC_OMX_FXN_IDX_TYPE nFxnIdx, OMX_U32 nBufHdrRemote,
+    OMX_BUFFERHEADERTYPE * pBufferHdr, OMX_U16 * pMsgId)
+{
+	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
+	RPC_OMX_ASYNC_CALL *pCall = NULL;
+	OMX_BOOL bCbThread = OMX_FALSE;
+	OMX_U32 i = 0;
+
+	/*The callback thread is the one processing acknowledgements, so calls
+	  made from a callback must not wait for the window to open */
+	bCbThread = pthread_equal(pthread_self(), hCtx->cbThread) ?
+	    OMX_TRUE : OMX_FALSE;
+
+	pthread_mutex_lock(&hCtx->tAsyncLock);
+
+	while (!hCtx->bAsyncAbort && !bCbThread &&
+	    hCtx->nAsyncInFlight >= hCtx->nAsyncWindow)
+	{
+		pthread_cond_wait(&hCtx->tAsyncCond, &hCtx->tAsyncLock);
+	}
+
+	if (hCtx->bAsyncAbort)
+	{
+		eRPCError = RPC_OMX_ErrorHardware;
+		goto EXIT;
+	}
+
+	for (i = 0; i < 2 * RPC_ASYNC_WINDOW_MAX; i++)
+	{
+		if (hCtx->tAsyncCalls[i].nMsgId == 0)
+		{
+			pCall = &hCtx->tAsyncCalls[i];
+			break;
+		}
+	}
+	if (pCall == NULL)
+	{
+		DOMX_ERROR("Too many calls in flight");
+		eRPCError = RPC_OMX_ErrorInsufficientResources;
+		goto EXIT;
+	}
+
+	/*0 is what synchronous calls send */
+	do
+	{
+		hCtx->nAsyncSeq++;
+	}
+	while (hCtx->nAsyncSeq == 0);
+
+	pCall->nMsgId = hCtx->nAsyncSeq;
+	pCall->nFxnIdx = nFxnIdx;
+	pCall->nOrder = hCtx->nAsyncOrder++;
+	pCall->nBufHdrRemote = nBufHdrRemote;
+	pCall->nFilledLen = pBufferHdr->nFilledLen;
+	pCall->nOffset = pBufferHdr->nOffset;
+	pCall->nFlags = pBufferHdr->nFlags;
+	hCtx->nAsyncInFlight++;
+	*pMsgId = pCall->nMsgId;
+
+      EXIT:
+	pthread_mutex_unlock(&hCtx->tAsyncLock);
+	return eRPCError;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncCancel()
+ * @brief Gives back a place reserved by RPC_AsyncBegin for a call that
+ *        could not be sent.
+ * @param hCtx [IN]   : RPC Context structure.
+ * @param nMsgId [IN] : Sequence id returned by RPC_AsyncBegin.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_AsyncCancel(RPC_OMX_CONTEXT * hCtx, OMX_U16 nMsgId)
+{
+	OMX_U32 i = 0;
+
+	pthread_mutex_lock(&hCtx->tAsyncLock);
+	for (i = 0; i < 2 * RPC_ASYNC_WINDOW_MAX; i++)
+	{
+		if (hCtx->tAsyncCalls[i].nMsgId == nMsgId)
+		{
+			hCtx->tAsyncCalls[i].nMsgId = 0;
+			hCtx->nAsyncInFlight--;
+			pthread_cond_broadcast(&hCtx->tAsyncCond);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hCtx->tAsyncLock);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncAck()
+ * @brief Processes the remote core's reply to an asynchronous ETB/FTB.
+ *        Called on the callback thread. A call the remote component refused
+ *        is reported through the EventHandler and its buffer is handed back
+ *        with EmptyBufferDone/FillBufferDone, since the client gave up
+ *        ownership when the call returned.
+ * @param hCtx [IN]    : RPC Context structure.
+ * @param pPacket [IN] : The reply packet. Not freed here.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_AsyncAck(RPC_OMX_CONTEXT * hCtx, OMX_PTR pPacket)
+{
+	struct omx_packet *pOmxPacket = (struct omx_packet *) pPacket;
+	OMX_U32 nFxnIdx = pOmxPacket->fxn_idx & 0x0FFFFFFF;
+	OMX_ERRORTYPE eCompReturn = (OMX_ERRORTYPE) pOmxPacket->result;
+	OMX_COMPONENTTYPE *hComp = NULL;
+	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
+	RPC_OMX_ASYNC_CALL tCall;
+	OMX_S32 nMatch = -1, nOldest = -1;
+	OMX_U32 i = 0;
+
+	pthread_mutex_lock(&hCtx->tAsyncLock);
+	for (i = 0; i < 2 * RPC_ASYNC_WINDOW_MAX; i++)
+	{
+		RPC_OMX_ASYNC_CALL *pCall = &hCtx->tAsyncCalls[i];
+
+		if (pCall->nMsgId == 0 || pCall->nFxnIdx != nFxnIdx)
+			continue;
+		if (pCall->nMsgId == pOmxPacket->msg_id)
+		{
+			nMatch = i;
+			break;
+		}
+		if (nOldest < 0 || (OMX_S32) (pCall->nOrder -
+			hCtx->tAsyncCalls[nOldest].nOrder) < 0)
+		{
+			nOldest = i;
+		}
+	}
+
+	/*The remote core replies in order, so a reply without a known id
+	  belongs to the oldest call of its kind */
+	if (nMatch < 0)
+		nMatch = nOldest;
+
+	if (nMatch >= 0)
+	{
+		tCall = hCtx->tAsyncCalls[nMatch];
+		hCtx->tAsyncCalls[nMatch].nMsgId = 0;
+		hCtx->nAsyncInFlight--;
+		pthread_cond_broadcast(&hCtx->tAsyncCond);
+	}
+	pthread_mutex_unlock(&hCtx->tAsyncLock);
+
+	if (nMatch < 0)
+	{
+		DOMX_ERROR("Reply %d to fxn %d matches no call in flight",
+		    pOmxPacket->msg_id, nFxnIdx);
+		return;
+	}
+
+	KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_ACK, hCtx->pAppData,
+	    tCall.nBufHdrRemote);
+
+	if (eCompReturn == OMX_ErrorNone)
+		return;
+
+	DOMX_ERROR("Remote %s returned 0x%x for buffer 0x%x",
+	    nFxnIdx == RPC_OMX_FXN_IDX_EMPTYTHISBUFFER ? "ETB" : "FTB",
+	    eCompReturn, tCall.nBufHdrRemote);
+
+	/*Implicit detail: pAppData is proxy component handle updated during
+	  RPC_GetHandle */
+	hComp = (OMX_COMPONENTTYPE *) hCtx->pAppData;
+	if (hComp == NULL || hComp->pComponentPrivate == NULL)
+		return;
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+
+	pCompPrv->proxyEventHandler(hComp, pCompPrv->pILAppData,
+	    OMX_EventError, eCompReturn, 0, NULL);
+
+	/*After a hardware error the client is expected to tear down */
+	if (eCompReturn == OMX_ErrorHardware)
+		return;
+
+	if (nFxnIdx == RPC_OMX_FXN_IDX_EMPTYTHISBUFFER)
+	{
+		pCompPrv->proxyEmptyBufferDone(hComp, tCall.nBufHdrRemote,
+		    tCall.nFilledLen, tCall.nOffset, tCall.nFlags);
+	} else
+	{
+		pCompPrv->proxyFillBufferDone(hComp, tCall.nBufHdrRemote, 0, 0,
+		    0, 0, NULL, NULL);
+	}
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncDrain()
+ * @brief Waits until every asynchronous ETB/FTB has been acknowledged, so
+ *        that their errors are reported before a command that depends on
+ *        buffer ownership. Does nothing on the callback thread.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_AsyncDrain(RPC_OMX_CONTEXT * hCtx)
+{
+	if (pthread_equal(pthread_self(), hCtx->cbThread))
+		return;
+
+	pthread_mutex_lock(&hCtx->tAsyncLock);
+	while (!hCtx->bAsyncAbort && hCtx->nAsyncInFlight != 0)
+	{
+		pthread_cond_wait(&hCtx->tAsyncCond, &hCtx->tAsyncLock);
+	}
+	pthread_mutex_unlock(&hCtx->tAsyncLock);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_AsyncAbort()
+ * @brief Forgets all calls in flight and fails further ones. Used once the
+ *        remote core can no longer reply.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_AsyncAbort(RPC_OMX_CONTEXT * hCtx)
+{
+	pthread_mutex_lock(&hCtx->tAsyncLock);
+	hCtx->bAsyncAbort = OMX_TRUE;
+	hCtx->nAsyncInFlight = 0;
+	TIMM_OSAL_Memset(hCtx->tAsyncCalls, 0, sizeof(hCtx->tAsyncCalls));
+	pthread_cond_broadcast(&hCtx->tAsyncCond);
+	pthread_mutex_unlock(&hCtx->tAsyncLock);
+}
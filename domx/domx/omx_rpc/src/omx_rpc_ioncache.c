@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  omx_rpc_ioncache.c
+ *         This file contains the cache of buffer mappings on the remote core
+ *         kept by each RPC context. Buffers are unregistered and registered
+ *         again on every port reconfiguration, most of the time the very
+ *         same buffers, so a mapping is kept for a while after its last
+ *         unregistration and handed out again when the buffer comes back.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\omx_rpc\src
+ *
+ *  @rev 1.0
+ */
+
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifdef _Android
+#include <cutils/properties.h>
+#endif
+
+#include <OMX_Types.h>
+#include <timm_osal_interfaces.h>
+#include <timm_osal_trace.h>
+
+#include <ion/ion.h>
+
+
+/*-------program files ----------------------------------------*/
+#include "omx_rpc.h"
+#include "omx_proxy_common.h"
+#include "omx_rpc_internal.h"
+#include "omx_rpc_utils.h"
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheKey()
+ * @brief Imports a buffer fd into the ION client of the context. The handle
+ *        identifies the buffer, and the reference it holds keeps the buffer
+ *        and so the handle from being reused while the mapping is cached.
+ * @param hCtx [IN] : RPC Context structure.
+ * @param fd [IN]   : Buffer fd, may be negative.
+ * @return The handle, NULL if the fd is not an ION buffer
+ */
+/* ===========================================================================*/
+static OMX_PTR RPC_IonCacheKey(RPC_OMX_CONTEXT * hCtx, int fd)
+{
+	ion_user_handle_t hKey = 0;
+
+	if (fd < 0 || ion_import(hCtx->fd_ion, fd, &hKey) < 0)
+		return NULL;
+
+	return (OMX_PTR) hKey;
+}
+
+
+
+/*Releases the reference taken by RPC_IonCacheKey */
+static void RPC_IonCacheDropKey(RPC_OMX_CONTEXT * hCtx, OMX_PTR hKey)
+{
+	if (hKey != NULL)
+		ion_free(hCtx->fd_ion, (ion_user_handle_t) hKey);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheRemove()
+ * @brief Unregisters a cached mapping and frees its slot.
+ * @param hCtx [IN]     : RPC Context structure.
+ * @param pMapping [IN] : The mapping.
+ * @return none
+ */
+/* ===========================================================================*/
+static void RPC_IonCacheRemove(RPC_OMX_CONTEXT * hCtx,
+    RPC_OMX_ION_MAPPING * pMapping)
+{
+	if (pMapping->nUsers == 0)
+		hCtx->nIonCacheIdle--;
+
+	if (RPC_UnMapIonBuffer(hCtx, pMapping->hRemote1, pMapping->hRemote2,
+		(PROXY_BUFFER_TYPE) pMapping->nType) != RPC_OMX_ErrorNone)
+	{
+		DOMX_WARN("Unregistering cached buffer %p failed",
+		    pMapping->hRemote1);
+	}
+	RPC_IonCacheDropKey(hCtx, pMapping->hKey1);
+	RPC_IonCacheDropKey(hCtx, pMapping->hKey2);
+	TIMM_OSAL_Memset(pMapping, 0, sizeof(RPC_OMX_ION_MAPPING));
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheEvict()
+ * @brief Drops the least recently used idle mapping.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return The slot freed, NULL if no mapping is idle
+ */
+/* ===========================================================================*/
+static RPC_OMX_ION_MAPPING *RPC_IonCacheEvict(RPC_OMX_CONTEXT * hCtx)
+{
+	RPC_OMX_ION_MAPPING *pOldest = NULL, *pMapping = NULL;
+	OMX_U32 i = 0;
+
+	for (i = 0; i < RPC_ION_CACHE_SIZE; i++)
+	{
+		pMapping = &hCtx->tIonCache[i];
+		if (pMapping->hKey1 == NULL || pMapping->nUsers != 0)
+			continue;
+		/*Compared as a difference so that the clock may wrap */
+		if (pOldest == NULL ||
+		    (OMX_S32) (pMapping->nLastUse - pOldest->nLastUse) < 0)
+			pOldest = pMapping;
+	}
+
+	if (pOldest != NULL)
+	{
+		DOMX_DEBUG("Evicting mapping %p", pOldest->hRemote1);
+		RPC_IonCacheRemove(hCtx, pOldest);
+		hCtx->tIonCacheStats.nEvictions++;
+	}
+
+	return pOldest;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheInit()
+ * @brief Sets up the mapping cache of an RPC context. The number of idle
+ *        mappings kept comes from DEBUG_DOMX_ION_CACHE or
+ *        debug.domx.ion_cache, 0 turns the cache off.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_IonCacheInit(RPC_OMX_CONTEXT * hCtx)
+{
+	OMX_S32 nBudget = RPC_ION_CACHE_DEFAULT;
+	char *val = getenv("DEBUG_DOMX_ION_CACHE");
+
+	if (val)
+	{
+		nBudget = strtol(val, NULL, 0);
+	}
+#ifdef _Android
+	else
+	{
+		char value[PROPERTY_VALUE_MAX];
+
+		if (property_get("debug.domx.ion_cache", value, NULL) > 0)
+			nBudget = atoi(value);
+	}
+#endif
+
+	if (nBudget < 0)
+		nBudget = 0;
+	if (nBudget > RPC_ION_CACHE_SIZE)
+		nBudget = RPC_ION_CACHE_SIZE;
+	DOMX_DEBUG("ION mapping cache budget %d", nBudget);
+
+	hCtx->fd_ion = -1;
+	hCtx->nIonCacheBudget = nBudget;
+	hCtx->nIonCacheIdle = 0;
+	hCtx->nIonCacheClock = 0;
+	TIMM_OSAL_Memset(&hCtx->tIonCacheStats, 0,
+	    sizeof(RPC_OMX_ION_CACHE_STATS));
+	TIMM_OSAL_Memset(hCtx->tIonCache, 0, sizeof(hCtx->tIonCache));
+	pthread_mutex_init(&hCtx->tIonCacheLock, NULL);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheDeInit()
+ * @brief Unregisters every cached mapping and reports the cache usage. Must
+ *        be called while fd_omx is still open.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_IonCacheDeInit(RPC_OMX_CONTEXT * hCtx)
+{
+	RPC_OMX_ION_CACHE_STATS *pStats = &hCtx->tIonCacheStats;
+	OMX_U32 i = 0, nLookups = 0;
+
+	pthread_mutex_lock(&hCtx->tIonCacheLock);
+	for (i = 0; i < RPC_ION_CACHE_SIZE; i++)
+	{
+		if (hCtx->tIonCache[i].hKey1 == NULL)
+			continue;
+		if (hCtx->tIonCache[i].nUsers != 0)
+		{
+			DOMX_DEBUG("Buffer %p still registered",
+			    hCtx->tIonCache[i].hRemote1);
+		}
+		RPC_IonCacheRemove(hCtx, &hCtx->tIonCache[i]);
+	}
+	if (hCtx->fd_ion >= 0)
+	{
+		ion_close(hCtx->fd_ion);
+		hCtx->fd_ion = -1;
+	}
+	pthread_mutex_unlock(&hCtx->tIonCacheLock);
+
+	nLookups = pStats->nHits + pStats->nMisses;
+	if (nLookups != 0 || pStats->nBypassed != 0)
+	{
+		DOMX_PROF("ION mapping cache: %d hits, %d misses (%d%% hit rate)"
+		    ", %d evictions, %d uncached", pStats->nHits,
+		    pStats->nMisses,
+		    nLookups ? (pStats->nHits * 100) / nLookups : 0,
+		    pStats->nEvictions, pStats->nBypassed);
+	}
+
+	pthread_mutex_destroy(&hCtx->tIonCacheLock);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheRegister()
+ * @brief Registers a buffer with the remote core, reusing the mapping of
+ *        the same buffer if it is cached. Buffers that are not ION buffers
+ *        are registered without the cache.
+ * @param hCtx [IN]              : RPC Context structure.
+ * @param fd1, fd2 [IN]          : Buffer components.
+ * @param handle1, handle2 [OUT] : Handles to pass to the remote core.
+ * @param proxyBufferType [IN]   : Kind of buffer.
+ * @return RPC_OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+RPC_OMX_ERRORTYPE RPC_IonCacheRegister(RPC_OMX_CONTEXT * hCtx, int fd1,
+    int fd2, OMX_PTR * handle1, OMX_PTR * handle2,
+    PROXY_BUFFER_TYPE proxyBufferType)
+{
+	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
+	RPC_OMX_ION_MAPPING *pMapping = NULL, *pFree = NULL;
+	OMX_PTR hKey1 = NULL, hKey2 = NULL;
+	OMX_BOOL bTwoFds = OMX_FALSE;
+	OMX_U32 i = 0;
+
+	*handle1 = NULL;
+	if (handle2 != NULL)
+		*handle2 = NULL;
+	if (hCtx->nIonCacheBudget == 0)
+		return RPC_MapIonBuffer(hCtx, fd1, fd2, handle1, handle2,
+		    proxyBufferType);
+
+	bTwoFds = (proxyBufferType == GrallocPointers ||
+	    proxyBufferType == BufferDescriptorVirtual2D) && fd2 >= 0;
+
+	pthread_mutex_lock(&hCtx->tIonCacheLock);
+	if (hCtx->fd_ion < 0)
+	{
+		hCtx->fd_ion = ion_open();
+		if (hCtx->fd_ion < 0)
+		{
+			DOMX_WARN("Can't open ION client, mapping cache off");
+			hCtx->nIonCacheBudget = 0;
+			goto UNCACHED;
+		}
+	}
+
+	hKey1 = RPC_IonCacheKey(hCtx, fd1);
+	if (bTwoFds)
+		hKey2 = RPC_IonCacheKey(hCtx, fd2);
+	if (hKey1 == NULL || (bTwoFds && hKey2 == NULL))
+		goto UNCACHED;
+
+	for (i = 0; i < RPC_ION_CACHE_SIZE; i++)
+	{
+		if (hCtx->tIonCache[i].hKey1 == NULL)
+		{
+			if (pFree == NULL)
+				pFree = &hCtx->tIonCache[i];
+			continue;
+		}
+		if (hCtx->tIonCache[i].hKey1 == hKey1 &&
+		    hCtx->tIonCache[i].hKey2 == hKey2 &&
+		    hCtx->tIonCache[i].nType == (OMX_U32) proxyBufferType)
+		{
+			pMapping = &hCtx->tIonCache[i];
+			break;
+		}
+	}
+
+	if (pMapping != NULL)
+	{
+		/*The mapping holds its own reference to the buffer */
+		RPC_IonCacheDropKey(hCtx, hKey1);
+		RPC_IonCacheDropKey(hCtx, hKey2);
+		if (pMapping->nUsers++ == 0)
+			hCtx->nIonCacheIdle--;
+		*handle1 = pMapping->hRemote1;
+		if (handle2 != NULL)
+			*handle2 = pMapping->hRemote2;
+		hCtx->tIonCacheStats.nHits++;
+		goto EXIT;
+	}
+
+	if (pFree == NULL)
+		pFree = RPC_IonCacheEvict(hCtx);
+	if (pFree == NULL)
+		goto UNCACHED;
+
+	/*Mapped under the lock so that the same buffer registered from two
+	  threads at once ends up with one mapping */
+	eRPCError = RPC_MapIonBuffer(hCtx, fd1, fd2, handle1, handle2,
+	    proxyBufferType);
+	if (eRPCError != RPC_OMX_ErrorNone || *handle1 == NULL)
+	{
+		RPC_IonCacheDropKey(hCtx, hKey1);
+		RPC_IonCacheDropKey(hCtx, hKey2);
+		goto EXIT;
+	}
+	pFree->hKey1 = hKey1;
+	pFree->hKey2 = hKey2;
+	pFree->hRemote1 = *handle1;
+	pFree->hRemote2 = (handle2 != NULL) ? *handle2 : NULL;
+	pFree->nType = proxyBufferType;
+	pFree->nUsers = 1;
+	hCtx->tIonCacheStats.nMisses++;
+	goto EXIT;
+
+      UNCACHED:
+	RPC_IonCacheDropKey(hCtx, hKey1);
+	RPC_IonCacheDropKey(hCtx, hKey2);
+	hCtx->tIonCacheStats.nBypassed++;
+	pthread_mutex_unlock(&hCtx->tIonCacheLock);
+	return RPC_MapIonBuffer(hCtx, fd1, fd2, handle1, handle2,
+	    proxyBufferType);
+
+      EXIT:
+	pthread_mutex_unlock(&hCtx->tIonCacheLock);
+	return eRPCError;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_IonCacheUnRegister()
+ * @brief Releases a registration. A cached mapping stays on the remote core
+ *        until the number of idle mappings exceeds the budget, the least
+ *        recently used one is unregistered then. Registrations made without
+ *        the cache are unregistered right away.
+ * @param hCtx [IN]             : RPC Context structure.
+ * @param handle1, handle2 [IN] : Handles returned by the registration.
+ * @param proxyBufferType [IN]  : Kind of buffer.
+ * @return RPC_OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+RPC_OMX_ERRORTYPE RPC_IonCacheUnRegister(RPC_OMX_CONTEXT * hCtx,
+    OMX_PTR handle1, OMX_PTR handle2, PROXY_BUFFER_TYPE proxyBufferType)
+{
+	RPC_OMX_ION_MAPPING *pMapping = NULL;
+	OMX_U32 i = 0;
+
+	pthread_mutex_lock(&hCtx->tIonCacheLock);
+	for (i = 0; i < RPC_ION_CACHE_SIZE; i++)
+	{
+		if (hCtx->tIonCache[i].hKey1 != NULL &&
+		    hCtx->tIonCache[i].nUsers != 0 &&
+		    hCtx->tIonCache[i].hRemote1 == handle1 &&
+		    hCtx->tIonCache[i].nType == (OMX_U32) proxyBufferType)
+		{
+			pMapping = &hCtx->tIonCache[i];
+			break;
+		}
+	}
+
+	if (pMapping == NULL)
+	{
+		pthread_mutex_unlock(&hCtx->tIonCacheLock);
+		return RPC_UnMapIonBuffer(hCtx, handle1, handle2,
+		    proxyBufferType);
+	}
+
+	if (--pMapping->nUsers == 0)
+	{
+		pMapping->nLastUse = ++hCtx->nIonCacheClock;
+		hCtx->nIonCacheIdle++;
+		while (hCtx->nIonCacheIdle > hCtx->nIonCacheBudget)
+			RPC_IonCacheEvict(hCtx);
+	}
+	pthread_mutex_unlock(&hCtx->tIonCacheLock);
+
+	return RPC_OMX_ErrorNone;
+}
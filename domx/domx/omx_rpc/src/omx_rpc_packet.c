@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  omx_rpc_packet.c
+ *         This file contains the packet pool used by the RPC stubs and the
+ *         callback thread of the OpenMAX1.1 DOMX Framework RPC.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\omx_rpc\src
+ *
+ *  @rev 1.0
+ */
+
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <OMX_Types.h>
+#include <timm_osal_interfaces.h>
+#include <timm_osal_trace.h>
+
+
+/*-------program files ----------------------------------------*/
+#include "omx_rpc.h"
+#include "omx_rpc_internal.h"
+#include "omx_rpc_utils.h"
+
+
+/******************************************************************
+ *   MACROS - LOCAL
+ ******************************************************************/
+/*Every packet is preceded by a header that is not sent over the wire*/
+typedef struct RPC_OMX_PACKET_HDR
+{
+	OMX_U32 nNext;		/*Index of the next free packet */
+	OMX_U32 nUsed;		/*Leading bytes that may be non zero */
+} RPC_OMX_PACKET_HDR;
+
+#define RPC_PACKET_SLOT_SIZE \
+    ((sizeof(RPC_OMX_PACKET_HDR) + RPC_PACKET_SIZE + 7) & ~7)
+
+/*Free list head: packet index in the low byte, change count above it so
+  that a pop racing with a pop and push of the same packet fails its CAS*/
+#define RPC_PACKET_INDEX_MASK 0xFF
+#define RPC_PACKET_NONE       0xFF
+#define RPC_PACKET_TAG_INC    0x100
+
+#if RPC_PACKET_POOL_SIZE >= RPC_PACKET_NONE
+#error "RPC_PACKET_POOL_SIZE does not fit the free list index"
+#endif
+
+#define RPC_PACKET_SLOT(hCtx, nIndex) \
+    ((RPC_OMX_PACKET_HDR *) ((hCtx)->pPacketPool + \
+    (nIndex) * RPC_PACKET_SLOT_SIZE))
+
+#define RPC_PACKET_HDR(pPacket) \
+    ((RPC_OMX_PACKET_HDR *) ((OMX_U8 *) (pPacket) - \
+    sizeof(RPC_OMX_PACKET_HDR)))
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_PacketPoolInit()
+ * @brief Allocates the packet pool of an RPC context and links all packets
+ *        into its free list.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return RPC_OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+RPC_OMX_ERRORTYPE RPC_PacketPoolInit(RPC_OMX_CONTEXT * hCtx)
+{
+	RPC_OMX_ERRORTYPE eRPCError = RPC_OMX_ErrorNone;
+	RPC_OMX_PACKET_HDR *pHdr = NULL;
+	OMX_U32 i = 0;
+
+	hCtx->pPacketPool =
+	    TIMM_OSAL_Malloc(RPC_PACKET_POOL_SIZE * RPC_PACKET_SLOT_SIZE,
+	    TIMM_OSAL_TRUE, 0, TIMMOSAL_MEM_SEGMENT_INT);
+	RPC_assert(hCtx->pPacketPool != NULL,
+	    RPC_OMX_ErrorInsufficientResources, "Packet pool malloc failed");
+
+	/*Packets start out zeroed. From then on only the part that was used
+	  is cleared when a packet is handed out again */
+	TIMM_OSAL_Memset(hCtx->pPacketPool, 0,
+	    RPC_PACKET_POOL_SIZE * RPC_PACKET_SLOT_SIZE);
+	for (i = 0; i < RPC_PACKET_POOL_SIZE; i++)
+	{
+		pHdr = RPC_PACKET_SLOT(hCtx, i);
+		pHdr->nNext =
+		    (i + 1 < RPC_PACKET_POOL_SIZE) ? i + 1 : RPC_PACKET_NONE;
+	}
+
+	hCtx->nPacketFreeList = 0;
+	TIMM_OSAL_Memset(&hCtx->tPacketStats, 0,
+	    sizeof(RPC_OMX_PACKET_STATS));
+	hCtx->tPacketStats.nPoolSize = RPC_PACKET_POOL_SIZE;
+
+      EXIT:
+	return eRPCError;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_PacketPoolDeInit()
+ * @brief Frees the packet pool. Must only be called once the callback thread
+ *        has exited and no stub call is in progress.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_PacketPoolDeInit(RPC_OMX_CONTEXT * hCtx)
+{
+	if (hCtx->tPacketStats.nInUse != 0)
+	{
+		DOMX_DEBUG("%d packets still allocated",
+		    hCtx->tPacketStats.nInUse);
+	}
+
+	if (hCtx->pPacketPool != NULL)
+	{
+		TIMM_OSAL_Free(hCtx->pPacketPool);
+		hCtx->pPacketPool = NULL;
+	}
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_PacketAlloc()
+ * @brief Takes a packet of RPC_PACKET_SIZE bytes from the pool, or from the
+ *        heap when the pool is empty. The packet is all zeroes. Safe to call
+ *        from any thread.
+ * @param hCtx [IN] : RPC Context structure.
+ * @return The packet, NULL if out of memory
+ */
+/* ===========================================================================*/
+OMX_PTR RPC_PacketAlloc(RPC_OMX_CONTEXT * hCtx)
+{
+	RPC_OMX_PACKET_HDR *pHdr = NULL;
+	OMX_U32 nHead = 0, nNext = 0, nInUse = 0, nHighWater = 0;
+
+	if (hCtx->pPacketPool != NULL)
+	{
+		nHead =
+		    __atomic_load_n(&hCtx->nPacketFreeList, __ATOMIC_ACQUIRE);
+		while ((nHead & RPC_PACKET_INDEX_MASK) != RPC_PACKET_NONE)
+		{
+			pHdr =
+			    RPC_PACKET_SLOT(hCtx,
+			    nHead & RPC_PACKET_INDEX_MASK);
+			nNext = __atomic_load_n(&pHdr->nNext, __ATOMIC_RELAXED);
+			if (__atomic_compare_exchange_n(&hCtx->nPacketFreeList,
+				&nHead,
+				((nHead + RPC_PACKET_TAG_INC) &
+				    ~RPC_PACKET_INDEX_MASK) | nNext, 1,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			{
+				break;
+			}
+			pHdr = NULL;
+		}
+	}
+
+	if (pHdr != NULL)
+	{
+		TIMM_OSAL_Memset(pHdr + 1, 0, pHdr->nUsed);
+	} else
+	{
+		__atomic_add_fetch(&hCtx->tPacketStats.nExhausted, 1,
+		    __ATOMIC_RELAXED);
+		pHdr =
+		    TIMM_OSAL_Malloc(sizeof(RPC_OMX_PACKET_HDR) +
+		    RPC_PACKET_SIZE, TIMM_OSAL_TRUE, 0,
+		    TIMMOSAL_MEM_SEGMENT_INT);
+		if (pHdr == NULL)
+		{
+			return NULL;
+		}
+		TIMM_OSAL_Memset(pHdr + 1, 0, RPC_PACKET_SIZE);
+	}
+
+	/*The caller may write anywhere until it says otherwise */
+	pHdr->nUsed = RPC_PACKET_SIZE;
+
+	nInUse =
+	    __atomic_add_fetch(&hCtx->tPacketStats.nInUse, 1,
+	    __ATOMIC_RELAXED);
+	nHighWater =
+	    __atomic_load_n(&hCtx->tPacketStats.nHighWater, __ATOMIC_RELAXED);
+	while (nInUse > nHighWater &&
+	    !__atomic_compare_exchange_n(&hCtx->tPacketStats.nHighWater,
+		&nHighWater, nInUse, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+	}
+
+	return pHdr + 1;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_PacketSetUsed()
+ * @brief Records how many leading bytes of a packet have been written, so
+ *        that only those get cleared when the packet is reused.
+ * @param pPacket [IN] : Packet returned by RPC_PacketAlloc.
+ * @param nUsed [IN]   : Header plus payload size written.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_PacketSetUsed(OMX_PTR pPacket, OMX_U32 nUsed)
+{
+	RPC_PACKET_HDR(pPacket)->nUsed =
+	    (nUsed < RPC_PACKET_SIZE) ? nUsed : RPC_PACKET_SIZE;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_PacketFree()
+ * @brief Returns a packet to the pool it came from, or to the heap. Safe to
+ *        call from any thread.
+ * @param hCtx [IN]    : RPC Context structure.
+ * @param pPacket [IN] : Packet returned by RPC_PacketAlloc.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_PacketFree(RPC_OMX_CONTEXT * hCtx, OMX_PTR pPacket)
+{
+	RPC_OMX_PACKET_HDR *pHdr = RPC_PACKET_HDR(pPacket);
+	OMX_U32 nHead = 0, nIndex = 0;
+
+	if (hCtx->pPacketPool != NULL &&
+	    (OMX_U8 *) pHdr >= hCtx->pPacketPool &&
+	    (OMX_U8 *) pHdr <
+	    hCtx->pPacketPool + RPC_PACKET_POOL_SIZE * RPC_PACKET_SLOT_SIZE)
+	{
+		nIndex =
+		    ((OMX_U8 *) pHdr -
+		    hCtx->pPacketPool) / RPC_PACKET_SLOT_SIZE;
+		nHead =
+		    __atomic_load_n(&hCtx->nPacketFreeList, __ATOMIC_RELAXED);
+		do
+		{
+			__atomic_store_n(&pHdr->nNext,
+			    nHead & RPC_PACKET_INDEX_MASK, __ATOMIC_RELAXED);
+		}
+		while (!__atomic_compare_exchange_n(&hCtx->nPacketFreeList,
+			&nHead,
+			((nHead + RPC_PACKET_TAG_INC) &
+			    ~RPC_PACKET_INDEX_MASK) | nIndex, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	} else
+	{
+		TIMM_OSAL_Free(pHdr);
+	}
+
+	__atomic_sub_fetch(&hCtx->tPacketStats.nInUse, 1, __ATOMIC_RELAXED);
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name RPC_PacketGetStats()
+ * @brief Reads the packet pool usage counters of an RPC context.
+ * @param hRPCCtx [IN] : RPC Context structure.
+ * @param pStats [OUT] : Filled in with the current counters.
+ * @return none
+ */
+/* ===========================================================================*/
+void RPC_PacketGetStats(OMX_HANDLETYPE hRPCCtx,
+    RPC_OMX_PACKET_STATS * pStats)
+{
+	RPC_OMX_CONTEXT *hCtx = (RPC_OMX_CONTEXT *) hRPCCtx;
+
+	pStats->nPoolSize = hCtx->tPacketStats.nPoolSize;
+	pStats->nInUse =
+	    __atomic_load_n(&hCtx->tPacketStats.nInUse, __ATOMIC_RELAXED);
+	pStats->nHighWater =
+	    __atomic_load_n(&hCtx->tPacketStats.nHighWater, __ATOMIC_RELAXED);
+	pStats->nExhausted =
+	    __atomic_load_n(&hCtx->tPacketStats.nExhausted, __ATOMIC_RELAXED);
+}
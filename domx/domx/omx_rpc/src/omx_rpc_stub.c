@@ -66,6 +66,7 @@
 
 #include <linux/rpmsg_omx.h>
 #include "rpmsg_omx_defs.h"
+#include "profile.h"
 
 /******************************************************************
  *   EXTERNS
@@ -78,27 +79,30 @@
 //#define RPC_MSGPIPE_SIZE (4)
 #define RPC_MSG_SIZE_FOR_PIPE (sizeof(OMX_PTR))
 
-/* When this is defined ETB/FTB calls are made in sync mode. Undefining will
- * result in these calls being sent via async mode. Sync mode leads to correct
- * functionality as per OMX spec but has a slight performance penalty. Async
- * mode sacrifices strict adherence to spec for some gain in performance. */
-#define RPC_SYNC_MODE
+/* ETB/FTB calls are sent without waiting for the remote reply when the
+ * context has an async window (see RPC_ASYNC_WINDOW_DEFAULT). The reply is
+ * matched by msg_id on the callback thread, and an error in it is reported
+ * through the EventHandler with the buffer handed back to the client. Other
+ * calls are always synchronous. */
 
 
-#define RPC_getPacket(nPacketSize, pPacket) do { \
-    pPacket = TIMM_OSAL_Malloc(nPacketSize, TIMM_OSAL_TRUE, 0, TIMMOSAL_MEM_SEGMENT_INT); \
+/*Packets come zeroed from the context's packet pool*/
+#define RPC_getPacket(hCtx, pPacket) do { \
+    pPacket = RPC_PacketAlloc(hCtx); \
     RPC_assert(pPacket != NULL, RPC_OMX_ErrorInsufficientResources, \
            "Error Allocating RCM Message Frame"); \
-    TIMM_OSAL_Memset(pPacket, 0, nPacketSize); \
     } while(0)
 
-#define RPC_freePacket(pPacket) do { \
-    if(pPacket != NULL) TIMM_OSAL_Free(pPacket); \
+#define RPC_freePacket(hCtx, pPacket) do { \
+    if(pPacket != NULL) RPC_PacketFree(hCtx, pPacket); \
     } while(0)
 
+/*All stubs pack their arguments through nPos, so the packet header plus
+  nPos bytes is what needs clearing before the packet is reused*/
 #define RPC_sendPacket_sync(hCtx, pPacket, nPacketSize, nFxnIdx, pRetPacket, nSize) do { \
+    RPC_PacketSetUsed(pPacket, sizeof(struct omx_packet) + nPos); \
     status = write(hCtx->fd_omx, pPacket, nPacketSize); \
-    RPC_freePacket(pPacket); \
+    RPC_freePacket(hCtx, pPacket); \
     pPacket = NULL; \
     if(status < 0 && errno == ENXIO) {  \
          RPC_assert(0, RPC_OMX_ErrorHardware, "Write failed - Ducati in faulty state"); \
@@ -125,31 +129,22 @@
     pOmxPacket->data_size = nPacketSize; \
     } while(0)
 
-//Async to be checked later - most probably same as sync but without the read
-#if 0
-
-#define RPC_sendPacket_async(HRCM, pPacket, nFxnIdx) do { \
-    pPacket->nFxnIdx = nFxnIdx; \
-    status = RcmClient_execCmd(HRCM, pPacket); \
-    if(status < 0) { \
-    RPC_freePacket(HRCM, pPacket); \
+#define RPC_sendPacket_async(hCtx, pPacket, nPacketSize, nMsgId) do { \
+    RPC_PacketSetUsed(pPacket, sizeof(struct omx_packet) + nPos); \
+    status = write(hCtx->fd_omx, pPacket, nPacketSize); \
+    RPC_freePacket(hCtx, pPacket); \
     pPacket = NULL; \
-    RPC_assert(0, RPC_OMX_RCM_ErrorExecFail, \
-           "RcmClient_exec failed"); \
-    } \
-    } while(0)
-
-#define RPC_checkAsyncErrors(rcmHndl, pPacket) do { \
-    status = RcmClient_checkForError(rcmHndl, &pPacket); \
-    if(status < 0) { \
-        RPC_freePacket(rcmHndl, pPacket); \
-        pPacket = NULL; \
+    if(status != (signed)nPacketSize) { \
+        RPC_AsyncCancel(hCtx, nMsgId); \
     } \
-    RPC_assert(status >= 0, RPC_OMX_RCM_ClientFail, \
-        "Async error check returned error"); \
+    if(status < 0 && errno == ENXIO) {  \
+         RPC_assert(0, RPC_OMX_ErrorHardware, "Write failed - Ducati in faulty state"); \
+    }  \
+    if(status != (signed)nPacketSize) { \
+        DOMX_ERROR("Write failed returning status = 0x%x",status); \
+        RPC_assert(0, RPC_OMX_ErrorUndefined, "Write failed"); \
+    }  \
     } while(0)
-
-#endif
 /* ===========================================================================*/
 /**
  * @name RPC_GetHandle()
@@ -186,7 +181,7 @@ RPC_OMX_ERRORTYPE RPC_GetHandle(OMX_HANDLETYPE hRPCCtx,
 	    cComponentName);
 
 	nFxnIdx = RPC_OMX_FXN_IDX_GET_HANDLE;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	DOMX_DEBUG("Packing data");
@@ -229,9 +224,9 @@ RPC_OMX_ERRORTYPE RPC_GetHandle(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -264,8 +259,11 @@ RPC_OMX_ERRORTYPE RPC_FreeHandle(OMX_HANDLETYPE hRPCCtx,
 
 	DOMX_ENTER("");
 
+	/*Let errors of buffers still in flight surface first */
+	RPC_AsyncDrain(hCtx);
+
 	nFxnIdx = RPC_OMX_FXN_IDX_FREE_HANDLE;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -282,9 +280,9 @@ RPC_OMX_ERRORTYPE RPC_FreeHandle(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -322,7 +320,7 @@ RPC_OMX_ERRORTYPE RPC_SetParameter(OMX_HANDLETYPE hRPCCtx,
 	struct omx_packet *pOmxPacket = NULL;
 
 	nFxnIdx = RPC_OMX_FXN_IDX_SET_PARAMETER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	if (pLocBufNeedMap != NULL && ((long int)pLocBufNeedMap - (long int)pCompParam) >= 0 ) {
@@ -357,9 +355,9 @@ RPC_OMX_ERRORTYPE RPC_SetParameter(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -398,7 +396,7 @@ RPC_OMX_ERRORTYPE RPC_GetParameter(OMX_HANDLETYPE hRPCCtx,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_GET_PARAMETER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	if (pLocBufNeedMap != NULL && ((long int)pLocBufNeedMap - (long int)pCompParam) >= 0 ) {
@@ -436,10 +434,10 @@ RPC_OMX_ERRORTYPE RPC_GetParameter(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	//In case of Error Hardware this packet gets freed in omx_rpc.c
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -477,7 +475,7 @@ RPC_OMX_ERRORTYPE RPC_SetConfig(OMX_HANDLETYPE hRPCCtx,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_SET_CONFIG;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	if (pLocBufNeedMap != NULL && ((long int)pLocBufNeedMap - (long int)pCompConfig) >= 0 ) {
@@ -505,9 +503,9 @@ RPC_OMX_ERRORTYPE RPC_SetConfig(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -544,7 +542,7 @@ RPC_OMX_ERRORTYPE RPC_GetConfig(OMX_HANDLETYPE hRPCCtx,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_GET_CONFIG;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	if (pLocBufNeedMap != NULL && ((long int)pLocBufNeedMap - (long int)pCompConfig) >= 0 ) {
@@ -582,9 +580,9 @@ RPC_OMX_ERRORTYPE RPC_GetConfig(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -622,8 +620,11 @@ RPC_OMX_ERRORTYPE RPC_SendCommand(OMX_HANDLETYPE hRPCCtx,
 
 	DOMX_ENTER("");
 
+	/*Let errors of buffers still in flight surface first */
+	RPC_AsyncDrain(hCtx);
+
 	nFxnIdx = RPC_OMX_FXN_IDX_SEND_CMD;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -654,9 +655,9 @@ RPC_OMX_ERRORTYPE RPC_SendCommand(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -693,7 +694,7 @@ RPC_OMX_ERRORTYPE RPC_GetState(OMX_HANDLETYPE hRPCCtx, OMX_STATETYPE * pState,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_GET_STATE;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -716,9 +717,9 @@ RPC_OMX_ERRORTYPE RPC_GetState(OMX_HANDLETYPE hRPCCtx, OMX_STATETYPE * pState,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -764,7 +765,7 @@ RPC_OMX_ERRORTYPE RPC_GetComponentVersion(OMX_HANDLETYPE hRPCCtx,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_GET_VERSION;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -793,9 +794,9 @@ RPC_OMX_ERRORTYPE RPC_GetComponentVersion(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	return eRPCError;
 }
@@ -832,7 +833,7 @@ RPC_OMX_ERRORTYPE RPC_GetExtensionIndex(OMX_HANDLETYPE hRPCCtx,
 
 	nFxnIdx = RPC_OMX_FXN_IDX_GET_EXT_INDEX;
 
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -858,9 +859,9 @@ RPC_OMX_ERRORTYPE RPC_GetExtensionIndex(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	return eRPCError;
 
@@ -901,7 +902,7 @@ RPC_OMX_ERRORTYPE RPC_AllocateBuffer(OMX_HANDLETYPE hRPCCtx,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_ALLOCATE_BUFFER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -987,9 +988,9 @@ RPC_OMX_ERRORTYPE RPC_AllocateBuffer(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -1037,7 +1038,7 @@ RPC_OMX_ERRORTYPE RPC_UseBuffer(OMX_HANDLETYPE hRPCCtx,
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_USE_BUFFER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	DOMX_DEBUG("Marshaling data");
@@ -1150,9 +1151,9 @@ RPC_OMX_ERRORTYPE RPC_UseBuffer(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -1186,8 +1187,11 @@ RPC_OMX_ERRORTYPE RPC_FreeBuffer(OMX_HANDLETYPE hRPCCtx,
 
 	DOMX_ENTER("");
 
+	/*Let errors of buffers still in flight surface first */
+	RPC_AsyncDrain(hCtx);
+
 	nFxnIdx = RPC_OMX_FXN_IDX_FREE_BUFFER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*Offset is the location of the buffer pointer from the start of the data packet */
@@ -1212,9 +1216,9 @@ RPC_OMX_ERRORTYPE RPC_FreeBuffer(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -1247,15 +1251,14 @@ RPC_OMX_ERRORTYPE RPC_EmptyThisBuffer(OMX_HANDLETYPE hRPCCtx,
 	OMX_HANDLETYPE hComp = hCtx->hRemoteHandle;
 	OMX_U8 *pAuxBuf1 = NULL;
 	struct omx_packet *pOmxPacket = NULL;
+	OMX_U16 nMsgId = 0;
 	RPC_OMX_MAP_INFO_TYPE eMapInfo = RPC_OMX_MAP_INFO_NONE;
-#ifdef RPC_SYNC_MODE
 	TIMM_OSAL_PTR pPacket = NULL, pRetPacket = NULL, pData = NULL;
-#endif
 
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_EMPTYTHISBUFFER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	if(bMapBuffer == OMX_TRUE)
@@ -1305,24 +1308,40 @@ RPC_OMX_ERRORTYPE RPC_EmptyThisBuffer(OMX_HANDLETYPE hRPCCtx,
 	DOMX_DEBUG(" pBufferHdr = %x BufHdrRemote %x", pBufferHdr,
 	    BufHdrRemote);
 
-#ifdef RPC_SYNC_MODE
-	RPC_sendPacket_sync(hCtx, pPacket, nPacketSize, nFxnIdx, pRetPacket,
-	    nSize);
-
-	*eCompReturn = (OMX_ERRORTYPE) (((struct omx_packet *) pRetPacket)->result);
-#else
-	RPC_sendPacket_async(hCtx->ClientHndl[RCM_DEFAULT_CLIENT], pPacket,
-	    nFxnIdx);
-	RPC_checkAsyncErrors(hCtx->ClientHndl[RCM_DEFAULT_CLIENT], pPacket);
-
-	*eCompReturn = OMX_ErrorNone;
-#endif
+	if (hCtx->nAsyncWindow != 0)
+	{
+		eRPCError =
+		    RPC_AsyncBegin(hCtx, nFxnIdx, BufHdrRemote, pBufferHdr,
+		    &nMsgId);
+		RPC_assert(eRPCError == RPC_OMX_ErrorNone, eRPCError,
+		    "No room for another call in flight");
+		/*The packet is freed before a failed write is cancelled, so
+		  keep the id in a local */
+		pOmxPacket->msg_id = nMsgId;
+		KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_WRITE, hCtx->pAppData,
+		    BufHdrRemote);
+		RPC_sendPacket_async(hCtx, pPacket, nPacketSize, nMsgId);
+
+		*eCompReturn = OMX_ErrorNone;
+	} else
+	{
+		KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_WRITE, hCtx->pAppData,
+		    BufHdrRemote);
+		RPC_sendPacket_sync(hCtx, pPacket, nPacketSize, nFxnIdx,
+		    pRetPacket, nSize);
+		KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_ACK, hCtx->pAppData,
+		    BufHdrRemote);
+
+		*eCompReturn =
+		    (OMX_ERRORTYPE) (((struct omx_packet *) pRetPacket)->
+		    result);
+	}
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -1354,14 +1373,13 @@ RPC_OMX_ERRORTYPE RPC_FillThisBuffer(OMX_HANDLETYPE hRPCCtx,
 	OMX_HANDLETYPE hComp = hCtx->hRemoteHandle;
 	OMX_U8 *pAuxBuf1 = NULL;
 	struct omx_packet *pOmxPacket = NULL;
-#ifdef RPC_SYNC_MODE
+	OMX_U16 nMsgId = 0;
 	TIMM_OSAL_PTR pPacket = NULL, pRetPacket = NULL, pData = NULL;
-#endif
 
 	DOMX_ENTER("");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_FILLTHISBUFFER;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
 	/*No buffer mapping required */
@@ -1383,25 +1401,40 @@ RPC_OMX_ERRORTYPE RPC_FillThisBuffer(OMX_HANDLETYPE hRPCCtx,
 	DOMX_DEBUG(" pBufferHdr = %x BufHdrRemote %x", pBufferHdr,
 	    BufHdrRemote);
 
-#ifdef RPC_SYNC_MODE
-	RPC_sendPacket_sync(hCtx, pPacket, nPacketSize, nFxnIdx, pRetPacket,
-	    nSize);
-
-	*eCompReturn = (OMX_ERRORTYPE) (((struct omx_packet *) pRetPacket)->result);
-
-#else
-	RPC_sendPacket_async(hCtx->ClientHndl[RCM_DEFAULT_CLIENT], pPacket,
-	    nFxnIdx);
-	RPC_checkAsyncErrors(hCtx->ClientHndl[RCM_DEFAULT_CLIENT], pPacket);
-
-	*eCompReturn = OMX_ErrorNone;
-#endif
+	if (hCtx->nAsyncWindow != 0)
+	{
+		eRPCError =
+		    RPC_AsyncBegin(hCtx, nFxnIdx, BufHdrRemote, pBufferHdr,
+		    &nMsgId);
+		RPC_assert(eRPCError == RPC_OMX_ErrorNone, eRPCError,
+		    "No room for another call in flight");
+		/*The packet is freed before a failed write is cancelled, so
+		  keep the id in a local */
+		pOmxPacket->msg_id = nMsgId;
+		KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_WRITE, hCtx->pAppData,
+		    BufHdrRemote);
+		RPC_sendPacket_async(hCtx, pPacket, nPacketSize, nMsgId);
+
+		*eCompReturn = OMX_ErrorNone;
+	} else
+	{
+		KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_WRITE, hCtx->pAppData,
+		    BufHdrRemote);
+		RPC_sendPacket_sync(hCtx, pPacket, nPacketSize, nFxnIdx,
+		    pRetPacket, nSize);
+		KPI_OmxCompRpcEvent(KPI_BUFFER_RPC_ACK, hCtx->pAppData,
+		    BufHdrRemote);
+
+		*eCompReturn =
+		    (OMX_ERRORTYPE) (((struct omx_packet *) pRetPacket)->
+		    result);
+	}
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket && *eCompReturn != OMX_ErrorHardware)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
@@ -1453,14 +1486,12 @@ RPC_OMX_ERRORTYPE RPC_ComponentTunnelRequest(OMX_HANDLETYPE hRPCCtx,
 	struct omx_packet *pOmxPacket = NULL;
 	OMX_U32 nPos = 0, nSize = 0, nOffset = 0;
 	OMX_S32 status = 0;
-#ifdef RPC_SYNC_MODE
 	TIMM_OSAL_PTR pPacket = NULL, pRetPacket = NULL, pData = NULL;
-#endif
 
         printf(" Entering rpc:domx_stub.c:ComponentTunnelRequest\n");
 
 	nFxnIdx = RPC_OMX_FXN_IDX_COMP_TUNNEL_REQUEST;
-	RPC_getPacket(nPacketSize, pPacket);
+	RPC_getPacket(hCtx, pPacket);
 	RPC_initPacket(pPacket, pOmxPacket, pData, nFxnIdx, nPacketSize);
 
         /*Pack the values into a packet*/
@@ -1479,9 +1510,9 @@ RPC_OMX_ERRORTYPE RPC_ComponentTunnelRequest(OMX_HANDLETYPE hRPCCtx,
 
       EXIT:
 	if (pPacket)
-		RPC_freePacket(pPacket);
+		RPC_freePacket(hCtx, pPacket);
 	if (pRetPacket)
-		RPC_freePacket(pRetPacket);
+		RPC_freePacket(hCtx, pRetPacket);
 
 	DOMX_EXIT("");
 	return eRPCError;
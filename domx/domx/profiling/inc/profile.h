@@ -62,7 +62,10 @@ enum KPI_BUFFER_EVENT {
         KPI_BUFFER_ETB = 1,
         KPI_BUFFER_FTB = 2,
         KPI_BUFFER_EBD = 3,
-        KPI_BUFFER_FBD = 4
+        KPI_BUFFER_FBD = 4,
+        KPI_BUFFER_RPC_WRITE = 5,    /* ETB/FTB written to the remote core */
+        KPI_BUFFER_RPC_ACK = 6,      /* remote core replied to the ETB/FTB */
+        KPI_BUFFER_REFUSED = 7       /* ETB/FTB failed, the buffer stays with the client */
 };
 
 /**
@@ -76,10 +79,35 @@ void KPI_OmxCompInit(OMX_HANDLETYPE hComponent);
 void KPI_OmxCompDeinit(OMX_HANDLETYPE hComponent);
 
 /**
- * OMA monitoring buffer event trace. Traces FTB/ETB/FBD/EBD event
+ * OMX monitoring RPC packet pool trace. Traces pool size, high-water mark and
+ * exhaustion count of the component's RPC context
+ */
+void KPI_OmxCompRpcPackets(OMX_HANDLETYPE hComponent, const char* name);
+
+/**
+ * OMX monitoring parameter cache trace. Traces hits, misses and invalidations
+ * of the proxy's parameter/config cache
+ */
+void KPI_OmxCompParamCache(OMX_HANDLETYPE hComponent, const char* name);
+
+/**
+ * OMA monitoring buffer event trace. Traces FTB/ETB/FBD/EBD event, keeps
+ * per buffer timestamps and latency histograms
  */
 void KPI_OmxCompBufferEvent(enum KPI_BUFFER_EVENT event, OMX_HANDLETYPE hComponent, PROXY_BUFFER_INFO* pBuffer);
 
+/**
+ * OMX monitoring RPC event trace. Timestamps the write of an ETB/FTB to the
+ * remote core and its reply, called from the RPC layer
+ */
+void KPI_OmxCompRpcEvent(enum KPI_BUFFER_EVENT event, OMX_HANDLETYPE hComponent, OMX_U32 nBufHdrRemote);
+
+/**
+ * OMX monitoring dump. Dumps in-flight depths, latency histograms and the
+ * event records of all threads to the KPI dump file or the trace
+ */
+void KPI_OmxDump(void);
+
 #ifdef __cplusplus
 }
 #endif /* #ifdef __cplusplus */
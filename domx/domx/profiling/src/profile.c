@@ -43,9 +43,13 @@
  *   INCLUDE FILES
  ******************************************************************/
 /* ----- system and platform files ----------------------------*/
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #ifdef _Android
 #include <cutils/properties.h>
@@ -53,6 +57,7 @@
 
 #include <OMX_Types.h>
 #include <OMX_Component.h>
+#include <timm_osal_interfaces.h>
 
 /*-------program files ----------------------------------------*/
 #include "omx_rpc_utils.h"
@@ -65,33 +70,120 @@
  ******************************************************************/
 /* Events that can be dynamically enabled */
 enum KPI_STATUS {
-	KPI_BUFFER_EVENTS = 1
+	KPI_BUFFER_EVENTS = 1,
+	KPI_RPC_PACKETS = 2,
+	KPI_PARAM_CACHE = 4,
+	KPI_BUFFER_LATENCY = 8,
+	KPI_EVENT_LOG = 16
 };
 
-/* OMX buffer events per component */
+/* Events traced at component init and deinit */
+#define KPI_COMP_EVENTS (KPI_BUFFER_EVENTS | KPI_RPC_PACKETS | KPI_PARAM_CACHE | \
+	KPI_BUFFER_LATENCY | KPI_EVENT_LOG)
+
+/* Events that look at every buffer */
+#define KPI_BUFFER_STATUS (KPI_BUFFER_EVENTS | KPI_BUFFER_LATENCY | KPI_EVENT_LOG)
+
+/* Bucket i of a histogram counts latencies below 2^i us and not below
+ * 2^(i-1) us, the last bucket everything longer */
+#define KPI_HIST_BUCKETS 24
+
+enum KPI_HISTOGRAM {
+	KPI_HIST_ETB_EBD = 0,	/* ETB called to EBD delivered */
+	KPI_HIST_FTB_FBD,	/* FTB called to FBD delivered */
+	KPI_HIST_RPC,		/* ETB/FTB written to the remote core to its reply */
+	KPI_HIST_PROXY,		/* ETB/FTB called to written to the remote core */
+	KPI_HIST_MAX
+};
+
+/* Event records kept per thread, a power of 2 */
+#define KPI_RING_SIZE 512
+
+/* Deliveries between two looks at the dump trigger */
+#define KPI_DUMP_POLL 256
+
+#define KPI_VALUE_MAX 92
+
+typedef struct {
+	OMX_U32 count;
+	OMX_U32 max;
+	OMX_U64 sum;
+	OMX_U32 buckets[KPI_HIST_BUCKETS];
+} kpi_histogram;
+
+/* Timestamps of the call a buffer is in, 0 when not taken */
 typedef struct {
+	OMX_U64 entry;		/* ETB/FTB called on the proxy */
+	OMX_U64 write;		/* call written to the remote core */
+	OMX_U64 ack;		/* remote core replied to the call */
+	OMX_U32 pending;	/* KPI_BUFFER_ETB/FTB until the buffer comes back */
+} kpi_omx_buffer;
+
+/* OMX buffer events per component */
+typedef struct kpi_omx_component {
+	struct kpi_omx_component *next;
 	OMX_HANDLETYPE hComponent;
+	OMX_U32 id;
 	OMX_U32 count_ftb;
 	OMX_U32 count_fbd;
 	OMX_U32 count_etb;
 	OMX_U32 count_ebd;
+	OMX_U32 count_refused;
 	char name[50];
+	OMX_S32 in_flight[2];		/* ETBs and FTBs not returned yet */
+	OMX_S32 in_flight_high[2];
+	kpi_histogram hist[KPI_HIST_MAX];
+	kpi_omx_buffer buffers[MAX_NUM_PROXY_BUFFERS];
 } kpi_omx_component;
 
-/* we trace up to MAX_OMX_COMP components */
-#define MAX_OMX_COMP 8
+typedef struct {
+	OMX_U64 time;
+	OMX_U32 comp;		/* id of the component */
+	OMX_U32 buffer;		/* remote buffer header */
+	OMX_U32 event;
+} kpi_event_record;
+
+/* Written by one thread only, read by the dump without locking */
+typedef struct kpi_event_ring {
+	struct kpi_event_ring *next;
+	OMX_U32 owned;		/* taken by a live thread */
+	OMX_U32 tid;
+	OMX_U32 head;		/* records written so far */
+	kpi_event_record records[KPI_RING_SIZE];
+} kpi_event_ring;
 
 
 /***************************************************************
  * kpi_omx_monitor
  * -------------------------------------------------------------
- * Contains up to 8 components data
+ * Monitored components, each is also reached through the pKpi
+ * field of its proxy so buffer events need no lookup. The list
+ * only changes at component init and deinit, under kpi_lock.
  *
  ***************************************************************/
-kpi_omx_component kpi_omx_monitor[MAX_OMX_COMP]; /* we trace up to MAX_OMX_COMP components */
+static kpi_omx_component *kpi_omx_monitor = NULL;
 OMX_U32 kpi_omx_monitor_cnt = 0; /* no component yet */
+static OMX_U32 kpi_omx_monitor_id = 0;
+static pthread_mutex_t kpi_lock = PTHREAD_MUTEX_INITIALIZER;
 unsigned int kpi_status = 0;
 
+/* Event rings of all threads that ever logged, never freed; the ring of a
+ * thread that exited is taken over by the next new thread */
+static kpi_event_ring *kpi_rings = NULL;
+static pthread_key_t kpi_ring_key;
+static pthread_once_t kpi_ring_once = PTHREAD_ONCE_INIT;
+
+/* Last value of the dump trigger, a dump is made for every new one */
+static char kpi_dump_trigger[KPI_VALUE_MAX];
+
+static const char *kpi_hist_names[KPI_HIST_MAX] = {
+	"ETB->EBD", "FTB->FBD", "RPC", "Proxy"
+};
+
+static const char *kpi_event_names[] = {
+	"", "ETB", "FTB", "EBD", "FBD", "WRITE", "ACK", "REFUSED"
+};
+
 
 /* ===========================================================================*/
 /**
@@ -111,6 +203,39 @@ OMX_U64 KPI_GetTime(void)
 	return ((long long)tp.tv_sec * 1000000 + tp.tv_nsec / 1000);
 }
 
+/* ===========================================================================*/
+/**
+ * @name KPI_GetSetting()
+ * @brief Read a setting from the environment, or else from a property
+ * @param env : environment variable
+ * @param prop : Android property
+ * @param value : receives the value, empty when neither is set
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_GetSetting(const char *env, const char *prop, char *value)
+{
+	char *val = getenv(env);
+
+	value[0] = '\0';
+	if (val)
+	{
+		strncpy(value, val, KPI_VALUE_MAX - 1);
+		value[KPI_VALUE_MAX - 1] = '\0';
+	}
+#ifdef _Android
+	else
+	{
+		char prop_value[PROPERTY_VALUE_MAX];
+
+		property_get(prop, prop_value, "");
+		strncpy(value, prop_value, KPI_VALUE_MAX - 1);
+		value[KPI_VALUE_MAX - 1] = '\0';
+	}
+#endif
+}
+
 /* ===========================================================================*/
 /**
  * @name KPI_OmxCompKpiUpdateStatus()
@@ -143,6 +268,27 @@ void KPI_OmxCompKpiUpdateStatus(void)
 #endif
 }
 
+/* ===========================================================================*/
+/**
+ * @name KPI_Component()
+ * @brief Monitoring structure of a proxy component
+ * @param hComponent : proxy component handle, may be NULL
+ * @return kpi_omx_component* = NULL if the component is not monitored
+ *
+ */
+/* ===========================================================================*/
+static kpi_omx_component *KPI_Component(OMX_HANDLETYPE hComponent)
+{
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+
+	if (hComponent == NULL) return NULL;
+
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
+	if (pCompPrv == NULL) return NULL;
+
+	return (kpi_omx_component *) pCompPrv->pKpi;
+}
+
 /* ===========================================================================*/
 /**
  * @name KPI_OmxCompInit()
@@ -159,43 +305,28 @@ void KPI_OmxCompInit(OMX_HANDLETYPE hComponent)
 	OMX_VERSIONTYPE nVersionSpec;
 	OMX_UUIDTYPE    compUUID;
 	char compName[OMX_MAX_STRINGNAME_SIZE];
+	char suffix[7];
 	char* p;
-	OMX_U32 omx_cnt;
-	struct timespec tp;
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+	kpi_omx_component *comp;
 
 	/* Check if some profiling events have been enabled/disabled */
 	KPI_OmxCompKpiUpdateStatus();
 
-	if ( !(kpi_status & KPI_BUFFER_EVENTS) )
+	if ( !(kpi_status & KPI_COMP_EVENTS) )
 		return;
 
-	/* First init: clear kpi_omx_monitor components */
-	if( kpi_omx_monitor_cnt == 0) {
-		for (omx_cnt = 0; omx_cnt < MAX_OMX_COMP; omx_cnt++) {
-			/*clear handler registry */
-			kpi_omx_monitor[omx_cnt].hComponent = 0;
-		}
-	}
-
-	/* find an empty monitoring structure */
-	for( omx_cnt = 0; omx_cnt < MAX_OMX_COMP;  omx_cnt++ ) {
-		if( kpi_omx_monitor[omx_cnt].hComponent == 0 ) break;
-	}
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
+	if( pCompPrv == NULL ) return;
 
-	/* too omany components started, do not monitor */
-	if( omx_cnt >= MAX_OMX_COMP) return;
-
-	/* current comp num and update */
-	kpi_omx_monitor_cnt++;
+	/* not enough memory, do not monitor */
+	comp = TIMM_OSAL_Malloc(sizeof(kpi_omx_component), TIMM_OSAL_TRUE, 0,
+	    TIMMOSAL_MEM_SEGMENT_INT);
+	if( comp == NULL ) return;
+	TIMM_OSAL_Memset(comp, 0, sizeof(kpi_omx_component));
 
 	/* register the component handle */
-	kpi_omx_monitor[omx_cnt].hComponent = hComponent;
-
-	/* reset event counts */
-	kpi_omx_monitor[omx_cnt].count_ftb = 0;
-	kpi_omx_monitor[omx_cnt].count_fbd = 0;
-	kpi_omx_monitor[omx_cnt].count_etb = 0;
-	kpi_omx_monitor[omx_cnt].count_ebd = 0;
+	comp->hComponent = hComponent;
 
 	/* register the component name */
 	((OMX_COMPONENTTYPE*) hComponent)->GetComponentVersion(hComponent, compName, &nVersionComp, &nVersionSpec, &compUUID);
@@ -203,16 +334,276 @@ void KPI_OmxCompInit(OMX_HANDLETYPE hComponent)
 	/* get the end of the string compName... */
 	p = compName + strlen( compName ) - 1;
 	while( (*p != '.' ) && (p != compName) ) p--;
-	strncpy(kpi_omx_monitor[omx_cnt].name, p + 1, 6);
-	*(kpi_omx_monitor[omx_cnt].name + 6) = '\0';                  // complete the chain of char
-	sprintf(kpi_omx_monitor[omx_cnt].name, "%s%u", kpi_omx_monitor[omx_cnt].name, (unsigned int)omx_cnt); // Add index to the name
+	strncpy(suffix, p + 1, 6);
+	suffix[6] = '\0';                  // complete the chain of char
+
+	pthread_mutex_lock(&kpi_lock);
+	comp->id = kpi_omx_monitor_id++;
+	snprintf(comp->name, sizeof(comp->name), "%s%u", suffix, (unsigned int)comp->id); // Add index to the name
+	comp->next = kpi_omx_monitor;
+	kpi_omx_monitor = comp;
+	kpi_omx_monitor_cnt++;
+	pCompPrv->pKpi = comp;
+	pthread_mutex_unlock(&kpi_lock);
 
 	/* trace component init */
-	DOMX_PROF("<KPI> OMX %-6s Init %-8lld", kpi_omx_monitor[omx_cnt].name, KPI_GetTime());
+	DOMX_PROF("<KPI> OMX %-6s Init %-8lld", comp->name, KPI_GetTime());
 
 	return;
 }
 
+/* ===========================================================================*/
+/**
+ * @name KPI_OmxCompRpcPackets()
+ * @brief Trace RPC packet pool usage of a component
+ * @param void
+ * @return void
+ * @sa TBD
+ *
+ */
+/* ===========================================================================*/
+void KPI_OmxCompRpcPackets(OMX_HANDLETYPE hComponent, const char* name)
+{
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+	RPC_OMX_PACKET_STATS tStats;
+
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
+	if( pCompPrv == NULL || pCompPrv->hRemoteComp == NULL) return;
+
+	RPC_PacketGetStats(pCompPrv->hRemoteComp, &tStats);
+
+	/* exhausted pool means packets came from the heap: raise RPC_PACKET_POOL_SIZE */
+	DOMX_PROF("<KPI> OMX %-6s RpcPackets pool %u inuse %u high %u exhausted %u", name,
+		(unsigned int)tStats.nPoolSize, (unsigned int)tStats.nInUse,
+		(unsigned int)tStats.nHighWater, (unsigned int)tStats.nExhausted);
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_OmxCompParamCache()
+ * @brief Trace parameter/config cache efficiency of a component
+ * @param void
+ * @return void
+ * @sa TBD
+ *
+ */
+/* ===========================================================================*/
+void KPI_OmxCompParamCache(OMX_HANDLETYPE hComponent, const char* name)
+{
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+	PROXY_PARAM_CACHE *pCache;
+
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
+	if( pCompPrv == NULL ) return;
+
+	pCache = &pCompPrv->tParamCache;
+	if( !pCache->bEnabled ) return;
+
+	/* misses only count cacheable indexes, invalidations include state changes */
+	DOMX_PROF("<KPI> OMX %-6s ParamCache hits %u misses %u invalidations %u", name,
+		(unsigned int)pCache->nHits, (unsigned int)pCache->nMisses,
+		(unsigned int)pCache->nInvalidations);
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_Print()
+ * @brief Write one line of a dump to the dump file, or to the trace
+ * @param out : dump file, NULL for the trace
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_Print(FILE *out, const char *fmt, ...)
+{
+	char line[256];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+
+	if (out)
+		fprintf(out, "%s\n", line);
+	else
+		DOMX_PROF("%s", line);
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_DumpComponent()
+ * @brief Dump in-flight gauges and latency histograms of a component
+ * @param out : dump file, NULL for the trace
+ * @param comp : component
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_DumpComponent(FILE *out, kpi_omx_component *comp)
+{
+	char line[200];
+	OMX_U32 h, b, len, n, count, seen;
+	OMX_U32 p50, p90, p99;
+
+	KPI_Print(out, "<KPI> OMX %-6s ETB %u EBD %u FTB %u FBD %u refused %u"
+		" in flight ETB %d (high %d) FTB %d (high %d)", comp->name,
+		(unsigned int)__atomic_load_n(&comp->count_etb, __ATOMIC_RELAXED),
+		(unsigned int)__atomic_load_n(&comp->count_ebd, __ATOMIC_RELAXED),
+		(unsigned int)__atomic_load_n(&comp->count_ftb, __ATOMIC_RELAXED),
+		(unsigned int)__atomic_load_n(&comp->count_fbd, __ATOMIC_RELAXED),
+		(unsigned int)__atomic_load_n(&comp->count_refused, __ATOMIC_RELAXED),
+		(int)__atomic_load_n(&comp->in_flight[0], __ATOMIC_RELAXED),
+		(int)__atomic_load_n(&comp->in_flight_high[0], __ATOMIC_RELAXED),
+		(int)__atomic_load_n(&comp->in_flight[1], __ATOMIC_RELAXED),
+		(int)__atomic_load_n(&comp->in_flight_high[1], __ATOMIC_RELAXED));
+
+	for (h = 0; h < KPI_HIST_MAX; h++) {
+		kpi_histogram *hist = &comp->hist[h];
+
+		count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+		if (count == 0) continue;
+
+		/* percentiles are given as the upper bound of their bucket */
+		p50 = p90 = p99 = 0;
+		line[0] = '\0';
+		len = 0;
+		seen = 0;
+		for (b = 0; b < KPI_HIST_BUCKETS; b++) {
+			n = __atomic_load_n(&hist->buckets[b], __ATOMIC_RELAXED);
+			if (n == 0) continue;
+			seen += n;
+			if (p50 == 0 && (OMX_U64) seen * 2 >= count) p50 = 1u << b;
+			if (p90 == 0 && (OMX_U64) seen * 10 >= (OMX_U64) count * 9) p90 = 1u << b;
+			if (p99 == 0 && (OMX_U64) seen * 100 >= (OMX_U64) count * 99) p99 = 1u << b;
+			if (len < sizeof(line))
+				len += snprintf(line + len, sizeof(line) - len, " <%u:%u",
+					1u << b, (unsigned int)n);
+		}
+		line[sizeof(line) - 1] = '\0';
+
+		KPI_Print(out, "<KPI> OMX %-6s %-8s n %u avg %llu us max %u us p50 <%u p90 <%u p99 <%u",
+			comp->name, kpi_hist_names[h], (unsigned int)count,
+			(unsigned long long)(__atomic_load_n(&hist->sum, __ATOMIC_RELAXED) / count),
+			(unsigned int)__atomic_load_n(&hist->max, __ATOMIC_RELAXED),
+			(unsigned int)p50, (unsigned int)p90, (unsigned int)p99);
+		KPI_Print(out, "<KPI> OMX %-6s %-8s us%s", comp->name, kpi_hist_names[h], line);
+	}
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_DumpRings()
+ * @brief Dump the event records of every thread, oldest first. Records the
+ *        owner overwrote while they were copied are left out.
+ * @param out : dump file, NULL for the trace
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_DumpRings(FILE *out)
+{
+	static kpi_event_record copy[KPI_RING_SIZE];	/* under kpi_lock */
+	kpi_event_ring *ring;
+	kpi_omx_component *comp;
+	OMX_U32 first, last, count, skip, i;
+
+	for (ring = __atomic_load_n(&kpi_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		first = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		count = first < KPI_RING_SIZE ? first : KPI_RING_SIZE;
+		for (i = 0; i < count; i++)
+			copy[i] = ring->records[(first - count + i) & (KPI_RING_SIZE - 1)];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		last = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+		/* record n shares its slot with n + KPI_RING_SIZE */
+		skip = last - first + count >= KPI_RING_SIZE ?
+			last - first + count - KPI_RING_SIZE + 1 : 0;
+		if (skip > count) skip = count;
+
+		KPI_Print(out, "<KPI> events of thread %u, last %u of %u", (unsigned int)ring->tid,
+			(unsigned int)(count - skip), (unsigned int)last);
+		for (i = skip; i < count; i++) {
+			const char *name = "?";
+
+			for (comp = kpi_omx_monitor; comp; comp = comp->next) {
+				if (comp->id == copy[i].comp) {
+					name = comp->name;
+					break;
+				}
+			}
+			KPI_Print(out, "<KPI> %-8lld %-6s %-7s x%-8x", (long long)copy[i].time, name,
+				copy[i].event < sizeof(kpi_event_names) / sizeof(kpi_event_names[0]) ?
+				kpi_event_names[copy[i].event] : "?", (unsigned int)copy[i].buffer);
+		}
+	}
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_OmxDump()
+ * @brief Dump gauges, histograms and event records of every monitored
+ *        component, appended to the file named by DEBUG_DOMX_KPI_FILE or
+ *        debug.domx.kpi_file, else to the trace
+ * @param void
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+void KPI_OmxDump(void)
+{
+	char path[KPI_VALUE_MAX];
+	kpi_omx_component *comp;
+	FILE *out = NULL;
+
+	KPI_GetSetting("DEBUG_DOMX_KPI_FILE", "debug.domx.kpi_file", path);
+	if (path[0] != '\0') {
+		out = fopen(path, "a");
+		if (out == NULL)
+			DOMX_ERROR("Cannot open KPI dump file %s", path);
+	}
+
+	pthread_mutex_lock(&kpi_lock);
+	KPI_Print(out, "<KPI> Dump %-8lld, %u components", (long long)KPI_GetTime(),
+		(unsigned int)kpi_omx_monitor_cnt);
+	for (comp = kpi_omx_monitor; comp; comp = comp->next)
+		KPI_DumpComponent(out, comp);
+	if (kpi_status & KPI_EVENT_LOG)
+		KPI_DumpRings(out);
+	pthread_mutex_unlock(&kpi_lock);
+
+	if (out)
+		fclose(out);
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_CheckDumpTrigger()
+ * @brief Dump when DEBUG_DOMX_KPI_DUMP or debug.domx.kpi_dump got a new
+ *        value, e.g. setprop debug.domx.kpi_dump 1, then 2 for the next one
+ * @param void
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_CheckDumpTrigger(void)
+{
+	char value[KPI_VALUE_MAX];
+	OMX_BOOL dump = OMX_FALSE;
+
+	KPI_GetSetting("DEBUG_DOMX_KPI_DUMP", "debug.domx.kpi_dump", value);
+	if (value[0] == '\0') return;
+
+	pthread_mutex_lock(&kpi_lock);
+	if (strcmp(value, kpi_dump_trigger) != 0) {
+		strcpy(kpi_dump_trigger, value);
+		dump = OMX_TRUE;
+	}
+	pthread_mutex_unlock(&kpi_lock);
+
+	if (dump)
+		KPI_OmxDump();
+}
+
 /* ===========================================================================*/
 /**
  * @name KPI_OmxCompDeinit()
@@ -225,29 +616,250 @@ void KPI_OmxCompInit(OMX_HANDLETYPE hComponent)
 /* ===========================================================================*/
 void KPI_OmxCompDeinit( OMX_HANDLETYPE hComponent)
 {
-	OMX_U32 omx_cnt;
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+	kpi_omx_component *comp, **link;
 
-	if ( !(kpi_status & KPI_BUFFER_EVENTS) )
-		return;
+	comp = KPI_Component(hComponent);
 
-	if( kpi_omx_monitor_cnt == 0) return;
+	/* component was not registered at init */
+	if( comp == NULL ) return;
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
 
-	/* identify the component from the registry */
-	for( omx_cnt = 0; omx_cnt < MAX_OMX_COMP;  omx_cnt++ ) {
-		if( kpi_omx_monitor[omx_cnt].hComponent == hComponent ) break;
-	}
+	/* trace packet pool usage over the component lifetime */
+	if ( kpi_status & KPI_RPC_PACKETS )
+		KPI_OmxCompRpcPackets(hComponent, comp->name);
+
+	/* trace parameter cache hits over the component lifetime */
+	if ( kpi_status & KPI_PARAM_CACHE )
+		KPI_OmxCompParamCache(hComponent, comp->name);
+
+	/* trace latencies over the component lifetime */
+	if ( kpi_status & KPI_BUFFER_LATENCY )
+		KPI_DumpComponent(NULL, comp);
 
 	/* trace component init */
-	DOMX_PROF( "<KPI> OMX %-6s Deinit %-8lld", kpi_omx_monitor[omx_cnt].name, KPI_GetTime());
+	DOMX_PROF( "<KPI> OMX %-6s Deinit %-8lld", comp->name, KPI_GetTime());
 
 	/* unregister the component */
-	kpi_omx_monitor[omx_cnt].hComponent = 0;
-
+	pthread_mutex_lock(&kpi_lock);
+	for (link = &kpi_omx_monitor; *link; link = &(*link)->next) {
+		if (*link == comp) {
+			*link = comp->next;
+			break;
+		}
+	}
 	kpi_omx_monitor_cnt--;
+	pCompPrv->pKpi = NULL;
+	pthread_mutex_unlock(&kpi_lock);
+
+	TIMM_OSAL_Free(comp);
 
 	return;
 }
 
+/* ===========================================================================*/
+/**
+ * @name KPI_HistAdd()
+ * @brief Account one latency in a histogram
+ * @param hist : histogram
+ * @param us : latency in us
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_HistAdd(kpi_histogram *hist, OMX_U64 us)
+{
+	OMX_U32 value = us > 0xFFFFFFFFull ? 0xFFFFFFFF : (OMX_U32) us;
+	OMX_U32 bucket = value ? 32 - __builtin_clz(value) : 0;
+	OMX_U32 max;
+
+	if (bucket >= KPI_HIST_BUCKETS) bucket = KPI_HIST_BUCKETS - 1;
+
+	__atomic_add_fetch(&hist->buckets[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->sum, us, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	while (value > max && !__atomic_compare_exchange_n(&hist->max, &max, value,
+		OMX_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_InFlight()
+ * @brief Move the in-flight depth of ETBs or FTBs of a component
+ * @param comp : component
+ * @param event : KPI_BUFFER_ETB or KPI_BUFFER_FTB
+ * @param delta : +1 when sent, -1 when back
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_InFlight(kpi_omx_component *comp, OMX_U32 event, OMX_S32 delta)
+{
+	OMX_U32 dir = event == KPI_BUFFER_ETB ? 0 : 1;
+	OMX_S32 depth, high;
+
+	depth = __atomic_add_fetch(&comp->in_flight[dir], delta, __ATOMIC_RELAXED);
+
+	high = __atomic_load_n(&comp->in_flight_high[dir], __ATOMIC_RELAXED);
+	while (depth > high && !__atomic_compare_exchange_n(&comp->in_flight_high[dir], &high,
+		depth, OMX_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_BufferTiming()
+ * @brief Timestamp a step of a buffer and account the latencies it closes
+ * @param comp : component
+ * @param event : the step
+ * @param slot : index of the buffer in the proxy buffer list
+ * @param now : time of the event in us
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_BufferTiming(kpi_omx_component *comp, enum KPI_BUFFER_EVENT event,
+	OMX_U32 slot, OMX_U64 now)
+{
+	kpi_omx_buffer *buf;
+	OMX_U32 pending;
+
+	if (slot >= MAX_NUM_PROXY_BUFFERS) return;
+	buf = &comp->buffers[slot];
+
+	switch(event) {
+		case KPI_BUFFER_ETB:
+		case KPI_BUFFER_FTB:
+			buf->entry = now;
+			buf->write = 0;
+			buf->ack = 0;
+			__atomic_store_n(&buf->pending, event, __ATOMIC_RELEASE);
+			KPI_InFlight(comp, event, 1);
+		break;
+		case KPI_BUFFER_RPC_WRITE:
+			buf->write = now;
+			if (buf->entry && now >= buf->entry)
+				KPI_HistAdd(&comp->hist[KPI_HIST_PROXY], now - buf->entry);
+		break;
+		/* an async reply can come after the buffer was sent again */
+		case KPI_BUFFER_RPC_ACK:
+			buf->ack = now;
+			if (buf->write && now >= buf->write)
+				KPI_HistAdd(&comp->hist[KPI_HIST_RPC], now - buf->write);
+		break;
+		/* a refused buffer never comes back */
+		case KPI_BUFFER_REFUSED:
+			pending = __atomic_exchange_n(&buf->pending, 0, __ATOMIC_ACQ_REL);
+			if (pending)
+				KPI_InFlight(comp, pending, -1);
+		break;
+		case KPI_BUFFER_EBD:
+		case KPI_BUFFER_FBD:
+			/* 0 for buffers sent before the component was monitored */
+			pending = __atomic_exchange_n(&buf->pending, 0, __ATOMIC_ACQ_REL);
+			if (pending == 0) break;
+			KPI_HistAdd(&comp->hist[pending == KPI_BUFFER_ETB ? KPI_HIST_ETB_EBD :
+				KPI_HIST_FTB_FBD], now - buf->entry);
+			KPI_InFlight(comp, pending, -1);
+		break;
+	}
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_ReleaseRing()
+ * @brief Hand the event ring of an exiting thread over to later threads
+ * @param data : the ring
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_ReleaseRing(void *data)
+{
+	kpi_event_ring *ring = data;
+
+	__atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void KPI_CreateRingKey(void)
+{
+	pthread_key_create(&kpi_ring_key, KPI_ReleaseRing);
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_ThreadRing()
+ * @brief Event ring of the calling thread, taken over from an exited thread
+ *        or allocated on first use
+ * @param void
+ * @return kpi_event_ring* = NULL if out of memory
+ *
+ */
+/* ===========================================================================*/
+static kpi_event_ring *KPI_ThreadRing(void)
+{
+	kpi_event_ring *ring;
+	OMX_U32 owned;
+
+	pthread_once(&kpi_ring_once, KPI_CreateRingKey);
+	ring = pthread_getspecific(kpi_ring_key);
+	if (ring) return ring;
+
+	for (ring = __atomic_load_n(&kpi_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		owned = 0;
+		if (__atomic_compare_exchange_n(&ring->owned, &owned, 1, OMX_FALSE,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (ring == NULL) {
+		ring = TIMM_OSAL_Malloc(sizeof(kpi_event_ring), TIMM_OSAL_TRUE, 0,
+		    TIMMOSAL_MEM_SEGMENT_INT);
+		if (ring == NULL) return NULL;
+		TIMM_OSAL_Memset(ring, 0, sizeof(kpi_event_ring));
+		ring->owned = 1;
+		ring->next = __atomic_load_n(&kpi_rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&kpi_rings, &ring->next, ring, OMX_TRUE,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	ring->tid = gettid();
+	pthread_setspecific(kpi_ring_key, ring);
+	return ring;
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_LogEvent()
+ * @brief Append an event record to the ring of the calling thread
+ * @param comp : component
+ * @param event : the event
+ * @param buffer : remote buffer header
+ * @param now : time of the event in us
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+static void KPI_LogEvent(kpi_omx_component *comp, enum KPI_BUFFER_EVENT event,
+	OMX_U32 buffer, OMX_U64 now)
+{
+	kpi_event_ring *ring = KPI_ThreadRing();
+	kpi_event_record *record;
+	OMX_U32 head;
+
+	if (ring == NULL) return;
+
+	/* only this thread moves head */
+	head = ring->head;
+	record = &ring->records[head & (KPI_RING_SIZE - 1)];
+	record->time = now;
+	record->comp = comp->id;
+	record->buffer = buffer;
+	record->event = event;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
 /* ===========================================================================*/
 /**
  * @name KPI_OmxCompBufferEvent()
@@ -260,42 +872,110 @@ void KPI_OmxCompDeinit( OMX_HANDLETYPE hComponent)
 /* ===========================================================================*/
 void KPI_OmxCompBufferEvent(enum KPI_BUFFER_EVENT event, OMX_HANDLETYPE hComponent, PROXY_BUFFER_INFO* pBuffer)
 {
-        OMX_U32 omx_cnt;
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+	kpi_omx_component *comp;
+	OMX_U64 now;
+	OMX_U32 count;
 
-	if ( !(kpi_status & KPI_BUFFER_EVENTS) )
+	if ( !(kpi_status & KPI_BUFFER_STATUS) )
 		return;
 
-        if (kpi_omx_monitor_cnt == 0) return;
-
-        /* identify the component from the registry */
-        for (omx_cnt = 0; omx_cnt < MAX_OMX_COMP;  omx_cnt++) {
-                if( kpi_omx_monitor[omx_cnt].hComponent == hComponent ) break;
-        }
+	comp = KPI_Component(hComponent);
+	if (comp == NULL) return;
+
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
+	now = KPI_GetTime();
+
+	/* Update counts and trace the event */
+	switch(event) {
+		case KPI_BUFFER_ETB:
+			count = __atomic_add_fetch(&comp->count_etb, 1, __ATOMIC_RELAXED);
+		break;
+		case KPI_BUFFER_FTB:
+			count = __atomic_add_fetch(&comp->count_ftb, 1, __ATOMIC_RELAXED);
+		break;
+		case KPI_BUFFER_EBD:
+			count = __atomic_add_fetch(&comp->count_ebd, 1, __ATOMIC_RELAXED);
+		break;
+		case KPI_BUFFER_FBD:
+			count = __atomic_add_fetch(&comp->count_fbd, 1, __ATOMIC_RELAXED);
+		break;
+		case KPI_BUFFER_REFUSED:
+			count = __atomic_add_fetch(&comp->count_refused, 1, __ATOMIC_RELAXED);
+		break;
+		default:
+			count = 0;
+		break;
+	}
 
-        /* Update counts and trace the event */
-        if( omx_cnt < MAX_OMX_COMP ) {
-                /* trace the event, we trace remote address to correlate to Ducati trace */
+	if (kpi_status & KPI_BUFFER_EVENTS) {
+		/* trace the event, we trace remote address to correlate to Ducati trace */
 		switch(event) {
 			case KPI_BUFFER_ETB:
-				DOMX_PROF("ETB %-6s %-4u %-8lld x%-8x", kpi_omx_monitor[omx_cnt].name, \
-					(unsigned int)++kpi_omx_monitor[omx_cnt].count_etb, KPI_GetTime(), (unsigned int)pBuffer->pBufHeaderRemote);
+				DOMX_PROF("ETB %-6s %-4u %-8lld x%-8x", comp->name, \
+					(unsigned int)count, (long long)now, (unsigned int)pBuffer->pBufHeaderRemote);
 			break;
 			case KPI_BUFFER_FTB:
-				DOMX_PROF("FTB %-6s %-4u %-8lld x%-8x", kpi_omx_monitor[omx_cnt].name, \
-					(unsigned int)++kpi_omx_monitor[omx_cnt].count_ftb, KPI_GetTime(), (unsigned int)pBuffer->pBufHeaderRemote);
+				DOMX_PROF("FTB %-6s %-4u %-8lld x%-8x", comp->name, \
+					(unsigned int)count, (long long)now, (unsigned int)pBuffer->pBufHeaderRemote);
 			break;
 			case KPI_BUFFER_EBD:
-				DOMX_PROF("EBD %-6s %-4u %-8lld x%-8x", kpi_omx_monitor[omx_cnt].name, \
-					(unsigned int)++kpi_omx_monitor[omx_cnt].count_ebd, KPI_GetTime(), (unsigned int)pBuffer->pBufHeaderRemote);
+				DOMX_PROF("EBD %-6s %-4u %-8lld x%-8x", comp->name, \
+					(unsigned int)count, (long long)now, (unsigned int)pBuffer->pBufHeaderRemote);
 			break;
 			/* we add timestamp metadata because this is a unique identifier of buffer among all SW layers */
 			case KPI_BUFFER_FBD:
-		                DOMX_PROF("FBD %-6s %-4u %-8lld x%-8x %lld", kpi_omx_monitor[omx_cnt].name, \
-					(unsigned int)++kpi_omx_monitor[omx_cnt].count_fbd, KPI_GetTime(), (unsigned int)pBuffer->pBufHeaderRemote, pBuffer->pBufHeader->nTimeStamp);
+		                DOMX_PROF("FBD %-6s %-4u %-8lld x%-8x %lld", comp->name, \
+					(unsigned int)count, (long long)now, (unsigned int)pBuffer->pBufHeaderRemote, (long long)pBuffer->pBufHeader->nTimeStamp);
+			break;
+			default:
 			break;
-
 		}
-        }
+	}
+
+	if (kpi_status & KPI_BUFFER_LATENCY)
+		KPI_BufferTiming(comp, event, pBuffer - pCompPrv->tBufList, now);
+
+	if (kpi_status & KPI_EVENT_LOG)
+		KPI_LogEvent(comp, event, pBuffer->pBufHeaderRemote, now);
+
+	/* look at the dump trigger now and then, from the callback thread */
+	if ((event == KPI_BUFFER_EBD || event == KPI_BUFFER_FBD) &&
+	    (count % KPI_DUMP_POLL) == 0)
+		KPI_CheckDumpTrigger();
+
+	return;
+}
+
+/* ===========================================================================*/
+/**
+ * @name KPI_OmxCompRpcEvent()
+ * @brief Trace the RPC steps of an ETB/FTB
+ * @param event : KPI_BUFFER_RPC_WRITE or KPI_BUFFER_RPC_ACK
+ * @param hComponent : proxy component handle, NULL before it is known
+ * @param nBufHdrRemote : remote buffer header of the call
+ * @return void
+ *
+ */
+/* ===========================================================================*/
+void KPI_OmxCompRpcEvent(enum KPI_BUFFER_EVENT event, OMX_HANDLETYPE hComponent, OMX_U32 nBufHdrRemote)
+{
+	PROXY_COMPONENT_PRIVATE *pCompPrv;
+	kpi_omx_component *comp;
+	OMX_U64 now;
+
+	if ( !(kpi_status & (KPI_BUFFER_LATENCY | KPI_EVENT_LOG)) )
+		return;
+
+	comp = KPI_Component(hComponent);
+	if (comp == NULL) return;
+
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) ((OMX_COMPONENTTYPE *) hComponent)->pComponentPrivate;
+	now = KPI_GetTime();
+
+	if (kpi_status & KPI_BUFFER_LATENCY)
+		KPI_BufferTiming(comp, event, PROXY_BufListFindRemote(pCompPrv, nBufHdrRemote), now);
 
-        return;
+	if (kpi_status & KPI_EVENT_LOG)
+		KPI_LogEvent(comp, event, nBufHdrRemote, now);
 }
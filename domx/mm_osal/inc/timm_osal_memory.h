@@ -69,6 +69,15 @@ extern "C"
 		TIMMOSAL_MEM_SEGMENT_UNCACHED
 	} TIMMOSAL_MEM_SEGMENTID;
 
+/* Usage of a memory segment, see TIMM_OSAL_GetMemStats */
+	typedef struct TIMM_OSAL_MEM_STATS
+	{
+		TIMM_OSAL_U32 nBlocks;		/* blocks allocated now */
+		TIMM_OSAL_U32 nBytes;		/* bytes requested by them */
+		TIMM_OSAL_U32 nPeakBytes;	/* high-water mark of nBytes */
+		TIMM_OSAL_U32 nAllocs;		/* allocations so far */
+	} TIMM_OSAL_MEM_STATS;
+
 
 /*******************************************************************************
 * External interface
@@ -95,6 +104,9 @@ extern "C"
 
 	TIMM_OSAL_U32 TIMM_OSAL_GetMemCounter(void);
 
+	TIMM_OSAL_ERRORTYPE TIMM_OSAL_GetMemStats(TIMMOSAL_MEM_SEGMENTID
+	    tMemSegId, TIMM_OSAL_MEM_STATS * pStats);
+
 #define TIMM_OSAL_MallocExtn(size, bBlockContiguous, unBlockAlignment, tMemSegId, hHeap) \
     TIMM_OSAL_Malloc(size, bBlockContiguous, unBlockAlignment, tMemSegId )
 
@@ -35,6 +35,14 @@
 *   This file contains methods that provides the functionality
 *   for allocating/deallocating memory.
 *
+*   Blocks of up to TIMM_OSAL_MEM_MAX_POOLED bytes come from size class
+*   pools: every thread keeps a small free list per class and exchanges
+*   batches with a global depot, so the common malloc/free pair of the
+*   proxy takes no lock. Larger or more strictly aligned blocks come from
+*   malloc. Every block carries a header with its class and segment, which
+*   is what lets TIMM_OSAL_Free find its way back and the per segment
+*   accounting report leaks and high-water marks.
+*
 *  @path \
 *
 */
@@ -43,6 +51,7 @@
  *!
  *! Revision History
  *! ===================================
+ *! Size class pools and per segment accounting
  *!23-Oct-2008 Maiya ShreeHarsha: Linux specific changes
  *!0.1: Created the first draft version, ksrini@ti.com
  * ========================================================================= */
@@ -52,7 +61,9 @@
 ******************************************************************************/
 
 #include <string.h>
+#include <stdlib.h>
 #include <malloc.h>
+#include <pthread.h>
 
 #ifdef __KERNEL__
 #include <linux/types.h>
@@ -66,24 +77,445 @@
 #include "timm_osal_error.h"
 #include "timm_osal_memory.h"
 
+#ifdef _Android
+#include <cutils/properties.h>
+#endif
+
+
+
+/*Smallest class is 16 bytes, each following one doubles up to 4 KB */
+#define TIMM_OSAL_MEM_MIN_SHIFT 4
+#define TIMM_OSAL_MEM_CLASSES 9
+#define TIMM_OSAL_MEM_MAX_POOLED (1U << (TIMM_OSAL_MEM_MIN_SHIFT + TIMM_OSAL_MEM_CLASSES - 1))
+/*Pooled payloads are aligned to the header size */
+#define TIMM_OSAL_MEM_ALIGN 16
+#define TIMM_OSAL_MEM_LARGE 0xFF
+#define TIMM_OSAL_MEM_SLAB_SIZE (64 * 1024)
+/*Blocks a thread keeps per class, half of them move to the depot at once */
+#define TIMM_OSAL_MEM_CACHE_MAX 32
+#define TIMM_OSAL_MEM_SEGMENTS (TIMMOSAL_MEM_SEGMENT_UNCACHED + 1)
+/*Allocations and frees a thread counts before adding them to the totals */
+#define TIMM_OSAL_MEM_FOLD_OPS 32
+
+#define TIMM_OSAL_MEM_MAGIC 0x4D41
+#define TIMM_OSAL_MEM_FREED 0x4652
+
+/**
+* TIMM_OSAL_MEM_HEADER precedes every block. Its size keeps pooled payloads
+* aligned to TIMM_OSAL_MEM_ALIGN.
+*/
+typedef struct TIMM_OSAL_MEM_HEADER
+{
+	TIMM_OSAL_U32 nSize;	/*requested size */
+	TIMM_OSAL_U32 nOffset;	/*payload - malloc result, large blocks only */
+	TIMM_OSAL_U16 nMagic;
+	TIMM_OSAL_U8 nClass;
+	TIMM_OSAL_U8 nSegment;
+	TIMM_OSAL_U32 nReserved;
+} TIMM_OSAL_MEM_HEADER;
+
+/*A free pooled block links through its payload */
+typedef struct TIMM_OSAL_MEM_FREE
+{
+	struct TIMM_OSAL_MEM_FREE *pNext;
+} TIMM_OSAL_MEM_FREE;
+
+typedef struct TIMM_OSAL_MEM_LIST
+{
+	TIMM_OSAL_MEM_FREE *pFree;
+	TIMM_OSAL_U32 nCount;
+} TIMM_OSAL_MEM_LIST;
+
+/*Accounting a thread has not added to the totals yet */
+typedef struct TIMM_OSAL_MEM_DELTA
+{
+	TIMM_OSAL_S32 nBlocks;
+	TIMM_OSAL_S32 nBytes;
+	TIMM_OSAL_U32 nAllocs;
+} TIMM_OSAL_MEM_DELTA;
 
+/*Per thread free lists and accounting, reached through a pthread key */
+typedef struct TIMM_OSAL_MEM_CACHE
+{
+	TIMM_OSAL_MEM_LIST tList[TIMM_OSAL_MEM_CLASSES];
+	TIMM_OSAL_MEM_DELTA tDelta[TIMM_OSAL_MEM_SEGMENTS];
+	TIMM_OSAL_U32 nOps;
+} TIMM_OSAL_MEM_CACHE;
 
-static TIMM_OSAL_U32 gMallocCounter = 0;
+/*Global free lists shared by all threads */
+typedef struct TIMM_OSAL_MEM_DEPOT
+{
+	pthread_mutex_t tLock;
+	TIMM_OSAL_MEM_LIST tList;
+} TIMM_OSAL_MEM_DEPOT;
+
+static pthread_once_t gMemOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gMemCacheKey;
+static TIMM_OSAL_BOOL bMemPooled = TIMM_OSAL_FALSE;
+static TIMM_OSAL_MEM_DEPOT gMemDepot[TIMM_OSAL_MEM_CLASSES];
+/*Bytes of slabs carved for the pools, never given back */
+static TIMM_OSAL_U32 gMemSlabBytes = 0;
+static TIMM_OSAL_MEM_STATS gMemStats[TIMM_OSAL_MEM_SEGMENTS];
+
+static const char *const gMemSegmentName[TIMM_OSAL_MEM_SEGMENTS] = {
+	"EXT", "INT", "UNCACHED"
+};
 
 /******************************************************************************
 * Function Prototypes
 ******************************************************************************/
 
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemFold function
+*
+* Adds the accounting of a thread to the totals of the segments and
+* updates their high-water marks
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_MemFold(TIMM_OSAL_MEM_DELTA * pDelta)
+{
+	TIMM_OSAL_MEM_STATS *pStats;
+	TIMM_OSAL_U32 s, nBytes, nPeak;
+
+	for (s = 0; s < TIMM_OSAL_MEM_SEGMENTS; s++, pDelta++)
+	{
+		if (pDelta->nBlocks == 0 && pDelta->nBytes == 0 &&
+		    pDelta->nAllocs == 0)
+		{
+			continue;
+		}
+		pStats = &gMemStats[s];
+		__atomic_add_fetch(&pStats->nAllocs, pDelta->nAllocs,
+		    __ATOMIC_RELAXED);
+		__atomic_add_fetch(&pStats->nBlocks, pDelta->nBlocks,
+		    __ATOMIC_RELAXED);
+		nBytes =
+		    __atomic_add_fetch(&pStats->nBytes, pDelta->nBytes,
+		    __ATOMIC_RELAXED);
+		nPeak = __atomic_load_n(&pStats->nPeakBytes, __ATOMIC_RELAXED);
+		while (nBytes > nPeak &&
+		    !__atomic_compare_exchange_n(&pStats->nPeakBytes, &nPeak,
+			nBytes, TIMM_OSAL_TRUE, __ATOMIC_RELAXED,
+			__ATOMIC_RELAXED));
+		pDelta->nBlocks = 0;
+		pDelta->nBytes = 0;
+		pDelta->nAllocs = 0;
+	}
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemAccount function
+*
+* Adds a block of nSize bytes to a segment, or removes it for a negative
+* nBlocks. Threads with a cache batch this up, so totals and high-water
+* marks lag by at most TIMM_OSAL_MEM_FOLD_OPS blocks per thread.
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_MemAccount(TIMM_OSAL_MEM_CACHE * pCache,
+    TIMM_OSAL_U32 nSegment, TIMM_OSAL_S32 nBlocks, TIMM_OSAL_U32 nSize)
+{
+	TIMM_OSAL_MEM_DELTA tDelta[TIMM_OSAL_MEM_SEGMENTS];
+	TIMM_OSAL_MEM_DELTA *pDelta;
+
+	if (pCache == NULL)
+	{
+		TIMM_OSAL_Memset(tDelta, 0, sizeof(tDelta));
+		pDelta = tDelta;
+	} else
+	{
+		pDelta = pCache->tDelta;
+	}
+
+	pDelta[nSegment].nBlocks += nBlocks;
+	pDelta[nSegment].nBytes += nBlocks < 0 ? -(TIMM_OSAL_S32) nSize :
+	    (TIMM_OSAL_S32) nSize;
+	if (nBlocks > 0)
+	{
+		pDelta[nSegment].nAllocs++;
+	}
+
+	if (pCache == NULL || ++pCache->nOps >= TIMM_OSAL_MEM_FOLD_OPS)
+	{
+		TIMM_OSAL_MemFold(pDelta);
+		if (pCache != NULL)
+		{
+			pCache->nOps = 0;
+		}
+	}
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemCache function
+*
+* Free lists of the calling thread, created on first use if bCreate is set
+*
+*/
+/* ========================================================================== */
+static TIMM_OSAL_MEM_CACHE *TIMM_OSAL_MemCache(TIMM_OSAL_BOOL bCreate)
+{
+	TIMM_OSAL_MEM_CACHE *pCache;
+
+	if (!bMemPooled)
+	{
+		return NULL;
+	}
+
+	pCache = (TIMM_OSAL_MEM_CACHE *) pthread_getspecific(gMemCacheKey);
+	if (pCache == NULL && bCreate)
+	{
+		pCache =
+		    (TIMM_OSAL_MEM_CACHE *) calloc(1,
+		    sizeof(TIMM_OSAL_MEM_CACHE));
+		if (pCache != NULL &&
+		    SUCCESS != pthread_setspecific(gMemCacheKey, pCache))
+		{
+			free(pCache);
+			pCache = NULL;
+		}
+	}
+	return pCache;
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemCacheRelease function
+*
+* pthread key destructor, hands the free lists of an exiting thread to the
+* depot
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_MemCacheRelease(void *pArg)
+{
+	TIMM_OSAL_MEM_CACHE *pCache = (TIMM_OSAL_MEM_CACHE *) pArg;
+	TIMM_OSAL_MEM_FREE *pLast;
+	TIMM_OSAL_U32 c;
+
+	for (c = 0; c < TIMM_OSAL_MEM_CLASSES; c++)
+	{
+		if (pCache->tList[c].nCount == 0)
+		{
+			continue;
+		}
+		for (pLast = pCache->tList[c].pFree; pLast->pNext != NULL;
+		    pLast = pLast->pNext);
+
+		pthread_mutex_lock(&gMemDepot[c].tLock);
+		pLast->pNext = gMemDepot[c].tList.pFree;
+		gMemDepot[c].tList.pFree = pCache->tList[c].pFree;
+		gMemDepot[c].tList.nCount += pCache->tList[c].nCount;
+		pthread_mutex_unlock(&gMemDepot[c].tLock);
+	}
+	TIMM_OSAL_MemFold(pCache->tDelta);
+	free(pCache);
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemInit function
+*
+* One time setup of the pools. TIMM_OSAL_MEM_POOL=0 in the environment or
+* debug.domx.mem_pool=0 sends every block to malloc, which keeps heap
+* tracking tools meaningful.
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_MemInit(void)
+{
+	char *val = getenv("TIMM_OSAL_MEM_POOL");
+	TIMM_OSAL_U32 c;
+
+#ifdef _Android
+	char value[PROPERTY_VALUE_MAX];
+
+	if (val == NULL)
+	{
+		property_get("debug.domx.mem_pool", value, "1");
+		val = value;
+	}
+#endif
+	for (c = 0; c < TIMM_OSAL_MEM_CLASSES; c++)
+	{
+		pthread_mutex_init(&gMemDepot[c].tLock, NULL);
+	}
+	bMemPooled = (val == NULL || atoi(val) != 0) &&
+	    SUCCESS == pthread_key_create(&gMemCacheKey,
+	    TIMM_OSAL_MemCacheRelease);
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemRefill function
+*
+* Fills an empty thread list of a class with half a cache worth of blocks
+* from the depot, carving a new slab when the depot is empty too
+*
+*/
+/* ========================================================================== */
+static TIMM_OSAL_BOOL TIMM_OSAL_MemRefill(TIMM_OSAL_MEM_LIST * pList,
+    TIMM_OSAL_U32 nClass)
+{
+	TIMM_OSAL_MEM_DEPOT *pDepot = &gMemDepot[nClass];
+	TIMM_OSAL_U32 nStride =
+	    sizeof(TIMM_OSAL_MEM_HEADER) +
+	    (1U << (TIMM_OSAL_MEM_MIN_SHIFT + nClass));
+	TIMM_OSAL_MEM_FREE *pBlock;
+	TIMM_OSAL_U8 *pSlab, *pCur;
+	TIMM_OSAL_U32 i;
+
+	pthread_mutex_lock(&pDepot->tLock);
+	for (i = 0; i < TIMM_OSAL_MEM_CACHE_MAX / 2 && pDepot->tList.nCount;
+	    i++)
+	{
+		pBlock = pDepot->tList.pFree;
+		pDepot->tList.pFree = pBlock->pNext;
+		pDepot->tList.nCount--;
+		pBlock->pNext = pList->pFree;
+		pList->pFree = pBlock;
+		pList->nCount++;
+	}
+	pthread_mutex_unlock(&pDepot->tLock);
+	if (pList->nCount)
+	{
+		return TIMM_OSAL_TRUE;
+	}
+
+	pSlab = (TIMM_OSAL_U8 *) malloc(TIMM_OSAL_MEM_SLAB_SIZE);
+	if (pSlab == NULL)
+	{
+		return TIMM_OSAL_FALSE;
+	}
+	__atomic_add_fetch(&gMemSlabBytes, TIMM_OSAL_MEM_SLAB_SIZE,
+	    __ATOMIC_RELAXED);
+
+	/*The whole slab goes to this thread, surplus flows to the depot on free */
+	pCur =
+	    (TIMM_OSAL_U8 *) (((uintptr_t) pSlab + TIMM_OSAL_MEM_ALIGN -
+		1) & ~(uintptr_t) (TIMM_OSAL_MEM_ALIGN - 1));
+	for (; pCur + nStride <= pSlab + TIMM_OSAL_MEM_SLAB_SIZE;
+	    pCur += nStride)
+	{
+		pBlock =
+		    (TIMM_OSAL_MEM_FREE *) (pCur +
+		    sizeof(TIMM_OSAL_MEM_HEADER));
+		pBlock->pNext = pList->pFree;
+		pList->pFree = pBlock;
+		pList->nCount++;
+	}
+	return TIMM_OSAL_TRUE;
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemDrain function
+*
+* Moves half of a full thread list of a class to the depot
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_MemDrain(TIMM_OSAL_MEM_LIST * pList,
+    TIMM_OSAL_U32 nClass)
+{
+	TIMM_OSAL_MEM_DEPOT *pDepot = &gMemDepot[nClass];
+	TIMM_OSAL_MEM_FREE *pFirst = pList->pFree, *pLast = pList->pFree;
+	TIMM_OSAL_U32 i, nMove = pList->nCount / 2;
+
+	for (i = 1; i < nMove; i++)
+	{
+		pLast = pLast->pNext;
+	}
+	pList->pFree = pLast->pNext;
+	pList->nCount -= nMove;
+
+	pthread_mutex_lock(&pDepot->tLock);
+	pLast->pNext = pDepot->tList.pFree;
+	pDepot->tList.pFree = pFirst;
+	pDepot->tList.nCount += nMove;
+	pthread_mutex_unlock(&pDepot->tLock);
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemPoolAlloc function
+*
+* Takes a block of a class from the calling thread's list
+*
+*/
+/* ========================================================================== */
+static TIMM_OSAL_MEM_HEADER *TIMM_OSAL_MemPoolAlloc(TIMM_OSAL_MEM_CACHE *
+    pCache, TIMM_OSAL_U32 nClass)
+{
+	TIMM_OSAL_MEM_LIST *pList;
+	TIMM_OSAL_MEM_FREE *pBlock;
+
+	pList = &pCache->tList[nClass];
+	if (pList->nCount == 0 && !TIMM_OSAL_MemRefill(pList, nClass))
+	{
+		return NULL;
+	}
+	pBlock = pList->pFree;
+	pList->pFree = pBlock->pNext;
+	pList->nCount--;
+
+	return (TIMM_OSAL_MEM_HEADER *) pBlock - 1;
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_MemPoolFree function
+*
+* Returns a block to the calling thread's list. Threads without a list,
+* such as exiting ones, hand it straight to the depot.
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_MemPoolFree(TIMM_OSAL_MEM_CACHE * pCache,
+    TIMM_OSAL_MEM_HEADER * pHeader)
+{
+	TIMM_OSAL_MEM_FREE *pBlock = (TIMM_OSAL_MEM_FREE *) (pHeader + 1);
+	TIMM_OSAL_U32 nClass = pHeader->nClass;
+	TIMM_OSAL_MEM_LIST *pList;
+
+	if (pCache == NULL)
+	{
+		pthread_mutex_lock(&gMemDepot[nClass].tLock);
+		pBlock->pNext = gMemDepot[nClass].tList.pFree;
+		gMemDepot[nClass].tList.pFree = pBlock;
+		gMemDepot[nClass].tList.nCount++;
+		pthread_mutex_unlock(&gMemDepot[nClass].tLock);
+		return;
+	}
+
+	pList = &pCache->tList[nClass];
+	pBlock->pNext = pList->pFree;
+	pList->pFree = pBlock;
+	if (++pList->nCount > TIMM_OSAL_MEM_CACHE_MAX)
+	{
+		TIMM_OSAL_MemDrain(pList, nClass);
+	}
+}
+
 /* ========================================================================== */
 /**
 * @fn TIMM_OSAL_createMemoryPool function
 *
+* The pools set themselves up on first use, this only makes sure it
+* happened
+*
 * @see
 */
 /* ========================================================================== */
 TIMM_OSAL_ERRORTYPE TIMM_OSAL_CreateMemoryPool(void)
 {
 	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_NONE;
+
+	pthread_once(&gMemOnce, TIMM_OSAL_MemInit);
+	TIMM_OSAL_Debug("Memory pools %s", bMemPooled ? "on" : "off");
 	return bReturnStatus;
 }
 
@@ -93,6 +525,10 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_CreateMemoryPool(void)
 /**
 * @fn TIMM_OSAL_DeleteMemoryPool function
 *
+* Reports the blocks still allocated and the high-water mark of every
+* segment. Pooled memory stays with the process, other threads may still
+* hold blocks of it.
+*
 * @see
 */
 /* ========================================================================== */
@@ -100,6 +536,28 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_CreateMemoryPool(void)
 TIMM_OSAL_ERRORTYPE TIMM_OSAL_DeleteMemoryPool(void)
 {
 	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_NONE;
+	TIMM_OSAL_MEM_STATS tStats;
+	TIMM_OSAL_U32 s;
+
+	for (s = 0; s < TIMM_OSAL_MEM_SEGMENTS; s++)
+	{
+		TIMM_OSAL_GetMemStats((TIMMOSAL_MEM_SEGMENTID) s, &tStats);
+		if (tStats.nBlocks)
+		{
+			TIMM_OSAL_Warning
+			    ("Segment %s: %u blocks of %u bytes still allocated, peak %u bytes, %u allocations",
+			    gMemSegmentName[s], tStats.nBlocks, tStats.nBytes,
+			    tStats.nPeakBytes, tStats.nAllocs);
+		} else
+		{
+			TIMM_OSAL_Info
+			    ("Segment %s: peak %u bytes, %u allocations",
+			    gMemSegmentName[s], tStats.nPeakBytes,
+			    tStats.nAllocs);
+		}
+	}
+	TIMM_OSAL_Info("Memory pools hold %u bytes of slabs",
+	    __atomic_load_n(&gMemSlabBytes, __ATOMIC_RELAXED));
 	return bReturnStatus;
 
 }
@@ -110,44 +568,86 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_DeleteMemoryPool(void)
 /**
 * @fn TIMM_OSAL_Malloc function
 *
+* bBlockContiguous is not used, all memory is virtually contiguous.
+* unBlockAlignment must be 0 or a power of two.
+*
 * @see
 */
 /* ========================================================================== */
 TIMM_OSAL_PTR TIMM_OSAL_Malloc(TIMM_OSAL_U32 size,
     __unused TIMM_OSAL_BOOL bBlockContiguous,
-    TIMM_OSAL_U32 unBlockAlignment, __unused TIMMOSAL_MEM_SEGMENTID tMemSegId)
+    TIMM_OSAL_U32 unBlockAlignment, TIMMOSAL_MEM_SEGMENTID tMemSegId)
 {
 
-	TIMM_OSAL_PTR pData = TIMM_OSAL_NULL;
+	TIMM_OSAL_MEM_HEADER *pHeader = TIMM_OSAL_NULL;
+	TIMM_OSAL_MEM_CACHE *pCache;
+	TIMM_OSAL_U32 nClass = 0;
+	TIMM_OSAL_U32 nAlign = TIMM_OSAL_MEM_ALIGN;
+	TIMM_OSAL_U8 *pRaw;
+	uintptr_t nPayload;
+
+	pthread_once(&gMemOnce, TIMM_OSAL_MemInit);
 
-#ifdef HAVE_MEMALIGN
-	if (0 == unBlockAlignment)
+	if (unBlockAlignment & (unBlockAlignment - 1))
 	{
-		pData = malloc((size_t) size);
-	} else
+		TIMM_OSAL_Error("Alignment %u is not a power of two!!!",
+		    unBlockAlignment);
+		return TIMM_OSAL_NULL;
+	}
+	if ((TIMM_OSAL_U32) tMemSegId >= TIMM_OSAL_MEM_SEGMENTS)
 	{
-		pData = memalign((size_t) unBlockAlignment, (size_t) size);
+		tMemSegId = TIMMOSAL_MEM_SEGMENT_EXT;
 	}
-#else
-	if (0 != unBlockAlignment)
+	if (unBlockAlignment > nAlign)
 	{
-		TIMM_OSAL_Warning
-		    ("Memory Allocation:Not done for specified nBufferAlignment. Alignment of 0 will be used");
+		nAlign = unBlockAlignment;
+	}
 
+	pCache = TIMM_OSAL_MemCache(TIMM_OSAL_TRUE);
+	if (pCache != NULL && nAlign == TIMM_OSAL_MEM_ALIGN &&
+	    size <= TIMM_OSAL_MEM_MAX_POOLED)
+	{
+		while ((1U << (TIMM_OSAL_MEM_MIN_SHIFT + nClass)) < size)
+		{
+			nClass++;
+		}
+		pHeader = TIMM_OSAL_MemPoolAlloc(pCache, nClass);
+		if (pHeader != NULL)
+		{
+			pHeader->nOffset = 0;
+		}
+	} else if (size <= (TIMM_OSAL_U32) ~0 - nAlign -
+	    sizeof(TIMM_OSAL_MEM_HEADER))
+	{
+		/*Header right before the payload, aligned by hand */
+		pRaw =
+		    (TIMM_OSAL_U8 *) malloc((size_t) size + nAlign - 1 +
+		    sizeof(TIMM_OSAL_MEM_HEADER));
+		if (pRaw != NULL)
+		{
+			nPayload =
+			    ((uintptr_t) pRaw + sizeof(TIMM_OSAL_MEM_HEADER) +
+			    nAlign - 1) & ~(uintptr_t) (nAlign - 1);
+			pHeader = (TIMM_OSAL_MEM_HEADER *) nPayload - 1;
+			pHeader->nOffset = nPayload - (uintptr_t) pRaw;
+			nClass = TIMM_OSAL_MEM_LARGE;
+		}
 	}
-	pData = malloc((size_t) size);	/*size_t is long long */
-#endif
-	if (TIMM_OSAL_NULL == pData)
+
+	if (TIMM_OSAL_NULL == pHeader)
 	{
 		TIMM_OSAL_Error("Malloc failed!!!");
-	} else
-	{
-		/* Memory Allocation was successfull */
-		gMallocCounter++;
+		return TIMM_OSAL_NULL;
 	}
 
+	/* Memory Allocation was successfull */
+	pHeader->nSize = size;
+	pHeader->nMagic = TIMM_OSAL_MEM_MAGIC;
+	pHeader->nClass = (TIMM_OSAL_U8) nClass;
+	pHeader->nSegment = (TIMM_OSAL_U8) tMemSegId;
+	TIMM_OSAL_MemAccount(pCache, tMemSegId, 1, size);
 
-	return pData;
+	return (TIMM_OSAL_PTR) (pHeader + 1);
 }
 
 /* ========================================================================== */
@@ -160,15 +660,35 @@ TIMM_OSAL_PTR TIMM_OSAL_Malloc(TIMM_OSAL_U32 size,
 
 void TIMM_OSAL_Free(TIMM_OSAL_PTR pData)
 {
+	TIMM_OSAL_MEM_HEADER *pHeader;
+	TIMM_OSAL_MEM_CACHE *pCache;
+
 	if (TIMM_OSAL_NULL == pData)
 	{
 		/*TIMM_OSAL_Warning("TIMM_OSAL_Free called on NULL pointer"); */
 		goto EXIT;
 	}
 
-	free(pData);
-	pData = NULL;
-	gMallocCounter--;
+	pHeader = (TIMM_OSAL_MEM_HEADER *) pData - 1;
+	if (pHeader->nMagic != TIMM_OSAL_MEM_MAGIC)
+	{
+		TIMM_OSAL_Error("%s %p!!!",
+		    pHeader->nMagic == TIMM_OSAL_MEM_FREED ?
+		    "Double free of" :
+		    "Free of a block not from TIMM_OSAL_Malloc", pData);
+		goto EXIT;
+	}
+	pHeader->nMagic = TIMM_OSAL_MEM_FREED;
+	pCache = TIMM_OSAL_MemCache(TIMM_OSAL_FALSE);
+	TIMM_OSAL_MemAccount(pCache, pHeader->nSegment, -1, pHeader->nSize);
+
+	if (pHeader->nClass == TIMM_OSAL_MEM_LARGE)
+	{
+		free((TIMM_OSAL_U8 *) pData - pHeader->nOffset);
+	} else
+	{
+		TIMM_OSAL_MemPoolFree(pCache, pHeader);
+	}
       EXIT:
 	return;
 }
@@ -239,12 +759,66 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_Memcpy(TIMM_OSAL_PTR pBufDst,
 /**
 * @fn TIMM_OSAL_GetMemCounter function ....
 *
+* Number of blocks allocated in all segments
+*
 * @see
 */
 /* ========================================================================== */
 
 TIMM_OSAL_U32 TIMM_OSAL_GetMemCounter(void)
 {
+	TIMM_OSAL_MEM_CACHE *pCache;
+	TIMM_OSAL_U32 s, nBlocks = 0;
+
+	/*The calling thread's figures at least are exact */
+	pCache = TIMM_OSAL_MemCache(TIMM_OSAL_FALSE);
+	if (pCache != NULL)
+	{
+		TIMM_OSAL_MemFold(pCache->tDelta);
+		pCache->nOps = 0;
+	}
+
+	for (s = 0; s < TIMM_OSAL_MEM_SEGMENTS; s++)
+	{
+		nBlocks +=
+		    __atomic_load_n(&gMemStats[s].nBlocks, __ATOMIC_RELAXED);
+	}
+	return nBlocks;
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_GetMemStats function ....
+*
+* @see
+*/
+/* ========================================================================== */
+
+TIMM_OSAL_ERRORTYPE TIMM_OSAL_GetMemStats(TIMMOSAL_MEM_SEGMENTID tMemSegId,
+    TIMM_OSAL_MEM_STATS * pStats)
+{
+	TIMM_OSAL_MEM_STATS *pSeg;
+	TIMM_OSAL_MEM_CACHE *pCache;
+
+	if (TIMM_OSAL_NULL == pStats ||
+	    (TIMM_OSAL_U32) tMemSegId >= TIMM_OSAL_MEM_SEGMENTS)
+	{
+		return TIMM_OSAL_ERR_PARAMETER;
+	}
+
+	/*The calling thread's figures at least are exact */
+	pCache = TIMM_OSAL_MemCache(TIMM_OSAL_FALSE);
+	if (pCache != NULL)
+	{
+		TIMM_OSAL_MemFold(pCache->tDelta);
+		pCache->nOps = 0;
+	}
 
-	return gMallocCounter;
+	pSeg = &gMemStats[tMemSegId];
+	pStats->nBlocks = __atomic_load_n(&pSeg->nBlocks, __ATOMIC_RELAXED);
+	pStats->nBytes = __atomic_load_n(&pSeg->nBytes, __ATOMIC_RELAXED);
+	pStats->nPeakBytes =
+	    __atomic_load_n(&pSeg->nPeakBytes, __ATOMIC_RELAXED);
+	pStats->nAllocs = __atomic_load_n(&pSeg->nAllocs, __ATOMIC_RELAXED);
+	return TIMM_OSAL_ERR_NONE;
 }
@@ -33,7 +33,9 @@
 /*
 *   @file  timm_osal_pipes.c
 *   This file contains methods that provides the functionality
-*   for creating/using Nucleus pipes.
+*   for creating/using pipes. A pipe is a bounded in-process deque of
+*   messages protected by a mutex, readers and writers block on
+*   condition variables.
 *
 *  @path \
 *
@@ -43,6 +45,7 @@
  *!
  *! Revision History
  *! ===================================
+ *! Pipes are an in-process deque instead of a kernel pipe
  *! 07-Nov-2008 Maiya ShreeHarsha: Linux specific changes
  *! 0.1: Created the first draft version, ksrini@ti.com
  * ========================================================================= */
@@ -56,23 +59,32 @@
 #include "timm_osal_memory.h"
 #include "timm_osal_trace.h"
 
-#include <unistd.h>
-#include <stdio.h>
-#include <string.h>
-#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 #include <errno.h>
 
 /**
 * TIMM_OSAL_PIPE structure define the OSAL pipe
+*
+* Messages live in nSlots slots of messageSize bytes each, used as a ring:
+* slot head is the oldest message and messageCount slots follow it. A
+* write appends after the last message, a write to front takes the slot
+* before head, so both are O(1).
 */
 typedef struct TIMM_OSAL_PIPE
 {
-	int pfd[2];
+	pthread_mutex_t mutex;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
 	TIMM_OSAL_U32 pipeSize;
 	TIMM_OSAL_U32 messageSize;
 	TIMM_OSAL_U8 isFixedMessage;
-	int messageCount;
-	int totalBytesInPipe;
+	TIMM_OSAL_U32 nSlots;
+	TIMM_OSAL_U32 head;
+	TIMM_OSAL_U32 messageCount;
+	TIMM_OSAL_U32 totalBytesInPipe;
+	TIMM_OSAL_U32 *pSizes;
+	TIMM_OSAL_U8 *pData;
 } TIMM_OSAL_PIPE;
 
 
@@ -80,10 +92,154 @@ typedef struct TIMM_OSAL_PIPE
 * Function Prototypes
 ******************************************************************************/
 
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_PipeDeadline function
+*
+* Converts a timeout in milliseconds to an absolute time on the clock the
+* pipe condition variables wait on
+*
+*/
+/* ========================================================================== */
+static void TIMM_OSAL_PipeDeadline(TIMM_OSAL_S32 timeout,
+    struct timespec *pDeadline)
+{
+	clock_gettime(CLOCK_MONOTONIC, pDeadline);
+	pDeadline->tv_sec += timeout / 1000;
+	pDeadline->tv_nsec += (timeout % 1000) * 1000000;
+	if (pDeadline->tv_nsec >= 1000000000)
+	{
+		pDeadline->tv_sec++;
+		pDeadline->tv_nsec -= 1000000000;
+	}
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_PipeWait function
+*
+* Waits on a condition of a locked pipe for at most timeout milliseconds,
+* TIMM_OSAL_SUSPEND waits forever. Returns the error to report if the
+* caller must give up.
+*
+*/
+/* ========================================================================== */
+static TIMM_OSAL_ERRORTYPE TIMM_OSAL_PipeWait(TIMM_OSAL_PIPE * pHandle,
+    pthread_cond_t * pCond, TIMM_OSAL_S32 timeout,
+    struct timespec *pDeadline)
+{
+	int status;
+
+	if (timeout == (TIMM_OSAL_S32) TIMM_OSAL_SUSPEND)
+	{
+		status = pthread_cond_wait(pCond, &pHandle->mutex);
+	} else
+	{
+		status =
+		    pthread_cond_timedwait(pCond, &pHandle->mutex,
+		    pDeadline);
+	}
+
+	if (ETIMEDOUT == status)
+	{
+		return TIMM_OSAL_ERR_TIMEOUT;
+	}
+	if (SUCCESS != status)
+	{
+		TIMM_OSAL_Error("Pipe wait failed!!!");
+		return TIMM_OSAL_ERR_UNKNOWN;
+	}
+	return TIMM_OSAL_ERR_NONE;
+}
+
+/* ========================================================================== */
+/**
+* @fn TIMM_OSAL_PipeWrite function
+*
+* Common part of TIMM_OSAL_WriteToPipe and TIMM_OSAL_WriteToFrontOfPipe
+*
+*/
+/* ========================================================================== */
+static TIMM_OSAL_ERRORTYPE TIMM_OSAL_PipeWrite(TIMM_OSAL_PTR pPipe,
+    void *pMessage, TIMM_OSAL_U32 size, TIMM_OSAL_S32 timeout,
+    TIMM_OSAL_BOOL bFront)
+{
+	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_NONE;
+	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
+	struct timespec deadline;
+	TIMM_OSAL_U32 slot;
+
+	if (TIMM_OSAL_NULL == pHandle || TIMM_OSAL_NULL == pMessage ||
+	    size == 0)
+	{
+		TIMM_OSAL_Error("Bad pipe write parameters!!!");
+		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
+		goto EXIT;
+	}
+	if ((pHandle->isFixedMessage && size != pHandle->messageSize) ||
+	    size > pHandle->messageSize)
+	{
+		TIMM_OSAL_Error("Message of %u bytes for a pipe of %u bytes messages!!!",
+		    size, pHandle->messageSize);
+		bReturnStatus = TIMM_OSAL_ERR_MSG_SIZE_MISMATCH;
+		goto EXIT;
+	}
+
+	if (timeout != TIMM_OSAL_NO_SUSPEND &&
+	    timeout != (TIMM_OSAL_S32) TIMM_OSAL_SUSPEND)
+	{
+		TIMM_OSAL_PipeDeadline(timeout, &deadline);
+	}
+
+	pthread_mutex_lock(&pHandle->mutex);
+	while (pHandle->messageCount == pHandle->nSlots)
+	{
+		if (timeout == TIMM_OSAL_NO_SUSPEND)
+		{
+			bReturnStatus = TIMM_OSAL_ERR_PIPE_FULL;
+			goto UNLOCK;
+		}
+		bReturnStatus =
+		    TIMM_OSAL_PipeWait(pHandle, &pHandle->notFull, timeout,
+		    &deadline);
+		if (TIMM_OSAL_ERR_NONE != bReturnStatus)
+		{
+			goto UNLOCK;
+		}
+	}
+
+	if (bFront)
+	{
+		pHandle->head =
+		    (pHandle->head + pHandle->nSlots - 1) % pHandle->nSlots;
+		slot = pHandle->head;
+	} else
+	{
+		slot =
+		    (pHandle->head + pHandle->messageCount) % pHandle->nSlots;
+	}
+	TIMM_OSAL_Memcpy(pHandle->pData + slot * pHandle->messageSize,
+	    pMessage, size);
+	pHandle->pSizes[slot] = size;
+
+	/*Update message count and size */
+	pHandle->messageCount++;
+	pHandle->totalBytesInPipe += size;
+	pthread_cond_signal(&pHandle->notEmpty);
+
+      UNLOCK:
+	pthread_mutex_unlock(&pHandle->mutex);
+      EXIT:
+	return bReturnStatus;
+}
+
 /* ========================================================================== */
 /**
 * @fn TIMM_OSAL_CreatePipe function
 *
+* Creates a pipe of pipeSize bytes holding messages of messageSize bytes,
+* at least one. Fixed size pipes only take messages of exactly messageSize
+* bytes, the others take messages of up to messageSize bytes.
 *
 */
 /* ========================================================================== */
@@ -94,6 +250,20 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_CreatePipe(TIMM_OSAL_PTR * pPipe,
 {
 	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_UNKNOWN;
 	TIMM_OSAL_PIPE *pHandle = TIMM_OSAL_NULL;
+	pthread_condattr_t attr;
+	TIMM_OSAL_U32 nSlots;
+
+	if (TIMM_OSAL_NULL == pPipe || messageSize == 0)
+	{
+		TIMM_OSAL_Error("Bad pipe parameters!!!");
+		return TIMM_OSAL_ERR_PARAMETER;
+	}
+
+	nSlots = pipeSize / messageSize;
+	if (nSlots == 0)
+	{
+		nSlots = 1;
+	}
 
 	pHandle =
 	    (TIMM_OSAL_PIPE *) TIMM_OSAL_Malloc(sizeof(TIMM_OSAL_PIPE), 0, 0,
@@ -106,17 +276,49 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_CreatePipe(TIMM_OSAL_PTR * pPipe,
 	}
 	TIMM_OSAL_Memset(pHandle, 0x0, sizeof(TIMM_OSAL_PIPE));
 
-	pHandle->pfd[0] = -1;
-	pHandle->pfd[1] = -1;
-	if (SUCCESS != pipe(pHandle->pfd))
+	pHandle->pSizes =
+	    (TIMM_OSAL_U32 *) TIMM_OSAL_Malloc(nSlots * sizeof(TIMM_OSAL_U32),
+	    0, 0, 0);
+	pHandle->pData =
+	    (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(nSlots * messageSize, 0, 0, 0);
+	if (TIMM_OSAL_NULL == pHandle->pSizes ||
+	    TIMM_OSAL_NULL == pHandle->pData)
+	{
+		bReturnStatus = TIMM_OSAL_ERR_ALLOC;
+		goto EXIT;
+	}
+
+	/*Timed waits must not jump with the wall clock */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (SUCCESS != pthread_mutex_init(&pHandle->mutex, NULL))
+	{
+		TIMM_OSAL_Error("Pipe mutex init failed!!!");
+		pthread_condattr_destroy(&attr);
+		goto EXIT;
+	}
+	if (SUCCESS != pthread_cond_init(&pHandle->notEmpty, &attr))
 	{
-		TIMM_OSAL_Error("Pipe failed: %s!!!", strerror(errno));
+		TIMM_OSAL_Error("Pipe condition init failed!!!");
+		pthread_mutex_destroy(&pHandle->mutex);
+		pthread_condattr_destroy(&attr);
 		goto EXIT;
 	}
+	if (SUCCESS != pthread_cond_init(&pHandle->notFull, &attr))
+	{
+		TIMM_OSAL_Error("Pipe condition init failed!!!");
+		pthread_cond_destroy(&pHandle->notEmpty);
+		pthread_mutex_destroy(&pHandle->mutex);
+		pthread_condattr_destroy(&attr);
+		goto EXIT;
+	}
+	pthread_condattr_destroy(&attr);
 
 	pHandle->pipeSize = pipeSize;
 	pHandle->messageSize = messageSize;
 	pHandle->isFixedMessage = isFixedMessage;
+	pHandle->nSlots = nSlots;
+	pHandle->head = 0;
 	pHandle->messageCount = 0;
 	pHandle->totalBytesInPipe = 0;
 
@@ -127,6 +329,11 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_CreatePipe(TIMM_OSAL_PTR * pPipe,
 
 	return bReturnStatus;
 EXIT:
+	if (TIMM_OSAL_NULL != pHandle)
+	{
+		TIMM_OSAL_Free(pHandle->pSizes);
+		TIMM_OSAL_Free(pHandle->pData);
+	}
 	TIMM_OSAL_Free(pHandle);
 	return bReturnStatus;
 }
@@ -153,17 +360,20 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_DeletePipe(TIMM_OSAL_PTR pPipe)
 		goto EXIT;
 	}
 
-	if (SUCCESS != close(pHandle->pfd[0]))
+	if (SUCCESS != pthread_cond_destroy(&pHandle->notEmpty) ||
+	    SUCCESS != pthread_cond_destroy(&pHandle->notFull))
 	{
-		TIMM_OSAL_Error("Delete_Pipe Read fd failed!!!");
+		TIMM_OSAL_Error("Delete_Pipe condition destroy failed!!!");
 		bReturnStatus = TIMM_OSAL_ERR_UNKNOWN;
 	}
-	if (SUCCESS != close(pHandle->pfd[1]))
+	if (SUCCESS != pthread_mutex_destroy(&pHandle->mutex))
 	{
-		TIMM_OSAL_Error("Delete_Pipe Write fd failed!!!");
+		TIMM_OSAL_Error("Delete_Pipe mutex destroy failed!!!");
 		bReturnStatus = TIMM_OSAL_ERR_UNKNOWN;
 	}
 
+	TIMM_OSAL_Free(pHandle->pSizes);
+	TIMM_OSAL_Free(pHandle->pData);
 	TIMM_OSAL_Free(pHandle);
 EXIT:
 	return bReturnStatus;
@@ -175,41 +385,16 @@ EXIT:
 /**
 * @fn TIMM_OSAL_WriteToPipe function
 *
+* Appends a message, waiting up to timeout milliseconds for room
 *
 */
 /* ========================================================================== */
 
 TIMM_OSAL_ERRORTYPE TIMM_OSAL_WriteToPipe(TIMM_OSAL_PTR pPipe,
-    void *pMessage, TIMM_OSAL_U32 size, __unused TIMM_OSAL_S32 timeout)
+    void *pMessage, TIMM_OSAL_U32 size, TIMM_OSAL_S32 timeout)
 {
-	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_UNKNOWN;
-	TIMM_OSAL_U32 lSizeWritten = -1;
-
-	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
-
-	if (size == 0)
-	{
-		TIMM_OSAL_Error("0 size!!!");
-		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-		goto EXIT;
-	}
-	lSizeWritten = write(pHandle->pfd[1], pMessage, size);
-
-	if (lSizeWritten != size)
-	{
-		TIMM_OSAL_Error("Write of pipe failed!!!");
-		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-		goto EXIT;
-	}
-
-	/*Update message count and size */
-	pHandle->messageCount++;
-	pHandle->totalBytesInPipe += size;
-
-	bReturnStatus = TIMM_OSAL_ERR_NONE;
-
-      EXIT:
-	return bReturnStatus;
+	return TIMM_OSAL_PipeWrite(pPipe, pMessage, size, timeout,
+	    TIMM_OSAL_FALSE);
 }
 
 
@@ -218,78 +403,17 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_WriteToPipe(TIMM_OSAL_PTR pPipe,
 /**
 * @fn TIMM_OSAL_WriteToFrontOfPipe function
 *
+* Inserts a message to be read before all queued ones, waiting up to
+* timeout milliseconds for room
 *
 */
 /* ========================================================================== */
 
 TIMM_OSAL_ERRORTYPE TIMM_OSAL_WriteToFrontOfPipe(TIMM_OSAL_PTR pPipe,
-    void *pMessage, TIMM_OSAL_U32 size, __unused TIMM_OSAL_S32 timeout)
+    void *pMessage, TIMM_OSAL_U32 size, TIMM_OSAL_S32 timeout)
 {
-
-	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_UNKNOWN;
-	TIMM_OSAL_U32 lSizeWritten = -1;
-	TIMM_OSAL_U32 lSizeRead = -1;
-	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
-	TIMM_OSAL_U8 *tempPtr = NULL;
-
-
-	/*First write to this pipe */
-	if (size == 0)
-	{
-		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-		goto EXIT;
-	}
-
-	lSizeWritten = write(pHandle->pfd[1], pMessage, size);
-
-	if (lSizeWritten != size)
-	{
-		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-		goto EXIT;
-	}
-
-	/*Update number of messages */
-	pHandle->messageCount++;
-
-
-	if (pHandle->messageCount > 1)
-	{
-		/*First allocate memory */
-		tempPtr =
-		    (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(pHandle->
-		    totalBytesInPipe, 0, 0, 0);
-
-		if (tempPtr == NULL)
-		{
-			bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-			goto EXIT;
-		}
-
-		/*Read out of pipe */
-		lSizeRead =
-		    read(pHandle->pfd[0], tempPtr, pHandle->totalBytesInPipe);
-
-		/*Write back to pipe */
-		lSizeWritten =
-		    write(pHandle->pfd[1], tempPtr,
-		    lSizeRead);
-
-		if (lSizeWritten != size)
-		{
-			bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-			goto EXIT;
-		}
-
-		/*Update Total bytes in pipe */
-		pHandle->totalBytesInPipe += size;
-	}
-
-
-      EXIT:
-	TIMM_OSAL_Free(tempPtr);
-
-	return bReturnStatus;
-
+	return TIMM_OSAL_PipeWrite(pPipe, pMessage, size, timeout,
+	    TIMM_OSAL_TRUE);
 }
 
 
@@ -298,6 +422,8 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_WriteToFrontOfPipe(TIMM_OSAL_PTR pPipe,
 /**
 * @fn TIMM_OSAL_ReadFromPipe function
 *
+* Takes the first message, waiting up to timeout milliseconds for one.
+* size is the room at pMessage, a message that does not fit stays queued.
 *
 */
 /* ========================================================================== */
@@ -306,43 +432,62 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_ReadFromPipe(TIMM_OSAL_PTR pPipe,
     void *pMessage,
     TIMM_OSAL_U32 size, TIMM_OSAL_U32 * actualSize, TIMM_OSAL_S32 timeout)
 {
-	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_UNKNOWN;
-	TIMM_OSAL_U32 lSizeRead = -1;
+	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_NONE;
 	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
+	struct timespec deadline;
+	TIMM_OSAL_U32 slot;
 
-	if (size == 0)
+	if (TIMM_OSAL_NULL == pHandle || TIMM_OSAL_NULL == pMessage ||
+	    TIMM_OSAL_NULL == actualSize || size == 0)
 	{
 		TIMM_OSAL_Error("nRead size has error!!!");
 		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
 		goto EXIT;
 	}
-	if ((pHandle->messageCount == 0) && (timeout == TIMM_OSAL_NO_SUSPEND))
+
+	if (timeout != TIMM_OSAL_NO_SUSPEND &&
+	    timeout != (TIMM_OSAL_S32) TIMM_OSAL_SUSPEND)
 	{
-		/*If timeout is 0 and pipe is empty, return error */
-		TIMM_OSAL_Error("Pipe is empty!!!");
-		bReturnStatus = TIMM_OSAL_ERR_PIPE_EMPTY;
-		goto EXIT;
+		TIMM_OSAL_PipeDeadline(timeout, &deadline);
 	}
-	if ((timeout !=TIMM_OSAL_NO_SUSPEND) &&
-	    (timeout != (TIMM_OSAL_S32)TIMM_OSAL_SUSPEND))
+
+	pthread_mutex_lock(&pHandle->mutex);
+	while (pHandle->messageCount == 0)
 	{
-		TIMM_OSAL_Warning("Only infinite or no timeouts \
-			supported. Going to read with infinite timeout now");
+		if (timeout == TIMM_OSAL_NO_SUSPEND)
+		{
+			/*If timeout is 0 and pipe is empty, return error */
+			bReturnStatus = TIMM_OSAL_ERR_PIPE_EMPTY;
+			goto UNLOCK;
+		}
+		bReturnStatus =
+		    TIMM_OSAL_PipeWait(pHandle, &pHandle->notEmpty, timeout,
+		    &deadline);
+		if (TIMM_OSAL_ERR_NONE != bReturnStatus)
+		{
+			goto UNLOCK;
+		}
 	}
-	/*read blocks infinitely until message is available */
-	*actualSize = lSizeRead = read(pHandle->pfd[0], pMessage, size);
-	if (0 == lSizeRead)
+
+	slot = pHandle->head;
+	if (pHandle->pSizes[slot] > size)
 	{
-		TIMM_OSAL_Error("EOF reached or no data in pipe!!!");
-		bReturnStatus = TIMM_OSAL_ERR_PARAMETER;
-		goto EXIT;
+		TIMM_OSAL_Error("Message of %u bytes read into %u bytes!!!",
+		    pHandle->pSizes[slot], size);
+		bReturnStatus = TIMM_OSAL_ERR_MSG_SIZE_MISMATCH;
+		goto UNLOCK;
 	}
+	*actualSize = pHandle->pSizes[slot];
+	TIMM_OSAL_Memcpy(pMessage, pHandle->pData + slot * pHandle->messageSize,
+	    *actualSize);
 
-	bReturnStatus = TIMM_OSAL_ERR_NONE;
-
+	pHandle->head = (pHandle->head + 1) % pHandle->nSlots;
 	pHandle->messageCount--;
-	pHandle->totalBytesInPipe -= size;
+	pHandle->totalBytesInPipe -= *actualSize;
+	pthread_cond_signal(&pHandle->notFull);
 
+      UNLOCK:
+	pthread_mutex_unlock(&pHandle->mutex);
       EXIT:
 	return bReturnStatus;
 
@@ -354,17 +499,28 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_ReadFromPipe(TIMM_OSAL_PTR pPipe,
 /**
 * @fn TIMM_OSAL_ClearPipe function
 *
+* Drops all queued messages
 *
 */
 /* ========================================================================== */
 
-TIMM_OSAL_ERRORTYPE TIMM_OSAL_ClearPipe(__unused TIMM_OSAL_PTR pPipe)
+TIMM_OSAL_ERRORTYPE TIMM_OSAL_ClearPipe(TIMM_OSAL_PTR pPipe)
 {
-	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR;
+	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
+
+	if (TIMM_OSAL_NULL == pHandle)
+	{
+		return TIMM_OSAL_ERR_PARAMETER;
+	}
 
-	TIMM_OSAL_Warning("This function is currently not implemented");
+	pthread_mutex_lock(&pHandle->mutex);
+	pHandle->head = 0;
+	pHandle->messageCount = 0;
+	pHandle->totalBytesInPipe = 0;
+	pthread_cond_broadcast(&pHandle->notFull);
+	pthread_mutex_unlock(&pHandle->mutex);
 
-	return bReturnStatus;
+	return TIMM_OSAL_ERR_NONE;
 }
 
 
@@ -382,13 +538,15 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_IsPipeReady(TIMM_OSAL_PTR pPipe)
 	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR;
 	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
 
-	if (pHandle->messageCount <= 0)
+	pthread_mutex_lock(&pHandle->mutex);
+	if (pHandle->messageCount == 0)
 	{
 		bReturnStatus = TIMM_OSAL_ERR_NOT_READY;
 	} else
 	{
 		bReturnStatus = TIMM_OSAL_ERR_NONE;
 	}
+	pthread_mutex_unlock(&pHandle->mutex);
 
 	return bReturnStatus;
 
@@ -410,7 +568,9 @@ TIMM_OSAL_ERRORTYPE TIMM_OSAL_GetPipeReadyMessageCount(TIMM_OSAL_PTR pPipe,
 	TIMM_OSAL_ERRORTYPE bReturnStatus = TIMM_OSAL_ERR_NONE;
 	TIMM_OSAL_PIPE *pHandle = (TIMM_OSAL_PIPE *) pPipe;
 
+	pthread_mutex_lock(&pHandle->mutex);
 	*count = pHandle->messageCount;
+	pthread_mutex_unlock(&pHandle->mutex);
 	return bReturnStatus;
 
 }
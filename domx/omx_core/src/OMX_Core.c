@@ -47,6 +47,7 @@
 #include "timm_osal_error.h"
 #include "timm_osal_trace.h"
 #include "timm_osal_mutex.h"
+#include "timm_osal_memory.h"
 
 #ifdef CHECK_SECURE_STATE
 #include <sys/ioctl.h>
@@ -158,6 +159,7 @@ OMX_ERRORTYPE OMX_Init()
     count++;
 
     if( count == 1 ) {
+        TIMM_OSAL_CreateMemoryPool();
         pthread_mutex_init(&mutex, NULL);
         eError = OMX_BuildComponentTable();
     }
@@ -445,6 +447,8 @@ OMX_ERRORTYPE OMX_Deinit()
         if( pthread_mutex_destroy(&mutex) != 0 ) {
             /*printf("%d :: Core: Error in Mutex destroy\n" ,__LINE__); */
         }
+        /* Reports what the components left allocated */
+        TIMM_OSAL_DeleteMemoryPool();
     } else {
         if( pthread_mutex_unlock(&mutex) != 0 ) {
             TIMM_OSAL_Error("Core: Error in Mutex unlock");
@@ -24,6 +24,7 @@ TI_OMXPROXY_ENCODER_INCLUDES := \
 	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
 	$(HARDWARE_TI_OMAP4_BASE)/hwc \
 	$(FRAMEWORKS_MEDIA_BASE) \
+	$(HARDWARE_TI_OMAP4_BASE)/libyuvconvert \
 	system/core/include/cutils
 
 
@@ -63,6 +64,14 @@ TI_OMXPROXY_ENCODER_SHARED_LIBRARIES := \
 	libhardware \
 	libcutils
 
+TI_OMXPROXY_ENCODER_STATIC_LIBRARIES := \
+	libyuvconvert
+
+# Color conversion pipeline of the encoders taking opaque input
+TI_OMXPROXY_ENCODER_SRC_FILES := \
+	omx_video_enc/src/omx_proxy_video_encoder.c \
+	omx_video_enc/src/omx_video_enc_convert.c
+
 
 #
 # libOMX.TI.DUCATI1.MISC.SAMPLE
@@ -105,11 +114,13 @@ LOCAL_SRC_FILES := \
 	omx_video_dec/src/omx_proxy_videodec.c \
 	omx_video_dec/src/omx_proxy_videodec_utils.c
 
-# Uncomment the below 2 lines to enable the run time
+# Uncomment the below 4 lines to enable the run time
 # dump of NV12 buffers from Decoder/Camera
 # based on setprop control
 #LOCAL_CFLAGS += -DENABLE_RAW_BUFFERS_DUMP_UTILITY
 #LOCAL_SHARED_LIBRARIES += libcutils
+#LOCAL_STATIC_LIBRARIES += libyuvconvert
+#LOCAL_C_INCLUDES += $(HARDWARE_TI_OMAP4_BASE)/libyuvconvert
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libOMX.TI.DUCATI1.VIDEO.DECODER
@@ -194,7 +205,11 @@ LOCAL_CFLAGS := \
 	$(TI_OMXPROXY_COMMON_CFLAGS) \
 	$(TI_OMXPROXY_ENCODER_CFLAGS)
 
-LOCAL_SRC_FILES := omx_video_enc/src/omx_h264_enc/src/omx_proxy_h264enc.c
+LOCAL_SRC_FILES := \
+	omx_video_enc/src/omx_h264_enc/src/omx_proxy_h264enc.c \
+	$(TI_OMXPROXY_ENCODER_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := $(TI_OMXPROXY_ENCODER_STATIC_LIBRARIES)
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libOMX.TI.DUCATI1.VIDEO.H264E
@@ -218,7 +233,11 @@ LOCAL_CFLAGS := \
 	$(TI_OMXPROXY_COMMON_CFLAGS) \
 	$(TI_OMXPROXY_ENCODER_CFLAGS)
 
-LOCAL_SRC_FILES := omx_video_enc/src/omx_vc1_enc/src/omx_proxy_vc1enc.c
+LOCAL_SRC_FILES := \
+	omx_video_enc/src/omx_vc1_enc/src/omx_proxy_vc1enc.c \
+	$(TI_OMXPROXY_ENCODER_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := $(TI_OMXPROXY_ENCODER_STATIC_LIBRARIES)
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libOMX.TI.DUCATI1.VIDEO.VC1E
@@ -242,7 +261,11 @@ LOCAL_CFLAGS := \
 	$(TI_OMXPROXY_COMMON_CFLAGS) \
 	$(TI_OMXPROXY_ENCODER_CFLAGS)
 
-LOCAL_SRC_FILES := omx_video_enc/src/omx_h264svc_enc/src/omx_proxy_h264svcenc.c
+LOCAL_SRC_FILES := \
+	omx_video_enc/src/omx_h264svc_enc/src/omx_proxy_h264svcenc.c \
+	$(TI_OMXPROXY_ENCODER_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := $(TI_OMXPROXY_ENCODER_STATIC_LIBRARIES)
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libOMX.TI.DUCATI1.VIDEO.H264SVCE
@@ -266,7 +289,11 @@ LOCAL_CFLAGS := \
 	$(TI_OMXPROXY_COMMON_CFLAGS) \
 	$(TI_OMXPROXY_ENCODER_CFLAGS)
 
-LOCAL_SRC_FILES := omx_video_enc/src/omx_mpeg4_enc/src/omx_proxy_mpeg4enc.c
+LOCAL_SRC_FILES := \
+	omx_video_enc/src/omx_mpeg4_enc/src/omx_proxy_mpeg4enc.c \
+	$(TI_OMXPROXY_ENCODER_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := $(TI_OMXPROXY_ENCODER_STATIC_LIBRARIES)
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libOMX.TI.DUCATI1.VIDEO.MPEG4E
@@ -53,6 +53,7 @@
 #include <cutils/properties.h>
 #include <stdlib.h>
 #include <errno.h>
+#include "yuv_convert.h"
 #endif
 
 #define COMPONENT_NAME "OMX.TI.DUCATI1.VIDEO.DECODER"
@@ -207,9 +208,11 @@ OMX_ERRORTYPE PrearrageEmptyThisBuffer(OMX_HANDLETYPE hComponent,
 * Usage#
 * By default this feature is kept disabled to avoid security leaks.
 *
-* (1) Uncomment the below 2 lines from Android.mk
+* (1) Uncomment the below 4 lines from Android.mk
 *     #LOCAL_CFLAGS += -DENABLE_RAW_BUFFERS_DUMP_UTILITY
 *     #LOCAL_SHARED_LIBRARIES += libcutils
+*     #LOCAL_STATIC_LIBRARIES += libyuvconvert
+*     #LOCAL_C_INCLUDES += $(HARDWARE_TI_OMAP4_BASE)/libyuvconvert
 *     And rebuild the omx proxy common component
 *
 * (2) Before start playback, make sure that "data" folder has r/w
@@ -234,27 +237,17 @@ static void convertNV12ToYuv420(DebugFrame_Dump *frameInfo, void *dst)
 {
 	int stride = 4096; /* ARM Page size = 4k */
 	uint32_t ybuf_offset = frameInfo->frame_yoffset * stride + frameInfo->frame_xoffset;
-	uint8_t* p1y = (uint8_t*)frameInfo->y_uv[0] + ybuf_offset;
+	const uint8_t* p1y = (uint8_t*)frameInfo->y_uv[0] + ybuf_offset;
 	uint8_t* p2y = (uint8_t*) dst;
-	int i, j, j1;
 	int width = frameInfo->frame_width;
 	int height = frameInfo->frame_height;
 
 	DOMX_DEBUG("Coverting NV-12 to YUV420p Width[%d], Height[%d] and Stride[%d] offset[%d]",
 	width, height, stride, ybuf_offset);
 
-	/* copy y-buffer, almost bytewise copy, except for stride jumps.*/
-	for(i=0;i<height;i++)
-	{
-		/* copy whole row of Y pixels. source and desination will point to new row each time.*/
-		memcpy(p2y+i*width, p1y+i*stride, width);
-	}
-
-	/** copy uv buffers
-	* rearrange from  packed planar [uvuvuv] to planar [uuu][vvvv] packages pixel wise
-	* calculate the offset for UV buffer
+	/** calculate the offset for UV buffer
+	* packed planar [uvuvuv] is rearranged to planar [uuu][vvvv]
 	*/
-
 	uint32_t UV_offset = frameInfo->frame_xoffset
 	        + (frameInfo->decoded_height
 	        + frameInfo->frame_yoffset / 2)
@@ -264,17 +257,9 @@ static void convertNV12ToYuv420(DebugFrame_Dump *frameInfo, void *dst)
 
 	uint8_t* p2u = ((uint8_t*) dst + (width * height));
 	uint8_t* p2v = ((uint8_t*) p2u + ((width/2) * (height/2)));
-	for(i=0;(i < height/2);i++)
-	{
-		for(j=0,j1=0;(j< width/2);j++,j1+=2)
-		{
-			p2u[j] = p1uv[j1];
-			p2v[j] = p1uv[j1+1];
-		}
-		p1uv+=stride;
-		p2u+=width/2;
-		p2v+=width/2;
-	}
+
+	yuv_copy_plane(p1y, stride, p2y, width, width, height);
+	yuv_split_pairs(p1uv, stride, p2u, width/2, p2v, width/2, width/2, height/2);
 }
 
 void DumpVideoFrame(DebugFrame_Dump *frameInfo)
@@ -72,8 +72,19 @@
 #include <hal_public.h>
 #include <VideoMetadata.h>
 #endif
+#include "omx_proxy_common.h"
+#include "omx_video_enc_convert.h"
 
 #define OMX_ENC_NUM_INTERNAL_BUF (8)
+
+/* Stride of the NV12 buffers the proxy allocates for color conversion */
+#define OMX_ENC_NV12_STRIDE (4096)
+
+/* Threads of the CPU color converter, 0 converts with the GPU blitter */
+#define OMX_ENC_CC_THREADS_DEFAULT (2)
+
+typedef OMX_ERRORTYPE (*PROXY_VENC_EMPTYTHISBUFFER) (OMX_HANDLETYPE
+    hComponent, OMX_BUFFERHEADERTYPE * pBufferHdr);
 /**
  * struct OMX_PROXY_ENCODER_PRIVATE: this struct contains all data elements specific
  *                                   to PROXY ENCODER components.
@@ -84,6 +95,15 @@
  * @param gralloc_handle: handles of local gralloc buffers allocated
  * @param nCurBufIndex: current buffer index
  * @param mAllocDev: Local gralloc client
+ * @param hStage: Thread converting and submitting opaque input frames ahead
+ *                of the client, created with the first of them
+ * @param hConverter: CPU RGB to NV12 converter, created on first use
+ * @param nCCThreads: Threads of hConverter, 0 to convert with the GPU
+ * @param bCCAsync: Opaque frames go through hStage
+ * @param pfnEmptyThisBuffer: ETB of the proxy, called by hStage
+ * @param proxyEmptyBufferDone: EBD handler of the proxy common layer
+ * @param nBufSlot: NV12 buffer held by each input buffer until its EBD,
+ *                  by tBufList index, -1 if none
  *
  *  */
 typedef struct OMX_PROXY_ENCODER_PRIVATE
@@ -94,4 +114,28 @@ typedef struct OMX_PROXY_ENCODER_PRIVATE
 	IMG_native_handle_t* gralloc_handle[OMX_ENC_NUM_INTERNAL_BUF];
 	OMX_S32  nCurBufIndex;
 	alloc_device_t* mAllocDev;
+	VENC_STAGE *hStage;
+	VENC_CONVERTER *hConverter;
+	OMX_S32  nCCThreads;
+	OMX_BOOL bCCAsync;
+	PROXY_VENC_EMPTYTHISBUFFER pfnEmptyThisBuffer;
+	PROXY_EMPTYBUFFER_DONE proxyEmptyBufferDone;
+	OMX_S32  nBufSlot[MAX_NUM_PROXY_BUFFERS];
 }OMX_PROXY_ENCODER_PRIVATE;
+
+/* Color conversion pipeline shared by the encoder proxies, see
+ * omx_proxy_video_encoder.c */
+OMX_ERRORTYPE PROXY_VENC_ColorConvInit(OMX_HANDLETYPE hComponent,
+    PROXY_VENC_EMPTYTHISBUFFER pfnEmptyThisBuffer);
+void PROXY_VENC_ColorConvDeInit(OMX_HANDLETYPE hComponent);
+OMX_BOOL PROXY_VENC_QueueEmptyThisBuffer(OMX_HANDLETYPE hComponent,
+    OMX_BUFFERHEADERTYPE * pBufferHdr);
+OMX_ERRORTYPE PROXY_VENC_AcquireSlot(OMX_HANDLETYPE hComponent,
+    OMX_BUFFERHEADERTYPE * pBufferHdr, OMX_U32 * pnSlot);
+void PROXY_VENC_ReleaseSlot(OMX_HANDLETYPE hComponent,
+    OMX_BUFFERHEADERTYPE * pBufferHdr);
+int PROXY_VENC_ConvertToNV12(OMX_HANDLETYPE hComponent,
+    IMG_native_handle_t * pSrc, IMG_native_handle_t * pDst);
+OMX_ERRORTYPE PROXY_VENC_SendCommand(OMX_IN OMX_HANDLETYPE hComponent,
+    OMX_IN OMX_COMMANDTYPE eCmd, OMX_IN OMX_U32 nParam,
+    OMX_IN OMX_PTR pCmdData);
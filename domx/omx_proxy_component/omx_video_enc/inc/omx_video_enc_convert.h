@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ *  @file  omx_video_enc_convert.h
+ *         Color conversion pipeline of the encoder proxies. A converter
+ *         splits an RGB to NV12 conversion across a small pool of threads
+ *         and a stage runs jobs in submission order on its own thread, so
+ *         converting the next input frame overlaps with the remote core
+ *         encoding the current one.
+ *
+ *         Neither depends on OMX or gralloc, they work on plain memory.
+ *
+ *  @path domx/omx_proxy_component/omx_video_enc/inc
+ *
+ *  @rev 1.0
+ */
+
+#ifndef OMX_VIDEO_ENC_CONVERT_H
+#define OMX_VIDEO_ENC_CONVERT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VENC_CONVERTER_MAX_THREADS (4)
+
+typedef struct VENC_CONVERTER VENC_CONVERTER;
+typedef struct VENC_STAGE VENC_STAGE;
+
+/* Runs one job on the stage thread */
+typedef void (*VENC_STAGE_PROCESS)(void *pCtx, void *pJob);
+
+/* ===========================================================================*/
+/**
+ * @name VENC_ConverterCreate()
+ * @brief Starts nThreads - 1 helper threads, the thread calling
+ *        VENC_ConverterRGBToNV12() converts the first band itself.
+ * @param nThreads : 1 to VENC_CONVERTER_MAX_THREADS
+ * @return The converter, NULL if out of memory or threads
+ */
+/* ===========================================================================*/
+VENC_CONVERTER *VENC_ConverterCreate(int nThreads);
+
+void VENC_ConverterDestroy(VENC_CONVERTER *hConv);
+
+/* ===========================================================================*/
+/**
+ * @name VENC_ConverterRGBToNV12()
+ * @brief 32 bit RGB (BGR if bBGR) to NV12, see yuv_rgba_to_nv12(). The
+ *        frame is split in bands of even rows, one per thread, and the
+ *        call returns once every band is done. Only one conversion may run
+ *        on a converter at a time.
+ */
+/* ===========================================================================*/
+void VENC_ConverterRGBToNV12(VENC_CONVERTER *hConv, const uint8_t *pSrc,
+    int nSrcStride, int bBGR, uint8_t *pY, int nYStride, uint8_t *pUV,
+    int nUVStride, int nWidth, int nHeight);
+
+/* ===========================================================================*/
+/**
+ * @name VENC_StageCreate()
+ * @brief Starts the stage thread.
+ * @param nDepth : Jobs that may be queued before VENC_StageSubmit() blocks
+ * @param pfnProcess : Called on the stage thread for every job, in order
+ * @return The stage, NULL if out of memory or threads
+ */
+/* ===========================================================================*/
+VENC_STAGE *VENC_StageCreate(int nDepth, VENC_STAGE_PROCESS pfnProcess,
+    void *pCtx);
+
+/* Drains the stage and stops its thread */
+void VENC_StageDestroy(VENC_STAGE *hStage);
+
+/* Queues a job, blocks while nDepth jobs are waiting */
+void VENC_StageSubmit(VENC_STAGE *hStage, void *pJob);
+
+/* Returns once every job submitted so far has been processed */
+void VENC_StageDrain(VENC_STAGE *hStage);
+
+/* Non zero on the stage thread, whose calls must not be queued again */
+int VENC_StageIsWorker(VENC_STAGE *hStage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OMX_VIDEO_ENC_CONVERT_H */
@@ -122,17 +122,7 @@ OMX_U16 nBFrames = 0; /* Number of B Frames in H264 Encoder */
  */
 #define OMX_H264VE_NUM_INTERNAL_BUF (8)
 
-#define COLORCONVERT_MAX_SUB_BUFFERS (3)
-
-#define COLORCONVERT_BUFTYPE_VIRTUAL (0x0)
-#define COLORCONVERT_BUFTYPE_ION     (0x1)
-#define COLORCONVERT_BUFTYPE_GRALLOCOPAQUE (0x2)
-
 int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv);
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC, void *pSrc[],
-				      void *pDst[], int nWidth,
-				      int nHeight, int nStride,
-				      int nSrcBufType, int nDstBufType);
 int COLORCONVERT_close(void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv);
 static int COLORCONVERT_AllocateBuffer(OMX_HANDLETYPE hComponent, OMX_U32 nStride);
 static OMX_ERRORTYPE LOCAL_PROXY_H264E_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
@@ -257,6 +247,12 @@ static OMX_ERRORTYPE ComponentPrivateEmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	PROXY_assert(hComponent != NULL, OMX_ErrorInsufficientResources,"Null component handle received in EmptyThisBuffer");
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 	PROXY_assert(pCompPrv != NULL, OMX_ErrorInsufficientResources,"Pointer to Null component private structure received in EmptyThisBuffer");
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+	/* A queued frame comes back here from the color conversion stage,
+	 * so that the frame rate changes after the frames queued before it */
+	if (PROXY_VENC_QueueEmptyThisBuffer(hComponent, pBufferHdr) == OMX_TRUE)
+		return OMX_ErrorNone;
+#endif
         if(pCompPrv->proxyPortBuffers[0].proxyBufferType == EncoderMetadataPointers) {
 		OMX_U32 *pTempBuffer;
 		OMX_U32 nMetadataBufferType;
@@ -343,8 +339,8 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pComponentPrivate->pCompProxyPrv;
 
 	/* Create Pipe of for encoder input buffers */
-	eOSALStatus = TIMM_OSAL_CreatePipe(&pProxy->hBufPipe, sizeof(OMX_U32),
-					   OMX_H264VE_NUM_INTERNAL_BUF, 1);
+	eOSALStatus = TIMM_OSAL_CreatePipe(&pProxy->hBufPipe,
+					   OMX_H264VE_NUM_INTERNAL_BUF * sizeof(OMX_U32), sizeof(OMX_U32), 1);
 	PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE,
 			OMX_ErrorInsufficientResources,
 			"Pipe creation failed");
@@ -370,6 +366,9 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	pHandle->ComponentDeInit = LOCAL_PROXY_H264E_ComponentDeInit;
 	pHandle->FreeBuffer = LOCAL_PROXY_H264E_FreeBuffer;
 	pHandle->AllocateBuffer = LOCAL_PROXY_H264E_AllocateBuffer;
+	if (eError == OMX_ErrorNone)
+		eError = PROXY_VENC_ColorConvInit(hComponent, mEnableVFR ?
+		    ComponentPrivateEmptyThisBuffer : LOCAL_PROXY_H264E_EmptyThisBuffer);
 #endif
 
 	if(mEnableVFR)
@@ -716,8 +715,7 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	OMX_U32 nFilledLen, nAllocLen;
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
-	TIMM_OSAL_ERRORTYPE eOSALStatus = TIMM_OSAL_ERR_NONE;
-	OMX_U32 nBufIndex = 0, nSize=0, nRet=0;
+	OMX_U32 nBufIndex = 0, nRet=0;
 #endif
 #ifdef ENABLE_GRALLOC_BUFFERS
 	OMX_PTR pAuxBuf0 = NULL, pAuxBuf1 = NULL;
@@ -735,6 +733,10 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+
+	/* Converted and submitted by the color conversion stage */
+	if (PROXY_VENC_QueueEmptyThisBuffer(hComponent, pBufferHdr) == OMX_TRUE)
+		return OMX_ErrorNone;
 #endif
 
 	tParamStruct.nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
@@ -833,25 +835,18 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 			if (pProxy->bAndroidOpaqueFormat && pGrallocHandle->iFormat != HAL_PIXEL_FORMAT_TI_NV12)
 			{
-				/* Dequeue NV12 buffer for encoder */
-				eOSALStatus = TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
-						                     sizeof(OMX_PTR), (TIMM_OSAL_U32 *)(&nSize),
-						                     TIMM_OSAL_SUSPEND);
-				PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, NULL);
+				/* Dequeue NV12 buffer for encoder, held until its EBD */
+				eError = PROXY_VENC_AcquireSlot(hComponent, pBufferHdr, &nBufIndex);
+				PROXY_assert(eError == OMX_ErrorNone, eError, NULL);
 
 				if(nFilledLen != 0)
 				{
 				    /* Get NV12 data after colorconv*/
-				    nRet = COLORCONVERT_PlatformOpaqueToNV12(pProxy->hCC, (void **) &pGrallocHandle, (void **) &pProxy->gralloc_handle[nBufIndex],
-									 pGrallocHandle->iWidth,
-									 pGrallocHandle->iHeight,
-									 4096, COLORCONVERT_BUFTYPE_GRALLOCOPAQUE,
-									 COLORCONVERT_BUFTYPE_GRALLOCOPAQUE );
+				    nRet = PROXY_VENC_ConvertToNV12(hComponent, pGrallocHandle,
+								    pProxy->gralloc_handle[nBufIndex]);
 
 				    if(nRet != 0)
 				    {
-					    eOSALStatus = TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nBufIndex,
-						                     sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
 					    PROXY_assert(0, OMX_ErrorBadParameter, "Color conversion routine failed");
 				    }
 				    fds[0] = pProxy->gralloc_handle[nBufIndex]->fd[0];
@@ -883,22 +878,15 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 #endif
 	}
 
+	/* The NV12 buffer goes back to the pipe on EBD, see
+	 * PROXY_VENC_EmptyBufferDone() */
 	eError = PROXY_EmptyThisBuffer(hComponent, pBufferHdr);
-#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
-	if (pProxy->bAndroidOpaqueFormat
-#ifdef ENABLE_GRALLOC_BUFFERS
-&& pGrallocHandle != NULL && pGrallocHandle->iFormat != HAL_PIXEL_FORMAT_TI_NV12
-#endif
-)
-	{
-		/*Write buffer to end of pipe for re-circulation for future ETB()*/
-		eOSALStatus = TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nBufIndex,
-					    sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
-		PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, "Pipe write failed");
-	}
-#endif
 
 EXIT:
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+	if (eError != OMX_ErrorNone && pBufferHdr != NULL && pProxy != NULL)
+		PROXY_VENC_ReleaseSlot(hComponent, pBufferHdr);
+#endif
 	if( pBufferHdr!=NULL && pCompPrv!=NULL)
 	{
 		if(pCompPrv->proxyPortBuffers[pBufferHdr->nInputPortIndex].proxyBufferType == EncoderMetadataPointers)
@@ -970,7 +958,7 @@ static OMX_ERRORTYPE LOCAL_PROXY_H264E_FreeBuffer(OMX_IN OMX_HANDLETYPE hCompone
 		if(nCount)
 		{
 			TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
-					       sizeof(OMX_PTR), (TIMM_OSAL_U32 *)&nSize, TIMM_OSAL_NO_SUSPEND);
+					       sizeof(OMX_U32), (TIMM_OSAL_U32 *)&nSize, TIMM_OSAL_NO_SUSPEND);
 		}
 	}
 
@@ -1023,6 +1011,8 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_ComponentDeInit(OMX_HANDLETYPE hComponent)
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
 
+	PROXY_VENC_ColorConvDeInit(hComponent);
+
 	if(pProxy->hBufPipe != NULL)
 	{
 		eOSALStatus = TIMM_OSAL_DeletePipe(pProxy->hBufPipe);
@@ -1087,27 +1077,6 @@ int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv)
 	return nErr;
 }
 
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC,
-				      void *pSrc[COLORCONVERT_MAX_SUB_BUFFERS],
-				      void *pDst[COLORCONVERT_MAX_SUB_BUFFERS],
-				      int nWidth, int nHeight, __unused int nStride,
-				      int nSrcBufType,int nDstBufType)
-{
-	IMG_gralloc_module_public_t const* module = hCC;
-	int nErr = -1;
-
-	if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_VIRTUAL))
-	{
-		nErr = module->Blit(module, pSrc[0], pDst, HAL_PIXEL_FORMAT_TI_NV12);
-	}
-	else if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE ))
-	{
-		nErr = module->Blit2(module, pSrc[0], pDst[0], nWidth, nHeight, 0, 0);
-	}
-
-	return nErr;
-}
-
 int COLORCONVERT_close(__unused void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv)
 {
 	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
@@ -342,8 +342,8 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pComponentPrivate->pCompProxyPrv;
 
 	/* Create Pipe of for encoder input buffers */
-	eOSALStatus = TIMM_OSAL_CreatePipe(&pProxy->hBufPipe, sizeof(OMX_U32),
-					   OMX_H264VE_NUM_INTERNAL_BUF, 1);
+	eOSALStatus = TIMM_OSAL_CreatePipe(&pProxy->hBufPipe,
+					   OMX_H264VE_NUM_INTERNAL_BUF * sizeof(OMX_U32), sizeof(OMX_U32), 1);
 	PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE,
 			OMX_ErrorInsufficientResources,
 			"Pipe creation failed");
@@ -837,7 +837,7 @@ OMX_ERRORTYPE LOCAL_PROXY_H264ESECURE_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 			{
 				/* Dequeue NV12 buffer for encoder */
 				eOSALStatus = TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
-						                     sizeof(OMX_PTR), (TIMM_OSAL_U32 *)(&nSize),
+						                     sizeof(OMX_U32), (TIMM_OSAL_U32 *)(&nSize),
 						                     TIMM_OSAL_SUSPEND);
 				PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, NULL);
 
@@ -972,7 +972,7 @@ static OMX_ERRORTYPE LOCAL_PROXY_H264ESECURE_FreeBuffer(OMX_IN OMX_HANDLETYPE hC
 		if(nCount)
 		{
 			TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
-					       sizeof(OMX_PTR), (TIMM_OSAL_U32 *)&nSize, TIMM_OSAL_NO_SUSPEND);
+					       sizeof(OMX_U32), (TIMM_OSAL_U32 *)&nSize, TIMM_OSAL_NO_SUSPEND);
 		}
 	}
 
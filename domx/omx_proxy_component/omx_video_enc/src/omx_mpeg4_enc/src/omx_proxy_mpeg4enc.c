@@ -121,17 +121,7 @@ OMX_U16 nBFrames = 0; /* Number of B Frames in H264 Encoder */
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 #define OMX_MPEG4E_NUM_INTERNAL_BUF (8)
 
-#define COLORCONVERT_MAX_SUB_BUFFERS (3)
-
-#define COLORCONVERT_BUFTYPE_VIRTUAL (0x0)
-#define COLORCONVERT_BUFTYPE_ION     (0x1)
-#define COLORCONVERT_BUFTYPE_GRALLOCOPAQUE (0x2)
-
 int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv);
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC, void *pSrc[],
-				      void *pDst[], int nWidth,
-				      int nHeight, int nStride,
-				      int nSrcBufType, int nDstBufType);
 int COLORCONVERT_close(void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv);
 
 static OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
@@ -255,6 +245,12 @@ static OMX_ERRORTYPE ComponentPrivateEmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	PROXY_assert(hComponent != NULL, OMX_ErrorInsufficientResources,"Null component handle received in EmptyThisBuffer");
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 	PROXY_assert(pCompPrv != NULL, OMX_ErrorInsufficientResources,"Pointer to Null component private structure received in EmptyThisBuffer");
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+	/* A queued frame comes back here from the color conversion stage,
+	 * so that the frame rate changes after the frames queued before it */
+	if (PROXY_VENC_QueueEmptyThisBuffer(hComponent, pBufferHdr) == OMX_TRUE)
+		return OMX_ErrorNone;
+#endif
         if(pCompPrv->proxyPortBuffers[0].proxyBufferType == EncoderMetadataPointers) {
 		OMX_U32 *pTempBuffer;
 		OMX_U32 nMetadataBufferType;
@@ -340,8 +336,8 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pComponentPrivate->pCompProxyPrv;
 
 	/* Create Pipe of for encoder input buffers */
-	eOSALStatus = TIMM_OSAL_CreatePipe(&pProxy->hBufPipe, sizeof(OMX_U32),
-					   OMX_MPEG4E_NUM_INTERNAL_BUF, 1);
+	eOSALStatus = TIMM_OSAL_CreatePipe(&pProxy->hBufPipe,
+					   OMX_MPEG4E_NUM_INTERNAL_BUF * sizeof(OMX_U32), sizeof(OMX_U32), 1);
 	PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE,
 			OMX_ErrorInsufficientResources,
 			"Pipe creation failed");
@@ -363,6 +359,11 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	pHandle->ComponentDeInit = LOCAL_PROXY_MPEG4E_ComponentDeInit;
 	pHandle->FreeBuffer = LOCAL_PROXY_MPEG4E_FreeBuffer;
 	pHandle->AllocateBuffer = LOCAL_PROXY_MPEG4E_AllocateBuffer;
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+	if (eError == OMX_ErrorNone)
+		eError = PROXY_VENC_ColorConvInit(hComponent, mEnableVFR ?
+		    ComponentPrivateEmptyThisBuffer : LOCAL_PROXY_MPEG4E_EmptyThisBuffer);
+#endif
 
 	pComponentPrivate->IsLoadedState = OMX_TRUE;
 	pHandle->EmptyThisBuffer = LOCAL_PROXY_MPEG4E_EmptyThisBuffer;
@@ -698,8 +699,7 @@ OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	OMX_U32 nFilledLen, nAllocLen;
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
-	TIMM_OSAL_ERRORTYPE eOSALStatus = TIMM_OSAL_ERR_NONE;
-	OMX_U32 nBufIndex = 0, nSize=0, nRet=0;
+	OMX_U32 nBufIndex = 0, nRet=0;
 #endif
 #ifdef ENABLE_GRALLOC_BUFFERS
 	OMX_PTR pAuxBuf0 = NULL, pAuxBuf1 = NULL;
@@ -716,6 +716,10 @@ OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+
+	/* Converted and submitted by the color conversion stage */
+	if (PROXY_VENC_QueueEmptyThisBuffer(hComponent, pBufferHdr) == OMX_TRUE)
+		return OMX_ErrorNone;
 #endif
 
 	tParamStruct.nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
@@ -798,26 +802,19 @@ OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 			if (pProxy->bAndroidOpaqueFormat)
 			{
-                                DOMX_DEBUG(" ++TIMM_OSAL_ReadFromPipe() ");
-				/* Dequeue NV12 buffer for encoder */
-				eOSALStatus = TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
-						                     sizeof(OMX_PTR), (TIMM_OSAL_U32 *)(&nSize),
-						                     TIMM_OSAL_SUSPEND);
-				PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, NULL);
+                                DOMX_DEBUG(" ++PROXY_VENC_AcquireSlot() ");
+				/* Dequeue NV12 buffer for encoder, held until its EBD */
+				eError = PROXY_VENC_AcquireSlot(hComponent, pBufferHdr, &nBufIndex);
+				PROXY_assert(eError == OMX_ErrorNone, eError, NULL);
 
 				/* Get NV12 data after colorconv*/
-				nRet = COLORCONVERT_PlatformOpaqueToNV12(pProxy->hCC, (void **) &pGrallocHandle, (void **) &pProxy->gralloc_handle[nBufIndex],
-									 pGrallocHandle->iWidth,
-									 pGrallocHandle->iHeight,
-									 4096, COLORCONVERT_BUFTYPE_GRALLOCOPAQUE,
-									 COLORCONVERT_BUFTYPE_GRALLOCOPAQUE );
+				nRet = PROXY_VENC_ConvertToNV12(hComponent, pGrallocHandle,
+								pProxy->gralloc_handle[nBufIndex]);
 				if(nRet != 0)
 				{
-					eOSALStatus = TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nBufIndex,
-						                     sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
 					PROXY_assert(0, OMX_ErrorBadParameter, "Color conversion routine failed");
 				}
-                                DOMX_DEBUG(" --COLORCONVERT_PlatformOpaqueToNV12() ");
+                                DOMX_DEBUG(" --PROXY_VENC_ConvertToNV12() ");
 
 				/* Update pBufferHdr with NV12 buffers for OMX component */
 				fds[0] = pProxy->gralloc_handle[nBufIndex]->fd[0];
@@ -844,18 +841,15 @@ OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 #endif
 	}
 
+	/* The NV12 buffer goes back to the pipe on EBD, see
+	 * PROXY_VENC_EmptyBufferDone() */
 	eError = PROXY_EmptyThisBuffer(hComponent, pBufferHdr);
-#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
-	if (pProxy->bAndroidOpaqueFormat)
-	{
-		/*Write buffer to end of pipe for re-circulation for future ETB()*/
-		eOSALStatus = TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nBufIndex,
-					    sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
-		PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, "Pipe write failed");
-	}
-#endif
 
 EXIT:
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+	if (eError != OMX_ErrorNone && pBufferHdr != NULL && pProxy != NULL)
+		PROXY_VENC_ReleaseSlot(hComponent, pBufferHdr);
+#endif
 		if( pBufferHdr!=NULL && pCompPrv!=NULL)
 	    {
 		    if(pCompPrv->proxyPortBuffers[pBufferHdr->nInputPortIndex].proxyBufferType == EncoderMetadataPointers)
@@ -962,7 +956,7 @@ static OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_FreeBuffer(OMX_IN OMX_HANDLETYPE hCompon
 		if(nCount)
 		{
 			TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
-					       sizeof(OMX_PTR), (TIMM_OSAL_U32 *)&nSize, TIMM_OSAL_NO_SUSPEND);
+					       sizeof(OMX_U32), (TIMM_OSAL_U32 *)&nSize, TIMM_OSAL_NO_SUSPEND);
 		}
 	}
 
@@ -986,6 +980,8 @@ OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_ComponentDeInit(OMX_HANDLETYPE hComponent)
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
 
+	PROXY_VENC_ColorConvDeInit(hComponent);
+
 	if(pProxy->hBufPipe != NULL)
 	{
 		eOSALStatus = TIMM_OSAL_DeletePipe(pProxy->hBufPipe);
@@ -1049,28 +1045,6 @@ int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv)
 	return nErr;
 }
 
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC,
-				      void *pSrc[COLORCONVERT_MAX_SUB_BUFFERS],
-				      void *pDst[COLORCONVERT_MAX_SUB_BUFFERS],
-				      int nWidth, int nHeight, __unused int nStride,
-				      int nSrcBufType,int nDstBufType)
-{
-	IMG_gralloc_module_public_t const* module = hCC;
-	int nErr = -1;
-
-	if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_VIRTUAL))
-	{
-		nErr = module->Blit(module, pSrc[0], pDst, HAL_PIXEL_FORMAT_TI_NV12);
-
-	}
-	else if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE ))
-	{
-		nErr = module->Blit2(module, pSrc[0], pDst[0], nWidth, nHeight, 0, 0);
-	}
-
-	return nErr;
-}
-
 int COLORCONVERT_close(__unused void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv)
 {
 	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ *  @file  omx_proxy_video_encoder.c
+ *         Color conversion pipeline shared by the encoder proxies.
+ *
+ *         Opaque (RGB gralloc) input frames are converted into one of the
+ *         NV12 buffers allocated by COLORCONVERT_AllocateBuffer(). With the
+ *         stage enabled, EmptyThisBuffer() of such a frame only reserves an
+ *         NV12 buffer and queues the frame; the stage thread converts and
+ *         submits it while the remote core is still encoding the previous
+ *         one. An NV12 buffer is held until the EmptyBufferDone() of the
+ *         frame it carries, so it is never overwritten while the encoder
+ *         reads it, and running out of them throttles the client.
+ *
+ *  @path domx/omx_proxy_component/omx_video_enc/src
+ *
+ *  @rev 1.0
+ */
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "omx_proxy_common.h"
+#include <timm_osal_interfaces.h>
+#include "omx_proxy_video_encoder.h"
+
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+
+/* Opaque gralloc handle of a metadata input buffer, NULL if the buffer
+ * carries anything the encoder can take directly */
+static IMG_native_handle_t *PROXY_VENC_OpaqueHandle(PROXY_COMPONENT_PRIVATE *
+    pCompPrv, OMX_BUFFERHEADERTYPE * pBufferHdr)
+{
+	OMX_U32 *pTempBuffer = (OMX_U32 *) pBufferHdr->pBuffer;
+	IMG_native_handle_t *pGrallocHandle;
+
+	if (pCompPrv->proxyPortBuffers[pBufferHdr->nInputPortIndex].
+	    proxyBufferType != EncoderMetadataPointers || pTempBuffer == NULL ||
+	    *pTempBuffer != kMetadataBufferTypeGrallocSource)
+	{
+		return NULL;
+	}
+
+	pGrallocHandle = *((IMG_native_handle_t **) (pTempBuffer + 1));
+	if (pGrallocHandle == NULL ||
+	    pGrallocHandle->iFormat == HAL_PIXEL_FORMAT_TI_NV12)
+	{
+		return NULL;
+	}
+
+	return pGrallocHandle;
+}
+
+static void PROXY_VENC_ReleaseIndex(OMX_PROXY_ENCODER_PRIVATE * pProxy,
+    OMX_U32 nIndex)
+{
+	OMX_S32 nSlot;
+
+	if (nIndex >= MAX_NUM_PROXY_BUFFERS)
+		return;
+
+	/* EBD and the error paths of ETB may race, only one gets the slot */
+	nSlot = __atomic_exchange_n(&pProxy->nBufSlot[nIndex], -1,
+	    __ATOMIC_ACQ_REL);
+	if (nSlot >= 0)
+	{
+		TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nSlot,
+		    sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
+	}
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_EmptyBufferDone()
+ * @brief Gives back the NV12 buffer of the frame, then lets the proxy
+ *        common layer return the buffer to the client.
+ */
+/* ===========================================================================*/
+static OMX_ERRORTYPE PROXY_VENC_EmptyBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_U32 remoteBufHdr, OMX_U32 nfilledLen, OMX_U32 nOffset, OMX_U32 nFlags)
+{
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy =
+	    (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+
+	PROXY_VENC_ReleaseIndex(pProxy,
+	    PROXY_BufListFindRemote(pCompPrv, remoteBufHdr));
+
+	return pProxy->proxyEmptyBufferDone(hComponent, remoteBufHdr,
+	    nfilledLen, nOffset, nFlags);
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_StageProcess()
+ * @brief Runs the ETB of the proxy for a queued frame. The client was told
+ *        the frame was accepted, so a failure is reported as an error
+ *        event and the buffer is handed back.
+ */
+/* ===========================================================================*/
+static void PROXY_VENC_StageProcess(void *pCtx, void *pJob)
+{
+	OMX_HANDLETYPE hComponent = (OMX_HANDLETYPE) pCtx;
+	OMX_BUFFERHEADERTYPE *pBufferHdr = (OMX_BUFFERHEADERTYPE *) pJob;
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy =
+	    (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+	OMX_ERRORTYPE eError;
+
+	eError = pProxy->pfnEmptyThisBuffer(hComponent, pBufferHdr);
+	if (eError != OMX_ErrorNone)
+	{
+		DOMX_ERROR("Queued EmptyThisBuffer of %p failed 0x%x",
+		    pBufferHdr, eError);
+		PROXY_VENC_ReleaseSlot(hComponent, pBufferHdr);
+		pCompPrv->tCBFunc.EventHandler(hComponent, pCompPrv->pILAppData,
+		    OMX_EventError, eError, 0, NULL);
+		pCompPrv->tCBFunc.EmptyBufferDone(hComponent,
+		    pCompPrv->pILAppData, pBufferHdr);
+	}
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_ColorConvInit()
+ * @brief Reads the color conversion knobs and hooks EBD and SendCommand.
+ *        Called by OMX_ComponentInit() after OMX_ProxyCommonInit().
+ *
+ *        DEBUG_DOMX_VENC_CC_THREADS or debug.domx.venc_cc_threads sets the
+ *        threads of the CPU converter, 0 converts with the GPU blitter.
+ *        DEBUG_DOMX_VENC_CC_ASYNC or debug.domx.venc_cc_async set to 0
+ *        converts synchronously in EmptyThisBuffer().
+ * @param pfnEmptyThisBuffer : ETB of the proxy, without the stage hook
+ * @return OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+OMX_ERRORTYPE PROXY_VENC_ColorConvInit(OMX_HANDLETYPE hComponent,
+    PROXY_VENC_EMPTYTHISBUFFER pfnEmptyThisBuffer)
+{
+	OMX_ERRORTYPE eError = OMX_ErrorNone;
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
+	OMX_S32 nThreads = OMX_ENC_CC_THREADS_DEFAULT;
+	OMX_S32 nAsync = 1;
+	char *val;
+	OMX_U32 i;
+
+	PROXY_require(hComp->pComponentPrivate != NULL, OMX_ErrorBadParameter,
+	    NULL);
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+	PROXY_require(pProxy != NULL, OMX_ErrorBadParameter, NULL);
+
+	val = getenv("DEBUG_DOMX_VENC_CC_THREADS");
+	if (val)
+	{
+		nThreads = strtol(val, NULL, 0);
+	}
+#ifdef _Android
+	else
+	{
+		char value[PROPERTY_VALUE_MAX];
+
+		if (property_get("debug.domx.venc_cc_threads", value, NULL) > 0)
+			nThreads = atoi(value);
+	}
+#endif
+
+	val = getenv("DEBUG_DOMX_VENC_CC_ASYNC");
+	if (val)
+	{
+		nAsync = strtol(val, NULL, 0);
+	}
+#ifdef _Android
+	else
+	{
+		char value[PROPERTY_VALUE_MAX];
+
+		if (property_get("debug.domx.venc_cc_async", value, NULL) > 0)
+			nAsync = atoi(value);
+	}
+#endif
+
+	if (nThreads < 0)
+		nThreads = 0;
+	if (nThreads > VENC_CONVERTER_MAX_THREADS)
+		nThreads = VENC_CONVERTER_MAX_THREADS;
+	DOMX_DEBUG("Color conversion: %d CPU threads, %s", nThreads,
+	    nAsync ? "pipelined" : "synchronous");
+
+	pProxy->nCCThreads = nThreads;
+	pProxy->bCCAsync = nAsync ? OMX_TRUE : OMX_FALSE;
+	pProxy->pfnEmptyThisBuffer = pfnEmptyThisBuffer;
+	for (i = 0; i < MAX_NUM_PROXY_BUFFERS; i++)
+		pProxy->nBufSlot[i] = -1;
+
+	pProxy->proxyEmptyBufferDone = pCompPrv->proxyEmptyBufferDone;
+	pCompPrv->proxyEmptyBufferDone = PROXY_VENC_EmptyBufferDone;
+	hComp->SendCommand = PROXY_VENC_SendCommand;
+
+      EXIT:
+	return eError;
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_ColorConvDeInit()
+ * @brief Submits what is still queued and stops the stage and converter
+ *        threads. Must run before the NV12 buffers and their pipe go away.
+ */
+/* ===========================================================================*/
+void PROXY_VENC_ColorConvDeInit(OMX_HANDLETYPE hComponent)
+{
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
+
+	if (pCompPrv == NULL || pCompPrv->pCompProxyPrv == NULL)
+		return;
+	pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+
+	VENC_StageDestroy(pProxy->hStage);
+	pProxy->hStage = NULL;
+	VENC_ConverterDestroy(pProxy->hConverter);
+	pProxy->hConverter = NULL;
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_QueueEmptyThisBuffer()
+ * @brief Hands an input frame to the stage. Once the stage runs, every
+ *        frame goes through it to keep them in order; opaque ones reserve
+ *        their NV12 buffer here, blocking while all of them are in use.
+ *        Frames arrive before the NV12 buffers are allocated, and all of
+ *        them if the stage is disabled, are left to the caller.
+ * @return OMX_TRUE if the frame was queued
+ */
+/* ===========================================================================*/
+OMX_BOOL PROXY_VENC_QueueEmptyThisBuffer(OMX_HANDLETYPE hComponent,
+    OMX_BUFFERHEADERTYPE * pBufferHdr)
+{
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy =
+	    (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+	OMX_U32 nSlot;
+
+	if (!pProxy->bCCAsync || !pProxy->bAndroidOpaqueFormat ||
+	    pProxy->gralloc_handle[0] == NULL ||
+	    pCompPrv->proxyPortBuffers[pBufferHdr->nInputPortIndex].
+	    proxyBufferType != EncoderMetadataPointers ||
+	    VENC_StageIsWorker(pProxy->hStage))
+	{
+		return OMX_FALSE;
+	}
+
+	if (pProxy->hStage == NULL)
+	{
+		pProxy->hStage = VENC_StageCreate(OMX_ENC_NUM_INTERNAL_BUF,
+		    PROXY_VENC_StageProcess, hComponent);
+		if (pProxy->hStage == NULL)
+		{
+			DOMX_ERROR("No color conversion stage, converting in ETB");
+			pProxy->bCCAsync = OMX_FALSE;
+			return OMX_FALSE;
+		}
+	}
+
+	if (PROXY_VENC_OpaqueHandle(pCompPrv, pBufferHdr) != NULL &&
+	    PROXY_VENC_AcquireSlot(hComponent, pBufferHdr, &nSlot) != OMX_ErrorNone)
+	{
+		return OMX_FALSE;
+	}
+
+	VENC_StageSubmit(pProxy->hStage, pBufferHdr);
+
+	return OMX_TRUE;
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_AcquireSlot()
+ * @brief NV12 buffer for an opaque input frame, the one reserved when it
+ *        was queued or the next free one.
+ * @param pnSlot : Index into gralloc_handle
+ * @return OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+OMX_ERRORTYPE PROXY_VENC_AcquireSlot(OMX_HANDLETYPE hComponent,
+    OMX_BUFFERHEADERTYPE * pBufferHdr, OMX_U32 * pnSlot)
+{
+	OMX_ERRORTYPE eError = OMX_ErrorNone;
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy =
+	    (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+	TIMM_OSAL_ERRORTYPE eOSALStatus = TIMM_OSAL_ERR_NONE;
+	OMX_U32 nIndex, nSize = 0;
+	OMX_S32 nSlot;
+
+	nIndex = PROXY_BufListFindLocal(pCompPrv, pBufferHdr);
+	PROXY_assert(nIndex != PROXY_BUFFER_NONE, OMX_ErrorBadParameter,
+	    "Unknown input buffer header");
+
+	nSlot = __atomic_load_n(&pProxy->nBufSlot[nIndex], __ATOMIC_ACQUIRE);
+	if (nSlot < 0)
+	{
+		eOSALStatus = TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nSlot,
+		    sizeof(OMX_U32), (TIMM_OSAL_U32 *) &nSize, TIMM_OSAL_SUSPEND);
+		PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE,
+		    OMX_ErrorBadParameter, "Pipe read failed");
+		__atomic_store_n(&pProxy->nBufSlot[nIndex], nSlot,
+		    __ATOMIC_RELEASE);
+	}
+	*pnSlot = nSlot;
+
+      EXIT:
+	return eError;
+}
+
+/* Gives back the NV12 buffer of a frame that will not see an EBD */
+void PROXY_VENC_ReleaseSlot(OMX_HANDLETYPE hComponent,
+    OMX_BUFFERHEADERTYPE * pBufferHdr)
+{
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+
+	PROXY_VENC_ReleaseIndex(
+	    (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv,
+	    PROXY_BufListFindLocal(pCompPrv, pBufferHdr));
+}
+
+/* Converts on the CPU, returns 1 if the source format is not handled */
+static int PROXY_VENC_CpuToNV12(OMX_PROXY_ENCODER_PRIVATE * pProxy,
+    IMG_native_handle_t * pSrc, IMG_native_handle_t * pDst)
+{
+	IMG_gralloc_module_public_t const *module =
+	    (IMG_gralloc_module_public_t const *) pProxy->hCC;
+	void *pSrcAddr = NULL;
+	void *pDstAddr[2] = { NULL, NULL };
+	OMX_U8 *pUV;
+	int bBGR, nErr;
+
+	switch (pSrc->iFormat)
+	{
+	case HAL_PIXEL_FORMAT_RGBA_8888:
+	case HAL_PIXEL_FORMAT_RGBX_8888:
+		bBGR = 0;
+		break;
+	case HAL_PIXEL_FORMAT_BGRA_8888:
+	case HAL_PIXEL_FORMAT_BGRX_8888:
+		bBGR = 1;
+		break;
+	default:
+		return 1;
+	}
+
+	if (pProxy->hConverter == NULL)
+	{
+		pProxy->hConverter = VENC_ConverterCreate(pProxy->nCCThreads);
+		if (pProxy->hConverter == NULL)
+		{
+			DOMX_ERROR("No CPU color converter, using the GPU");
+			pProxy->nCCThreads = 0;
+			return 1;
+		}
+	}
+
+	nErr = module->base.lock(&module->base, (buffer_handle_t) pSrc,
+	    GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, pSrc->iWidth, pSrc->iHeight,
+	    &pSrcAddr);
+	if (nErr != 0)
+		return nErr;
+
+	nErr = module->base.lock(&module->base, (buffer_handle_t) pDst,
+	    GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, pSrc->iWidth, pSrc->iHeight,
+	    pDstAddr);
+	if (nErr != 0)
+	{
+		module->base.unlock(&module->base, (buffer_handle_t) pSrc);
+		return nErr;
+	}
+
+	/* the chroma plane follows the luma plane of the 2D container */
+	pUV = pDstAddr[1] ? (OMX_U8 *) pDstAddr[1] :
+	    (OMX_U8 *) pDstAddr[0] + pDst->iHeight * OMX_ENC_NV12_STRIDE;
+
+	VENC_ConverterRGBToNV12(pProxy->hConverter, (const uint8_t *) pSrcAddr,
+	    ALIGN(pSrc->iWidth, HW_ALIGN) * 4, bBGR, (uint8_t *) pDstAddr[0],
+	    OMX_ENC_NV12_STRIDE, pUV, OMX_ENC_NV12_STRIDE, pSrc->iWidth,
+	    pSrc->iHeight);
+
+	module->base.unlock(&module->base, (buffer_handle_t) pDst);
+	module->base.unlock(&module->base, (buffer_handle_t) pSrc);
+
+	return 0;
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_ConvertToNV12()
+ * @brief Converts an opaque frame into one of the NV12 buffers, on the CPU
+ *        for 32 bit RGB sources unless disabled, with the GPU blitter
+ *        otherwise.
+ * @return 0 = Successful
+ */
+/* ===========================================================================*/
+int PROXY_VENC_ConvertToNV12(OMX_HANDLETYPE hComponent,
+    IMG_native_handle_t * pSrc, IMG_native_handle_t * pDst)
+{
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy =
+	    (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+	IMG_gralloc_module_public_t const *module =
+	    (IMG_gralloc_module_public_t const *) pProxy->hCC;
+	int nErr;
+
+	if (pProxy->nCCThreads > 0)
+	{
+		nErr = PROXY_VENC_CpuToNV12(pProxy, pSrc, pDst);
+		if (nErr != 1)
+			return nErr;
+	}
+
+	return module->Blit2(module, (buffer_handle_t) pSrc,
+	    (buffer_handle_t) pDst, pSrc->iWidth, pSrc->iHeight, 0, 0);
+}
+
+/* ===========================================================================*/
+/**
+ * @name PROXY_VENC_SendCommand()
+ * @brief Submits the queued frames before any command, so that a flush or
+ *        state change finds them on the remote core.
+ */
+/* ===========================================================================*/
+OMX_ERRORTYPE PROXY_VENC_SendCommand(OMX_IN OMX_HANDLETYPE hComponent,
+    OMX_IN OMX_COMMANDTYPE eCmd, OMX_IN OMX_U32 nParam,
+    OMX_IN OMX_PTR pCmdData)
+{
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	PROXY_COMPONENT_PRIVATE *pCompPrv =
+	    (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	OMX_PROXY_ENCODER_PRIVATE *pProxy = NULL;
+
+	if (pCompPrv != NULL && pCompPrv->pCompProxyPrv != NULL)
+	{
+		pProxy = (OMX_PROXY_ENCODER_PRIVATE *) pCompPrv->pCompProxyPrv;
+		if (pProxy->hStage != NULL)
+			VENC_StageDrain(pProxy->hStage);
+	}
+
+	return PROXY_SendCommand(hComponent, eCmd, nParam, pCmdData);
+}
+
+#endif
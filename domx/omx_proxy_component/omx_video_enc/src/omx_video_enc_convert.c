@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ *  @file  omx_video_enc_convert.c
+ *         Threaded RGB to NV12 converter and the stage that runs it ahead
+ *         of the encoder, see omx_video_enc_convert.h.
+ *
+ *  @path domx/omx_proxy_component/omx_video_enc/src
+ *
+ *  @rev 1.0
+ */
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yuv_convert.h"
+#include "omx_video_enc_convert.h"
+
+typedef struct VENC_CONVERTER_WORKER
+{
+	VENC_CONVERTER *hConv;
+	int nIndex;
+	pthread_t tThread;
+} VENC_CONVERTER_WORKER;
+
+/* ===========================================================================*/
+/**
+ * struct VENC_CONVERTER
+ *
+ * @param nGeneration : Bumped for every conversion, wakes the helpers
+ * @param nPending : Helpers still converting their band
+ * @param nBand : Rows per band, even so that no chroma row is shared
+ */
+/* ===========================================================================*/
+struct VENC_CONVERTER
+{
+	pthread_mutex_t tLock;
+	pthread_cond_t tStart;
+	pthread_cond_t tDone;
+	int nThreads;
+	int nStarted;
+	unsigned int nGeneration;
+	int nPending;
+	int bExit;
+	VENC_CONVERTER_WORKER tWorkers[VENC_CONVERTER_MAX_THREADS];
+
+	const uint8_t *pSrc;
+	int nSrcStride;
+	int bBGR;
+	uint8_t *pY;
+	int nYStride;
+	uint8_t *pUV;
+	int nUVStride;
+	int nWidth;
+	int nHeight;
+	int nBand;
+};
+
+/* ===========================================================================*/
+/**
+ * struct VENC_STAGE
+ *
+ * @param ppJobs : Ring of nDepth queued jobs starting at nHead
+ * @param bBusy : A job is being processed outside of the lock
+ */
+/* ===========================================================================*/
+struct VENC_STAGE
+{
+	pthread_mutex_t tLock;
+	pthread_cond_t tWork;
+	pthread_cond_t tSpace;
+	pthread_cond_t tIdle;
+	void **ppJobs;
+	int nDepth;
+	int nHead;
+	int nCount;
+	int bBusy;
+	int bExit;
+	pthread_t tThread;
+	VENC_STAGE_PROCESS pfnProcess;
+	void *pCtx;
+};
+
+/*--------------------Converter---------------------------------*/
+
+static void VENC_ConvertBand(VENC_CONVERTER * hConv, int nIndex)
+{
+	int nStart = nIndex * hConv->nBand;
+	int nRows = hConv->nHeight - nStart;
+
+	if (nRows <= 0)
+		return;
+	if (nRows > hConv->nBand)
+		nRows = hConv->nBand;
+
+	if (hConv->bBGR)
+		yuv_bgra_to_nv12(hConv->pSrc + nStart * hConv->nSrcStride,
+		    hConv->nSrcStride, hConv->pY + nStart * hConv->nYStride,
+		    hConv->nYStride, hConv->pUV + (nStart / 2) * hConv->nUVStride,
+		    hConv->nUVStride, hConv->nWidth, nRows);
+	else
+		yuv_rgba_to_nv12(hConv->pSrc + nStart * hConv->nSrcStride,
+		    hConv->nSrcStride, hConv->pY + nStart * hConv->nYStride,
+		    hConv->nYStride, hConv->pUV + (nStart / 2) * hConv->nUVStride,
+		    hConv->nUVStride, hConv->nWidth, nRows);
+}
+
+static void *VENC_ConverterThread(void *arg)
+{
+	VENC_CONVERTER_WORKER *pWorker = (VENC_CONVERTER_WORKER *) arg;
+	VENC_CONVERTER *hConv = pWorker->hConv;
+	/* not read from hConv, a conversion may start before this runs */
+	unsigned int nSeen = 0;
+
+	pthread_mutex_lock(&hConv->tLock);
+	for (;;)
+	{
+		while (!hConv->bExit && hConv->nGeneration == nSeen)
+			pthread_cond_wait(&hConv->tStart, &hConv->tLock);
+		if (hConv->bExit)
+			break;
+		nSeen = hConv->nGeneration;
+		pthread_mutex_unlock(&hConv->tLock);
+
+		VENC_ConvertBand(hConv, pWorker->nIndex);
+
+		pthread_mutex_lock(&hConv->tLock);
+		if (--hConv->nPending == 0)
+			pthread_cond_signal(&hConv->tDone);
+	}
+	pthread_mutex_unlock(&hConv->tLock);
+
+	return NULL;
+}
+
+VENC_CONVERTER *VENC_ConverterCreate(int nThreads)
+{
+	VENC_CONVERTER *hConv = NULL;
+	int i;
+
+	if (nThreads < 1 || nThreads > VENC_CONVERTER_MAX_THREADS)
+		return NULL;
+
+	hConv = (VENC_CONVERTER *) calloc(1, sizeof(VENC_CONVERTER));
+	if (hConv == NULL)
+		return NULL;
+
+	pthread_mutex_init(&hConv->tLock, NULL);
+	pthread_cond_init(&hConv->tStart, NULL);
+	pthread_cond_init(&hConv->tDone, NULL);
+	hConv->nThreads = nThreads;
+
+	for (i = 1; i < nThreads; i++)
+	{
+		hConv->tWorkers[i].hConv = hConv;
+		hConv->tWorkers[i].nIndex = i;
+		if (pthread_create(&hConv->tWorkers[i].tThread, NULL,
+			VENC_ConverterThread, &hConv->tWorkers[i]) != 0)
+		{
+			VENC_ConverterDestroy(hConv);
+			return NULL;
+		}
+		hConv->nStarted = i;
+	}
+
+	return hConv;
+}
+
+void VENC_ConverterDestroy(VENC_CONVERTER * hConv)
+{
+	int i;
+
+	if (hConv == NULL)
+		return;
+
+	pthread_mutex_lock(&hConv->tLock);
+	hConv->bExit = 1;
+	pthread_cond_broadcast(&hConv->tStart);
+	pthread_mutex_unlock(&hConv->tLock);
+
+	for (i = 1; i <= hConv->nStarted; i++)
+		pthread_join(hConv->tWorkers[i].tThread, NULL);
+
+	pthread_cond_destroy(&hConv->tDone);
+	pthread_cond_destroy(&hConv->tStart);
+	pthread_mutex_destroy(&hConv->tLock);
+	free(hConv);
+}
+
+void VENC_ConverterRGBToNV12(VENC_CONVERTER * hConv, const uint8_t * pSrc,
+    int nSrcStride, int bBGR, uint8_t * pY, int nYStride, uint8_t * pUV,
+    int nUVStride, int nWidth, int nHeight)
+{
+	pthread_mutex_lock(&hConv->tLock);
+	hConv->pSrc = pSrc;
+	hConv->nSrcStride = nSrcStride;
+	hConv->bBGR = bBGR;
+	hConv->pY = pY;
+	hConv->nYStride = nYStride;
+	hConv->pUV = pUV;
+	hConv->nUVStride = nUVStride;
+	hConv->nWidth = nWidth;
+	hConv->nHeight = nHeight;
+	hConv->nBand = ((nHeight + hConv->nThreads - 1) / hConv->nThreads + 1) & ~1;
+	hConv->nPending = hConv->nThreads - 1;
+	hConv->nGeneration++;
+	pthread_cond_broadcast(&hConv->tStart);
+	pthread_mutex_unlock(&hConv->tLock);
+
+	VENC_ConvertBand(hConv, 0);
+
+	pthread_mutex_lock(&hConv->tLock);
+	while (hConv->nPending > 0)
+		pthread_cond_wait(&hConv->tDone, &hConv->tLock);
+	pthread_mutex_unlock(&hConv->tLock);
+}
+
+/*--------------------Stage-------------------------------------*/
+
+static void *VENC_StageThread(void *arg)
+{
+	VENC_STAGE *hStage = (VENC_STAGE *) arg;
+	void *pJob;
+
+	pthread_mutex_lock(&hStage->tLock);
+	for (;;)
+	{
+		while (hStage->nCount == 0 && !hStage->bExit)
+			pthread_cond_wait(&hStage->tWork, &hStage->tLock);
+		if (hStage->nCount == 0)
+			break;
+
+		pJob = hStage->ppJobs[hStage->nHead];
+		hStage->nHead = (hStage->nHead + 1) % hStage->nDepth;
+		hStage->nCount--;
+		hStage->bBusy = 1;
+		pthread_cond_signal(&hStage->tSpace);
+		pthread_mutex_unlock(&hStage->tLock);
+
+		hStage->pfnProcess(hStage->pCtx, pJob);
+
+		pthread_mutex_lock(&hStage->tLock);
+		hStage->bBusy = 0;
+		if (hStage->nCount == 0)
+			pthread_cond_broadcast(&hStage->tIdle);
+	}
+	pthread_mutex_unlock(&hStage->tLock);
+
+	return NULL;
+}
+
+VENC_STAGE *VENC_StageCreate(int nDepth, VENC_STAGE_PROCESS pfnProcess,
+    void *pCtx)
+{
+	VENC_STAGE *hStage = NULL;
+
+	if (nDepth < 1 || pfnProcess == NULL)
+		return NULL;
+
+	hStage = (VENC_STAGE *) calloc(1, sizeof(VENC_STAGE));
+	if (hStage == NULL)
+		return NULL;
+	hStage->ppJobs = (void **) calloc(nDepth, sizeof(void *));
+	if (hStage->ppJobs == NULL)
+	{
+		free(hStage);
+		return NULL;
+	}
+
+	pthread_mutex_init(&hStage->tLock, NULL);
+	pthread_cond_init(&hStage->tWork, NULL);
+	pthread_cond_init(&hStage->tSpace, NULL);
+	pthread_cond_init(&hStage->tIdle, NULL);
+	hStage->nDepth = nDepth;
+	hStage->pfnProcess = pfnProcess;
+	hStage->pCtx = pCtx;
+
+	if (pthread_create(&hStage->tThread, NULL, VENC_StageThread,
+		hStage) != 0)
+	{
+		pthread_cond_destroy(&hStage->tIdle);
+		pthread_cond_destroy(&hStage->tSpace);
+		pthread_cond_destroy(&hStage->tWork);
+		pthread_mutex_destroy(&hStage->tLock);
+		free(hStage->ppJobs);
+		free(hStage);
+		return NULL;
+	}
+
+	return hStage;
+}
+
+void VENC_StageDestroy(VENC_STAGE * hStage)
+{
+	if (hStage == NULL)
+		return;
+
+	/* the thread only leaves once the queue is empty */
+	pthread_mutex_lock(&hStage->tLock);
+	hStage->bExit = 1;
+	pthread_cond_signal(&hStage->tWork);
+	pthread_mutex_unlock(&hStage->tLock);
+	pthread_join(hStage->tThread, NULL);
+
+	pthread_cond_destroy(&hStage->tIdle);
+	pthread_cond_destroy(&hStage->tSpace);
+	pthread_cond_destroy(&hStage->tWork);
+	pthread_mutex_destroy(&hStage->tLock);
+	free(hStage->ppJobs);
+	free(hStage);
+}
+
+void VENC_StageSubmit(VENC_STAGE * hStage, void *pJob)
+{
+	pthread_mutex_lock(&hStage->tLock);
+	while (hStage->nCount == hStage->nDepth)
+		pthread_cond_wait(&hStage->tSpace, &hStage->tLock);
+	hStage->ppJobs[(hStage->nHead + hStage->nCount) % hStage->nDepth] = pJob;
+	hStage->nCount++;
+	pthread_cond_signal(&hStage->tWork);
+	pthread_mutex_unlock(&hStage->tLock);
+}
+
+void VENC_StageDrain(VENC_STAGE * hStage)
+{
+	pthread_mutex_lock(&hStage->tLock);
+	while (hStage->nCount > 0 || hStage->bBusy)
+		pthread_cond_wait(&hStage->tIdle, &hStage->tLock);
+	pthread_mutex_unlock(&hStage->tLock);
+}
+
+int VENC_StageIsWorker(VENC_STAGE * hStage)
+{
+	return hStage != NULL && pthread_equal(pthread_self(), hStage->tThread);
+}
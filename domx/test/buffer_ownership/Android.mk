@@ -0,0 +1,23 @@
+LOCAL_PATH:= $(call my-dir)
+
+# OMX buffer ownership conformance test for the DOMX proxy, run with
+# synchronous and with windowed asynchronous ETB/FTB
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= buffer_ownership_test.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../omx_core/inc \
+	frameworks/native/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES:= \
+	libOMX_Core \
+	libcutils \
+	liblog
+
+LOCAL_CFLAGS += -Wall -O2 $(ANDROID_API_CFLAGS)
+
+LOCAL_MODULE:= domx_buffer_ownership_test
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
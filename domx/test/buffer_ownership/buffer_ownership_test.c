@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *  @file  buffer_ownership_test.c
+ *         Checks that a DOMX proxy component keeps to the OMX buffer
+ *         ownership rules, first with synchronous and then with windowed
+ *         asynchronous EmptyThisBuffer/FillThisBuffer.
+ *
+ *  Every buffer is tracked as owned by the client or by the component. The
+ *  test streams all buffers through the component, resubmitting them as
+ *  they come back, flushes both ports in the middle of the stream and goes
+ *  back to Idle at the end. It fails if
+ *   - a buffer comes back that the component does not own, or on the
+ *     wrong callback,
+ *   - a flush or the transition to Idle completes while the component
+ *     still owns buffers of the affected ports,
+ *   - a submission that returned an error is later returned anyway.
+ *  Errors reported through the EventHandler are counted, the buffer they
+ *  concern must still come back.
+ *
+ *  The RPC window is picked up from DEBUG_DOMX_RPC_WINDOW when the
+ *  component is created, 0 meaning synchronous calls.
+ *
+ *  Usage: domx_buffer_ownership_test [-c component] [-n buffers to stream]
+ *                                    [-w async window]
+ */
+
+/****************************************************************
+*  INCLUDE FILES
+****************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*-------program files ----------------------------------------*/
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+
+/****************************************************************
+*  PRIVATE DECLARATIONS Defined and used only here
+****************************************************************/
+#define TEST_COMPONENT "OMX.TI.DUCATI1.MISC.SAMPLE"
+#define TEST_INPUT_PORT 0
+#define TEST_OUTPUT_PORT 1
+#define TEST_MAX_BUFFERS 32
+#define TEST_TIMEOUT_SEC 5
+
+#define TEST_INIT_STRUCT(_s_, _name_) do { \
+    memset(&(_s_), 0, sizeof(_name_)); \
+    (_s_).nSize = sizeof(_name_); \
+    (_s_).nVersion.s.nVersionMajor = 0x1; \
+    (_s_).nVersion.s.nVersionMinor = 0x1; \
+    } while(0)
+
+typedef enum TEST_OWNER
+{
+	TEST_OWNER_CLIENT = 0,
+	TEST_OWNER_COMPONENT
+} TEST_OWNER;
+
+typedef struct TEST_BUFFER
+{
+	OMX_BUFFERHEADERTYPE *pHdr;
+	OMX_U32 nPort;
+	TEST_OWNER eOwner;
+} TEST_BUFFER;
+
+typedef struct TEST_CONTEXT
+{
+	OMX_HANDLETYPE hComp;
+	pthread_mutex_t tLock;
+	pthread_cond_t tCond;
+	TEST_BUFFER tBuffers[TEST_MAX_BUFFERS];
+	OMX_U32 nBuffers;
+	OMX_U32 nReturned;
+	OMX_U32 nCmdComplete;
+	OMX_U32 nErrors;
+	OMX_U32 nViolations;
+} TEST_CONTEXT;
+
+static TEST_CONTEXT gCtx;
+
+
+static void Test_Violation(const char *cMsg, OMX_BUFFERHEADERTYPE * pHdr)
+{
+	printf("VIOLATION: %s (buffer %p)\n", cMsg, pHdr);
+	gCtx.nViolations++;
+}
+
+static TEST_BUFFER *Test_FindBuffer(OMX_BUFFERHEADERTYPE * pHdr)
+{
+	OMX_U32 i;
+
+	for (i = 0; i < gCtx.nBuffers; i++)
+	{
+		if (gCtx.tBuffers[i].pHdr == pHdr)
+			return &gCtx.tBuffers[i];
+	}
+	return NULL;
+}
+
+/* Called with tLock held */
+static void Test_BufferReturned(OMX_BUFFERHEADERTYPE * pHdr, OMX_U32 nPort)
+{
+	TEST_BUFFER *pBuf = Test_FindBuffer(pHdr);
+
+	if (pBuf == NULL)
+	{
+		Test_Violation("unknown buffer returned", pHdr);
+		return;
+	}
+	if (pBuf->nPort != nPort)
+	{
+		Test_Violation("buffer returned on the wrong callback", pHdr);
+	}
+	if (pBuf->eOwner != TEST_OWNER_COMPONENT)
+	{
+		Test_Violation("buffer returned that the component does not own",
+		    pHdr);
+	}
+	pBuf->eOwner = TEST_OWNER_CLIENT;
+	gCtx.nReturned++;
+	pthread_cond_broadcast(&gCtx.tCond);
+}
+
+static OMX_ERRORTYPE Test_EventHandler(OMX_HANDLETYPE hComponent,
+    OMX_PTR pAppData, OMX_EVENTTYPE eEvent, OMX_U32 nData1, OMX_U32 nData2,
+    OMX_PTR pEventData)
+{
+	pthread_mutex_lock(&gCtx.tLock);
+	if (eEvent == OMX_EventCmdComplete)
+	{
+		gCtx.nCmdComplete++;
+	} else if (eEvent == OMX_EventError)
+	{
+		printf("EventError 0x%x\n", (unsigned int)nData1);
+		gCtx.nErrors++;
+	}
+	pthread_cond_broadcast(&gCtx.tCond);
+	pthread_mutex_unlock(&gCtx.tLock);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE Test_EmptyBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_PTR pAppData, OMX_BUFFERHEADERTYPE * pHdr)
+{
+	pthread_mutex_lock(&gCtx.tLock);
+	Test_BufferReturned(pHdr, TEST_INPUT_PORT);
+	pthread_mutex_unlock(&gCtx.tLock);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE Test_FillBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_PTR pAppData, OMX_BUFFERHEADERTYPE * pHdr)
+{
+	pthread_mutex_lock(&gCtx.tLock);
+	Test_BufferReturned(pHdr, TEST_OUTPUT_PORT);
+	pthread_mutex_unlock(&gCtx.tLock);
+	return OMX_ErrorNone;
+}
+
+/* Waits with tLock held until *pValue reaches nTarget */
+static OMX_BOOL Test_WaitFor(OMX_U32 * pValue, OMX_U32 nTarget)
+{
+	struct timespec tDeadline;
+
+	clock_gettime(CLOCK_REALTIME, &tDeadline);
+	tDeadline.tv_sec += TEST_TIMEOUT_SEC;
+	while (*pValue < nTarget)
+	{
+		if (pthread_cond_timedwait(&gCtx.tCond, &gCtx.tLock,
+			&tDeadline) != 0)
+		{
+			return OMX_FALSE;
+		}
+	}
+	return OMX_TRUE;
+}
+
+static OMX_BOOL Test_SendCommand(OMX_COMMANDTYPE eCmd, OMX_U32 nParam,
+    OMX_U32 nCompletions)
+{
+	OMX_ERRORTYPE eError;
+	OMX_BOOL bDone;
+	OMX_U32 nTarget;
+
+	pthread_mutex_lock(&gCtx.tLock);
+	nTarget = gCtx.nCmdComplete + nCompletions;
+	pthread_mutex_unlock(&gCtx.tLock);
+
+	eError = OMX_SendCommand(gCtx.hComp, eCmd, nParam, NULL);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("SendCommand %d failed 0x%x\n", eCmd, eError);
+		return OMX_FALSE;
+	}
+
+	pthread_mutex_lock(&gCtx.tLock);
+	bDone = Test_WaitFor(&gCtx.nCmdComplete, nTarget);
+	pthread_mutex_unlock(&gCtx.tLock);
+	if (!bDone)
+		printf("SendCommand %d timed out\n", eCmd);
+	return bDone;
+}
+
+/* Submits every buffer the client owns, returns how many were accepted */
+static OMX_U32 Test_SubmitAll(void)
+{
+	OMX_ERRORTYPE eError;
+	OMX_U32 i, nSubmitted = 0;
+
+	for (i = 0; i < gCtx.nBuffers; i++)
+	{
+		TEST_BUFFER *pBuf = &gCtx.tBuffers[i];
+
+		pthread_mutex_lock(&gCtx.tLock);
+		if (pBuf->eOwner != TEST_OWNER_CLIENT)
+		{
+			pthread_mutex_unlock(&gCtx.tLock);
+			continue;
+		}
+		/* ownership moves before the call, the buffer may come back
+		   before it returns */
+		pBuf->eOwner = TEST_OWNER_COMPONENT;
+		pthread_mutex_unlock(&gCtx.tLock);
+
+		if (pBuf->nPort == TEST_INPUT_PORT)
+		{
+			pBuf->pHdr->nFilledLen = pBuf->pHdr->nAllocLen;
+			pBuf->pHdr->nOffset = 0;
+			eError = OMX_EmptyThisBuffer(gCtx.hComp, pBuf->pHdr);
+		} else
+		{
+			eError = OMX_FillThisBuffer(gCtx.hComp, pBuf->pHdr);
+		}
+
+		if (eError == OMX_ErrorNone)
+		{
+			nSubmitted++;
+			continue;
+		}
+
+		/* a refused buffer stays with the client */
+		printf("%s failed 0x%x\n", pBuf->nPort == TEST_INPUT_PORT ?
+		    "EmptyThisBuffer" : "FillThisBuffer", eError);
+		pthread_mutex_lock(&gCtx.tLock);
+		if (pBuf->eOwner != TEST_OWNER_COMPONENT)
+			Test_Violation("refused buffer was returned", pBuf->pHdr);
+		pBuf->eOwner = TEST_OWNER_CLIENT;
+		pthread_mutex_unlock(&gCtx.tLock);
+	}
+
+	return nSubmitted;
+}
+
+/* Counts buffers of a port (OMX_ALL for any) the component owns */
+static OMX_U32 Test_ComponentOwned(OMX_U32 nPort)
+{
+	OMX_U32 i, nOwned = 0;
+
+	pthread_mutex_lock(&gCtx.tLock);
+	for (i = 0; i < gCtx.nBuffers; i++)
+	{
+		if (gCtx.tBuffers[i].eOwner == TEST_OWNER_COMPONENT &&
+		    (nPort == OMX_ALL || gCtx.tBuffers[i].nPort == nPort))
+		{
+			nOwned++;
+		}
+	}
+	pthread_mutex_unlock(&gCtx.tLock);
+	return nOwned;
+}
+
+static OMX_BOOL Test_AllocatePort(OMX_U32 nPort)
+{
+	OMX_PARAM_PORTDEFINITIONTYPE tPortDef;
+	OMX_ERRORTYPE eError;
+	OMX_U32 i;
+
+	TEST_INIT_STRUCT(tPortDef, OMX_PARAM_PORTDEFINITIONTYPE);
+	tPortDef.nPortIndex = nPort;
+	eError = OMX_GetParameter(gCtx.hComp, OMX_IndexParamPortDefinition,
+	    &tPortDef);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("GetParameter port %u failed 0x%x\n", (unsigned int)nPort,
+		    eError);
+		return OMX_FALSE;
+	}
+
+	for (i = 0; i < tPortDef.nBufferCountActual; i++)
+	{
+		TEST_BUFFER *pBuf = &gCtx.tBuffers[gCtx.nBuffers];
+
+		if (gCtx.nBuffers == TEST_MAX_BUFFERS)
+		{
+			printf("Too many buffers\n");
+			return OMX_FALSE;
+		}
+		eError = OMX_AllocateBuffer(gCtx.hComp, &pBuf->pHdr, nPort,
+		    NULL, tPortDef.nBufferSize);
+		if (eError != OMX_ErrorNone)
+		{
+			printf("AllocateBuffer port %u failed 0x%x\n",
+			    (unsigned int)nPort, eError);
+			return OMX_FALSE;
+		}
+		pBuf->nPort = nPort;
+		pBuf->eOwner = TEST_OWNER_CLIENT;
+		gCtx.nBuffers++;
+	}
+	return OMX_TRUE;
+}
+
+/* Streams buffers until nCount have come back, resubmitting each one */
+static OMX_BOOL Test_Stream(OMX_U32 nCount)
+{
+	OMX_BOOL bOk = OMX_TRUE;
+	OMX_U32 nTarget;
+
+	pthread_mutex_lock(&gCtx.tLock);
+	nTarget = gCtx.nReturned + nCount;
+	pthread_mutex_unlock(&gCtx.tLock);
+
+	while (bOk)
+	{
+		Test_SubmitAll();
+
+		pthread_mutex_lock(&gCtx.tLock);
+		if (gCtx.nReturned >= nTarget)
+		{
+			pthread_mutex_unlock(&gCtx.tLock);
+			break;
+		}
+		bOk = Test_WaitFor(&gCtx.nReturned, gCtx.nReturned + 1);
+		pthread_mutex_unlock(&gCtx.tLock);
+		if (!bOk)
+			printf("No buffer came back in %d s\n", TEST_TIMEOUT_SEC);
+	}
+	return bOk;
+}
+
+static OMX_BOOL Test_Run(const char *cComponent, OMX_U32 nCount,
+    OMX_S32 nWindow)
+{
+	OMX_CALLBACKTYPE tCallbacks = {
+		Test_EventHandler, Test_EmptyBufferDone, Test_FillBufferDone
+	};
+	OMX_ERRORTYPE eError;
+	OMX_BOOL bOk = OMX_FALSE;
+	OMX_U32 i, nOwned;
+	char cWindow[16];
+	struct timespec tStart, tEnd;
+	double fElapsed;
+
+	memset(&gCtx, 0, sizeof(gCtx));
+	pthread_mutex_init(&gCtx.tLock, NULL);
+	pthread_cond_init(&gCtx.tCond, NULL);
+
+	/* read by the RPC layer when the component is created */
+	snprintf(cWindow, sizeof(cWindow), "%d", (int)nWindow);
+	setenv("DEBUG_DOMX_RPC_WINDOW", cWindow, 1);
+
+	eError = OMX_GetHandle(&gCtx.hComp, (OMX_STRING) cComponent, NULL,
+	    &tCallbacks);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("GetHandle %s failed 0x%x\n", cComponent, eError);
+		goto EXIT;
+	}
+
+	/* Loaded -> Idle completes once all buffers are allocated */
+	eError = OMX_SendCommand(gCtx.hComp, OMX_CommandStateSet,
+	    OMX_StateIdle, NULL);
+	if (eError != OMX_ErrorNone ||
+	    !Test_AllocatePort(TEST_INPUT_PORT) ||
+	    !Test_AllocatePort(TEST_OUTPUT_PORT))
+	{
+		goto EXIT;
+	}
+	pthread_mutex_lock(&gCtx.tLock);
+	bOk = Test_WaitFor(&gCtx.nCmdComplete, 1);
+	pthread_mutex_unlock(&gCtx.tLock);
+	if (!bOk || !Test_SendCommand(OMX_CommandStateSet,
+		OMX_StateExecuting, 1))
+	{
+		bOk = OMX_FALSE;
+		goto EXIT;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tStart);
+
+	/* Flushing returns every buffer of the flushed ports */
+	bOk = Test_Stream(nCount / 2);
+	Test_SubmitAll();
+	bOk = bOk && Test_SendCommand(OMX_CommandFlush, OMX_ALL, 2);
+	nOwned = Test_ComponentOwned(OMX_ALL);
+	if (nOwned != 0)
+	{
+		printf("VIOLATION: component holds %u buffers after flush\n",
+		    (unsigned int)nOwned);
+		gCtx.nViolations++;
+	}
+
+	bOk = bOk && Test_Stream(nCount - nCount / 2);
+
+	clock_gettime(CLOCK_MONOTONIC, &tEnd);
+	fElapsed = (tEnd.tv_sec - tStart.tv_sec) +
+	    (tEnd.tv_nsec - tStart.tv_nsec) / 1e9;
+
+	/* Executing -> Idle returns every buffer */
+	Test_SubmitAll();
+	bOk = bOk && Test_SendCommand(OMX_CommandStateSet, OMX_StateIdle, 1);
+	nOwned = Test_ComponentOwned(OMX_ALL);
+	if (nOwned != 0)
+	{
+		printf("VIOLATION: component holds %u buffers in Idle\n",
+		    (unsigned int)nOwned);
+		gCtx.nViolations++;
+	}
+
+	printf("window %d: %u buffers in %.3f s (%.0f/s), %u errors, "
+	    "%u violations\n", (int)nWindow, (unsigned int)gCtx.nReturned,
+	    fElapsed, fElapsed > 0 ? gCtx.nReturned / fElapsed : 0.0,
+	    (unsigned int)gCtx.nErrors, (unsigned int)gCtx.nViolations);
+
+	/* Idle -> Loaded completes once all buffers are freed */
+	eError = OMX_SendCommand(gCtx.hComp, OMX_CommandStateSet,
+	    OMX_StateLoaded, NULL);
+	for (i = 0; i < gCtx.nBuffers; i++)
+	{
+		OMX_FreeBuffer(gCtx.hComp, gCtx.tBuffers[i].nPort,
+		    gCtx.tBuffers[i].pHdr);
+	}
+	if (eError == OMX_ErrorNone)
+	{
+		pthread_mutex_lock(&gCtx.tLock);
+		Test_WaitFor(&gCtx.nCmdComplete, gCtx.nCmdComplete + 1);
+		pthread_mutex_unlock(&gCtx.tLock);
+	}
+
+      EXIT:
+	if (gCtx.hComp)
+		OMX_FreeHandle(gCtx.hComp);
+	pthread_cond_destroy(&gCtx.tCond);
+	pthread_mutex_destroy(&gCtx.tLock);
+
+	return bOk && gCtx.nViolations == 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *cComponent = TEST_COMPONENT;
+	OMX_U32 nCount = 2000;
+	OMX_S32 nWindow = 4;
+	OMX_BOOL bOk;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:n:w:")) != -1)
+	{
+		switch (c)
+		{
+		case 'c':
+			cComponent = optarg;
+			break;
+		case 'n':
+			nCount = atoi(optarg);
+			break;
+		case 'w':
+			nWindow = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c component] [-n buffers] "
+			    "[-w window]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (OMX_Init() != OMX_ErrorNone)
+	{
+		printf("OMX_Init failed\n");
+		return 1;
+	}
+
+	bOk = Test_Run(cComponent, nCount, 0);
+	if (nWindow > 0)
+		bOk = Test_Run(cComponent, nCount, nWindow) && bOk;
+
+	OMX_Deinit();
+
+	printf("%s\n", bOk ? "PASS" : "FAIL");
+	return bOk ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#
+#  Host build of the DOMX pieces that run without the remote processor,
+#  included by the test Makefiles next to their Android.mk. mm_osal is
+#  built without _Android, so debug properties come from the environment
+#  and traces go to stdout.
+#
+#  OMX_INCLUDE must point at the OpenMAX IL headers, by default the ones
+#  of the Android tree this directory lives in.
+#
+
+DOMX_ROOT := $(abspath $(dir $(lastword $(MAKEFILE_LIST)))/..)
+ANDROID_BUILD_TOP ?= $(abspath $(DOMX_ROOT)/../../../..)
+OMX_INCLUDE ?= $(ANDROID_BUILD_TOP)/frameworks/native/include/media/openmax
+
+OUT ?= out-host
+
+CC ?= gcc
+CFLAGS ?= -O2 -g
+HOST_CFLAGS := $(CFLAGS) -Wall -D_POSIX_VERSION_1_ \
+	-DTIMM_OSAL_DEBUG_TRACE_DETAIL=1 \
+	'-D__unused=__attribute__((unused))' \
+	-I$(DOMX_ROOT)/mm_osal/inc \
+	-I$(OMX_INCLUDE)
+HOST_LDLIBS := -lpthread -lrt
+
+MM_OSAL_SRCS := $(wildcard $(DOMX_ROOT)/mm_osal/src/*.c)
+MM_OSAL_OBJS := $(patsubst $(DOMX_ROOT)/mm_osal/src/%.c,$(OUT)/mm_osal/%.o,$(MM_OSAL_SRCS))
+MM_OSAL_LIB := $(OUT)/libmm_osal.a
+
+$(OUT)/mm_osal/%.o: $(DOMX_ROOT)/mm_osal/src/%.c
+	@mkdir -p $(dir $@)
+	$(CC) $(HOST_CFLAGS) -c $< -o $@
+
+$(MM_OSAL_LIB): $(MM_OSAL_OBJS)
+	$(AR) rcs $@ $^
@@ -0,0 +1,56 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Loopback remote core, serves DOMX clients that have
+# DEBUG_DOMX_RPC_LOOPBACK set to its socket instead of the remote processor
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	loopback_remote.c \
+	loopback_remote_main.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../omx_core/inc \
+	$(LOCAL_PATH)/../../domx \
+	$(LOCAL_PATH)/../../domx/omx_rpc/inc \
+	$(LOCAL_PATH)/../../mm_osal/inc \
+	frameworks/native/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES:= \
+	libmm_osal \
+	libcutils \
+	liblog
+
+LOCAL_CFLAGS += -Wall -O2 $(ANDROID_API_CFLAGS)
+
+LOCAL_MODULE:= domx_loopback_remote
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
+
+# Latency and throughput of the DOMX client stack against an in-process
+# loopback remote core
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	loopback_remote.c \
+	loopback_bench.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../omx_core/inc \
+	$(LOCAL_PATH)/../../domx \
+	$(LOCAL_PATH)/../../domx/omx_rpc/inc \
+	$(LOCAL_PATH)/../../mm_osal/inc \
+	frameworks/native/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES:= \
+	libOMX_Core \
+	libmm_osal \
+	libcutils \
+	liblog
+
+LOCAL_CFLAGS += -Wall -O2 $(ANDROID_API_CFLAGS)
+
+LOCAL_MODULE:= domx_loopback_bench
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
@@ -0,0 +1,583 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ *  @file  loopback_bench.c
+ *         Latency and throughput of the whole DOMX client stack (OMX core,
+ *         proxy, RPC stubs and skeletons) against the loopback remote core,
+ *         which is started in this process.
+ *
+ *  For the synchronous RPC and then for the given asynchronous window it
+ *  measures
+ *   - the round trip of GetState and GetParameter(PortDefinition),
+ *   - the time from EmptyThisBuffer to EmptyBufferDone and from
+ *     FillThisBuffer to FillBufferDone with one buffer in flight,
+ *   - the buffers per second with every buffer in flight, resubmitting
+ *     each one as it comes back.
+ *  The remote latency is added to the buffer times, 0 leaves only the cost
+ *  of DOMX itself.
+ *
+ *  Usage: domx_loopback_bench [-c component] [-l remote latency us]
+ *                             [-j remote jitter us] [-b buffers per port]
+ *                             [-n round trips] [-m buffers to stream]
+ *                             [-w async window]
+ */
+
+/****************************************************************
+*  INCLUDE FILES
+****************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*-------program files ----------------------------------------*/
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+#include "loopback_remote.h"
+
+
+/****************************************************************
+*  PRIVATE DECLARATIONS Defined and used only here
+****************************************************************/
+/*Any proxy will do, the loopback remote core plays every component*/
+#define BENCH_COMPONENT "OMX.TI.DUCATI1.MISC.SAMPLE"
+#define BENCH_PATH "/data/local/tmp/domx_loopback_bench"
+#define BENCH_INPUT_PORT 0
+#define BENCH_OUTPUT_PORT 1
+#define BENCH_MAX_BUFFERS (2 * LOOPBACK_REMOTE_MAX_BUFFERS)
+#define BENCH_TIMEOUT_SEC 5
+
+#define BENCH_INIT_STRUCT(_s_, _name_) do { \
+    memset(&(_s_), 0, sizeof(_name_)); \
+    (_s_).nSize = sizeof(_name_); \
+    (_s_).nVersion.s.nVersionMajor = 0x1; \
+    (_s_).nVersion.s.nVersionMinor = 0x1; \
+    } while(0)
+
+typedef struct BENCH_BUFFER
+{
+	OMX_BUFFERHEADERTYPE *pHdr;
+	OMX_U32 nPort;
+	OMX_BOOL bWithComponent;
+} BENCH_BUFFER;
+
+typedef struct BENCH_OPTIONS
+{
+	const char *cComponent;
+	OMX_U32 nRoundTrips;
+	OMX_U32 nStream;
+} BENCH_OPTIONS;
+
+typedef struct BENCH_CONTEXT
+{
+	OMX_HANDLETYPE hComp;
+	pthread_mutex_t tLock;
+	pthread_cond_t tCond;
+	BENCH_BUFFER tBuffers[BENCH_MAX_BUFFERS];
+	OMX_U32 nBuffers;
+	OMX_U32 nReturned;
+	OMX_U32 nCmdComplete;
+	OMX_U32 nErrors;
+	OMX_U32 nStrays;
+} BENCH_CONTEXT;
+
+static BENCH_CONTEXT gCtx;
+
+
+static double Bench_Now(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return tNow.tv_sec + tNow.tv_nsec / 1e9;
+}
+
+static void Bench_BufferReturned(OMX_BUFFERHEADERTYPE * pHdr, OMX_U32 nPort)
+{
+	OMX_U32 i;
+
+	pthread_mutex_lock(&gCtx.tLock);
+	for (i = 0; i < gCtx.nBuffers; i++)
+	{
+		if (gCtx.tBuffers[i].pHdr == pHdr)
+			break;
+	}
+	if (i == gCtx.nBuffers || gCtx.tBuffers[i].nPort != nPort ||
+	    !gCtx.tBuffers[i].bWithComponent)
+	{
+		gCtx.nStrays++;
+	} else
+	{
+		gCtx.tBuffers[i].bWithComponent = OMX_FALSE;
+		gCtx.nReturned++;
+	}
+	pthread_cond_broadcast(&gCtx.tCond);
+	pthread_mutex_unlock(&gCtx.tLock);
+}
+
+static OMX_ERRORTYPE Bench_EventHandler(OMX_HANDLETYPE hComponent,
+    OMX_PTR pAppData, OMX_EVENTTYPE eEvent, OMX_U32 nData1, OMX_U32 nData2,
+    OMX_PTR pEventData)
+{
+	pthread_mutex_lock(&gCtx.tLock);
+	if (eEvent == OMX_EventCmdComplete)
+	{
+		gCtx.nCmdComplete++;
+	} else if (eEvent == OMX_EventError)
+	{
+		printf("EventError 0x%x\n", (unsigned int)nData1);
+		gCtx.nErrors++;
+	}
+	pthread_cond_broadcast(&gCtx.tCond);
+	pthread_mutex_unlock(&gCtx.tLock);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE Bench_EmptyBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_PTR pAppData, OMX_BUFFERHEADERTYPE * pHdr)
+{
+	Bench_BufferReturned(pHdr, BENCH_INPUT_PORT);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE Bench_FillBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_PTR pAppData, OMX_BUFFERHEADERTYPE * pHdr)
+{
+	Bench_BufferReturned(pHdr, BENCH_OUTPUT_PORT);
+	return OMX_ErrorNone;
+}
+
+/* Waits with tLock held until *pValue reaches nTarget */
+static OMX_BOOL Bench_WaitFor(OMX_U32 * pValue, OMX_U32 nTarget)
+{
+	struct timespec tDeadline;
+
+	clock_gettime(CLOCK_REALTIME, &tDeadline);
+	tDeadline.tv_sec += BENCH_TIMEOUT_SEC;
+	while (*pValue < nTarget)
+	{
+		if (pthread_cond_timedwait(&gCtx.tCond, &gCtx.tLock,
+			&tDeadline) != 0)
+		{
+			return OMX_FALSE;
+		}
+	}
+	return OMX_TRUE;
+}
+
+static OMX_BOOL Bench_SendCommand(OMX_COMMANDTYPE eCmd, OMX_U32 nParam)
+{
+	OMX_ERRORTYPE eError;
+	OMX_BOOL bDone;
+	OMX_U32 nTarget;
+
+	pthread_mutex_lock(&gCtx.tLock);
+	nTarget = gCtx.nCmdComplete + 1;
+	pthread_mutex_unlock(&gCtx.tLock);
+
+	eError = OMX_SendCommand(gCtx.hComp, eCmd, nParam, NULL);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("SendCommand %d failed 0x%x\n", eCmd, eError);
+		return OMX_FALSE;
+	}
+
+	pthread_mutex_lock(&gCtx.tLock);
+	bDone = Bench_WaitFor(&gCtx.nCmdComplete, nTarget);
+	pthread_mutex_unlock(&gCtx.tLock);
+	if (!bDone)
+		printf("SendCommand %d timed out\n", eCmd);
+	return bDone;
+}
+
+static OMX_BOOL Bench_Submit(BENCH_BUFFER * pBuf)
+{
+	OMX_ERRORTYPE eError;
+
+	/* the buffer may come back before the call returns */
+	pthread_mutex_lock(&gCtx.tLock);
+	pBuf->bWithComponent = OMX_TRUE;
+	pthread_mutex_unlock(&gCtx.tLock);
+
+	if (pBuf->nPort == BENCH_INPUT_PORT)
+	{
+		pBuf->pHdr->nFilledLen = pBuf->pHdr->nAllocLen;
+		pBuf->pHdr->nOffset = 0;
+		eError = OMX_EmptyThisBuffer(gCtx.hComp, pBuf->pHdr);
+	} else
+	{
+		eError = OMX_FillThisBuffer(gCtx.hComp, pBuf->pHdr);
+	}
+
+	if (eError != OMX_ErrorNone)
+	{
+		printf("%s failed 0x%x\n", pBuf->nPort == BENCH_INPUT_PORT ?
+		    "EmptyThisBuffer" : "FillThisBuffer", eError);
+		pthread_mutex_lock(&gCtx.tLock);
+		pBuf->bWithComponent = OMX_FALSE;
+		pthread_mutex_unlock(&gCtx.tLock);
+		return OMX_FALSE;
+	}
+	return OMX_TRUE;
+}
+
+static OMX_BOOL Bench_AllocatePort(OMX_U32 nPort)
+{
+	OMX_PARAM_PORTDEFINITIONTYPE tPortDef;
+	OMX_ERRORTYPE eError;
+	OMX_U32 i;
+
+	BENCH_INIT_STRUCT(tPortDef, OMX_PARAM_PORTDEFINITIONTYPE);
+	tPortDef.nPortIndex = nPort;
+	eError = OMX_GetParameter(gCtx.hComp, OMX_IndexParamPortDefinition,
+	    &tPortDef);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("GetParameter port %u failed 0x%x\n", (unsigned int)nPort,
+		    eError);
+		return OMX_FALSE;
+	}
+
+	for (i = 0; i < tPortDef.nBufferCountActual; i++)
+	{
+		BENCH_BUFFER *pBuf = &gCtx.tBuffers[gCtx.nBuffers];
+
+		if (gCtx.nBuffers == BENCH_MAX_BUFFERS)
+		{
+			printf("Too many buffers\n");
+			return OMX_FALSE;
+		}
+		eError = OMX_AllocateBuffer(gCtx.hComp, &pBuf->pHdr, nPort,
+		    NULL, tPortDef.nBufferSize);
+		if (eError != OMX_ErrorNone)
+		{
+			printf("AllocateBuffer port %u failed 0x%x\n",
+			    (unsigned int)nPort, eError);
+			return OMX_FALSE;
+		}
+		pBuf->nPort = nPort;
+		pBuf->bWithComponent = OMX_FALSE;
+		gCtx.nBuffers++;
+	}
+	return OMX_TRUE;
+}
+
+/* Average round trip of a call without buffers, in us */
+static double Bench_Calls(OMX_U32 nRoundTrips, OMX_BOOL bParameter)
+{
+	OMX_PARAM_PORTDEFINITIONTYPE tPortDef;
+	OMX_STATETYPE eState;
+	OMX_ERRORTYPE eError = OMX_ErrorNone;
+	double fStart;
+	OMX_U32 i;
+
+	BENCH_INIT_STRUCT(tPortDef, OMX_PARAM_PORTDEFINITIONTYPE);
+	fStart = Bench_Now();
+	for (i = 0; i < nRoundTrips && eError == OMX_ErrorNone; i++)
+	{
+		if (bParameter)
+		{
+			tPortDef.nPortIndex = i & 1;
+			eError = OMX_GetParameter(gCtx.hComp,
+			    OMX_IndexParamPortDefinition, &tPortDef);
+		} else
+		{
+			eError = OMX_GetState(gCtx.hComp, &eState);
+		}
+	}
+	if (eError != OMX_ErrorNone)
+	{
+		printf("%s failed 0x%x\n", bParameter ? "GetParameter" :
+		    "GetState", eError);
+		return -1;
+	}
+	return (Bench_Now() - fStart) * 1e6 / nRoundTrips;
+}
+
+/* Average time from submission to return with one buffer of the port in
+   flight, in us */
+static double Bench_BufferLatency(OMX_U32 nPort, OMX_U32 nRoundTrips)
+{
+	OMX_U32 i, j = 0, nTarget;
+	double fStart;
+	OMX_BOOL bOk = OMX_TRUE;
+
+	fStart = Bench_Now();
+	for (i = 0; i < nRoundTrips && bOk; i++)
+	{
+		/* cycle through the buffers of the port */
+		do
+		{
+			j = (j + 1) % gCtx.nBuffers;
+		} while (gCtx.tBuffers[j].nPort != nPort);
+
+		pthread_mutex_lock(&gCtx.tLock);
+		nTarget = gCtx.nReturned + 1;
+		pthread_mutex_unlock(&gCtx.tLock);
+
+		bOk = Bench_Submit(&gCtx.tBuffers[j]);
+
+		pthread_mutex_lock(&gCtx.tLock);
+		bOk = bOk && Bench_WaitFor(&gCtx.nReturned, nTarget);
+		pthread_mutex_unlock(&gCtx.tLock);
+	}
+	if (!bOk)
+	{
+		printf("Buffer on port %u did not come back\n",
+		    (unsigned int)nPort);
+		return -1;
+	}
+	return (Bench_Now() - fStart) * 1e6 / nRoundTrips;
+}
+
+/* Buffers per second with every buffer in flight. Resubmission happens
+   here and not in the callbacks, a synchronous call from the callback
+   thread would wait for a reply only that thread can read. */
+static double Bench_Throughput(OMX_U32 nCount)
+{
+	OMX_U32 i, nTarget;
+	double fStart;
+	OMX_BOOL bOk = OMX_TRUE;
+
+	pthread_mutex_lock(&gCtx.tLock);
+	nTarget = gCtx.nReturned + nCount;
+	pthread_mutex_unlock(&gCtx.tLock);
+
+	fStart = Bench_Now();
+	while (bOk)
+	{
+		for (i = 0; i < gCtx.nBuffers && bOk; i++)
+		{
+			OMX_BOOL bWithComponent;
+
+			pthread_mutex_lock(&gCtx.tLock);
+			bWithComponent = gCtx.tBuffers[i].bWithComponent;
+			pthread_mutex_unlock(&gCtx.tLock);
+			if (!bWithComponent)
+				bOk = Bench_Submit(&gCtx.tBuffers[i]);
+		}
+
+		pthread_mutex_lock(&gCtx.tLock);
+		if (gCtx.nReturned >= nTarget)
+		{
+			pthread_mutex_unlock(&gCtx.tLock);
+			break;
+		}
+		bOk = bOk && Bench_WaitFor(&gCtx.nReturned, gCtx.nReturned + 1);
+		pthread_mutex_unlock(&gCtx.tLock);
+	}
+	if (!bOk)
+	{
+		printf("Stream stalled\n");
+		return -1;
+	}
+	return nCount / (Bench_Now() - fStart);
+}
+
+static OMX_BOOL Bench_Run(const BENCH_OPTIONS * pOptions, OMX_S32 nWindow)
+{
+	OMX_CALLBACKTYPE tCallbacks = {
+		Bench_EventHandler, Bench_EmptyBufferDone, Bench_FillBufferDone
+	};
+	OMX_ERRORTYPE eError;
+	OMX_BOOL bOk = OMX_FALSE;
+	double fGetState, fGetParam, fEmpty, fFill, fStream;
+	OMX_U32 i;
+	char cWindow[16];
+
+	memset(&gCtx, 0, sizeof(gCtx));
+	pthread_mutex_init(&gCtx.tLock, NULL);
+	pthread_cond_init(&gCtx.tCond, NULL);
+
+	/* read by the RPC layer when the component is created */
+	snprintf(cWindow, sizeof(cWindow), "%d", (int)nWindow);
+	setenv("DEBUG_DOMX_RPC_WINDOW", cWindow, 1);
+
+	eError = OMX_GetHandle(&gCtx.hComp, (OMX_STRING) pOptions->cComponent,
+	    NULL, &tCallbacks);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("GetHandle %s failed 0x%x\n", pOptions->cComponent,
+		    eError);
+		goto EXIT;
+	}
+
+	fGetState = Bench_Calls(pOptions->nRoundTrips, OMX_FALSE);
+	fGetParam = Bench_Calls(pOptions->nRoundTrips, OMX_TRUE);
+
+	/* Loaded -> Idle completes once all buffers are allocated */
+	eError = OMX_SendCommand(gCtx.hComp, OMX_CommandStateSet,
+	    OMX_StateIdle, NULL);
+	if (eError != OMX_ErrorNone ||
+	    !Bench_AllocatePort(BENCH_INPUT_PORT) ||
+	    !Bench_AllocatePort(BENCH_OUTPUT_PORT))
+	{
+		goto EXIT;
+	}
+	pthread_mutex_lock(&gCtx.tLock);
+	bOk = Bench_WaitFor(&gCtx.nCmdComplete, 1);
+	pthread_mutex_unlock(&gCtx.tLock);
+	if (!bOk || !Bench_SendCommand(OMX_CommandStateSet,
+		OMX_StateExecuting))
+	{
+		bOk = OMX_FALSE;
+		goto EXIT;
+	}
+
+	fEmpty = Bench_BufferLatency(BENCH_INPUT_PORT, pOptions->nRoundTrips);
+	fFill = Bench_BufferLatency(BENCH_OUTPUT_PORT, pOptions->nRoundTrips);
+	fStream = Bench_Throughput(pOptions->nStream);
+
+	/* Executing -> Idle returns every buffer */
+	bOk = Bench_SendCommand(OMX_CommandStateSet, OMX_StateIdle);
+
+	printf("window %d: GetState %.1f us, GetParameter %.1f us, "
+	    "ETB->EBD %.1f us, FTB->FBD %.1f us, stream %.0f buffers/s, "
+	    "%u errors\n", (int)nWindow, fGetState, fGetParam, fEmpty, fFill,
+	    fStream, (unsigned int)(gCtx.nErrors + gCtx.nStrays));
+
+	bOk = bOk && fGetState >= 0 && fGetParam >= 0 && fEmpty >= 0 &&
+	    fFill >= 0 && fStream >= 0;
+
+	/* Idle -> Loaded completes once all buffers are freed */
+	eError = OMX_SendCommand(gCtx.hComp, OMX_CommandStateSet,
+	    OMX_StateLoaded, NULL);
+	for (i = 0; i < gCtx.nBuffers; i++)
+	{
+		OMX_FreeBuffer(gCtx.hComp, gCtx.tBuffers[i].nPort,
+		    gCtx.tBuffers[i].pHdr);
+	}
+	if (eError == OMX_ErrorNone)
+	{
+		pthread_mutex_lock(&gCtx.tLock);
+		Bench_WaitFor(&gCtx.nCmdComplete, gCtx.nCmdComplete + 1);
+		pthread_mutex_unlock(&gCtx.tLock);
+	}
+
+      EXIT:
+	if (gCtx.hComp)
+		OMX_FreeHandle(gCtx.hComp);
+	pthread_cond_destroy(&gCtx.tCond);
+	pthread_mutex_destroy(&gCtx.tLock);
+
+	return bOk && gCtx.nErrors == 0 && gCtx.nStrays == 0;
+}
+
+int main(int argc, char **argv)
+{
+	BENCH_OPTIONS tOptions = { BENCH_COMPONENT, 2000, 20000 };
+	LOOPBACK_REMOTE_CONFIG tConfig;
+	LOOPBACK_REMOTE *pRemote = NULL;
+	OMX_S32 nWindow = 4;
+	OMX_BOOL bOk;
+	int c;
+
+	LoopbackRemote_DefaultConfig(&tConfig);
+
+	while ((c = getopt(argc, argv, "c:l:j:b:n:m:w:")) != -1)
+	{
+		switch (c)
+		{
+		case 'c':
+			tOptions.cComponent = optarg;
+			break;
+		case 'l':
+			tConfig.nLatencyUs = atoi(optarg);
+			break;
+		case 'j':
+			tConfig.nJitterUs = atoi(optarg);
+			break;
+		case 'b':
+			tConfig.nBufferCount = atoi(optarg);
+			break;
+		case 'n':
+			tOptions.nRoundTrips = atoi(optarg);
+			break;
+		case 'm':
+			tOptions.nStream = atoi(optarg);
+			break;
+		case 'w':
+			nWindow = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c component] [-l latency us] "
+			    "[-j jitter us] [-b buffers] [-n round trips] "
+			    "[-m buffers] [-w window]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (tConfig.nBufferCount == 0 ||
+	    tConfig.nBufferCount > LOOPBACK_REMOTE_MAX_BUFFERS ||
+	    tOptions.nRoundTrips == 0 || tOptions.nStream == 0)
+	{
+		fprintf(stderr, "1 to %d buffers per port\n",
+		    LOOPBACK_REMOTE_MAX_BUFFERS);
+		return 2;
+	}
+
+	if (LoopbackRemote_Start(BENCH_PATH, &tConfig, &pRemote) !=
+	    OMX_ErrorNone)
+	{
+		printf("Cannot start the loopback remote core on %s\n",
+		    BENCH_PATH);
+		return 1;
+	}
+	/* every component created from now on talks to it */
+	setenv("DEBUG_DOMX_RPC_LOOPBACK", BENCH_PATH, 1);
+
+	if (OMX_Init() != OMX_ErrorNone)
+	{
+		printf("OMX_Init failed\n");
+		LoopbackRemote_Stop(pRemote);
+		return 1;
+	}
+
+	printf("remote latency %u us, jitter %u us, %u buffers per port\n",
+	    (unsigned int)tConfig.nLatencyUs, (unsigned int)tConfig.nJitterUs,
+	    (unsigned int)tConfig.nBufferCount);
+	bOk = Bench_Run(&tOptions, 0);
+	if (nWindow > 0)
+		bOk = Bench_Run(&tOptions, nWindow) && bOk;
+
+	OMX_Deinit();
+	LoopbackRemote_Stop(pRemote);
+
+	printf("%s\n", bOk ? "PASS" : "FAIL");
+	return bOk ? 0 : 1;
+}
@@ -0,0 +1,999 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ *  @file  loopback_remote.c
+ *         A loopback remote core for DOMX.
+ *
+ *  Every connection to the socket stands for one component instance, like
+ *  every open of /dev/rpmsg-omx1 does. The reader thread of a connection
+ *  answers each call in the layout the stubs in omx_rpc_stub.c expect: the
+ *  reply is the request with the outputs written behind the arguments.
+ *  EmptyThisBuffer and FillThisBuffer are acknowledged at once and queued;
+ *  the worker thread sends EmptyBufferDone/FillBufferDone in the layout
+ *  omx_rpc_skel.c reads once the configured latency has passed. Commands
+ *  complete the way an OMX component completes them, state transitions to
+ *  Idle and Loaded wait for the ports to be populated and emptied.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\test\loopback
+ *
+ *  @rev 1.0
+ */
+
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+#include <timm_osal_interfaces.h>
+
+#include <linux/rpmsg_omx.h>
+
+/*-------program files ----------------------------------------*/
+#include "omx_rpc_internal.h"
+#include "omx_rpc_utils.h"
+#include "rpmsg_omx_defs.h"
+#include "loopback_remote.h"
+
+
+/******************************************************************
+ *   PRIVATE DECLARATIONS Defined and used only here
+ ******************************************************************/
+#define LOOPBACK_NUM_PORTS 2
+#define LOOPBACK_INPUT_PORT 0
+#define LOOPBACK_OUTPUT_PORT 1
+#define LOOPBACK_COMPONENT_NAME "OMX.TI.LOOPBACK"
+
+/*Remote buffer headers are handed out as fake remote addresses*/
+#define LOOPBACK_HDR_BASE 0x4C000000
+#define LOOPBACK_HDR_STRIDE 0x80
+#define LOOPBACK_MAX_HEADERS (LOOPBACK_NUM_PORTS * LOOPBACK_REMOTE_MAX_BUFFERS)
+
+/*Set on fxn_idx for functions of the static table*/
+#define LOOPBACK_FXN_STATIC 0x80000000
+
+typedef struct LOOPBACK_HEADER
+{
+	OMX_BOOL bUsed;
+	OMX_U32 nPort;
+	OMX_U32 nAllocLen;
+} LOOPBACK_HEADER;
+
+/*A buffer held by the fake component*/
+typedef struct LOOPBACK_HELD
+{
+	OMX_U32 nBufHdrRemote;
+	OMX_U32 nFilledLen;
+	OMX_U32 nFlags;
+	OMX_TICKS nTimeStamp;
+	struct timespec tDue;
+} LOOPBACK_HELD;
+
+typedef struct LOOPBACK_PORT
+{
+	OMX_U32 nBufferCount;
+	OMX_U32 nBufferSize;
+	OMX_U32 nBuffers;
+	LOOPBACK_HELD tHeld[LOOPBACK_REMOTE_MAX_BUFFERS];
+	OMX_U32 nFirst;
+	OMX_U32 nHeld;
+	struct timespec tLastDue;
+} LOOPBACK_PORT;
+
+typedef struct LOOPBACK_SESSION
+{
+	LOOPBACK_REMOTE *pRemote;
+	OMX_S32 fd;
+	pthread_t tReader;
+	pthread_t tWorker;
+	pthread_mutex_t tLock;
+	pthread_cond_t tCond;
+	OMX_BOOL bExit;
+	OMX_BOOL bDone;
+	OMX_HANDLETYPE hProxy;
+	OMX_STATETYPE eState;
+	OMX_STATETYPE eTarget;
+	LOOPBACK_PORT tPorts[LOOPBACK_NUM_PORTS];
+	LOOPBACK_HEADER tHeaders[LOOPBACK_MAX_HEADERS];
+	OMX_TICKS nLastTimeStamp;
+	OMX_U32 nSubmitted;
+	OMX_U32 nReturned;
+	unsigned int nSeed;
+	struct LOOPBACK_SESSION *pNext;
+} LOOPBACK_SESSION;
+
+struct LOOPBACK_REMOTE
+{
+	LOOPBACK_REMOTE_CONFIG tConfig;
+	struct sockaddr_un sAddr;
+	OMX_S32 fdListen;
+	OMX_S32 fdKill;
+	pthread_t tListener;
+	pthread_mutex_t tLock;
+	LOOPBACK_SESSION *pSessions;
+};
+
+
+static void Loopback_Now(struct timespec *pTime)
+{
+	clock_gettime(CLOCK_REALTIME, pTime);
+}
+
+static void Loopback_AddUs(struct timespec *pTime, OMX_U32 nUs)
+{
+	pTime->tv_sec += nUs / 1000000;
+	pTime->tv_nsec += (nUs % 1000000) * 1000;
+	if (pTime->tv_nsec >= 1000000000)
+	{
+		pTime->tv_sec++;
+		pTime->tv_nsec -= 1000000000;
+	}
+}
+
+static OMX_BOOL Loopback_Before(const struct timespec *pA,
+    const struct timespec *pB)
+{
+	if (pA->tv_sec != pB->tv_sec)
+		return pA->tv_sec < pB->tv_sec ? OMX_TRUE : OMX_FALSE;
+	return pA->tv_nsec < pB->tv_nsec ? OMX_TRUE : OMX_FALSE;
+}
+
+static void Loopback_Send(LOOPBACK_SESSION * pSession, OMX_U8 * pPacket)
+{
+	/*A client that went away is noticed by the reader */
+	send(pSession->fd, pPacket, RPC_PACKET_SIZE, MSG_NOSIGNAL);
+}
+
+/* Starts a packet for a call made by the remote core, returns its data */
+static OMX_U8 *Loopback_InitCallback(OMX_U8 * pPacket, OMX_U32 nFxnIdx)
+{
+	struct omx_packet *pOmxPacket = (struct omx_packet *)pPacket;
+
+	memset(pPacket, 0, RPC_PACKET_SIZE);
+	pOmxPacket->desc = OMX_DESC_MSG << OMX_DESC_TYPE_SHIFT;
+	pOmxPacket->fxn_idx = nFxnIdx | LOOPBACK_FXN_STATIC;
+	pOmxPacket->data_size = RPC_PACKET_SIZE - sizeof(struct omx_packet);
+	return (OMX_U8 *) pOmxPacket->data;
+}
+
+/* Called with tLock held */
+static void Loopback_Event(LOOPBACK_SESSION * pSession, OMX_EVENTTYPE eEvent,
+    OMX_U32 nData1, OMX_U32 nData2)
+{
+	OMX_U8 pPacket[RPC_PACKET_SIZE];
+	OMX_U8 *pData = Loopback_InitCallback(pPacket,
+	    RPC_OMX_FXN_IDX_EVENTHANDLER);
+	OMX_U32 nPos = 0;
+
+	//Marshalled:[>hComp|>eEvent|>nData1|>nData2|>pEventData]
+	RPC_SETFIELDVALUE(pData, nPos, pSession->hProxy, OMX_HANDLETYPE);
+	RPC_SETFIELDVALUE(pData, nPos, eEvent, OMX_EVENTTYPE);
+	RPC_SETFIELDVALUE(pData, nPos, nData1, OMX_U32);
+	RPC_SETFIELDVALUE(pData, nPos, nData2, OMX_U32);
+	RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_PTR);
+	Loopback_Send(pSession, pPacket);
+}
+
+/* Sends the buffer back to the client, called with tLock held */
+static void Loopback_BufferDone(LOOPBACK_SESSION * pSession, OMX_U32 nPort,
+    const LOOPBACK_HELD * pHeld)
+{
+	OMX_U8 pPacket[RPC_PACKET_SIZE];
+	OMX_U8 *pData;
+	OMX_U32 nPos = 0;
+
+	if (nPort == LOOPBACK_INPUT_PORT)
+	{
+		pData = Loopback_InitCallback(pPacket,
+		    RPC_OMX_FXN_IDX_EMPTYBUFFERDONE);
+		//Marshalled:[>hComp|>bufferHdr|>nFilledLen|>nOffset|>nFlags]
+		RPC_SETFIELDVALUE(pData, nPos, pSession->hProxy,
+		    OMX_HANDLETYPE);
+		RPC_SETFIELDVALUE(pData, nPos, pHeld->nBufHdrRemote, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, pHeld->nFlags, OMX_U32);
+	} else
+	{
+		pData = Loopback_InitCallback(pPacket,
+		    RPC_OMX_FXN_IDX_FILLBUFFERDONE);
+		//Marshalled:[>hComp|>bufferHdr|>nFilledLen|>nOffset|>nFlags|>nTimeStamp|>hMarkTargetComponent|>pMarkData]
+		RPC_SETFIELDVALUE(pData, nPos, pSession->hProxy,
+		    OMX_HANDLETYPE);
+		RPC_SETFIELDVALUE(pData, nPos, pHeld->nBufHdrRemote, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, pHeld->nFilledLen, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, pHeld->nFlags, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, pHeld->nTimeStamp, OMX_TICKS);
+		RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_HANDLETYPE);
+		RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_PTR);
+	}
+	Loopback_Send(pSession, pPacket);
+
+	pSession->nReturned++;
+	if (pSession->pRemote->tConfig.nCrashAfter != 0 &&
+	    pSession->nReturned == pSession->pRemote->tConfig.nCrashAfter)
+	{
+		/*The client reads end of file and treats it as a crash */
+		shutdown(pSession->fd, SHUT_RDWR);
+		pSession->bExit = OMX_TRUE;
+		pthread_cond_broadcast(&pSession->tCond);
+	}
+}
+
+/* Returns every buffer held on a port right away, called with tLock held */
+static void Loopback_ReturnAll(LOOPBACK_SESSION * pSession, OMX_U32 nPort)
+{
+	LOOPBACK_PORT *pPort = &pSession->tPorts[nPort];
+
+	while (pPort->nHeld > 0 && pSession->bExit == OMX_FALSE)
+	{
+		LOOPBACK_HELD *pHeld = &pPort->tHeld[pPort->nFirst];
+
+		/*Flushed buffers come back empty */
+		pHeld->nFilledLen = 0;
+		Loopback_BufferDone(pSession, nPort, pHeld);
+		pPort->nFirst =
+		    (pPort->nFirst + 1) % LOOPBACK_REMOTE_MAX_BUFFERS;
+		pPort->nHeld--;
+	}
+}
+
+/* Completes a pending transition to Idle or Loaded once the ports allow it,
+   called with tLock held */
+static void Loopback_CheckTransition(LOOPBACK_SESSION * pSession)
+{
+	OMX_U32 i, nPopulated = 0, nEmpty = 0;
+
+	if (pSession->eTarget == pSession->eState)
+		return;
+
+	for (i = 0; i < LOOPBACK_NUM_PORTS; i++)
+	{
+		if (pSession->tPorts[i].nBuffers >=
+		    pSession->tPorts[i].nBufferCount)
+			nPopulated++;
+		if (pSession->tPorts[i].nBuffers == 0)
+			nEmpty++;
+	}
+
+	if ((pSession->eTarget == OMX_StateIdle &&
+		nPopulated == LOOPBACK_NUM_PORTS) ||
+	    (pSession->eTarget == OMX_StateLoaded &&
+		nEmpty == LOOPBACK_NUM_PORTS))
+	{
+		pSession->eState = pSession->eTarget;
+		Loopback_Event(pSession, OMX_EventCmdComplete,
+		    OMX_CommandStateSet, pSession->eState);
+	}
+}
+
+/* Carries out a command after its call was answered, called with tLock
+   held */
+static void Loopback_Command(LOOPBACK_SESSION * pSession,
+    OMX_COMMANDTYPE eCmd, OMX_U32 nParam)
+{
+	OMX_U32 i;
+
+	switch (eCmd)
+	{
+	case OMX_CommandStateSet:
+		if ((OMX_STATETYPE) nParam == pSession->eState)
+		{
+			Loopback_Event(pSession, OMX_EventError,
+			    OMX_ErrorSameState, 0);
+			break;
+		}
+		if (nParam == OMX_StateIdle &&
+		    pSession->eState != OMX_StateLoaded)
+		{
+			for (i = 0; i < LOOPBACK_NUM_PORTS; i++)
+				Loopback_ReturnAll(pSession, i);
+		}
+		pSession->eTarget = (OMX_STATETYPE) nParam;
+		if ((nParam == OMX_StateIdle &&
+			pSession->eState == OMX_StateLoaded) ||
+		    nParam == OMX_StateLoaded)
+		{
+			Loopback_CheckTransition(pSession);
+		} else
+		{
+			pSession->eState = pSession->eTarget;
+			Loopback_Event(pSession, OMX_EventCmdComplete,
+			    OMX_CommandStateSet, nParam);
+		}
+		break;
+	case OMX_CommandFlush:
+	case OMX_CommandPortDisable:
+	case OMX_CommandPortEnable:
+		for (i = 0; i < LOOPBACK_NUM_PORTS; i++)
+		{
+			if (nParam != OMX_ALL && nParam != i)
+				continue;
+			if (eCmd != OMX_CommandPortEnable)
+				Loopback_ReturnAll(pSession, i);
+			Loopback_Event(pSession, OMX_EventCmdComplete, eCmd, i);
+		}
+		break;
+	default:
+		break;
+	}
+
+	/*Buffers held in Idle start moving */
+	pthread_cond_broadcast(&pSession->tCond);
+}
+
+static void Loopback_FillPortDefinition(LOOPBACK_SESSION * pSession,
+    OMX_PARAM_PORTDEFINITIONTYPE * pPortDef)
+{
+	LOOPBACK_PORT *pPort = &pSession->tPorts[pPortDef->nPortIndex];
+
+	pPortDef->eDir = pPortDef->nPortIndex == LOOPBACK_INPUT_PORT ?
+	    OMX_DirInput : OMX_DirOutput;
+	pPortDef->nBufferCountActual = pPort->nBufferCount;
+	pPortDef->nBufferCountMin = 1;
+	pPortDef->nBufferSize = pPort->nBufferSize;
+	pPortDef->bEnabled = OMX_TRUE;
+	pPortDef->bPopulated = pPort->nBuffers >= pPort->nBufferCount ?
+	    OMX_TRUE : OMX_FALSE;
+	pPortDef->eDomain = OMX_PortDomainOther;
+	pPortDef->bBuffersContiguous = OMX_FALSE;
+	pPortDef->nBufferAlignment = 0;
+}
+
+static LOOPBACK_HEADER *Loopback_FindHeader(LOOPBACK_SESSION * pSession,
+    OMX_U32 nBufHdrRemote)
+{
+	OMX_U32 nSlot = (nBufHdrRemote - LOOPBACK_HDR_BASE) /
+	    LOOPBACK_HDR_STRIDE;
+
+	if (nBufHdrRemote < LOOPBACK_HDR_BASE ||
+	    nSlot >= LOOPBACK_MAX_HEADERS ||
+	    pSession->tHeaders[nSlot].bUsed == OMX_FALSE)
+		return NULL;
+	return &pSession->tHeaders[nSlot];
+}
+
+/* Queues an EmptyThisBuffer/FillThisBuffer, called with tLock held */
+static OMX_ERRORTYPE Loopback_Hold(LOOPBACK_SESSION * pSession,
+    OMX_U32 nPort, OMX_U32 nBufHdrRemote, OMX_U32 nFlags, OMX_TICKS nTimeStamp)
+{
+	const LOOPBACK_REMOTE_CONFIG *pConfig = &pSession->pRemote->tConfig;
+	LOOPBACK_HEADER *pHeader = Loopback_FindHeader(pSession, nBufHdrRemote);
+	LOOPBACK_PORT *pPort = &pSession->tPorts[nPort];
+	LOOPBACK_HELD *pHeld;
+	OMX_U32 nDelayUs;
+
+	if (pHeader == NULL || pHeader->nPort != nPort)
+		return OMX_ErrorBadParameter;
+	if (pSession->eState == OMX_StateLoaded ||
+	    pSession->eState == OMX_StateInvalid)
+		return OMX_ErrorIncorrectStateOperation;
+	if (pPort->nHeld == LOOPBACK_REMOTE_MAX_BUFFERS)
+		return OMX_ErrorInsufficientResources;
+
+	pSession->nSubmitted++;
+	if (pConfig->nErrorEvery != 0 &&
+	    pSession->nSubmitted % pConfig->nErrorEvery == 0)
+		return OMX_ErrorUndefined;
+
+	pHeld = &pPort->tHeld[(pPort->nFirst + pPort->nHeld) %
+	    LOOPBACK_REMOTE_MAX_BUFFERS];
+	pHeld->nBufHdrRemote = nBufHdrRemote;
+	pHeld->nFilledLen = nPort == LOOPBACK_INPUT_PORT ? 0 :
+	    pHeader->nAllocLen;
+	pHeld->nFlags = nFlags;
+	pHeld->nTimeStamp = nTimeStamp;
+
+	/*A port returns its buffers in order whatever the jitter */
+	nDelayUs = pConfig->nLatencyUs;
+	if (pConfig->nJitterUs != 0)
+		nDelayUs += rand_r(&pSession->nSeed) % (pConfig->nJitterUs + 1);
+	Loopback_Now(&pHeld->tDue);
+	Loopback_AddUs(&pHeld->tDue, nDelayUs);
+	if (Loopback_Before(&pHeld->tDue, &pPort->tLastDue))
+		pHeld->tDue = pPort->tLastDue;
+	pPort->tLastDue = pHeld->tDue;
+
+	pPort->nHeld++;
+	return OMX_ErrorNone;
+}
+
+/* Answers one call. The reply starts as a copy of the request, outputs go
+   behind the arguments. A command is left in pCmd to be carried out once
+   the reply is sent. Called with tLock held */
+static void Loopback_Call(LOOPBACK_SESSION * pSession, OMX_U8 * pReply,
+    OMX_BOOL * pCmd, OMX_COMMANDTYPE * pCmdType, OMX_U32 * pCmdParam)
+{
+	struct omx_packet *pOmxPacket = (struct omx_packet *)pReply;
+	OMX_U8 *pData = (OMX_U8 *) pOmxPacket->data;
+	OMX_U32 nFxnIdx = pOmxPacket->fxn_idx & ~LOOPBACK_FXN_STATIC;
+	OMX_ERRORTYPE eCompReturn = OMX_ErrorNone;
+	OMX_U32 nPos = 0, nMapInfo = 0, nPort = 0, nIndex = 0;
+	OMX_U32 nBufHdrRemote = 0, nFlags = 0, nSize = 0;
+	OMX_U32 i;
+	OMX_TICKS nTimeStamp = 0;
+	OMX_HANDLETYPE hComp = NULL;
+	OMX_PTR pValue = NULL;
+	OMX_VERSIONTYPE tVersion;
+	OMX_PARAM_PORTDEFINITIONTYPE *pPortDef = NULL;
+
+	RPC_GETFIELDVALUE(pData, nPos, nMapInfo, OMX_U32);
+	/*Offset of the buffer to map, nothing is mapped here */
+	nPos += sizeof(OMX_U32);
+
+	/*Everything but GetHandle is addressed to the handle it returned */
+	if (nFxnIdx != RPC_OMX_FXN_IDX_GET_HANDLE)
+	{
+		RPC_GETFIELDVALUE(pData, nPos, hComp, OMX_HANDLETYPE);
+		if (hComp != (OMX_HANDLETYPE) pSession)
+		{
+			pOmxPacket->result = OMX_ErrorInvalidComponent;
+			return;
+		}
+	}
+
+	switch (nFxnIdx)
+	{
+	case RPC_OMX_FXN_IDX_GET_HANDLE:
+		nPos += OMX_MAX_STRINGNAME_SIZE;
+		RPC_GETFIELDVALUE(pData, nPos, pSession->hProxy, OMX_PTR);
+		pSession->eState = OMX_StateLoaded;
+		pSession->eTarget = OMX_StateLoaded;
+		/*The context handle and the actual component handle */
+		RPC_SETFIELDVALUE(pData, nPos, pSession, OMX_HANDLETYPE);
+		RPC_SETFIELDVALUE(pData, nPos, pSession, OMX_HANDLETYPE);
+		break;
+
+	case RPC_OMX_FXN_IDX_FREE_HANDLE:
+	case RPC_OMX_FXN_IDX_SET_CONFIG:
+		break;
+
+	case RPC_OMX_FXN_IDX_SET_PARAMETER:
+	case RPC_OMX_FXN_IDX_GET_PARAMETER:
+	case RPC_OMX_FXN_IDX_GET_CONFIG:
+		RPC_GETFIELDVALUE(pData, nPos, nIndex, OMX_U32);
+		if (nIndex != OMX_IndexParamPortDefinition ||
+		    nFxnIdx == RPC_OMX_FXN_IDX_GET_CONFIG)
+			break;
+		/*Other structures go back as they came */
+		pPortDef = (OMX_PARAM_PORTDEFINITIONTYPE *) (pData + nPos);
+		if (pPortDef->nPortIndex >= LOOPBACK_NUM_PORTS)
+		{
+			eCompReturn = OMX_ErrorBadPortIndex;
+			break;
+		}
+		if (nFxnIdx == RPC_OMX_FXN_IDX_SET_PARAMETER)
+		{
+			LOOPBACK_PORT *pPort =
+			    &pSession->tPorts[pPortDef->nPortIndex];
+
+			if (pPortDef->nBufferCountActual == 0 ||
+			    pPortDef->nBufferCountActual >
+			    LOOPBACK_REMOTE_MAX_BUFFERS)
+			{
+				eCompReturn = OMX_ErrorBadParameter;
+				break;
+			}
+			pPort->nBufferCount = pPortDef->nBufferCountActual;
+			if (pPortDef->nBufferSize > pPort->nBufferSize)
+				pPort->nBufferSize = pPortDef->nBufferSize;
+		} else
+		{
+			Loopback_FillPortDefinition(pSession, pPortDef);
+		}
+		break;
+
+	case RPC_OMX_FXN_IDX_GET_STATE:
+		RPC_SETFIELDVALUE(pData, nPos, pSession->eState, OMX_STATETYPE);
+		break;
+
+	case RPC_OMX_FXN_IDX_SEND_CMD:
+		RPC_GETFIELDVALUE(pData, nPos, *pCmdType, OMX_COMMANDTYPE);
+		RPC_GETFIELDVALUE(pData, nPos, *pCmdParam, OMX_U32);
+		*pCmd = OMX_TRUE;
+		break;
+
+	case RPC_OMX_FXN_IDX_GET_VERSION:
+		memset(pData + nPos, 0, OMX_MAX_STRINGNAME_SIZE);
+		strcpy((char *)(pData + nPos), LOOPBACK_COMPONENT_NAME);
+		nPos += OMX_MAX_STRINGNAME_SIZE;
+		tVersion.nVersion = 0;
+		tVersion.s.nVersionMajor = 1;
+		tVersion.s.nVersionMinor = 1;
+		RPC_SETFIELDCOPYTYPE(pData, nPos, &tVersion, OMX_VERSIONTYPE);
+		RPC_SETFIELDCOPYTYPE(pData, nPos, &tVersion, OMX_VERSIONTYPE);
+		memset(pData + nPos, 0, sizeof(OMX_UUIDTYPE));
+		break;
+
+	case RPC_OMX_FXN_IDX_USE_BUFFER:
+		RPC_GETFIELDVALUE(pData, nPos, nPort, OMX_U32);
+		RPC_GETFIELDVALUE(pData, nPos, pValue, OMX_PTR);
+		RPC_GETFIELDVALUE(pData, nPos, nSize, OMX_U32);
+		/*One buffer, plus UV and metadata for the larger map infos */
+		nPos += sizeof(OMX_U32);
+		if (nMapInfo >= RPC_OMX_MAP_INFO_TWO_BUF)
+			nPos += sizeof(OMX_U32);
+		if (nMapInfo >= RPC_OMX_MAP_INFO_THREE_BUF)
+			nPos += sizeof(OMX_U32);
+		if (nPort >= LOOPBACK_NUM_PORTS)
+		{
+			eCompReturn = OMX_ErrorBadPortIndex;
+			break;
+		}
+		for (i = 0; i < LOOPBACK_MAX_HEADERS; i++)
+		{
+			if (pSession->tHeaders[i].bUsed == OMX_FALSE)
+				break;
+		}
+		if (i == LOOPBACK_MAX_HEADERS ||
+		    pSession->tPorts[nPort].nBuffers ==
+		    LOOPBACK_REMOTE_MAX_BUFFERS)
+		{
+			eCompReturn = OMX_ErrorInsufficientResources;
+			break;
+		}
+		pSession->tHeaders[i].bUsed = OMX_TRUE;
+		pSession->tHeaders[i].nPort = nPort;
+		pSession->tHeaders[i].nAllocLen = nSize;
+		pSession->tPorts[nPort].nBuffers++;
+
+		nBufHdrRemote = LOOPBACK_HDR_BASE + i * LOOPBACK_HDR_STRIDE;
+		tVersion.nVersion = 0;
+		tVersion.s.nVersionMajor = 1;
+		tVersion.s.nVersionMinor = 1;
+		RPC_SETFIELDVALUE(pData, nPos, nBufHdrRemote, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, sizeof(OMX_BUFFERHEADERTYPE),
+		    OMX_U32);
+		RPC_SETFIELDCOPYTYPE(pData, nPos, &tVersion, OMX_VERSIONTYPE);
+		RPC_SETFIELDVALUE(pData, nPos, nSize, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, pValue, OMX_PTR);
+		RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_PTR);
+		RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_PTR);
+		RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_HANDLETYPE);
+		RPC_SETFIELDVALUE(pData, nPos, NULL, OMX_PTR);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_TICKS);
+		RPC_SETFIELDVALUE(pData, nPos, 0, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, nPort == LOOPBACK_INPUT_PORT ?
+		    nPort : OMX_NOPORT, OMX_U32);
+		RPC_SETFIELDVALUE(pData, nPos, nPort == LOOPBACK_OUTPUT_PORT ?
+		    nPort : OMX_NOPORT, OMX_U32);
+		break;
+
+	case RPC_OMX_FXN_IDX_FREE_BUFFER:
+		RPC_GETFIELDVALUE(pData, nPos, nPort, OMX_U32);
+		RPC_GETFIELDVALUE(pData, nPos, nBufHdrRemote, OMX_U32);
+		{
+			LOOPBACK_HEADER *pHeader =
+			    Loopback_FindHeader(pSession, nBufHdrRemote);
+
+			if (pHeader == NULL || pHeader->nPort != nPort)
+			{
+				eCompReturn = OMX_ErrorBadParameter;
+				break;
+			}
+			pHeader->bUsed = OMX_FALSE;
+			pSession->tPorts[nPort].nBuffers--;
+		}
+		break;
+
+	case RPC_OMX_FXN_IDX_EMPTYTHISBUFFER:
+		//Marshalled:[>hComp|>bufferHdr|>nFilledLen|>nOffset|>nFlags|>nTimeStamp|...]
+		/*Sent as OMX_BUFFERHEADERTYPE *, the same size */
+		RPC_GETFIELDVALUE(pData, nPos, nBufHdrRemote, OMX_U32);
+		/*nFilledLen and nOffset */
+		nPos += 2 * sizeof(OMX_U32);
+		RPC_GETFIELDVALUE(pData, nPos, nFlags, OMX_U32);
+		RPC_GETFIELDVALUE(pData, nPos, nTimeStamp, OMX_TICKS);
+		eCompReturn = Loopback_Hold(pSession, LOOPBACK_INPUT_PORT,
+		    nBufHdrRemote, nFlags, nTimeStamp);
+		if (eCompReturn == OMX_ErrorNone)
+			pSession->nLastTimeStamp = nTimeStamp;
+		break;
+
+	case RPC_OMX_FXN_IDX_FILLTHISBUFFER:
+		//Marshalled:[>hComp|>bufferHdr|>nFilledLen|>nOffset|>nFlags|...]
+		/*Sent as OMX_BUFFERHEADERTYPE *, the same size */
+		RPC_GETFIELDVALUE(pData, nPos, nBufHdrRemote, OMX_U32);
+		/*nFilledLen and nOffset */
+		nPos += 2 * sizeof(OMX_U32);
+		RPC_GETFIELDVALUE(pData, nPos, nFlags, OMX_U32);
+		eCompReturn = Loopback_Hold(pSession, LOOPBACK_OUTPUT_PORT,
+		    nBufHdrRemote, nFlags, pSession->nLastTimeStamp);
+		break;
+
+	case RPC_OMX_FXN_IDX_GET_EXT_INDEX:
+		eCompReturn = OMX_ErrorUnsupportedIndex;
+		break;
+
+	default:
+		/*AllocateBuffer included, the proxy allocates all buffers */
+		eCompReturn = OMX_ErrorNotImplemented;
+		break;
+	}
+
+	pOmxPacket->result = eCompReturn;
+}
+
+/* Sends buffers back as they become due */
+static void *Loopback_Worker(void *data)
+{
+	LOOPBACK_SESSION *pSession = (LOOPBACK_SESSION *) data;
+	struct timespec tNow;
+	OMX_U32 i, nPort;
+
+	pthread_mutex_lock(&pSession->tLock);
+	while (pSession->bExit == OMX_FALSE)
+	{
+		LOOPBACK_PORT *pPort = NULL;
+
+		/*The port whose first buffer is due first */
+		for (i = 0; i < LOOPBACK_NUM_PORTS; i++)
+		{
+			LOOPBACK_PORT *pCandidate = &pSession->tPorts[i];
+
+			if (pCandidate->nHeld == 0)
+				continue;
+			if (pPort == NULL ||
+			    Loopback_Before(&pCandidate->tHeld[pCandidate->
+				    nFirst].tDue, &pPort->tHeld[pPort->nFirst].tDue))
+			{
+				pPort = pCandidate;
+				nPort = i;
+			}
+		}
+
+		if (pPort == NULL || pSession->eState != OMX_StateExecuting)
+		{
+			pthread_cond_wait(&pSession->tCond, &pSession->tLock);
+			continue;
+		}
+
+		Loopback_Now(&tNow);
+		if (Loopback_Before(&tNow, &pPort->tHeld[pPort->nFirst].tDue))
+		{
+			pthread_cond_timedwait(&pSession->tCond,
+			    &pSession->tLock, &pPort->tHeld[pPort->nFirst].tDue);
+			continue;
+		}
+
+		Loopback_BufferDone(pSession, nPort,
+		    &pPort->tHeld[pPort->nFirst]);
+		pPort->nFirst =
+		    (pPort->nFirst + 1) % LOOPBACK_REMOTE_MAX_BUFFERS;
+		pPort->nHeld--;
+	}
+	pthread_mutex_unlock(&pSession->tLock);
+
+	return NULL;
+}
+
+/* Reads and answers calls until the client goes away */
+static void *Loopback_Reader(void *data)
+{
+	LOOPBACK_SESSION *pSession = (LOOPBACK_SESSION *) data;
+	OMX_U8 pPacket[RPC_PACKET_SIZE];
+	OMX_COMMANDTYPE eCmd = OMX_CommandMax;
+	OMX_U32 nCmdParam = 0;
+	OMX_BOOL bCmd;
+	ssize_t status;
+
+	while (1)
+	{
+		status = recv(pSession->fd, pPacket, RPC_PACKET_SIZE, 0);
+		if (status <= 0)
+			break;
+		if (status < (ssize_t) sizeof(struct omx_packet))
+			continue;
+		memset(pPacket + status, 0, RPC_PACKET_SIZE - status);
+
+		pthread_mutex_lock(&pSession->tLock);
+		if (pSession->bExit == OMX_TRUE)
+		{
+			pthread_mutex_unlock(&pSession->tLock);
+			break;
+		}
+		bCmd = OMX_FALSE;
+		Loopback_Call(pSession, pPacket, &bCmd, &eCmd, &nCmdParam);
+		Loopback_Send(pSession, pPacket);
+		if (bCmd == OMX_TRUE)
+			Loopback_Command(pSession, eCmd, nCmdParam);
+		Loopback_CheckTransition(pSession);
+		pthread_cond_broadcast(&pSession->tCond);
+		pthread_mutex_unlock(&pSession->tLock);
+	}
+
+	pthread_mutex_lock(&pSession->tLock);
+	pSession->bExit = OMX_TRUE;
+	pthread_cond_broadcast(&pSession->tCond);
+	pthread_mutex_unlock(&pSession->tLock);
+	pthread_join(pSession->tWorker, NULL);
+
+	pthread_mutex_lock(&pSession->pRemote->tLock);
+	pSession->bDone = OMX_TRUE;
+	pthread_mutex_unlock(&pSession->pRemote->tLock);
+
+	return NULL;
+}
+
+static void Loopback_FreeSession(LOOPBACK_SESSION * pSession)
+{
+	pthread_join(pSession->tReader, NULL);
+	close(pSession->fd);
+	pthread_cond_destroy(&pSession->tCond);
+	pthread_mutex_destroy(&pSession->tLock);
+	free(pSession);
+}
+
+/* Frees sessions whose client went away, or all of them when stopping */
+static void Loopback_Reap(LOOPBACK_REMOTE * pRemote, OMX_BOOL bAll)
+{
+	LOOPBACK_SESSION **ppSession = &pRemote->pSessions;
+
+	pthread_mutex_lock(&pRemote->tLock);
+	while (*ppSession != NULL)
+	{
+		LOOPBACK_SESSION *pSession = *ppSession;
+
+		if (bAll == OMX_FALSE && pSession->bDone == OMX_FALSE)
+		{
+			ppSession = &pSession->pNext;
+			continue;
+		}
+		*ppSession = pSession->pNext;
+		pthread_mutex_unlock(&pRemote->tLock);
+		/*Wakes a reader still waiting for its client */
+		shutdown(pSession->fd, SHUT_RDWR);
+		Loopback_FreeSession(pSession);
+		pthread_mutex_lock(&pRemote->tLock);
+	}
+	pthread_mutex_unlock(&pRemote->tLock);
+}
+
+static void Loopback_Accept(LOOPBACK_REMOTE * pRemote)
+{
+	LOOPBACK_SESSION *pSession;
+	OMX_S32 fd = accept(pRemote->fdListen, NULL, NULL);
+	OMX_U32 i;
+
+	if (fd < 0)
+		return;
+
+	pSession = calloc(1, sizeof(LOOPBACK_SESSION));
+	if (pSession == NULL)
+	{
+		close(fd);
+		return;
+	}
+	pSession->pRemote = pRemote;
+	pSession->fd = fd;
+	pSession->eState = OMX_StateLoaded;
+	pSession->eTarget = OMX_StateLoaded;
+	pSession->nSeed = (unsigned int)fd;
+	for (i = 0; i < LOOPBACK_NUM_PORTS; i++)
+	{
+		pSession->tPorts[i].nBufferCount = pRemote->tConfig.nBufferCount;
+		pSession->tPorts[i].nBufferSize = pRemote->tConfig.nBufferSize;
+	}
+	pthread_mutex_init(&pSession->tLock, NULL);
+	pthread_cond_init(&pSession->tCond, NULL);
+
+	if (pthread_create(&pSession->tWorker, NULL, Loopback_Worker,
+		pSession) != 0)
+	{
+		close(fd);
+		free(pSession);
+		return;
+	}
+	if (pthread_create(&pSession->tReader, NULL, Loopback_Reader,
+		pSession) != 0)
+	{
+		pthread_mutex_lock(&pSession->tLock);
+		pSession->bExit = OMX_TRUE;
+		pthread_cond_broadcast(&pSession->tCond);
+		pthread_mutex_unlock(&pSession->tLock);
+		pthread_join(pSession->tWorker, NULL);
+		close(fd);
+		free(pSession);
+		return;
+	}
+
+	pthread_mutex_lock(&pRemote->tLock);
+	pSession->pNext = pRemote->pSessions;
+	pRemote->pSessions = pSession;
+	pthread_mutex_unlock(&pRemote->tLock);
+}
+
+static void *Loopback_Listener(void *data)
+{
+	LOOPBACK_REMOTE *pRemote = (LOOPBACK_REMOTE *) data;
+	struct pollfd tFds[2];
+
+	tFds[0].fd = pRemote->fdListen;
+	tFds[0].events = POLLIN;
+	tFds[1].fd = pRemote->fdKill;
+	tFds[1].events = POLLIN;
+
+	while (1)
+	{
+		tFds[0].revents = 0;
+		tFds[1].revents = 0;
+		if (poll(tFds, 2, -1) < 0 && errno != EINTR)
+			break;
+		if (tFds[1].revents != 0)
+			break;
+		if (tFds[0].revents != 0)
+		{
+			Loopback_Reap(pRemote, OMX_FALSE);
+			Loopback_Accept(pRemote);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name LoopbackRemote_DefaultConfig()
+ * @brief Fills in a configuration with immediate returns, four 64 kB
+ *        buffers per port and no faults.
+ * @param pConfig [OUT] : Configuration to fill in.
+ * @return none
+ */
+/* ===========================================================================*/
+void LoopbackRemote_DefaultConfig(LOOPBACK_REMOTE_CONFIG * pConfig)
+{
+	memset(pConfig, 0, sizeof(LOOPBACK_REMOTE_CONFIG));
+	pConfig->nBufferCount = 4;
+	pConfig->nBufferSize = 64 * 1024;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name LoopbackRemote_Start()
+ * @brief Starts serving the packet protocol on a unix socket. Clients reach
+ *        it with DEBUG_DOMX_RPC_LOOPBACK set to the same path.
+ * @param cPath [IN]     : Socket path, an old socket there is replaced.
+ * @param pConfig [IN]   : Behaviour of the fake component.
+ * @param ppRemote [OUT] : The running loopback remote core.
+ * @return OMX_ErrorNone = Successful
+ */
+/* ===========================================================================*/
+OMX_ERRORTYPE LoopbackRemote_Start(const char *cPath,
+    const LOOPBACK_REMOTE_CONFIG * pConfig, LOOPBACK_REMOTE ** ppRemote)
+{
+	OMX_ERRORTYPE eError = OMX_ErrorNone;
+	LOOPBACK_REMOTE *pRemote = NULL;
+
+	*ppRemote = NULL;
+	if (strlen(cPath) >= sizeof(pRemote->sAddr.sun_path) ||
+	    pConfig->nBufferCount == 0 ||
+	    pConfig->nBufferCount > LOOPBACK_REMOTE_MAX_BUFFERS)
+	{
+		eError = OMX_ErrorBadParameter;
+		goto EXIT;
+	}
+
+	pRemote = calloc(1, sizeof(LOOPBACK_REMOTE));
+	if (pRemote == NULL)
+	{
+		eError = OMX_ErrorInsufficientResources;
+		goto EXIT;
+	}
+	pRemote->tConfig = *pConfig;
+	pRemote->fdListen = -1;
+	pRemote->fdKill = -1;
+	pthread_mutex_init(&pRemote->tLock, NULL);
+
+	pRemote->sAddr.sun_family = AF_UNIX;
+	strcpy(pRemote->sAddr.sun_path, cPath);
+	unlink(cPath);
+
+	pRemote->fdListen = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	pRemote->fdKill = eventfd(0, 0);
+	if (pRemote->fdListen < 0 || pRemote->fdKill < 0 ||
+	    bind(pRemote->fdListen, (struct sockaddr *)&pRemote->sAddr,
+		sizeof(pRemote->sAddr)) < 0 ||
+	    listen(pRemote->fdListen, 8) < 0 ||
+	    pthread_create(&pRemote->tListener, NULL, Loopback_Listener,
+		pRemote) != 0)
+	{
+		eError = OMX_ErrorInsufficientResources;
+		goto EXIT;
+	}
+
+	*ppRemote = pRemote;
+
+      EXIT:
+	if (eError != OMX_ErrorNone && pRemote != NULL)
+	{
+		if (pRemote->fdListen >= 0)
+			close(pRemote->fdListen);
+		if (pRemote->fdKill >= 0)
+			close(pRemote->fdKill);
+		unlink(cPath);
+		pthread_mutex_destroy(&pRemote->tLock);
+		free(pRemote);
+	}
+	return eError;
+}
+
+
+
+/* ===========================================================================*/
+/**
+ * @name LoopbackRemote_Stop()
+ * @brief Drops all connections and stops serving. Clients still connected
+ *        see the remote core crash.
+ * @param pRemote [IN] : The loopback remote core.
+ * @return none
+ */
+/* ===========================================================================*/
+void LoopbackRemote_Stop(LOOPBACK_REMOTE * pRemote)
+{
+	OMX_U64 nKill = 1;
+
+	if (pRemote == NULL)
+		return;
+
+	if (write(pRemote->fdKill, &nKill, sizeof(nKill)) ==
+	    (ssize_t) sizeof(nKill))
+		pthread_join(pRemote->tListener, NULL);
+	Loopback_Reap(pRemote, OMX_TRUE);
+
+	close(pRemote->fdListen);
+	close(pRemote->fdKill);
+	unlink(pRemote->sAddr.sun_path);
+	pthread_mutex_destroy(&pRemote->tLock);
+	free(pRemote);
+}
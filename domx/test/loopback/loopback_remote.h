@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ *  @file  loopback_remote.h
+ *         A loopback remote core for DOMX. It serves the rpmsg-omx packet
+ *         protocol on a local socket and plays a simple two port component,
+ *         so the proxy and RPC layers can run and be measured without the
+ *         remote processor.
+ *
+ *  @path \WTSD_DucatiMMSW\framework\domx\test\loopback
+ *
+ *  @rev 1.0
+ */
+
+#ifndef LOOPBACK_REMOTE_H
+#define LOOPBACK_REMOTE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif				/* __cplusplus */
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+#include <OMX_Core.h>
+
+
+/******************************************************************
+ *   DEFINES - CONSTANTS
+ ******************************************************************/
+/*Default socket path, also what DEBUG_DOMX_RPC_LOOPBACK is set to*/
+#define LOOPBACK_REMOTE_PATH "/data/local/tmp/domx_loopback"
+
+/*Buffers the fake component can hold per port*/
+#define LOOPBACK_REMOTE_MAX_BUFFERS 32
+
+
+/******************************************************************
+ *   STRUCTURES
+ ******************************************************************/
+/*===============================================================*/
+/** LOOPBACK_REMOTE_CONFIG : Behaviour of the fake component.
+ *
+ *  @ param nLatencyUs    : Time an EmptyThisBuffer/FillThisBuffer spends
+ *                          on the remote core before it comes back.
+ *  @ param nJitterUs     : Up to this much is added at random to each
+ *                          latency. Buffers of a port still come back in
+ *                          the order they were sent.
+ *  @ param nBufferCount  : nBufferCountActual of both ports.
+ *  @ param nBufferSize   : nBufferSize of both ports.
+ *  @ param nCrashAfter   : The connection is dropped after this many
+ *                          buffers came back, as if the remote core had
+ *                          crashed. 0 never crashes.
+ *  @ param nErrorEvery   : Every nth EmptyThisBuffer/FillThisBuffer is
+ *                          refused with OMX_ErrorUndefined. 0 refuses
+ *                          none.
+ */
+/*===============================================================*/
+	typedef struct LOOPBACK_REMOTE_CONFIG
+	{
+		OMX_U32 nLatencyUs;
+		OMX_U32 nJitterUs;
+		OMX_U32 nBufferCount;
+		OMX_U32 nBufferSize;
+		OMX_U32 nCrashAfter;
+		OMX_U32 nErrorEvery;
+	} LOOPBACK_REMOTE_CONFIG;
+
+	typedef struct LOOPBACK_REMOTE LOOPBACK_REMOTE;
+
+
+/******************************************************************
+ *   FUNCTIONS
+ ******************************************************************/
+	void LoopbackRemote_DefaultConfig(LOOPBACK_REMOTE_CONFIG * pConfig);
+
+	OMX_ERRORTYPE LoopbackRemote_Start(const char *cPath,
+	    const LOOPBACK_REMOTE_CONFIG * pConfig,
+	    LOOPBACK_REMOTE ** ppRemote);
+
+	void LoopbackRemote_Stop(LOOPBACK_REMOTE * pRemote);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
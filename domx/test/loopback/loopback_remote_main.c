@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ *  @file  loopback_remote_main.c
+ *         Runs the loopback remote core on its own, for DOMX clients in
+ *         other processes. Start it, then run the client with
+ *         DEBUG_DOMX_RPC_LOOPBACK set to the socket path, e.g.
+ *
+ *           domx_loopback_remote -l 2000 &
+ *           DEBUG_DOMX_RPC_LOOPBACK=/data/local/tmp/domx_loopback \
+ *               domx_buffer_ownership_test
+ *
+ *  Usage: domx_loopback_remote [-p socket path] [-l latency us]
+ *                              [-j jitter us] [-b buffers per port]
+ *                              [-s buffer size] [-x crash after n buffers]
+ *                              [-e refuse every nth buffer]
+ */
+
+/****************************************************************
+*  INCLUDE FILES
+****************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*-------program files ----------------------------------------*/
+#include "loopback_remote.h"
+
+
+int main(int argc, char **argv)
+{
+	LOOPBACK_REMOTE_CONFIG tConfig;
+	LOOPBACK_REMOTE *pRemote = NULL;
+	const char *cPath = LOOPBACK_REMOTE_PATH;
+	OMX_ERRORTYPE eError;
+	sigset_t tSignals;
+	int c, nSignal;
+
+	LoopbackRemote_DefaultConfig(&tConfig);
+
+	while ((c = getopt(argc, argv, "p:l:j:b:s:x:e:")) != -1)
+	{
+		switch (c)
+		{
+		case 'p':
+			cPath = optarg;
+			break;
+		case 'l':
+			tConfig.nLatencyUs = atoi(optarg);
+			break;
+		case 'j':
+			tConfig.nJitterUs = atoi(optarg);
+			break;
+		case 'b':
+			tConfig.nBufferCount = atoi(optarg);
+			break;
+		case 's':
+			tConfig.nBufferSize = atoi(optarg);
+			break;
+		case 'x':
+			tConfig.nCrashAfter = atoi(optarg);
+			break;
+		case 'e':
+			tConfig.nErrorEvery = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p path] [-l latency us] "
+			    "[-j jitter us] [-b buffers] [-s size] [-x crash after] "
+			    "[-e error every]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (tConfig.nBufferCount == 0 ||
+	    tConfig.nBufferCount > LOOPBACK_REMOTE_MAX_BUFFERS)
+	{
+		fprintf(stderr, "1 to %d buffers per port\n",
+		    LOOPBACK_REMOTE_MAX_BUFFERS);
+		return 2;
+	}
+
+	/* taken synchronously below, the server threads must not see them */
+	sigemptyset(&tSignals);
+	sigaddset(&tSignals, SIGINT);
+	sigaddset(&tSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &tSignals, NULL);
+
+	eError = LoopbackRemote_Start(cPath, &tConfig, &pRemote);
+	if (eError != OMX_ErrorNone)
+	{
+		printf("Cannot serve %s: 0x%x\n", cPath, eError);
+		return 1;
+	}
+	printf("Serving %s, latency %u us, jitter %u us, %u buffers of %u "
+	    "bytes per port\n", cPath, (unsigned int)tConfig.nLatencyUs,
+	    (unsigned int)tConfig.nJitterUs, (unsigned int)tConfig.nBufferCount,
+	    (unsigned int)tConfig.nBufferSize);
+
+	sigwait(&tSignals, &nSignal);
+
+	LoopbackRemote_Stop(pRemote);
+	return 0;
+}
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *  @file  mem_pool_test.c
+ *         Checks the size class pools behind TIMM_OSAL_Malloc and
+ *         TIMM_OSAL_Free on the host.
+ *
+ *  The test fails if
+ *   - two live blocks overlap, checked by a pattern every thread writes
+ *     into its blocks and verifies before freeing them, while blocks are
+ *     also handed to other threads to be freed there,
+ *   - a block is not aligned as requested, or a bad alignment is accepted,
+ *   - a double free is not reported, or changes the statistics, or puts
+ *     the block on a free list twice,
+ *   - the statistics of a segment do not return to where they started
+ *     once every block is freed.
+ *
+ *  Usage: domx_mem_pool_test [-t threads] [-n rounds per thread]
+ */
+
+/****************************************************************
+*  INCLUDE FILES
+****************************************************************/
+/* ----- system and platform files ----------------------------*/
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*-------program files ----------------------------------------*/
+#include <timm_osal_types.h>
+#include <timm_osal_memory.h>
+
+
+/****************************************************************
+*  PRIVATE DECLARATIONS Defined and used only here
+****************************************************************/
+#define TEST_MAX_THREADS 16
+#define TEST_SLOTS 64
+/*Larger than the biggest size class, so some blocks bypass the pools */
+#define TEST_MAX_SIZE 6000
+
+typedef struct TEST_BLOCK
+{
+	TIMM_OSAL_U8 *pData;
+	TIMM_OSAL_U32 nSize;
+	TIMM_OSAL_U8 nFill;
+} TEST_BLOCK;
+
+typedef struct TEST_THREAD
+{
+	pthread_t tThread;
+	TIMM_OSAL_U32 nIndex;
+	TIMM_OSAL_U32 nRounds;
+	TIMM_OSAL_U32 nAllocs;
+	TIMM_OSAL_U32 nCorrupted;
+} TEST_THREAD;
+
+/*Blocks in transit between threads, freed by whoever takes them */
+static pthread_mutex_t gExchangeLock = PTHREAD_MUTEX_INITIALIZER;
+static TEST_BLOCK gExchange[TEST_SLOTS];
+
+static TIMM_OSAL_U32 gFailures;
+
+
+static void Test_Fail(const char *cMsg)
+{
+	printf("FAIL: %s\n", cMsg);
+	gFailures++;
+}
+
+static TIMM_OSAL_U32 Test_Random(TIMM_OSAL_U32 * pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 8;
+}
+
+static TIMM_OSAL_U32 Test_Stats(TIMMOSAL_MEM_SEGMENTID eSeg,
+    TIMM_OSAL_MEM_STATS * pStats)
+{
+	if (TIMM_OSAL_GetMemStats(eSeg, pStats) != TIMM_OSAL_ERR_NONE)
+	{
+		Test_Fail("GetMemStats failed");
+		return 0;
+	}
+	return 1;
+}
+
+/* Returns the number of bytes that lost their fill pattern */
+static TIMM_OSAL_U32 Test_Release(TEST_BLOCK * pBlock)
+{
+	TIMM_OSAL_U32 i, nBad = 0;
+
+	if (pBlock->pData == NULL)
+		return 0;
+	for (i = 0; i < pBlock->nSize; i++)
+	{
+		if (pBlock->pData[i] != pBlock->nFill)
+			nBad++;
+	}
+	TIMM_OSAL_Free(pBlock->pData);
+	pBlock->pData = NULL;
+	return nBad;
+}
+
+/* Replaces random slots with blocks of random size, and swaps some with
+   the exchange so they are freed by another thread */
+static void *Test_StressThread(void *pArg)
+{
+	TEST_THREAD *pThread = (TEST_THREAD *) pArg;
+	TEST_BLOCK tSlot[TEST_SLOTS], tSwap;
+	TIMM_OSAL_U32 nSeed = pThread->nIndex * 2654435761U + 1;
+	TIMM_OSAL_U32 i, n, r;
+
+	memset(tSlot, 0, sizeof(tSlot));
+	for (i = 0; i < pThread->nRounds; i++)
+	{
+		r = Test_Random(&nSeed);
+		n = r % TEST_SLOTS;
+		pThread->nCorrupted += Test_Release(&tSlot[n]);
+
+		/*Mostly small blocks, as DOMX allocates them */
+		tSlot[n].nSize = (r & 0x700) ? 1 + (r >> 12) % 256 :
+		    1 + (r >> 12) % TEST_MAX_SIZE;
+		tSlot[n].nFill = (TIMM_OSAL_U8) (pThread->nIndex * 31 + i);
+		tSlot[n].pData = (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(tSlot[n].nSize,
+		    TIMM_OSAL_TRUE, 0, (TIMMOSAL_MEM_SEGMENTID) (r % 3));
+		if (tSlot[n].pData == NULL)
+		{
+			pThread->nCorrupted++;
+			continue;
+		}
+		pThread->nAllocs++;
+		memset(tSlot[n].pData, tSlot[n].nFill, tSlot[n].nSize);
+
+		if ((r & 0x7) == 0)
+		{
+			pthread_mutex_lock(&gExchangeLock);
+			tSwap = gExchange[n];
+			gExchange[n] = tSlot[n];
+			pthread_mutex_unlock(&gExchangeLock);
+			tSlot[n] = tSwap;
+		}
+	}
+
+	for (n = 0; n < TEST_SLOTS; n++)
+		pThread->nCorrupted += Test_Release(&tSlot[n]);
+	return NULL;
+}
+
+/* Runs the stress threads and checks the totals once they are gone, which
+   also folds their cached statistics */
+static void Test_Stress(TIMM_OSAL_U32 nThreads, TIMM_OSAL_U32 nRounds)
+{
+	TEST_THREAD tThreads[TEST_MAX_THREADS];
+	TIMM_OSAL_MEM_STATS tBefore[3], tAfter[3];
+	TIMM_OSAL_U32 i, s, nAllocs = 0, nCorrupted = 0;
+
+	for (s = 0; s < 3; s++)
+		Test_Stats((TIMMOSAL_MEM_SEGMENTID) s, &tBefore[s]);
+
+	memset(tThreads, 0, sizeof(tThreads));
+	for (i = 0; i < nThreads; i++)
+	{
+		tThreads[i].nIndex = i + 1;
+		tThreads[i].nRounds = nRounds;
+		if (pthread_create(&tThreads[i].tThread, NULL,
+			Test_StressThread, &tThreads[i]) != 0)
+		{
+			Test_Fail("pthread_create failed");
+			nThreads = i;
+			break;
+		}
+	}
+	for (i = 0; i < nThreads; i++)
+	{
+		pthread_join(tThreads[i].tThread, NULL);
+		nAllocs += tThreads[i].nAllocs;
+		nCorrupted += tThreads[i].nCorrupted;
+	}
+	for (i = 0; i < TEST_SLOTS; i++)
+		nCorrupted += Test_Release(&gExchange[i]);
+
+	printf("stress: %u threads, %u allocations, %u corrupted bytes\n",
+	    nThreads, nAllocs, nCorrupted);
+	if (nCorrupted)
+		Test_Fail("blocks overlapped or failed to allocate");
+
+	for (s = 0; s < 3; s++)
+	{
+		Test_Stats((TIMMOSAL_MEM_SEGMENTID) s, &tAfter[s]);
+		if (tAfter[s].nBlocks != tBefore[s].nBlocks ||
+		    tAfter[s].nBytes != tBefore[s].nBytes)
+		{
+			printf("segment %u: %u blocks of %u bytes, expected %u "
+			    "of %u\n", s, tAfter[s].nBlocks, tAfter[s].nBytes,
+			    tBefore[s].nBlocks, tBefore[s].nBytes);
+			Test_Fail("stress left the statistics unbalanced");
+		}
+		nAllocs -= tAfter[s].nAllocs - tBefore[s].nAllocs;
+	}
+	if (nAllocs != 0)
+		Test_Fail("allocation count does not match");
+}
+
+static void Test_Alignment(void)
+{
+	static const TIMM_OSAL_U32 nAligns[] = { 0, 1, 16, 32, 64, 128, 4096 };
+	static const TIMM_OSAL_U32 nSizes[] = { 1, 100, 4096, 5000 };
+	TIMM_OSAL_U8 *pData;
+	TIMM_OSAL_U32 a, s, nAlign;
+
+	for (a = 0; a < sizeof(nAligns) / sizeof(nAligns[0]); a++)
+	{
+		for (s = 0; s < sizeof(nSizes) / sizeof(nSizes[0]); s++)
+		{
+			pData = (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(nSizes[s],
+			    TIMM_OSAL_TRUE, nAligns[a],
+			    TIMMOSAL_MEM_SEGMENT_EXT);
+			/*Every block is at least 16 byte aligned */
+			nAlign = nAligns[a] > 16 ? nAligns[a] : 16;
+			if (pData == NULL || ((uintptr_t) pData & (nAlign - 1)))
+			{
+				printf("%u bytes aligned to %u: %p\n",
+				    nSizes[s], nAligns[a], pData);
+				Test_Fail("block not aligned");
+			}
+			if (pData != NULL)
+			{
+				memset(pData, 0xA5, nSizes[s]);
+				TIMM_OSAL_Free(pData);
+			}
+		}
+	}
+
+	pData = (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(64, TIMM_OSAL_TRUE, 24,
+	    TIMMOSAL_MEM_SEGMENT_EXT);
+	if (pData != NULL)
+	{
+		Test_Fail("alignment that is not a power of two accepted");
+		TIMM_OSAL_Free(pData);
+	}
+}
+
+/* Frees pData with the traces, which go to stdout on the host, captured
+   into cLog */
+static void Test_FreeCaptured(TIMM_OSAL_PTR pData, char *cLog, size_t nLog)
+{
+	FILE *pFile = tmpfile();
+	int nSaved;
+	size_t nRead;
+
+	cLog[0] = '\0';
+	if (pFile == NULL)
+	{
+		Test_Fail("tmpfile failed");
+		return;
+	}
+	fflush(stdout);
+	nSaved = dup(STDOUT_FILENO);
+	dup2(fileno(pFile), STDOUT_FILENO);
+
+	TIMM_OSAL_Free(pData);
+
+	fflush(stdout);
+	dup2(nSaved, STDOUT_FILENO);
+	close(nSaved);
+
+	rewind(pFile);
+	nRead = fread(cLog, 1, nLog - 1, pFile);
+	cLog[nRead] = '\0';
+	fclose(pFile);
+}
+
+/* Only pooled blocks, a large one goes back to malloc and must not be
+   touched once freed */
+static void Test_DoubleFree(void)
+{
+	TIMM_OSAL_MEM_STATS tBefore, tAfter;
+	TIMM_OSAL_U8 *pData, *pFirst, *pSecond;
+	char cLog[512];
+
+	pData = (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(48, TIMM_OSAL_TRUE, 0,
+	    TIMMOSAL_MEM_SEGMENT_INT);
+	if (pData == NULL)
+	{
+		Test_Fail("Malloc failed");
+		return;
+	}
+	TIMM_OSAL_Free(pData);
+
+	Test_Stats(TIMMOSAL_MEM_SEGMENT_INT, &tBefore);
+	Test_FreeCaptured(pData, cLog, sizeof(cLog));
+	Test_Stats(TIMMOSAL_MEM_SEGMENT_INT, &tAfter);
+
+	if (strstr(cLog, "Double free") == NULL)
+		Test_Fail("double free not reported");
+	if (tAfter.nBlocks != tBefore.nBlocks ||
+	    tAfter.nBytes != tBefore.nBytes)
+		Test_Fail("double free changed the statistics");
+
+	/*The block was listed once, so it cannot come back twice */
+	pFirst = (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(48, TIMM_OSAL_TRUE, 0,
+	    TIMMOSAL_MEM_SEGMENT_INT);
+	pSecond = (TIMM_OSAL_U8 *) TIMM_OSAL_Malloc(48, TIMM_OSAL_TRUE, 0,
+	    TIMMOSAL_MEM_SEGMENT_INT);
+	if (pFirst == NULL || pFirst == pSecond)
+		Test_Fail("double freed block handed out twice");
+	TIMM_OSAL_Free(pFirst);
+	TIMM_OSAL_Free(pSecond);
+}
+
+/* Allocates a few blocks in every segment and checks they are counted
+   where they belong, and gone once freed */
+static void Test_Balance(void)
+{
+	static const TIMM_OSAL_U32 nSizes[] = { 8, 200, 4096, 10000 };
+	TIMM_OSAL_MEM_STATS tBefore[3], tLive[3], tAfter[3];
+	TIMM_OSAL_PTR pData[3][4];
+	TIMM_OSAL_U32 s, i, nBlocks, nBytes = 0;
+
+	for (i = 0; i < 4; i++)
+		nBytes += nSizes[i];
+
+	nBlocks = TIMM_OSAL_GetMemCounter();
+	for (s = 0; s < 3; s++)
+	{
+		Test_Stats((TIMMOSAL_MEM_SEGMENTID) s, &tBefore[s]);
+		for (i = 0; i < 4; i++)
+			pData[s][i] = TIMM_OSAL_Malloc(nSizes[i],
+			    TIMM_OSAL_TRUE, i == 3 ? 64 : 0,
+			    (TIMMOSAL_MEM_SEGMENTID) s);
+	}
+
+	if (TIMM_OSAL_GetMemCounter() != nBlocks + 3 * 4)
+		Test_Fail("block counter off");
+	for (s = 0; s < 3; s++)
+	{
+		Test_Stats((TIMMOSAL_MEM_SEGMENTID) s, &tLive[s]);
+		if (tLive[s].nBlocks != tBefore[s].nBlocks + 4 ||
+		    tLive[s].nBytes != tBefore[s].nBytes + nBytes ||
+		    tLive[s].nAllocs != tBefore[s].nAllocs + 4 ||
+		    tLive[s].nPeakBytes < tLive[s].nBytes)
+		{
+			printf("segment %u: %u blocks of %u bytes, peak %u\n",
+			    s, tLive[s].nBlocks, tLive[s].nBytes,
+			    tLive[s].nPeakBytes);
+			Test_Fail("allocations not counted");
+		}
+	}
+
+	for (s = 0; s < 3; s++)
+	{
+		for (i = 0; i < 4; i++)
+			TIMM_OSAL_Free(pData[s][i]);
+		Test_Stats((TIMMOSAL_MEM_SEGMENTID) s, &tAfter[s]);
+		if (tAfter[s].nBlocks != tBefore[s].nBlocks ||
+		    tAfter[s].nBytes != tBefore[s].nBytes ||
+		    tAfter[s].nPeakBytes != tLive[s].nPeakBytes)
+			Test_Fail("frees not counted");
+	}
+	if (TIMM_OSAL_GetMemCounter() != nBlocks)
+		Test_Fail("block counter not back");
+
+	if (TIMM_OSAL_GetMemStats((TIMMOSAL_MEM_SEGMENTID) 3,
+		&tAfter[0]) != TIMM_OSAL_ERR_PARAMETER)
+		Test_Fail("unknown segment accepted");
+}
+
+int main(int argc, char **argv)
+{
+	TIMM_OSAL_U32 nThreads = 4;
+	TIMM_OSAL_U32 nRounds = 200000;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:n:")) != -1)
+	{
+		switch (c)
+		{
+		case 't':
+			nThreads = atoi(optarg);
+			break;
+		case 'n':
+			nRounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-n rounds]\n",
+			    argv[0]);
+			return 2;
+		}
+	}
+	if (nThreads < 1 || nThreads > TEST_MAX_THREADS)
+	{
+		fprintf(stderr, "1 to %d threads\n", TEST_MAX_THREADS);
+		return 2;
+	}
+
+	/*The pools are what is tested, and the double free check relies on
+	   the freed block staying with them */
+	setenv("TIMM_OSAL_MEM_POOL", "1", 1);
+	TIMM_OSAL_CreateMemoryPool();
+
+	Test_Balance();
+	Test_Alignment();
+	Test_DoubleFree();
+	Test_Stress(nThreads, nRounds);
+	Test_Balance();
+
+	TIMM_OSAL_DeleteMemoryPool();
+
+	printf("%s\n", gFailures ? "FAILED" : "PASSED");
+	return gFailures ? 1 : 0;
+}
@@ -17,6 +17,8 @@
 
 #include <android/log.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <time.h>
 #include <stdarg.h>
 
@@ -32,44 +34,59 @@ static mapinfo *milist;
 
 #define MAX_BACKTRACE_DEPTH 15
 #define ALLOCATION_TAG      0x1ee7d00d
+#define UNTRACKED_TAG       0x1ee7f00d
 #define BACKLOG_TAG         0xbabecafe
+#define CURSOR_TAG          0x5ca4c0de
 #define FREE_POISON         0xa5
-#define BACKLOG_MAX         50
+#define BACKLOG_MAX         4   /* per shard */
 #define FRONT_GUARD         0xaa
 #define FRONT_GUARD_LEN     (1<<4)
 #define REAR_GUARD          0xbb
 #define REAR_GUARD_LEN      (1<<4)
 #define SCANNER_SLEEP_S     3
+#define SCANNER_SLICE       64  /* allocations checked per lock hold */
+#define NUM_SHARDS          16
+#define DEPOT_BUCKETS       4096
+#define DEPOT_SLAB_SIZE     (64 * 1024)
+#define DEPOT_MAX_SLABS     1024
 
+/* Stacks are kept once in the depot and referred to by id, 0 is unknown. */
 struct hdr {
     uint32_t tag;
+    uint32_t bt;
+    uint32_t freed_bt;
+    uint32_t shard;
     struct hdr *prev;
     struct hdr *next;
-    intptr_t bt[MAX_BACKTRACE_DEPTH];
-    int bt_depth;
-    intptr_t freed_bt[MAX_BACKTRACE_DEPTH];
-    int freed_bt_depth;
     size_t size;
-    char front_guard[FRONT_GUARD_LEN];
-} __attribute__((packed));
+};
+
+/* The front guard ends the header, right before the 8 byte aligned user
+ * data. */
+#define HDR_SIZE            ((sizeof(struct hdr) + FRONT_GUARD_LEN + 7) & ~7)
 
 struct ftr {
     char rear_guard[REAR_GUARD_LEN];
 } __attribute__((packed));
 
-static inline struct ftr * to_ftr(struct hdr *hdr)
+static inline void *user(struct hdr *hdr)
 {
-    return (struct ftr *)(((char *)(hdr + 1)) + hdr->size);
+    return ((char *)hdr) + HDR_SIZE;
 }
 
-static inline void *user(struct hdr *hdr)
+static inline struct hdr *meta(void *user)
 {
-    return hdr + 1;
+    return (struct hdr *)(((char *)user) - HDR_SIZE);
 }
 
-static inline struct hdr *meta(void *user)
+static inline char *front_guard(struct hdr *hdr)
 {
-    return ((struct hdr *)user) - 1;
+    return ((char *)user(hdr)) - FRONT_GUARD_LEN;
+}
+
+static inline struct ftr * to_ftr(struct hdr *hdr)
+{
+    return (struct ftr *)(((char *)user(hdr)) + hdr->size);
 }
 
 extern int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap);
@@ -86,15 +103,132 @@ void (*malloc_log)(const char *fmt, ...) = default_log;
 /* Call this ad dlclose() to get leaked memory */
 void free_leaked_memory(void);
 
-static unsigned num;
-static struct hdr *first;
-static struct hdr *last;
-static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+/* Allocations are kept in the shard of the thread that made them, so
+ * threads rarely wait for each other. */
+struct shard {
+    pthread_mutex_t lock;
+    unsigned num;
+    struct hdr *first;
+    struct hdr *last;
+    unsigned backlog_num;
+    struct hdr *backlog_first;
+    struct hdr *backlog_last;
+    /* Bytes left until the next tracked allocation when sampling. */
+    long countdown;
+    /* Where the scanner resumes, linked into the list during a pass. */
+    struct hdr cursor;
+} __attribute__((aligned(64)));
+
+static struct shard shards[NUM_SHARDS] = {
+    [0 ... NUM_SHARDS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+/* Track one allocation per this many bytes, 0 tracks all of them. */
+static long sample_interval;
+
+static inline struct shard *home_shard(void)
+{
+    uintptr_t self = (uintptr_t)pthread_self();
+    return &shards[((self >> 4) ^ (self >> 12)) % NUM_SHARDS];
+}
+
+/* Stack depot: every distinct stack is stored once in slabs that are never
+ * freed. An id holds the slab number in its upper half and the offset in
+ * words in the lower half. Lookups run without the lock. */
+struct stack {
+    uint32_t next;
+    uint32_t hash;
+    uint32_t depth;
+    intptr_t bt[];
+};
+
+static char *depot_slabs[DEPOT_MAX_SLABS];
+static unsigned depot_num_slabs;
+static size_t depot_used;
+static unsigned depot_num_stacks;
+static uint32_t depot_buckets[DEPOT_BUCKETS];
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline struct stack *id_to_stack(uint32_t id)
+{
+    return (struct stack *)(depot_slabs[(id >> 16) - 1] + (id & 0xffff) * 4);
+}
+
+static inline uint32_t hash_stack(const intptr_t *bt, int depth)
+{
+    uint32_t hash = 2166136261U;
+    int i;
+    for (i = 0; i < depth; i++)
+        hash = (hash ^ (uint32_t)bt[i]) * 16777619U;
+    return hash;
+}
+
+static uint32_t find_stack(uint32_t id, uint32_t hash,
+                           const intptr_t *bt, int depth)
+{
+    struct stack *stack;
+    while (id) {
+        stack = id_to_stack(id);
+        if (stack->hash == hash && stack->depth == (uint32_t)depth &&
+            !memcmp(stack->bt, bt, depth * sizeof(intptr_t)))
+            return id;
+        id = stack->next;
+    }
+    return 0;
+}
+
+static uint32_t save_stack(const intptr_t *bt, int depth)
+{
+    uint32_t hash = hash_stack(bt, depth);
+    uint32_t *bucket = &depot_buckets[hash % DEPOT_BUCKETS];
+    struct stack *stack;
+    size_t size;
+    uint32_t id;
+
+    id = find_stack(__atomic_load_n(bucket, __ATOMIC_ACQUIRE), hash, bt, depth);
+    if (id)
+        return id;
+
+    pthread_mutex_lock(&depot_lock);
+    /* Another thread may have saved it meanwhile */
+    id = find_stack(*bucket, hash, bt, depth);
+    if (id)
+        goto done;
+
+    size = sizeof(struct stack) + depth * sizeof(intptr_t);
+    size = (size + sizeof(intptr_t) - 1) & ~(sizeof(intptr_t) - 1);
+    if (!depot_num_slabs || depot_used + size > DEPOT_SLAB_SIZE) {
+        char *slab;
+        if (depot_num_slabs == DEPOT_MAX_SLABS)
+            goto done;
+        slab = __real_malloc(DEPOT_SLAB_SIZE);
+        if (!slab)
+            goto done;
+        depot_slabs[depot_num_slabs++] = slab;
+        depot_used = 0;
+    }
+
+    id = (depot_num_slabs << 16) | (depot_used / 4);
+    stack = id_to_stack(id);
+    stack->next = *bucket;
+    stack->hash = hash;
+    stack->depth = depth;
+    memcpy(stack->bt, bt, depth * sizeof(intptr_t));
+    depot_used += size;
+    depot_num_stacks++;
+    __atomic_store_n(bucket, id, __ATOMIC_RELEASE);
+
+done:
+    pthread_mutex_unlock(&depot_lock);
+    return id;
+}
 
-static unsigned backlog_num;
-static struct hdr *backlog_first;
-static struct hdr *backlog_last;
-static pthread_rwlock_t backlog_lock = PTHREAD_RWLOCK_INITIALIZER;
+static inline uint32_t record_stack(void)
+{
+    intptr_t bt[MAX_BACKTRACE_DEPTH];
+    int depth = heaptracker_stacktrace(bt, MAX_BACKTRACE_DEPTH);
+    return save_stack(bt, depth);
+}
 
 void print_backtrace(const intptr_t *bt, int depth)
 {
@@ -116,16 +250,31 @@ void print_backtrace(const intptr_t *bt, int depth)
     }
 }
 
+static void print_stack(uint32_t id)
+{
+    struct stack *stack;
+
+    if (!id) {
+        malloc_log("*** *** *** *** *** *** *** *** *** *** *** *** *** *** *** ***\n");
+        malloc_log("\t(stack not recorded)\n");
+        return;
+    }
+
+    stack = id_to_stack(id);
+    print_backtrace(stack->bt, stack->depth);
+}
+
 static inline void init_front_guard(struct hdr *hdr)
 {
-    memset(hdr->front_guard, FRONT_GUARD, FRONT_GUARD_LEN);
+    memset(front_guard(hdr), FRONT_GUARD, FRONT_GUARD_LEN);
 }
 
 static inline int is_front_guard_valid(struct hdr *hdr)
 {
     unsigned i;
+    const char *guard = front_guard(hdr);
     for (i = 0; i < FRONT_GUARD_LEN; i++)
-        if (hdr->front_guard[i] != FRONT_GUARD)
+        if (guard[i] != (char)FRONT_GUARD)
             return 0;
     return 1;
 }
@@ -143,7 +292,7 @@ static inline int is_rear_guard_valid(struct hdr *hdr)
     int first_mismatch = -1;
     struct ftr *ftr = to_ftr(hdr);
     for (i = 0; i < REAR_GUARD_LEN; i++) {
-        if (ftr->rear_guard[i] != REAR_GUARD) {
+        if (ftr->rear_guard[i] != (char)REAR_GUARD) {
             if (first_mismatch < 0)
                 first_mismatch = i;
             valid = 0;
@@ -170,6 +319,18 @@ static inline void __add(struct hdr *hdr, struct hdr **first, struct hdr **last)
     *last = hdr;
 }
 
+/* Links hdr right after pos, the way the lists are walked. */
+static inline void __add_after(struct hdr *hdr, struct hdr *pos, struct hdr **first)
+{
+    hdr->prev = pos;
+    hdr->next = pos->next;
+    if (pos->next)
+        pos->next->prev = hdr;
+    else
+        *first = hdr;
+    pos->next = hdr;
+}
+
 static inline int __del(struct hdr *hdr, struct hdr **first, struct hdr **last)
 {
     if (hdr->prev)
@@ -183,27 +344,60 @@ static inline int __del(struct hdr *hdr, struct hdr **first, struct hdr **last)
     return 0;
 }
 
+/* Returns 1 if the allocation is to be tracked. */
+static inline int sample(struct shard *shard, size_t size)
+{
+    long interval = sample_interval;
+
+    if (!interval)
+        return 1;
+    if (__atomic_sub_fetch(&shard->countdown, (long)size, __ATOMIC_RELAXED) > 0)
+        return 0;
+    __atomic_store_n(&shard->countdown, interval, __ATOMIC_RELAXED);
+    return 1;
+}
+
 static inline void add(struct hdr *hdr, size_t size)
 {
-    pthread_rwlock_wrlock(&lock);
-    hdr->tag = ALLOCATION_TAG;
+    struct shard *shard = home_shard();
+
     hdr->size = size;
+    hdr->freed_bt = 0;
     init_front_guard(hdr);
     init_rear_guard(hdr);
-    num++;
-    __add(hdr, &first, &last);
-    pthread_rwlock_unlock(&lock);
+
+    /* Untracked allocations only carry the guards, checked when freed */
+    if (!sample(shard, size)) {
+        hdr->tag = UNTRACKED_TAG;
+        hdr->bt = 0;
+        hdr->shard = 0;
+        return;
+    }
+
+    hdr->bt = record_stack();
+    hdr->shard = shard - shards;
+
+    pthread_mutex_lock(&shard->lock);
+    hdr->tag = ALLOCATION_TAG;
+    shard->num++;
+    __add(hdr, &shard->first, &shard->last);
+    pthread_mutex_unlock(&shard->lock);
 }
 
 static inline int del(struct hdr *hdr)
 {
+    struct shard *shard;
+
+    if (hdr->tag == UNTRACKED_TAG)
+        return 0;
     if (hdr->tag != ALLOCATION_TAG)
         return -1;
 
-    pthread_rwlock_wrlock(&lock);
-    __del(hdr, &first, &last);
-    num--;
-    pthread_rwlock_unlock(&lock);
+    shard = &shards[hdr->shard % NUM_SHARDS];
+    pthread_mutex_lock(&shard->lock);
+    __del(hdr, &shard->first, &shard->last);
+    shard->num--;
+    pthread_mutex_unlock(&shard->lock);
     return 0;
 }
 
@@ -217,7 +411,7 @@ static int was_used_after_free(struct hdr *hdr)
     unsigned i;
     const char *data = (const char *)user(hdr);
     for (i = 0; i < hdr->size; i++)
-        if (data[i] != FREE_POISON)
+        if (data[i] != (char)FREE_POISON)
             return 1;
     return 0;
 }
@@ -227,7 +421,7 @@ static inline int check_guards(struct hdr *hdr, int *safe)
 {
     *safe = 1;
     if (!is_front_guard_valid(hdr)) {
-        if (hdr->front_guard[0] == FRONT_GUARD) {
+        if (front_guard(hdr)[0] == (char)FRONT_GUARD) {
             malloc_log("+++ ALLOCATION %p SIZE %d HAS A CORRUPTED FRONT GUARD\n",
                        user(hdr), hdr->size);
         } else {
@@ -277,11 +471,11 @@ static inline int __check_allocation(struct hdr *hdr, int *safe)
     if (!valid && *safe) {
         malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
                         user(hdr), hdr->size);
-        print_backtrace(hdr->bt, hdr->bt_depth);
+        print_stack(hdr->bt);
         if (hdr->tag == BACKLOG_TAG) {
             malloc_log("+++ ALLOCATION %p SIZE %d FREED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->freed_bt, hdr->freed_bt_depth);
+            print_stack(hdr->freed_bt);
         }
     }
 
@@ -301,57 +495,67 @@ static inline int __del_and_check(struct hdr *hdr,
     return valid;
 }
 
-static inline void __del_from_backlog(struct hdr *hdr)
+static inline void __del_from_backlog(struct shard *shard, struct hdr *hdr)
 {
         int safe;
         (void)__del_and_check(hdr,
-                              &backlog_first, &backlog_last, &backlog_num,
-                              &safe);
+                              &shard->backlog_first, &shard->backlog_last,
+                              &shard->backlog_num, &safe);
         hdr->tag = 0; /* clear the tag */
 }
 
 static inline void del_from_backlog(struct hdr *hdr)
 {
-    pthread_rwlock_wrlock(&backlog_lock);
-    __del_from_backlog(hdr);
-    pthread_rwlock_unlock(&backlog_lock);
-}
-
-static inline int del_leak(struct hdr *hdr, int *safe)
-{
-    int valid;
-    pthread_rwlock_wrlock(&lock);
-    valid = __del_and_check(hdr,
-                            &first, &last, &num,
-                            safe);
-    pthread_rwlock_unlock(&lock);
-    return valid;
+    struct shard *shard = &shards[hdr->shard % NUM_SHARDS];
+    pthread_mutex_lock(&shard->lock);
+    __del_from_backlog(shard, hdr);
+    pthread_mutex_unlock(&shard->lock);
 }
 
 static inline void add_to_backlog(struct hdr *hdr)
 {
-    pthread_rwlock_wrlock(&backlog_lock);
-    hdr->tag = BACKLOG_TAG;
-    backlog_num++;
-    __add(hdr, &backlog_first, &backlog_last);
+    struct shard *shard = &shards[hdr->shard % NUM_SHARDS];
     poison(hdr);
+    pthread_mutex_lock(&shard->lock);
+    hdr->tag = BACKLOG_TAG;
+    shard->backlog_num++;
+    __add(hdr, &shard->backlog_first, &shard->backlog_last);
     /* If we've exceeded the maximum backlog, clear it up */
-    while (backlog_num > BACKLOG_MAX) {
-        struct hdr *gone = backlog_first;
-        __del_from_backlog(gone);
+    while (shard->backlog_num > BACKLOG_MAX) {
+        struct hdr *gone = shard->backlog_first;
+        __del_from_backlog(shard, gone);
         __real_free(gone);
     }
-    pthread_rwlock_unlock(&backlog_lock);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/* Checks the guards of an allocation that was not sampled, which the
+ * scanner never sees, before it is freed or reallocated. */
+static void check_untracked(struct hdr *hdr, const char *action)
+{
+    intptr_t bt[MAX_BACKTRACE_DEPTH];
+    int depth, safe;
+
+    if (!check_guards(hdr, &safe) && safe) {
+        depth = heaptracker_stacktrace(bt, MAX_BACKTRACE_DEPTH);
+        malloc_log("+++ ALLOCATION %p SIZE %d %s HERE:\n",
+                   user(hdr), hdr->size, action);
+        print_backtrace(bt, depth);
+    }
+}
+
+static inline void free_untracked(struct hdr *hdr)
+{
+    check_untracked(hdr, "FREED");
+    hdr->tag = 0;
+    __real_free(hdr);
 }
 
 void* __wrap_malloc(size_t size)
 {
 //  malloc_tracker_log("%s: %s\n", __FILE__, __FUNCTION__);
-    struct hdr *hdr = __real_malloc(sizeof(struct hdr) + size +
-                                    sizeof(struct ftr));
+    struct hdr *hdr = __real_malloc(HDR_SIZE + size + sizeof(struct ftr));
     if (hdr) {
-        hdr->bt_depth = heaptracker_stacktrace(
-                            hdr->bt, MAX_BACKTRACE_DEPTH);
         add(hdr, size);
         return user(hdr);
     }
@@ -375,11 +579,11 @@ void __wrap_free(void *ptr)
                        user(hdr), hdr->size);
             malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->bt, hdr->bt_depth);
-            /* hdr->freed_bt_depth should be nonzero here */
+            print_stack(hdr->bt);
+            /* hdr->freed_bt should be nonzero here */
             malloc_log("+++ ALLOCATION %p SIZE %d FIRST FREED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->freed_bt, hdr->freed_bt_depth);
+            print_stack(hdr->freed_bt);
             malloc_log("+++ ALLOCATION %p SIZE %d NOW BEING FREED HERE:\n",
                        user(hdr), hdr->size);
             print_backtrace(bt, depth);
@@ -392,9 +596,11 @@ void __wrap_free(void *ptr)
             //__real_free(user(hdr));
         }
     }
+    else if (hdr->tag == UNTRACKED_TAG) {
+        free_untracked(hdr);
+    }
     else {
-        hdr->freed_bt_depth = heaptracker_stacktrace(hdr->freed_bt,
-                                      MAX_BACKTRACE_DEPTH);
+        hdr->freed_bt = record_stack();
         add_to_backlog(hdr);
     }
 }
@@ -423,11 +629,11 @@ void *__wrap_realloc(void *ptr, size_t size)
                        user(hdr), size, hdr->size);
             malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->bt, hdr->bt_depth);
-            /* hdr->freed_bt_depth should be nonzero here */
+            print_stack(hdr->bt);
+            /* hdr->freed_bt should be nonzero here */
             malloc_log("+++ ALLOCATION %p SIZE %d FIRST FREED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->freed_bt, hdr->freed_bt_depth);
+            print_stack(hdr->freed_bt);
             malloc_log("+++ ALLOCATION %p SIZE %d NOW BEING REALLOCATED HERE:\n",
                        user(hdr), hdr->size);
             print_backtrace(bt, depth);
@@ -447,10 +653,11 @@ void *__wrap_realloc(void *ptr, size_t size)
             // return __real_realloc(user(hdr), size); // assuming it was allocated externally
         }
     }
+    else if (hdr->tag == UNTRACKED_TAG)
+        check_untracked(hdr, "REALLOCATED");
  
-    hdr = __real_realloc(hdr, sizeof(struct hdr) + size + sizeof(struct ftr));
+    hdr = __real_realloc(hdr, HDR_SIZE + size + sizeof(struct ftr));
     if (hdr) {
-        hdr->bt_depth = heaptracker_stacktrace(hdr->bt, MAX_BACKTRACE_DEPTH);
         add(hdr, size);
         return user(hdr);
     }
@@ -463,61 +670,127 @@ void *__wrap_calloc(int nmemb, size_t size)
 //  malloc_tracker_log("%s: %s\n", __FILE__, __FUNCTION__);
     struct hdr *hdr;
     size_t __size = nmemb * size;
-    hdr = __real_calloc(1, sizeof(struct hdr) + __size + sizeof(struct ftr));
+    hdr = __real_calloc(1, HDR_SIZE + __size + sizeof(struct ftr));
     if (hdr) {
-        hdr->bt_depth = heaptracker_stacktrace(
-                            hdr->bt, MAX_BACKTRACE_DEPTH);
         add(hdr, __size);
         return user(hdr);
     }
     return NULL;
 }
 
+/* Tracks one allocation for every interval bytes allocated, 0 tracks them
+ * all. Only tracked allocations are reported as leaks, checked by the
+ * scanner and kept in the backlog; the others are checked when freed. */
+void heaptracker_set_sample_interval(size_t interval)
+{
+    int i;
+    sample_interval = interval;
+    for (i = 0; i < NUM_SHARDS; i++)
+        __atomic_store_n(&shards[i].countdown, (long)interval, __ATOMIC_RELAXED);
+}
+
+/* Takes the newest leak off the shard, unlinking the scanner cursor if a
+ * pass is under way; the scanner starts over on its next slice. Returns
+ * NULL once the shard is empty. */
+static struct hdr *pop_leak(struct shard *shard, int *valid, int *safe)
+{
+    struct hdr *hdr;
+
+    pthread_mutex_lock(&shard->lock);
+    if (shard->cursor.tag == CURSOR_TAG) {
+        __del(&shard->cursor, &shard->first, &shard->last);
+        shard->cursor.tag = 0;
+    }
+    hdr = shard->last;
+    if (hdr)
+        *valid = __del_and_check(hdr,
+                                 &shard->first, &shard->last, &shard->num,
+                                 safe);
+    pthread_mutex_unlock(&shard->lock);
+    return hdr;
+}
+
+static struct hdr *pop_backlog(struct shard *shard)
+{
+    struct hdr *hdr;
+
+    pthread_mutex_lock(&shard->lock);
+    hdr = shard->backlog_first;
+    if (hdr)
+        __del_from_backlog(shard, hdr);
+    pthread_mutex_unlock(&shard->lock);
+    return hdr;
+}
+
 void heaptracker_free_leaked_memory(void)
 {
-    struct hdr *del; int cnt;
+    struct hdr *del; int i;
+    unsigned num = 0;
 
-    if (num)
-        malloc_log("+++ THERE ARE %d LEAKED ALLOCATIONS\n", num);
+    for (i = 0; i < NUM_SHARDS; i++)
+        num += shards[i].num;
 
-    while (last) {
-        int safe;
-        del = last;
-        malloc_log("+++ DELETING %d BYTES OF LEAKED MEMORY AT %p (%d REMAINING)\n",
-                del->size, user(del), num);
-        if (del_leak(del, &safe)) {
-            /* safe == 1, because the allocation is valid */
-            malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
-                        user(del), del->size);
-            print_backtrace(del->bt, del->bt_depth);
+    if (num)
+        malloc_log("+++ THERE ARE %d LEAKED ALLOCATIONS%s\n", num,
+                   sample_interval ? " (SAMPLED)" : "");
+
+    for (i = 0; i < NUM_SHARDS; i++) {
+        struct shard *shard = &shards[i];
+        int valid, safe;
+
+        while ((del = pop_leak(shard, &valid, &safe)) != NULL) {
+            malloc_log("+++ DELETING %d BYTES OF LEAKED MEMORY AT %p (%d REMAINING)\n",
+                    del->size, user(del), num--);
+            if (valid) {
+                /* safe == 1, because the allocation is valid */
+                malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
+                            user(del), del->size);
+                print_stack(del->bt);
+            }
+            __real_free(del);
         }
-        __real_free(del);
-    }
 
-//  malloc_log("+++ DELETING %d BACKLOGGED ALLOCATIONS\n", backlog_num);
-    while (backlog_last) {
-	del = backlog_first;
-        del_from_backlog(del);
-        __real_free(del);
+//      malloc_log("+++ DELETING %d BACKLOGGED ALLOCATIONS\n", shard->backlog_num);
+        while ((del = pop_backlog(shard)) != NULL)
+            __real_free(del);
     }
 }
 
-static int check_list(struct hdr *list, pthread_rwlock_t *rwlock)
+/* Checks the next SCANNER_SLICE allocations of the shard and the whole
+ * backlog at the start of a pass, so the lock is held for a bounded time.
+ * Returns 0 when the pass over the shard is complete. */
+static int scan_slice(struct shard *shard)
 {
-    struct hdr *hdr;
-    int safe, num_checked;
+    struct hdr *cursor = &shard->cursor;
+    struct hdr *hdr, *checked = NULL;
+    int safe, n;
+
+    pthread_mutex_lock(&shard->lock);
+
+    if (cursor->tag != CURSOR_TAG) {
+        cursor->tag = CURSOR_TAG;
+        __add(cursor, &shard->first, &shard->last);
 
-    pthread_rwlock_rdlock(rwlock);
-    num_checked = 0;
-    hdr = list;
-    while (hdr) {
+        for (hdr = shard->backlog_last; hdr; hdr = hdr->next)
+            (void)__check_allocation(hdr, &safe);
+    }
+
+    hdr = cursor->next;
+    for (n = 0; hdr && n < SCANNER_SLICE; n++) {
         (void)__check_allocation(hdr, &safe);
+        checked = hdr;
         hdr = hdr->next;
-        num_checked++;
     }
-    pthread_rwlock_unlock(rwlock);
 
-    return num_checked;
+    /* Resume after the last allocation checked */
+    __del(cursor, &shard->first, &shard->last);
+    if (hdr)
+        __add_after(cursor, checked, &shard->first);
+    else
+        cursor->tag = 0;
+
+    pthread_mutex_unlock(&shard->lock);
+    return hdr != NULL;
 }
 
 static pthread_t scanner_thread;
@@ -528,15 +801,14 @@ static pthread_mutex_t scanner_lock = PTHREAD_MUTEX_INITIALIZER;
 static void* scanner(void *data __attribute__((unused)))
 {
     struct timespec ts;
-    int num_checked, num_checked_backlog;
+    int i;
 
     while (1) {
-        num_checked = check_list(last, &lock);
-        num_checked_backlog = check_list(backlog_last, &backlog_lock);
+        for (i = 0; i < NUM_SHARDS && !scanner_stop; i++)
+            while (scan_slice(&shards[i]) && !scanner_stop)
+                sched_yield();
 
-//      malloc_log("@@@ scanned %d/%d allocs and %d/%d freed\n",
-//                 num_checked, num,
-//                 num_checked_backlog, backlog_num);
+//      malloc_log("@@@ scanned, %d stacks in the depot\n", depot_num_stacks);
 
         pthread_mutex_lock(&scanner_lock);
         if (!scanner_stop) {
@@ -558,6 +830,11 @@ static void* scanner(void *data __attribute__((unused)))
 static void init(void) __attribute__((constructor));
 static void init(void)
 {
+    const char *interval = getenv("HEAPTRACKER_SAMPLE_BYTES");
+
+    if (interval)
+        heaptracker_set_sample_interval(strtoul(interval, NULL, 0));
+
 //  malloc_log("@@@ start scanner thread");
     milist = init_mapinfo(getpid());
     pthread_create(&scanner_thread,
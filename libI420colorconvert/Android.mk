@@ -6,7 +6,10 @@ LOCAL_SRC_FILES := \
 
 LOCAL_C_INCLUDES:= \
         $(TOP)/frameworks/native/include/media/openmax \
-        $(TOP)/frameworks/native/include/media/editor
+        $(TOP)/frameworks/native/include/media/editor \
+        $(HARDWARE_TI_OMAP4_BASE)/libyuvconvert
+
+LOCAL_STATIC_LIBRARIES := libyuvconvert
 
 LOCAL_CFLAGS := -Wall -Werror
 
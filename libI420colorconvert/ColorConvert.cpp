@@ -18,6 +18,8 @@
 #include <OMX_IVCommon.h>
 #include <string.h>
 
+#include "yuv_convert.h"
+
 static int getDecoderOutputFormat() {
     return OMX_TI_COLOR_FormatYUV420PackedSemiPlanar;
 }
@@ -39,22 +41,9 @@ static int convertDecoderOutputToI420(
     uint8_t *pDst_u = pDst_y + dst_y_size;
     uint8_t *pDst_v = pDst_u + dst_uv_size;
 
-    for (int y = 0; y < dstHeight; ++y) {
-        memcpy(pDst_y, pSrc_y, dstWidth);
-        pSrc_y += srcWidth;
-        pDst_y += dstWidth;
-    }
-
-    size_t tmp = (dstWidth + 1) / 2;
-    for (int y = 0; y < (dstHeight + 1) / 2; ++y) {
-        for (size_t x = 0; x < tmp; ++x) {
-            pDst_u[x] = pSrc_uv[2 * x];
-            pDst_v[x] = pSrc_uv[2 * x + 1];
-        }
-        pSrc_uv += srcWidth;
-        pDst_u += dst_uv_stride;
-        pDst_v += dst_uv_stride;
-    }
+    yuv_nv12_to_i420(pSrc_y, srcWidth, pSrc_uv, srcWidth,
+                     pDst_y, dstWidth, pDst_u, dst_uv_stride, pDst_v, dst_uv_stride,
+                     dstWidth, dstHeight);
     return 0;
 }
 
@@ -66,26 +55,15 @@ static int convertI420ToEncoderInput(
     void* srcBits, int srcWidth, int srcHeight,
     int dstWidth, int dstHeight, ARect dstRect __unused,
     void* dstBits) {
-    uint8_t *pSrc_y = (uint8_t*) srcBits;
-    uint8_t *pDst_y = (uint8_t*) dstBits;
-    for(int i=0; i < srcHeight; i++) {
-        memcpy(pDst_y, pSrc_y, srcWidth);
-        pSrc_y += srcWidth;
-        pDst_y += dstWidth;
-    }
-    uint8_t* pSrc_u = (uint8_t*)srcBits + (srcWidth * srcHeight);
-    uint8_t* pSrc_v = (uint8_t*)pSrc_u + (srcWidth / 2) * (srcHeight / 2);
-    uint8_t* pDst_uv  = (uint8_t*)dstBits + dstWidth * dstHeight;
+    const uint8_t* pSrc_y = (const uint8_t*) srcBits;
+    const uint8_t* pSrc_u = pSrc_y + (srcWidth * srcHeight);
+    const uint8_t* pSrc_v = pSrc_u + (srcWidth / 2) * (srcHeight / 2);
+    uint8_t* pDst_y = (uint8_t*) dstBits;
+    uint8_t* pDst_uv = pDst_y + dstWidth * dstHeight;
 
-    for(int i=0; i < srcHeight / 2; i++) {
-        for(int j=0, k=0; j < srcWidth / 2; j++, k+=2) {
-            pDst_uv[k] = pSrc_u[j];
-            pDst_uv[k+1] = pSrc_v[j];
-        }
-        pDst_uv += dstWidth;
-        pSrc_u += srcWidth / 2;
-        pSrc_v += srcWidth / 2;
-    }
+    yuv_i420_to_nv12(pSrc_y, srcWidth, pSrc_u, srcWidth / 2, pSrc_v, srcWidth / 2,
+                     pDst_y, dstWidth, pDst_uv, dstWidth,
+                     srcWidth, srcHeight);
     return 0;
 }
 
@@ -9,6 +9,7 @@ LOCAL_SRC_FILES:= \
     DebugUtils.cpp \
     MessageQueue.cpp \
     Semaphore.cpp \
+    WorkerPool.cpp \
     ErrorUtils.cpp
 
 LOCAL_SHARED_LIBRARIES:= \
@@ -17,10 +17,12 @@
 
 #include <errno.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/poll.h>
 #include <unistd.h>
 #include <utils/Errors.h>
+#include <utils/Timers.h>
 
 
 
@@ -42,31 +44,30 @@ MessageQueue::MessageQueue()
 {
     LOG_FUNCTION_NAME;
 
-    int fds[2] = {-1,-1};
-    android::status_t stat;
-
-    stat = pipe(fds);
-
-    if ( 0 > stat )
+    for ( int i = 0; i < CAPACITY; i++ )
         {
-        MSGQ_LOGEB("Error while openning pipe: %s", strerror(stat) );
-        this->fd_read = 0;
-        this->fd_write = 0;
-        mHasMsg = false;
+        mCells[i].sequence = i;
         }
-    else
-        {
-        this->fd_read = fds[0];
-        this->fd_write = fds[1];
 
-        mHasMsg = false;
+    mPutPos = 0;
+    mGetPos = 0;
+    mWaiters = 0;
+    mExported = false;
+    mSpaceWaiters = 0;
+    mHasMsg = false;
+
+    mFd = eventfd(0, EFD_NONBLOCK);
+    if ( 0 > mFd )
+        {
+        MSGQ_LOGEB("Error while opening eventfd: %s", strerror(errno) );
+        mFd = 0;
         }
 
     LOG_FUNCTION_NAME_EXIT;
 }
 
 /**
-   @brief Destructor for the semaphore class
+   @brief Destructor for the message queue class
 
    @param none
    @return none
@@ -75,27 +76,152 @@ MessageQueue::~MessageQueue()
 {
     LOG_FUNCTION_NAME;
 
-    if(this->fd_read >= 0)
+    if ( 0 < mFd )
+        {
+        close(mFd);
+        }
+
+    LOG_FUNCTION_NAME_EXIT;
+}
+
+/**
+   @brief Take the oldest message without blocking
+
+   @param msg Message structure to hold the message to be retrieved
+   @return true If a message was retrieved
+ */
+bool MessageQueue::tryGet(Message* msg)
+{
+    uint32_t pos = __atomic_load_n(&mGetPos, __ATOMIC_RELAXED);
+
+    for ( ;; )
         {
-        close(this->fd_read);
+        Cell *cell = &mCells[pos & ( CAPACITY - 1 )];
+        uint32_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t) ( seq - ( pos + 1 ) );
+
+        if ( 0 > diff )
+            {
+            return false;
+            }
+
+        if ( ( 0 == diff ) &&
+             __atomic_compare_exchange_n(&mGetPos, &pos, pos + 1, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+            {
+            *msg = cell->msg;
+            __atomic_store_n(&cell->sequence, pos + CAPACITY, __ATOMIC_RELEASE);
+            break;
+            }
+
+        if ( 0 < diff )
+            {
+            pos = __atomic_load_n(&mGetPos, __ATOMIC_RELAXED);
+            }
         }
 
-    if(this->fd_write >= 0)
+    // a producer may be waiting for the cell just freed
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ( 0 < __atomic_load_n(&mSpaceWaiters, __ATOMIC_RELAXED) )
         {
-        close(this->fd_write);
+        android::AutoMutex lock(mSpaceLock);
+        mSpaceCond.broadcast();
         }
 
-    LOG_FUNCTION_NAME_EXIT;
+    return true;
+}
+
+/**
+   @brief Whether the oldest cell holds a completely written message
+
+   @param none
+   @return true If get() would not block
+ */
+bool MessageQueue::isReady() const
+{
+    uint32_t pos = __atomic_load_n(&mGetPos, __ATOMIC_ACQUIRE);
+    const Cell *cell = &mCells[pos & ( CAPACITY - 1 )];
+
+    return ( pos + 1 ) == __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
 }
 
 /**
-   @brief Get a message from the queue
+   @brief Announce a reader that is about to sleep on the eventfd
+
+   Must be followed by a check of isReady(), producers publish their
+   message before they look at the waiter count, so either the reader
+   sees the message or the producer sees the reader.
+ */
+void MessageQueue::arm()
+{
+    __atomic_add_fetch(&mWaiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void MessageQueue::disarm()
+{
+    __atomic_sub_fetch(&mWaiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void MessageQueue::wake()
+{
+    uint64_t one = 1;
+
+    if ( 0 > write(mFd, &one, sizeof(one)) )
+        {
+        MSGQ_LOGEB("write() error: %s", strerror(errno));
+        }
+}
+
+void MessageQueue::drain()
+{
+    uint64_t count;
+
+    // the eventfd is non blocking, this only clears a pending wakeup
+    if ( ( 0 > read(mFd, &count, sizeof(count)) ) && ( EAGAIN != errno ) )
+        {
+        MSGQ_LOGEB("read() error: %s", strerror(errno));
+        }
+
+    // an exported descriptor stays readable while messages are queued,
+    // a put racing with the read above signals again anyway
+    if ( __atomic_load_n(&mExported, __ATOMIC_SEQ_CST) && isReady() )
+        {
+        wake();
+        }
+}
+
+/**
+   @brief Block the calling producer until the reader frees a cell
+
+   @param none
+   @return none
+ */
+void MessageQueue::waitForSpace()
+{
+    android::AutoMutex lock(mSpaceLock);
+
+    __atomic_add_fetch(&mSpaceWaiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint32_t pos = __atomic_load_n(&mPutPos, __ATOMIC_RELAXED);
+    const Cell *cell = &mCells[pos & ( CAPACITY - 1 )];
+    if ( (int32_t) ( __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - pos ) < 0 )
+        {
+        mSpaceCond.waitRelative(mSpaceLock, ms2ns(100));
+        }
+
+    __atomic_sub_fetch(&mSpaceWaiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+   @brief Get a message from the queue, blocks until one is available
 
    @param msg Message structure to hold the message to be retrieved
    @return android::NO_ERROR On success
    @return android::BAD_VALUE if the message pointer is NULL
-   @return android::NO_INIT If the file read descriptor is not set
-   @return android::UNKNOWN_ERROR if the read operation fromthe file read descriptor fails
+   @return android::NO_INIT If the wakeup descriptor is not set
+   @return android::UNKNOWN_ERROR if waiting on the wakeup descriptor fails
  */
 android::status_t MessageQueue::get(Message* msg)
 {
@@ -108,29 +234,44 @@ android::status_t MessageQueue::get(Message* msg)
         return android::BAD_VALUE;
         }
 
-    if(!this->fd_read)
+    if(!mFd)
         {
         MSGQ_LOGEA("read descriptor not initialized for message queue");
         LOG_FUNCTION_NAME_EXIT;
         return android::NO_INIT;
         }
 
-    char* p = (char*) msg;
-    size_t read_bytes = 0;
-
-    while( read_bytes  < sizeof(*msg) )
+    while ( !tryGet(msg) )
         {
-        int err = read(this->fd_read, p, sizeof(*msg) - read_bytes);
+        struct pollfd pfd;
 
-        if( err < 0 )
+        arm();
+        if ( isReady() )
             {
-            MSGQ_LOGEB("read() error: %s", strerror(errno));
-            return android::UNKNOWN_ERROR;
+            disarm();
+            continue;
             }
-        else
+
+        pfd.fd = mFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int err = poll(&pfd, 1, -1);
+        disarm();
+
+        if ( ( 0 > err ) && ( EINTR != errno ) )
             {
-            read_bytes += err;
+            MSGQ_LOGEB("poll() error: %s", strerror(errno));
+            LOG_FUNCTION_NAME_EXIT;
+            return android::UNKNOWN_ERROR;
             }
+
+        drain();
+        }
+
+    if ( __atomic_load_n(&mExported, __ATOMIC_RELAXED) && !isReady() )
+        {
+        drain();
         }
 
     MSGQ_LOGDB("MQ.get(%d,%p,%p,%p,%p)", msg->command, msg->arg1,msg->arg2,msg->arg3,msg->arg4);
@@ -145,19 +286,31 @@ android::status_t MessageQueue::get(Message* msg)
 /**
    @brief Get the input file descriptor of the message queue
 
+   From the first call on every put() signals the descriptor, so it can be
+   polled together with other descriptors.
+
    @param none
    @return file read descriptor
  */
 
 int MessageQueue::getInFd()
 {
-    return this->fd_read;
+    if ( !__atomic_exchange_n(&mExported, true, __ATOMIC_SEQ_CST) )
+        {
+        arm();
+        if ( isReady() )
+            {
+            wake();
+            }
+        }
+
+    return mFd;
 }
 
 /**
-   @brief Constructor for the message queue class
+   @brief Replace the wakeup descriptor of the message queue
 
-   @param fd file read descriptor
+   @param fd eventfd to be signaled when messages are queued
    @return none
  */
 
@@ -165,12 +318,12 @@ void MessageQueue::setInFd(int fd)
 {
     LOG_FUNCTION_NAME;
 
-    if ( -1 != this->fd_read )
+    if ( 0 < mFd )
         {
-        close(this->fd_read);
+        close(mFd);
         }
 
-    this->fd_read = fd;
+    mFd = fd;
 
     LOG_FUNCTION_NAME_EXIT;
 }
@@ -181,17 +334,13 @@ void MessageQueue::setInFd(int fd)
    @param msg Message structure to hold the message to be retrieved
    @return android::NO_ERROR On success
    @return android::BAD_VALUE if the message pointer is NULL
-   @return android::NO_INIT If the file write descriptor is not set
-   @return android::UNKNOWN_ERROR if the write operation fromthe file write descriptor fails
+   @return android::NO_INIT If the wakeup descriptor is not set
  */
 
 android::status_t MessageQueue::put(Message* msg)
 {
     LOG_FUNCTION_NAME;
 
-    char* p = (char*) msg;
-    size_t bytes = 0;
-
     if(!msg)
         {
         MSGQ_LOGEA("msg is NULL");
@@ -199,30 +348,50 @@ android::status_t MessageQueue::put(Message* msg)
         return android::BAD_VALUE;
         }
 
-    if(!this->fd_write)
+    if(!mFd)
         {
         MSGQ_LOGEA("write descriptor not initialized for message queue");
         LOG_FUNCTION_NAME_EXIT;
         return android::NO_INIT;
         }
 
-
     MSGQ_LOGDB("MQ.put(%d,%p,%p,%p,%p)", msg->command, msg->arg1,msg->arg2,msg->arg3,msg->arg4);
 
-    while( bytes  < sizeof(msg) )
+    uint32_t pos = __atomic_load_n(&mPutPos, __ATOMIC_RELAXED);
+    Cell *cell;
+
+    for ( ;; )
         {
-        int err = write(this->fd_write, p, sizeof(*msg) - bytes);
+        cell = &mCells[pos & ( CAPACITY - 1 )];
+        uint32_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t) ( seq - pos );
 
-        if( err < 0 )
+        if ( ( 0 == diff ) &&
+             __atomic_compare_exchange_n(&mPutPos, &pos, pos + 1, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
             {
-            MSGQ_LOGEB("write() error: %s", strerror(errno));
-            LOG_FUNCTION_NAME_EXIT;
-            return android::UNKNOWN_ERROR;
+            break;
             }
-        else
+
+        if ( 0 > diff )
             {
-            bytes += err;
+            waitForSpace();
             }
+
+        if ( 0 != diff )
+            {
+            pos = __atomic_load_n(&mPutPos, __ATOMIC_RELAXED);
+            }
+        }
+
+    cell->msg = *msg;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    // only pay for the system call if the reader sleeps
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ( 0 < __atomic_load_n(&mWaiters, __ATOMIC_RELAXED) )
+        {
+        wake();
         }
 
     MSGQ_LOGDA("MessageQueue::put EXIT");
@@ -243,35 +412,14 @@ bool MessageQueue::isEmpty()
 {
     LOG_FUNCTION_NAME;
 
-    struct pollfd pfd;
-
-    pfd.fd = this->fd_read;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-
-    if(!this->fd_read)
+    if(!mFd)
         {
         MSGQ_LOGEA("read descriptor not initialized for message queue");
         LOG_FUNCTION_NAME_EXIT;
         return android::NO_INIT;
         }
 
-
-    if( -1 == poll(&pfd,1,0) )
-        {
-        MSGQ_LOGEB("poll() error: %s", strerror(errno));
-        LOG_FUNCTION_NAME_EXIT;
-        return false;
-        }
-
-    if(pfd.revents & POLLIN)
-        {
-        mHasMsg = true;
-        }
-    else
-        {
-        mHasMsg = false;
-        }
+    mHasMsg = isReady();
 
     LOG_FUNCTION_NAME_EXIT;
     return !mHasMsg;
@@ -281,7 +429,7 @@ void MessageQueue::clear()
 {
     LOG_FUNCTION_NAME;
 
-    if(!this->fd_read)
+    if(!mFd)
         {
         MSGQ_LOGEA("read descriptor not initialized for message queue");
         LOG_FUNCTION_NAME_EXIT;
@@ -315,17 +463,20 @@ void MessageQueue::setMsg(bool hasMsg)
    @param queue1 First queue. At least this should be set to a valid queue pointer
    @param queue2 Second queue. Optional.
    @param queue3 Third queue. Optional.
-   @param timeout The timeout value (in micro secs) to wait for a message in any of the queues
-   @return android::NO_ERROR On success
+   @param timeout The timeout value (in milli secs) to wait for a message in any of the queues, -1 waits forever
+   @return Number of queues holding a message, 0 on timeout
    @return android::BAD_VALUE If queue1 is NULL
-   @return android::NO_INIT If the file read descriptor of any of the provided queues is not set
+   @return android::NO_INIT If the wakeup descriptor of any of the provided queues is not set
  */
 android::status_t MessageQueue::waitForMsg(MessageQueue *queue1, MessageQueue *queue2, MessageQueue *queue3, int timeout)
     {
     LOG_FUNCTION_NAME;
 
-    int n =1;
+    MessageQueue *queues[3] = { queue1, queue2, queue3 };
     struct pollfd pfd[3];
+    nsecs_t deadline = 0;
+    int n = 0;
+    int ret = 0;
 
     if(!queue1)
         {
@@ -334,80 +485,110 @@ android::status_t MessageQueue::waitForMsg(MessageQueue *queue1, MessageQueue *q
         return android::BAD_VALUE;
         }
 
-    pfd[0].fd = queue1->getInFd();
-    if(!pfd[0].fd)
-        {
-        MSGQ_LOGEA("read descriptor not initialized for message queue1");
-        LOG_FUNCTION_NAME_EXIT;
-        return android::NO_INIT;
-        }
-    pfd[0].events = POLLIN;
-    pfd[0].revents = 0;
-    if(queue2)
+    for ( int i = 0; i < 3; i++ )
         {
-        MSGQ_LOGDA("queue2 not-null");
-        pfd[1].fd = queue2->getInFd();
-        if(!pfd[1].fd)
+        if ( NULL == queues[i] )
             {
-            MSGQ_LOGEA("read descriptor not initialized for message queue2");
-            LOG_FUNCTION_NAME_EXIT;
-            return android::NO_INIT;
+            continue;
             }
 
-        pfd[1].events = POLLIN;
-        pfd[1].revents = 0;
-        n++;
-        }
-
-    if(queue3)
-        {
-        MSGQ_LOGDA("queue3 not-null");
-        pfd[2].fd = queue3->getInFd();
-        if(!pfd[2].fd)
+        if ( !queues[i]->mFd )
             {
-            MSGQ_LOGEA("read descriptor not initialized for message queue3");
+            MSGQ_LOGEB("read descriptor not initialized for message queue%d", i + 1);
             LOG_FUNCTION_NAME_EXIT;
             return android::NO_INIT;
             }
 
-        pfd[2].events = POLLIN;
-        pfd[2].revents = 0;
-        n++;
+        queues[n++] = queues[i];
         }
 
-
-    int ret = poll(pfd, n, timeout);
-    if(ret==0)
+    if ( 0 < timeout )
         {
-        LOG_FUNCTION_NAME_EXIT;
-        return ret;
+        deadline = systemTime() + ms2ns(timeout);
         }
 
-    if(ret<android::NO_ERROR)
+    for ( ;; )
         {
-        MSGQ_LOGEB("Message queue returned error %d", ret);
-        LOG_FUNCTION_NAME_EXIT;
-        return ret;
-        }
+        for ( int i = 0; i < n; i++ )
+            {
+            queues[i]->arm();
+            }
 
-    if (pfd[0].revents & POLLIN)
-        {
-        queue1->setMsg(true);
-        }
+        ret = 0;
+        for ( int i = 0; i < n; i++ )
+            {
+            if ( queues[i]->isReady() )
+                {
+                ret++;
+                }
+            }
 
-    if(queue2)
-        {
-        if (pfd[1].revents & POLLIN)
+        if ( 0 == ret )
             {
-            queue2->setMsg(true);
+            int wait = timeout;
+
+            if ( 0 < timeout )
+                {
+                wait = ns2ms(deadline - systemTime());
+                if ( 0 > wait )
+                    {
+                    wait = 0;
+                    }
+                }
+
+            for ( int i = 0; i < n; i++ )
+                {
+                pfd[i].fd = queues[i]->mFd;
+                pfd[i].events = POLLIN;
+                pfd[i].revents = 0;
+                }
+
+            ret = poll(pfd, n, wait);
+
+            if ( ( 0 > ret ) && ( EINTR != errno ) )
+                {
+                for ( int i = 0; i < n; i++ )
+                    {
+                    queues[i]->disarm();
+                    }
+                MSGQ_LOGEB("Message queue returned error %d", ret);
+                LOG_FUNCTION_NAME_EXIT;
+                return ret;
+                }
+
+            for ( int i = 0; i < n; i++ )
+                {
+                if ( pfd[i].revents & POLLIN )
+                    {
+                    queues[i]->drain();
+                    }
+                }
+
+            ret = 0;
+            for ( int i = 0; i < n; i++ )
+                {
+                if ( queues[i]->isReady() )
+                    {
+                    ret++;
+                    }
+                }
             }
-        }
 
-    if(queue3)
-        {
-        if (pfd[2].revents & POLLIN)
+        for ( int i = 0; i < n; i++ )
+            {
+            queues[i]->disarm();
+            if ( queues[i]->isReady() )
+                {
+                queues[i]->setMsg(true);
+                }
+            }
+
+        // a wakeup may be left over from a message that was already
+        // taken, go back to sleep unless the time is up
+        if ( ( 0 < ret ) || ( 0 == timeout ) ||
+             ( ( 0 < timeout ) && ( systemTime() >= deadline ) ) )
             {
-            queue3->setMsg(true);
+            break;
             }
         }
 
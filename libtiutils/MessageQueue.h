@@ -21,6 +21,7 @@
 
 #include "DebugUtils.h"
 #include <stdint.h>
+#include <utils/threads.h>
 
 #ifdef MSGQ_DEBUG
 #   define MSGQ_LOGDA DBGUTILS_LOGDA
@@ -48,20 +49,31 @@ struct Message
 };
 
 ///Message queue implementation
+///
+///Messages are kept in a bounded lock-free ring which any number of threads
+///may put to. The eventfd behind getInFd() is only written while a reader
+///is sleeping in get() or waitForMsg(), so passing a message to a busy
+///thread costs no system call. A full queue blocks put() until the reader
+///catches up, just like the pipe the queue used to be built on.
 class MessageQueue
 {
 public:
 
+    ///Number of messages the queue holds before put() blocks
+    enum { CAPACITY = 256 };
+
     MessageQueue();
     ~MessageQueue();
 
     ///Get a message from the queue
     android::status_t get(Message*);
 
-    ///Get the input file descriptor of the message queue
+    ///Get the input file descriptor of the message queue. The descriptor
+    ///becomes readable whenever a message is queued from then on, and get()
+    ///drains it once the queue is empty
     int getInFd();
 
-    ///Set the input file descriptor for the message queue
+    ///Replace the wakeup descriptor of the message queue, fd must be an eventfd
     void setInFd(int fd);
 
     ///Queue a message
@@ -84,8 +96,36 @@ public:
     }
 
 private:
-    int fd_read;
-    int fd_write;
+    struct Cell
+    {
+        uint32_t sequence;
+        Message  msg;
+    };
+
+    bool tryGet(Message* msg);
+    bool isReady() const;
+    void arm();
+    void disarm();
+    void wake();
+    void drain();
+    void waitForSpace();
+
+private:
+    Cell mCells[CAPACITY];
+    uint32_t mPutPos;
+    uint32_t mGetPos;
+
+    ///Readers about to sleep, producers only signal mFd while nonzero
+    int mWaiters;
+    ///Someone polls mFd outside of this class, see getInFd()
+    bool mExported;
+    int mFd;
+
+    ///Producers blocked on a full queue
+    int mSpaceWaiters;
+    android::Mutex mSpaceLock;
+    android::Condition mSpaceCond;
+
     bool mHasMsg;
 };
 
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef TI_UTILS_RING_H
+#define TI_UTILS_RING_H
+
+namespace Ti {
+namespace Utils {
+
+///Bounded lock-free FIFO for exactly one producer and one consumer thread.
+///Several producers (or consumers) are fine as long as they are serialized
+///by a lock of their own. Capacity must be a power of two.
+template <typename T, unsigned int Capacity>
+class Ring
+{
+public:
+
+    Ring() : mHead(0), mTail(0) {}
+
+    ///Append an item, false if the ring is full
+    bool push(const T &item)
+    {
+        unsigned int tail = __atomic_load_n(&mTail, __ATOMIC_RELAXED);
+        unsigned int head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+
+        if ( Capacity == ( tail - head ) )
+            {
+            return false;
+            }
+
+        mItems[tail & ( Capacity - 1 )] = item;
+        __atomic_store_n(&mTail, tail + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    ///Remove the oldest item, false if the ring is empty
+    bool pop(T &item)
+    {
+        unsigned int head = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+        unsigned int tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+
+        if ( head == tail )
+            {
+            return false;
+            }
+
+        item = mItems[head & ( Capacity - 1 )];
+        __atomic_store_n(&mHead, head + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    ///Number of queued items, only exact if both sides are idle
+    unsigned int size() const
+    {
+        return __atomic_load_n(&mTail, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+    }
+
+    ///Drop all items, neither side may be active
+    void clear()
+    {
+        mHead = 0;
+        mTail = 0;
+    }
+
+private:
+    static_assert(( Capacity & ( Capacity - 1 ) ) == 0, "Ring capacity must be a power of two");
+
+    T mItems[Capacity];
+
+    ///Consumer and producer indices live on separate cache lines
+    unsigned int mHead __attribute__((aligned(64)));
+    unsigned int mTail __attribute__((aligned(64)));
+};
+
+} // namespace Utils
+} // namespace Ti
+
+#endif // TI_UTILS_RING_H
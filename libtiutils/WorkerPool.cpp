@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define LOG_TAG "WorkerPool"
+#include <utils/Log.h>
+
+#include "WorkerPool.h"
+
+namespace Ti {
+namespace Utils {
+
+/**
+   @brief Constructor for the worker pool class
+
+   @param none
+   @return none
+ */
+WorkerPool::WorkerPool() :
+    mThreadCount(0), mExit(false), mJobs(NULL)
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mDoneCond, NULL);
+}
+
+/**
+   @brief Destructor of the worker pool class
+
+   @param none
+   @return none
+ */
+WorkerPool::~WorkerPool()
+{
+    stop();
+
+    pthread_cond_destroy(&mDoneCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/**
+   @brief Number of online cpus
+
+   @param none
+   @return Number of cpus currently online, at least 1
+ */
+int WorkerPool::onlineCpus()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return ( cpus > 0 ) ? static_cast<int>(cpus) : 1;
+}
+
+/**
+   @brief Pool shared by all clients of the process
+
+   Jobs submitted from several threads at once run side by side, see
+   run(), so one pool serves the resizer, the JPEG encoder and the MJPEG
+   decoder without them competing with pools of their own.
+
+   @param none
+   @return Pool started with one worker less than the number of online cpus
+ */
+WorkerPool& WorkerPool::shared()
+{
+    static WorkerPool sPool;
+    static bool sStarted = ( NO_ERROR == sPool.start() );
+
+    ( void ) sStarted;
+
+    return sPool;
+}
+
+/**
+   @brief Start the worker threads
+
+   The thread calling run() always executes a share of the work, so
+   a pool started with N threads has N + 1 way concurrency.
+
+   @param threadCount Number of workers, 0 for one less than the number of online cpus
+   @return NO_ERROR On success
+   @return INVALID_OPERATION If the pool is already running
+   @return UNKNOWN_ERROR If no thread could be created
+ */
+status_t WorkerPool::start(int threadCount)
+{
+    if ( 0 < mThreadCount )
+        {
+        return INVALID_OPERATION;
+        }
+
+    if ( 0 >= threadCount )
+        {
+        threadCount = onlineCpus() - 1;
+        }
+
+    if ( threadCount > MAX_THREADS )
+        {
+        threadCount = MAX_THREADS;
+        }
+
+    mExit = false;
+
+    for ( int i = 0; i < threadCount; i++ )
+        {
+        if ( 0 != pthread_create(&mThreads[mThreadCount], NULL, workerEntry, this) )
+            {
+            ALOGE("Unable to create worker %d", i);
+            break;
+            }
+        mThreadCount++;
+        }
+
+    if ( ( 0 < threadCount ) && ( 0 == mThreadCount ) )
+        {
+        return UNKNOWN_ERROR;
+        }
+
+    return NO_ERROR;
+}
+
+/**
+   @brief Stop and join all worker threads
+
+   @param none
+   @return none
+ */
+void WorkerPool::stop()
+{
+    pthread_mutex_lock(&mLock);
+    mExit = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
+
+    for ( int i = 0; i < mThreadCount; i++ )
+        {
+        pthread_join(mThreads[i], NULL);
+        }
+
+    mThreadCount = 0;
+}
+
+/**
+   @brief Number of threads which execute parts of a job
+
+   @param none
+   @return Worker count plus the calling thread
+ */
+int WorkerPool::concurrency() const
+{
+    return mThreadCount + 1;
+}
+
+/**
+   @brief Run a task for every index in [0, count)
+
+   Indices are handed out dynamically, so parts of uneven cost are
+   balanced across threads. The call returns once every index has
+   completed. The caller only executes indices of its own job, while
+   idle workers take indices from the oldest job which still has any,
+   so jobs of concurrent callers all progress and queue for the workers.
+
+   @param task Function executed for every index
+   @param arg Opaque argument passed to the task
+   @param count Number of indices
+   @return NO_ERROR On success
+   @return BAD_VALUE If task is NULL
+ */
+status_t WorkerPool::run(Task task, void *arg, int count)
+{
+    Job job;
+    Job **tail;
+
+    if ( NULL == task )
+        {
+        return BAD_VALUE;
+        }
+
+    if ( ( 0 == mThreadCount ) || ( 1 >= count ) )
+        {
+        for ( int i = 0; i < count; i++ )
+            {
+            task(arg, i);
+            }
+        return NO_ERROR;
+        }
+
+    job.task = task;
+    job.arg = arg;
+    job.count = count;
+    job.next = 0;
+    job.pending = count;
+    job.link = NULL;
+
+    pthread_mutex_lock(&mLock);
+    for ( tail = &mJobs; NULL != *tail; tail = &(*tail)->link );
+    *tail = &job;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
+
+    while ( runNext(&job) );
+
+    pthread_mutex_lock(&mLock);
+    while ( 0 < job.pending )
+        {
+        pthread_cond_wait(&mDoneCond, &mLock);
+        }
+    for ( tail = &mJobs; &job != *tail; tail = &(*tail)->link );
+    *tail = job.link;
+    pthread_mutex_unlock(&mLock);
+
+    return NO_ERROR;
+}
+
+/**
+   @brief Grow a scratch buffer
+
+   @param buf Buffer, reallocated if too small
+   @param size Current size of the buffer, 0 if the allocation failed
+   @param needed Minimum size in bytes
+   @return The buffer, NULL if it could not be allocated
+ */
+unsigned char * reserveScratch(unsigned char **buf, size_t *size, size_t needed)
+{
+    if ( *size < needed )
+        {
+        free(*buf);
+        *buf = static_cast<unsigned char *>(malloc(needed));
+        *size = ( NULL != *buf ) ? needed : 0;
+        }
+
+    return *buf;
+}
+
+/**
+   @brief Oldest job with indices left, called with mLock held
+
+   @param none
+   @return The job, NULL if there is nothing left to hand out
+ */
+WorkerPool::Job * WorkerPool::nextJob() const
+{
+    Job *job = mJobs;
+
+    while ( ( NULL != job ) && ( job->next >= job->count ) )
+        {
+        job = job->link;
+        }
+
+    return job;
+}
+
+/**
+   @brief Execute one index
+
+   @param job Job to take the index from, NULL for the oldest one
+   @return false If there was no index left
+ */
+bool WorkerPool::runNext(Job *job)
+{
+    int index;
+
+    pthread_mutex_lock(&mLock);
+    if ( NULL == job )
+        {
+        job = nextJob();
+        }
+    if ( ( NULL == job ) || ( job->next >= job->count ) )
+        {
+        pthread_mutex_unlock(&mLock);
+        return false;
+        }
+    index = job->next++;
+    pthread_mutex_unlock(&mLock);
+
+    job->task(job->arg, index);
+
+    pthread_mutex_lock(&mLock);
+    if ( 0 == --job->pending )
+        {
+        pthread_cond_broadcast(&mDoneCond);
+        }
+    pthread_mutex_unlock(&mLock);
+
+    return true;
+}
+
+void * WorkerPool::workerEntry(void *pool)
+{
+    static_cast<WorkerPool *>(pool)->workerLoop();
+    return NULL;
+}
+
+void WorkerPool::workerLoop()
+{
+    for ( ;; )
+        {
+        pthread_mutex_lock(&mLock);
+        while ( !mExit && ( NULL == nextJob() ) )
+            {
+            pthread_cond_wait(&mWorkCond, &mLock);
+            }
+        if ( mExit )
+            {
+            pthread_mutex_unlock(&mLock);
+            break;
+            }
+        pthread_mutex_unlock(&mLock);
+
+        while ( runNext(NULL) );
+        }
+}
+
+} // namespace Utils
+} // namespace Ti
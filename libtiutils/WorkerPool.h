@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef TI_UTILS_WORKER_POOL_H
+#define TI_UTILS_WORKER_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "Status.h"
+
+namespace Ti {
+namespace Utils {
+
+///Fixed set of worker threads used to split one job into independent parts
+class WorkerPool
+{
+public:
+
+    ///Work item, called once for every index in [0, count)
+    typedef void (*Task)(void *arg, int index);
+
+    ///Upper bound for the number of threads in a pool
+    static const int MAX_THREADS = 8;
+
+    WorkerPool();
+    ~WorkerPool();
+
+    ///Start threadCount workers; 0 sizes the pool to the number of online cpus
+    status_t start(int threadCount = 0);
+
+    ///Stop and join all workers
+    void stop();
+
+    ///Number of threads which execute parts of a job, including the caller
+    int concurrency() const;
+
+    ///Run task for every index and return once all of them have completed
+    status_t run(Task task, void *arg, int count);
+
+    ///Number of online cpus
+    static int onlineCpus();
+
+    ///Process wide pool sized to the online cpus, started on first use
+    static WorkerPool& shared();
+
+private:
+    ///One run() call, lives on the stack of its caller
+    struct Job
+    {
+        Task task;
+        void *arg;
+        int count;
+        int next;
+        int pending;
+        Job *link;
+    };
+
+    static void * workerEntry(void *pool);
+    void workerLoop();
+    Job * nextJob() const;
+    bool runNext(Job *job);
+
+private:
+    pthread_mutex_t mLock;
+    pthread_cond_t mWorkCond;
+    pthread_cond_t mDoneCond;
+
+    pthread_t mThreads[MAX_THREADS];
+    int mThreadCount;
+    bool mExit;
+
+    ///Jobs of concurrent clients in submission order
+    Job *mJobs;
+};
+
+///Grows a scratch buffer of a task to at least needed bytes, contents are not kept
+unsigned char * reserveScratch(unsigned char **buf, size_t *size, size_t needed);
+
+} // namespace Utils
+} // namespace Ti
+
+#endif // TI_UTILS_WORKER_POOL_H
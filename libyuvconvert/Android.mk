@@ -0,0 +1,31 @@
+LOCAL_PATH:= $(call my-dir)
+
+YUV_CONVERT_CFLAGS := -Wall -Werror -O2 -fno-short-enums
+
+ifdef ARCH_ARM_HAVE_NEON
+    YUV_CONVERT_CFLAGS += -DARCH_ARM_HAVE_NEON
+endif
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= yuv_convert.c
+LOCAL_CFLAGS:= $(YUV_CONVERT_CFLAGS)
+LOCAL_ARM_MODE:= arm
+LOCAL_EXPORT_C_INCLUDE_DIRS:= $(LOCAL_PATH)
+
+LOCAL_MODULE:= libyuvconvert
+LOCAL_MODULE_TAGS:= optional
+
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= yuv_convert.c
+LOCAL_CFLAGS:= $(YUV_CONVERT_CFLAGS)
+LOCAL_EXPORT_C_INCLUDE_DIRS:= $(LOCAL_PATH)
+
+LOCAL_MODULE:= libyuvconvert_host
+LOCAL_MODULE_TAGS:= optional
+LOCAL_MULTILIB:= 32
+
+include $(BUILD_HOST_STATIC_LIBRARY)
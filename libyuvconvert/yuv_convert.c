@@ -0,0 +1,782 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "yuv_convert.h"
+
+#if defined(ARCH_ARM_HAVE_NEON) || defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define YUV_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#define YUV_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/* AVX2 is not part of the x86 baseline, its kernels are built with a
+ * function level target and only selected if the cpu reports support */
+#if ( defined(__x86_64__) || defined(__i386__) ) && \
+    ( defined(__clang__) || ( defined(__GNUC__) && __GNUC__ >= 5 ) )
+#define YUV_HAVE_AVX2
+#define YUV_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+/* One set of row kernels, every operation works on byte pairs */
+typedef struct {
+    yuv_kernel_t id;
+    void (*swap)(const uint8_t *src, uint8_t *dst, int pairs);
+    void (*split)(const uint8_t *src, uint8_t *a, uint8_t *b, int pairs);
+    void (*merge)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int pairs);
+    /* every second byte of src starting at odd (0 or 1) */
+    void (*pick)(const uint8_t *src, uint8_t *dst, int count, int odd);
+    /* two rows of 32 bit RGB (BGR if bgr) to two luma rows and one chroma
+     * row, the second row repeats the first on the last row of odd heights */
+    void (*rgb)(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                uint8_t *uv, int width, int bgr);
+} row_kernels;
+
+/* BT.601 limited range in 8 bit fixed point. Every intermediate fits 16
+ * bits (unsigned for luma, signed for chroma) so the SIMD kernels are bit
+ * exact with the scalar one */
+#define RGB_Y(r, g, b) ((( 66 * (r) + 129 * (g) +  25 * (b) + 128) >> 8) + 16)
+#define RGB_U(r, g, b) (((-38 * (r) -  74 * (g) + 112 * (b) + 128) >> 8) + 128)
+#define RGB_V(r, g, b) (((112 * (r) -  94 * (g) -  18 * (b) + 128) >> 8) + 128)
+
+/*--------------------Scalar kernels----------------------------*/
+
+static void swap_scalar(const uint8_t *src, uint8_t *dst, int pairs) {
+    int i;
+    for ( i = 0; i < pairs; i++ ) {
+        uint8_t first = src[2 * i];
+        dst[2 * i] = src[2 * i + 1];
+        dst[2 * i + 1] = first;
+    }
+}
+
+static void split_scalar(const uint8_t *src, uint8_t *a, uint8_t *b, int pairs) {
+    int i;
+    for ( i = 0; i < pairs; i++ ) {
+        a[i] = src[2 * i];
+        b[i] = src[2 * i + 1];
+    }
+}
+
+static void merge_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, int pairs) {
+    int i;
+    for ( i = 0; i < pairs; i++ ) {
+        dst[2 * i] = a[i];
+        dst[2 * i + 1] = b[i];
+    }
+}
+
+static void pick_scalar(const uint8_t *src, uint8_t *dst, int count, int odd) {
+    int i;
+    src += odd;
+    for ( i = 0; i < count; i++ ) {
+        dst[i] = src[2 * i];
+    }
+}
+
+static void rgb_scalar(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                       uint8_t *uv, int width, int bgr) {
+    int ri = bgr ? 2 : 0;
+    int bi = 2 - ri;
+    int i;
+
+    for ( i = 0; i < width; i += 2 ) {
+        /* the last column of odd widths stands in for its missing pair */
+        int j = ( i + 1 < width ) ? i + 1 : i;
+        const uint8_t *a = src0 + 4 * i, *b = src0 + 4 * j;
+        const uint8_t *c = src1 + 4 * i, *d = src1 + 4 * j;
+        int r = (a[ri] + b[ri] + c[ri] + d[ri] + 2) >> 2;
+        int g = (a[1] + b[1] + c[1] + d[1] + 2) >> 2;
+        int bl = (a[bi] + b[bi] + c[bi] + d[bi] + 2) >> 2;
+
+        y0[i] = RGB_Y(a[ri], a[1], a[bi]);
+        y0[j] = RGB_Y(b[ri], b[1], b[bi]);
+        y1[i] = RGB_Y(c[ri], c[1], c[bi]);
+        y1[j] = RGB_Y(d[ri], d[1], d[bi]);
+        uv[i] = RGB_U(r, g, bl);
+        uv[i + 1] = RGB_V(r, g, bl);
+    }
+}
+
+static const row_kernels kScalarKernels = {
+    YUV_KERNEL_SCALAR, swap_scalar, split_scalar, merge_scalar, pick_scalar, rgb_scalar
+};
+
+/*--------------------NEON kernels------------------------------*/
+
+#ifdef YUV_HAVE_NEON
+static void swap_neon(const uint8_t *src, uint8_t *dst, int pairs) {
+    int i = 0;
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        uint8x16_t lo = vld1q_u8(src + 2 * i);
+        uint8x16_t hi = vld1q_u8(src + 2 * i + 16);
+        vst1q_u8(dst + 2 * i, vrev16q_u8(lo));
+        vst1q_u8(dst + 2 * i + 16, vrev16q_u8(hi));
+    }
+    for ( ; i + 4 <= pairs; i += 4 ) {
+        vst1_u8(dst + 2 * i, vrev16_u8(vld1_u8(src + 2 * i)));
+    }
+    swap_scalar(src + 2 * i, dst + 2 * i, pairs - i);
+}
+
+static void split_neon(const uint8_t *src, uint8_t *a, uint8_t *b, int pairs) {
+    int i = 0;
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        uint8x16x2_t v = vld2q_u8(src + 2 * i);
+        vst1q_u8(a + i, v.val[0]);
+        vst1q_u8(b + i, v.val[1]);
+    }
+    for ( ; i + 8 <= pairs; i += 8 ) {
+        uint8x8x2_t v = vld2_u8(src + 2 * i);
+        vst1_u8(a + i, v.val[0]);
+        vst1_u8(b + i, v.val[1]);
+    }
+    split_scalar(src + 2 * i, a + i, b + i, pairs - i);
+}
+
+static void merge_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst, int pairs) {
+    int i = 0;
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        uint8x16x2_t v;
+        v.val[0] = vld1q_u8(a + i);
+        v.val[1] = vld1q_u8(b + i);
+        vst2q_u8(dst + 2 * i, v);
+    }
+    for ( ; i + 8 <= pairs; i += 8 ) {
+        uint8x8x2_t v;
+        v.val[0] = vld1_u8(a + i);
+        v.val[1] = vld1_u8(b + i);
+        vst2_u8(dst + 2 * i, v);
+    }
+    merge_scalar(a + i, b + i, dst + 2 * i, pairs - i);
+}
+
+static void pick_neon(const uint8_t *src, uint8_t *dst, int count, int odd) {
+    int i = 0;
+    for ( ; i + 16 <= count; i += 16 ) {
+        uint8x16x2_t v = vld2q_u8(src + 2 * i);
+        vst1q_u8(dst + i, odd ? v.val[1] : v.val[0]);
+    }
+    pick_scalar(src + 2 * i, dst + i, count - i, odd);
+}
+
+static inline uint8x16_t luma_neon(uint8x16_t r, uint8x16_t g, uint8x16_t b) {
+    const uint8x8_t cr = vdup_n_u8(66), cg = vdup_n_u8(129), cb = vdup_n_u8(25);
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), cr);
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), cr);
+    lo = vmlal_u8(lo, vget_low_u8(g), cg);
+    hi = vmlal_u8(hi, vget_high_u8(g), cg);
+    lo = vmlal_u8(lo, vget_low_u8(b), cb);
+    hi = vmlal_u8(hi, vget_high_u8(b), cb);
+    return vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)), vdupq_n_u8(16));
+}
+
+/* rounded 2x2 average of one channel over two rows, 8 lanes */
+static inline int16x8_t average_neon(uint8x16_t top, uint8x16_t bottom) {
+    return vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(top), bottom), 2));
+}
+
+static void rgb_neon(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                     uint8_t *uv, int width, int bgr) {
+    int ri = bgr ? 2 : 0;
+    int bi = 2 - ri;
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        uint8x16x4_t p = vld4q_u8(src0 + 4 * i);
+        uint8x16x4_t q = vld4q_u8(src1 + 4 * i);
+        int16x8_t r, g, b, u, v;
+        uint8x8x2_t c;
+
+        vst1q_u8(y0 + i, luma_neon(p.val[ri], p.val[1], p.val[bi]));
+        vst1q_u8(y1 + i, luma_neon(q.val[ri], q.val[1], q.val[bi]));
+
+        r = average_neon(p.val[ri], q.val[ri]);
+        g = average_neon(p.val[1], q.val[1]);
+        b = average_neon(p.val[bi], q.val[bi]);
+        u = vmulq_n_s16(b, 112);
+        u = vmlsq_n_s16(u, r, 38);
+        u = vmlsq_n_s16(u, g, 74);
+        v = vmulq_n_s16(r, 112);
+        v = vmlsq_n_s16(v, g, 94);
+        v = vmlsq_n_s16(v, b, 18);
+        u = vaddq_s16(vrshrq_n_s16(u, 8), vdupq_n_s16(128));
+        v = vaddq_s16(vrshrq_n_s16(v, 8), vdupq_n_s16(128));
+        c.val[0] = vmovn_u16(vreinterpretq_u16_s16(u));
+        c.val[1] = vmovn_u16(vreinterpretq_u16_s16(v));
+        vst2_u8(uv + i, c);
+    }
+    rgb_scalar(src0 + 4 * i, src1 + 4 * i, y0 + i, y1 + i, uv + i, width - i, bgr);
+}
+
+static const row_kernels kNeonKernels = {
+    YUV_KERNEL_NEON, swap_neon, split_neon, merge_neon, pick_neon, rgb_neon
+};
+#endif
+
+/*--------------------SSE2 kernels------------------------------*/
+
+#ifdef YUV_HAVE_SSE2
+static void swap_sse2(const uint8_t *src, uint8_t *dst, int pairs) {
+    int i = 0;
+    for ( ; i + 8 <= pairs; i += 8 ) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), v);
+    }
+    swap_scalar(src + 2 * i, dst + 2 * i, pairs - i);
+}
+
+static void split_sse2(const uint8_t *src, uint8_t *a, uint8_t *b, int pairs) {
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(a + i),
+                         _mm_packus_epi16(_mm_and_si128(v0, mask), _mm_and_si128(v1, mask)));
+        _mm_storeu_si128((__m128i *)(b + i),
+                         _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8)));
+    }
+    split_scalar(src + 2 * i, a + i, b + i, pairs - i);
+}
+
+static void merge_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int pairs) {
+    int i = 0;
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(va, vb));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(va, vb));
+    }
+    merge_scalar(a + i, b + i, dst + 2 * i, pairs - i);
+}
+
+static void pick_sse2(const uint8_t *src, uint8_t *dst, int count, int odd) {
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        if ( odd ) {
+            v0 = _mm_srli_epi16(v0, 8);
+            v1 = _mm_srli_epi16(v1, 8);
+        } else {
+            v0 = _mm_and_si128(v0, mask);
+            v1 = _mm_and_si128(v1, mask);
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(v0, v1));
+    }
+    pick_scalar(src + 2 * i, dst + i, count - i, odd);
+}
+
+/* 8 pixels to one 16 bit lane per channel */
+static inline void unpack_rgb_sse2(const uint8_t *src, int bgr,
+                                   __m128i *r, __m128i *g, __m128i *b) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i p0 = _mm_loadu_si128((const __m128i *)src);
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i c0 = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    __m128i c2 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                                 _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+    *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                         _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    *r = bgr ? c2 : c0;
+    *b = bgr ? c0 : c2;
+}
+
+/* luma wraps past 32767 but never past 65535, hence the logical shift */
+static inline __m128i luma_sse2(__m128i r, __m128i g, __m128i b) {
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+/* rounded 2x2 averages of 16 pixels in two rows, given as 8 pixel halves */
+static inline __m128i average_sse2(__m128i top0, __m128i top1,
+                                   __m128i bottom0, __m128i bottom1) {
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i s0 = _mm_add_epi32(_mm_madd_epi16(top0, ones), _mm_madd_epi16(bottom0, ones));
+    __m128i s1 = _mm_add_epi32(_mm_madd_epi16(top1, ones), _mm_madd_epi16(bottom1, ones));
+    return _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(s0, s1), _mm_set1_epi16(2)), 2);
+}
+
+/* 8 chroma pairs from averaged channels */
+static inline __m128i chroma_sse2(__m128i r, __m128i g, __m128i b) {
+    const __m128i round = _mm_set1_epi16(128);
+    __m128i u = _mm_sub_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)),
+                              _mm_mullo_epi16(r, _mm_set1_epi16(38)));
+    __m128i v = _mm_sub_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(94)));
+    u = _mm_sub_epi16(u, _mm_mullo_epi16(g, _mm_set1_epi16(74)));
+    v = _mm_sub_epi16(v, _mm_mullo_epi16(b, _mm_set1_epi16(18)));
+    u = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(u, round), 8), round);
+    v = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(v, round), 8), round);
+    return _mm_or_si128(u, _mm_slli_epi16(v, 8));
+}
+
+static void rgb_sse2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                     uint8_t *uv, int width, int bgr) {
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        __m128i r[4], g[4], b[4];
+
+        unpack_rgb_sse2(src0 + 4 * i, bgr, &r[0], &g[0], &b[0]);
+        unpack_rgb_sse2(src0 + 4 * i + 32, bgr, &r[1], &g[1], &b[1]);
+        unpack_rgb_sse2(src1 + 4 * i, bgr, &r[2], &g[2], &b[2]);
+        unpack_rgb_sse2(src1 + 4 * i + 32, bgr, &r[3], &g[3], &b[3]);
+
+        _mm_storeu_si128((__m128i *)(y0 + i),
+                         _mm_packus_epi16(luma_sse2(r[0], g[0], b[0]),
+                                          luma_sse2(r[1], g[1], b[1])));
+        _mm_storeu_si128((__m128i *)(y1 + i),
+                         _mm_packus_epi16(luma_sse2(r[2], g[2], b[2]),
+                                          luma_sse2(r[3], g[3], b[3])));
+        _mm_storeu_si128((__m128i *)(uv + i),
+                         chroma_sse2(average_sse2(r[0], r[1], r[2], r[3]),
+                                     average_sse2(g[0], g[1], g[2], g[3]),
+                                     average_sse2(b[0], b[1], b[2], b[3])));
+    }
+    rgb_scalar(src0 + 4 * i, src1 + 4 * i, y0 + i, y1 + i, uv + i, width - i, bgr);
+}
+
+static const row_kernels kSse2Kernels = {
+    YUV_KERNEL_SSE2, swap_sse2, split_sse2, merge_sse2, pick_sse2, rgb_sse2
+};
+#endif
+
+/*--------------------AVX2 kernels------------------------------*/
+
+#ifdef YUV_HAVE_AVX2
+/* _mm256_packus_epi16 packs within 128 bit lanes, 0xD8 restores the order */
+#define PACK_ORDER 0xD8
+
+YUV_TARGET_AVX2
+static void swap_avx2(const uint8_t *src, uint8_t *dst, int pairs) {
+    int i = 0;
+    for ( ; i + 16 <= pairs; i += 16 ) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), v);
+    }
+    swap_scalar(src + 2 * i, dst + 2 * i, pairs - i);
+}
+
+YUV_TARGET_AVX2
+static void split_avx2(const uint8_t *src, uint8_t *a, uint8_t *b, int pairs) {
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    int i = 0;
+    for ( ; i + 32 <= pairs; i += 32 ) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+        __m256i va = _mm256_packus_epi16(_mm256_and_si256(v0, mask), _mm256_and_si256(v1, mask));
+        __m256i vb = _mm256_packus_epi16(_mm256_srli_epi16(v0, 8), _mm256_srli_epi16(v1, 8));
+        _mm256_storeu_si256((__m256i *)(a + i), _mm256_permute4x64_epi64(va, PACK_ORDER));
+        _mm256_storeu_si256((__m256i *)(b + i), _mm256_permute4x64_epi64(vb, PACK_ORDER));
+    }
+    split_scalar(src + 2 * i, a + i, b + i, pairs - i);
+}
+
+YUV_TARGET_AVX2
+static void merge_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int pairs) {
+    int i = 0;
+    for ( ; i + 32 <= pairs; i += 32 ) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i lo = _mm256_unpacklo_epi8(va, vb);
+        __m256i hi = _mm256_unpackhi_epi8(va, vb);
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    merge_scalar(a + i, b + i, dst + 2 * i, pairs - i);
+}
+
+YUV_TARGET_AVX2
+static void pick_avx2(const uint8_t *src, uint8_t *dst, int count, int odd) {
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    int i = 0;
+    for ( ; i + 32 <= count; i += 32 ) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+        if ( odd ) {
+            v0 = _mm256_srli_epi16(v0, 8);
+            v1 = _mm256_srli_epi16(v1, 8);
+        } else {
+            v0 = _mm256_and_si256(v0, mask);
+            v1 = _mm256_and_si256(v1, mask);
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), PACK_ORDER));
+    }
+    pick_scalar(src + 2 * i, dst + i, count - i, odd);
+}
+
+/* 16 pixels to one 16 bit lane per channel, in pixel order */
+YUV_TARGET_AVX2
+static inline void unpack_rgb_avx2(const uint8_t *src, int bgr,
+                                   __m256i *r, __m256i *g, __m256i *b) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i p0 = _mm256_loadu_si256((const __m256i *)src);
+    __m256i p1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+    __m256i c0 = _mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask));
+    __m256i c1 = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+                                    _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask));
+    __m256i c2 = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+                                    _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+    c0 = _mm256_permute4x64_epi64(c0, PACK_ORDER);
+    c2 = _mm256_permute4x64_epi64(c2, PACK_ORDER);
+    *g = _mm256_permute4x64_epi64(c1, PACK_ORDER);
+    *r = bgr ? c2 : c0;
+    *b = bgr ? c0 : c2;
+}
+
+YUV_TARGET_AVX2
+static inline __m128i luma_avx2(__m256i r, __m256i g, __m256i b) {
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+    y = _mm256_srli_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(128)), 8);
+    y = _mm256_add_epi16(y, _mm256_set1_epi16(16));
+    y = _mm256_permute4x64_epi64(_mm256_packus_epi16(y, y), PACK_ORDER);
+    return _mm256_castsi256_si128(y);
+}
+
+/* 8 averages in the low half, the high half repeats them */
+YUV_TARGET_AVX2
+static inline __m256i average_avx2(__m256i top, __m256i bottom) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i s = _mm256_add_epi32(_mm256_madd_epi16(top, ones), _mm256_madd_epi16(bottom, ones));
+    s = _mm256_permute4x64_epi64(_mm256_packs_epi32(s, s), PACK_ORDER);
+    return _mm256_srli_epi16(_mm256_add_epi16(s, _mm256_set1_epi16(2)), 2);
+}
+
+YUV_TARGET_AVX2
+static void rgb_avx2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                     uint8_t *uv, int width, int bgr) {
+    const __m256i round = _mm256_set1_epi16(128);
+    int i = 0;
+
+    for ( ; i + 16 <= width; i += 16 ) {
+        __m256i r0, g0, b0, r1, g1, b1, r, g, b, u, v;
+
+        unpack_rgb_avx2(src0 + 4 * i, bgr, &r0, &g0, &b0);
+        unpack_rgb_avx2(src1 + 4 * i, bgr, &r1, &g1, &b1);
+        _mm_storeu_si128((__m128i *)(y0 + i), luma_avx2(r0, g0, b0));
+        _mm_storeu_si128((__m128i *)(y1 + i), luma_avx2(r1, g1, b1));
+
+        r = average_avx2(r0, r1);
+        g = average_avx2(g0, g1);
+        b = average_avx2(b0, b1);
+        u = _mm256_sub_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(112)),
+                             _mm256_mullo_epi16(r, _mm256_set1_epi16(38)));
+        v = _mm256_sub_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(112)),
+                             _mm256_mullo_epi16(g, _mm256_set1_epi16(94)));
+        u = _mm256_sub_epi16(u, _mm256_mullo_epi16(g, _mm256_set1_epi16(74)));
+        v = _mm256_sub_epi16(v, _mm256_mullo_epi16(b, _mm256_set1_epi16(18)));
+        u = _mm256_add_epi16(_mm256_srai_epi16(_mm256_add_epi16(u, round), 8), round);
+        v = _mm256_add_epi16(_mm256_srai_epi16(_mm256_add_epi16(v, round), 8), round);
+        _mm_storeu_si128((__m128i *)(uv + i),
+                         _mm256_castsi256_si128(_mm256_or_si256(u, _mm256_slli_epi16(v, 8))));
+    }
+    rgb_scalar(src0 + 4 * i, src1 + 4 * i, y0 + i, y1 + i, uv + i, width - i, bgr);
+}
+
+static const row_kernels kAvx2Kernels = {
+    YUV_KERNEL_AVX2, swap_avx2, split_avx2, merge_avx2, pick_avx2, rgb_avx2
+};
+#endif
+
+/*--------------------Dispatch----------------------------------*/
+
+static pthread_once_t sDetectOnce = PTHREAD_ONCE_INIT;
+static int sHaveAvx2;
+static const row_kernels * volatile sKernels;
+
+static void detectCpu(void) {
+#ifdef YUV_HAVE_AVX2
+    __builtin_cpu_init();
+    sHaveAvx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+static const row_kernels *kernelsFor(yuv_kernel_t kernel) {
+    pthread_once(&sDetectOnce, detectCpu);
+
+    switch ( kernel ) {
+        case YUV_KERNEL_SCALAR:
+            return &kScalarKernels;
+#ifdef YUV_HAVE_NEON
+        /* NEON is part of the ARM target the library is built for */
+        case YUV_KERNEL_NEON:
+            return &kNeonKernels;
+#endif
+#ifdef YUV_HAVE_SSE2
+        case YUV_KERNEL_SSE2:
+            return &kSse2Kernels;
+#endif
+#ifdef YUV_HAVE_AVX2
+        case YUV_KERNEL_AVX2:
+            return sHaveAvx2 ? &kAvx2Kernels : NULL;
+#endif
+        case YUV_KERNEL_AUTO:
+#ifdef YUV_HAVE_AVX2
+            if ( sHaveAvx2 ) {
+                return &kAvx2Kernels;
+            }
+#endif
+#if defined(YUV_HAVE_NEON)
+            return &kNeonKernels;
+#elif defined(YUV_HAVE_SSE2)
+            return &kSse2Kernels;
+#else
+            return &kScalarKernels;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static const row_kernels *kernels(void) {
+    const row_kernels *k = sKernels;
+    if ( NULL == k ) {
+        k = kernelsFor(YUV_KERNEL_AUTO);
+        sKernels = k;
+    }
+    return k;
+}
+
+int yuv_kernel_available(yuv_kernel_t kernel) {
+    return NULL != kernelsFor(kernel);
+}
+
+int yuv_set_kernel(yuv_kernel_t kernel) {
+    const row_kernels *k = kernelsFor(kernel);
+    if ( NULL == k ) {
+        return -1;
+    }
+    sKernels = k;
+    return 0;
+}
+
+yuv_kernel_t yuv_get_kernel(void) {
+    return kernels()->id;
+}
+
+const char *yuv_kernel_name(yuv_kernel_t kernel) {
+    switch ( kernel ) {
+        case YUV_KERNEL_AUTO:   return "auto";
+        case YUV_KERNEL_SCALAR: return "scalar";
+        case YUV_KERNEL_NEON:   return "neon";
+        case YUV_KERNEL_SSE2:   return "sse2";
+        case YUV_KERNEL_AVX2:   return "avx2";
+        default:                return "unknown";
+    }
+}
+
+/*--------------------Plane operations--------------------------*/
+
+void yuv_copy_plane(const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    int width, int rows) {
+    int i;
+
+    if ( ( src_stride == width ) && ( dst_stride == width ) ) {
+        memcpy(dst, src, (size_t)width * rows);
+        return;
+    }
+
+    for ( i = 0; i < rows; i++ ) {
+        memcpy(dst, src, width);
+        src += src_stride;
+        dst += dst_stride;
+    }
+}
+
+void yuv_swap_pairs(const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    int pairs, int rows) {
+    const row_kernels *k = kernels();
+    int i;
+
+    for ( i = 0; i < rows; i++ ) {
+        k->swap(src, dst, pairs);
+        src += src_stride;
+        dst += dst_stride;
+    }
+}
+
+void yuv_split_pairs(const uint8_t *src, int src_stride,
+                     uint8_t *dst_a, int a_stride,
+                     uint8_t *dst_b, int b_stride,
+                     int pairs, int rows) {
+    const row_kernels *k = kernels();
+    int i;
+
+    for ( i = 0; i < rows; i++ ) {
+        k->split(src, dst_a, dst_b, pairs);
+        src += src_stride;
+        dst_a += a_stride;
+        dst_b += b_stride;
+    }
+}
+
+void yuv_merge_pairs(const uint8_t *src_a, int a_stride,
+                     const uint8_t *src_b, int b_stride,
+                     uint8_t *dst, int dst_stride,
+                     int pairs, int rows) {
+    const row_kernels *k = kernels();
+    int i;
+
+    for ( i = 0; i < rows; i++ ) {
+        k->merge(src_a, src_b, dst, pairs);
+        src_a += a_stride;
+        src_b += b_stride;
+        dst += dst_stride;
+    }
+}
+
+/*--------------------Frame conversions-------------------------*/
+
+void yuv_nv12_to_nv21(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_uv, int src_uv_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_vu, int dst_vu_stride,
+                      int width, int height) {
+    yuv_copy_plane(src_y, src_y_stride, dst_y, dst_y_stride, width, height);
+    yuv_swap_pairs(src_uv, src_uv_stride, dst_vu, dst_vu_stride,
+                   (width + 1) / 2, (height + 1) / 2);
+}
+
+void yuv_nv12_to_i420(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_uv, int src_uv_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_u, int dst_u_stride,
+                      uint8_t *dst_v, int dst_v_stride,
+                      int width, int height) {
+    yuv_copy_plane(src_y, src_y_stride, dst_y, dst_y_stride, width, height);
+    yuv_split_pairs(src_uv, src_uv_stride, dst_u, dst_u_stride, dst_v, dst_v_stride,
+                    (width + 1) / 2, (height + 1) / 2);
+}
+
+void yuv_i420_to_nv12(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_u, int src_u_stride,
+                      const uint8_t *src_v, int src_v_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height) {
+    yuv_copy_plane(src_y, src_y_stride, dst_y, dst_y_stride, width, height);
+    yuv_merge_pairs(src_u, src_u_stride, src_v, src_v_stride, dst_uv, dst_uv_stride,
+                    (width + 1) / 2, (height + 1) / 2);
+}
+
+static void packed422ToNV12(const uint8_t *src, int src_stride,
+                            uint8_t *dst_y, int dst_y_stride,
+                            uint8_t *dst_uv, int dst_uv_stride,
+                            int width, int height, int luma_odd) {
+    const row_kernels *k = kernels();
+    int i;
+
+    for ( i = 0; i < height; i++ ) {
+        if ( i & 1 ) {
+            k->pick(src, dst_y, width, luma_odd);
+        } else {
+            if ( luma_odd ) {
+                k->split(src, dst_uv, dst_y, width);
+            } else {
+                k->split(src, dst_y, dst_uv, width);
+            }
+            dst_uv += dst_uv_stride;
+        }
+        src += src_stride;
+        dst_y += dst_y_stride;
+    }
+}
+
+void yuv_yuyv_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height) {
+    packed422ToNV12(src, src_stride, dst_y, dst_y_stride, dst_uv, dst_uv_stride,
+                    width, height, 0);
+}
+
+void yuv_uyvy_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height) {
+    packed422ToNV12(src, src_stride, dst_y, dst_y_stride, dst_uv, dst_uv_stride,
+                    width, height, 1);
+}
+
+void yuv_nv12_to_yuyv(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_uv, int src_uv_stride,
+                      uint8_t *dst, int dst_stride,
+                      int width, int height) {
+    const row_kernels *k = kernels();
+    int i;
+
+    for ( i = 0; i < height; i++ ) {
+        k->merge(src_y, src_uv, dst, width);
+        if ( i & 1 ) {
+            src_uv += src_uv_stride;
+        }
+        src_y += src_y_stride;
+        dst += dst_stride;
+    }
+}
+
+static void rgb32ToNV12(const uint8_t *src, int src_stride,
+                        uint8_t *dst_y, int dst_y_stride,
+                        uint8_t *dst_uv, int dst_uv_stride,
+                        int width, int height, int bgr) {
+    const row_kernels *k = kernels();
+    int i;
+
+    for ( i = 0; i < height; i += 2 ) {
+        int last = ( i + 1 == height );
+        k->rgb(src, last ? src : src + src_stride, dst_y, last ? dst_y : dst_y + dst_y_stride,
+               dst_uv, width, bgr);
+        src += 2 * src_stride;
+        dst_y += 2 * dst_y_stride;
+        dst_uv += dst_uv_stride;
+    }
+}
+
+void yuv_rgba_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height) {
+    rgb32ToNV12(src, src_stride, dst_y, dst_y_stride, dst_uv, dst_uv_stride,
+                width, height, 0);
+}
+
+void yuv_bgra_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height) {
+    rgb32ToNV12(src, src_stride, dst_y, dst_y_stride, dst_uv, dst_uv_stride,
+                width, height, 1);
+}
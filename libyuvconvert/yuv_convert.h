@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef YUV_CONVERT_H
+#define YUV_CONVERT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pixel layout conversions shared by the camera HAL, libI420colorconvert
+ * and the DOMX proxies.
+ *
+ * Every plane is described by a pointer to its first visible sample and
+ * a stride in bytes, so cropping is done by offsetting the plane pointers
+ * (luma by y * stride + x, chroma by (y / 2) * stride + x for NV12 with
+ * even x). Widths and heights are in luma pixels; odd sizes round the
+ * chroma planes up. Packed 4:2:2 formats need an even width. Nothing is
+ * ever written past width bytes (or pairs) of a destination row.
+ */
+
+/* Row kernel set, AUTO picks the best one supported by the running cpu */
+typedef enum {
+    YUV_KERNEL_AUTO,
+    YUV_KERNEL_SCALAR,
+    YUV_KERNEL_NEON,
+    YUV_KERNEL_SSE2,
+    YUV_KERNEL_AVX2,
+} yuv_kernel_t;
+
+/* Non zero if the kernel is built in and supported by the cpu */
+int yuv_kernel_available(yuv_kernel_t kernel);
+
+/* Process wide kernel selection, returns -1 if the kernel is not available */
+int yuv_set_kernel(yuv_kernel_t kernel);
+
+/* Kernel currently in use, never AUTO */
+yuv_kernel_t yuv_get_kernel(void);
+
+const char *yuv_kernel_name(yuv_kernel_t kernel);
+
+/*--------------------Plane operations--------------------------*/
+
+void yuv_copy_plane(const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    int width, int rows);
+
+/* Swap the bytes of every pair: NV12 <-> NV21 chroma, YUYV <-> UYVY.
+ * src and dst may be the same buffer */
+void yuv_swap_pairs(const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    int pairs, int rows);
+
+/* De-interleave pairs into two planes: NV12 chroma -> U and V */
+void yuv_split_pairs(const uint8_t *src, int src_stride,
+                     uint8_t *dst_a, int a_stride,
+                     uint8_t *dst_b, int b_stride,
+                     int pairs, int rows);
+
+/* Interleave two planes into pairs: U and V -> NV12 chroma */
+void yuv_merge_pairs(const uint8_t *src_a, int a_stride,
+                     const uint8_t *src_b, int b_stride,
+                     uint8_t *dst, int dst_stride,
+                     int pairs, int rows);
+
+/*--------------------Frame conversions-------------------------*/
+
+void yuv_nv12_to_nv21(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_uv, int src_uv_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_vu, int dst_vu_stride,
+                      int width, int height);
+
+/* Swap dst_u and dst_v for YV12 */
+void yuv_nv12_to_i420(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_uv, int src_uv_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_u, int dst_u_stride,
+                      uint8_t *dst_v, int dst_v_stride,
+                      int width, int height);
+
+void yuv_i420_to_nv12(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_u, int src_u_stride,
+                      const uint8_t *src_v, int src_v_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height);
+
+/* Packed 4:2:2 to NV12, chroma is taken from the even source rows */
+void yuv_yuyv_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height);
+
+void yuv_uyvy_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height);
+
+/* NV12 to packed YUYV, every chroma row is used for two output rows */
+void yuv_nv12_to_yuyv(const uint8_t *src_y, int src_y_stride,
+                      const uint8_t *src_uv, int src_uv_stride,
+                      uint8_t *dst, int dst_stride,
+                      int width, int height);
+
+/* 32 bit RGB to NV12 with BT.601 limited range coefficients, each chroma
+ * sample is the rounded average of its 2x2 block. The fourth byte of a
+ * pixel (alpha or padding) is ignored and a source is cropped by
+ * y * stride + 4 * x. Bands starting on even rows convert independently,
+ * so a frame can be split across threads */
+void yuv_rgba_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height);
+
+void yuv_bgra_to_nv12(const uint8_t *src, int src_stride,
+                      uint8_t *dst_y, int dst_y_stride,
+                      uint8_t *dst_uv, int dst_uv_stride,
+                      int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YUV_CONVERT_H */
@@ -102,3 +102,121 @@ endif
 include $(BUILD_HEAPTRACKED_EXECUTABLE)
 
 endif
+
+# Host side golden image test for the CameraHal NV12 resize engine
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	nv12_resize_test.cpp \
+	../../camera/NV12_resize.cpp \
+	../../libtiutils/WorkerPool.cpp \
+	../../libtiutils/DebugUtils.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+	libutils \
+	libcutils \
+	liblog
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
+	$(HARDWARE_TI_OMAP4_BASE)/libtiutils
+
+LOCAL_MODULE:= nv12_resize_test
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 -DLOG_TAG=\"nv12_resize_test\" $(ANDROID_API_CFLAGS)
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host side stress test for the V4L preview pipeline, runs against a fake
+# device by default or against a real V4L2 device such as vivid with -d
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	v4l_pipeline_test.cpp \
+	../../camera/V4LCameraAdapter/V4LPreviewPipeline.cpp \
+	../../libtiutils/WorkerPool.cpp \
+	../../libtiutils/Semaphore.cpp \
+	../../libtiutils/ErrorUtils.cpp \
+	../../libtiutils/DebugUtils.cpp
+
+LOCAL_STATIC_LIBRARIES:= \
+	libyuvconvert_host
+
+LOCAL_SHARED_LIBRARIES:= \
+	libutils \
+	libcutils \
+	liblog
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
+	$(HARDWARE_TI_OMAP4_BASE)/camera/inc/V4LCameraAdapter \
+	$(HARDWARE_TI_OMAP4_BASE)/libtiutils \
+	$(HARDWARE_TI_OMAP4_BASE)/domx/omx_core/inc \
+	$(HARDWARE_TI_OMAP4_BASE)/domx/mm_osal/inc \
+	frameworks/native/include/media/openmax
+
+LOCAL_MODULE:= v4l_pipeline_test
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 -DLOG_TAG=\"v4l_pipeline_test\" $(ANDROID_API_CFLAGS)
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host side check and contention benchmark for the camera adapter frame
+# reference counts
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	frame_ref_test.cpp \
+	../../camera/FrameRefTable.cpp \
+	../../libtiutils/DebugUtils.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+	libutils \
+	libcutils \
+	liblog
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
+	$(HARDWARE_TI_OMAP4_BASE)/libtiutils
+
+LOCAL_MODULE:= frame_ref_test
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 -DLOG_TAG=\"frame_ref_test\" $(ANDROID_API_CFLAGS)
+LOCAL_LDLIBS += -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Bit exactness test for the sliced MJPEG decoder
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	mjpeg_decode_test.cpp \
+	../../camera/Decoder_libjpeg.cpp
+
+LOCAL_STATIC_LIBRARIES:= \
+	libyuvconvert
+
+LOCAL_SHARED_LIBRARIES:= \
+	libtiutils \
+	libjpeg \
+	libutils \
+	libcutils \
+	liblog
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
+	$(HARDWARE_TI_OMAP4_BASE)/libtiutils \
+	external/jpeg
+
+LOCAL_MODULE:= mjpeg_decode_test
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 -DLOG_TAG=\"mjpeg_decode_test\" $(ANDROID_API_CFLAGS)
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test and microbenchmark for the frame reference count table of the
+ * camera adapter.
+ *
+ * The check phase releases one buffer from several threads at once, many
+ * times over, and verifies that exactly one release per round sees the
+ * buffer become free, which is what makes returnFrame() safe without a
+ * lock. The reuse phase keeps handing the single free slot back and forth
+ * between two buffers while other threads release the one that just lost
+ * it, and verifies that none of those late releases lands on the other.
+ *
+ * The benchmark phase replays what sendFrameToSubscribers() and
+ * returnFrame() do for every frame: set the initial counts of a preview
+ * buffer (and of the video group while recording), look them up once per
+ * frame type during fan out, then return the frame once per subscriber.
+ * Every thread streams its own buffers through one shared table. The same
+ * sequence runs against a copy of the previous scheme, one mutex and one
+ * KeyedVector per frame type plus the return frame mutex, to show the
+ * difference in contention.
+ *
+ * Usage: frame_ref_test [-t threads] [-n frames per thread] [-b buffers per thread]
+ *                       [-s subscribers] [-r (recording)]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "FrameRefTable.h"
+
+using namespace Ti::Camera;
+
+enum {
+    PREVIEW_GROUP = 2,
+    VIDEO_GROUP = 4,
+    MAX_THREADS = 16,
+    MAX_BUFFERS = 8
+};
+
+struct Options {
+    int threads;
+    int frames;
+    int buffers;
+    int subscribers;
+    bool recording;
+};
+
+/* stands in for a CameraBuffer, only the address is used */
+struct Buffer {
+    char data[64];
+};
+
+/*--------------------Previous scheme-----------------------------*/
+
+class LockedRefTable {
+public:
+    int get(const void* buffer, int group) {
+        android::AutoMutex lock(mLocks[group]);
+        ssize_t index = mCounts[group].indexOfKey(buffer);
+        return ( 0 <= index ) ? mCounts[group].valueAt(index) : -1;
+    }
+
+    void set(const void* buffer, int group, int count) {
+        android::AutoMutex lock(mLocks[group]);
+        mCounts[group].replaceValueFor(buffer, count);
+    }
+
+    int release(const void* buffer, int group, int* total) {
+        android::AutoMutex lock(mReturnLock);
+        int count = get(buffer, group);
+
+        if ( 0 >= count ) {
+            return -1;
+        }
+
+        set(buffer, group, --count);
+        *total = 0;
+        for ( int i = 0; i < FrameRefTable::MAX_GROUPS; i++ ) {
+            int other = get(buffer, i);
+            if ( 0 < other ) {
+                *total += other;
+            }
+        }
+
+        return count;
+    }
+
+private:
+    android::Mutex mReturnLock;
+    android::Mutex mLocks[FrameRefTable::MAX_GROUPS];
+    android::KeyedVector<const void*, int> mCounts[FrameRefTable::MAX_GROUPS];
+};
+
+/*--------------------Check-----------------------------*/
+
+struct CheckShared {
+    FrameRefTable table;
+    pthread_barrier_t barrier;
+    int rounds;
+    int freed;
+    int bad;
+};
+
+static char sCheckBuffer;
+
+static void* checkThread(void* arg) {
+    CheckShared* shared = static_cast<CheckShared*>(arg);
+
+    for ( int round = 0; round < shared->rounds; round++ ) {
+        int total = -1;
+
+        pthread_barrier_wait(&shared->barrier);
+
+        // every thread holds one preview and one video reference
+        int preview = shared->table.release(&sCheckBuffer, PREVIEW_GROUP, &total);
+        if ( 0 > preview ) {
+            __atomic_add_fetch(&shared->bad, 1, __ATOMIC_RELAXED);
+        } else if ( 0 == total ) {
+            __atomic_add_fetch(&shared->freed, 1, __ATOMIC_RELAXED);
+        }
+
+        int video = shared->table.release(&sCheckBuffer, VIDEO_GROUP, &total);
+        if ( 0 > video ) {
+            __atomic_add_fetch(&shared->bad, 1, __ATOMIC_RELAXED);
+        } else if ( 0 == total ) {
+            __atomic_add_fetch(&shared->freed, 1, __ATOMIC_RELAXED);
+        }
+
+        pthread_barrier_wait(&shared->barrier);
+
+        // a release past zero must be refused
+        if ( 0 <= shared->table.release(&sCheckBuffer, PREVIEW_GROUP, &total) ) {
+            __atomic_add_fetch(&shared->bad, 1, __ATOMIC_RELAXED);
+        }
+
+        // the main thread checks and refills in between
+        pthread_barrier_wait(&shared->barrier);
+        pthread_barrier_wait(&shared->barrier);
+    }
+
+    return NULL;
+}
+
+static bool check(int threads) {
+    CheckShared* shared = new CheckShared;
+    pthread_t tids[MAX_THREADS];
+    bool ok = true;
+
+    shared->rounds = 2000;
+    shared->freed = 0;
+    shared->bad = 0;
+    pthread_barrier_init(&shared->barrier, NULL, threads + 1);
+
+    for ( int i = 0; i < threads; i++ ) {
+        pthread_create(&tids[i], NULL, checkThread, shared);
+    }
+
+    for ( int round = 0; round < shared->rounds; round++ ) {
+        shared->table.set(&sCheckBuffer, PREVIEW_GROUP, threads);
+        shared->table.set(&sCheckBuffer, VIDEO_GROUP, threads);
+        pthread_barrier_wait(&shared->barrier);
+        pthread_barrier_wait(&shared->barrier);
+        pthread_barrier_wait(&shared->barrier);
+
+        if ( ( 0 != shared->table.get(&sCheckBuffer, PREVIEW_GROUP) ) ||
+             ( 0 != shared->table.total(&sCheckBuffer) ) ) {
+            ok = false;
+        }
+        pthread_barrier_wait(&shared->barrier);
+    }
+
+    for ( int i = 0; i < threads; i++ ) {
+        pthread_join(tids[i], NULL);
+    }
+
+    if ( ( shared->freed != shared->rounds ) || ( 0 != shared->bad ) ) {
+        ok = false;
+    }
+
+    printf("check: %d threads, %d rounds, %d frees, %d bad releases: %s\n",
+           threads, shared->rounds, shared->freed, shared->bad, ok ? "PASS" : "FAIL");
+
+    // groups that were cleared give their slots back
+    for ( int i = 0; i < FrameRefTable::MAX_GROUPS; i++ ) {
+        shared->table.clear(i);
+    }
+    static Buffer other[FrameRefTable::MAX_SLOTS];
+    for ( int i = 0; i < FrameRefTable::MAX_SLOTS; i++ ) {
+        shared->table.set(&other[i], PREVIEW_GROUP, 1);
+        if ( 1 != shared->table.get(&other[i], PREVIEW_GROUP) ) {
+            printf("check: slot %d not reused: FAIL\n", i);
+            ok = false;
+            break;
+        }
+    }
+
+    pthread_barrier_destroy(&shared->barrier);
+    delete shared;
+
+    return ok;
+}
+
+/*--------------------Slot reuse-----------------------------*/
+
+struct ReuseShared {
+    FrameRefTable table;
+    Buffer stale;
+    Buffer fresh;
+    int stop;
+};
+
+static void* reuseThread(void* arg) {
+    ReuseShared* shared = static_cast<ReuseShared*>(arg);
+    int total;
+
+    while ( !__atomic_load_n(&shared->stop, __ATOMIC_ACQUIRE) ) {
+        shared->table.release(&shared->stale, PREVIEW_GROUP, &total);
+    }
+
+    return NULL;
+}
+
+static bool checkReuse(int threads) {
+    ReuseShared* shared = new ReuseShared;
+    static Buffer others[FrameRefTable::MAX_SLOTS - 1];
+    pthread_t tids[MAX_THREADS];
+    int rounds = 20000;
+    int bad = 0;
+
+    // leave a single free slot, the two buffers take turns in it
+    for ( int i = 0; i < FrameRefTable::MAX_SLOTS - 1; i++ ) {
+        shared->table.set(&others[i], VIDEO_GROUP, 0);
+    }
+
+    shared->stop = 0;
+    for ( int i = 0; i < threads; i++ ) {
+        pthread_create(&tids[i], NULL, reuseThread, shared);
+    }
+
+    for ( int round = 0; round < rounds; round++ ) {
+        shared->table.set(&shared->stale, PREVIEW_GROUP, 1 << 20);
+        shared->table.clear(PREVIEW_GROUP);
+
+        shared->table.set(&shared->fresh, PREVIEW_GROUP, 2);
+        for ( int i = 0; i < 64; i++ ) {
+            if ( ( 2 != shared->table.get(&shared->fresh, PREVIEW_GROUP) ) ||
+                 ( 2 != shared->table.total(&shared->fresh) ) ) {
+                bad++;
+                break;
+            }
+        }
+        shared->table.clear(PREVIEW_GROUP);
+    }
+
+    __atomic_store_n(&shared->stop, 1, __ATOMIC_RELEASE);
+    for ( int i = 0; i < threads; i++ ) {
+        pthread_join(tids[i], NULL);
+    }
+
+    printf("reuse: %d threads, %d rounds, %d late releases landed: %s\n",
+           threads, rounds, bad, bad ? "FAIL" : "PASS");
+
+    delete shared;
+
+    return 0 == bad;
+}
+
+/*--------------------Benchmark-----------------------------*/
+
+template <typename Table>
+struct BenchShared {
+    Table* table;
+    const Options* opt;
+    Buffer buffers[MAX_THREADS][MAX_BUFFERS];
+    int fills;
+    int bad;
+};
+
+template <typename Table>
+struct BenchThread {
+    BenchShared<Table>* shared;
+    int self;
+};
+
+template <typename Table>
+static void* benchThread(void* arg) {
+    BenchShared<Table>* shared = static_cast<BenchThread<Table>*>(arg)->shared;
+    int self = static_cast<BenchThread<Table>*>(arg)->self;
+    const Options* opt = shared->opt;
+    int fills = 0;
+    int bad = 0;
+
+    for ( int frame = 0; frame < opt->frames; frame++ ) {
+        const void* buffer = &shared->buffers[self][frame % opt->buffers];
+        int total = -1;
+
+        // setInitFrameRefCount()
+        shared->table->set(buffer, PREVIEW_GROUP, opt->subscribers);
+        if ( opt->recording ) {
+            shared->table->set(buffer, VIDEO_GROUP, 1);
+        }
+
+        // __sendFrameToSubscribers(), one lookup per frame type
+        if ( opt->subscribers != shared->table->get(buffer, PREVIEW_GROUP) ) {
+            bad++;
+        }
+        if ( opt->recording && ( 1 != shared->table->get(buffer, VIDEO_GROUP) ) ) {
+            bad++;
+        }
+
+        // returnFrame() from every subscriber
+        int left = 0;
+        for ( int i = 0; i < opt->subscribers; i++ ) {
+            left = shared->table->release(buffer, PREVIEW_GROUP, &total);
+        }
+        if ( opt->recording ) {
+            shared->table->release(buffer, VIDEO_GROUP, &total);
+            left = total;
+        }
+        if ( 0 == left ) {
+            fills++;
+        }
+    }
+
+    __atomic_add_fetch(&shared->fills, fills, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shared->bad, bad, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+
+template <typename Table>
+static bool bench(const char* name, const Options& opt) {
+    BenchShared<Table>* shared = new BenchShared<Table>;
+    BenchThread<Table> threads[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+
+    shared->table = new Table;
+    shared->opt = &opt;
+    shared->fills = 0;
+    shared->bad = 0;
+
+    // buffers are registered at use buffers time
+    for ( int t = 0; t < opt.threads; t++ ) {
+        for ( int b = 0; b < opt.buffers; b++ ) {
+            shared->table->set(&shared->buffers[t][b], PREVIEW_GROUP, 0);
+            shared->table->set(&shared->buffers[t][b], VIDEO_GROUP, 0);
+        }
+    }
+
+    nsecs_t start = systemTime();
+    for ( int i = 0; i < opt.threads; i++ ) {
+        threads[i].shared = shared;
+        threads[i].self = i;
+        pthread_create(&tids[i], NULL, benchThread<Table>, &threads[i]);
+    }
+    for ( int i = 0; i < opt.threads; i++ ) {
+        pthread_join(tids[i], NULL);
+    }
+    nsecs_t elapsed = systemTime() - start;
+
+    int frames = opt.threads * opt.frames;
+    bool ok = ( frames == shared->fills ) && ( 0 == shared->bad );
+
+    printf("%-8s %d threads: %d frames in %.1f ms, %.0f ns per frame: %s\n",
+           name, opt.threads, frames, elapsed / 1e6, (double) elapsed / frames,
+           ok ? "PASS" : "FAIL");
+
+    delete shared->table;
+    delete shared;
+
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Options opt = { 4, 200000, 6, 3, false };
+    int c;
+
+    while ( (c = getopt(argc, argv, "t:n:b:s:r")) != -1 ) {
+        switch ( c ) {
+            case 't': opt.threads = atoi(optarg); break;
+            case 'n': opt.frames = atoi(optarg); break;
+            case 'b': opt.buffers = atoi(optarg); break;
+            case 's': opt.subscribers = atoi(optarg); break;
+            case 'r': opt.recording = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-t threads] [-n frames] [-b buffers] "
+                        "[-s subscribers] [-r]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if ( ( 0 >= opt.threads ) || ( MAX_THREADS < opt.threads ) ||
+         ( 0 >= opt.buffers ) || ( MAX_BUFFERS < opt.buffers ) ||
+         ( 0 >= opt.subscribers ) || ( 0 >= opt.frames ) ) {
+        fprintf(stderr, "at most %d threads and %d buffers per thread\n",
+                MAX_THREADS, MAX_BUFFERS);
+        return 2;
+    }
+
+    bool ok = check(opt.threads > 1 ? opt.threads : 2);
+
+    ok &= checkReuse(opt.threads > 1 ? opt.threads : 2);
+
+    ok &= bench<LockedRefTable>("locked", opt);
+    ok &= bench<FrameRefTable>("table", opt);
+
+    return ok ? 0 : 1;
+}
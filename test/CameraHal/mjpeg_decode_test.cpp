@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks Decoder_libjpeg against a plain libjpeg decode.
+ *
+ * Test frames are encoded here with 4:2:2 and 4:2:0 sampling, with and
+ * without restart markers, and with the Huffman tables stripped the way
+ * USB cameras send MJPEG. The NV12 output, including sliced decodes,
+ * must be bit exact. Truncated and corrupted frames must not crash.
+ *
+ * Restart settings are MCU rows, or MCUs when negative.
+ *
+ * Usage: mjpeg_decode_test [-b WxH]   (-b also times decoding)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Decoder_libjpeg.h"
+
+extern "C" {
+#include "jpeglib.h"
+}
+
+using Ti::Camera::Decoder_libjpeg;
+
+static const int kStride = 4096;
+
+struct Buffer {
+    unsigned char* data;
+    unsigned long size;
+};
+
+static void fillImage(unsigned char* rgb, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char* p = rgb + 3 * (y * width + x);
+            p[0] = (unsigned char)(x * 255 / width);
+            p[1] = (unsigned char)(y * 255 / height);
+            p[2] = (unsigned char)(((x / 16) ^ (y / 16)) & 1 ? 200 : 40);
+        }
+    }
+}
+
+/* In memory destination and source, older libjpeg has neither */
+struct MemoryDest : jpeg_destination_mgr {
+    Buffer* out;
+    unsigned long capacity;
+};
+
+static void memInitDestination(j_compress_ptr cinfo) {
+    MemoryDest* dest = (MemoryDest*)cinfo->dest;
+    dest->capacity = 65536;
+    dest->out->data = (unsigned char*)malloc(dest->capacity);
+    dest->next_output_byte = dest->out->data;
+    dest->free_in_buffer = dest->capacity;
+}
+
+static boolean memEmptyOutputBuffer(j_compress_ptr cinfo) {
+    MemoryDest* dest = (MemoryDest*)cinfo->dest;
+    dest->out->data = (unsigned char*)realloc(dest->out->data, dest->capacity * 2);
+    dest->next_output_byte = dest->out->data + dest->capacity;
+    dest->free_in_buffer = dest->capacity;
+    dest->capacity *= 2;
+    return TRUE;
+}
+
+static void memTermDestination(j_compress_ptr cinfo) {
+    MemoryDest* dest = (MemoryDest*)cinfo->dest;
+    dest->out->size = dest->capacity - dest->free_in_buffer;
+}
+
+static void memInitSource(j_decompress_ptr) {}
+static void memTermSource(j_decompress_ptr) {}
+
+static boolean memFillInputBuffer(j_decompress_ptr cinfo) {
+    static const JOCTET eoi[2] = { 0xff, 0xd9 };
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+static void memSkipInputData(j_decompress_ptr cinfo, long count) {
+    cinfo->src->next_input_byte += count;
+    cinfo->src->bytes_in_buffer -= count;
+}
+
+/* Baseline jpeg with the default (standard) Huffman tables */
+static Buffer encode(const unsigned char* rgb, int width, int height, int vsamp, int restartRows) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    MemoryDest dest;
+    Buffer out = { NULL, 0 };
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    dest.out = &out;
+    dest.init_destination = memInitDestination;
+    dest.empty_output_buffer = memEmptyOutputBuffer;
+    dest.term_destination = memTermDestination;
+    cinfo.dest = &dest;
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = vsamp;
+    // negative values are a restart interval in MCUs instead of MCU rows
+    if (restartRows < 0) {
+        cinfo.restart_interval = -restartRows;
+    } else {
+        cinfo.restart_in_rows = restartRows;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)(rgb + 3 * cinfo.next_scanline * width);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return out;
+}
+
+/* Removes the DHT segments, as MJPEG streams do */
+static void stripDHT(Buffer& jpeg) {
+    unsigned long pos = 2;
+
+    while (pos + 4 <= jpeg.size && jpeg.data[pos] == 0xff && jpeg.data[pos + 1] != 0xda) {
+        unsigned long len = (jpeg.data[pos + 2] << 8) | jpeg.data[pos + 3];
+        if (jpeg.data[pos + 1] == 0xc4) {
+            memmove(jpeg.data + pos, jpeg.data + pos + 2 + len, jpeg.size - pos - 2 - len);
+            jpeg.size -= 2 + len;
+        } else {
+            pos += 2 + len;
+        }
+    }
+}
+
+/* Reference NV12: luma as decoded, chroma rows of 4:2:0, even chroma
+ * rows of 4:2:2 */
+static void referenceDecode(const Buffer& jpeg, unsigned char* nv12, int stride) {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    jpeg_source_mgr src;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    memset(&src, 0, sizeof(src));
+    src.init_source = memInitSource;
+    src.fill_input_buffer = memFillInputBuffer;
+    src.skip_input_data = memSkipInputData;
+    src.resync_to_restart = jpeg_resync_to_restart;
+    src.term_source = memTermSource;
+    src.next_input_byte = jpeg.data;
+    src.bytes_in_buffer = jpeg.size;
+    cinfo.src = &src;
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.raw_data_out = TRUE;
+    cinfo.out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(&cinfo);
+
+    int vsamp = cinfo.max_v_samp_factor;
+    int rowsPerCall = vsamp * DCTSIZE;
+    int width = cinfo.output_width;
+    int height = cinfo.output_height;
+    int lumaWidth = cinfo.comp_info[0].width_in_blocks * DCTSIZE;
+    int chromaWidth = cinfo.comp_info[1].width_in_blocks * DCTSIZE;
+    unsigned char* y = (unsigned char*)malloc(lumaWidth * rowsPerCall);
+    unsigned char* u = (unsigned char*)malloc(chromaWidth * DCTSIZE);
+    unsigned char* v = (unsigned char*)malloc(chromaWidth * DCTSIZE);
+    JSAMPROW yRows[2 * DCTSIZE], uRows[DCTSIZE], vRows[DCTSIZE];
+    JSAMPARRAY planes[3] = { yRows, uRows, vRows };
+
+    for (int i = 0; i < rowsPerCall; i++) yRows[i] = y + i * lumaWidth;
+    for (int i = 0; i < DCTSIZE; i++) {
+        uRows[i] = u + i * chromaWidth;
+        vRows[i] = v + i * chromaWidth;
+    }
+
+    for (int row = 0; row < height; row += rowsPerCall) {
+        jpeg_read_raw_data(&cinfo, planes, rowsPerCall);
+        for (int i = 0; i < rowsPerCall && row + i < height; i++) {
+            memcpy(nv12 + (row + i) * stride, yRows[i], width);
+        }
+        for (int i = 0; i < rowsPerCall / 2 && (row / 2 + i) < (height + 1) / 2; i++) {
+            int c = (vsamp == 2) ? i : 2 * i;
+            unsigned char* uv = nv12 + height * stride + (row / 2 + i) * stride;
+            for (int x = 0; x < (width + 1) / 2; x++) {
+                uv[2 * x] = uRows[c][x];
+                uv[2 * x + 1] = vRows[c][x];
+            }
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(y);
+    free(u);
+    free(v);
+}
+
+static bool compare(const unsigned char* a, const unsigned char* b, int width, int height) {
+    for (int row = 0; row < height + (height + 1) / 2; row++) {
+        if (memcmp(a + row * kStride, b + row * kStride, width)) {
+            printf("    first difference in row %d\n", row);
+            return false;
+        }
+    }
+    return true;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    static const int sizes[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 322, 238 } };
+    static const int restarts[] = { 0, 1, 2, -7 };
+    Decoder_libjpeg decoder;
+    int failures = 0;
+    int benchWidth = 0, benchHeight = 0;
+
+    if (argc == 3 && !strcmp(argv[1], "-b")) {
+        sscanf(argv[2], "%dx%d", &benchWidth, &benchHeight);
+    }
+
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        size_t frameSize = (size_t)kStride * (height + (height + 1) / 2);
+        unsigned char* rgb = (unsigned char*)malloc(width * height * 3);
+        unsigned char* expected = (unsigned char*)malloc(frameSize);
+        unsigned char* actual = (unsigned char*)malloc(frameSize);
+
+        fillImage(rgb, width, height);
+
+        for (int vsamp = 1; vsamp <= 2; vsamp++) {
+            for (unsigned r = 0; r < sizeof(restarts) / sizeof(restarts[0]); r++) {
+                for (int strip = 0; strip <= 1; strip++) {
+                    Buffer jpeg = encode(rgb, width, height, vsamp, restarts[r]);
+                    memset(expected, 0, frameSize);
+                    memset(actual, 0, frameSize);
+                    referenceDecode(jpeg, expected, kStride);
+                    if (strip) {
+                        stripDHT(jpeg);
+                    }
+
+                    bool ok = decoder.decode(jpeg.data, jpeg.size, actual, kStride) &&
+                              compare(expected, actual, width, height);
+                    printf("%s %dx%d 4:2:%d restart %d%s\n", ok ? "ok  " : "FAIL",
+                           width, height, vsamp == 2 ? 0 : 2, restarts[r],
+                           strip ? ", no DHT" : "");
+                    failures += !ok;
+
+                    // damaged frames: the result does not matter, surviving does
+                    decoder.decode(jpeg.data, jpeg.size / 2, actual, kStride);
+                    for (unsigned long i = jpeg.size / 3; i < jpeg.size; i += 97) {
+                        jpeg.data[i] ^= 0x5a;
+                    }
+                    decoder.decode(jpeg.data, jpeg.size, actual, kStride);
+                    decoder.decode(jpeg.data + 7, jpeg.size - 7, actual, kStride);
+
+                    free(jpeg.data);
+                }
+            }
+        }
+
+        free(rgb);
+        free(expected);
+        free(actual);
+    }
+
+    if (benchWidth > 0 && benchHeight > 0) {
+        unsigned char* rgb = (unsigned char*)malloc(benchWidth * benchHeight * 3);
+        unsigned char* nv12 = (unsigned char*)malloc((size_t)kStride * benchHeight * 2);
+        fillImage(rgb, benchWidth, benchHeight);
+
+        for (unsigned r = 0; r < sizeof(restarts) / sizeof(restarts[0]); r++) {
+            Buffer jpeg = encode(rgb, benchWidth, benchHeight, 1, restarts[r]);
+            stripDHT(jpeg);
+            int frames = 100;
+            double start = now();
+            for (int i = 0; i < frames; i++) {
+                decoder.decode(jpeg.data, jpeg.size, nv12, kStride);
+            }
+            double ms = (now() - start) * 1000 / frames;
+            printf("%dx%d 4:2:2 restart %d: %.2f ms/frame\n", benchWidth, benchHeight,
+                   restarts[r], ms);
+            free(jpeg.data);
+        }
+
+        free(rgb);
+        free(nv12);
+    }
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
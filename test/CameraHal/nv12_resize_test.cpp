@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Golden image test for the CameraHal NV12 resize engine.
+ *
+ * Every case resizes a synthetic NV12 pattern with the scalar kernel on a
+ * single thread and compares the CRC32 of the destination planes (padding
+ * and area outside of the destination rectangle included) against a table
+ * of known good values. All other kernels and thread counts built for the
+ * host must then produce bit exact copies of the scalar output.
+ *
+ * Usage: nv12_resize_test [-g] [-o <dir>] [-b <iterations>]
+ *   -g  print a new golden table instead of checking
+ *   -o  write every scalar output to <dir>/<case>.yuv for inspection
+ *   -b  time every case for each kernel and thread count
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NV12_resize.h"
+
+using namespace Ti::Camera;
+
+struct TestCase {
+    const char* name;
+    int srcWidth, srcHeight, srcStride;
+    Ti::Camera::NV12Rect srcCrop;   // width 0 selects the whole image
+    int dstWidth, dstHeight, dstStride;
+    Ti::Camera::NV12Rect dstRect;   // width 0 selects the whole image
+    NV12ResizeFilter filter;
+    uint32_t golden;
+};
+
+static TestCase sCases[] = {
+    { "thumb_bilinear",   640,  480,  640, {0, 0, 0, 0},          160, 120, 160, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BILINEAR, 0xc451f5a9u },
+    { "half_box",         640,  480,  768, {0, 0, 0, 0},          320, 240, 320, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BOX,      0xc8bff2bcu },
+    { "upscale_nearest",  640,  480,  640, {0, 0, 0, 0},         1280, 720, 1280, {0, 0, 0, 0},       NV12_RESIZE_FILTER_NEAREST,  0x8c478f73u },
+    { "upscale_bilinear", 320,  240,  384, {0, 0, 0, 0},         1280, 720, 1344, {0, 0, 0, 0},       NV12_RESIZE_FILTER_BILINEAR, 0x97b8705eu },
+    { "crop_into_rect",  1920, 1080, 2048, {256, 128, 1280, 720}, 640, 480, 704, {64, 48, 512, 384},  NV12_RESIZE_FILTER_BILINEAR, 0x1fd9ff4du },
+    { "odd_tail",         322,  242,  350, {0, 0, 0, 0},           98,  66, 100, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BILINEAR, 0x0e5cb1b6u },
+    { "odd_tail_box",     322,  242,  350, {2, 2, 318, 238},       98,  66, 100, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BOX,      0x8a2741abu },
+    { "odd_output",       322,  242,  350, {0, 0, 0, 0},           97,  65, 100, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BILINEAR, 0x4be6f8deu },
+    { "odd_output_box",   321,  241,  352, {2, 2, 317, 237},       99,  67, 100, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BOX,      0xa0a7a364u },
+    { "odd_rect_nearest", 320,  240,  320, {0, 0, 0, 0},          160, 120, 160, {2, 4, 151, 99},     NV12_RESIZE_FILTER_NEAREST,  0xc51f8e49u },
+    { "capture_thumb",   3264, 2448, 3264, {0, 0, 0, 0},          160, 120, 160, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BOX,      0x695713bcu },
+    { "capture_preview", 3264, 2448, 4096, {0, 0, 0, 0},          640, 480, 640, {0, 0, 0, 0},        NV12_RESIZE_FILTER_BILINEAR, 0xa5069340u },
+};
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    while ( len-- ) {
+        crc ^= *data++;
+        for ( int k = 0; k < 8; k++ ) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+struct Buffer {
+    NV12Image img;
+    uint8_t* mem;
+    size_t size;
+};
+
+static bool allocImage(Buffer& buf, int width, int height, int stride) {
+    buf.size = (size_t)stride * (height + (height + 1) / 2);
+    buf.mem = (uint8_t*)malloc(buf.size);
+    if ( !buf.mem ) {
+        return false;
+    }
+    buf.img.width = width;
+    buf.img.height = height;
+    buf.img.yStride = stride;
+    buf.img.uvStride = stride;
+    buf.img.y = buf.mem;
+    buf.img.uv = buf.mem + (size_t)stride * height;
+    return true;
+}
+
+// gradients, a checker board and some noise so every filter tap matters
+static void fillPattern(Buffer& buf) {
+    uint32_t seed = 0x1234567u;
+    const NV12Image& img = buf.img;
+
+    memset(buf.mem, 0x5A, buf.size);
+
+    for ( int y = 0; y < img.height; y++ ) {
+        uint8_t* row = img.y + y * img.yStride;
+        for ( int x = 0; x < img.width; x++ ) {
+            seed = seed * 1103515245u + 12345u;
+            int v = ((x * 255) / img.width + (y * 255) / img.height) / 2;
+            if ( ((x >> 4) ^ (y >> 4)) & 1 ) {
+                v += 48;
+            }
+            v += (int)((seed >> 16) & 15) - 8;
+            row[x] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+
+    for ( int y = 0; y < (img.height + 1) / 2; y++ ) {
+        uint8_t* row = img.uv + y * img.uvStride;
+        for ( int x = 0; x < (img.width + 1) / 2; x++ ) {
+            row[2 * x]     = (uint8_t)(16 + (x * 224) / (img.width / 2));
+            row[2 * x + 1] = (uint8_t)(240 - (y * 224) / (img.height / 2));
+        }
+    }
+}
+
+static Ti::status_t resizeCase(NV12Resizer& resizer, const TestCase& tc, Buffer& src, Buffer& dst) {
+    const NV12Rect* crop = tc.srcCrop.width ? &tc.srcCrop : NULL;
+    const NV12Rect* rect = tc.dstRect.width ? &tc.dstRect : NULL;
+
+    return resizer.resize(src.img, crop, dst.img, rect, tc.filter);
+}
+
+static uint32_t runCase(NV12Resizer& resizer, const TestCase& tc, Buffer& src, Buffer& dst) {
+    memset(dst.mem, 0x10, dst.size);
+    if ( Ti::NO_ERROR != resizeCase(resizer, tc, src, dst) ) {
+        return 0;
+    }
+    return crc32(0, dst.mem, dst.size);
+}
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static const struct {
+    NV12ResizeKernel kernel;
+    const char* name;
+} sKernels[] = {
+    { NV12_RESIZE_KERNEL_SCALAR, "scalar" },
+    { NV12_RESIZE_KERNEL_NEON,   "neon" },
+    { NV12_RESIZE_KERNEL_SSE2,   "sse2" },
+};
+
+static const int sThreads[] = { 0, 1, 3 };
+
+int main(int argc, char** argv) {
+    bool generate = false;
+    const char* outDir = NULL;
+    int benchIterations = 0;
+    int failures = 0;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "go:b:")) != -1 ) {
+        switch ( opt ) {
+            case 'g': generate = true; break;
+            case 'o': outDir = optarg; break;
+            case 'b': benchIterations = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-g] [-o dir] [-b iterations]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    NV12Resizer reference(0);
+    reference.setKernel(NV12_RESIZE_KERNEL_SCALAR);
+
+    for ( size_t c = 0; c < sizeof(sCases) / sizeof(sCases[0]); c++ ) {
+        const TestCase& tc = sCases[c];
+        Buffer src, dst;
+
+        if ( !allocImage(src, tc.srcWidth, tc.srcHeight, tc.srcStride) ||
+             !allocImage(dst, tc.dstWidth, tc.dstHeight, tc.dstStride) ) {
+            fprintf(stderr, "%s: out of memory\n", tc.name);
+            return 1;
+        }
+        fillPattern(src);
+
+        uint32_t crc = runCase(reference, tc, src, dst);
+
+        if ( outDir ) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%s.yuv", outDir, tc.name);
+            FILE* f = fopen(path, "wb");
+            if ( f ) {
+                fwrite(dst.mem, 1, dst.size, f);
+                fclose(f);
+            }
+        }
+
+        if ( generate ) {
+            printf("%-18s 0x%08xu\n", tc.name, crc);
+        } else if ( crc != tc.golden ) {
+            printf("FAIL %-18s golden 0x%08x got 0x%08x\n", tc.name, tc.golden, crc);
+            failures++;
+        }
+
+        for ( size_t k = 0; k < sizeof(sKernels) / sizeof(sKernels[0]); k++ ) {
+            if ( !NV12Resizer::isKernelAvailable(sKernels[k].kernel) ) {
+                continue;
+            }
+            for ( size_t t = 0; t < sizeof(sThreads) / sizeof(sThreads[0]); t++ ) {
+                NV12Resizer resizer(sThreads[t]);
+                resizer.setKernel(sKernels[k].kernel);
+
+                uint32_t got = runCase(resizer, tc, src, dst);
+                if ( got != crc ) {
+                    printf("FAIL %-18s %s/%d threads differs from scalar (0x%08x vs 0x%08x)\n",
+                           tc.name, sKernels[k].name, sThreads[t], got, crc);
+                    failures++;
+                }
+
+                if ( benchIterations > 0 ) {
+                    double start = nowMs();
+                    for ( int i = 0; i < benchIterations; i++ ) {
+                        resizeCase(resizer, tc, src, dst);
+                    }
+                    printf("BENCH %-18s %-6s %d threads %8.3f ms\n", tc.name, sKernels[k].name,
+                           sThreads[t], (nowMs() - start) / benchIterations);
+                }
+            }
+        }
+
+        free(src.mem);
+        free(dst.mem);
+    }
+
+    if ( !generate ) {
+        printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+    }
+
+    return failures ? 1 : 0;
+}
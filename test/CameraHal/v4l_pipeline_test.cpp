@@ -0,0 +1,518 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stress test for the V4L preview pipeline.
+ *
+ * By default frames come from a fake device: a fixed set of buffers which
+ * is refilled at the requested frame rate, either with a synthetic pattern
+ * or with frames read from a raw YUYV file. A frame arriving while every
+ * device buffer is held by the pipeline is lost, as it would be on a real
+ * sensor. Every delivered preview buffer is compared with its source
+ * frame and delivery order is checked.
+ *
+ * With -d the frames are captured from a real V4L2 device instead, e.g. the
+ * vivid virtual driver (modprobe vivid), in which case only the delivery
+ * order is checked.
+ *
+ * Usage: v4l_pipeline_test [-s WxH] [-n frames] [-r fps] [-b buffers]
+ *                          [-l subscriber delay ms] [-f file.yuyv] [-d /dev/videoN]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "V4LPreviewPipeline.h"
+
+using namespace Ti::Camera;
+
+struct Options {
+    int width;
+    int height;
+    int frames;
+    int fps;
+    int buffers;
+    int subscriberDelayMs;
+    const char* file;
+    const char* device;
+};
+
+static void sleepUs(long us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+}
+
+/*--------------------Frame sources-----------------------------*/
+
+class Device {
+public:
+    virtual ~Device() {}
+    virtual bool open(const Options& opt) = 0;
+    /* blocks until the next frame, returns its buffer index or -1 when done */
+    virtual int dequeue(const uint8_t*& data, nsecs_t& timestamp) = 0;
+    virtual void queue(int index) = 0;
+    virtual int stride() const = 0;
+    virtual int dropped() const = 0;
+    /* true if fill() reproduces the content of a frame */
+    virtual bool verifiable() const = 0;
+    virtual void fill(uint8_t* dst, long frame) const = 0;
+};
+
+/* Fake device fed from a pattern or a raw YUYV file */
+class FakeDevice : public Device {
+public:
+    FakeDevice() : mBuffers(NULL), mFile(NULL), mFileFrames(0), mFrame(0),
+                   mDropped(0), mFree(0) {
+        pthread_mutex_init(&mLock, NULL);
+    }
+
+    ~FakeDevice() {
+        free(mBuffers);
+        free(mFile);
+        pthread_mutex_destroy(&mLock);
+    }
+
+    virtual bool open(const Options& opt) {
+        mOpt = opt;
+        mFrameSize = (size_t)opt.width * 2 * opt.height;
+
+        if ( opt.file ) {
+            FILE* f = fopen(opt.file, "rb");
+            if ( !f ) {
+                fprintf(stderr, "%s: %s\n", opt.file, strerror(errno));
+                return false;
+            }
+            fseek(f, 0, SEEK_END);
+            long size = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            mFileFrames = size / mFrameSize;
+            mFile = (uint8_t*)malloc(mFileFrames * mFrameSize);
+            if ( !mFileFrames || !mFile ||
+                 fread(mFile, mFrameSize, mFileFrames, f) != (size_t)mFileFrames ) {
+                fprintf(stderr, "%s: no complete %dx%d YUYV frame\n", opt.file,
+                        opt.width, opt.height);
+                fclose(f);
+                return false;
+            }
+            fclose(f);
+        }
+
+        mBuffers = (uint8_t*)malloc(mFrameSize * opt.buffers);
+        if ( !mBuffers ) {
+            return false;
+        }
+        mFree = (1u << opt.buffers) - 1;
+        mNextFrameTime = systemTime();
+        return true;
+    }
+
+    virtual int dequeue(const uint8_t*& data, nsecs_t& timestamp) {
+        for ( ;; ) {
+            if ( mFrame >= mOpt.frames ) {
+                return -1;
+            }
+
+            // pace like a sensor running at the requested rate
+            nsecs_t now = systemTime();
+            if ( now < mNextFrameTime ) {
+                sleepUs(ns2us(mNextFrameTime - now));
+            }
+            mNextFrameTime += s2ns(1) / mOpt.fps;
+
+            long frame = mFrame++;
+
+            pthread_mutex_lock(&mLock);
+            int index = mFree ? __builtin_ctz(mFree) : -1;
+            if ( 0 <= index ) {
+                mFree &= ~(1u << index);
+            }
+            pthread_mutex_unlock(&mLock);
+
+            if ( 0 > index ) {
+                mDropped++;
+                continue;
+            }
+
+            uint8_t* buffer = mBuffers + index * mFrameSize;
+            fill(buffer, frame);
+            data = buffer;
+            timestamp = frame;
+            return index;
+        }
+    }
+
+    virtual void queue(int index) {
+        pthread_mutex_lock(&mLock);
+        mFree |= 1u << index;
+        pthread_mutex_unlock(&mLock);
+    }
+
+    virtual int stride() const { return mOpt.width * 2; }
+    virtual int dropped() const { return mDropped; }
+    virtual bool verifiable() const { return true; }
+
+    virtual void fill(uint8_t* dst, long frame) const {
+        if ( mFile ) {
+            memcpy(dst, mFile + (frame % mFileFrames) * mFrameSize, mFrameSize);
+            return;
+        }
+        // moving gradient, different in every frame
+        for ( int y = 0; y < mOpt.height; y++ ) {
+            uint8_t* row = dst + (size_t)y * mOpt.width * 2;
+            for ( int x = 0; x < mOpt.width * 2; x++ ) {
+                row[x] = (uint8_t)(x + 3 * y + 7 * frame);
+            }
+        }
+    }
+
+private:
+    Options mOpt;
+    size_t mFrameSize;
+    uint8_t* mBuffers;
+    uint8_t* mFile;
+    long mFileFrames;
+    long mFrame;
+    int mDropped;
+    pthread_mutex_t mLock;
+    unsigned int mFree;
+    nsecs_t mNextFrameTime;
+};
+
+/* Real V4L2 capture device, e.g. vivid */
+class V4L2Device : public Device {
+public:
+    V4L2Device() : mFd(-1), mCount(0), mFrames(0), mMaxFrames(0), mStride(0) {
+        memset(mMem, 0, sizeof(mMem));
+    }
+
+    ~V4L2Device() {
+        if ( 0 <= mFd ) {
+            int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            ioctl(mFd, VIDIOC_STREAMOFF, &type);
+            for ( int i = 0; i < mCount; i++ ) {
+                munmap(mMem[i], mLength[i]);
+            }
+            close(mFd);
+        }
+    }
+
+    virtual bool open(const Options& opt) {
+        struct v4l2_format fmt;
+        struct v4l2_requestbuffers rb;
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+        mMaxFrames = opt.frames;
+
+        mFd = ::open(opt.device, O_RDWR);
+        if ( 0 > mFd ) {
+            fprintf(stderr, "%s: %s\n", opt.device, strerror(errno));
+            return false;
+        }
+
+        memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = opt.width;
+        fmt.fmt.pix.height = opt.height;
+        fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        if ( 0 > ioctl(mFd, VIDIOC_S_FMT, &fmt) ||
+             fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV ||
+             (int)fmt.fmt.pix.width != opt.width || (int)fmt.fmt.pix.height != opt.height ) {
+            fprintf(stderr, "%s: %dx%d YUYV not supported\n", opt.device, opt.width, opt.height);
+            return false;
+        }
+        mStride = fmt.fmt.pix.bytesperline;
+
+        memset(&rb, 0, sizeof(rb));
+        rb.count = opt.buffers;
+        rb.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        rb.memory = V4L2_MEMORY_MMAP;
+        if ( 0 > ioctl(mFd, VIDIOC_REQBUFS, &rb) ) {
+            fprintf(stderr, "VIDIOC_REQBUFS: %s\n", strerror(errno));
+            return false;
+        }
+
+        for ( mCount = 0; mCount < (int)rb.count && mCount < V4LPreviewPipeline::MAX_BUFFERS; ) {
+            struct v4l2_buffer buf;
+            memset(&buf, 0, sizeof(buf));
+            buf.index = mCount;
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            if ( 0 > ioctl(mFd, VIDIOC_QUERYBUF, &buf) ) {
+                return false;
+            }
+            mLength[mCount] = buf.length;
+            mMem[mCount] = (uint8_t*)mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED, mFd, buf.m.offset);
+            if ( MAP_FAILED == mMem[mCount] ) {
+                return false;
+            }
+            mCount++;
+            queue(buf.index);
+        }
+
+        return 0 <= ioctl(mFd, VIDIOC_STREAMON, &type);
+    }
+
+    virtual int dequeue(const uint8_t*& data, nsecs_t& timestamp) {
+        struct v4l2_buffer buf;
+
+        if ( mFrames++ >= mMaxFrames ) {
+            return -1;
+        }
+
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if ( 0 > ioctl(mFd, VIDIOC_DQBUF, &buf) ) {
+            fprintf(stderr, "VIDIOC_DQBUF: %s\n", strerror(errno));
+            return -1;
+        }
+
+        data = mMem[buf.index];
+        timestamp = mFrames;
+        return buf.index;
+    }
+
+    virtual void queue(int index) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.index = index;
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if ( 0 > ioctl(mFd, VIDIOC_QBUF, &buf) ) {
+            fprintf(stderr, "VIDIOC_QBUF: %s\n", strerror(errno));
+        }
+    }
+
+    virtual int stride() const { return mStride; }
+    virtual int dropped() const { return 0; }
+    virtual bool verifiable() const { return false; }
+    virtual void fill(uint8_t*, long) const {}
+
+private:
+    int mFd;
+    int mCount;
+    int mFrames;
+    int mMaxFrames;
+    int mStride;
+    uint8_t* mMem[V4LPreviewPipeline::MAX_BUFFERS];
+    size_t mLength[V4LPreviewPipeline::MAX_BUFFERS];
+};
+
+/*--------------------Pipeline client---------------------------*/
+
+class TestClient : public V4LPreviewPipeline::Client {
+public:
+    TestClient(const Options& opt, Device& device) :
+        mOpt(opt), mDevice(device), mPipeline(NULL), mLast(-1),
+        mDelivered(0), mMismatches(0), mOutOfOrder(0) {
+        mYuyv = (uint8_t*)malloc((size_t)opt.width * 2 * opt.height);
+    }
+
+    ~TestClient() {
+        free(mYuyv);
+    }
+
+    void setPipeline(V4LPreviewPipeline* pipeline, const V4LPreviewPipeline::Output* outputs) {
+        mPipeline = pipeline;
+        mOutputs = outputs;
+    }
+
+    virtual void releaseInput(int index) {
+        mDevice.queue(index);
+    }
+
+    virtual void deliverOutput(int index, nsecs_t timestamp) {
+        if ( timestamp <= mLast ) {
+            mOutOfOrder++;
+        }
+        mLast = timestamp;
+        mDelivered++;
+
+        if ( mDevice.verifiable() && !verify(mOutputs[index], timestamp) ) {
+            mMismatches++;
+        }
+
+        if ( mOpt.subscriberDelayMs ) {
+            sleepUs(mOpt.subscriberDelayMs * 1000);
+        }
+
+        mPipeline->releaseOutput(index);
+    }
+
+    int delivered() const { return mDelivered; }
+    int mismatches() const { return mMismatches; }
+    int outOfOrder() const { return mOutOfOrder; }
+
+private:
+    /* Plain reference: luma from every row, chroma from the even rows */
+    bool verify(const V4LPreviewPipeline::Output& out, long frame) {
+        int w = mOpt.width;
+        int h = mOpt.height;
+
+        mDevice.fill(mYuyv, frame);
+
+        for ( int y = 0; y < h; y++ ) {
+            const uint8_t* src = mYuyv + (size_t)y * w * 2;
+            const uint8_t* luma = out.y + y * out.stride;
+            const uint8_t* chroma = out.uv + (y / 2) * out.stride;
+            for ( int x = 0; x < w; x++ ) {
+                if ( luma[x] != src[2 * x] ||
+                     ( !(y & 1) && chroma[x] != src[2 * x + 1] ) ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    Options mOpt;
+    Device& mDevice;
+    V4LPreviewPipeline* mPipeline;
+    const V4LPreviewPipeline::Output* mOutputs;
+    nsecs_t mLast;
+    int mDelivered;
+    int mMismatches;
+    int mOutOfOrder;
+    uint8_t* mYuyv;
+};
+
+static void printStage(const char* name, const V4LPreviewPipeline::StageStats& stage) {
+    if ( stage.count ) {
+        printf("  %-8s avg %7lld us  max %7lld us\n", name,
+               (long long)ns2us(stage.total / stage.count), (long long)ns2us(stage.max));
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opt = { 640, 480, 300, 30, 6, 0, NULL, NULL };
+    int c;
+
+    while ( (c = getopt(argc, argv, "s:n:r:b:l:f:d:")) != -1 ) {
+        switch ( c ) {
+            case 's': sscanf(optarg, "%dx%d", &opt.width, &opt.height); break;
+            case 'n': opt.frames = atoi(optarg); break;
+            case 'r': opt.fps = atoi(optarg); break;
+            case 'b': opt.buffers = atoi(optarg); break;
+            case 'l': opt.subscriberDelayMs = atoi(optarg); break;
+            case 'f': opt.file = optarg; break;
+            case 'd': opt.device = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s WxH] [-n frames] [-r fps] [-b buffers] "
+                        "[-l delay ms] [-f file.yuyv] [-d /dev/videoN]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if ( opt.buffers < 2 || opt.buffers > V4LPreviewPipeline::MAX_BUFFERS ||
+         opt.fps <= 0 || (opt.width & 1) ) {
+        fprintf(stderr, "invalid options\n");
+        return 2;
+    }
+
+    FakeDevice fake;
+    V4L2Device v4l2;
+    Device& device = opt.device ? static_cast<Device&>(v4l2) : static_cast<Device&>(fake);
+    if ( !device.open(opt) ) {
+        return 1;
+    }
+
+    // preview buffers with a padded stride, like Tiler buffers
+    int outputStride = (opt.width + 63) & ~63;
+    size_t outputSize = (size_t)outputStride * opt.height * 3 / 2;
+    V4LPreviewPipeline::Output outputs[V4LPreviewPipeline::MAX_BUFFERS];
+    for ( int i = 0; i < opt.buffers; i++ ) {
+        uint8_t* mem = (uint8_t*)malloc(outputSize);
+        if ( !mem ) {
+            return 1;
+        }
+        outputs[i].y = mem;
+        outputs[i].uv = mem + (size_t)outputStride * opt.height;
+        outputs[i].stride = outputStride;
+    }
+
+    TestClient client(opt, device);
+    V4LPreviewPipeline pipeline(&client);
+    client.setPipeline(&pipeline, outputs);
+
+    if ( Ti::NO_ERROR != pipeline.start(opt.width, opt.height, device.stride(),
+                                        outputs, opt.buffers, opt.buffers) ) {
+        fprintf(stderr, "pipeline start failed\n");
+        return 1;
+    }
+
+    nsecs_t start = systemTime();
+    const uint8_t* data;
+    nsecs_t timestamp;
+    int index;
+
+    // capture stage
+    while ( (index = device.dequeue(data, timestamp)) >= 0 ) {
+        if ( Ti::NO_ERROR != pipeline.queueInput(index, data, timestamp) ) {
+            device.queue(index);
+        }
+    }
+
+    // let the last frames drain
+    sleepUs(200 * 1000);
+    pipeline.stop();
+    double seconds = (systemTime() - start) / 1e9;
+
+    V4LPreviewPipeline::Stats stats;
+    pipeline.getStats(stats);
+
+    printf("%dx%d, %d buffers, %d ms subscriber delay, %.1f s\n", opt.width, opt.height,
+           opt.buffers, opt.subscriberDelayMs, seconds);
+    printf("  captured %u, delivered %d (%.1f fps), dropped: device %d, queue %u, buffers %u\n",
+           stats.captured, client.delivered(), client.delivered() / seconds,
+           device.dropped(), stats.droppedInput, stats.droppedOutput);
+    printStage("queued", stats.queued);
+    printStage("convert", stats.convert);
+    printStage("handoff", stats.handoff);
+    printStage("deliver", stats.deliver);
+    printStage("total", stats.total);
+
+    for ( int i = 0; i < opt.buffers; i++ ) {
+        free(outputs[i].y);
+    }
+
+    int failures = client.mismatches() + client.outOfOrder();
+    if ( (int)stats.delivered != client.delivered() ||
+         stats.captured < stats.delivered + stats.droppedInput + stats.droppedOutput ) {
+        printf("FAIL frame accounting\n");
+        failures++;
+    }
+    if ( client.mismatches() ) {
+        printf("FAIL %d frames differ from their source\n", client.mismatches());
+    }
+    if ( client.outOfOrder() ) {
+        printf("FAIL %d frames delivered out of order\n", client.outOfOrder());
+    }
+    printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,42 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Unit test and throughput benchmark for the open CPU BLTsville backend,
+# built for the target to measure the NEON kernels and for the host for SSE2
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= cpubv_test.cpp
+LOCAL_SHARED_LIBRARIES:= libbltsville_cpubv
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= cpubv_test
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= cpubv_test.cpp
+LOCAL_STATIC_LIBRARIES:= libbltsville_cpubv_host
+LOCAL_LDLIBS += -lm -lpthread
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= cpubv_test_host
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Records the command stream gcbv builds for a set of BLTs on top of the stub
+# driver and checks it, with -b it measures the cost of building the commands
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= gcbv_trace_test.cpp
+LOCAL_STATIC_LIBRARIES:= libbltsville_gc2d_host
+LOCAL_LDLIBS += -lpthread
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= gcbv_trace_test_host
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,1167 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit test and throughput benchmark for the open CPU BLTsville backend.
+ *
+ * Every blt is checked against a floating point reference that works in
+ * virtual coordinates: it decodes the source pixels, resamples them with a
+ * windowed sinc, applies the ROP or blend and compares with what the
+ * library wrote, allowing for the fixed point arithmetic of the library
+ * and the precision of the destination format. Pixels outside the clipped
+ * destination rectangle and the stride padding must not change.
+ *
+ * The same blt is then repeated with every kernel the cpu supports and
+ * with one and several threads; all of them have to produce the same
+ * bytes.
+ *
+ * Usage: cpubv_test [-b <iterations>]
+ *   -b  also report the throughput of every operation and format pair
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpubv.h"
+
+enum Layout {
+    LAYOUT_RGB,
+    LAYOUT_PACKED,      // 4:2:2 in 32 bit macro pixels
+    LAYOUT_NV,          // 4:2:0, interleaved chroma plane
+    LAYOUT_PLANAR,      // 4:2:0, separate chroma planes
+};
+
+struct Format {
+    enum ocdformat ocd;
+    const char* name;
+    Layout layout;
+    int bytespp;
+    int shift[4];       // R, G, B, A
+    int size[4];
+    bool premultiplied;
+    bool yfirst;
+    bool vfirst;
+    bool bt709;
+};
+
+enum {
+    FMT_RGBA, FMT_RGBX, FMT_BGRA, FMT_NRGBA, FMT_RGB565,
+    FMT_UYVY, FMT_YUYV, FMT_YVYU, FMT_NV12, FMT_NV21, FMT_I420, FMT_YV12,
+    FMT_NV12_709, FMT_NONE = -1
+};
+
+static const Format sFormats[] = {
+    { OCDFMT_RGBA24,   "rgba",     LAYOUT_RGB,    4, { 0, 8, 16, 24 }, { 8, 8, 8, 8 }, true,  false, false, false },
+    { OCDFMT_RGBx24,   "rgbx",     LAYOUT_RGB,    4, { 0, 8, 16, 24 }, { 8, 8, 8, 0 }, true,  false, false, false },
+    { OCDFMT_BGRA24,   "bgra",     LAYOUT_RGB,    4, { 16, 8, 0, 24 }, { 8, 8, 8, 8 }, true,  false, false, false },
+    { OCDFMT_nRGBA24,  "nrgba",    LAYOUT_RGB,    4, { 0, 8, 16, 24 }, { 8, 8, 8, 8 }, false, false, false, false },
+    { OCDFMT_RGB16,    "rgb565",   LAYOUT_RGB,    2, { 11, 5, 0, 0 },  { 5, 6, 5, 0 }, true,  false, false, false },
+    { OCDFMT_UYVY,     "uyvy",     LAYOUT_PACKED, 2, { 0 }, { 0 }, true, false, false, false },
+    { OCDFMT_YUYV,     "yuyv",     LAYOUT_PACKED, 2, { 0 }, { 0 }, true, true,  false, false },
+    { OCDFMT_YVYU,     "yvyu",     LAYOUT_PACKED, 2, { 0 }, { 0 }, true, true,  true,  false },
+    { OCDFMT_NV12,     "nv12",     LAYOUT_NV,     1, { 0 }, { 0 }, true, false, false, false },
+    { OCDFMT_NV21,     "nv21",     LAYOUT_NV,     1, { 0 }, { 0 }, true, false, true,  false },
+    { OCDFMT_I420,     "i420",     LAYOUT_PLANAR, 1, { 0 }, { 0 }, true, false, false, false },
+    { OCDFMT_YV12,     "yv12",     LAYOUT_PLANAR, 1, { 0 }, { 0 }, true, false, true,  false },
+    { OCDFMT_NV12_709, "nv12_709", LAYOUT_NV,     1, { 0 }, { 0 }, true, false, false, true },
+};
+
+static const enum cpukernel sKernels[] = {
+    CPUKERNEL_SCALAR, CPUKERNEL_NEON, CPUKERNEL_SSE2,
+};
+
+static uint32_t sSeed = 0x2545F491u;
+
+static uint8_t nextByte() {
+    sSeed = sSeed * 1103515245u + 12345u;
+    return (uint8_t)(sSeed >> 16);
+}
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*--------------------------Surfaces----------------------------*/
+
+/* Width and height are virtual, the buffer is laid out physically with
+ * 16 bytes of padding at the end of every row. Chroma planes follow the
+ * luma plane as the library expects. */
+struct Surface {
+    const Format* fmt;
+    int width, height, angle;
+    int physWidth, physHeight;
+    long stride;
+    uint8_t* mem;
+    size_t size;
+    struct bvbuffdesc desc;
+    struct bvsurfgeom geom;
+};
+
+static void allocSurface(Surface& s, int format, int width, int height, int angle) {
+    memset(&s, 0, sizeof(s));
+    s.fmt = &sFormats[format];
+    s.width = width;
+    s.height = height;
+    s.angle = angle;
+    s.physWidth = ( angle % 180 ) ? height : width;
+    s.physHeight = ( angle % 180 ) ? width : height;
+
+    int bytespp = s.fmt->bytespp;
+    s.stride = s.physWidth * bytespp + 16;
+    s.size = s.stride * s.physHeight;
+    if ( s.fmt->layout == LAYOUT_NV ) {
+        s.size += s.stride * (s.physHeight / 2);
+    } else if ( s.fmt->layout == LAYOUT_PLANAR ) {
+        s.size += 2 * (s.stride / 2) * (s.physHeight / 2);
+    }
+
+    s.mem = (uint8_t*)malloc(s.size);
+    if ( !s.mem ) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    s.desc.structsize = sizeof(s.desc);
+    s.desc.virtaddr = s.mem;
+    s.desc.length = s.size;
+
+    s.geom.structsize = sizeof(s.geom);
+    s.geom.format = s.fmt->ocd;
+    s.geom.width = width;
+    s.geom.height = height;
+    s.geom.orientation = angle;
+    s.geom.virtstride = s.stride;
+}
+
+static void freeSurface(Surface& s) {
+    free(s.mem);
+    s.mem = NULL;
+}
+
+static uint8_t* lumaAt(const Surface& s, int x, int y) {
+    uint8_t* row = s.mem + y * s.stride;
+    if ( s.fmt->layout == LAYOUT_PACKED ) {
+        return row + (x / 2) * 4 + ( s.fmt->yfirst ? 0 : 1 ) + (x & 1) * 2;
+    }
+    return row + x;
+}
+
+static uint8_t* chromaAt(const Surface& s, int x, int y, bool v) {
+    bool second = v != s.fmt->vfirst;
+    if ( s.fmt->layout == LAYOUT_PACKED ) {
+        return s.mem + y * s.stride + (x / 2) * 4 + ( s.fmt->yfirst ? 1 : 0 ) + ( second ? 2 : 0 );
+    }
+
+    int rows = s.physHeight / 2;
+    int cy = ( y / 2 < rows ) ? y / 2 : rows - 1;
+    uint8_t* plane = s.mem + s.stride * s.physHeight;
+    if ( s.fmt->layout == LAYOUT_NV ) {
+        return plane + cy * s.stride + (x / 2) * 2 + ( second ? 1 : 0 );
+    }
+
+    long cstride = s.stride / 2;
+    if ( second ) {
+        plane += cstride * rows;
+    }
+    return plane + cy * cstride + x / 2;
+}
+
+static uint32_t readRaw(const Surface& s, int x, int y) {
+    const uint8_t* p = s.mem + y * s.stride + x * s.fmt->bytespp;
+    return s.fmt->bytespp == 2 ? (uint32_t)(p[0] | (p[1] << 8))
+                               : (uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static void writeRaw(const Surface& s, int x, int y, uint32_t raw) {
+    uint8_t* p = s.mem + y * s.stride + x * s.fmt->bytespp;
+    for ( int i = 0; i < s.fmt->bytespp; i++ ) {
+        p[i] = (uint8_t)(raw >> (8 * i));
+    }
+}
+
+/* Writes 8 bit components, premultiplying them for premultiplied formats */
+static void writeRgb(const Surface& s, int x, int y, const int c[4]) {
+    const Format* f = s.fmt;
+    uint32_t raw = readRaw(s, x, y);
+    int a = f->size[3] ? c[3] : 255;
+    for ( int i = 0; i < 4; i++ ) {
+        if ( !f->size[i] ) {
+            continue;
+        }
+        int v = ( i < 3 && f->premultiplied ) ? (c[i] * a + 127) / 255 : c[i];
+        uint32_t mask = (1u << f->size[i]) - 1;
+        raw &= ~(mask << f->shift[i]);
+        raw |= ((uint32_t)v >> (8 - f->size[i])) << f->shift[i];
+    }
+    writeRaw(s, x, y, raw);
+}
+
+static void virtToPhys(const Surface& s, int vx, int vy, int& px, int& py) {
+    switch ( s.angle ) {
+        case 90:  px = vy;                 py = s.width - 1 - vx;  break;
+        case 180: px = s.width - 1 - vx;   py = s.height - 1 - vy; break;
+        case 270: px = s.height - 1 - vy;  py = vx;                break;
+        default:  px = vx;                 py = vy;                break;
+    }
+}
+
+static void physToVirt(const Surface& s, int px, int py, int& vx, int& vy) {
+    switch ( s.angle ) {
+        case 90:  vx = s.width - 1 - py;   vy = px;                break;
+        case 180: vx = s.width - 1 - px;   vy = s.height - 1 - py; break;
+        case 270: vx = py;                 vy = s.height - 1 - px; break;
+        default:  vx = px;                 vy = py;                break;
+    }
+}
+
+/* Random bytes, with colors kept within alpha where that matters */
+static void fillRandom(Surface& s) {
+    for ( size_t i = 0; i < s.size; i++ ) {
+        s.mem[i] = nextByte();
+    }
+    const Format* f = s.fmt;
+    if ( f->layout != LAYOUT_RGB || !f->premultiplied || !f->size[3] ) {
+        return;
+    }
+    for ( int y = 0; y < s.physHeight; y++ ) {
+        for ( int x = 0; x < s.physWidth; x++ ) {
+            uint32_t raw = readRaw(s, x, y);
+            uint32_t a = (raw >> f->shift[3]) & 0xFF;
+            for ( int i = 0; i < 3; i++ ) {
+                uint32_t c = (raw >> f->shift[i]) & 0xFF;
+                if ( c > a ) {
+                    raw = (raw & ~(0xFFu << f->shift[i])) | (a << f->shift[i]);
+                }
+            }
+            writeRaw(s, x, y, raw);
+        }
+    }
+}
+
+static int smoothValue(int x, int y, int channel) {
+    return (int)(127.5 + 110.0 * sin(x * (0.029 + 0.006 * channel) +
+                                      y * (0.021 + 0.005 * channel) + channel));
+}
+
+/* Slowly varying content for the resampling tests */
+static void fillSmooth(Surface& s) {
+    for ( size_t i = 0; i < s.size; i++ ) {
+        s.mem[i] = nextByte();
+    }
+    for ( int y = 0; y < s.physHeight; y++ ) {
+        for ( int x = 0; x < s.physWidth; x++ ) {
+            if ( s.fmt->layout == LAYOUT_RGB ) {
+                int c[4] = { smoothValue(x, y, 0), smoothValue(x, y, 1), smoothValue(x, y, 2),
+                             64 + smoothValue(x, y, 3) * 3 / 4 };
+                writeRgb(s, x, y, c);
+            } else {
+                *lumaAt(s, x, y) = (uint8_t)smoothValue(x, y, 0);
+                *chromaAt(s, x, y, false) = (uint8_t)smoothValue(x & ~1, y & ~1, 1);
+                *chromaAt(s, x, y, true) = (uint8_t)smoothValue(x & ~1, y & ~1, 2);
+            }
+        }
+    }
+}
+
+/*--------------------------Reference---------------------------*/
+
+static double clamp255(double v) {
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* Premultiplied components between 0 and 255 */
+static void decodePhys(const Surface& s, int x, int y, double out[4]) {
+    const Format* f = s.fmt;
+    if ( f->layout == LAYOUT_RGB ) {
+        uint32_t raw = readRaw(s, x, y);
+        for ( int i = 0; i < 4; i++ ) {
+            uint32_t mask = (1u << f->size[i]) - 1;
+            out[i] = f->size[i] ? ((raw >> f->shift[i]) & mask) * 255.0 / mask : 255.0;
+        }
+        if ( !f->premultiplied ) {
+            for ( int i = 0; i < 3; i++ ) {
+                out[i] = out[i] * out[3] / 255.0;
+            }
+        }
+        return;
+    }
+
+    double luma = 1.164 * (*lumaAt(s, x, y) - 16);
+    double u = *chromaAt(s, x, y, false) - 128;
+    double v = *chromaAt(s, x, y, true) - 128;
+    if ( f->bt709 ) {
+        out[0] = clamp255(luma + 1.793 * v);
+        out[1] = clamp255(luma - 0.213 * u - 0.533 * v);
+        out[2] = clamp255(luma + 2.112 * u);
+    } else {
+        out[0] = clamp255(luma + 1.596 * v);
+        out[1] = clamp255(luma - 0.392 * u - 0.813 * v);
+        out[2] = clamp255(luma + 2.017 * u);
+    }
+    out[3] = 255.0;
+}
+
+static void decodeVirt(const Surface& s, int vx, int vy, double out[4]) {
+    int px, py;
+    virtToPhys(s, vx, vy, px, py);
+    decodePhys(s, px, py, out);
+}
+
+static double windowedSinc(double x, int half) {
+    if ( x == 0.0 ) {
+        return 1.0;
+    }
+    if ( fabs(x) >= half ) {
+        return 0.0;
+    }
+    double px = M_PI * x;
+    return sin(px) / px * sin(px / half) / (px / half);
+}
+
+struct Taps {
+    int count;
+    int index[16];
+    double weight[16];
+};
+
+/* Source pixels contributing to destination index u along one axis */
+static void axisTaps(int u, int dspan, int lo, int span, int kernel, Taps& t) {
+    if ( span == dspan ) {
+        t.count = 1;
+        t.index[0] = lo + u;
+        t.weight[0] = 1.0;
+        return;
+    }
+    if ( kernel <= 1 ) {
+        t.count = 1;
+        t.index[0] = lo + (int)(((2LL * u + 1) * span) / (2LL * dspan));
+        t.weight[0] = 1.0;
+        return;
+    }
+
+    int half = kernel / 2;
+    double center = (u + 0.5) * span / dspan - 0.5;
+    double scale = dspan < span ? (double)dspan / span : 1.0;
+    int first = (int)floor(center) - half - 1;
+    double sum = 0;
+    t.count = 0;
+    for ( int i = first; i <= first + kernel + 2; i++ ) {
+        double w = windowedSinc((i - center) * scale, half);
+        if ( w == 0.0 ) {
+            continue;
+        }
+        t.index[t.count] = lo + ( i < 0 ? 0 : i >= span ? span - 1 : i );
+        t.weight[t.count] = w;
+        sum += w;
+        t.count++;
+    }
+    for ( int i = 0; i < t.count; i++ ) {
+        t.weight[i] /= sum;
+    }
+}
+
+enum Alias {
+    ALIAS_NONE,
+    ALIAS_SRC1,         // source 1 reads the destination surface
+    ALIAS_SRC2,         // source 2 is the destination rectangle
+    ALIAS_BOTH,
+};
+
+struct Case {
+    const char* name;
+    unsigned long flags;        // operation, flips and clip
+    unsigned int op;            // ROP code or blend
+    unsigned char alpha;        // global alpha of blends
+    int dstFmt, dstAngle;
+    struct bvrect dstRect;
+    int src1Fmt, src1Angle;
+    struct bvrect src1Rect;
+    int src2Fmt, src2Angle;
+    struct bvrect src2Rect;
+    enum bvscalemode scalemode;
+    int hKernel, vKernel;       // kernel sizes the scale mode selects
+    struct bvrect clip;
+    Alias alias;
+    bool smooth;
+    double tolerance;           // in 8 bit units
+};
+
+struct Blt {
+    const Case* c;
+    Surface dst, src[2];
+    const Surface* srcSurface[2];
+    struct bvrect srcRect[2];
+    bool srcUsed[2];
+    uint8_t* initial;
+    double* expected;           // premultiplied RGBA per virtual pixel
+    bool* inside;
+    struct bvbltparams params;
+};
+
+static void sampleSource(const Blt& b, int index, int u, int v, double out[4]) {
+    const Case& c = *b.c;
+    const Surface& s = *b.srcSurface[index];
+    const struct bvrect& r = b.srcRect[index];
+    unsigned long hflip = index ? BVFLAG_HORZ_FLIP_SRC2 : BVFLAG_HORZ_FLIP_SRC1;
+    unsigned long vflip = index ? BVFLAG_VERT_FLIP_SRC2 : BVFLAG_VERT_FLIP_SRC1;
+    int dw = c.dstRect.width;
+    int dh = c.dstRect.height;
+
+    if ( r.width == 1 && r.height == 1 ) {
+        decodeVirt(s, r.left, r.top, out);
+        return;
+    }
+    if ( c.flags & hflip ) {
+        u = dw - 1 - u;
+    }
+    if ( c.flags & vflip ) {
+        v = dh - 1 - v;
+    }
+
+    Taps tx, ty;
+    axisTaps(u, dw, r.left, r.width, c.hKernel, tx);
+    axisTaps(v, dh, r.top, r.height, c.vKernel, ty);
+
+    out[0] = out[1] = out[2] = out[3] = 0;
+    for ( int j = 0; j < ty.count; j++ ) {
+        for ( int i = 0; i < tx.count; i++ ) {
+            double p[4];
+            decodeVirt(s, tx.index[i], ty.index[j], p);
+            for ( int k = 0; k < 4; k++ ) {
+                out[k] += tx.weight[i] * ty.weight[j] * p[k];
+            }
+        }
+    }
+    for ( int k = 0; k < 4; k++ ) {
+        out[k] = clamp255(out[k]);
+    }
+}
+
+static void referenceRop(unsigned int rop, const double s[4], const double p[4],
+                         const double d[4], double out[4]) {
+    for ( int k = 0; k < 4; k++ ) {
+        int si = (int)lround(s[k]), pi = (int)lround(p[k]), di = (int)lround(d[k]);
+        int r = 0;
+        for ( int bit = 0; bit < 8; bit++ ) {
+            int index = (((pi >> bit) & 1) << 2) | (((si >> bit) & 1) << 1) | ((di >> bit) & 1);
+            r |= ((rop >> index) & 1) << bit;
+        }
+        out[k] = r;
+    }
+}
+
+static void referenceBlend(unsigned int blend, const double c1[4], const double c2[4],
+                           double out[4]) {
+    double a1 = c1[3] / 255.0, a2 = c2[3] / 255.0;
+    for ( int k = 0; k < 4; k++ ) {
+        double v;
+        switch ( blend & ~BVBLENDDEF_GLOBAL_MASK ) {
+            case BVBLEND_CLEAR:     v = 0; break;
+            case BVBLEND_SRC1:      v = c1[k]; break;
+            case BVBLEND_SRC2:      v = c2[k]; break;
+            case BVBLEND_SRC1OVER:  v = c1[k] + c2[k] * (1 - a1); break;
+            case BVBLEND_SRC2OVER:  v = c2[k] + c1[k] * (1 - a2); break;
+            case BVBLEND_SRC1IN:    v = c1[k] * a2; break;
+            case BVBLEND_SRC2IN:    v = c2[k] * a1; break;
+            case BVBLEND_SRC1OUT:   v = c1[k] * (1 - a2); break;
+            case BVBLEND_SRC2OUT:   v = c2[k] * (1 - a1); break;
+            case BVBLEND_SRC1ATOP:  v = c1[k] * a2 + c2[k] * (1 - a1); break;
+            case BVBLEND_SRC2ATOP:  v = c2[k] * a1 + c1[k] * (1 - a2); break;
+            case BVBLEND_XOR:       v = c1[k] * (1 - a2) + c2[k] * (1 - a1); break;
+            case BVBLEND_PLUS:      v = c1[k] + c2[k]; break;
+            default:                v = 0; break;
+        }
+        out[k] = clamp255(v);
+    }
+}
+
+static void computeReference(Blt& b) {
+    const Case& c = *b.c;
+    const Surface& dst = b.dst;
+    int left = c.dstRect.left, top = c.dstRect.top;
+    int right = left + c.dstRect.width, bottom = top + c.dstRect.height;
+
+    if ( c.flags & BVFLAG_CLIP ) {
+        left = left > c.clip.left ? left : c.clip.left;
+        top = top > c.clip.top ? top : c.clip.top;
+        right = right < c.clip.left + (int)c.clip.width ? right : c.clip.left + (int)c.clip.width;
+        bottom = bottom < c.clip.top + (int)c.clip.height ? bottom : c.clip.top + (int)c.clip.height;
+    }
+
+    for ( int vy = 0; vy < dst.height; vy++ ) {
+        for ( int vx = 0; vx < dst.width; vx++ ) {
+            size_t i = (size_t)vy * dst.width + vx;
+            b.inside[i] = vx >= left && vx < right && vy >= top && vy < bottom;
+            if ( !b.inside[i] ) {
+                continue;
+            }
+
+            int u = vx - c.dstRect.left, v = vy - c.dstRect.top;
+            double s[4] = { 0 }, p[4] = { 0 }, d[4], *out = b.expected + 4 * i;
+            if ( b.srcUsed[0] ) {
+                sampleSource(b, 0, u, v, s);
+            }
+            if ( b.srcUsed[1] ) {
+                sampleSource(b, 1, u, v, p);
+            }
+            decodeVirt(dst, vx, vy, d);
+
+            if ( (c.flags & BVFLAG_OP_MASK) == BVFLAG_BLEND ) {
+                if ( c.op & BVBLENDDEF_GLOBAL_MASK ) {
+                    for ( int k = 0; k < 4; k++ ) {
+                        s[k] = s[k] * c.alpha / 255.0;
+                    }
+                }
+                referenceBlend(c.op, s, p, out);
+            } else {
+                referenceRop(c.op, s, p, d, out);
+            }
+        }
+    }
+}
+
+/*--------------------------Checking----------------------------*/
+
+static int checkOutput(const Blt& b, const char* variant) {
+    const Case& c = *b.c;
+    const Surface& dst = b.dst;
+    const Format* f = dst.fmt;
+    size_t rowBytes = (size_t)dst.physWidth * f->bytespp;
+    int failures = 0;
+
+    for ( int py = 0; py < dst.physHeight && failures < 4; py++ ) {
+        const uint8_t* got = dst.mem + py * dst.stride;
+        const uint8_t* was = b.initial + py * dst.stride;
+        if ( memcmp(got + rowBytes, was + rowBytes, dst.stride - rowBytes) ) {
+            printf("FAIL %s %s: stride padding of row %d written\n", c.name, variant, py);
+            failures++;
+        }
+
+        for ( int px = 0; px < dst.physWidth && failures < 4; px++ ) {
+            int vx, vy;
+            physToVirt(dst, px, py, vx, vy);
+            size_t i = (size_t)vy * dst.width + vx;
+
+            if ( !b.inside[i] ) {
+                if ( memcmp(got + px * f->bytespp, was + px * f->bytespp, f->bytespp) ) {
+                    printf("FAIL %s %s: pixel %d,%d outside the blt written\n",
+                           c.name, variant, vx, vy);
+                    failures++;
+                }
+                continue;
+            }
+
+            double actual[4], expected[4];
+            decodePhys(dst, px, py, actual);
+            memcpy(expected, b.expected + 4 * i, sizeof(expected));
+
+            // a premultiplied color above alpha saturates when unpremultiplied
+            if ( !f->premultiplied ) {
+                for ( int k = 0; k < 3; k++ ) {
+                    expected[k] = expected[k] < expected[3] ? expected[k] : expected[3];
+                }
+            }
+
+            for ( int k = 0; k < 4; k++ ) {
+                if ( !f->size[k] ) {
+                    continue;
+                }
+                // one step of the destination format, plus rounding of the
+                // unpremultiplied storage
+                double slack = f->size[k] < 8 ? 255.0 / ((1 << f->size[k]) - 1) + 0.5 : 0.0;
+                if ( !f->premultiplied ) {
+                    slack += 2.0;
+                }
+                if ( fabs(actual[k] - expected[k]) > c.tolerance + slack + 1e-6 ) {
+                    printf("FAIL %s %s: pixel %d,%d component %d is %.1f, expected %.1f\n",
+                           c.name, variant, vx, vy, k, actual[k], expected[k]);
+                    failures++;
+                    break;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+/*--------------------------Test cases--------------------------*/
+
+#define RECT(l, t, w, h)   { l, t, w, h }
+#define NORECT             { 0, 0, 0, 0 }
+#define ROP                BVFLAG_ROP
+#define BLEND              BVFLAG_BLEND
+
+static const enum bvscalemode kScale7x5 = (enum bvscalemode)(
+    BVSCALEDEF_VENDOR_GENERIC | BVSCALEDEF_EXPLICIT |
+    (BVSCALEDEF_7_TAP << BVSCALEDEF_HORZ_SHIFT) | (BVSCALEDEF_5_TAP << BVSCALEDEF_VERT_SHIFT));
+#define NOSCALE            (enum bvscalemode)0
+
+/* The destination is 256x160 (virtual) for every case */
+static const Case sCases[] = {
+    // fills and copies
+    { "fill_brush_rgba", ROP, 0xF0F0, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NONE, 0, NORECT, FMT_BGRA, 0, RECT(1, 1, 1, 1), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "blackness_rgb565", ROP, 0x0000, 0, FMT_RGB565, 0, RECT(8, 6, 232, 144),
+      FMT_NONE, 0, NORECT, FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "whiteness_rgbx_clip", ROP | BVFLAG_CLIP, 0xFFFF, 0, FMT_RGBX, 0, RECT(8, 6, 232, 144),
+      FMT_NONE, 0, NORECT, FMT_NONE, 0, NORECT, NOSCALE, 0, 0, RECT(0, 40, 200, 300), ALIAS_NONE, false, 0 },
+    { "copy_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "copy_rgba_bgra", ROP, 0xCCCC, 0, FMT_BGRA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "copy_rgb565_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGB565, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 1 },
+    { "copy_rgba_rgb565", ROP, 0xCCCC, 0, FMT_RGB565, 0, RECT(7, 6, 233, 144),
+      FMT_RGBA, 0, RECT(3, 2, 233, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "copy_nrgba_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NRGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 1 },
+    { "copy_rgba_nrgba", ROP, 0xCCCC, 0, FMT_NRGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 1 },
+
+    // raster operations
+    { "rop_sd_xor", ROP, 0x6666, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rop_pd_xor", ROP, 0x5A5A, 0, FMT_BGRA, 0, RECT(8, 6, 232, 144),
+      FMT_NONE, 0, NORECT, FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rop_psdpxax", ROP, 0xB8B8, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_BGRA, 0, RECT(3, 2, 232, 144), FMT_RGBX, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rop_brush_and", ROP, 0xA0A0, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NONE, 0, NORECT, FMT_RGBA, 0, RECT(2, 2, 1, 1), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+
+    // blends
+    { "blend_src1over", BLEND, BVBLEND_SRC1OVER, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_BGRA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_src1over_global", BLEND, BVBLEND_SRC1OVER | BVBLENDDEF_GLOBAL_UCHAR, 0x80, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_BGRA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_src1over_inplace", BLEND, BVBLEND_SRC1OVER, 0, FMT_BGRA, 0, RECT(8, 6, 232, 144),
+      FMT_NRGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_SRC2, false, 2 },
+    { "blend_src2over", BLEND, BVBLEND_SRC2OVER, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_src1in", BLEND, BVBLEND_SRC1IN, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_src1out", BLEND, BVBLEND_SRC1OUT, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_src1atop", BLEND, BVBLEND_SRC1ATOP, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_xor", BLEND, BVBLEND_XOR, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_plus", BLEND, BVBLEND_PLUS, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_RGBA, 0, RECT(5, 4, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_solid_fill", BLEND, BVBLEND_SRC1OVER, 0, FMT_RGB565, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(1, 1, 1, 1), FMT_RGBA, 0, RECT(2, 3, 1, 1), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 2 },
+    { "blend_rgb565_inplace", BLEND, BVBLEND_SRC1OVER, 0, FMT_RGB565, 0, RECT(8, 6, 232, 144),
+      FMT_NRGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_SRC2, false, 2 },
+
+    // YUV sources, odd origins to start in the middle of a chroma pair
+    { "uyvy_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_UYVY, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "yuyv_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 231, 144),
+      FMT_YUYV, 0, RECT(2, 3, 231, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "yvyu_bgra", ROP, 0xCCCC, 0, FMT_BGRA, 0, RECT(8, 6, 232, 144),
+      FMT_YVYU, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "nv12_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NV12, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "nv21_rgbx", ROP, 0xCCCC, 0, FMT_RGBX, 0, RECT(8, 6, 233, 144),
+      FMT_NV21, 0, RECT(1, 3, 233, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "i420_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_I420, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "yv12_rgb565", ROP, 0xCCCC, 0, FMT_RGB565, 0, RECT(8, 6, 232, 144),
+      FMT_YV12, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "nv12_709_rgba", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NV12_709, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "nv12_over_rgba", BLEND, BVBLEND_SRC1OVER | BVBLENDDEF_GLOBAL_UCHAR, 0xA0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NV12, 0, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_SRC2, false, 4 },
+
+    // orientation and mirroring
+    { "rot90_dst", ROP, 0xCCCC, 0, FMT_RGBA, 90, RECT(8, 6, 232, 144),
+      FMT_BGRA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rot180_dst", ROP, 0xCCCC, 0, FMT_RGBA, 180, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rot270_dst", ROP, 0xCCCC, 0, FMT_RGB565, 270, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rot90_src", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 90, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rot270_src_rot90_dst", ROP, 0xCCCC, 0, FMT_RGBA, 90, RECT(8, 6, 232, 144),
+      FMT_RGBA, 270, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "rot180_src_nv12", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NV12, 180, RECT(1, 3, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+    { "rot90_src_blend", BLEND, BVBLEND_SRC1OVER, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 90, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_SRC2, false, 2 },
+    { "hflip_src1", ROP | BVFLAG_HORZ_FLIP_SRC1, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "vflip_src1", ROP | BVFLAG_VERT_FLIP_SRC1, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 0 },
+    { "hvflip_rot90_src2", ROP | BVFLAG_HORZ_FLIP_SRC2 | BVFLAG_VERT_FLIP_SRC2, 0xF0F0, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NONE, 0, NORECT, FMT_UYVY, 90, RECT(3, 2, 232, 144), NOSCALE, 0, 0, NORECT, ALIAS_NONE, false, 4 },
+
+    // resampling
+    { "scale_nearest_down", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 301, 171), FMT_NONE, 0, NORECT, BVSCALE_NEAREST_NEIGHBOR, 1, 1, NORECT, ALIAS_NONE, false, 0 },
+    { "scale_nearest_up_flip", ROP | BVFLAG_HORZ_FLIP_SRC1, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 77, 49), FMT_NONE, 0, NORECT, BVSCALE_NEAREST_NEIGHBOR, 1, 1, NORECT, ALIAS_NONE, false, 0 },
+    { "scale_point_sample_rot90", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 90, RECT(3, 2, 117, 73), FMT_NONE, 0, NORECT, BVSCALE_FASTEST_POINT_SAMPLE, 1, 1, NORECT, ALIAS_NONE, false, 0 },
+    { "scale_3tap_up", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 117, 73), FMT_NONE, 0, NORECT, BVSCALE_3x3_TAP, 3, 3, NORECT, ALIAS_NONE, true, 3 },
+    { "scale_5tap_down", ROP, 0xCCCC, 0, FMT_BGRA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 464, 288), FMT_NONE, 0, NORECT, BVSCALE_5x5_TAP, 5, 5, NORECT, ALIAS_NONE, true, 3 },
+    { "scale_7x5_mixed", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 150, 288), FMT_NONE, 0, NORECT, kScale7x5, 7, 5, NORECT, ALIAS_NONE, true, 3 },
+    { "scale_9tap_vertical", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 217), FMT_NONE, 0, NORECT, BVSCALE_9x9_TAP, 9, 9, NORECT, ALIAS_NONE, true, 3 },
+    { "scale_best_flip", ROP | BVFLAG_VERT_FLIP_SRC1, 0xCCCC, 0, FMT_RGB565, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 200, 100), FMT_NONE, 0, NORECT, BVSCALE_BEST, 9, 9, NORECT, ALIAS_NONE, true, 3 },
+    { "scale_nv12_rot90_5tap", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NV12, 90, RECT(2, 4, 320, 180), FMT_NONE, 0, NORECT, BVSCALE_GOOD, 5, 5, NORECT, ALIAS_NONE, true, 5 },
+    { "scale_rot90_dst_3tap", ROP, 0xCCCC, 0, FMT_RGBA, 90, RECT(8, 6, 232, 144),
+      FMT_BGRA, 0, RECT(3, 2, 160, 100), FMT_NONE, 0, NORECT, BVSCALE_FASTEST, 3, 3, NORECT, ALIAS_NONE, true, 3 },
+    { "scale_blend_over", BLEND, BVBLEND_SRC1OVER, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_NRGBA, 0, RECT(3, 2, 180, 100), FMT_NONE, 0, NORECT, BVSCALE_BETTER, 7, 7, NORECT, ALIAS_SRC2, true, 3 },
+
+    // clipping and overlap
+    { "clip_copy", ROP | BVFLAG_CLIP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, RECT(40, 30, 170, 110), ALIAS_NONE, false, 0 },
+    { "clip_scaled_rot90", ROP | BVFLAG_CLIP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 90, RECT(3, 2, 150, 100), FMT_NONE, 0, NORECT, BVSCALE_5x5_TAP, 5, 5, RECT(21, 17, 200, 120), ALIAS_NONE, true, 3 },
+    { "clip_empty", ROP | BVFLAG_CLIP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 6, 232, 144),
+      FMT_RGBA, 0, RECT(3, 2, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, RECT(240, 0, 10, 10), ALIAS_NONE, false, 0 },
+    { "overlap_scroll_down", ROP, 0xCCCC, 0, FMT_RGBA, 0, RECT(8, 9, 232, 144),
+      FMT_RGBA, 0, RECT(11, 4, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_SRC1, false, 0 },
+    { "overlap_scroll_left", ROP, 0xCCCC, 0, FMT_RGB565, 0, RECT(4, 6, 232, 144),
+      FMT_RGB565, 0, RECT(11, 6, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_SRC1, false, 0 },
+    { "overlap_blend", BLEND, BVBLEND_SRC1OVER, 0, FMT_RGBA, 0, RECT(8, 9, 232, 144),
+      FMT_RGBA, 0, RECT(10, 12, 232, 144), FMT_NONE, 0, NORECT, NOSCALE, 0, 0, NORECT, ALIAS_BOTH, false, 2 },
+};
+
+static const int kDstWidth = 256;
+static const int kDstHeight = 160;
+
+static bool ropUses(unsigned int rop, int shift, int mask) {
+    return (((rop & mask) >> shift) ^ (rop & (mask >> shift))) != 0;
+}
+
+static void setupBlt(Blt& b, const Case& c) {
+    memset(&b, 0, sizeof(b));
+    b.c = &c;
+
+    allocSurface(b.dst, c.dstFmt, kDstWidth, kDstHeight, c.dstAngle);
+    fillRandom(b.dst);
+
+    if ( (c.flags & BVFLAG_OP_MASK) == BVFLAG_BLEND ) {
+        b.srcUsed[0] = b.srcUsed[1] = true;
+    } else {
+        b.srcUsed[0] = ropUses(c.op & 0xFF, 2, 0xCC);
+        b.srcUsed[1] = ropUses(c.op & 0xFF, 4, 0xF0);
+    }
+
+    int fmts[2] = { c.src1Fmt, c.src2Fmt };
+    int angles[2] = { c.src1Angle, c.src2Angle };
+    b.srcRect[0] = c.src1Rect;
+    b.srcRect[1] = c.src2Rect;
+
+    for ( int i = 0; i < 2; i++ ) {
+        if ( !b.srcUsed[i] ) {
+            continue;
+        }
+        if ( c.alias == ALIAS_BOTH || (c.alias == ALIAS_SRC1 && i == 0) ||
+             (c.alias == ALIAS_SRC2 && i == 1) ) {
+            b.srcSurface[i] = &b.dst;
+            if ( i == 1 ) {
+                b.srcRect[i] = c.dstRect;
+            }
+            continue;
+        }
+        const struct bvrect& r = b.srcRect[i];
+        allocSurface(b.src[i], fmts[i], (r.left + r.width + 4) & ~1, (r.top + r.height + 4) & ~1,
+                     angles[i]);
+        if ( c.smooth ) {
+            fillSmooth(b.src[i]);
+        } else {
+            fillRandom(b.src[i]);
+        }
+        b.srcSurface[i] = &b.src[i];
+    }
+
+    b.initial = (uint8_t*)malloc(b.dst.size);
+    b.expected = (double*)malloc(sizeof(double) * 4 * kDstWidth * kDstHeight);
+    b.inside = (bool*)malloc(sizeof(bool) * kDstWidth * kDstHeight);
+    if ( !b.initial || !b.expected || !b.inside ) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memcpy(b.initial, b.dst.mem, b.dst.size);
+
+    struct bvbltparams& p = b.params;
+    p.structsize = sizeof(p);
+    p.flags = c.flags;
+    if ( (c.flags & BVFLAG_OP_MASK) == BVFLAG_BLEND ) {
+        p.op.blend = (enum bvblend)c.op;
+        p.globalalpha.size8 = c.alpha;
+    } else {
+        p.op.rop = (unsigned short)c.op;
+    }
+    p.scalemode = c.scalemode;
+    p.dstdesc = &b.dst.desc;
+    p.dstgeom = &b.dst.geom;
+    p.dstrect = c.dstRect;
+    p.cliprect = c.clip;
+    if ( b.srcUsed[0] ) {
+        p.src1.desc = (struct bvbuffdesc*)&b.srcSurface[0]->desc;
+        p.src1geom = (struct bvsurfgeom*)&b.srcSurface[0]->geom;
+        p.src1rect = b.srcRect[0];
+    }
+    if ( b.srcUsed[1] ) {
+        p.src2.desc = (struct bvbuffdesc*)&b.srcSurface[1]->desc;
+        p.src2geom = (struct bvsurfgeom*)&b.srcSurface[1]->geom;
+        p.src2rect = b.srcRect[1];
+    }
+}
+
+static void releaseBlt(Blt& b) {
+    freeSurface(b.dst);
+    for ( int i = 0; i < 2; i++ ) {
+        if ( b.src[i].mem ) {
+            freeSurface(b.src[i]);
+        }
+    }
+    free(b.initial);
+    free(b.expected);
+    free(b.inside);
+}
+
+static int testCase(const Case& c) {
+    static const unsigned int kThreads[] = { 1, 4 };
+    Blt b;
+    uint8_t* first = NULL;
+    int failures = 0;
+
+    setupBlt(b, c);
+    computeReference(b);
+
+    for ( size_t k = 0; k < sizeof(sKernels) / sizeof(sKernels[0]); k++ ) {
+        if ( !cpubv_set_kernel(sKernels[k]) ) {
+            continue;
+        }
+        for ( size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); t++ ) {
+            char variant[32];
+            snprintf(variant, sizeof(variant), "%s/%uT", cpubv_kernel_name(sKernels[k]), kThreads[t]);
+            cpubv_set_threads(kThreads[t]);
+
+            memcpy(b.dst.mem, b.initial, b.dst.size);
+            enum bverror err = bv_blt(&b.params);
+            if ( err != BVERR_NONE ) {
+                printf("FAIL %s %s: bv_blt returned 0x%x (%s)\n", c.name, variant, err,
+                       b.params.errdesc ? b.params.errdesc : "");
+                failures++;
+                continue;
+            }
+
+            if ( !first ) {
+                failures += checkOutput(b, variant);
+                first = (uint8_t*)malloc(b.dst.size);
+                memcpy(first, b.dst.mem, b.dst.size);
+            } else if ( memcmp(first, b.dst.mem, b.dst.size) ) {
+                printf("FAIL %s %s: differs from the scalar single threaded blt\n", c.name, variant);
+                failures++;
+            }
+        }
+    }
+
+    cpubv_set_kernel(CPUKERNEL_AUTO);
+    cpubv_set_threads(0);
+    free(first);
+    releaseBlt(b);
+    return failures;
+}
+
+/*--------------------------API---------------------------------*/
+
+static unsigned long sCallbackData;
+static int sCallbackCount;
+
+static void asyncCallback(struct bvcallbackerror* err, unsigned long data) {
+    if ( !err ) {
+        sCallbackData = data;
+        sCallbackCount++;
+    }
+}
+
+static int expectError(const char* name, struct bvbltparams p, enum bverror expected) {
+    enum bverror err = bv_blt(&p);
+    if ( err != expected ) {
+        printf("FAIL api %s: bv_blt returned 0x%x, expected 0x%x\n", name, err, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int testApi() {
+    Surface dst, src, yuv;
+    int failures = 0;
+
+    allocSurface(dst, FMT_RGBA, 64, 64, 0);
+    allocSurface(src, FMT_RGBA, 64, 64, 0);
+    allocSurface(yuv, FMT_NV12, 64, 64, 0);
+    fillRandom(dst);
+    fillRandom(src);
+    fillRandom(yuv);
+
+    struct bvbltparams base;
+    memset(&base, 0, sizeof(base));
+    base.structsize = sizeof(base);
+    base.flags = BVFLAG_ROP;
+    base.op.rop = 0xCCCC;
+    base.dstdesc = &dst.desc;
+    base.dstgeom = &dst.geom;
+    base.dstrect.width = 64;
+    base.dstrect.height = 64;
+    base.src1.desc = &src.desc;
+    base.src1geom = &src.geom;
+    base.src1rect = base.dstrect;
+
+    // mapping
+    if ( bv_map(&dst.desc) != BVERR_NONE || !dst.desc.map ) {
+        printf("FAIL api map: no mapping attached\n");
+        failures++;
+    }
+    struct bvbuffmap* map = dst.desc.map;
+    if ( bv_map(&dst.desc) != BVERR_NONE || dst.desc.map != map ) {
+        printf("FAIL api map: mapping attached twice\n");
+        failures++;
+    }
+    if ( bv_unmap(&dst.desc) != BVERR_NONE || dst.desc.map ) {
+        printf("FAIL api unmap: mapping left attached\n");
+        failures++;
+    }
+
+    // unsupported requests
+    struct bvbltparams p = base;
+    p.flags = BVFLAG_FILTER;
+    failures += expectError("filter", p, BVERR_OP);
+    p = base;
+    p.op.rop = 0xCCAA;
+    failures += expectError("rop_mask", p, BVERR_OP);
+    p = base;
+    p.flags |= BVFLAG_KEY_SRC;
+    failures += expectError("color_key", p, BVERR_KEY);
+    p = base;
+    p.flags |= BVFLAG_TILE_SRC1;
+    failures += expectError("tiled_source", p, BVERR_SRC1_TILE);
+    p = base;
+    p.dstdesc = &yuv.desc;
+    p.dstgeom = &yuv.geom;
+    failures += expectError("yuv_destination", p, BVERR_DSTGEOM_FORMAT);
+    p = base;
+    p.dstrect.left = 1;
+    failures += expectError("destination_rect", p, BVERR_DSTRECT);
+    p = base;
+    dst.desc.length = dst.size - dst.stride;
+    failures += expectError("destination_length", p, BVERR_DSTDESC_LEN);
+    dst.desc.length = dst.size;
+    p = base;
+    p.src1geom = &yuv.geom;
+    p.src1.desc = &yuv.desc;
+    yuv.geom.orientation = 45;
+    failures += expectError("source_orientation", p, BVERR_SRC1_ROT);
+    yuv.geom.orientation = 0;
+
+    // parameters only
+    uint8_t* saved = (uint8_t*)malloc(dst.size);
+    memcpy(saved, dst.mem, dst.size);
+    p = base;
+    p.flags |= BVFLAG_TESTPARAMS_NOP;
+    if ( bv_blt(&p) != BVERR_NONE || memcmp(saved, dst.mem, dst.size) ) {
+        printf("FAIL api testparams: destination written\n");
+        failures++;
+    }
+
+    // scale mode returned for implicit scaling
+    p = base;
+    p.flags |= BVFLAG_SCALE_RETURN;
+    p.src1rect.width = 32;
+    p.scalemode = BVSCALE_GOOD;
+    if ( bv_blt(&p) != BVERR_NONE || p.scalemode != BVSCALE_5x5_TAP ) {
+        printf("FAIL api scale_return: scale mode 0x%x\n", (unsigned int)p.scalemode);
+        failures++;
+    }
+
+    // batches
+    p = base;
+    p.flags |= BVFLAG_BATCH_BEGIN;
+    if ( bv_blt(&p) != BVERR_NONE || !p.batch ) {
+        printf("FAIL api batch: no batch returned\n");
+        failures++;
+    }
+    p.flags = (p.flags & ~BVFLAG_BATCH_MASK) | BVFLAG_BATCH_CONTINUE;
+    failures += expectError("batch_continue", p, BVERR_NONE);
+    memcpy(dst.mem, saved, dst.size);
+    p.flags = (p.flags & ~BVFLAG_BATCH_MASK) | BVFLAG_BATCH_END;
+    p.batchflags = BVBATCH_ENDNOP;
+    if ( bv_blt(&p) != BVERR_NONE || memcmp(saved, dst.mem, dst.size) ) {
+        printf("FAIL api batch_endnop: blt executed\n");
+        failures++;
+    }
+    p.batch = NULL;
+    p.batchflags = 0;
+    failures += expectError("batch_uninitialized", p, BVERR_BATCH);
+
+    // asynchronous blts complete before the callback
+    p = base;
+    p.flags |= BVFLAG_ASYNC;
+    p.callbackfn = asyncCallback;
+    p.callbackdata = 0x5A5A;
+    if ( bv_blt(&p) != BVERR_NONE || sCallbackCount != 1 || sCallbackData != 0x5A5A ||
+         memcmp(dst.mem, src.mem, 64 * 4) ) {
+        printf("FAIL api async: callback %d, data 0x%lx\n", sCallbackCount, sCallbackData);
+        failures++;
+    }
+
+    free(saved);
+    freeSurface(dst);
+    freeSurface(src);
+    freeSurface(yuv);
+    return failures;
+}
+
+/*--------------------------Benchmark---------------------------*/
+
+struct Bench {
+    const char* name;
+    unsigned long flags;
+    unsigned int op;
+    int dstFmt, dstAngle;
+    int srcFmt, srcWidth, srcHeight;
+    enum bvscalemode scalemode;
+};
+
+static const Bench sBenches[] = {
+    { "fill",          BVFLAG_ROP,   0xF0F0,           FMT_RGBA,   0,  FMT_RGBA,   1,    1,    NOSCALE },
+    { "copy",          BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_RGBA,   1920, 1080, NOSCALE },
+    { "convert",       BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_RGB565, 1920, 1080, NOSCALE },
+    { "convert",       BVFLAG_ROP,   0xCCCC,           FMT_RGB565, 0,  FMT_RGBA,   1920, 1080, NOSCALE },
+    { "rop_xor",       BVFLAG_ROP,   0x6666,           FMT_RGBA,   0,  FMT_BGRA,   1920, 1080, NOSCALE },
+    { "src1over",      BVFLAG_BLEND, BVBLEND_SRC1OVER, FMT_RGBA,   0,  FMT_RGBA,   1920, 1080, NOSCALE },
+    { "src1over",      BVFLAG_BLEND, BVBLEND_SRC1OVER, FMT_RGB565, 0,  FMT_NRGBA,  1920, 1080, NOSCALE },
+    { "yuv",           BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_NV12,   1920, 1080, NOSCALE },
+    { "yuv",           BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_UYVY,   1920, 1080, NOSCALE },
+    { "yuv",           BVFLAG_ROP,   0xCCCC,           FMT_RGB565, 0,  FMT_I420,   1920, 1080, NOSCALE },
+    { "rotate90",      BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   90, FMT_RGBA,   1920, 1080, NOSCALE },
+    { "scale_3tap_up", BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_NV12,   960,  540,  BVSCALE_3x3_TAP },
+    { "scale_5tap_dn", BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_RGBA,   3840, 2160, BVSCALE_5x5_TAP },
+    { "scale_nearest", BVFLAG_ROP,   0xCCCC,           FMT_RGBA,   0,  FMT_RGBA,   1280, 720,  BVSCALE_NEAREST_NEIGHBOR },
+};
+
+static void benchmark(int iterations) {
+    static const unsigned int kThreads[] = { 1, 0 };
+    const int width = 1920, height = 1080;
+
+    for ( size_t n = 0; n < sizeof(sBenches) / sizeof(sBenches[0]); n++ ) {
+        const Bench& bench = sBenches[n];
+        Surface dst, src;
+        allocSurface(dst, bench.dstFmt, width, height, bench.dstAngle);
+        allocSurface(src, bench.srcFmt, bench.srcWidth, bench.srcHeight, 0);
+        fillRandom(dst);
+        fillRandom(src);
+
+        struct bvbltparams p;
+        memset(&p, 0, sizeof(p));
+        p.structsize = sizeof(p);
+        p.flags = bench.flags;
+        if ( bench.flags == BVFLAG_BLEND ) {
+            p.op.blend = (enum bvblend)bench.op;
+            p.src2.desc = &dst.desc;
+            p.src2geom = &dst.geom;
+            p.src2rect.width = width;
+            p.src2rect.height = height;
+        } else {
+            p.op.rop = (unsigned short)bench.op;
+        }
+        p.scalemode = bench.scalemode;
+        p.dstdesc = &dst.desc;
+        p.dstgeom = &dst.geom;
+        p.dstrect.width = width;
+        p.dstrect.height = height;
+        p.src1.desc = &src.desc;
+        p.src1geom = &src.geom;
+        p.src1rect.width = bench.srcWidth;
+        p.src1rect.height = bench.srcHeight;
+        if ( bench.op == 0xF0F0 ) {
+            p.src2 = p.src1;
+            p.src2geom = p.src1geom;
+            p.src2rect = p.src1rect;
+        }
+
+        char formats[32];
+        snprintf(formats, sizeof(formats), "%s>%s", sFormats[bench.srcFmt].name,
+                 sFormats[bench.dstFmt].name);
+
+        for ( size_t k = 0; k < sizeof(sKernels) / sizeof(sKernels[0]); k++ ) {
+            if ( !cpubv_set_kernel(sKernels[k]) ) {
+                continue;
+            }
+            for ( size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); t++ ) {
+                cpubv_set_threads(kThreads[t]);
+                bv_blt(&p);
+                double start = nowMs();
+                for ( int i = 0; i < iterations; i++ ) {
+                    bv_blt(&p);
+                }
+                double ms = (nowMs() - start) / iterations;
+                printf("BENCH %-14s %-14s %-6s %-3s %8.3f ms %8.1f Mpix/s\n", bench.name, formats,
+                       cpubv_kernel_name(sKernels[k]), kThreads[t] == 1 ? "1T" : "MT", ms,
+                       (double)width * height / (ms * 1000.0));
+            }
+        }
+
+        cpubv_set_kernel(CPUKERNEL_AUTO);
+        cpubv_set_threads(0);
+        freeSurface(dst);
+        freeSurface(src);
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = 0;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "b:")) != -1 ) {
+        if ( opt == 'b' ) {
+            iterations = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-b iterations]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failures = 0;
+    for ( size_t i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++ ) {
+        failures += testCase(sCases[i]);
+    }
+    failures += testApi();
+
+    if ( iterations > 0 ) {
+        benchmark(iterations);
+    }
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Command stream regression test for the gc2d BLTsville implementation.
+ *
+ * Runs on the stub driver, so it needs neither the GPU nor the kernel
+ * driver: every blt is recorded to a trace, the stub checks each commit
+ * against the live mappings, and the trace is then read back and decoded
+ * to make sure the builder produced a well formed stream. The command
+ * bytes, state writes and reloads per blit are printed for every case so
+ * changes to the builder show up as changes to these numbers.
+ *
+ * Usage: gcbv_trace_test [-b <iterations>] [-k]
+ *   -b  also report the time the library spends building each blt
+ *   -k  keep the traces in the current directory
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bltsville.h"
+#include "gctrace.h"
+
+extern "C" {
+enum bverror bv_map(struct bvbuffdesc* buffdesc);
+enum bverror bv_unmap(struct bvbuffdesc* buffdesc);
+enum bverror bv_blt(struct bvbltparams* bltparams);
+void gcbv_defer(unsigned int size);
+enum bverror gcbv_flush(void);
+}
+
+// struct bvphysdesc of gcmain.h, which is not usable from C++
+#define BVAT_PHYSDESC 0xDEADBEEF
+
+struct PhysDesc {
+    unsigned int structsize;
+    unsigned long pagesize;
+    unsigned long* pagearray;
+    unsigned int pagecount;
+    unsigned long pageoffset;
+};
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*--------------------------Surfaces----------------------------*/
+
+enum {
+    FMT_RGBA,
+    FMT_BGRA,
+    FMT_RGB16,
+    FMT_UYVY,
+    FMT_NV12,
+};
+
+struct Format {
+    enum ocdformat ocd;
+    int bytespp;        // of the first plane
+    int chromaRows;     // extra rows of the chroma plane per two luma rows
+};
+
+static const Format sFormats[] = {
+    { OCDFMT_RGBA24, 4, 0 },
+    { OCDFMT_BGRA24, 4, 0 },
+    { OCDFMT_RGB16,  2, 0 },
+    { OCDFMT_UYVY,   2, 0 },
+    { OCDFMT_NV12,   1, 1 },
+};
+
+struct Surface {
+    uint8_t* mem;
+    struct bvbuffdesc desc;
+    struct bvsurfgeom geom;
+    struct PhysDesc phys;
+};
+
+static void allocSurface(Surface& s, int format, int width, int height, int angle) {
+    const Format& f = sFormats[format];
+    int physWidth = ( angle % 180 ) ? height : width;
+    int physHeight = ( angle % 180 ) ? width : height;
+    long stride = (physWidth * f.bytespp + 63) & ~63;
+    size_t size = stride * (physHeight + f.chromaRows * physHeight / 2);
+
+    memset(&s, 0, sizeof(s));
+    // the library needs 64 byte aligned surfaces
+    if ( posix_memalign((void**)&s.mem, 4096, size) ) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for ( size_t i = 0; i < size; i++ ) {
+        s.mem[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    s.desc.structsize = sizeof(s.desc);
+    s.desc.virtaddr = s.mem;
+    s.desc.length = size;
+
+    s.geom.structsize = sizeof(s.geom);
+    s.geom.format = f.ocd;
+    s.geom.width = width;
+    s.geom.height = height;
+    s.geom.orientation = angle;
+    s.geom.virtstride = stride;
+}
+
+// Describes the surface by made up physical pages; the stub does not touch them.
+static void describePages(Surface& s) {
+    s.phys.structsize = sizeof(s.phys);
+    s.phys.pagesize = 4096;
+    s.phys.pagecount = (s.desc.length + 4095) / 4096;
+    s.phys.pagearray = (unsigned long*)malloc(s.phys.pagecount * sizeof(unsigned long));
+    for ( unsigned int i = 0; i < s.phys.pagecount; i++ ) {
+        s.phys.pagearray[i] = 0x80000000UL + (((uintptr_t)s.mem + i * 4096) & 0x7FFFF000UL);
+    }
+    s.phys.pageoffset = 0;
+    s.desc.auxtype = (enum bvauxtype)BVAT_PHYSDESC;
+    s.desc.auxptr = &s.phys;
+}
+
+static void freeSurface(Surface& s) {
+    free(s.phys.pagearray);
+    free(s.mem);
+    s.mem = NULL;
+}
+
+/*--------------------------Cases-------------------------------*/
+
+enum Kind {
+    KIND_ROP,           // src1 through a ROP, mapped implicitly
+    KIND_ROP_MAPPED,    // same with all surfaces mapped by the caller
+    KIND_BLEND,         // src1 over src2
+    KIND_BATCH,         // a batch of copies to different destination rects
+    KIND_ASYNC,         // asynchronous with a callback
+    KIND_DEFER,         // asynchronous without a callback, merged until flushed
+    KIND_PHYS,          // surfaces described by pages, mapped from the cache
+};
+
+struct Case {
+    const char* name;
+    Kind kind;
+    unsigned short rop;
+    int dstFormat, srcFormat;
+    int srcWidth, srcHeight, srcAngle;
+    int dstAngle;
+    int blts;           // per batch or repeated
+};
+
+static const int kDstWidth = 320;
+static const int kDstHeight = 240;
+
+static const Case sCases[] = {
+    // name                 kind              rop     dst        src        sw   sh   sa   da  n
+    { "fill",               KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_RGBA,   1,   1,   0,   0, 4 },
+    { "copy",               KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_RGBA, 320, 240,   0,   0, 4 },
+    { "copy_mapped",        KIND_ROP_MAPPED,  0xCCCC, FMT_RGBA,  FMT_RGBA, 320, 240,   0,   0, 4 },
+    { "swizzle",            KIND_ROP,         0xCCCC, FMT_BGRA,  FMT_RGBA, 320, 240,   0,   0, 4 },
+    { "convert_rgb16",      KIND_ROP,         0xCCCC, FMT_RGB16, FMT_RGBA, 320, 240,   0,   0, 4 },
+    { "rotate_90",          KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_RGBA, 320, 240,   0,  90, 4 },
+    { "scale_up",           KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_RGBA, 160, 120,   0,   0, 4 },
+    { "scale_down",         KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_RGBA, 640, 480,   0,   0, 4 },
+    { "uyvy_to_rgb",        KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_UYVY, 320, 240,   0,   0, 4 },
+    { "nv12_to_rgb",        KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_NV12, 320, 240,   0,   0, 4 },
+    { "nv12_scale",         KIND_ROP,         0xCCCC, FMT_RGBA,  FMT_NV12, 640, 480,   0,   0, 4 },
+    { "blend",              KIND_BLEND,       0,      FMT_RGBA,  FMT_RGBA, 320, 240,   0,   0, 4 },
+    { "batch",              KIND_BATCH,       0xCCCC, FMT_RGBA,  FMT_RGBA,  80,  60,   0,   0, 16 },
+    { "blend_batch",        KIND_BATCH,       0,      FMT_RGBA,  FMT_RGBA,  80,  60,   0,   0, 16 },
+    { "async",              KIND_ASYNC,       0xCCCC, FMT_RGBA,  FMT_RGBA, 320, 240,   0,   0, 4 },
+    { "defer",              KIND_DEFER,       0xCCCC, FMT_RGBA,  FMT_RGBA, 320, 240,   0,   0, 8 },
+    { "copy_physdesc",      KIND_PHYS,        0xCCCC, FMT_RGBA,  FMT_RGBA, 320, 240,   0,   0, 4 },
+};
+
+static int sCallbackCount;
+
+static void asyncCallback(struct bvcallbackerror* err, unsigned long data) {
+    if ( !err && data == 0x5D ) {
+        __sync_fetch_and_add(&sCallbackCount, 1);
+    }
+}
+
+struct Blt {
+    Surface dst, src;
+    struct bvbltparams params;
+};
+
+static void setupBlt(Blt& b, const Case& c) {
+    allocSurface(b.dst, c.dstFormat, kDstWidth, kDstHeight, c.dstAngle);
+
+    struct bvbltparams& p = b.params;
+    memset(&p, 0, sizeof(p));
+    p.structsize = sizeof(p);
+    p.dstdesc = &b.dst.desc;
+    p.dstgeom = &b.dst.geom;
+    p.dstrect.width = kDstWidth;
+    p.dstrect.height = kDstHeight;
+    p.cliprect = p.dstrect;
+
+    if ( c.kind == KIND_BLEND || (c.kind == KIND_BATCH && c.rop == 0) ) {
+        p.flags = BVFLAG_BLEND;
+        p.op.blend = BVBLEND_SRC1OVER;
+        p.src2.desc = &b.dst.desc;
+        p.src2geom = &b.dst.geom;
+        p.src2rect = p.dstrect;
+    } else {
+        p.flags = BVFLAG_ROP;
+        p.op.rop = c.rop;
+    }
+
+    // a 1x1 source is a fill
+    allocSurface(b.src, c.srcFormat, c.srcWidth, c.srcHeight, c.srcAngle);
+    p.src1.desc = &b.src.desc;
+    p.src1geom = &b.src.geom;
+    p.src1rect.width = c.srcWidth;
+    p.src1rect.height = c.srcHeight;
+
+    if ( c.kind == KIND_PHYS ) {
+        describePages(b.dst);
+        describePages(b.src);
+    }
+
+    if ( c.kind == KIND_BATCH ) {
+        p.dstrect.width = c.srcWidth;
+        p.dstrect.height = c.srcHeight;
+        p.src2rect = p.dstrect;
+    }
+    if ( c.kind == KIND_ASYNC ) {
+        p.flags |= BVFLAG_ASYNC;
+        p.callbackfn = asyncCallback;
+        p.callbackdata = 0x5D;
+    }
+    if ( c.kind == KIND_DEFER ) {
+        p.flags |= BVFLAG_ASYNC;
+    }
+}
+
+static void releaseBlt(Blt& b) {
+    freeSurface(b.dst);
+    freeSurface(b.src);
+}
+
+/* Issues the blts of one case, returns the number of failures. */
+static int runBlts(const Case& c, Blt& b) {
+    struct bvbltparams& p = b.params;
+    int failures = 0;
+
+    if ( c.kind != KIND_BATCH ) {
+        if ( c.kind == KIND_DEFER ) {
+            gcbv_defer(1 << 20);
+        }
+        for ( int i = 0; i < c.blts; i++ ) {
+            enum bverror err = bv_blt(&p);
+            if ( err != BVERR_NONE ) {
+                printf("FAIL %s: bv_blt returned 0x%x (%s)\n", c.name, err,
+                       p.errdesc ? p.errdesc : "");
+                failures++;
+            }
+        }
+        if ( c.kind == KIND_DEFER ) {
+            enum bverror err = gcbv_flush();
+            if ( err != BVERR_NONE ) {
+                printf("FAIL %s: gcbv_flush returned 0x%x\n", c.name, err);
+                failures++;
+            }
+            gcbv_defer(0);
+        }
+        return failures;
+    }
+
+    unsigned long flags = p.flags;
+    int columns = kDstWidth / c.srcWidth;
+    for ( int i = 0; i < c.blts; i++ ) {
+        p.flags = flags | ( i == 0 ? BVFLAG_BATCH_BEGIN
+                          : i == c.blts - 1 ? BVFLAG_BATCH_END : BVFLAG_BATCH_CONTINUE );
+        p.dstrect.left = (i % columns) * c.srcWidth;
+        p.dstrect.top = (i / columns) * c.srcHeight;
+        p.src2rect = p.dstrect;
+        p.batchflags = ( i == 0 ) ? 0 : BVBATCH_DSTRECT_ORIGIN | BVBATCH_SRC2RECT_ORIGIN;
+        enum bverror err = bv_blt(&p);
+        if ( err != BVERR_NONE ) {
+            printf("FAIL %s: batch blt %d returned 0x%x (%s)\n", c.name, i, err,
+                   p.errdesc ? p.errdesc : "");
+            failures++;
+        }
+    }
+    p.flags = flags;
+    p.dstrect.left = p.dstrect.top = 0;
+    return failures;
+}
+
+/*--------------------------Trace check-------------------------*/
+
+struct TraceInfo {
+    unsigned int commits;
+    unsigned int callbacks;
+    unsigned int failed;
+    unsigned long long driverUs;
+    struct gcdecodestats stats;
+};
+
+static int readTrace(const char* path, const char* name, TraceInfo& info) {
+    struct gctracefile trace;
+    int failures = 0;
+    int result;
+
+    memset(&info, 0, sizeof(info));
+    if ( gctrace_open(&trace, path) ) {
+        printf("FAIL %s: no trace written\n", name);
+        return 1;
+    }
+    if ( gcdecode_init(&info.stats) ) {
+        gctrace_close(&trace);
+        return 1;
+    }
+
+    while ( (result = gctrace_read(&trace)) > 0 ) {
+        if ( trace.record.gcerror != 0 ) {
+            info.failed++;
+        }
+        if ( trace.record.type == GCTRACE_CALLBACK ) {
+            info.callbacks++;
+        }
+        if ( trace.record.type != GCTRACE_COMMIT ) {
+            continue;
+        }
+
+        struct gctracecommit commit;
+        if ( gctrace_commit(&trace, &commit) ) {
+            result = -1;
+            break;
+        }
+        info.commits++;
+        info.driverUs += trace.record.duration;
+        gcdecode_commit(&info.stats);
+        for ( unsigned int i = 0; i < commit.buffercount; i++ ) {
+            struct gctracebuffer buffer;
+            if ( gctrace_buffer(&commit, &buffer) ) {
+                result = -1;
+                break;
+            }
+            gcdecode_buffer(&info.stats, buffer.words, buffer.wordcount, buffer.fixupcount);
+        }
+        if ( result < 0 ) {
+            break;
+        }
+    }
+    gctrace_close(&trace);
+
+    if ( result < 0 ) {
+        printf("FAIL %s: trace is corrupt\n", name);
+        failures++;
+    }
+    if ( info.failed ) {
+        printf("FAIL %s: %u requests failed in the driver\n", name, info.failed);
+        failures++;
+    }
+    if ( info.stats.malformed ) {
+        printf("FAIL %s: %u malformed command buffers\n", name, info.stats.malformed);
+        failures++;
+    }
+    return failures;
+}
+
+/*--------------------------Test--------------------------------*/
+
+static int testCase(const Case& c, bool keep) {
+    char path[256];
+    Blt b;
+    int failures = 0;
+
+    if ( keep ) {
+        snprintf(path, sizeof(path), "gcbv_%s.trace", c.name);
+    } else {
+        snprintf(path, sizeof(path), "/tmp/gcbv_trace_test_%d.trace", (int)getpid());
+    }
+
+    setupBlt(b, c);
+
+    struct gcstubstats before, after;
+    gcstub_stats(&before);
+    sCallbackCount = 0;
+
+    if ( gc_trace_start(path) ) {
+        printf("FAIL %s: cannot record to %s\n", c.name, path);
+        releaseBlt(b);
+        return 1;
+    }
+
+    if ( c.kind == KIND_ROP_MAPPED ) {
+        bv_map(&b.dst.desc);
+        bv_map(&b.src.desc);
+    }
+    failures += runBlts(c, b);
+
+    // only the first blt maps the surfaces, bv_unmap drops the cached mappings
+    if ( c.kind == KIND_PHYS ) {
+        struct gcstubstats cached;
+        gcstub_stats(&cached);
+        if ( cached.maps - before.maps != 2 ) {
+            printf("FAIL %s: %u mappings for %d blts\n", c.name, cached.maps - before.maps, c.blts);
+            failures++;
+        }
+        bv_unmap(&b.dst.desc);
+        bv_unmap(&b.src.desc);
+    }
+
+    // the callbacks arrive on the callback thread
+    for ( int i = 0; i < 1000 && c.kind == KIND_ASYNC && sCallbackCount < c.blts; i++ ) {
+        usleep(1000);
+    }
+    if ( c.kind == KIND_ROP_MAPPED ) {
+        bv_unmap(&b.dst.desc);
+        bv_unmap(&b.src.desc);
+    }
+
+    gc_trace_stop();
+    gcstub_stats(&after);
+
+    if ( after.errors != before.errors ) {
+        printf("FAIL %s: the stub refused %u requests\n", c.name, after.errors - before.errors);
+        failures++;
+    }
+    if ( after.livemaps != before.livemaps ) {
+        printf("FAIL %s: %d mappings leaked\n", c.name, (int)(after.livemaps - before.livemaps));
+        failures++;
+    }
+    if ( c.kind == KIND_ASYNC && sCallbackCount != c.blts ) {
+        printf("FAIL %s: %d of %d callbacks\n", c.name, sCallbackCount, c.blts);
+        failures++;
+    }
+
+    TraceInfo info;
+    failures += readTrace(path, c.name, info);
+
+    // a batch and the deferred blts go out in one commit
+    unsigned int expected = ( c.kind == KIND_BATCH || c.kind == KIND_DEFER ) ? 1 : c.blts;
+    if ( info.commits != expected ) {
+        printf("FAIL %s: %u commits, expected %u\n", c.name, info.commits, expected);
+        failures++;
+    }
+    if ( info.stats.blits < (unsigned int)c.blts ) {
+        printf("FAIL %s: %u blits for %d blts\n", c.name, info.stats.blits, c.blts);
+        failures++;
+    }
+    if ( c.kind == KIND_ASYNC && info.callbacks != (unsigned int)c.blts ) {
+        printf("FAIL %s: %u callbacks recorded\n", c.name, info.callbacks);
+        failures++;
+    }
+
+    const gcdecodestats& s = info.stats;
+    printf("CASE %-16s %5.0f bytes/blt %5.1f states/blt %5.1f%% reloaded %5.1f%% carried\n",
+           c.name, (double)s.words * 4 / c.blts, (double)s.states / c.blts,
+           s.states ? 100.0 * s.redundant / s.states : 0.0,
+           s.states ? 100.0 * s.carried / s.states : 0.0);
+
+    gcdecode_free(&info.stats);
+    if ( !keep ) {
+        unlink(path);
+    }
+    releaseBlt(b);
+    return failures;
+}
+
+/* Time spent in bv_blt per blt; on the stub this is the cost of building
+ * and checking the command stream. */
+static void benchmark(int iterations) {
+    for ( size_t i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++ ) {
+        const Case& c = sCases[i];
+        Blt b;
+
+        setupBlt(b, c);
+        bv_map(&b.dst.desc);
+        bv_map(&b.src.desc);
+        if ( c.kind == KIND_ASYNC ) {
+            b.params.flags &= ~BVFLAG_ASYNC;
+        }
+
+        runBlts(c, b);
+        double start = nowMs();
+        for ( int n = 0; n < iterations; n++ ) {
+            runBlts(c, b);
+        }
+        double ms = nowMs() - start;
+
+        printf("BENCH %-16s %8.2f us/blt\n", c.name, ms * 1000.0 / (iterations * c.blts));
+
+        bv_unmap(&b.dst.desc);
+        bv_unmap(&b.src.desc);
+        releaseBlt(b);
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = 0;
+    bool keep = false;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "b:k")) != -1 ) {
+        if ( opt == 'b' ) {
+            iterations = atoi(optarg);
+        } else if ( opt == 'k' ) {
+            keep = true;
+        } else {
+            fprintf(stderr, "usage: %s [-b iterations] [-k]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failures = 0;
+    for ( size_t i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++ ) {
+        failures += testCase(sCases[i], keep);
+    }
+
+    if ( iterations > 0 ) {
+        benchmark(iterations);
+    }
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,42 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Checks and benchmarks the threaded RGB to NV12 converter and the
+# conversion stage of the video encoder proxies on plain memory
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	venc_convert_test.cpp \
+	../../domx/omx_proxy_component/omx_video_enc/src/omx_video_enc_convert.c
+
+LOCAL_STATIC_LIBRARIES:= libyuvconvert
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/libyuvconvert \
+	$(HARDWARE_TI_OMAP4_BASE)/domx/omx_proxy_component/omx_video_enc/inc
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= venc_convert_test
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	venc_convert_test.cpp \
+	../../domx/omx_proxy_component/omx_video_enc/src/omx_video_enc_convert.c
+
+LOCAL_STATIC_LIBRARIES:= libyuvconvert_host
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/libyuvconvert \
+	$(HARDWARE_TI_OMAP4_BASE)/domx/omx_proxy_component/omx_video_enc/inc
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= venc_convert_test_host
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+include $(BUILD_HOST_EXECUTABLE)
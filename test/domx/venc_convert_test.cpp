@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test and benchmark for the color conversion stage of the video encoder
+ * proxies.
+ *
+ * The check phase compares the banded multithreaded RGB to NV12 converter
+ * against a single yuv_rgba_to_nv12() call for odd sizes and every thread
+ * count, then verifies that the stage processes jobs in submission order,
+ * blocks the submitter once its queue is full, drains on demand and
+ * identifies its own thread.
+ *
+ * The benchmark phase converts a 1080p frame with 1 to 4 threads, then
+ * streams frames to a stand in for the remote encoder, once converting in
+ * the ETB of the client and once on the stage, and reports how long the
+ * client is held in ETB and the time per frame.
+ *
+ * Usage: venc_convert_test [-n frames] [-e encode ms]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "yuv_convert.h"
+#include "omx_video_enc_convert.h"
+
+struct Options {
+    int frames;
+    int encodeMs;
+};
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+struct Image {
+    uint8_t* rgb;
+    uint8_t* y;
+    uint8_t* uv;
+    int width, height;
+    int rgbStride, yStride;
+};
+
+static void allocImage(Image& img, int width, int height) {
+    img.width = width;
+    img.height = height;
+    img.rgbStride = width * 4 + 12;
+    img.yStride = width + 7;
+    img.rgb = new uint8_t[img.rgbStride * height];
+    img.y = new uint8_t[img.yStride * height];
+    img.uv = new uint8_t[img.yStride * ( ( height + 1 ) / 2 )];
+
+    uint32_t seed = width * 31 + height;
+    for ( int i = 0; i < img.rgbStride * height; i++ ) {
+        seed = seed * 1103515245u + 12345u;
+        img.rgb[i] = seed >> 24;
+    }
+}
+
+static void freeImage(Image& img) {
+    delete [] img.rgb;
+    delete [] img.y;
+    delete [] img.uv;
+}
+
+/*--------------------Check-----------------------------*/
+
+static bool checkConverter() {
+    static const int sizes[][2] = {
+        { 2, 2 }, { 3, 1 }, { 7, 5 }, { 34, 9 }, { 130, 11 }, { 322, 243 }, { 640, 480 },
+    };
+    bool ok = true;
+
+    for ( int threads = 1; threads <= VENC_CONVERTER_MAX_THREADS; threads++ ) {
+        VENC_CONVERTER* conv = VENC_ConverterCreate(threads);
+        if ( NULL == conv ) {
+            printf("converter: %d threads not created\n", threads);
+            return false;
+        }
+
+        for ( size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ ) {
+            for ( int bgr = 0; bgr < 2; bgr++ ) {
+                Image ref, out;
+                allocImage(ref, sizes[i][0], sizes[i][1]);
+                allocImage(out, sizes[i][0], sizes[i][1]);
+                int uvSize = out.yStride * ( ( out.height + 1 ) / 2 );
+                memset(ref.y, 0xAA, ref.yStride * ref.height);
+                memset(out.y, 0xAA, out.yStride * out.height);
+                memset(ref.uv, 0xAA, uvSize);
+                memset(out.uv, 0xAA, uvSize);
+
+                if ( bgr ) {
+                    yuv_bgra_to_nv12(ref.rgb, ref.rgbStride, ref.y, ref.yStride,
+                                     ref.uv, ref.yStride, ref.width, ref.height);
+                } else {
+                    yuv_rgba_to_nv12(ref.rgb, ref.rgbStride, ref.y, ref.yStride,
+                                     ref.uv, ref.yStride, ref.width, ref.height);
+                }
+                VENC_ConverterRGBToNV12(conv, out.rgb, out.rgbStride, bgr, out.y,
+                                        out.yStride, out.uv, out.yStride, out.width,
+                                        out.height);
+
+                if ( memcmp(ref.y, out.y, ref.yStride * ref.height) ||
+                     memcmp(ref.uv, out.uv, uvSize) ) {
+                    printf("converter: %d threads, %dx%d %s differs\n", threads,
+                           ref.width, ref.height, bgr ? "bgra" : "rgba");
+                    ok = false;
+                }
+
+                freeImage(ref);
+                freeImage(out);
+            }
+        }
+
+        VENC_ConverterDestroy(conv);
+    }
+
+    printf("converter: 1 to %d threads: %s\n", VENC_CONVERTER_MAX_THREADS, ok ? "PASS" : "FAIL");
+
+    return ok;
+}
+
+struct OrderCtx {
+    VENC_STAGE* stage;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool gate;            // jobs block until the gate opens
+    int processed;
+    int next;
+    int bad;
+};
+
+static void orderProcess(void* ctx, void* job) {
+    OrderCtx* c = static_cast<OrderCtx*>(ctx);
+
+    pthread_mutex_lock(&c->lock);
+    while ( !c->gate ) {
+        pthread_cond_wait(&c->cond, &c->lock);
+    }
+    if ( ( (intptr_t) job != c->next ) || !VENC_StageIsWorker(c->stage) ) {
+        c->bad++;
+    }
+    c->next++;
+    c->processed++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+struct Submitter {
+    VENC_STAGE* stage;
+    int first;
+    int count;
+    volatile int submitted;
+};
+
+static void* submit(void* arg) {
+    Submitter* s = static_cast<Submitter*>(arg);
+
+    for ( int i = 0; i < s->count; i++ ) {
+        VENC_StageSubmit(s->stage, (void*) (intptr_t) ( s->first + i ));
+        __atomic_store_n(&s->submitted, i + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static bool checkStage() {
+    const int depth = 3;
+    OrderCtx ctx;
+    bool ok = true;
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+    ctx.gate = false;
+    ctx.processed = 0;
+    ctx.next = 0;
+    ctx.bad = 0;
+
+    ctx.stage = VENC_StageCreate(depth, orderProcess, &ctx);
+    if ( NULL == ctx.stage ) {
+        printf("stage: not created: FAIL\n");
+        return false;
+    }
+    if ( VENC_StageIsWorker(ctx.stage) ) {
+        ok = false;
+    }
+
+    // with the job blocked, one job runs and depth more fit in the queue
+    Submitter s = { ctx.stage, 0, depth + 4, 0 };
+    pthread_t tid;
+    pthread_create(&tid, NULL, submit, &s);
+    usleep(50000);
+    int blocked = __atomic_load_n(&s.submitted, __ATOMIC_ACQUIRE);
+    if ( depth + 1 != blocked ) {
+        printf("stage: %d submitted with a queue of %d\n", blocked, depth);
+        ok = false;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    ctx.gate = true;
+    pthread_cond_broadcast(&ctx.cond);
+    pthread_mutex_unlock(&ctx.lock);
+    pthread_join(tid, NULL);
+
+    // drain returns only once everything submitted was processed
+    for ( int round = 0; round < 200; round++ ) {
+        int first = depth + 4 + round * 5;
+        for ( int i = 0; i < 5; i++ ) {
+            VENC_StageSubmit(ctx.stage, (void*) (intptr_t) ( first + i ));
+        }
+        VENC_StageDrain(ctx.stage);
+        pthread_mutex_lock(&ctx.lock);
+        if ( first + 5 != ctx.processed ) {
+            ok = false;
+        }
+        pthread_mutex_unlock(&ctx.lock);
+    }
+
+    // destroy processes what is still queued
+    int total = depth + 4 + 200 * 5;
+    for ( int i = 0; i < 10; i++ ) {
+        VENC_StageSubmit(ctx.stage, (void*) (intptr_t) ( total + i ));
+    }
+    VENC_StageDestroy(ctx.stage);
+    total += 10;
+
+    ok = ok && ( total == ctx.processed ) && ( 0 == ctx.bad );
+    printf("stage: %d jobs, %d out of order: %s\n", ctx.processed, ctx.bad, ok ? "PASS" : "FAIL");
+
+    pthread_cond_destroy(&ctx.cond);
+    pthread_mutex_destroy(&ctx.lock);
+
+    return ok;
+}
+
+/*--------------------Benchmark-----------------------------*/
+
+static bool benchConverter(const Options& opt) {
+    Image img;
+    double single = 0;
+
+    allocImage(img, 1920, 1080);
+
+    for ( int threads = 1; threads <= VENC_CONVERTER_MAX_THREADS; threads++ ) {
+        VENC_CONVERTER* conv = VENC_ConverterCreate(threads);
+        if ( NULL == conv ) {
+            freeImage(img);
+            return false;
+        }
+
+        double start = nowMs();
+        for ( int i = 0; i < opt.frames; i++ ) {
+            VENC_ConverterRGBToNV12(conv, img.rgb, img.rgbStride, 1, img.y, img.yStride,
+                                    img.uv, img.yStride, img.width, img.height);
+        }
+        double ms = ( nowMs() - start ) / opt.frames;
+        if ( 1 == threads ) {
+            single = ms;
+        }
+        printf("convert 1920x1080 %d threads: %6.2f ms per frame, x%.2f\n",
+               threads, ms, single / ms);
+
+        VENC_ConverterDestroy(conv);
+    }
+
+    freeImage(img);
+
+    return true;
+}
+
+struct Pipeline {
+    VENC_CONVERTER* conv;
+    VENC_STAGE* remote;
+    Image img;
+    int encodeMs;
+};
+
+static void convert(Pipeline* p) {
+    VENC_ConverterRGBToNV12(p->conv, p->img.rgb, p->img.rgbStride, 1, p->img.y,
+                            p->img.yStride, p->img.uv, p->img.yStride, p->img.width,
+                            p->img.height);
+}
+
+// the remote core, encodes one frame at a time
+static void encodeProcess(void* ctx, void*) {
+    usleep(static_cast<Pipeline*>(ctx)->encodeMs * 1000);
+}
+
+// the ETB of the proxy as run by the stage
+static void stageProcess(void* ctx, void* job) {
+    Pipeline* p = static_cast<Pipeline*>(ctx);
+
+    convert(p);
+    VENC_StageSubmit(p->remote, job);
+}
+
+static bool benchPipeline(const Options& opt) {
+    static const char* names[2] = { "in ETB", "staged" };
+    Pipeline p;
+
+    p.conv = VENC_ConverterCreate(2);
+    if ( NULL == p.conv ) {
+        return false;
+    }
+    allocImage(p.img, 1920, 1080);
+    p.encodeMs = opt.encodeMs;
+
+    for ( int async = 0; async < 2; async++ ) {
+        p.remote = VENC_StageCreate(1, encodeProcess, &p);
+        VENC_STAGE* stage = async ? VENC_StageCreate(4, stageProcess, &p) : NULL;
+        double client = 0;
+
+        double start = nowMs();
+        for ( int i = 0; i < opt.frames; i++ ) {
+            // the client produces frames at the encoder rate
+            usleep(opt.encodeMs * 1000);
+
+            double etb = nowMs();
+            if ( async ) {
+                VENC_StageSubmit(stage, NULL);
+            } else {
+                convert(&p);
+                VENC_StageSubmit(p.remote, NULL);
+            }
+            client += nowMs() - etb;
+        }
+        VENC_StageDestroy(stage);
+        VENC_StageDestroy(p.remote);
+        double total = ( nowMs() - start ) / opt.frames;
+
+        printf("pipeline 1920x1080, %d ms encode, %s: ETB %6.2f ms, %6.2f ms per frame\n",
+               opt.encodeMs, names[async], client / opt.frames, total);
+    }
+
+    freeImage(p.img);
+    VENC_ConverterDestroy(p.conv);
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options opt = { 30, 10 };
+    int c;
+
+    while ( (c = getopt(argc, argv, "n:e:")) != -1 ) {
+        switch ( c ) {
+            case 'n': opt.frames = atoi(optarg); break;
+            case 'e': opt.encodeMs = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-e encode ms]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if ( ( 0 >= opt.frames ) || ( 0 > opt.encodeMs ) ) {
+        fprintf(stderr, "frames must be positive\n");
+        return 2;
+    }
+
+    bool ok = checkConverter();
+    ok &= checkStage();
+
+    ok &= benchConverter(opt);
+    ok &= benchPipeline(opt);
+
+    return ok ? 0 : 1;
+}
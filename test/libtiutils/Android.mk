@@ -0,0 +1,23 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Ordering and wakeup test for Ti::Utils::MessageQueue with a ping-pong
+# latency and streaming throughput comparison against the old pipe queue
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= message_queue_test.cpp
+
+LOCAL_SHARED_LIBRARIES:= \
+	libtiutils \
+	libutils \
+	libcutils \
+	liblog
+
+LOCAL_C_INCLUDES += \
+	$(HARDWARE_TI_OMAP4_BASE)/libtiutils
+
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2 -DLOG_TAG=\"message_queue_test\" $(ANDROID_API_CFLAGS)
+
+LOCAL_MODULE:= message_queue_test
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test and benchmark for Ti::Utils::MessageQueue.
+ *
+ * The check phase has several producers flood one queue past its capacity
+ * and verifies that the reader gets every message once and in per producer
+ * order, then exercises waitForMsg() on three queues and polling of the
+ * descriptor returned by getInFd().
+ *
+ * The benchmark phase bounces a message between two threads over a pair of
+ * queues (latency) and streams messages from one thread to another
+ * (throughput), both with MessageQueue and with a copy of the pipe based
+ * queue it replaced.
+ *
+ * Usage: message_queue_test [-n round trips] [-m streamed messages] [-p producers]
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <utils/Timers.h>
+
+#include "MessageQueue.h"
+
+using Ti::Utils::Message;
+using Ti::Utils::MessageQueue;
+
+enum {
+    MAX_PRODUCERS = 8,
+    CMD_DATA = 1,
+    CMD_EXIT = 2
+};
+
+struct Options {
+    int roundTrips;
+    int messages;
+    int producers;
+};
+
+/*--------------------Previous implementation-----------------------------*/
+
+class PipeQueue {
+public:
+    PipeQueue() {
+        int fds[2];
+        if ( 0 > pipe(fds) ) {
+            fds[0] = fds[1] = -1;
+        }
+        mRead = fds[0];
+        mWrite = fds[1];
+    }
+
+    ~PipeQueue() {
+        close(mRead);
+        close(mWrite);
+    }
+
+    android::status_t put(Message* msg) {
+        char* p = (char*) msg;
+        size_t bytes = 0;
+
+        while ( bytes < sizeof(*msg) ) {
+            int err = write(mWrite, p + bytes, sizeof(*msg) - bytes);
+            if ( 0 > err ) {
+                return android::UNKNOWN_ERROR;
+            }
+            bytes += err;
+        }
+
+        return android::NO_ERROR;
+    }
+
+    android::status_t get(Message* msg) {
+        char* p = (char*) msg;
+        size_t bytes = 0;
+
+        while ( bytes < sizeof(*msg) ) {
+            int err = read(mRead, p + bytes, sizeof(*msg) - bytes);
+            if ( 0 > err ) {
+                return android::UNKNOWN_ERROR;
+            }
+            bytes += err;
+        }
+
+        return android::NO_ERROR;
+    }
+
+private:
+    int mRead;
+    int mWrite;
+};
+
+/*--------------------Check-----------------------------*/
+
+struct Producer {
+    MessageQueue* queue;
+    int id;
+    int count;
+};
+
+static void* produce(void* arg) {
+    Producer* producer = static_cast<Producer*>(arg);
+    Message msg;
+
+    memset(&msg, 0, sizeof(msg));
+    for ( int i = 0; i < producer->count; i++ ) {
+        msg.command = CMD_DATA;
+        msg.arg1 = (void*) (intptr_t) producer->id;
+        msg.id = i;
+        producer->queue->put(&msg);
+    }
+
+    return NULL;
+}
+
+static bool checkOrder(const Options& opt) {
+    MessageQueue* queue = new MessageQueue;
+    Producer producers[MAX_PRODUCERS];
+    pthread_t tids[MAX_PRODUCERS];
+    int64_t next[MAX_PRODUCERS];
+    int count = MessageQueue::CAPACITY * 8;
+    bool ok = true;
+
+    for ( int i = 0; i < opt.producers; i++ ) {
+        producers[i].queue = queue;
+        producers[i].id = i;
+        producers[i].count = count;
+        next[i] = 0;
+        pthread_create(&tids[i], NULL, produce, &producers[i]);
+    }
+
+    for ( int i = 0; i < opt.producers * count; i++ ) {
+        Message msg;
+
+        queue->get(&msg);
+        int id = (int) (intptr_t) msg.arg1;
+        if ( ( CMD_DATA != msg.command ) || ( 0 > id ) || ( opt.producers <= id ) ||
+             ( next[id] != msg.id ) ) {
+            ok = false;
+            break;
+        }
+        next[id]++;
+
+        // let the queue fill up now and then so put() has to block
+        if ( 0 == ( i % ( MessageQueue::CAPACITY * 2 ) ) ) {
+            usleep(1000);
+        }
+    }
+
+    for ( int i = 0; i < opt.producers; i++ ) {
+        pthread_join(tids[i], NULL);
+    }
+
+    ok = ok && queue->isEmpty();
+    printf("order: %d producers, %d messages: %s\n",
+           opt.producers, opt.producers * count, ok ? "PASS" : "FAIL");
+
+    delete queue;
+
+    return ok;
+}
+
+struct DelayedPut {
+    MessageQueue* queue;
+    int delayMs;
+};
+
+static void* putDelayed(void* arg) {
+    DelayedPut* put = static_cast<DelayedPut*>(arg);
+    Message msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.command = CMD_DATA;
+    usleep(put->delayMs * 1000);
+    put->queue->put(&msg);
+
+    return NULL;
+}
+
+static bool checkWait() {
+    MessageQueue queues[3];
+    Message msg;
+    bool ok = true;
+
+    memset(&msg, 0, sizeof(msg));
+
+    // nothing queued, must time out
+    nsecs_t start = systemTime();
+    int ret = MessageQueue::waitForMsg(&queues[0], &queues[1], &queues[2], 50);
+    nsecs_t waited = systemTime() - start;
+    if ( ( 0 != ret ) || ( ms2ns(45) > waited ) ) {
+        printf("wait: timeout returned %d after %lld ms\n", ret, (long long) ns2ms(waited));
+        ok = false;
+    }
+
+    // a message on the third queue wakes a sleeping waiter
+    DelayedPut put = { &queues[2], 20 };
+    pthread_t tid;
+    pthread_create(&tid, NULL, putDelayed, &put);
+    ret = MessageQueue::waitForMsg(&queues[0], &queues[1], &queues[2], -1);
+    pthread_join(tid, NULL);
+    if ( ( 1 != ret ) || queues[0].hasMsg() || queues[1].hasMsg() || !queues[2].hasMsg() ) {
+        printf("wait: wakeup returned %d\n", ret);
+        ok = false;
+    }
+    queues[2].get(&msg);
+
+    // messages already queued are reported without sleeping
+    queues[0].put(&msg);
+    queues[1].put(&msg);
+    ret = MessageQueue::waitForMsg(&queues[0], &queues[1], &queues[2], -1);
+    if ( ( 2 != ret ) || !queues[0].hasMsg() || !queues[1].hasMsg() ) {
+        printf("wait: pending returned %d\n", ret);
+        ok = false;
+    }
+    queues[0].get(&msg);
+    queues[1].get(&msg);
+
+    // the exported descriptor is readable exactly while messages are queued
+    struct pollfd pfd;
+    pfd.fd = queues[0].getInFd();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if ( 0 != poll(&pfd, 1, 0) ) {
+        printf("wait: empty descriptor readable\n");
+        ok = false;
+    }
+    queues[0].put(&msg);
+    queues[0].put(&msg);
+    if ( 1 != poll(&pfd, 1, 0) ) {
+        printf("wait: descriptor not readable\n");
+        ok = false;
+    }
+    queues[0].get(&msg);
+    if ( 1 != poll(&pfd, 1, 0) ) {
+        printf("wait: descriptor cleared early\n");
+        ok = false;
+    }
+    queues[0].get(&msg);
+    if ( 0 != poll(&pfd, 1, 0) ) {
+        printf("wait: descriptor not cleared\n");
+        ok = false;
+    }
+
+    printf("wait: %s\n", ok ? "PASS" : "FAIL");
+
+    return ok;
+}
+
+/*--------------------Benchmark-----------------------------*/
+
+template <typename Queue>
+struct PingPong {
+    Queue ping;
+    Queue pong;
+    int count;
+};
+
+template <typename Queue>
+static void* echo(void* arg) {
+    PingPong<Queue>* pp = static_cast<PingPong<Queue>*>(arg);
+    Message msg;
+
+    for ( ;; ) {
+        pp->ping.get(&msg);
+        pp->pong.put(&msg);
+        if ( CMD_EXIT == msg.command ) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+template <typename Queue>
+static void* stream(void* arg) {
+    PingPong<Queue>* pp = static_cast<PingPong<Queue>*>(arg);
+    Message msg;
+
+    memset(&msg, 0, sizeof(msg));
+    for ( int i = 0; i < pp->count; i++ ) {
+        msg.command = ( i == pp->count - 1 ) ? CMD_EXIT : CMD_DATA;
+        msg.id = i;
+        pp->ping.put(&msg);
+    }
+
+    return NULL;
+}
+
+template <typename Queue>
+static bool bench(const char* name, const Options& opt) {
+    PingPong<Queue>* pp = new PingPong<Queue>;
+    pthread_t tid;
+    Message msg;
+    bool ok = true;
+
+    memset(&msg, 0, sizeof(msg));
+
+    // latency: one message in flight at a time
+    pp->count = opt.roundTrips;
+    pthread_create(&tid, NULL, echo<Queue>, pp);
+    nsecs_t start = systemTime();
+    for ( int i = 0; i < opt.roundTrips; i++ ) {
+        msg.command = ( i == opt.roundTrips - 1 ) ? CMD_EXIT : CMD_DATA;
+        msg.id = i;
+        pp->ping.put(&msg);
+        pp->pong.get(&msg);
+        ok = ok && ( i == msg.id );
+    }
+    nsecs_t roundTrip = ( systemTime() - start ) / opt.roundTrips;
+    pthread_join(tid, NULL);
+
+    // throughput: the producer runs ahead as far as the queue allows
+    pp->count = opt.messages;
+    start = systemTime();
+    pthread_create(&tid, NULL, stream<Queue>, pp);
+    for ( int i = 0; i < opt.messages; i++ ) {
+        pp->ping.get(&msg);
+        ok = ok && ( i == msg.id );
+    }
+    nsecs_t elapsed = systemTime() - start;
+    pthread_join(tid, NULL);
+
+    printf("%-6s round trip %6lld ns, stream %6.2f M messages/s: %s\n",
+           name, (long long) roundTrip, opt.messages * 1e3 / elapsed, ok ? "PASS" : "FAIL");
+
+    delete pp;
+
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Options opt = { 100000, 1000000, 4 };
+    int c;
+
+    while ( (c = getopt(argc, argv, "n:m:p:")) != -1 ) {
+        switch ( c ) {
+            case 'n': opt.roundTrips = atoi(optarg); break;
+            case 'm': opt.messages = atoi(optarg); break;
+            case 'p': opt.producers = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n round trips] [-m messages] [-p producers]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+
+    if ( ( 0 >= opt.roundTrips ) || ( 0 >= opt.messages ) ||
+         ( 0 >= opt.producers ) || ( MAX_PRODUCERS < opt.producers ) ) {
+        fprintf(stderr, "at most %d producers\n", MAX_PRODUCERS);
+        return 2;
+    }
+
+    bool ok = checkOrder(opt);
+    ok &= checkWait();
+
+    ok &= bench<PipeQueue>("pipe", opt);
+    ok &= bench<MessageQueue>("ring", opt);
+
+    return ok ? 0 : 1;
+}
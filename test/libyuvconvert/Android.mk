@@ -0,0 +1,26 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Unit test and throughput benchmark for libyuvconvert, built for the
+# target to measure the NEON kernels and for the host for SSE2/AVX2
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= yuv_convert_test.cpp
+LOCAL_STATIC_LIBRARIES:= libyuvconvert
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= yuv_convert_test
+LOCAL_MODULE_TAGS:= tests
+
+include $(BUILD_HEAPTRACKED_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= yuv_convert_test.cpp
+LOCAL_STATIC_LIBRARIES:= libyuvconvert_host
+LOCAL_CFLAGS += -Wall -fno-short-enums -O2
+
+LOCAL_MODULE:= yuv_convert_test_host
+LOCAL_MODULE_TAGS:= tests
+LOCAL_MULTILIB:= 32
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit test and throughput benchmark for libyuvconvert.
+ *
+ * Every conversion is run with every kernel available on the cpu over a
+ * set of sizes covering odd widths, SIMD tails, padded strides and cropped
+ * sources, and compared byte by byte against a naive reference. Destination
+ * buffers are prefilled so writes past the visible area are caught too.
+ *
+ * Usage: yuv_convert_test [-b <iterations>]
+ *   -b  also report the throughput of every conversion and kernel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "yuv_convert.h"
+
+enum Conversion {
+    CONV_NV12_TO_NV21,
+    CONV_NV12_TO_I420,
+    CONV_I420_TO_NV12,
+    CONV_YUYV_TO_NV12,
+    CONV_UYVY_TO_NV12,
+    CONV_NV12_TO_YUYV,
+    CONV_YUYV_TO_UYVY,
+    CONV_RGBA_TO_NV12,
+    CONV_BGRA_TO_NV12,
+    CONV_COUNT
+};
+
+static const char* sConversionNames[CONV_COUNT] = {
+    "nv12_to_nv21", "nv12_to_i420", "i420_to_nv12", "yuyv_to_nv12",
+    "uyvy_to_nv12", "nv12_to_yuyv", "yuyv_to_uyvy", "rgba_to_nv12", "bgra_to_nv12",
+};
+
+static bool isRgb(Conversion conv) {
+    return conv == CONV_RGBA_TO_NV12 || conv == CONV_BGRA_TO_NV12;
+}
+
+static bool isPacked(Conversion conv) {
+    return conv == CONV_YUYV_TO_NV12 || conv == CONV_UYVY_TO_NV12 ||
+           conv == CONV_NV12_TO_YUYV || conv == CONV_YUYV_TO_UYVY;
+}
+
+struct TestSize {
+    int width, height;
+    int cropX, cropY;     // origin of the converted area inside the source
+    int padding;          // extra bytes added to every stride
+};
+
+static const TestSize sSizes[] = {
+    {    2,    2,   0,  0,   0 },
+    {    6,    3,   0,  0,   1 },
+    {   14,    5,   2,  0,   3 },
+    {   34,    7,   0,  2,   0 },
+    {   66,    9,   4,  2,  13 },
+    {  130,   11,   0,  0,  64 },
+    {  176,  144,   8,  4,   0 },
+    {  322,  242,  16,  8,  30 },
+    {  640,  480,   0,  0, 128 },
+};
+
+/* Planes of one frame; each plane has its own stride. Packed formats
+ * (2 bytes per pixel for 4:2:2, 4 for RGB) only use plane 0, NV12 planes
+ * 0 and 1, I420 all three. */
+struct Frame {
+    uint8_t* mem;
+    size_t size;
+    uint8_t* plane[3];
+    int stride[3];
+};
+
+static uint32_t sSeed = 0x2545F491u;
+
+static uint8_t nextByte() {
+    sSeed = sSeed * 1103515245u + 12345u;
+    return (uint8_t)(sSeed >> 16);
+}
+
+// fullWidth/fullHeight include the crop margin
+static bool allocFrame(Frame& f, int packed, bool planar, int fullWidth, int fullHeight,
+                       int padding, bool random) {
+    int cw = (fullWidth + 1) / 2;
+    int ch = (fullHeight + 1) / 2;
+
+    memset(&f, 0, sizeof(f));
+    if ( packed ) {
+        f.stride[0] = fullWidth * packed + padding;
+        f.size = (size_t)f.stride[0] * fullHeight;
+    } else if ( planar ) {
+        f.stride[0] = fullWidth + padding;
+        f.stride[1] = f.stride[2] = cw + padding;
+        f.size = (size_t)f.stride[0] * fullHeight + 2 * (size_t)f.stride[1] * ch;
+    } else {
+        f.stride[0] = f.stride[1] = 2 * cw + padding;
+        f.size = (size_t)f.stride[0] * fullHeight + (size_t)f.stride[1] * ch;
+    }
+
+    f.mem = (uint8_t*)malloc(f.size);
+    if ( !f.mem ) {
+        return false;
+    }
+    for ( size_t i = 0; i < f.size; i++ ) {
+        f.mem[i] = random ? nextByte() : 0xA5;
+    }
+
+    f.plane[0] = f.mem;
+    if ( !packed ) {
+        f.plane[1] = f.mem + (size_t)f.stride[0] * fullHeight;
+        if ( planar ) {
+            f.plane[2] = f.plane[1] + (size_t)f.stride[1] * ch;
+        }
+    }
+    return true;
+}
+
+/* Plane pointers moved to the crop origin */
+static Frame cropFrame(const Frame& f, int packed, bool planar, int x, int y) {
+    Frame c = f;
+    if ( packed ) {
+        c.plane[0] += y * f.stride[0] + packed * x;
+    } else {
+        c.plane[0] += y * f.stride[0] + x;
+        if ( planar ) {
+            c.plane[1] += (y / 2) * f.stride[1] + x / 2;
+            c.plane[2] += (y / 2) * f.stride[2] + x / 2;
+        } else {
+            c.plane[1] += (y / 2) * f.stride[1] + x;
+        }
+    }
+    return c;
+}
+
+/*--------------------Reference conversions---------------------*/
+
+/* BT.601 limited range, written out in floating point */
+static uint8_t referenceComponent(double r, double g, double b, int component) {
+    static const double kCoefs[3][3] = {
+        {  65.738 / 256, 129.057 / 256,  25.064 / 256 },
+        { -37.945 / 256, -74.494 / 256, 112.439 / 256 },
+        { 112.439 / 256, -94.154 / 256, -18.285 / 256 },
+    };
+    const double* c = kCoefs[component];
+    double v = c[0] * r + c[1] * g + c[2] * b + ( component ? 128.0 : 16.0 );
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v + 0.5);
+}
+
+/* The library rounds in 8 bit fixed point, so allow it to be one off */
+static void referenceRgb(Conversion conv, const Frame& s, const Frame& d, int w, int h) {
+    int ri = conv == CONV_BGRA_TO_NV12 ? 2 : 0;
+    int bi = 2 - ri;
+
+    for ( int y = 0; y < h; y++ ) {
+        for ( int x = 0; x < w; x++ ) {
+            const uint8_t* p = s.plane[0] + y * s.stride[0] + 4 * x;
+            d.plane[0][y * d.stride[0] + x] = referenceComponent(p[ri], p[1], p[bi], 0);
+        }
+    }
+
+    for ( int y = 0; y < h; y += 2 ) {
+        for ( int x = 0; x < w; x += 2 ) {
+            double sum[3] = { 0, 0, 0 };
+            for ( int i = 0; i < 4; i++ ) {
+                int sx = x + ( i & 1 ) < w ? x + ( i & 1 ) : x;
+                int sy = y + ( i >> 1 ) < h ? y + ( i >> 1 ) : y;
+                const uint8_t* p = s.plane[0] + sy * s.stride[0] + 4 * sx;
+                for ( int c = 0; c < 3; c++ ) {
+                    sum[c] += p[c];
+                }
+            }
+            uint8_t* uv = d.plane[1] + (y / 2) * d.stride[1] + x;
+            uv[0] = referenceComponent(sum[ri] / 4, sum[1] / 4, sum[bi] / 4, 1);
+            uv[1] = referenceComponent(sum[ri] / 4, sum[1] / 4, sum[bi] / 4, 2);
+        }
+    }
+}
+
+static void referenceConvert(Conversion conv, const Frame& s, const Frame& d, int w, int h) {
+    int cw = (w + 1) / 2;
+    int ch = (h + 1) / 2;
+
+    if ( isRgb(conv) ) {
+        referenceRgb(conv, s, d, w, h);
+        return;
+    }
+
+    if ( conv == CONV_NV12_TO_NV21 || conv == CONV_NV12_TO_I420 || conv == CONV_I420_TO_NV12 ) {
+        for ( int y = 0; y < h; y++ ) {
+            memcpy(d.plane[0] + y * d.stride[0], s.plane[0] + y * s.stride[0], w);
+        }
+    }
+
+    for ( int y = 0; y < h; y++ ) {
+        for ( int x = 0; x < w; x++ ) {
+            if ( x >= cw && !isPacked(conv) ) {
+                break;
+            }
+            switch ( conv ) {
+                case CONV_NV12_TO_NV21:
+                    if ( y < ch ) {
+                        const uint8_t* uv = s.plane[1] + y * s.stride[1] + 2 * x;
+                        uint8_t* vu = d.plane[1] + y * d.stride[1] + 2 * x;
+                        vu[0] = uv[1];
+                        vu[1] = uv[0];
+                    }
+                    break;
+                case CONV_NV12_TO_I420:
+                    if ( y < ch ) {
+                        const uint8_t* uv = s.plane[1] + y * s.stride[1] + 2 * x;
+                        d.plane[1][y * d.stride[1] + x] = uv[0];
+                        d.plane[2][y * d.stride[2] + x] = uv[1];
+                    }
+                    break;
+                case CONV_I420_TO_NV12:
+                    if ( y < ch ) {
+                        uint8_t* uv = d.plane[1] + y * d.stride[1] + 2 * x;
+                        uv[0] = s.plane[1][y * s.stride[1] + x];
+                        uv[1] = s.plane[2][y * s.stride[2] + x];
+                    }
+                    break;
+                case CONV_YUYV_TO_NV12:
+                case CONV_UYVY_TO_NV12: {
+                    const uint8_t* p = s.plane[0] + y * s.stride[0] + 2 * x;
+                    int luma = conv == CONV_UYVY_TO_NV12;
+                    d.plane[0][y * d.stride[0] + x] = p[luma];
+                    if ( !(y & 1) ) {
+                        d.plane[1][(y / 2) * d.stride[1] + x] = p[1 - luma];
+                    }
+                    break;
+                }
+                case CONV_NV12_TO_YUYV: {
+                    uint8_t* p = d.plane[0] + y * d.stride[0] + 2 * x;
+                    p[0] = s.plane[0][y * s.stride[0] + x];
+                    p[1] = s.plane[1][(y / 2) * s.stride[1] + x];
+                    break;
+                }
+                case CONV_YUYV_TO_UYVY: {
+                    const uint8_t* p = s.plane[0] + y * s.stride[0] + 2 * x;
+                    uint8_t* q = d.plane[0] + y * d.stride[0] + 2 * x;
+                    q[0] = p[1];
+                    q[1] = p[0];
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+static void libraryConvert(Conversion conv, const Frame& s, const Frame& d, int w, int h) {
+    switch ( conv ) {
+        case CONV_NV12_TO_NV21:
+            yuv_nv12_to_nv21(s.plane[0], s.stride[0], s.plane[1], s.stride[1],
+                             d.plane[0], d.stride[0], d.plane[1], d.stride[1], w, h);
+            break;
+        case CONV_NV12_TO_I420:
+            yuv_nv12_to_i420(s.plane[0], s.stride[0], s.plane[1], s.stride[1],
+                             d.plane[0], d.stride[0], d.plane[1], d.stride[1],
+                             d.plane[2], d.stride[2], w, h);
+            break;
+        case CONV_I420_TO_NV12:
+            yuv_i420_to_nv12(s.plane[0], s.stride[0], s.plane[1], s.stride[1],
+                             s.plane[2], s.stride[2], d.plane[0], d.stride[0],
+                             d.plane[1], d.stride[1], w, h);
+            break;
+        case CONV_YUYV_TO_NV12:
+            yuv_yuyv_to_nv12(s.plane[0], s.stride[0], d.plane[0], d.stride[0],
+                             d.plane[1], d.stride[1], w, h);
+            break;
+        case CONV_UYVY_TO_NV12:
+            yuv_uyvy_to_nv12(s.plane[0], s.stride[0], d.plane[0], d.stride[0],
+                             d.plane[1], d.stride[1], w, h);
+            break;
+        case CONV_NV12_TO_YUYV:
+            yuv_nv12_to_yuyv(s.plane[0], s.stride[0], s.plane[1], s.stride[1],
+                             d.plane[0], d.stride[0], w, h);
+            break;
+        case CONV_YUYV_TO_UYVY:
+            yuv_swap_pairs(s.plane[0], s.stride[0], d.plane[0], d.stride[0], w, h);
+            break;
+        case CONV_RGBA_TO_NV12:
+            yuv_rgba_to_nv12(s.plane[0], s.stride[0], d.plane[0], d.stride[0],
+                             d.plane[1], d.stride[1], w, h);
+            break;
+        case CONV_BGRA_TO_NV12:
+            yuv_bgra_to_nv12(s.plane[0], s.stride[0], d.plane[0], d.stride[0],
+                             d.plane[1], d.stride[1], w, h);
+            break;
+        default:
+            break;
+    }
+}
+
+static void formatsOf(Conversion conv, int& srcPacked, bool& srcPlanar,
+                      int& dstPacked, bool& dstPlanar) {
+    srcPacked = ( conv == CONV_YUYV_TO_NV12 || conv == CONV_UYVY_TO_NV12 ||
+                  conv == CONV_YUYV_TO_UYVY ) ? 2 : isRgb(conv) ? 4 : 0;
+    dstPacked = ( conv == CONV_NV12_TO_YUYV || conv == CONV_YUYV_TO_UYVY ) ? 2 : 0;
+    srcPlanar = conv == CONV_I420_TO_NV12;
+    dstPlanar = conv == CONV_NV12_TO_I420;
+}
+
+static const yuv_kernel_t sKernels[] = {
+    YUV_KERNEL_SCALAR, YUV_KERNEL_NEON, YUV_KERNEL_SSE2, YUV_KERNEL_AVX2,
+};
+
+static int testConversion(Conversion conv, const TestSize& ts) {
+    int srcPacked, dstPacked;
+    bool srcPlanar, dstPlanar;
+    Frame src, expected, got;
+    int failures = 0;
+
+    formatsOf(conv, srcPacked, srcPlanar, dstPacked, dstPlanar);
+
+    // packed 4:2:2 formats carry two pixels per macro pixel
+    int w = isPacked(conv) ? ts.width & ~1 : ts.width;
+    int h = ts.height;
+
+    if ( !allocFrame(src, srcPacked, srcPlanar, w + ts.cropX, h + ts.cropY, ts.padding, true) ||
+         !allocFrame(expected, dstPacked, dstPlanar, w, h, ts.padding, false) ||
+         !allocFrame(got, dstPacked, dstPlanar, w, h, ts.padding, false) ) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    Frame cropped = cropFrame(src, srcPacked, srcPlanar, ts.cropX, ts.cropY);
+    referenceConvert(conv, cropped, expected, w, h);
+
+    for ( size_t k = 0; k < sizeof(sKernels) / sizeof(sKernels[0]); k++ ) {
+        if ( yuv_set_kernel(sKernels[k]) != 0 ) {
+            continue;
+        }
+        memset(got.mem, 0xA5, got.size);
+        libraryConvert(conv, cropped, got, w, h);
+
+        bool same = true;
+        if ( isRgb(conv) ) {
+            // one off from the floating point reference, and the SIMD kernels
+            // bit exact with the scalar one, whose output becomes the reference
+            for ( size_t i = 0; i < got.size && same; i++ ) {
+                same = abs(got.mem[i] - expected.mem[i]) <= 1;
+            }
+            if ( same && sKernels[k] == YUV_KERNEL_SCALAR ) {
+                memcpy(expected.mem, got.mem, got.size);
+            } else if ( same ) {
+                same = memcmp(got.mem, expected.mem, got.size) == 0;
+            }
+        } else {
+            same = memcmp(got.mem, expected.mem, got.size) == 0;
+        }
+        if ( !same ) {
+            printf("FAIL %-14s %-6s %dx%d crop %d,%d padding %d\n", sConversionNames[conv],
+                   yuv_kernel_name(sKernels[k]), w, h, ts.cropX, ts.cropY, ts.padding);
+            failures++;
+        }
+    }
+
+    free(src.mem);
+    free(expected.mem);
+    free(got.mem);
+
+    return failures;
+}
+
+static int testInPlaceSwap() {
+    const int pairs = 77;
+    uint8_t ref[2 * pairs], buf[2 * pairs];
+    int failures = 0;
+
+    for ( size_t k = 0; k < sizeof(sKernels) / sizeof(sKernels[0]); k++ ) {
+        if ( yuv_set_kernel(sKernels[k]) != 0 ) {
+            continue;
+        }
+        for ( int i = 0; i < 2 * pairs; i++ ) {
+            ref[i] = buf[i] = nextByte();
+        }
+        yuv_swap_pairs(buf, 0, buf, 0, pairs, 1);
+        for ( int i = 0; i < pairs; i++ ) {
+            if ( buf[2 * i] != ref[2 * i + 1] || buf[2 * i + 1] != ref[2 * i] ) {
+                printf("FAIL in place swap %s\n", yuv_kernel_name(sKernels[k]));
+                failures++;
+                break;
+            }
+        }
+    }
+
+    return failures;
+}
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* 1080p with a Tiler like source stride, output rate in luma megapixels/s */
+static void benchConversion(Conversion conv, int iterations) {
+    const int w = 1920, h = 1080;
+    int srcPacked, dstPacked;
+    bool srcPlanar, dstPlanar;
+    Frame src, dst;
+
+    formatsOf(conv, srcPacked, srcPlanar, dstPacked, dstPlanar);
+    if ( !allocFrame(src, srcPacked, srcPlanar, w, h, srcPacked ? 0 : 4096 - w, true) ||
+         !allocFrame(dst, dstPacked, dstPlanar, w, h, 0, false) ) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for ( size_t k = 0; k < sizeof(sKernels) / sizeof(sKernels[0]); k++ ) {
+        if ( yuv_set_kernel(sKernels[k]) != 0 ) {
+            continue;
+        }
+        libraryConvert(conv, src, dst, w, h);
+        double start = nowMs();
+        for ( int i = 0; i < iterations; i++ ) {
+            libraryConvert(conv, src, dst, w, h);
+        }
+        double ms = (nowMs() - start) / iterations;
+        printf("BENCH %-14s %-6s %8.3f ms %8.1f Mpix/s\n", sConversionNames[conv],
+               yuv_kernel_name(sKernels[k]), ms, (w * h) / (ms * 1000.0));
+    }
+
+    free(src.mem);
+    free(dst.mem);
+}
+
+int main(int argc, char** argv) {
+    int benchIterations = 0;
+    int failures = 0;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "b:")) != -1 ) {
+        switch ( opt ) {
+            case 'b': benchIterations = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-b iterations]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    printf("auto kernel: %s\n", yuv_kernel_name(yuv_get_kernel()));
+
+    for ( int c = 0; c < CONV_COUNT; c++ ) {
+        for ( size_t s = 0; s < sizeof(sSizes) / sizeof(sSizes[0]); s++ ) {
+            failures += testConversion((Conversion)c, sSizes[s]);
+        }
+    }
+    failures += testInPlaceSwap();
+
+    if ( benchIterations > 0 ) {
+        for ( int c = 0; c < CONV_COUNT; c++ ) {
+            benchConversion((Conversion)c, benchIterations);
+        }
+    }
+
+    yuv_set_kernel(YUV_KERNEL_AUTO);
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+
+    return failures ? 1 : 0;
+}
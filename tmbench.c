@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Allocation throughput of the heaptracker wrappers against the allocator
+ * underneath, with every allocation tracked and with sampling. */
+
+#define SLOTS       256
+#define ROUNDS      200000
+#define MAX_THREADS 4
+#define SAMPLE_BYTES (64 * 1024)
+
+extern void *__real_malloc(size_t size);
+extern void __real_free(void *ptr);
+extern void heaptracker_set_sample_interval(size_t interval);
+
+static void printf_log(const char *fmt, ...)
+{
+    va_list lst;
+    va_start(lst, fmt);
+    vprintf(fmt, lst);
+    va_end(lst);
+}
+
+/* Override this for non-printf reporting */
+extern void (*malloc_log)(const char *fmt, ...);
+static void ctor(void) __attribute__((constructor));
+static void ctor(void)
+{
+    malloc_log = printf_log;
+}
+
+static void *(*alloc_fn)(size_t);
+static void (*free_fn)(void *);
+
+static void *wrapped_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void wrapped_free(void *ptr)
+{
+    free(ptr);
+}
+
+/* Replaces random slots with blocks of 16 to 1024 bytes. */
+static void *worker(void *data)
+{
+    void *slot[SLOTS] = { 0 };
+    uint32_t seed = (uint32_t)(uintptr_t)data * 2654435761U + 1;
+    int i, n;
+
+    for (i = 0; i < ROUNDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        n = (seed >> 8) % SLOTS;
+        free_fn(slot[n]);
+        slot[n] = alloc_fn(16 + ((seed >> 16) & 1008));
+    }
+
+    for (n = 0; n < SLOTS; n++)
+        free_fn(slot[n]);
+    return NULL;
+}
+
+static double run(int threads)
+{
+    pthread_t thread[MAX_THREADS];
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < threads; i++)
+        pthread_create(&thread[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+    for (i = 0; i < threads; i++)
+        pthread_join(thread[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    /* Nanoseconds per malloc and free pair of one thread */
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec))
+           / ROUNDS;
+}
+
+int main(void)
+{
+    double real, tracked, sampled;
+    int threads;
+
+    printf("threads      real   tracked   sampled  (ns per malloc/free)\n");
+    for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        alloc_fn = __real_malloc;
+        free_fn = __real_free;
+        real = run(threads);
+
+        alloc_fn = wrapped_malloc;
+        free_fn = wrapped_free;
+        heaptracker_set_sample_interval(0);
+        tracked = run(threads);
+
+        heaptracker_set_sample_interval(SAMPLE_BYTES);
+        sampled = run(threads);
+
+        printf("%7d %9.0f %9.0f %9.0f  (%.1fx, %.1fx)\n", threads,
+               real, tracked, sampled, tracked / real, sampled / real);
+    }
+    heaptracker_set_sample_interval(0);
+
+    return 0;
+}